@@ -0,0 +1,64 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace chrona::bench {
+
+using BenchmarkFn = void (*)();
+
+struct Benchmark {
+  const char *name;
+  BenchmarkFn fn;
+};
+
+std::vector<Benchmark> &registry();
+
+struct Registrar {
+  Registrar(const char *name, BenchmarkFn fn) {
+    registry().push_back(Benchmark{name, fn});
+  }
+};
+
+#define CHRONA_BENCHMARK(name)                                                 \
+  static void name();                                                          \
+  static ::chrona::bench::Registrar name##_registrar(#name, &name);            \
+  static void name()
+
+class Stopwatch {
+public:
+  Stopwatch() : start_(std::chrono::steady_clock::now()) {}
+  double seconds() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start_)
+        .count();
+  }
+
+private:
+  std::chrono::steady_clock::time_point start_;
+};
+
+// Prints "<label>: <MB/s> (<bytes> in <seconds>)".
+void report_throughput(std::string_view label, std::uint64_t bytes,
+                       double seconds);
+void report_time(std::string_view label, double seconds);
+
+// Heap allocations made through operator new by this process so far.
+std::uint64_t allocation_count();
+
+// Prints "<label>: <allocations> allocations (<per unit> per <unit>)".
+void report_allocations(std::string_view label, std::uint64_t allocations,
+                        std::uint64_t units, std::string_view unit);
+
+// Deterministic pseudo-random bytes; compressible ~50% when text_like.
+std::string make_payload(std::size_t size, std::uint64_t seed,
+                         bool text_like = false);
+
+// An empty scratch directory, removed again when the process exits.
+std::filesystem::path scratch_dir(std::string_view name);
+
+} // namespace chrona::bench
@@ -0,0 +1,71 @@
+#include "bench.hpp"
+#include "bundle/bundle.hpp"
+#include "objects/object_store.hpp"
+#include <cstdio>
+#include <iostream>
+
+namespace chrona::bench {
+
+// 20000 text-like blobs of 4 KiB: writing them to a bundle, importing it
+// into an empty store on one thread and on the pool, and importing it
+// again once every object is present (what a resumed import costs).
+CHRONA_BENCHMARK(bundle_transfer) {
+  auto dir = scratch_dir("bundle");
+  std::filesystem::create_directories(dir / "source");
+  ObjectStore source(dir / "source");
+  std::vector<ObjectId> ids;
+  {
+    ObjectBatch batch(source);
+    for (std::size_t i = 0; i < 20000; ++i) {
+      ObjectId id;
+      if (auto error =
+              batch.add(ObjectType::Blob, make_payload(4096, i, true), id)) {
+        std::cerr << error->message << std::endl;
+        return;
+      }
+      ids.push_back(id);
+    }
+    if (auto error = batch.commit()) {
+      std::cerr << error->message << std::endl;
+      return;
+    }
+  }
+
+  WorkPool pool;
+  auto path = dir / "all.bundle";
+  BundleHeader header;
+  header.refs.emplace_back("refs/heads/main", ids.back());
+  BundleResult created;
+  Stopwatch timer;
+  if (auto error = create_bundle(path, source, pool, header, ids, created)) {
+    std::cerr << error->message << std::endl;
+    return;
+  }
+  report_time("create", timer.seconds());
+  std::printf("  %zu objects, %ju bytes\n", created.written,
+              static_cast<std::uintmax_t>(created.bytes));
+
+  auto import = [&](const char *label, const char *name, WorkPool &workers) {
+    std::filesystem::create_directories(dir / name);
+    ObjectStore target(dir / name);
+    BundleResult result;
+    Stopwatch import_timer;
+    if (auto error = unbundle(path, target, workers, result)) {
+      std::cerr << error->message << std::endl;
+      return;
+    }
+    report_time(label, import_timer.seconds());
+    Stopwatch again_timer;
+    if (auto error = unbundle(path, target, workers, result)) {
+      std::cerr << error->message << std::endl;
+      return;
+    }
+    report_time(std::string(label) + ", again", again_timer.seconds());
+    std::printf("  %zu present\n", result.present);
+  };
+  WorkPool single(1);
+  import("unbundle, 1 thread", "single", single);
+  import("unbundle, pool", "pooled", pool);
+}
+
+} // namespace chrona::bench
@@ -0,0 +1,97 @@
+#include "bench.hpp"
+#include "checkout/checkout.hpp"
+#include "objects/object_store.hpp"
+#include "snapshot/tree.hpp"
+#include <cstdio>
+#include <iostream>
+#include <thread>
+
+namespace chrona::bench {
+
+// A fresh checkout of 100 directories x 50 files of 8 KiB, at 1 thread and
+// at every core, followed by a switch to a tree where 1% of files changed.
+CHRONA_BENCHMARK(checkout_fresh) {
+  auto dir = scratch_dir("checkout");
+  auto objects = dir / "objects";
+  std::filesystem::create_directories(objects);
+  ObjectStore store(objects);
+
+  auto build = [&](std::size_t changed_every, ObjectId &root,
+                   std::uint64_t &bytes) -> std::optional<Error> {
+    ObjectBatch batch(store);
+    std::vector<TreeEntry> dirs;
+    bytes = 0;
+    for (std::size_t d = 0; d < 100; ++d) {
+      std::vector<TreeEntry> files;
+      for (std::size_t f = 0; f < 50; ++f) {
+        std::size_t n = d * 50 + f;
+        auto seed = changed_every != 0 && n % changed_every == 0 ? n + 1000000
+                                                                 : n;
+        auto content = make_payload(8 << 10, seed, true);
+        bytes += content.size();
+        TreeEntry entry{"file" + std::to_string(f), EntryMode::Regular, {}};
+        if (auto error = batch.add(ObjectType::Blob, content, entry.id)) {
+          return error;
+        }
+        files.push_back(std::move(entry));
+      }
+      TreeEntry entry{"dir" + std::to_string(d), EntryMode::Directory, {}};
+      if (auto error =
+              batch.add(ObjectType::Tree, encode_tree(files), entry.id)) {
+        return error;
+      }
+      dirs.push_back(std::move(entry));
+    }
+    if (auto error = batch.add(ObjectType::Tree, encode_tree(dirs), root)) {
+      return error;
+    }
+    return batch.commit();
+  };
+
+  ObjectId base;
+  ObjectId changed;
+  std::uint64_t bytes = 0;
+  std::uint64_t changed_bytes = 0;
+  if (auto error = build(0, base, bytes)) {
+    std::cerr << error->message << std::endl;
+    return;
+  }
+  if (auto error = build(100, changed, changed_bytes)) {
+    std::cerr << error->message << std::endl;
+    return;
+  }
+
+  std::vector<std::size_t> thread_counts = {1};
+  if (std::thread::hardware_concurrency() > 1) {
+    thread_counts.push_back(std::thread::hardware_concurrency());
+  }
+  for (auto threads : thread_counts) {
+    auto root = dir / ("work-" + std::to_string(threads));
+    std::filesystem::create_directories(root / ".chrona");
+    WorkPool pool(threads);
+
+    CheckoutResult result;
+    Stopwatch fresh_timer;
+    if (auto error = checkout_tree(root, store, pool, base, std::nullopt,
+                                   result)) {
+      std::cerr << error->message << std::endl;
+      return;
+    }
+    report_throughput("fresh, " + std::to_string(threads) + " thread(s)",
+                      bytes, fresh_timer.seconds());
+
+    Stopwatch switch_timer;
+    if (auto error =
+            checkout_tree(root, store, pool, changed, base, result)) {
+      std::cerr << error->message << std::endl;
+      return;
+    }
+    report_time("switch 1% changed, " + std::to_string(threads) +
+                    " thread(s)",
+                switch_timer.seconds());
+    std::printf("  (%zu written, %zu unchanged)\n", result.written,
+                result.unchanged);
+  }
+}
+
+} // namespace chrona::bench
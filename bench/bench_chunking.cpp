@@ -0,0 +1,143 @@
+#include "bench.hpp"
+#include "objects/chunker.hpp"
+#include "objects/object_store.hpp"
+#include "parallel/work_pool.hpp"
+#include <cstdio>
+#include <iostream>
+
+namespace chrona::bench {
+
+namespace {
+
+constexpr std::size_t average_size = 64 * 1024;
+
+// Bytes taken by every loose object, chunk lists included.
+std::uint64_t stored_bytes(const ObjectStore &store) {
+  std::uint64_t total = 0;
+  store.for_each_loose([&](const ObjectId &id) {
+    total += std::filesystem::file_size(store.object_path(id));
+  });
+  return total;
+}
+
+// Each version rewrites, inserts or deletes a few short runs of bytes
+// somewhere in the previous one, like an edited binary asset.
+std::vector<std::string> edited_versions(std::size_t size,
+                                         std::size_t versions) {
+  std::vector<std::string> out = {make_payload(size, 1)};
+  std::uint64_t state = 12345;
+  auto next = [&] {
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return state >> 33;
+  };
+  while (out.size() < versions) {
+    auto version = out.back();
+    for (int edit = 0; edit < 8; ++edit) {
+      auto at = next() % (version.size() - 64);
+      auto length = 1 + next() % 64;
+      switch (next() % 3) {
+      case 0:
+        version.replace(at, length, make_payload(length, next()));
+        break;
+      case 1:
+        version.insert(at, make_payload(length, next()));
+        break;
+      default:
+        version.erase(at, length);
+      }
+    }
+    out.push_back(std::move(version));
+  }
+  return out;
+}
+
+// Each version appends a few hundred lines to the previous one, like a
+// growing log file.
+std::vector<std::string> appended_versions(std::size_t size,
+                                           std::size_t versions) {
+  std::vector<std::string> out = {make_payload(size, 2, true)};
+  while (out.size() < versions) {
+    out.push_back(out.back() + make_payload(32 * 1024, out.size(), true));
+  }
+  return out;
+}
+
+void store_versions(const char *label, const std::vector<std::string> &data) {
+  std::uint64_t logical = 0;
+  for (const auto &version : data) {
+    logical += version.size();
+  }
+  std::uint64_t whole = 0;
+  for (bool chunked : {false, true}) {
+    auto dir = scratch_dir(std::string("chunking-") + label +
+                           (chunked ? "-chunked" : "-whole"));
+    ObjectStore store(dir);
+    if (chunked) {
+      store.set_chunking({1 << 20, average_size});
+    }
+    Stopwatch timer;
+    for (const auto &version : data) {
+      ObjectId id;
+      if (auto error = store.write(ObjectType::Blob, version, id)) {
+        std::cerr << error->message << std::endl;
+        return;
+      }
+    }
+    auto seconds = timer.seconds();
+    auto stored = stored_bytes(store);
+    report_throughput(std::string("  ") + label +
+                          (chunked ? " write (chunked)" : " write (whole)"),
+                      logical, seconds);
+    if (!chunked) {
+      whole = stored;
+      continue;
+    }
+    std::printf("    %zu versions, %.1f MiB logical: %.1f MiB whole, "
+                "%.1f MiB chunked, dedup ratio %.1fx\n",
+                data.size(), static_cast<double>(logical) / (1 << 20),
+                static_cast<double>(whole) / (1 << 20),
+                static_cast<double>(stored) / (1 << 20),
+                static_cast<double>(logical) / stored);
+  }
+}
+
+} // namespace
+
+// Raw chunker speed on one buffer, then on several files at once.
+CHRONA_BENCHMARK(chunking_throughput) {
+  constexpr std::size_t size = 64 << 20;
+  auto data = make_payload(size, 7);
+  std::vector<std::size_t> lengths;
+  Stopwatch timer;
+  split_chunks(data, average_size, lengths);
+  report_throughput("split_chunks (64 KiB average)", data.size(),
+                    timer.seconds());
+  std::printf("  %zu chunks, mean %zu bytes\n", lengths.size(),
+              data.size() / lengths.size());
+
+  constexpr std::size_t files = 16;
+  std::vector<std::string> inputs;
+  for (std::size_t i = 0; i < files; ++i) {
+    inputs.push_back(make_payload(8 << 20, 100 + i));
+  }
+  WorkPool pool;
+  std::vector<std::vector<std::size_t>> results(files);
+  Stopwatch parallel_timer;
+  pool.parallel_for(files, 1, [&](std::size_t begin, std::size_t end) {
+    for (auto i = begin; i < end; ++i) {
+      split_chunks(inputs[i], average_size, results[i]);
+    }
+  });
+  report_throughput("split_chunks, 16 files on " +
+                        std::to_string(pool.size()) + " threads",
+                    files * (8 << 20), parallel_timer.seconds());
+}
+
+// Space taken by successive versions of large blobs, stored whole and as
+// chunks.
+CHRONA_BENCHMARK(chunking_dedup) {
+  store_versions("asset", edited_versions(16 << 20, 12));
+  store_versions("log", appended_versions(8 << 20, 12));
+}
+
+} // namespace chrona::bench
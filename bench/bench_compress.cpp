@@ -0,0 +1,138 @@
+#include "bench.hpp"
+#include "compress/compress.hpp"
+#include "objects/object_store.hpp"
+#include <cstdio>
+#include <iostream>
+
+namespace chrona::bench {
+
+namespace {
+
+// Lines drawn from a small vocabulary, a fifth of them repeats of recent
+// lines: roughly how source trees compress.
+std::string source_corpus(std::size_t size, std::uint64_t seed) {
+  static const char *words[] = {
+      "auto",   "const",  "return", "std::string_view", "if", "for",
+      "error",  "value",  "size",   "std::optional<Error>", "id", "out",
+      "chrona", "object", "=",      "(", ")",      "{", "}", ";", "&", "->"};
+  std::uint64_t state = seed * 0x9E3779B97F4A7C15ULL + 1;
+  auto next = [&]() {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+  };
+  std::string out;
+  std::vector<std::string> recent;
+  while (out.size() < size) {
+    std::string line;
+    if (recent.size() > 16 && next() % 5 == 0) {
+      line = recent[next() % recent.size()];
+    } else {
+      line.assign(next() % 8, ' ');
+      for (auto n = 2 + next() % 8; n > 0; --n) {
+        line += words[next() % std::size(words)];
+        line += ' ';
+      }
+      line.back() = '\n';
+      recent.push_back(line);
+    }
+    out += line;
+  }
+  out.resize(size);
+  return out;
+}
+
+} // namespace
+
+// Ratio and throughput per codec and level over three 8 MiB corpora.
+CHRONA_BENCHMARK(compress_codecs) {
+  constexpr std::size_t corpus_size = 8 << 20;
+  struct Corpus {
+    const char *name;
+    std::string data;
+  };
+  Corpus corpora[] = {{"source", source_corpus(corpus_size, 1)},
+                      {"text", make_payload(corpus_size, 2, true)},
+                      {"binary", make_payload(corpus_size, 3)}};
+  struct Setting {
+    Codec codec;
+    int level;
+  };
+  const Setting settings[] = {{Codec::Fast, 1}, {Codec::Fast, 5},
+                              {Codec::Fast, 9}, {Codec::Dense, 1},
+                              {Codec::Dense, 5}, {Codec::Dense, 9}};
+
+  for (const auto &corpus : corpora) {
+    for (const auto &setting : settings) {
+      CompressionOptions options{setting.codec, setting.level};
+      Stopwatch compress_timer;
+      auto stream = compress(corpus.data, options);
+      double compress_seconds = compress_timer.seconds();
+
+      Stopwatch decompress_timer;
+      std::string out;
+      if (auto error = decompress(stream, corpus.data.size(), out)) {
+        std::cerr << error->message << std::endl;
+        return;
+      }
+      double decompress_seconds = decompress_timer.seconds();
+
+      double mb = static_cast<double>(corpus.data.size()) / (1 << 20);
+      std::printf("  %-6s %-5s level %d: ratio %.2f, compress %.0f MB/s, "
+                  "decompress %.0f MB/s\n",
+                  corpus.name, codec_name(setting.codec), setting.level,
+                  static_cast<double>(corpus.data.size()) / stream.size(),
+                  mb / compress_seconds, mb / decompress_seconds);
+    }
+  }
+}
+
+// Writing and reading back 256 source-like 32 KiB blobs through the store.
+CHRONA_BENCHMARK(compress_store) {
+  constexpr std::size_t blobs = 256;
+  std::vector<std::string> contents;
+  std::uint64_t bytes = 0;
+  for (std::size_t i = 0; i < blobs; ++i) {
+    contents.push_back(source_corpus(32 << 10, 100 + i));
+    bytes += contents.back().size();
+  }
+
+  for (auto codec : {Codec::None, Codec::Fast, Codec::Dense}) {
+    auto dir = scratch_dir(std::string("compress-store-") + codec_name(codec));
+    ObjectStore store(dir);
+    store.set_compression({codec, 0});
+
+    std::vector<ObjectId> ids(blobs);
+    Stopwatch write_timer;
+    ObjectBatch batch(store);
+    for (std::size_t i = 0; i < blobs; ++i) {
+      batch.add(ObjectType::Blob, contents[i], ids[i]);
+    }
+    if (auto error = batch.commit()) {
+      std::cerr << error->message << std::endl;
+      return;
+    }
+    report_throughput(std::string("write ") + codec_name(codec), bytes,
+                      write_timer.seconds());
+
+    std::uint64_t stored = 0;
+    for (const auto &id : ids) {
+      stored += std::filesystem::file_size(store.object_path(id));
+    }
+    Stopwatch read_timer;
+    std::uint64_t read = 0;
+    for (const auto &id : ids) {
+      ObjectView view;
+      if (!store.read(id, view)) {
+        read += view.size();
+      }
+    }
+    report_throughput(std::string("read ") + codec_name(codec), read,
+                      read_timer.seconds());
+    std::printf("  %llu bytes on disk\n",
+                static_cast<unsigned long long>(stored));
+  }
+}
+
+} // namespace chrona::bench
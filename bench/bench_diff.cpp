@@ -0,0 +1,121 @@
+#include "bench.hpp"
+#include "diff/diff.hpp"
+#include "diff/file_diff.hpp"
+#include "diff/lines.hpp"
+#include "parallel/work_pool.hpp"
+#include <cstdio>
+
+namespace chrona::bench {
+
+namespace {
+
+// A text file and a copy with `edits` scattered single-line replacements.
+void make_pair(std::size_t size, std::size_t edits, std::uint64_t seed,
+               std::string &old_text, std::string &new_text) {
+  old_text = make_payload(size, seed, true);
+  for (std::size_t i = 64; i < old_text.size(); i += 61) {
+    old_text[i] = '\n';
+  }
+  new_text = old_text;
+  for (std::size_t e = 0; e < edits; ++e) {
+    auto at = (e * 7919 + seed * 104729) % (new_text.size() - 16);
+    new_text.replace(at, 8, "CHANGED\n");
+  }
+}
+
+} // namespace
+
+CHRONA_BENCHMARK(diff_lines) {
+  std::string old_text;
+  std::string new_text;
+  make_pair(32 << 20, 1, 1, old_text, new_text);
+
+  std::vector<std::string_view> lines;
+  for (auto kernel : {LineKernel::Scalar, LineKernel::Auto}) {
+    Stopwatch timer;
+    split_lines(old_text, lines, kernel);
+    report_throughput(std::string("split_lines ") +
+                          (kernel == LineKernel::Scalar ? "scalar (memchr)"
+                                                        : line_kernel_name()),
+                      old_text.size(), timer.seconds());
+  }
+  Stopwatch hash_timer;
+  std::uint64_t sink = 0;
+  for (auto line : lines) {
+    sink ^= hash_line(line);
+  }
+  report_throughput("hash_line", old_text.size(), hash_timer.seconds());
+  std::printf("  (%zu lines, %llx)\n", lines.size(),
+              static_cast<unsigned long long>(sink));
+
+  make_pair(4 << 20, 200, 2, old_text, new_text);
+  for (auto [name, algorithm] :
+       {std::pair{"myers", DiffAlgorithm::Myers},
+        std::pair{"histogram", DiffAlgorithm::Histogram},
+        std::pair{"patience", DiffAlgorithm::Patience}}) {
+    DiffOptions options;
+    options.algorithm = algorithm;
+    Stopwatch timer;
+    auto stats = diff_text(
+        old_text, new_text, [](const DiffHunk &) { return true; }, options);
+    report_throughput(std::string("diff_text 4 MiB, 200 edits, ") + name,
+                      old_text.size() + new_text.size(), timer.seconds());
+    std::printf("  (%zu hunks, +%zu -%zu)\n", stats.hunks, stats.added,
+                stats.removed);
+  }
+
+  // Unrelated inputs: the cost cutoff keeps Myers from going quadratic
+  auto unrelated_old = make_payload(256 << 10, 3, true);
+  auto unrelated_new = make_payload(256 << 10, 4, true);
+  for (std::size_t i = 40; i < unrelated_old.size(); i += 41) {
+    unrelated_old[i] = '\n';
+    unrelated_new[i] = '\n';
+  }
+  for (std::size_t max_cost : {std::size_t(0), std::size_t(1) << 30}) {
+    DiffOptions options;
+    options.algorithm = DiffAlgorithm::Myers;
+    options.max_cost = max_cost;
+    Stopwatch timer;
+    diff_text(unrelated_old, unrelated_new,
+              [](const DiffHunk &) { return true; }, options);
+    report_time(max_cost == 0 ? "myers, unrelated 256 KiB, default cutoff"
+                              : "myers, unrelated 256 KiB, no cutoff",
+                timer.seconds());
+  }
+}
+
+CHRONA_BENCHMARK(diff_files_parallel) {
+  std::vector<std::pair<std::string, std::string>> pairs(2000);
+  for (std::size_t i = 0; i < pairs.size(); ++i) {
+    make_pair(32 << 10, 5, i + 10, pairs[i].first, pairs[i].second);
+  }
+  std::vector<FileDiffJob> jobs;
+  std::uint64_t bytes = 0;
+  for (std::size_t i = 0; i < pairs.size(); ++i) {
+    FileDiffJob job;
+    job.old_label = "a/f" + std::to_string(i);
+    job.new_label = "b/f" + std::to_string(i);
+    job.load = [&pairs, i](std::string &old_text, std::string &new_text) {
+      old_text = pairs[i].first;
+      new_text = pairs[i].second;
+      return std::optional<Error>();
+    };
+    bytes += pairs[i].first.size() + pairs[i].second.size();
+    jobs.push_back(std::move(job));
+  }
+
+  for (std::size_t threads : {std::size_t(1), std::size_t(0)}) {
+    WorkPool pool(threads);
+    std::size_t output = 0;
+    Stopwatch timer;
+    diff_files(jobs, pool, {},
+               [&](std::size_t, std::string_view text) {
+                 output += text.size();
+               });
+    report_throughput("diff_files 2000 x 32 KiB, " +
+                          std::to_string(pool.size()) + " threads",
+                      bytes, timer.seconds());
+  }
+}
+
+} // namespace chrona::bench
@@ -0,0 +1,80 @@
+#include "bench.hpp"
+#include "fsck/fsck.hpp"
+#include "objects/object_store.hpp"
+#include "pack/pack_writer.hpp"
+#include <cstdio>
+#include <iostream>
+
+namespace chrona::bench {
+
+// 40000 text-like blobs of 4 KiB in one pack and 4000 more loose: a full
+// fsck on one thread and on the pool, a 10% sample, and an incremental
+// run after the full one (which only looks at nothing new).
+CHRONA_BENCHMARK(fsck_verify) {
+  auto dir = scratch_dir("fsck");
+  auto chrona_dir = dir / ".chrona";
+  std::filesystem::create_directories(chrona_dir / "objects");
+  ObjectStore store(chrona_dir / "objects");
+  auto add = [&](std::size_t first, std::size_t count) {
+    ObjectBatch batch(store);
+    for (std::size_t i = first; i < first + count; ++i) {
+      ObjectId id;
+      if (auto error =
+              batch.add(ObjectType::Blob, make_payload(4096, i, true), id)) {
+        return error;
+      }
+    }
+    return batch.commit();
+  };
+  if (auto error = add(0, 40000)) {
+    std::cerr << error->message << std::endl;
+    return;
+  }
+  std::vector<ObjectId> ids;
+  store.for_each_loose([&](const ObjectId &id) { ids.push_back(id); });
+  PackResult packed;
+  if (auto error = write_pack(store.pack_dir(), store, ids, packed)) {
+    std::cerr << error->message << std::endl;
+    return;
+  }
+  for (const auto &id : ids) {
+    std::filesystem::remove(store.object_path(id));
+  }
+  if (auto error = store.reload_packs()) {
+    std::cerr << error->message << std::endl;
+    return;
+  }
+  if (auto error = add(40000, 4000)) {
+    std::cerr << error->message << std::endl;
+    return;
+  }
+
+  auto run = [&](const std::string &label, WorkPool &pool,
+                 const FsckOptions &options) {
+    ObjectStore fresh(chrona_dir / "objects");
+    FsckResult result;
+    Stopwatch timer;
+    if (auto error = fsck(chrona_dir, fresh, pool, result, options)) {
+      std::cerr << error->message << std::endl;
+      return;
+    }
+    auto seconds = timer.seconds();
+    report_time(label, seconds);
+    std::printf("  %zu objects, %.0f MB/s, %zu problems\n",
+                result.loose + result.packed,
+                static_cast<double>(result.bytes) / seconds / 1e6,
+                result.issues.size());
+  };
+  WorkPool single(1);
+  WorkPool pool;
+  run("full, 1 thread", single, {});
+  run("full, pool", pool, {});
+  FsckOptions sample;
+  sample.sample = 0.1;
+  run("10% sample", pool, sample);
+  FsckOptions incremental;
+  incremental.incremental = true;
+  run("incremental", pool, incremental);
+}
+
+} // namespace chrona::bench
@@ -0,0 +1,86 @@
+#include "bench.hpp"
+#include "fsmonitor/daemon.hpp"
+#include "index/index.hpp"
+#include "repo/repo.hpp"
+#include "snapshot/tree_builder.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+namespace chrona::bench {
+
+// A full status scan against a daemon query, over the same tree: idle,
+// and right after one file changed. The query should not grow with the
+// tree (CHRONA_BENCH_MONITOR_FILES, default 20000).
+CHRONA_BENCHMARK(fsmonitor_query) {
+  auto root = scratch_dir("fsmonitor");
+  const char *env = std::getenv("CHRONA_BENCH_MONITOR_FILES");
+  std::size_t files = env ? std::strtoull(env, nullptr, 10) : 20000;
+  if (auto error = init_repo(root)) {
+    std::cerr << error->message << std::endl;
+    return;
+  }
+  for (std::size_t i = 0; i < files; ++i) {
+    auto path = root / ("d" + std::to_string(i % 100)) /
+                ("s" + std::to_string(i % 7)) / ("f" + std::to_string(i));
+    if (i < 700) {
+      std::filesystem::create_directories(path.parent_path());
+    }
+    std::ofstream(path) << i;
+  }
+  auto chrona_dir = root / ".chrona";
+  ObjectStore store(chrona_dir / "objects");
+  WorkPool pool;
+  {
+    std::vector<IndexEntry> entries;
+    SnapshotOptions options;
+    options.collect = &entries;
+    SnapshotResult result;
+    build_snapshot(root, store, pool, result, options);
+    write_index(chrona_dir / "index", std::move(entries));
+  }
+
+  {
+    IndexView index;
+    IndexView::open(chrona_dir / "index", index);
+    Stopwatch timer;
+    StatusResult status;
+    compute_status(root, index, pool, status);
+    report_time("scan " + std::to_string(files) + " files",
+                timer.seconds());
+  }
+
+  std::thread daemon([&] { serve_daemon(root, chrona_dir, pool); });
+  std::vector<StatusChange> changes;
+  Stopwatch startup;
+  while (query_daemon(chrona_dir, changes)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  report_time("daemon startup (initial scan)", startup.seconds());
+
+  constexpr std::size_t queries = 200;
+  for (bool touch : {false, true}) {
+    std::vector<double> samples;
+    for (std::size_t i = 0; i < queries; ++i) {
+      if (touch) {
+        std::ofstream(root / "d0" / "s0" / "f0") << i;
+      }
+      Stopwatch timer;
+      query_daemon(chrona_dir, changes);
+      samples.push_back(timer.seconds());
+    }
+    std::sort(samples.begin(), samples.end());
+    std::printf("  query%-14s median %7.1f us, p99 %7.1f us (%zu changes)\n",
+                touch ? " after a write" : " idle",
+                samples[queries / 2] * 1e6, samples[queries * 99 / 100] * 1e6,
+                changes.size());
+  }
+
+  stop_daemon(chrona_dir);
+  daemon.join();
+}
+
+} // namespace chrona::bench
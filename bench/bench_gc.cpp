@@ -0,0 +1,97 @@
+#include "bench.hpp"
+#include "gc/gc.hpp"
+#include "history/commit.hpp"
+#include "objects/object_store.hpp"
+#include "refs/refs.hpp"
+#include "snapshot/tree.hpp"
+#include <cstdio>
+#include <iostream>
+
+namespace chrona::bench {
+
+// 2000 commits of a 20-file tree where one file changes per commit, plus
+// 5000 unreachable blobs: a full cycle, then the same cycle in 5 ms slices.
+CHRONA_BENCHMARK(gc_mark_sweep) {
+  auto dir = scratch_dir("gc");
+  auto chrona_dir = dir / ".chrona";
+  std::filesystem::create_directories(chrona_dir / "objects");
+
+  auto build = [&](ObjectStore &store) -> std::optional<Error> {
+    ObjectBatch batch(store);
+    std::vector<TreeEntry> files(20);
+    for (std::size_t i = 0; i < files.size(); ++i) {
+      files[i].name = "file" + std::to_string(i);
+      files[i].mode = EntryMode::Regular;
+    }
+    std::optional<ObjectId> tip;
+    for (std::size_t n = 0; n < 2000; ++n) {
+      auto &file = files[n % files.size()];
+      auto content = make_payload(256, n, true);
+      if (auto error = batch.add(ObjectType::Blob, content, file.id)) {
+        return error;
+      }
+      Commit commit;
+      if (auto error =
+              batch.add(ObjectType::Tree, encode_tree(files), commit.tree)) {
+        return error;
+      }
+      if (tip) {
+        commit.parents.push_back(*tip);
+      }
+      commit.author = "bench";
+      commit.message = "commit " + std::to_string(n) + "\n";
+      ObjectId id;
+      if (auto error =
+              batch.add(ObjectType::Commit, encode_commit(commit), id)) {
+        return error;
+      }
+      tip = id;
+    }
+    for (std::size_t n = 0; n < 5000; ++n) {
+      ObjectId id;
+      if (auto error = batch.add(ObjectType::Blob,
+                                 make_payload(256, 100000 + n, true), id)) {
+        return error;
+      }
+    }
+    if (auto error = batch.commit()) {
+      return error;
+    }
+    return write_ref(chrona_dir, default_branch_ref, *tip);
+  };
+
+  WorkPool pool;
+  GcOptions options;
+  options.grace_seconds = -60; // everything unreachable counts as old
+  for (std::int64_t budget : {std::int64_t(0), std::int64_t(5)}) {
+    std::filesystem::remove_all(chrona_dir / "objects");
+    std::filesystem::create_directories(chrona_dir / "objects");
+    ObjectStore store(chrona_dir / "objects");
+    if (auto error = build(store)) {
+      std::cerr << error->message << std::endl;
+      return;
+    }
+
+    options.budget_ms = budget;
+    GcResult result;
+    std::size_t runs = 0;
+    std::size_t removed = 0;
+    Stopwatch timer;
+    do {
+      if (auto error =
+              collect_garbage(chrona_dir, store, pool, result, options)) {
+        std::cerr << error->message << std::endl;
+        return;
+      }
+      ++runs;
+      removed += result.loose_removed;
+    } while (!result.complete);
+    report_time(budget == 0 ? "gc, one run"
+                            : "gc, " + std::to_string(budget) + " ms budget",
+                timer.seconds());
+    std::printf("  %zu runs, %zu marked, %zu removed\n", runs, result.marked,
+                removed);
+  }
+}
+
+} // namespace chrona::bench
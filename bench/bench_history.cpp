@@ -0,0 +1,314 @@
+#include "bench.hpp"
+#include "history/commit.hpp"
+#include "history/commit_graph.hpp"
+#include "history/history.hpp"
+#include "history/path_filter.hpp"
+#include "objects/object_store.hpp"
+#include "snapshot/tree.hpp"
+#include <cstdio>
+#include <iostream>
+
+namespace chrona::bench {
+
+namespace {
+
+constexpr std::size_t history_length = 20000;
+
+// A mainline with a two-commit topic branch merged every 25 commits.
+std::optional<Error> build_history(ObjectStore &store, ObjectId &tip,
+                                   ObjectId &root, ObjectId &topic) {
+  ObjectBatch batch(store);
+  auto tree = hash_object(ObjectType::Tree, "");
+  std::int64_t time = 1600000000;
+  auto add = [&](std::vector<ObjectId> parents, ObjectId &out) {
+    Commit commit;
+    commit.tree = tree;
+    commit.parents = std::move(parents);
+    commit.author = "bench";
+    commit.time = time++;
+    commit.message = "commit " + std::to_string(time) + "\n";
+    return batch.add(ObjectType::Commit, encode_commit(commit), out);
+  };
+
+  if (auto error = add({}, root)) {
+    return error;
+  }
+  tip = root;
+  for (std::size_t i = 1; i < history_length; ++i) {
+    ObjectId next;
+    if (i % 25 == 0) {
+      ObjectId first;
+      if (auto error = add({tip}, first)) {
+        return error;
+      }
+      if (auto error = add({first}, topic)) {
+        return error;
+      }
+      if (auto error = add({tip, topic}, next)) {
+        return error;
+      }
+    } else if (auto error = add({tip}, next)) {
+      return error;
+    }
+    tip = next;
+  }
+  return batch.commit();
+}
+
+void run_queries(const char *label, const ObjectStore &store,
+                 const CommitGraph &graph, const ObjectId &tip,
+                 const ObjectId &root, const ObjectId &topic) {
+  std::printf("%s\n", label);
+  {
+    History history(store, graph);
+    Stopwatch timer;
+    std::vector<ObjectId> log;
+    history.log({tip}, log);
+    report_time("  log (" + std::to_string(log.size()) + " commits)",
+                timer.seconds());
+  }
+  {
+    History history(store, graph);
+    Stopwatch timer;
+    bool ancestor = false;
+    history.is_ancestor(root, tip, ancestor);
+    report_time("  is_ancestor(root, tip)", timer.seconds());
+  }
+  {
+    History history(store, graph);
+    Stopwatch timer;
+    bool ancestor = true;
+    history.is_ancestor(tip, topic, ancestor);
+    report_time("  is_ancestor(tip, early commit) [false]", timer.seconds());
+  }
+  {
+    History history(store, graph);
+    Stopwatch timer;
+    std::vector<ObjectId> bases;
+    history.merge_bases(tip, topic, bases);
+    report_time("  merge_bases(tip, early commit)", timer.seconds());
+    std::printf("    (%zu commits parsed)\n", history.parsed());
+  }
+}
+
+constexpr std::size_t path_history_length = 100000;
+constexpr std::size_t path_dirs = 16;
+constexpr std::size_t files_per_dir = 16;
+
+// A linear history over 16 directories of 16 files where commit i flips
+// file i % 256 between two contents. Trees repeat every 512 commits, so
+// only the commits themselves are new objects.
+std::optional<Error> build_path_history(ObjectStore &store, ObjectId &tip) {
+  ObjectId contents[2];
+  ObjectBatch blobs(store);
+  for (int v = 0; v < 2; ++v) {
+    if (auto error = blobs.add(ObjectType::Blob,
+                               "version " + std::to_string(v) + "\n",
+                               contents[v])) {
+      return error;
+    }
+  }
+  if (auto error = blobs.commit()) {
+    return error;
+  }
+
+  std::vector<int> state(path_dirs * files_per_dir, 0);
+  std::vector<ObjectId> dir_trees(path_dirs);
+  auto write_dir = [&](ObjectBatch &batch, std::size_t d) {
+    std::vector<TreeEntry> entries;
+    for (std::size_t f = 0; f < files_per_dir; ++f) {
+      entries.push_back({"file" + std::to_string(f), EntryMode::Regular,
+                         contents[state[d * files_per_dir + f]]});
+    }
+    return batch.add(ObjectType::Tree, encode_tree(std::move(entries)),
+                     dir_trees[d]);
+  };
+  auto write_root = [&](ObjectBatch &batch, ObjectId &out) {
+    std::vector<TreeEntry> entries;
+    for (std::size_t d = 0; d < path_dirs; ++d) {
+      entries.push_back(
+          {"dir" + std::to_string(d), EntryMode::Directory, dir_trees[d]});
+    }
+    return batch.add(ObjectType::Tree, encode_tree(std::move(entries)), out);
+  };
+
+  std::optional<ObjectId> parent;
+  std::int64_t time = 1600000000;
+  for (std::size_t start = 0; start < path_history_length; start += 4096) {
+    ObjectBatch batch(store);
+    for (std::size_t i = start;
+         i < std::min(start + 4096, path_history_length); ++i) {
+      auto file = i % state.size();
+      state[file] ^= 1;
+      for (std::size_t d = 0; d < path_dirs; ++d) {
+        if (i == 0 || d == file / files_per_dir) {
+          if (auto error = write_dir(batch, d)) {
+            return error;
+          }
+        }
+      }
+      Commit commit;
+      if (auto error = write_root(batch, commit.tree)) {
+        return error;
+      }
+      if (parent) {
+        commit.parents.push_back(*parent);
+      }
+      commit.author = "bench";
+      commit.time = time++;
+      commit.message = "commit " + std::to_string(i) + "\n";
+      if (auto error =
+              batch.add(ObjectType::Commit, encode_commit(commit), tip)) {
+        return error;
+      }
+      parent = tip;
+    }
+    if (auto error = batch.commit()) {
+      return error;
+    }
+  }
+  return std::nullopt;
+}
+
+} // namespace
+
+CHRONA_BENCHMARK(history_traversal) {
+  auto dir = scratch_dir("history");
+  ObjectStore store(dir);
+  ObjectId tip;
+  ObjectId root;
+  ObjectId topic;
+  if (auto error = build_history(store, tip, root, topic)) {
+    std::cerr << error->message << std::endl;
+    return;
+  }
+
+  // The last merged topic is close to the tip; use a commit from early on
+  CommitGraph none;
+  History lookup(store, none);
+  std::vector<ObjectId> log;
+  lookup.log({tip}, log);
+  topic = log[log.size() - 40];
+
+  run_queries("without commit-graph", store, none, tip, root, topic);
+
+  Stopwatch write_timer;
+  std::size_t written = 0;
+  auto graph_path = dir / "commit-graph";
+  if (auto error = write_commit_graph(graph_path, store, {tip}, written)) {
+    std::cerr << error->message << std::endl;
+    return;
+  }
+  report_time("write_commit_graph (" + std::to_string(written) + " commits)",
+              write_timer.seconds());
+
+  CommitGraph graph;
+  if (auto error = CommitGraph::open(graph_path, graph)) {
+    std::cerr << error->message << std::endl;
+    return;
+  }
+  run_queries("with commit-graph", store, graph, tip, root, topic);
+}
+
+// Path-limited log over a 100k-commit history, with and without the
+// changed-path filters.
+CHRONA_BENCHMARK(history_path_filters) {
+  auto dir = scratch_dir("history-paths");
+  ObjectStore store(dir);
+  ObjectId tip;
+  if (auto error = build_path_history(store, tip)) {
+    std::cerr << error->message << std::endl;
+    return;
+  }
+
+  auto graph_path = dir / "commit-graph";
+  auto filters_path = dir / "commit-graph-bloom";
+  std::size_t written = 0;
+  if (auto error = write_commit_graph(graph_path, store, {tip}, written)) {
+    std::cerr << error->message << std::endl;
+    return;
+  }
+  CommitGraph graph;
+  if (auto error = CommitGraph::open(graph_path, graph)) {
+    std::cerr << error->message << std::endl;
+    return;
+  }
+
+  CommitGraph no_graph;
+  PathFilters none;
+  Stopwatch write_timer;
+  std::size_t computed = 0;
+  if (auto error = write_path_filters(filters_path, store, graph, no_graph,
+                                      none, computed)) {
+    std::cerr << error->message << std::endl;
+    return;
+  }
+  report_time("write_path_filters (" + std::to_string(computed) +
+                  " computed)",
+              write_timer.seconds());
+  std::printf("  %llu bytes for %zu commits\n",
+              static_cast<unsigned long long>(
+                  std::filesystem::file_size(filters_path)),
+              graph.size());
+
+  PathFilters filters;
+  if (auto error = PathFilters::open(filters_path, graph, filters)) {
+    std::cerr << error->message << std::endl;
+    return;
+  }
+  History history(store, graph);
+  std::vector<ObjectId> log;
+  history.log({tip}, log);
+
+  for (const char *path : {"dir3/file7", "dir9", "dir12/missing"}) {
+    for (const PathFilters *source : {&none, &filters}) {
+      std::vector<ObjectId> touching;
+      PathLogStats stats;
+      Stopwatch timer;
+      if (auto error = filter_by_path(store, graph, *source, log, path,
+                                      touching, SIZE_MAX, &stats)) {
+        std::cerr << error->message << std::endl;
+        return;
+      }
+      report_time(std::string("  log -- ") + path +
+                      (source == &none ? " (no filters)" : " (filters)"),
+                  timer.seconds());
+      std::printf("    %zu commits, %zu skipped, %zu false positives\n",
+                  touching.size(), stats.skipped, stats.false_positives);
+    }
+  }
+
+  // Rewriting after one more commit only diffs that commit
+  ObjectId next;
+  Commit commit;
+  commit.tree = graph.tree_at(*graph.find(tip));
+  commit.parents = {tip};
+  commit.author = "bench";
+  commit.time = 2000000000;
+  commit.message = "empty\n";
+  if (auto error = store.write(ObjectType::Commit, encode_commit(commit),
+                               next)) {
+    std::cerr << error->message << std::endl;
+    return;
+  }
+  if (auto error = write_commit_graph(graph_path, store, {next}, written)) {
+    std::cerr << error->message << std::endl;
+    return;
+  }
+  CommitGraph updated;
+  if (auto error = CommitGraph::open(graph_path, updated)) {
+    std::cerr << error->message << std::endl;
+    return;
+  }
+  Stopwatch update_timer;
+  if (auto error = write_path_filters(filters_path, store, updated, graph,
+                                      filters, computed)) {
+    std::cerr << error->message << std::endl;
+    return;
+  }
+  report_time("incremental write_path_filters (" + std::to_string(computed) +
+                  " computed)",
+              update_timer.seconds());
+}
+
+} // namespace chrona::bench
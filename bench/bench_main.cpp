@@ -0,0 +1,121 @@
+#include "bench.hpp"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <unistd.h>
+
+namespace {
+
+std::atomic<std::uint64_t> allocations{0};
+
+void *counted_allocate(std::size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+} // namespace
+
+// Every allocation in the benchmark binary is counted, so benchmarks can
+// report allocations per unit of work next to their timings
+void *operator new(std::size_t size) { return counted_allocate(size); }
+void *operator new[](std::size_t size) { return counted_allocate(size); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+
+namespace chrona::bench {
+
+namespace {
+
+std::vector<std::filesystem::path> &scratch_dirs() {
+  static std::vector<std::filesystem::path> dirs;
+  return dirs;
+}
+
+} // namespace
+
+std::vector<Benchmark> &registry() {
+  static std::vector<Benchmark> benchmarks;
+  return benchmarks;
+}
+
+void report_throughput(std::string_view label, std::uint64_t bytes,
+                       double seconds) {
+  double mb = static_cast<double>(bytes) / (1024.0 * 1024.0);
+  std::printf("  %-40.*s %10.1f MB/s  (%.1f MB in %.3f s)\n",
+              static_cast<int>(label.size()), label.data(), mb / seconds, mb,
+              seconds);
+}
+
+void report_time(std::string_view label, double seconds) {
+  std::printf("  %-40.*s %10.3f ms\n", static_cast<int>(label.size()),
+              label.data(), seconds * 1000.0);
+}
+
+std::uint64_t allocation_count() {
+  return allocations.load(std::memory_order_relaxed);
+}
+
+void report_allocations(std::string_view label, std::uint64_t count,
+                        std::uint64_t units, std::string_view unit) {
+  std::printf("  %-40.*s %10llu allocs  (%.3f per %.*s)\n",
+              static_cast<int>(label.size()), label.data(),
+              static_cast<unsigned long long>(count),
+              units == 0 ? 0.0
+                         : static_cast<double>(count) /
+                               static_cast<double>(units),
+              static_cast<int>(unit.size()), unit.data());
+}
+
+std::string make_payload(std::size_t size, std::uint64_t seed,
+                         bool text_like) {
+  static constexpr char words[] = "the quick brown fox jumps over lazy dog\n";
+  std::string out(size, '\0');
+  std::uint64_t state = seed * 0x9E3779B97F4A7C15ULL + 1;
+  for (std::size_t i = 0; i < size; ++i) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    out[i] = text_like ? words[state % (sizeof(words) - 1)]
+                       : static_cast<char>(state);
+  }
+  return out;
+}
+
+std::filesystem::path scratch_dir(std::string_view name) {
+  auto path = std::filesystem::temp_directory_path() /
+              ("chrona-bench-" + std::string(name) + "-" +
+               std::to_string(::getpid()));
+  std::filesystem::remove_all(path);
+  std::filesystem::create_directories(path);
+  scratch_dirs().push_back(path);
+  return path;
+}
+
+} // namespace chrona::bench
+
+int main(int argc, char *argv[]) {
+  // Optional substring filter: chrona_microbench object_store
+  std::string_view filter = (argc > 1) ? argv[1] : "";
+
+  for (const auto &benchmark : chrona::bench::registry()) {
+    if (std::string_view(benchmark.name).find(filter) ==
+        std::string_view::npos) {
+      continue;
+    }
+    std::cout << benchmark.name << std::endl;
+    benchmark.fn();
+  }
+
+  for (const auto &dir : chrona::bench::scratch_dirs()) {
+    std::error_code ec;
+    std::filesystem::remove_all(dir, ec);
+  }
+  return 0;
+}
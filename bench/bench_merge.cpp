@@ -0,0 +1,128 @@
+#include "bench.hpp"
+#include "merge/merge.hpp"
+#include "objects/object_store.hpp"
+#include "parallel/work_pool.hpp"
+#include "snapshot/tree.hpp"
+#include <cstdio>
+#include <functional>
+#include <iostream>
+
+namespace chrona::bench {
+
+namespace {
+
+constexpr std::size_t dir_count = 1000;
+constexpr std::size_t files_per_dir = 100;
+
+enum class Edit { None, Top, Bottom, OtherTop };
+
+// 64 distinct files of 200 lines, reused across the tree so the store
+// holds few blobs; an edit rewrites the first or last line.
+std::string file_text(std::size_t n, Edit edit) {
+  std::string out;
+  for (std::size_t line = 0; line < 200; ++line) {
+    if (line == 0 && edit == Edit::Top) {
+      out += "changed on our side\n";
+    } else if (line == 0 && edit == Edit::OtherTop) {
+      out += "changed on their side\n";
+    } else if (line == 199 && edit == Edit::Bottom) {
+      out += "changed at the end\n";
+    } else {
+      out += "line " + std::to_string(line) + " of file " +
+             std::to_string(n % 64) + "\n";
+    }
+  }
+  return out;
+}
+
+std::optional<Error> build_tree(ObjectStore &store,
+                                const std::function<Edit(std::size_t)> &edit,
+                                ObjectId &root) {
+  ObjectBatch batch(store);
+  std::vector<TreeEntry> dirs;
+  for (std::size_t d = 0; d < dir_count; ++d) {
+    std::vector<TreeEntry> files;
+    for (std::size_t f = 0; f < files_per_dir; ++f) {
+      auto n = d * files_per_dir + f;
+      TreeEntry entry{"file" + std::to_string(f), EntryMode::Regular, {}};
+      if (auto error =
+              batch.add(ObjectType::Blob, file_text(n, edit(n)), entry.id)) {
+        return error;
+      }
+      files.push_back(std::move(entry));
+    }
+    TreeEntry entry{"dir" + std::to_string(d), EntryMode::Directory, {}};
+    if (auto error =
+            batch.add(ObjectType::Tree, encode_tree(files), entry.id)) {
+      return error;
+    }
+    dirs.push_back(std::move(entry));
+  }
+  if (auto error = batch.add(ObjectType::Tree, encode_tree(dirs), root)) {
+    return error;
+  }
+  return batch.commit();
+}
+
+} // namespace
+
+// Merges over a tree of 1000 directories x 100 files: a handful of files
+// changed on both sides (merged cleanly by line) among a few one-sided
+// edits, then 2000 files both sides changed the same line of.
+CHRONA_BENCHMARK(merge_large_trees) {
+  auto dir = scratch_dir("merge");
+  ObjectStore store(dir);
+  WorkPool pool;
+
+  struct Scenario {
+    const char *label;
+    std::function<Edit(std::size_t)> ours;
+    std::function<Edit(std::size_t)> theirs;
+  };
+  const Scenario scenarios[] = {
+      {"few conflicts",
+       [](std::size_t n) { return n % 5000 == 0 ? Edit::Top : Edit::None; },
+       [](std::size_t n) {
+         if (n % 5000 == 0) {
+           return Edit::Bottom;
+         }
+         return n % 7000 == 3 ? Edit::Top : Edit::None;
+       }},
+      {"many conflicts",
+       [](std::size_t n) { return n % 50 == 0 ? Edit::Top : Edit::None; },
+       [](std::size_t n) {
+         return n % 50 == 0 ? Edit::OtherTop : Edit::None;
+       }},
+  };
+
+  ObjectId base;
+  if (auto error =
+          build_tree(store, [](std::size_t) { return Edit::None; }, base)) {
+    std::cerr << error->message << std::endl;
+    return;
+  }
+  for (const auto &scenario : scenarios) {
+    ObjectId ours;
+    ObjectId theirs;
+    if (auto error = build_tree(store, scenario.ours, ours)) {
+      std::cerr << error->message << std::endl;
+      return;
+    }
+    if (auto error = build_tree(store, scenario.theirs, theirs)) {
+      std::cerr << error->message << std::endl;
+      return;
+    }
+    MergeResult result;
+    Stopwatch timer;
+    if (auto error = merge_trees(store, pool, &base, ours, theirs, result)) {
+      std::cerr << error->message << std::endl;
+      return;
+    }
+    report_time(scenario.label, timer.seconds());
+    std::printf("  %zu trees read, %zu files merged by line, %zu conflicts\n",
+                result.stats.trees_read, result.stats.files_merged,
+                result.conflicts.size());
+  }
+}
+
+} // namespace chrona::bench
@@ -0,0 +1,133 @@
+#include "bench.hpp"
+#include "objects/object_cache.hpp"
+#include "objects/object_store.hpp"
+#include <atomic>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace chrona::bench {
+
+namespace {
+
+// The obvious alternative: one map behind one mutex.
+class LockedCache {
+public:
+  bool get(const ObjectId &id, ObjectView &out) {
+    std::lock_guard lock(mutex_);
+    auto it = map_.find(id);
+    if (it == map_.end()) {
+      return false;
+    }
+    out = it->second;
+    return true;
+  }
+  void put(const ObjectId &id, const ObjectView &view) {
+    std::lock_guard lock(mutex_);
+    map_.emplace(id, view);
+  }
+
+private:
+  std::mutex mutex_;
+  std::unordered_map<ObjectId, ObjectView, ObjectIdHash> map_;
+};
+
+// Runs `threads` workers that each read `reads` ids, stepping through the
+// working set from a different start, and returns reads per second.
+template <typename Read>
+double run_readers(std::size_t threads, std::size_t reads,
+                   const std::vector<ObjectId> &ids, Read read) {
+  std::atomic<bool> go{false};
+  std::atomic<std::uint64_t> failures{0};
+  std::vector<std::thread> workers;
+  for (std::size_t t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t] {
+      while (!go.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+      }
+      auto at = t * 7919;
+      for (std::size_t n = 0; n < reads; ++n) {
+        if (!read(ids[(at + n * 31) % ids.size()])) {
+          failures.fetch_add(1, std::memory_order_relaxed);
+        }
+      }
+    });
+  }
+  Stopwatch timer;
+  go.store(true, std::memory_order_release);
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  double seconds = timer.seconds();
+  if (failures > 0) {
+    std::cerr << failures << " reads failed" << std::endl;
+  }
+  return static_cast<double>(threads * reads) / seconds;
+}
+
+} // namespace
+
+// 1 to 64 threads reading a hot set of 4096 trees and commits: through
+// the store with its object cache, through a single-mutex map, and
+// straight from the loose files.
+CHRONA_BENCHMARK(object_cache_contention) {
+  constexpr std::size_t hot_objects = 4096;
+  constexpr std::size_t total_reads = 1 << 20;
+  auto dir = scratch_dir("object-cache");
+  ObjectStore store(dir);
+  std::vector<ObjectId> ids(hot_objects);
+  {
+    ObjectBatch batch(store);
+    for (std::size_t i = 0; i < hot_objects; ++i) {
+      auto type = i % 2 ? ObjectType::Commit : ObjectType::Tree;
+      if (auto error = batch.add(type, make_payload(200 + i % 400, i, true),
+                                 ids[i])) {
+        std::cerr << error->message << std::endl;
+        return;
+      }
+    }
+    if (auto error = batch.commit()) {
+      std::cerr << error->message << std::endl;
+      return;
+    }
+  }
+  LockedCache locked;
+  for (const auto &id : ids) {
+    ObjectView view;
+    if (!store.read(id, view)) {
+      locked.put(id, view);
+    }
+  }
+
+  for (std::size_t threads = 1; threads <= 64; threads *= 2) {
+    auto reads = total_reads / threads;
+    auto &cache = store.object_cache();
+    auto hits = cache.hits();
+    auto misses = cache.misses();
+    double sharded = run_readers(threads, reads, ids, [&](const ObjectId &id) {
+      ObjectView view;
+      return !store.read(id, view);
+    });
+    hits = cache.hits() - hits;
+    misses = cache.misses() - misses;
+    double mutex = run_readers(threads, reads, ids, [&](const ObjectId &id) {
+      ObjectView view;
+      return locked.get(id, view);
+    });
+    double uncached =
+        run_readers(threads, reads / 16, ids, [&](const ObjectId &id) {
+          ObjectView view;
+          return !store.read_loose(id, view);
+        });
+    std::printf("  %2zu threads: cache %.2f M reads/s (hit rate %.1f%%), "
+                "single mutex %.2f M/s, uncached %.2f M/s\n",
+                threads, sharded / 1e6,
+                100.0 * static_cast<double>(hits) /
+                    static_cast<double>(hits + misses),
+                mutex / 1e6, uncached / 1e6);
+  }
+}
+
+} // namespace chrona::bench
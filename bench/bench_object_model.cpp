@@ -0,0 +1,101 @@
+#include "bench.hpp"
+#include "history/commit.hpp"
+#include "memory/arena.hpp"
+#include "snapshot/tree.hpp"
+#include <cstdio>
+
+namespace chrona::bench {
+
+// 2000 trees of 64 entries, parsed into owning vectors and into arena
+// views that are reset per tree, as a checkout or diff walk would.
+CHRONA_BENCHMARK(object_model_trees) {
+  std::vector<std::string> trees;
+  std::uint64_t entries = 0;
+  std::uint64_t bytes = 0;
+  for (std::size_t t = 0; t < 2000; ++t) {
+    std::vector<TreeEntry> list;
+    for (std::size_t i = 0; i < 64; ++i) {
+      list.push_back(TreeEntry{"source_file_" + std::to_string(i) + ".cpp",
+                               EntryMode::Regular,
+                               hash_object(ObjectType::Blob,
+                                           std::to_string(t * 64 + i))});
+    }
+    trees.push_back(encode_tree(std::move(list)));
+    entries += 64;
+    bytes += trees.back().size();
+  }
+
+  std::uint64_t checksum = 0;
+  auto before = allocation_count();
+  Stopwatch owning_timer;
+  for (const auto &tree : trees) {
+    std::vector<TreeEntry> out;
+    decode_tree(tree, out);
+    checksum += out.size();
+  }
+  report_throughput("decode_tree (owning)", bytes, owning_timer.seconds());
+  report_allocations("decode_tree (owning)", allocation_count() - before,
+                     entries, "entry");
+
+  Arena arena;
+  before = allocation_count();
+  Stopwatch view_timer;
+  for (const auto &tree : trees) {
+    arena.reset();
+    TreeView view;
+    parse_tree(tree, arena, view);
+    checksum += view.entries.size();
+  }
+  report_throughput("parse_tree (arena views)", bytes, view_timer.seconds());
+  report_allocations("parse_tree (arena views)", allocation_count() - before,
+                     entries, "entry");
+  std::printf("  (%llu entries parsed)\n",
+              static_cast<unsigned long long>(checksum));
+}
+
+CHRONA_BENCHMARK(object_model_commits) {
+  std::vector<std::string> commits;
+  for (std::size_t n = 0; n < 20000; ++n) {
+    Commit commit;
+    commit.tree = hash_object(ObjectType::Tree, std::to_string(n));
+    commit.parents.push_back(
+        hash_object(ObjectType::Commit, std::to_string(n)));
+    if (n % 10 == 0) {
+      commit.parents.push_back(
+          hash_object(ObjectType::Commit, std::to_string(n + 1)));
+    }
+    commit.author = "Bench Author";
+    commit.time = 1700000000 + static_cast<std::int64_t>(n);
+    commit.message = "Commit number " + std::to_string(n) +
+                     "\n\nA longer body that would not fit in SSO.\n";
+    commits.push_back(encode_commit(commit));
+  }
+
+  std::size_t parents = 0;
+  auto before = allocation_count();
+  Stopwatch owning_timer;
+  for (const auto &content : commits) {
+    Commit commit;
+    decode_commit(content, commit);
+    parents += commit.parents.size();
+  }
+  report_time("decode_commit (owning)", owning_timer.seconds());
+  report_allocations("decode_commit (owning)", allocation_count() - before,
+                     commits.size(), "commit");
+
+  Arena arena;
+  before = allocation_count();
+  Stopwatch view_timer;
+  for (const auto &content : commits) {
+    arena.reset();
+    CommitView commit;
+    parse_commit(content, arena, commit);
+    parents += commit.parents.size();
+  }
+  report_time("parse_commit (arena views)", view_timer.seconds());
+  report_allocations("parse_commit (arena views)",
+                     allocation_count() - before, commits.size(), "commit");
+  std::printf("  (%zu parents seen)\n", parents);
+}
+
+} // namespace chrona::bench
@@ -0,0 +1,146 @@
+#include "bench.hpp"
+#include "hash/sha256.hpp"
+#include "objects/batch_read.hpp"
+#include "objects/object_store.hpp"
+#include "pack/pack_writer.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+namespace chrona::bench {
+
+namespace {
+
+void put_get(const char *label, std::size_t object_size, std::size_t count) {
+  auto dir = scratch_dir(std::string("objects-") + label);
+  ObjectStore store(dir);
+
+  std::vector<std::string> payloads;
+  payloads.reserve(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    payloads.push_back(make_payload(object_size, i));
+  }
+  std::uint64_t total = static_cast<std::uint64_t>(object_size) * count;
+
+  std::vector<ObjectId> ids(count);
+  Stopwatch put_timer;
+  ObjectBatch batch(store);
+  for (std::size_t i = 0; i < count; ++i) {
+    if (auto error = batch.add(ObjectType::Blob, payloads[i], ids[i])) {
+      std::cerr << error->message << std::endl;
+      return;
+    }
+  }
+  if (auto error = batch.commit()) {
+    std::cerr << error->message << std::endl;
+    return;
+  }
+  report_throughput(std::string("put ") + label, total, put_timer.seconds());
+
+  Stopwatch get_timer;
+  std::uint64_t checksum = 0;
+  for (const auto &id : ids) {
+    ObjectView view;
+    if (auto error = store.read(id, view)) {
+      std::cerr << error->message << std::endl;
+      return;
+    }
+    // Touch every page so the mapping cost is actually paid
+    auto content = view.content();
+    for (std::size_t i = 0; i < content.size(); i += 4096) {
+      checksum += static_cast<unsigned char>(content[i]);
+    }
+  }
+  report_throughput(std::string("get ") + label, total, get_timer.seconds());
+  std::printf("  (checksum %llu)\n", static_cast<unsigned long long>(checksum));
+}
+
+} // namespace
+
+CHRONA_BENCHMARK(object_store_hash) {
+  auto data = make_payload(64 << 20, 1);
+  for (auto kernel : {Sha256Kernel::Scalar, Sha256Kernel::Auto}) {
+    Stopwatch timer;
+    Sha256 hasher(kernel);
+    hasher.update(data);
+    hasher.finish();
+    report_throughput(kernel == Sha256Kernel::Scalar
+                          ? "sha256 scalar"
+                          : std::string("sha256 ") + sha256_kernel_name(),
+                      data.size(), timer.seconds());
+  }
+
+  auto dir = scratch_dir("hash-file");
+  auto path = dir / "large.bin";
+  std::ofstream(path, std::ios::binary) << data;
+  Stopwatch timer;
+  ObjectId id;
+  hash_file(path, id);
+  report_throughput("hash_file (streamed, 256 KiB chunks)", data.size(),
+                    timer.seconds());
+}
+
+CHRONA_BENCHMARK(object_store_put_get) {
+  put_get("4 KiB x 16384", 4096, 16384);
+  put_get("1 MiB x 64", 1 << 20, 64);
+}
+
+// 20k blobs requested in random order, half packed and half loose: one
+// store.read() per id against read_batch(), which reads packed entries in
+// offset order with read-ahead and spreads the loose ones over the pool.
+CHRONA_BENCHMARK(object_store_batch_read) {
+  auto dir = scratch_dir("objects-batch");
+  ObjectStore store(dir);
+  constexpr std::size_t count = 20000;
+  std::vector<ObjectId> ids(count);
+  std::vector<ObjectId> packed;
+  ObjectBatch batch(store);
+  for (std::size_t i = 0; i < count; ++i) {
+    batch.add(ObjectType::Blob, make_payload(2048, i, true), ids[i]);
+    if (i % 2 == 0) {
+      packed.push_back(ids[i]);
+    }
+  }
+  PackResult result;
+  if (auto error = batch.commit()) {
+    std::cerr << error->message << std::endl;
+    return;
+  }
+  if (auto error = write_pack(store.pack_dir(), store, packed, result)) {
+    std::cerr << error->message << std::endl;
+    return;
+  }
+  for (const auto &id : packed) {
+    std::filesystem::remove(store.object_path(id));
+  }
+  store.reload_packs();
+
+  std::uint64_t state = 42;
+  for (std::size_t i = count - 1; i > 0; --i) {
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    std::swap(ids[i], ids[(state >> 33) % (i + 1)]);
+  }
+
+  Stopwatch single_timer;
+  std::uint64_t bytes = 0;
+  for (const auto &id : ids) {
+    ObjectView view;
+    if (!store.read(id, view)) {
+      bytes += view.size();
+    }
+  }
+  report_throughput("one read per id", bytes, single_timer.seconds());
+
+  WorkPool pool;
+  Stopwatch batch_timer;
+  std::vector<BatchRead> out;
+  read_batch(store, ids, out, &pool);
+  bytes = 0;
+  for (const auto &read : out) {
+    bytes += read.error ? 0 : read.view.size();
+  }
+  report_throughput("read_batch", bytes, batch_timer.seconds());
+}
+
+} // namespace chrona::bench
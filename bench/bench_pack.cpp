@@ -0,0 +1,83 @@
+#include "bench.hpp"
+#include "objects/object_store.hpp"
+#include "pack/pack.hpp"
+#include "pack/pack_writer.hpp"
+#include "snapshot/tree.hpp"
+#include <cstdio>
+#include <iostream>
+
+namespace chrona::bench {
+
+// 200 files with 10 small edits each: the shape delta compression is for.
+CHRONA_BENCHMARK(pack_history) {
+  auto dir = scratch_dir("pack-history");
+  ObjectStore store(dir);
+
+  std::vector<ObjectId> ids;
+  std::uint64_t loose_bytes = 0;
+  ObjectBatch batch(store);
+  for (std::size_t file = 0; file < 200; ++file) {
+    auto content = make_payload(16 << 10, file, true);
+    for (std::size_t version = 0; version < 10; ++version) {
+      auto edit = (version * 1031 + file * 7) % content.size();
+      content.replace(edit, 8, "edited!!");
+      ObjectId blob;
+      ObjectId tree;
+      batch.add(ObjectType::Blob, content, blob);
+      batch.add(ObjectType::Tree,
+                encode_tree({TreeEntry{"file" + std::to_string(file),
+                                       EntryMode::Regular, blob}}),
+                tree);
+      ids.push_back(blob);
+      ids.push_back(tree);
+      loose_bytes += content.size();
+    }
+  }
+  if (auto error = batch.commit()) {
+    std::cerr << error->message << std::endl;
+    return;
+  }
+
+  Stopwatch pack_timer;
+  PackResult result;
+  if (auto error = write_pack(store.pack_dir(), store, ids, result)) {
+    std::cerr << error->message << std::endl;
+    return;
+  }
+  report_throughput("write_pack", loose_bytes, pack_timer.seconds());
+  std::printf("  %zu objects, %zu deltas, %llu loose blob bytes -> %llu "
+              "pack bytes\n",
+              result.objects, result.deltas,
+              static_cast<unsigned long long>(loose_bytes),
+              static_cast<unsigned long long>(result.bytes));
+
+  for (const auto &id : ids) {
+    std::filesystem::remove(store.object_path(id));
+  }
+  store.reload_packs();
+
+  Stopwatch lookup_timer;
+  std::size_t found = 0;
+  for (int round = 0; round < 100; ++round) {
+    for (const auto &id : ids) {
+      found += store.packs()->front()->find(id).has_value();
+    }
+  }
+  report_time("100 x " + std::to_string(ids.size()) + " fanout lookups",
+              lookup_timer.seconds());
+
+  for (int pass = 0; pass < 2; ++pass) {
+    Stopwatch read_timer;
+    for (const auto &id : ids) {
+      ObjectView view;
+      store.read(id, view);
+    }
+    report_throughput(pass == 0 ? "read all (cold base cache)"
+                                : "read all (warm base cache)",
+                      loose_bytes, read_timer.seconds());
+  }
+  std::printf("  (found %zu, base cache %zu hits / %zu misses)\n", found,
+              store.delta_cache().hits(), store.delta_cache().misses());
+}
+
+} // namespace chrona::bench
@@ -0,0 +1,158 @@
+#include "bench.hpp"
+#include "gc/gc.hpp"
+#include "history/commit.hpp"
+#include "objects/object_store.hpp"
+#include "pack/bitmap.hpp"
+#include "pack/pack.hpp"
+#include "pack/pack_writer.hpp"
+#include "refs/refs.hpp"
+#include "snapshot/tree.hpp"
+#include <cstdio>
+#include <iostream>
+
+namespace chrona::bench {
+
+// 3000 commits over 20 directories of 50 files, 3 files changed per
+// commit, all in one pack: reachability from the tip by walking and from
+// bitmaps, the objects a mirror at commit 2500 is missing, and a gc mark
+// with and without the bitmaps.
+CHRONA_BENCHMARK(reachability_bitmaps) {
+  auto dir = scratch_dir("reachability");
+  auto chrona_dir = dir / ".chrona";
+  std::filesystem::create_directories(chrona_dir / "objects");
+  ObjectStore store(chrona_dir / "objects");
+
+  constexpr std::size_t dirs = 20;
+  constexpr std::size_t files_per_dir = 50;
+  std::vector<ObjectId> history;
+  {
+    ObjectBatch batch(store);
+    std::vector<std::vector<TreeEntry>> files(dirs);
+    std::vector<TreeEntry> root(dirs);
+    auto fail = [](const Error &error) {
+      std::cerr << error.message << std::endl;
+    };
+    for (std::size_t d = 0; d < dirs; ++d) {
+      for (std::size_t f = 0; f < files_per_dir; ++f) {
+        TreeEntry entry{"file" + std::to_string(f), EntryMode::Regular, {}};
+        auto content = make_payload(512, d * files_per_dir + f, true);
+        if (auto error = batch.add(ObjectType::Blob, content, entry.id)) {
+          return fail(*error);
+        }
+        files[d].push_back(std::move(entry));
+      }
+      root[d] = TreeEntry{"dir" + std::to_string(d), EntryMode::Directory,
+                          {}};
+      if (auto error = batch.add(ObjectType::Tree, encode_tree(files[d]),
+                                 root[d].id)) {
+        return fail(*error);
+      }
+    }
+    for (std::size_t n = 0; n < 3000; ++n) {
+      for (std::size_t k = 0; k < 3; ++k) {
+        auto d = (n * 7 + k * 13) % dirs;
+        auto &file = files[d][(n * 11 + k) % files_per_dir];
+        auto content = make_payload(512, 1000000 + n * 3 + k, true);
+        if (auto error = batch.add(ObjectType::Blob, content, file.id)) {
+          return fail(*error);
+        }
+        if (auto error = batch.add(ObjectType::Tree, encode_tree(files[d]),
+                                   root[d].id)) {
+          return fail(*error);
+        }
+      }
+      Commit commit;
+      if (auto error =
+              batch.add(ObjectType::Tree, encode_tree(root), commit.tree)) {
+        return fail(*error);
+      }
+      if (!history.empty()) {
+        commit.parents.push_back(history.back());
+      }
+      commit.author = "bench";
+      commit.time = static_cast<std::int64_t>(n);
+      commit.message = "commit " + std::to_string(n) + "\n";
+      ObjectId id;
+      if (auto error =
+              batch.add(ObjectType::Commit, encode_commit(commit), id)) {
+        return fail(*error);
+      }
+      history.push_back(id);
+    }
+    if (auto error = batch.commit()) {
+      return fail(*error);
+    }
+  }
+  if (auto error = write_ref(chrona_dir, default_branch_ref, history.back())) {
+    std::cerr << error->message << std::endl;
+    return;
+  }
+
+  std::vector<ObjectId> ids;
+  store.for_each_loose([&](const ObjectId &id) { ids.push_back(id); });
+  PackResult packed;
+  if (auto error = write_pack(store.pack_dir(), store, ids, packed)) {
+    std::cerr << error->message << std::endl;
+    return;
+  }
+  store.for_each_loose([&](const ObjectId &id) {
+    std::filesystem::remove(store.object_path(id));
+  });
+  if (auto error = store.reload_packs()) {
+    std::cerr << error->message << std::endl;
+    return;
+  }
+
+  auto measure = [&](const char *label) {
+    Reachability reachability(store);
+    Stopwatch timer;
+    ObjectSet set;
+    if (auto error = reachability.reachable({history.back()}, set)) {
+      std::cerr << error->message << std::endl;
+      return;
+    }
+    report_time(std::string(label) + ", reachable from tip", timer.seconds());
+    std::printf("  %zu objects\n", reachability.count(set));
+
+    Stopwatch missing_timer;
+    std::vector<ObjectId> missing;
+    if (auto error = reachability.missing({history.back()}, {history[2500]},
+                                          missing)) {
+      std::cerr << error->message << std::endl;
+      return;
+    }
+    report_time(std::string(label) + ", missing since commit 2500",
+                missing_timer.seconds());
+    std::printf("  %zu objects\n", missing.size());
+
+    WorkPool pool;
+    GcResult result;
+    Stopwatch gc_timer;
+    if (auto error = collect_garbage(chrona_dir, store, pool, result)) {
+      std::cerr << error->message << std::endl;
+      return;
+    }
+    report_time(std::string(label) + ", gc", gc_timer.seconds());
+    std::printf("  %zu marked\n", result.marked);
+  };
+
+  measure("walk");
+  std::shared_ptr<PackFile> pack = store.packs()->front();
+  Stopwatch timer;
+  std::size_t written = 0;
+  if (auto error =
+          write_pack_bitmaps(store, *pack, {history.back()}, written)) {
+    std::cerr << error->message << std::endl;
+    return;
+  }
+  report_time("write bitmaps", timer.seconds());
+  auto bitmap_path = pack->path();
+  bitmap_path.replace_extension(".bitmap");
+  std::printf("  %zu bitmaps, %ju bytes (pack: %ju bytes)\n", written,
+              static_cast<std::uintmax_t>(
+                  std::filesystem::file_size(bitmap_path)),
+              static_cast<std::uintmax_t>(packed.bytes));
+  measure("bitmaps");
+}
+
+} // namespace chrona::bench
@@ -0,0 +1,210 @@
+#include "bench.hpp"
+#include "refs/packed_refs.hpp"
+#include "refs/refs.hpp"
+#include "refs/transaction.hpp"
+#include "repo/repo.hpp"
+#include <atomic>
+#include <cstdio>
+#include <iostream>
+#include <thread>
+
+namespace chrona::bench {
+
+namespace {
+
+ObjectId next_id(const ObjectId &id) {
+  return hash_object(ObjectType::Commit, id.hex());
+}
+
+struct WriterStats {
+  std::atomic<std::uint64_t> committed{0};
+  std::atomic<std::uint64_t> conflicts{0};
+  std::atomic<std::uint64_t> lock_timeouts{0};
+  std::atomic<std::uint64_t> errors{0};
+};
+
+// `threads` writers each commit `per_thread` transactions. Every
+// transaction moves the writer's own branch and, when `shared_refs` is not
+// zero, one of that many refs every writer competes for, both with
+// compare-and-swap; a lost race re-reads and retries.
+double run_writers(const std::filesystem::path &chrona_dir,
+                   std::size_t threads, std::size_t per_thread,
+                   std::size_t shared_refs, WriterStats &stats) {
+  std::atomic<bool> go{false};
+  std::vector<std::thread> workers;
+  for (std::size_t t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t] {
+      while (!go.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+      }
+      auto own = "refs/heads/writer-" + std::to_string(t);
+      for (std::size_t done = 0; done < per_thread;) {
+        std::vector<std::string> names{own};
+        if (shared_refs != 0) {
+          names.push_back("refs/heads/shared-" +
+                          std::to_string((t + done) % shared_refs));
+        }
+        RefTransaction transaction(chrona_dir);
+        for (const auto &name : names) {
+          std::optional<ObjectId> current;
+          if (read_ref(chrona_dir, name, current) || !current) {
+            stats.errors.fetch_add(1);
+            return;
+          }
+          transaction.update(name, next_id(*current), current);
+        }
+        auto error = transaction.commit();
+        if (!error) {
+          stats.committed.fetch_add(1, std::memory_order_relaxed);
+          ++done;
+        } else if (error->error_code == ErrorCode::Conflict) {
+          stats.conflicts.fetch_add(1, std::memory_order_relaxed);
+        } else if (error->error_code == ErrorCode::Locked) {
+          stats.lock_timeouts.fetch_add(1, std::memory_order_relaxed);
+        } else {
+          std::cerr << error->message << std::endl;
+          stats.errors.fetch_add(1);
+          return;
+        }
+      }
+    });
+  }
+  Stopwatch timer;
+  go.store(true, std::memory_order_release);
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  return timer.seconds();
+}
+
+} // namespace
+
+// 10k branches read one by one and listed, first as loose files, then
+// after pack_refs() has folded them into packed-refs.
+CHRONA_BENCHMARK(refs_lookup) {
+  constexpr std::size_t ref_count = 10000;
+  auto dir = scratch_dir("refs-lookup");
+  if (auto error = init_repo(dir)) {
+    std::cerr << error->message << std::endl;
+    return;
+  }
+  auto chrona_dir = dir / ".chrona";
+  std::vector<std::string> names;
+  {
+    RefTransaction transaction(chrona_dir);
+    for (std::size_t i = 0; i < ref_count; ++i) {
+      names.push_back("refs/heads/team-" + std::to_string(i % 50) +
+                      "/branch-" + std::to_string(i));
+      transaction.create(names.back(),
+                         hash_object(ObjectType::Commit, names.back()));
+    }
+    Stopwatch timer;
+    if (auto error = transaction.commit()) {
+      std::cerr << error->message << std::endl;
+      return;
+    }
+    report_time("create 10k refs in one transaction", timer.seconds());
+  }
+
+  auto measure = [&](const char *layout) {
+    Stopwatch read_timer;
+    std::size_t found = 0;
+    for (const auto &name : names) {
+      std::optional<ObjectId> id;
+      if (!read_ref(chrona_dir, name, id) && id) {
+        ++found;
+      }
+    }
+    double read = read_timer.seconds();
+    Stopwatch list_timer;
+    std::vector<std::pair<std::string, ObjectId>> refs;
+    if (auto error = list_refs(chrona_dir, refs)) {
+      std::cerr << error->message << std::endl;
+      return;
+    }
+    double list = list_timer.seconds();
+    if (found != ref_count || refs.size() != ref_count) {
+      std::cerr << "missing refs" << std::endl;
+    }
+    std::printf("  %-8s read_ref %.2f us/ref, list_refs %.2f ms\n", layout,
+                read * 1e6 / ref_count, list * 1e3);
+  };
+  measure("loose");
+  std::size_t packed = 0;
+  Stopwatch pack_timer;
+  if (auto error = pack_refs(chrona_dir, packed)) {
+    std::cerr << error->message << std::endl;
+    return;
+  }
+  report_time("pack_refs", pack_timer.seconds());
+  measure("packed");
+}
+
+// 1 to 16 concurrent writers: each moving only its own branch, then each
+// transaction also moving one of 4 shared refs, then all of them fighting
+// over one. Checks afterwards that no committed update was lost.
+CHRONA_BENCHMARK(refs_concurrent_writers) {
+  constexpr std::size_t per_thread = 100;
+  struct Scenario {
+    const char *label;
+    std::size_t shared_refs;
+  };
+  const Scenario scenarios[] = {
+      {"disjoint", 0}, {"4 shared", 4}, {"1 shared", 1}};
+
+  for (const auto &scenario : scenarios) {
+    for (std::size_t threads = 1; threads <= 16; threads *= 2) {
+      auto dir = scratch_dir("refs-writers");
+      if (auto error = init_repo(dir)) {
+        std::cerr << error->message << std::endl;
+        return;
+      }
+      auto chrona_dir = dir / ".chrona";
+      auto start = hash_object(ObjectType::Commit, "start");
+      RefTransaction setup(chrona_dir);
+      for (std::size_t t = 0; t < threads; ++t) {
+        setup.create("refs/heads/writer-" + std::to_string(t), start);
+      }
+      for (std::size_t s = 0; s < scenario.shared_refs; ++s) {
+        setup.create("refs/heads/shared-" + std::to_string(s), start);
+      }
+      if (auto error = setup.commit()) {
+        std::cerr << error->message << std::endl;
+        return;
+      }
+
+      WriterStats stats;
+      double seconds =
+          run_writers(chrona_dir, threads, per_thread, scenario.shared_refs,
+                      stats);
+
+      // Every ref must have advanced exactly once per commit touching it
+      std::size_t steps = 0;
+      std::vector<std::pair<std::string, ObjectId>> refs;
+      if (auto error = list_refs(chrona_dir, refs)) {
+        std::cerr << error->message << std::endl;
+        return;
+      }
+      for (const auto &[name, id] : refs) {
+        auto at = start;
+        std::size_t n = 0;
+        for (; at != id && n <= threads * per_thread; ++n) {
+          at = next_id(at);
+        }
+        steps += n;
+      }
+      auto expected =
+          stats.committed * (scenario.shared_refs == 0 ? 1 : 2);
+      std::printf("  %-8s %2zu writers: %7.0f commits/s, %llu conflicts, "
+                  "%llu lock timeouts%s\n",
+                  scenario.label, threads,
+                  static_cast<double>(stats.committed) / seconds,
+                  static_cast<unsigned long long>(stats.conflicts),
+                  static_cast<unsigned long long>(stats.lock_timeouts),
+                  steps == expected && stats.errors == 0 ? ""
+                                                         : " (LOST UPDATES)");
+    }
+  }
+}
+
+} // namespace chrona::bench
@@ -0,0 +1,96 @@
+#include "bench.hpp"
+#include "objects/object_store.hpp"
+#include "refs/refs.hpp"
+#include "repo/repo.hpp"
+#include "repo/repository.hpp"
+#include <cstdio>
+#include <iostream>
+
+namespace chrona::bench {
+
+// Startup to first object: find the repository from 16 directories down,
+// resolve HEAD and read the commit it names. "per-call" opens everything
+// afresh each time, the way commands did before the repository context;
+// "context" discovers once per iteration; "warm" reuses one context.
+CHRONA_BENCHMARK(repo_first_object) {
+  auto dir = scratch_dir("repository");
+  if (auto error = init_repo(dir)) {
+    std::cerr << error->message << std::endl;
+    return;
+  }
+  auto start = dir;
+  for (int i = 0; i < 16; ++i) {
+    start /= "level" + std::to_string(i);
+  }
+  std::filesystem::create_directories(start);
+  {
+    ObjectStore store(dir / ".chrona" / "objects");
+    ObjectId commit;
+    if (auto error = store.write(ObjectType::Commit, "tree x\n", commit)) {
+      std::cerr << error->message << std::endl;
+      return;
+    }
+    write_ref(dir / ".chrona", default_branch_ref, commit);
+  }
+
+  constexpr std::size_t iterations = 2000;
+  std::size_t bytes = 0;
+
+  Stopwatch per_call_timer;
+  for (std::size_t i = 0; i < iterations; ++i) {
+    // The old discovery: a std::filesystem::exists per level
+    auto current = start;
+    while (!std::filesystem::exists(current / ".chrona")) {
+      current = current.parent_path();
+    }
+    auto chrona_dir = current / ".chrona";
+    ObjectId id;
+    ObjectView view;
+    ObjectStore store(chrona_dir / "objects");
+    if (resolve_revision(chrona_dir, "HEAD", id) || store.read(id, view)) {
+      return;
+    }
+    bytes += view.content().size();
+  }
+  double per_call = per_call_timer.seconds();
+
+  Stopwatch context_timer;
+  for (std::size_t i = 0; i < iterations; ++i) {
+    Repository repo;
+    ObjectId id;
+    ObjectView view;
+    if (Repository::discover(start, repo) || repo.resolve("HEAD", id) ||
+        repo.objects().read(id, view)) {
+      return;
+    }
+    bytes += view.content().size();
+  }
+  double context = context_timer.seconds();
+
+  Repository repo;
+  if (Repository::discover(start, repo)) {
+    return;
+  }
+  Stopwatch warm_timer;
+  for (std::size_t i = 0; i < iterations; ++i) {
+    ObjectId id;
+    ObjectView view;
+    if (repo.resolve("HEAD", id) || repo.objects().read(id, view)) {
+      return;
+    }
+    bytes += view.content().size();
+  }
+  double warm = warm_timer.seconds();
+
+  for (auto [label, seconds] : {std::pair{"per-call", per_call},
+                                std::pair{"context", context},
+                                std::pair{"warm", warm}}) {
+    std::printf("  %-9s %8.2f us to first object\n", label,
+                seconds * 1e6 / iterations);
+  }
+  if (bytes == 0) {
+    std::printf("  (no objects read)\n");
+  }
+}
+
+} // namespace chrona::bench
@@ -0,0 +1,96 @@
+#include "bench.hpp"
+#include "objects/object_store.hpp"
+#include "snapshot/tree_builder.hpp"
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <unistd.h>
+
+namespace chrona::bench {
+
+namespace {
+
+constexpr int top_dirs = 16;
+constexpr int sub_dirs = 8;
+constexpr int files_per_dir = 64; // 8192 files in total
+
+std::uint64_t generate_tree(const std::filesystem::path &root) {
+  std::uint64_t bytes = 0;
+  std::uint64_t seed = 0;
+  for (int a = 0; a < top_dirs; ++a) {
+    for (int b = 0; b < sub_dirs; ++b) {
+      auto dir = root / ("d" + std::to_string(a)) / ("s" + std::to_string(b));
+      std::filesystem::create_directories(dir);
+      for (int f = 0; f < files_per_dir; ++f) {
+        // Mostly small source-like files with the occasional larger one
+        std::size_t size = (f % 16 == 0) ? 128 * 1024 : 4096 + (f * 97) % 8192;
+        std::ofstream(dir / ("f" + std::to_string(f) + ".txt"),
+                      std::ios::binary)
+            << make_payload(size, ++seed, true);
+        bytes += size;
+      }
+    }
+  }
+  return bytes;
+}
+
+// Drops the tree's clean pages from the page cache without needing root
+void evict_page_cache(const std::filesystem::path &root) {
+  for (const auto &entry :
+       std::filesystem::recursive_directory_iterator(root)) {
+    if (!entry.is_regular_file()) {
+      continue;
+    }
+    int fd = ::open(entry.path().c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+      ::fdatasync(fd);
+      ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+      ::close(fd);
+    }
+  }
+}
+
+} // namespace
+
+CHRONA_BENCHMARK(snapshot_scaling) {
+  auto dir = scratch_dir("snapshot");
+  auto work = dir / "work";
+  auto bytes = generate_tree(work);
+
+  std::vector<std::size_t> thread_counts;
+  std::size_t hardware = std::max(1u, std::thread::hardware_concurrency());
+  for (std::size_t n = 1; n < hardware; n *= 2) {
+    thread_counts.push_back(n);
+  }
+  thread_counts.push_back(hardware);
+
+  for (auto threads : thread_counts) {
+    WorkPool pool(threads);
+    auto objects = dir / ("objects-" + std::to_string(threads));
+    std::filesystem::create_directories(objects);
+    ObjectStore store(objects);
+
+    // Cold: nothing cached, every blob and tree is new
+    evict_page_cache(work);
+    Stopwatch cold_timer;
+    SnapshotResult result;
+    if (auto error = build_snapshot(work, store, pool, result)) {
+      std::cerr << error->message << std::endl;
+      return;
+    }
+    report_throughput("cold, " + std::to_string(threads) + " threads", bytes,
+                      cold_timer.seconds());
+
+    // Warm: page cache hot and every object already stored
+    Stopwatch warm_timer;
+    if (auto error = build_snapshot(work, store, pool, result)) {
+      std::cerr << error->message << std::endl;
+      return;
+    }
+    report_throughput("warm, " + std::to_string(threads) + " threads", bytes,
+                      warm_timer.seconds());
+  }
+}
+
+} // namespace chrona::bench
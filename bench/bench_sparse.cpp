@@ -0,0 +1,113 @@
+#include "bench.hpp"
+#include "checkout/checkout.hpp"
+#include "objects/object_store.hpp"
+#include "snapshot/tree.hpp"
+#include "sparse/sparse.hpp"
+#include "status/status.hpp"
+#include <cstdio>
+#include <iostream>
+
+namespace chrona::bench {
+
+// 200 directories x 100 files of 1 KiB, checked out in full and with a
+// cone of 4 directories (2%): a fresh checkout, a switch to a tree where
+// 1% of files changed everywhere, and a status. The sparse costs should
+// follow the cone, not the tree.
+CHRONA_BENCHMARK(sparse_cone) {
+  auto dir = scratch_dir("sparse");
+  auto objects = dir / "objects";
+  std::filesystem::create_directories(objects);
+  ObjectStore store(objects);
+
+  auto build = [&](std::size_t changed_every,
+                   ObjectId &root) -> std::optional<Error> {
+    ObjectBatch batch(store);
+    std::vector<TreeEntry> dirs;
+    for (std::size_t d = 0; d < 200; ++d) {
+      std::vector<TreeEntry> files;
+      for (std::size_t f = 0; f < 100; ++f) {
+        std::size_t n = d * 100 + f;
+        auto seed = changed_every != 0 && n % changed_every == 0 ? n + 1000000
+                                                                 : n;
+        TreeEntry entry{"file" + std::to_string(f), EntryMode::Regular, {}};
+        if (auto error = batch.add(ObjectType::Blob,
+                                   make_payload(1024, seed, true), entry.id)) {
+          return error;
+        }
+        files.push_back(std::move(entry));
+      }
+      TreeEntry entry{"dir" + std::to_string(d), EntryMode::Directory, {}};
+      if (auto error =
+              batch.add(ObjectType::Tree, encode_tree(files), entry.id)) {
+        return error;
+      }
+      dirs.push_back(std::move(entry));
+    }
+    if (auto error = batch.add(ObjectType::Tree, encode_tree(dirs), root)) {
+      return error;
+    }
+    return batch.commit();
+  };
+  ObjectId base;
+  ObjectId changed;
+  if (auto error = build(0, base)) {
+    std::cerr << error->message << std::endl;
+    return;
+  }
+  if (auto error = build(100, changed)) {
+    std::cerr << error->message << std::endl;
+    return;
+  }
+
+  SparseCone cone;
+  if (auto error =
+          SparseCone::parse({"dir0", "dir1", "dir2", "dir3"}, cone)) {
+    std::cerr << error->message << std::endl;
+    return;
+  }
+  WorkPool pool;
+  for (bool sparse : {false, true}) {
+    std::string label = sparse ? "sparse" : "full";
+    auto root = dir / ("work-" + label);
+    std::filesystem::create_directories(root / ".chrona");
+    CheckoutOptions options;
+    options.cone = sparse ? cone : SparseCone();
+
+    CheckoutResult result;
+    Stopwatch fresh_timer;
+    if (auto error = checkout_tree(root, store, pool, base, std::nullopt,
+                                   result, options)) {
+      std::cerr << error->message << std::endl;
+      return;
+    }
+    report_time("fresh checkout, " + label, fresh_timer.seconds());
+    std::printf("  (%zu written)\n", result.written);
+
+    Stopwatch switch_timer;
+    if (auto error = checkout_tree(root, store, pool, changed, base, result,
+                                   options)) {
+      std::cerr << error->message << std::endl;
+      return;
+    }
+    report_time("switch 1% changed, " + label, switch_timer.seconds());
+    std::printf("  (%zu written, %zu unchanged)\n", result.written,
+                result.unchanged);
+
+    Stopwatch status_timer;
+    IndexView index;
+    StatusResult status;
+    if (auto error = IndexView::open(root / ".chrona" / "index", index)) {
+      std::cerr << error->message << std::endl;
+      return;
+    }
+    if (auto error = compute_status(root, index, pool, status)) {
+      std::cerr << error->message << std::endl;
+      return;
+    }
+    report_time("status, " + label, status_timer.seconds());
+    std::printf("  (%zu entries checked, %zu changes)\n", status.checked,
+                status.changes.size());
+  }
+}
+
+} // namespace chrona::bench
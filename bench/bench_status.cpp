@@ -0,0 +1,119 @@
+#include "bench.hpp"
+#include "index/index.hpp"
+#include "snapshot/tree_builder.hpp"
+#include "status/status.hpp"
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+namespace chrona::bench {
+
+namespace {
+
+std::size_t env_size(const char *name, std::size_t fallback) {
+  const char *value = std::getenv(name);
+  return value ? std::strtoull(value, nullptr, 10) : fallback;
+}
+
+} // namespace
+
+// Index load + lookup cost without touching the filesystem, at the scale of
+// a large monorepo.
+CHRONA_BENCHMARK(status_index_lookup) {
+  auto dir = scratch_dir("index-lookup");
+  std::size_t count = env_size("CHRONA_BENCH_INDEX_ENTRIES", 1000000);
+
+  std::vector<IndexEntry> entries;
+  entries.reserve(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    IndexEntry entry;
+    entry.path = "dir" + std::to_string(i % 1000) + "/sub" +
+                 std::to_string(i % 37) + "/file" + std::to_string(i) + ".cpp";
+    entry.stat.size = i;
+    entries.push_back(std::move(entry));
+  }
+  auto paths = entries;
+
+  Stopwatch write_timer;
+  write_index(dir / "index", std::move(entries));
+  report_time("write " + std::to_string(count) + "-entry index",
+              write_timer.seconds());
+
+  Stopwatch open_timer;
+  IndexView index;
+  IndexView::open(dir / "index", index);
+  report_time("open (mmap, no parsing)", open_timer.seconds());
+
+  Stopwatch find_timer;
+  std::size_t hits = 0;
+  for (const auto &entry : paths) {
+    hits += index.find(entry.path).has_value() ? 1 : 0;
+  }
+  report_time("find() every entry (" + std::to_string(hits) + " hits)",
+              find_timer.seconds());
+}
+
+// No-op status over a real tree: every file is stat()ed, none is rehashed.
+CHRONA_BENCHMARK(status_noop) {
+  auto dir = scratch_dir("status");
+  auto work = dir / "work";
+  std::size_t files = env_size("CHRONA_BENCH_STATUS_FILES", 50000);
+  for (std::size_t i = 0; i < files; ++i) {
+    auto path = work / ("d" + std::to_string(i % 100)) /
+                ("s" + std::to_string(i % 7)) / ("f" + std::to_string(i));
+    if (i < 700) {
+      std::filesystem::create_directories(path.parent_path());
+    }
+    std::ofstream(path) << i;
+  }
+
+  auto objects = dir / "objects";
+  std::filesystem::create_directories(objects);
+  ObjectStore store(objects);
+  {
+    WorkPool pool;
+    std::vector<IndexEntry> entries;
+    SnapshotOptions options;
+    options.collect = &entries;
+    SnapshotResult result;
+    build_snapshot(work, store, pool, result, options);
+    write_index(dir / "index", std::move(entries));
+  }
+  // Let the racy window pass so the stat cache is trusted
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  {
+    // Refresh once, as chrona status would
+    IndexView index;
+    IndexView::open(dir / "index", index);
+    WorkPool pool;
+    StatusResult status;
+    compute_status(work, index, pool, status);
+    if (!status.refreshed.empty()) {
+      write_index(dir / "index", index.entries());
+    }
+  }
+
+  std::size_t hardware = std::max(1u, std::thread::hardware_concurrency());
+  for (std::size_t threads = 1;; threads = std::min(threads * 2, hardware)) {
+    WorkPool pool(threads);
+    IndexView index;
+    IndexView::open(dir / "index", index);
+
+    for (bool untracked : {false, true}) {
+      Stopwatch timer;
+      StatusResult status;
+      compute_status(work, index, pool, status, {untracked, 1024});
+      report_time(std::to_string(files) + " files, " +
+                      std::to_string(threads) + " threads" +
+                      (untracked ? ", +untracked" : "") + " (" +
+                      std::to_string(status.rehashed) + " rehashed)",
+                  timer.seconds());
+    }
+    if (threads == hardware) {
+      break;
+    }
+  }
+}
+
+} // namespace chrona::bench
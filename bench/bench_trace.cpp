@@ -0,0 +1,34 @@
+#include "bench.hpp"
+#include "trace/trace.hpp"
+#include <cstdio>
+
+namespace chrona::bench {
+
+// Cost per probe with tracing off (what production builds pay) and on.
+CHRONA_BENCHMARK(trace_overhead) {
+  constexpr std::size_t probes = 10000000;
+  for (bool on : {false, true}) {
+    discard_trace();
+    if (on) {
+      start_trace("1");
+    }
+    Stopwatch count_timer;
+    for (std::size_t i = 0; i < probes; ++i) {
+      trace_count(TraceCounter::StatCalls);
+    }
+    double count_seconds = count_timer.seconds();
+
+    Stopwatch scope_timer;
+    for (std::size_t i = 0; i < probes / 10; ++i) {
+      CHRONA_TRACE_SCOPE("bench");
+    }
+    double scope_seconds = scope_timer.seconds();
+    std::printf("  tracing %-3s  counter %6.2f ns/probe, scope %6.2f "
+                "ns/probe\n",
+                on ? "on" : "off", count_seconds * 1e9 / probes,
+                scope_seconds * 1e9 / (probes / 10));
+  }
+  discard_trace();
+}
+
+} // namespace chrona::bench
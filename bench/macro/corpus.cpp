@@ -0,0 +1,487 @@
+#include "corpus.hpp"
+#include "checkout/checkout.hpp"
+#include "history/commit.hpp"
+#include "objects/object_store.hpp"
+#include "refs/refs.hpp"
+#include "refs/transaction.hpp"
+#include "repo/repo.hpp"
+#include "repo/repository.hpp"
+#include "snapshot/tree.hpp"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <set>
+#include <unordered_map>
+
+namespace chrona::bench {
+
+namespace {
+
+// splitmix64: tiny, fast, and the same everywhere
+class Rng {
+public:
+  explicit Rng(std::uint64_t seed) : state_(seed) {}
+
+  std::uint64_t next() {
+    std::uint64_t z = (state_ += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+  }
+  std::size_t below(std::size_t n) { return n == 0 ? 0 : next() % n; }
+  double unit() {
+    return static_cast<double>(next() >> 11) * (1.0 / 9007199254740992.0);
+  }
+
+private:
+  std::uint64_t state_;
+};
+
+std::uint64_t mix(std::uint64_t seed, std::uint64_t value) {
+  return Rng(seed ^ (value * 0xD1B54A32D192ED03ULL)).next();
+}
+
+constexpr const char *identifiers[] = {
+    "count", "buffer", "offset", "result", "index",  "length", "cursor",
+    "state", "parent", "weight", "flags",  "handle", "limit",  "total"};
+
+void append_line(Rng &rng, std::string &out) {
+  auto pick = [&] { return identifiers[rng.below(std::size(identifiers))]; };
+  switch (rng.below(4)) {
+  case 0:
+    out += "  ";
+    out += pick();
+    out += " = ";
+    out += pick();
+    out += " + " + std::to_string(rng.below(1000)) + ";\n";
+    break;
+  case 1:
+    out += "  if (";
+    out += pick();
+    out += " > ";
+    out += pick();
+    out += ") {\n";
+    break;
+  case 2:
+    out += "  }\n";
+    break;
+  default:
+    out += "  // ";
+    out += pick();
+    out += " of the ";
+    out += pick();
+    out += " " + std::to_string(rng.below(100000)) + "\n";
+    break;
+  }
+}
+
+std::string make_text(Rng &rng, std::size_t size) {
+  std::string out;
+  out.reserve(size + 64);
+  while (out.size() < size) {
+    append_line(rng, out);
+  }
+  return out;
+}
+
+// Replaces a few lines somewhere in the file, or appends some
+std::string edit_text(Rng &rng, const std::string &text) {
+  std::size_t added = 1 + rng.below(4);
+  std::string out;
+  if (rng.below(5) == 0) {
+    out = text;
+    for (std::size_t i = 0; i < added; ++i) {
+      append_line(rng, out);
+    }
+    return out;
+  }
+  std::vector<std::size_t> starts{0};
+  for (std::size_t i = 0; i + 1 < text.size(); ++i) {
+    if (text[i] == '\n') {
+      starts.push_back(i + 1);
+    }
+  }
+  auto first = rng.below(starts.size());
+  auto last = std::min(starts.size(), first + 1 + rng.below(4));
+  auto end = last < starts.size() ? starts[last] : text.size();
+  out.append(text, 0, starts[first]);
+  for (std::size_t i = 0; i < added; ++i) {
+    append_line(rng, out);
+  }
+  out.append(text, end);
+  return out;
+}
+
+struct FileState {
+  std::shared_ptr<const std::string> content;
+  bool executable = false;
+};
+using BranchState = std::map<std::string, FileState>;
+
+class Generator {
+public:
+  explicit Generator(const CorpusOptions &options)
+      : options_(options), rng_(options.seed) {}
+
+  Corpus run();
+
+private:
+  std::string path_of(std::size_t file) const;
+  FileState new_file(std::size_t file) const;
+  void commit(const std::string &branch, std::vector<std::size_t> parents,
+              std::string message, std::vector<CorpusChange> changes);
+  std::vector<CorpusChange> random_changes(BranchState &state);
+
+  const CorpusOptions &options_;
+  Rng rng_;
+  Corpus corpus_;
+  std::size_t next_file_ = 0;
+};
+
+std::string Generator::path_of(std::size_t file) const {
+  Rng rng(mix(options_.seed, file));
+  std::string path;
+  auto levels = rng.below(options_.depth + 1);
+  for (std::size_t level = 0; level < levels; ++level) {
+    path += "dir" + std::to_string(rng.below(options_.fanout)) + "/";
+  }
+  return path + "file" + std::to_string(file) +
+         (rng.below(3) == 0 ? ".txt" : ".c");
+}
+
+FileState Generator::new_file(std::size_t file) const {
+  Rng rng(mix(options_.seed ^ 0xF11E, file));
+  // Log-normal: most files near the median, a long tail of large ones
+  double u1 = std::max(rng.unit(), 1e-12);
+  double u2 = rng.unit();
+  double normal = std::sqrt(-2.0 * std::log(u1)) * std::cos(6.283185307 * u2);
+  auto size = static_cast<std::size_t>(
+      static_cast<double>(options_.median_size) * std::exp(normal));
+  size = std::clamp<std::size_t>(size, 1, options_.max_size);
+  return FileState{std::make_shared<const std::string>(make_text(rng, size)),
+                   rng.below(20) == 0};
+}
+
+void Generator::commit(const std::string &branch,
+                       std::vector<std::size_t> parents, std::string message,
+                       std::vector<CorpusChange> changes) {
+  std::sort(changes.begin(), changes.end(),
+            [](const CorpusChange &a, const CorpusChange &b) {
+              return a.path < b.path;
+            });
+  auto position = corpus_.commits.size();
+  corpus_.commits.push_back(CorpusCommit{
+      branch, std::move(parents),
+      1700000000 + static_cast<std::int64_t>(position) * 60,
+      std::move(message), std::move(changes)});
+}
+
+std::vector<CorpusChange> Generator::random_changes(BranchState &state) {
+  std::vector<CorpusChange> changes;
+  std::set<std::string> touched;
+  for (std::size_t n = 0; n < options_.changes_per_commit; ++n) {
+    auto roll = rng_.below(20);
+    if (roll == 0 || state.empty()) {
+      auto file = next_file_++;
+      auto path = path_of(file);
+      auto added = new_file(file);
+      state[path] = added;
+      touched.insert(path);
+      changes.push_back(CorpusChange{path, added.content, added.executable});
+      continue;
+    }
+    // Existing files, picked by position in the sorted map
+    auto it = state.begin();
+    std::advance(it, static_cast<std::ptrdiff_t>(rng_.below(state.size())));
+    if (!touched.insert(it->first).second) {
+      continue;
+    }
+    if (roll == 1 && state.size() > 1) {
+      changes.push_back(CorpusChange{it->first, nullptr, false});
+      state.erase(it);
+      continue;
+    }
+    it->second.content = std::make_shared<const std::string>(
+        edit_text(rng_, *it->second.content));
+    changes.push_back(CorpusChange{it->first, it->second.content,
+                                   it->second.executable});
+  }
+  return changes;
+}
+
+Corpus Generator::run() {
+  corpus_.options = options_;
+  BranchState main;
+  std::vector<CorpusChange> initial;
+  for (; next_file_ < options_.files; ++next_file_) {
+    auto path = path_of(next_file_);
+    auto file = new_file(next_file_);
+    initial.push_back(CorpusChange{path, file.content, file.executable});
+    main[path] = std::move(file);
+  }
+  commit("main", {}, "Initial import\n", std::move(initial));
+  std::size_t main_tip = 0;
+
+  // Forks spread evenly over main; merges land halfway to the next fork
+  auto spacing = std::max<std::size_t>(
+      1, options_.commits / (options_.branches + 1));
+  struct Topic {
+    std::string name;
+    std::size_t fork_at = 0;
+    std::size_t merge_at = 0; // 0: stays open
+    BranchState state;
+    std::set<std::string> changed;
+    std::size_t tip = 0;
+  };
+  std::vector<Topic> topics(options_.branches);
+  for (std::size_t b = 0; b < topics.size(); ++b) {
+    topics[b].name = "topic-" + std::to_string(b);
+    topics[b].fork_at = std::max<std::size_t>(1, (b + 1) * spacing);
+    if (b % 2 == 0) {
+      topics[b].merge_at = topics[b].fork_at + std::max<std::size_t>(
+                                                   1, spacing / 2);
+    }
+  }
+
+  for (std::size_t m = 1; m < std::max<std::size_t>(options_.commits, 1);
+       ++m) {
+    for (auto &topic : topics) {
+      if (topic.fork_at != m) {
+        continue;
+      }
+      topic.state = main;
+      topic.tip = main_tip;
+      for (std::size_t c = 0; c < options_.commits_per_branch; ++c) {
+        auto changes = random_changes(topic.state);
+        for (const auto &change : changes) {
+          topic.changed.insert(change.path);
+        }
+        commit(topic.name, {topic.tip},
+               "Work on " + topic.name + " (" + std::to_string(c + 1) +
+                   ")\n",
+               std::move(changes));
+        topic.tip = corpus_.commits.size() - 1;
+      }
+    }
+    auto merging = std::find_if(topics.begin(), topics.end(), [&](auto &t) {
+      return t.merge_at == m && t.tip != 0;
+    });
+    if (merging != topics.end()) {
+      // The topic's version of everything it touched wins
+      std::vector<CorpusChange> changes;
+      for (const auto &path : merging->changed) {
+        auto it = merging->state.find(path);
+        if (it == merging->state.end()) {
+          if (main.erase(path)) {
+            changes.push_back(CorpusChange{path, nullptr, false});
+          }
+          continue;
+        }
+        main[path] = it->second;
+        changes.push_back(
+            CorpusChange{path, it->second.content, it->second.executable});
+      }
+      commit("main", {main_tip, merging->tip}, "Merge " + merging->name + "\n",
+             std::move(changes));
+    } else {
+      commit("main", {main_tip},
+             "Change " + std::to_string(m) + " on main\n",
+             random_changes(main));
+    }
+    main_tip = corpus_.commits.size() - 1;
+  }
+
+  corpus_.branches.emplace_back("main", main_tip);
+  for (const auto &topic : topics) {
+    if (topic.tip != 0) {
+      corpus_.branches.emplace_back(topic.name, topic.tip);
+    }
+  }
+  corpus_.files = main.size();
+  for (const auto &[path, file] : main) {
+    corpus_.bytes += file.content->size();
+  }
+  return std::move(corpus_);
+}
+
+// Tree ids per directory, kept between commits so only directories along
+// changed paths are encoded again.
+struct TreeState {
+  std::map<std::string, TreeEntry> files; // by full path
+  std::map<std::string, ObjectId> trees;  // by "dir/" prefix; "" is root
+  std::set<std::string> dirty;
+};
+
+void mark_dirty(TreeState &state, const std::string &path) {
+  for (auto slash = path.find('/'); slash != std::string::npos;
+       slash = path.find('/', slash + 1)) {
+    state.dirty.insert(path.substr(0, slash + 1));
+  }
+  state.dirty.insert("");
+}
+
+// Writes the tree for `prefix`; returns false for a directory left empty
+std::optional<Error> write_tree(TreeState &state, ObjectBatch &batch,
+                                const std::string &prefix, bool &present) {
+  present = false;
+  if (!state.dirty.count(prefix)) {
+    present = state.trees.count(prefix) != 0;
+    return std::nullopt;
+  }
+  std::vector<TreeEntry> entries;
+  auto it = state.files.lower_bound(prefix);
+  while (it != state.files.end() &&
+         it->first.compare(0, prefix.size(), prefix) == 0) {
+    auto rest = std::string_view(it->first).substr(prefix.size());
+    auto slash = rest.find('/');
+    if (slash == std::string_view::npos) {
+      entries.push_back(it->second);
+      ++it;
+      continue;
+    }
+    auto sub = prefix + std::string(rest.substr(0, slash + 1));
+    bool sub_present = false;
+    if (auto error = write_tree(state, batch, sub, sub_present)) {
+      return error;
+    }
+    if (sub_present) {
+      entries.push_back(TreeEntry{std::string(rest.substr(0, slash)),
+                                  EntryMode::Directory, state.trees[sub]});
+    }
+    // Past everything under `sub`: '0' follows '/'
+    it = state.files.lower_bound(sub.substr(0, sub.size() - 1) + "0");
+  }
+  state.dirty.erase(prefix);
+  if (entries.empty()) {
+    state.trees.erase(prefix);
+    return std::nullopt;
+  }
+  ObjectId id;
+  if (auto error = batch.add(ObjectType::Tree, encode_tree(entries), id)) {
+    return error;
+  }
+  state.trees[prefix] = id;
+  present = true;
+  return std::nullopt;
+}
+
+} // namespace
+
+Corpus generate_corpus(const CorpusOptions &options) {
+  return Generator(options).run();
+}
+
+std::optional<Error> write_chrona_repo(const Corpus &corpus,
+                                       const std::filesystem::path &root) {
+  if (auto error = init_repo(root)) {
+    return error;
+  }
+  Repository repo;
+  if (auto error = Repository::open(root, repo)) {
+    return error;
+  }
+  auto &store = repo.objects();
+
+  std::vector<ObjectId> ids(corpus.commits.size());
+  std::vector<ObjectId> trees(corpus.commits.size());
+  std::unordered_map<std::string, TreeState> branches;
+  for (std::size_t i = 0; i < corpus.commits.size(); ++i) {
+    const auto &commit = corpus.commits[i];
+    if (!branches.count(commit.branch)) {
+      // A fork starts from the tree of the branch it forks from
+      branches[commit.branch] =
+          commit.parents.empty()
+              ? TreeState{}
+              : branches[corpus.commits[commit.parents[0]].branch];
+    }
+    auto &state = branches[commit.branch];
+    ObjectBatch batch(store);
+    for (const auto &change : commit.changes) {
+      mark_dirty(state, change.path);
+      if (!change.content) {
+        state.files.erase(change.path);
+        continue;
+      }
+      TreeEntry entry{
+          change.path.substr(change.path.rfind('/') + 1),
+          change.executable ? EntryMode::Executable : EntryMode::Regular,
+          {}};
+      if (auto error = batch.add(ObjectType::Blob, *change.content,
+                                 entry.id)) {
+        return error;
+      }
+      state.files[change.path] = std::move(entry);
+    }
+    bool present = false;
+    if (auto error = write_tree(state, batch, "", present)) {
+      return error;
+    }
+    if (!present) {
+      return create_error(ErrorCode::InvalidArgument,
+                          "Corpus commit with an empty tree");
+    }
+    Commit object{state.trees[""], {}, "Chrona Bench", commit.time,
+                  commit.message};
+    for (auto parent : commit.parents) {
+      object.parents.push_back(ids[parent]);
+    }
+    if (auto error = batch.add(ObjectType::Commit, encode_commit(object),
+                               ids[i])) {
+      return error;
+    }
+    if (auto error = batch.commit()) {
+      return error;
+    }
+    trees[i] = object.tree;
+  }
+
+  RefTransaction transaction(repo.chrona_dir());
+  std::optional<ObjectId> main_tree;
+  for (const auto &[name, tip] : corpus.branches) {
+    transaction.create("refs/heads/" + name, ids[tip]);
+    if (name == "main") {
+      main_tree = trees[tip];
+    }
+  }
+  if (auto error = transaction.commit()) {
+    return error;
+  }
+  if (auto error = write_head(repo.chrona_dir(), "refs/heads/main")) {
+    return error;
+  }
+  CheckoutResult result;
+  return checkout_tree(root, store, repo.pool(), *main_tree, std::nullopt,
+                       result);
+}
+
+std::string fast_import_stream(const Corpus &corpus) {
+  std::string out;
+  for (std::size_t i = 0; i < corpus.commits.size(); ++i) {
+    const auto &commit = corpus.commits[i];
+    out += "commit refs/heads/" + commit.branch + "\n";
+    out += "mark :" + std::to_string(i + 1) + "\n";
+    out += "committer Chrona Bench <bench@chrona.invalid> " +
+           std::to_string(commit.time) + " +0000\n";
+    out += "data " + std::to_string(commit.message.size()) + "\n";
+    out += commit.message;
+    for (std::size_t p = 0; p < commit.parents.size(); ++p) {
+      out += p == 0 ? "from :" : "merge :";
+      out += std::to_string(commit.parents[p] + 1) + "\n";
+    }
+    for (const auto &change : commit.changes) {
+      if (!change.content) {
+        out += "D " + change.path + "\n";
+        continue;
+      }
+      out += change.executable ? "M 100755 inline " : "M 100644 inline ";
+      out += change.path + "\n";
+      out += "data " + std::to_string(change.content->size()) + "\n";
+      out += *change.content;
+      out += "\n";
+    }
+    out += "\n";
+  }
+  return out;
+}
+
+} // namespace chrona::bench
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "errors/error.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace chrona::bench {
+
+// Shape of a synthetic repository. The same options (seed included)
+// always produce the same corpus, byte for byte.
+struct CorpusOptions {
+  std::uint64_t seed = 1;
+  std::size_t files = 10000;
+  std::size_t depth = 3;  // directory levels below the root
+  std::size_t fanout = 8; // subdirectories per directory
+  // File sizes are log-normal around the median, cut off at max_size
+  std::size_t median_size = 2048;
+  std::size_t max_size = 1 << 20;
+  std::size_t commits = 200;          // on main, the root commit included
+  std::size_t branches = 4;           // topic branches forked from main
+  std::size_t commits_per_branch = 5;
+  std::size_t changes_per_commit = 8; // files touched per commit
+};
+
+// One file in a commit: new contents, or a deletion (no contents).
+struct CorpusChange {
+  std::string path;
+  std::shared_ptr<const std::string> content;
+  bool executable = false;
+};
+
+struct CorpusCommit {
+  std::string branch;               // "main" or "topic-<n>"
+  std::vector<std::size_t> parents; // positions of earlier commits
+  std::int64_t time = 0;
+  std::string message;
+  std::vector<CorpusChange> changes; // against the first parent
+};
+
+// A history in topological order. Topic branches fork from main; even
+// ones are merged back (their files win), odd ones stay open.
+struct Corpus {
+  CorpusOptions options;
+  std::vector<CorpusCommit> commits;
+  std::vector<std::pair<std::string, std::size_t>> branches; // tips
+  std::size_t files = 0;                                     // at main
+  std::uint64_t bytes = 0;                                   // at main
+};
+
+Corpus generate_corpus(const CorpusOptions &options);
+
+// Writes the corpus into a fresh chrona repository at `root` (objects,
+// branches, HEAD on main) and checks main out.
+std::optional<Error> write_chrona_repo(const Corpus &corpus,
+                                       const std::filesystem::path &root);
+
+// The corpus as a `git fast-import` stream, for the same history in git.
+std::string fast_import_stream(const Corpus &corpus);
+
+} // namespace chrona::bench
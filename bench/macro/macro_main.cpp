@@ -0,0 +1,489 @@
+// chrona_bench: end-to-end timings of chrona commands on generated
+// repositories, optionally next to git on the same history, as JSON.
+//
+//   chrona_bench [--files=N] [--depth=N] [--fanout=N] [--median-size=N]
+//                [--max-size=N] [--commits=N] [--branches=N]
+//                [--branch-commits=N] [--changes=N] [--seed=N] [--runs=N]
+//                [--git] [--chrona=<binary>] [--output=<file>]
+
+#include "corpus.hpp"
+#include "io/file_io.hpp"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <iostream>
+#include <numeric>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace chrona::bench {
+
+namespace {
+
+struct BenchOptions {
+  CorpusOptions corpus;
+  std::size_t runs = 5;
+  bool git = false;
+  std::string chrona = CHRONA_BINARY;
+  std::string output; // empty: stdout
+};
+
+struct Measurement {
+  std::string tool;
+  std::string operation;
+  std::vector<double> seconds;
+};
+
+double elapsed(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+// Runs `argv` in `cwd` with its output discarded and stdin read from
+// `input` (or /dev/null); a non-zero exit is an error.
+std::optional<Error> run_process(const std::vector<std::string> &argv,
+                                 const std::filesystem::path &cwd,
+                                 const std::filesystem::path &input = {}) {
+  std::vector<char *> args;
+  for (const auto &arg : argv) {
+    args.push_back(const_cast<char *>(arg.c_str()));
+  }
+  args.push_back(nullptr);
+  pid_t pid = ::fork();
+  if (pid < 0) {
+    return errno_error("Cannot fork for", argv[0]);
+  }
+  if (pid == 0) {
+    int in = ::open(input.empty() ? "/dev/null" : input.c_str(), O_RDONLY);
+    int null = ::open("/dev/null", O_WRONLY);
+    if (in < 0 || null < 0 || ::dup2(in, 0) < 0 || ::dup2(null, 1) < 0 ||
+        ::dup2(null, 2) < 0 || ::chdir(cwd.c_str()) != 0) {
+      ::_exit(126);
+    }
+    ::execvp(args[0], args.data());
+    ::_exit(127);
+  }
+  int status = 0;
+  while (::waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR) {
+      return errno_error("Cannot wait for", argv[0]);
+    }
+  }
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    std::string command;
+    for (const auto &arg : argv) {
+      command += (command.empty() ? "" : " ") + arg;
+    }
+    return create_error(ErrorCode::UnknownError,
+                        "Failed (" + std::to_string(WEXITSTATUS(status)) +
+                            "): " + command + " in " + cwd.string());
+  }
+  return std::nullopt;
+}
+
+// How one tool spells each benchmarked operation
+struct Tool {
+  std::string name;
+  std::vector<std::string> base; // the binary, plus global flags
+  std::string metadata_dir;      // ".chrona" or ".git"
+  std::vector<std::string> init, add, commit, status, diff, log, commit_graph,
+      gc;
+  std::vector<std::string> switch_to(const std::string &branch) const {
+    return name == "git" ? std::vector<std::string>{"checkout", "-q", branch}
+                         : std::vector<std::string>{"checkout", branch};
+  }
+};
+
+Tool chrona_tool(const std::string &binary) {
+  return Tool{"chrona",         {binary},          ".chrona",
+              {"init"},         {"add"},           {"commit", "-m", "import"},
+              {"status"},       {"diff"},          {"log"},
+              {"commit-graph"}, {"gc"}};
+}
+
+Tool git_tool() {
+  return Tool{"git",
+              {"git", "-c", "gc.auto=0", "-c", "core.pager=cat"},
+              ".git",
+              {"init", "-q", "-b", "main"},
+              {"add", "-A"},
+              {"commit", "-q", "-m", "import"},
+              {"status", "--porcelain"},
+              {"diff", "--no-color"},
+              {"log"},
+              {"commit-graph", "write"},
+              {"gc", "-q"}};
+}
+
+class Runner {
+public:
+  Runner(const Tool &tool, const std::filesystem::path &repo,
+         std::vector<Measurement> &out)
+      : tool_(tool), repo_(repo), out_(out) {}
+
+  // Times `runs` runs of each command list in turn; `warm` adds an
+  // untimed run first so caches and refreshed stat data are in place.
+  std::optional<Error>
+  measure(const std::string &operation,
+          const std::vector<std::vector<std::string>> &commands,
+          std::size_t runs, bool warm,
+          const std::filesystem::path &cwd = {}) {
+    Measurement measurement{tool_.name, operation, {}};
+    for (std::size_t run = 0; run < runs + (warm ? 1 : 0); ++run) {
+      auto start = std::chrono::steady_clock::now();
+      for (const auto &command : commands) {
+        if (auto error = this->run(command, cwd.empty() ? repo_ : cwd)) {
+          return error;
+        }
+      }
+      if (!warm || run > 0) {
+        measurement.seconds.push_back(elapsed(start));
+      }
+    }
+    out_.push_back(std::move(measurement));
+    return std::nullopt;
+  }
+
+  std::optional<Error> run(const std::vector<std::string> &command,
+                           const std::filesystem::path &cwd) {
+    auto argv = tool_.base;
+    argv.insert(argv.end(), command.begin(), command.end());
+    return run_process(argv, cwd);
+  }
+
+private:
+  const Tool &tool_;
+  std::filesystem::path repo_;
+  std::vector<Measurement> &out_;
+};
+
+// A copy of the checked-out files without the tool's metadata
+std::optional<Error> copy_worktree(const std::filesystem::path &from,
+                                   const std::filesystem::path &to,
+                                   const std::string &metadata_dir) {
+  std::error_code ec;
+  std::filesystem::remove_all(to, ec);
+  std::filesystem::create_directories(to, ec);
+  for (const auto &entry : std::filesystem::directory_iterator(from, ec)) {
+    if (entry.path().filename() == metadata_dir) {
+      continue;
+    }
+    std::filesystem::copy(entry.path(), to / entry.path().filename(),
+                          std::filesystem::copy_options::recursive, ec);
+    if (ec) {
+      return create_error(ErrorCode::IOError,
+                          "Cannot copy " + entry.path().string() + ": " +
+                              ec.message());
+    }
+  }
+  return std::nullopt;
+}
+
+std::optional<Error> benchmark_tool(const Tool &tool, const Corpus &corpus,
+                                    const std::filesystem::path &scratch,
+                                    std::size_t runs,
+                                    std::vector<Measurement> &out) {
+  auto repo = scratch / ("repo-" + tool.name);
+  Runner runner(tool, repo, out);
+
+  // Building the repository is timed too, though the two tools build it
+  // differently: chrona in process, git through fast-import
+  auto start = std::chrono::steady_clock::now();
+  if (tool.name == "git") {
+    std::filesystem::create_directories(repo);
+    auto stream = scratch / "corpus.fast-import";
+    if (auto error = write_file_atomic(stream, fast_import_stream(corpus))) {
+      return error;
+    }
+    if (auto error = runner.run(tool.init, repo)) {
+      return error;
+    }
+    auto argv = tool.base;
+    argv.insert(argv.end(), {"fast-import", "--quiet"});
+    if (auto error = run_process(argv, repo, stream)) {
+      return error;
+    }
+    if (auto error = runner.run({"reset", "-q", "--hard"}, repo)) {
+      return error;
+    }
+  } else if (auto error = write_chrona_repo(corpus, repo)) {
+    return error;
+  }
+  out.push_back(Measurement{tool.name, "generate", {elapsed(start)}});
+
+  if (auto error = runner.measure("status", {tool.status}, runs, true)) {
+    return error;
+  }
+
+  // Edit a spread of files, time status and diff, then put them back
+  std::vector<std::pair<std::filesystem::path, std::string>> originals;
+  const auto &initial = corpus.commits.front().changes;
+  for (std::size_t i = 0; i < initial.size(); i += 97) {
+    auto path = repo / initial[i].path;
+    std::string content;
+    if (read_file(path, content)) {
+      continue; // deleted since
+    }
+    originals.emplace_back(path, content);
+    if (auto error = write_file_atomic(path, content + "  // edited\n")) {
+      return error;
+    }
+  }
+  if (auto error =
+          runner.measure("status (modified)", {tool.status}, runs, true)) {
+    return error;
+  }
+  if (auto error = runner.measure("diff", {tool.diff}, runs, true)) {
+    return error;
+  }
+  for (const auto &[path, content] : originals) {
+    if (auto error = write_file_atomic(path, content)) {
+      return error;
+    }
+  }
+  if (auto error = runner.run(tool.status, repo)) {
+    return error;
+  }
+
+  if (auto error = runner.measure("log", {tool.log}, runs, true)) {
+    return error;
+  }
+  // A path the last commit on main touched
+  const auto &last = corpus.commits[corpus.branches.front().second];
+  if (!last.changes.empty()) {
+    auto log_path = tool.log;
+    log_path.insert(log_path.end(), {"--", last.changes.front().path});
+    if (auto error = runner.measure("log -- <path>", {log_path}, runs, true)) {
+      return error;
+    }
+  }
+  if (auto error =
+          runner.measure("commit-graph", {tool.commit_graph}, runs, false)) {
+    return error;
+  }
+  if (corpus.branches.size() > 1) {
+    // The last branch is open, so it differs most from main
+    const auto &topic = corpus.branches.back().first;
+    if (auto error = runner.measure(
+            "checkout (there and back)",
+            {tool.switch_to(topic), tool.switch_to("main")}, runs, false)) {
+      return error;
+    }
+  }
+  if (auto error = runner.measure("gc", {tool.gc}, runs, false)) {
+    return error;
+  }
+
+  // Importing the working tree into a new repository, once per run
+  auto fresh = scratch / ("fresh-" + tool.name);
+  Measurement init{tool.name, "init", {}};
+  Measurement add{tool.name, "add (whole tree)", {}};
+  Measurement commit{tool.name, "commit (whole tree)", {}};
+  for (std::size_t run = 0; run < runs; ++run) {
+    if (auto error = copy_worktree(repo, fresh, tool.metadata_dir)) {
+      return error;
+    }
+    for (auto [measurement, command] :
+         {std::pair{&init, &tool.init}, std::pair{&add, &tool.add},
+          std::pair{&commit, &tool.commit}}) {
+      auto begin = std::chrono::steady_clock::now();
+      if (auto error = runner.run(*command, fresh)) {
+        return error;
+      }
+      measurement->seconds.push_back(elapsed(begin));
+    }
+  }
+  out.push_back(std::move(init));
+  out.push_back(std::move(add));
+  out.push_back(std::move(commit));
+  return std::nullopt;
+}
+
+std::string json_string(std::string_view text) {
+  std::string out = "\"";
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char escape[8];
+      std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+      out += escape;
+    } else {
+      out += c;
+    }
+  }
+  return out + "\"";
+}
+
+std::string to_json(const BenchOptions &options, const Corpus &corpus,
+                    const std::vector<Measurement> &measurements) {
+  const auto &c = options.corpus;
+  std::string out = "{\n  \"corpus\": {";
+  for (auto [key, value] : std::initializer_list<
+           std::pair<const char *, std::uint64_t>>{
+           {"seed", c.seed},
+           {"files", c.files},
+           {"depth", c.depth},
+           {"fanout", c.fanout},
+           {"median_size", c.median_size},
+           {"max_size", c.max_size},
+           {"commits", c.commits},
+           {"branches", c.branches},
+           {"commits_per_branch", c.commits_per_branch},
+           {"changes_per_commit", c.changes_per_commit},
+           {"total_commits", corpus.commits.size()},
+           {"head_files", corpus.files},
+           {"head_bytes", corpus.bytes}}) {
+    out += std::string(out.back() == '{' ? "" : ",") + "\n    " +
+           json_string(key) + ": " + std::to_string(value);
+  }
+  out += "\n  },\n  \"runs\": " + std::to_string(options.runs) +
+         ",\n  \"results\": [";
+  for (std::size_t i = 0; i < measurements.size(); ++i) {
+    auto seconds = measurements[i].seconds;
+    std::sort(seconds.begin(), seconds.end());
+    double mean = std::accumulate(seconds.begin(), seconds.end(), 0.0) /
+                  static_cast<double>(seconds.size());
+    char numbers[160];
+    std::snprintf(numbers, sizeof(numbers),
+                  "\"min_seconds\": %.6f, \"median_seconds\": %.6f, "
+                  "\"mean_seconds\": %.6f",
+                  seconds.front(), seconds[seconds.size() / 2], mean);
+    out += std::string(i == 0 ? "" : ",") + "\n    {\"tool\": " +
+           json_string(measurements[i].tool) +
+           ", \"operation\": " + json_string(measurements[i].operation) +
+           ", \"samples\": " + std::to_string(seconds.size()) + ", " +
+           numbers + "}";
+  }
+  return out + "\n  ]\n}\n";
+}
+
+std::optional<Error> parse_options(int argc, char *argv[],
+                                   BenchOptions &out) {
+  auto &c = out.corpus;
+  const std::pair<const char *, std::size_t *> numbers[] = {
+      {"--files=", &c.files},
+      {"--depth=", &c.depth},
+      {"--fanout=", &c.fanout},
+      {"--median-size=", &c.median_size},
+      {"--max-size=", &c.max_size},
+      {"--commits=", &c.commits},
+      {"--branches=", &c.branches},
+      {"--branch-commits=", &c.commits_per_branch},
+      {"--changes=", &c.changes_per_commit},
+      {"--runs=", &out.runs}};
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    std::size_t *target = nullptr;
+    std::string_view value;
+    for (auto [prefix, field] : numbers) {
+      if (arg.rfind(prefix, 0) == 0) {
+        target = field;
+        value = arg.substr(std::string_view(prefix).size());
+      }
+    }
+    if (arg.rfind("--seed=", 0) == 0) {
+      value = arg.substr(7);
+      auto [ptr, ec] = std::from_chars(value.data(),
+                                       value.data() + value.size(), c.seed);
+      if (ec != std::errc() || ptr != value.data() + value.size()) {
+        return create_error(ErrorCode::InvalidArgument,
+                            "Invalid value: " + std::string(arg));
+      }
+    } else if (target) {
+      auto [ptr, ec] =
+          std::from_chars(value.data(), value.data() + value.size(), *target);
+      if (ec != std::errc() || ptr != value.data() + value.size()) {
+        return create_error(ErrorCode::InvalidArgument,
+                            "Invalid value: " + std::string(arg));
+      }
+    } else if (arg == "--git") {
+      out.git = true;
+    } else if (arg.rfind("--chrona=", 0) == 0) {
+      out.chrona = arg.substr(9);
+    } else if (arg.rfind("--output=", 0) == 0) {
+      out.output = arg.substr(9);
+    } else {
+      return create_error(ErrorCode::InvalidArgument,
+                          "Unknown option: " + std::string(arg) +
+                              "\nUsage: chrona_bench [--files=N] [--depth=N] "
+                              "[--fanout=N] [--median-size=N] [--max-size=N] "
+                              "[--commits=N] [--branches=N] "
+                              "[--branch-commits=N] [--changes=N] "
+                              "[--seed=N] [--runs=N] [--git] "
+                              "[--chrona=<binary>] [--output=<file>]");
+    }
+  }
+  if (c.files == 0 || c.commits == 0 || c.fanout == 0 || out.runs == 0 ||
+      c.median_size == 0 || c.commits_per_branch == 0) {
+    return create_error(ErrorCode::InvalidArgument,
+                        "files, commits, fanout, median-size, "
+                        "branch-commits and runs must be positive");
+  }
+  return std::nullopt;
+}
+
+} // namespace
+
+} // namespace chrona::bench
+
+int main(int argc, char *argv[]) {
+  using namespace chrona;
+  using namespace chrona::bench;
+  BenchOptions options;
+  if (auto error = parse_options(argc, argv, options)) {
+    print_error(*error);
+    return 2;
+  }
+  // Identical commits in every run, and no user config in git's way
+  ::setenv("CHRONA_AUTHOR_NAME", "Chrona Bench", 1);
+  ::setenv("GIT_CONFIG_NOSYSTEM", "1", 1);
+  ::setenv("GIT_CONFIG_GLOBAL", "/dev/null", 1);
+  for (const char *role : {"AUTHOR", "COMMITTER"}) {
+    ::setenv(("GIT_" + std::string(role) + "_NAME").c_str(), "Chrona Bench",
+             1);
+    ::setenv(("GIT_" + std::string(role) + "_EMAIL").c_str(),
+             "bench@chrona.invalid", 1);
+  }
+
+  auto scratch = std::filesystem::temp_directory_path() /
+                 ("chrona-macro-" + std::to_string(::getpid()));
+  std::filesystem::create_directories(scratch);
+
+  std::cerr << "Generating corpus..." << std::endl;
+  auto corpus = generate_corpus(options.corpus);
+  std::vector<Tool> tools{chrona_tool(options.chrona)};
+  if (options.git) {
+    tools.push_back(git_tool());
+  }
+  std::vector<Measurement> measurements;
+  int status = 0;
+  for (const auto &tool : tools) {
+    std::cerr << "Benchmarking " << tool.name << "..." << std::endl;
+    if (auto error =
+            benchmark_tool(tool, corpus, scratch, options.runs, measurements)) {
+      print_error(*error);
+      status = 1;
+      break;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::remove_all(scratch, ec);
+  if (status != 0) {
+    return status;
+  }
+
+  auto json = to_json(options, corpus, measurements);
+  if (options.output.empty()) {
+    std::cout << json;
+  } else if (auto error = write_file_atomic(options.output, json)) {
+    print_error(*error);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,585 @@
+#include "bundle.hpp"
+#include "hash/sha256.hpp"
+#include "io/file_io.hpp"
+#include "io/mapped_file.hpp"
+#include "pack/varint.hpp"
+#include "trace/trace.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace chrona {
+
+namespace {
+
+constexpr std::string_view bundle_signature = "chrona bundle 1\n";
+constexpr std::uint8_t compressed_flag = 0x40;
+constexpr std::uint8_t chunk_list_flag = 0x80;
+constexpr std::size_t frame_header_size = 8;
+// Objects smaller than this are stored as they are
+constexpr std::size_t min_compress_size = 64;
+
+std::uint32_t load_u32(const char *p) {
+  std::uint32_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+void append_u32(std::string &out, std::uint32_t value) {
+  out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+bool is_object_type(int type) {
+  return type == static_cast<int>(ObjectType::Blob) ||
+         type == static_cast<int>(ObjectType::Tree) ||
+         type == static_cast<int>(ObjectType::Commit);
+}
+
+// Keeps the first error any task reports.
+class FirstError {
+public:
+  void set(std::optional<Error> error) {
+    std::lock_guard lock(mutex_);
+    if (error && !error_) {
+      error_ = std::move(error);
+    }
+  }
+  std::optional<Error> take() {
+    std::lock_guard lock(mutex_);
+    return std::move(error_);
+  }
+
+private:
+  std::mutex mutex_;
+  std::optional<Error> error_;
+};
+
+using ChunkLists =
+    std::unordered_map<ObjectId, std::vector<ChunkRef>, ObjectIdHash>;
+
+// Finds the chunk lists of the loose chunked blobs among `objects` and
+// appends their chunks to `entries`, after `objects` and once each.
+std::optional<Error> collect_chunk_lists(const ObjectStore &store,
+                                         const std::vector<ObjectId> &objects,
+                                         ChunkLists &lists,
+                                         std::vector<ObjectId> &entries) {
+  entries = objects;
+  std::string ids;
+  if (auto error = read_file(store.chunked_list_path(), ids)) {
+    return error->error_code == ErrorCode::NotFound ? std::nullopt : error;
+  }
+  std::unordered_set<ObjectId, ObjectIdHash> chunked;
+  for (std::size_t at = 0; at + ObjectId::size <= ids.size();
+       at += ObjectId::size) {
+    ObjectId id;
+    std::memcpy(id.bytes.data(), ids.data() + at, ObjectId::size);
+    chunked.insert(id);
+  }
+  std::unordered_set<ObjectId, ObjectIdHash> seen(objects.begin(),
+                                                  objects.end());
+  std::vector<ChunkRef> chunks;
+  for (const auto &id : objects) {
+    if (!chunked.count(id) || lists.count(id)) {
+      continue;
+    }
+    if (auto error = store.read_chunk_list(id, chunks)) {
+      if (error->error_code == ErrorCode::NotFound) {
+        continue; // packed whole since
+      }
+      return error;
+    }
+    if (chunks.empty()) {
+      continue;
+    }
+    for (const auto &chunk : chunks) {
+      if (seen.insert(chunk.id).second) {
+        entries.push_back(chunk.id);
+      }
+    }
+    lists.emplace(id, chunks);
+  }
+  return std::nullopt;
+}
+
+std::optional<Error> encode_object(const ObjectStore &store,
+                                   const ObjectId &id,
+                                   const CompressionOptions &compression,
+                                   std::string &out) {
+  ObjectView view;
+  if (auto error = store.read(id, view)) {
+    return error;
+  }
+  auto content = view.content();
+  std::string packed;
+  if (compression.codec != Codec::None &&
+      content.size() >= min_compress_size) {
+    packed = compress(content, compression);
+  }
+  bool compressed = !packed.empty() && packed.size() < content.size();
+  out += static_cast<char>(static_cast<std::uint8_t>(view.type()) |
+                           (compressed ? compressed_flag : 0));
+  out.append(reinterpret_cast<const char *>(id.bytes.data()), ObjectId::size);
+  append_varint(out, content.size());
+  if (compressed) {
+    append_varint(out, packed.size());
+    out += packed;
+  } else {
+    out.append(content);
+  }
+  return std::nullopt;
+}
+
+void encode_chunk_list(const ObjectId &id, const std::vector<ChunkRef> &chunks,
+                       std::string &out) {
+  std::string list;
+  std::uint64_t size = 0;
+  for (const auto &chunk : chunks) {
+    append_varint(list, chunk.size);
+    list.append(reinterpret_cast<const char *>(chunk.id.bytes.data()),
+                ObjectId::size);
+    size += chunk.size;
+  }
+  out += static_cast<char>(static_cast<std::uint8_t>(ObjectType::Blob) |
+                           chunk_list_flag);
+  out.append(reinterpret_cast<const char *>(id.bytes.data()), ObjectId::size);
+  append_varint(out, size);
+  append_varint(out, list.size());
+  out += list;
+}
+
+// Encodes `ids` as one or more frames: a frame is closed before its body
+// would pass `max_body` bytes. An object that cannot fit a frame of its
+// own fails with InvalidArgument.
+std::optional<Error> encode_frames(const ObjectStore &store,
+                                   const ObjectId *ids, std::size_t count,
+                                   const ChunkLists &lists,
+                                   const CompressionOptions &compression,
+                                   std::uint64_t max_body, std::string &out) {
+  std::size_t frame = 0;
+  std::uint32_t objects = 0;
+  auto close = [&] {
+    auto body = static_cast<std::uint32_t>(out.size() - frame -
+                                           frame_header_size);
+    std::memcpy(out.data() + frame, &body, 4);
+    std::memcpy(out.data() + frame + 4, &objects, 4);
+  };
+  out.assign(frame_header_size, '\0');
+  for (std::size_t i = 0; i < count; ++i) {
+    auto entry = out.size();
+    auto listed = lists.find(ids[i]);
+    if (listed != lists.end()) {
+      encode_chunk_list(ids[i], listed->second, out);
+    } else if (auto error = encode_object(store, ids[i], compression, out)) {
+      return error;
+    }
+    if (out.size() - entry > max_body) {
+      return create_error(ErrorCode::InvalidArgument,
+                          "Object " + ids[i].hex() + " takes " +
+                              std::to_string(out.size() - entry) +
+                              " bytes, more than a bundle frame holds");
+    }
+    if (out.size() - frame - frame_header_size > max_body) {
+      // The entry that overflowed opens the next frame
+      std::string moved = out.substr(entry);
+      out.resize(entry);
+      close();
+      frame = out.size();
+      out.append(frame_header_size, '\0');
+      out += moved;
+      objects = 0;
+    }
+    ++objects;
+  }
+  close();
+  return std::nullopt;
+}
+
+// Chunk lists wait for every frame to be in, as their chunks may arrive
+// in any of them.
+struct PendingLists {
+  std::mutex mutex;
+  std::vector<std::pair<ObjectId, std::vector<ChunkRef>>> lists;
+};
+
+std::optional<Error> decode_frame(ObjectStore &store, std::string_view body,
+                                  std::uint32_t count,
+                                  std::atomic<std::size_t> &written,
+                                  std::atomic<std::size_t> &present,
+                                  PendingLists &pending) {
+  auto corrupt = [](const std::string &what) {
+    return create_error(ErrorCode::CorruptObject, "Corrupt bundle: " + what);
+  };
+  ObjectBatch batch(store);
+  std::string expanded;
+  for (std::uint32_t i = 0; i < count; ++i) {
+    if (body.size() < 1 + ObjectId::size) {
+      return corrupt("truncated frame");
+    }
+    auto kind = static_cast<std::uint8_t>(body.front());
+    ObjectId id;
+    std::memcpy(id.bytes.data(), body.data() + 1, ObjectId::size);
+    body.remove_prefix(1 + ObjectId::size);
+    bool compressed = (kind & compressed_flag) != 0;
+    bool listed = (kind & chunk_list_flag) != 0;
+    int type = kind & ~(compressed_flag | chunk_list_flag);
+    std::uint64_t size = 0;
+    std::uint64_t stored = 0;
+    bool blob = type == static_cast<int>(ObjectType::Blob);
+    if (!is_object_type(type) || (listed && (compressed || !blob)) ||
+        !read_varint(body, size) ||
+        ((compressed || listed) && !read_varint(body, stored))) {
+      return corrupt("bad entry for " + id.hex());
+    }
+    if (!compressed && !listed) {
+      stored = size;
+    }
+    if (stored > body.size()) {
+      return corrupt("truncated entry for " + id.hex());
+    }
+    auto payload = body.substr(0, stored);
+    body.remove_prefix(stored);
+
+    // What an earlier, interrupted import already stored is skipped
+    // without being decompressed
+    if (store.contains(id)) {
+      present.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+    if (listed) {
+      std::vector<ChunkRef> chunks;
+      std::uint64_t total = 0;
+      while (!payload.empty()) {
+        ChunkRef chunk;
+        if (!read_varint(payload, chunk.size) || chunk.size == 0 ||
+            payload.size() < ObjectId::size) {
+          return corrupt("bad chunk list for " + id.hex());
+        }
+        std::memcpy(chunk.id.bytes.data(), payload.data(), ObjectId::size);
+        payload.remove_prefix(ObjectId::size);
+        total += chunk.size;
+        chunks.push_back(chunk);
+      }
+      if (chunks.empty() || total != size) {
+        return corrupt("bad chunk list for " + id.hex());
+      }
+      std::lock_guard lock(pending.mutex);
+      pending.lists.emplace_back(id, std::move(chunks));
+      continue;
+    }
+    std::string_view content = payload;
+    if (compressed) {
+      if (decompress(payload, size, expanded)) {
+        return corrupt("bad compressed entry for " + id.hex());
+      }
+      content = expanded;
+    }
+    ObjectId got;
+    if (auto error = batch.add(static_cast<ObjectType>(type), content, got)) {
+      return error;
+    }
+    if (got != id) {
+      return corrupt("object " + id.hex() + " does not match its content");
+    }
+    written.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (!body.empty()) {
+    return corrupt("trailing data in frame");
+  }
+  return batch.commit();
+}
+
+// Parses the text header at the front of `in` and consumes it.
+std::optional<Error> parse_header(std::string_view &in,
+                                  const std::filesystem::path &path,
+                                  BundleHeader &out) {
+  out = BundleHeader();
+  auto corrupt = [&] {
+    return create_error(ErrorCode::CorruptObject,
+                        "Not a chrona bundle: " + path.string());
+  };
+  if (in.substr(0, bundle_signature.size()) != bundle_signature) {
+    return corrupt();
+  }
+  in.remove_prefix(bundle_signature.size());
+  bool counted = false;
+  while (true) {
+    auto end = in.find('\n');
+    if (end == std::string_view::npos) {
+      return corrupt();
+    }
+    auto line = in.substr(0, end);
+    in.remove_prefix(end + 1);
+    if (line.empty()) {
+      break;
+    }
+    auto space = line.find(' ');
+    auto keyword = line.substr(0, space);
+    auto rest = space == std::string_view::npos ? std::string_view()
+                                                : line.substr(space + 1);
+    if (keyword == "prerequisite") {
+      auto id = ObjectId::from_hex(rest);
+      if (!id) {
+        return corrupt();
+      }
+      out.prerequisites.push_back(*id);
+    } else if (keyword == "ref") {
+      auto split = rest.find(' ');
+      auto id = ObjectId::from_hex(rest.substr(0, split));
+      if (!id || split == std::string_view::npos) {
+        return corrupt();
+      }
+      out.refs.emplace_back(std::string(rest.substr(split + 1)), *id);
+    } else if (keyword == "objects") {
+      out.objects = std::strtoull(std::string(rest).c_str(), nullptr, 10);
+      counted = true;
+    } else {
+      return corrupt();
+    }
+  }
+  if (!counted) {
+    return corrupt();
+  }
+  return std::nullopt;
+}
+
+} // namespace
+
+std::optional<Error> create_bundle(const std::filesystem::path &path,
+                                   const ObjectStore &store, WorkPool &pool,
+                                   BundleHeader header,
+                                   const std::vector<ObjectId> &objects,
+                                   BundleResult &out,
+                                   const BundleOptions &options) {
+  CHRONA_TRACE_SCOPE("bundle.create");
+  out = BundleResult();
+  auto compression = options.compression.value_or(store.compression());
+  if (compression.codec == Codec::None && !options.compression) {
+    compression.codec = Codec::Fast;
+  }
+
+  // A chunked blob travels as its chunk list, with the chunks as blobs of
+  // their own, so neither side ever holds it whole
+  ChunkLists lists;
+  std::vector<ObjectId> entries;
+  if (auto error = collect_chunk_lists(store, objects, lists, entries)) {
+    return error;
+  }
+  header.objects = entries.size();
+
+  auto dir = path.parent_path().empty() ? std::filesystem::path(".")
+                                        : path.parent_path();
+  TempFile file;
+  if (auto error = TempFile::create(dir, file)) {
+    return error;
+  }
+  Sha256 hasher;
+  auto emit = [&](std::string_view data) {
+    hasher.update(data);
+    out.bytes += data.size();
+    return file.write(data);
+  };
+
+  std::string text(bundle_signature);
+  for (const auto &id : header.prerequisites) {
+    text += "prerequisite " + id.hex() + "\n";
+  }
+  for (const auto &[name, id] : header.refs) {
+    text += "ref " + id.hex() + " " + name + "\n";
+  }
+  text += "objects " + std::to_string(entries.size()) + "\n\n";
+  if (auto error = emit(text)) {
+    return error;
+  }
+
+  // Frames are encoded a window at a time on the pool; the previous
+  // window is hashed and written meanwhile
+  const std::size_t per_frame = std::max<std::size_t>(1, options.frame_objects);
+  const std::uint64_t max_body =
+      std::min<std::uint64_t>(options.max_frame_bytes, UINT32_MAX);
+  const std::size_t frames = (entries.size() + per_frame - 1) / per_frame;
+  const std::size_t window = std::max<std::size_t>(4, pool.size() * 4);
+  std::vector<std::string> encoded;
+  std::vector<std::string> ready;
+  FirstError failed;
+  auto submit = [&](std::size_t first) {
+    encoded.assign(std::min(window, frames - first), std::string());
+    for (std::size_t f = 0; f < encoded.size(); ++f) {
+      pool.submit([&, f, first] {
+        auto begin = (first + f) * per_frame;
+        auto count = std::min(per_frame, entries.size() - begin);
+        failed.set(encode_frames(store, entries.data() + begin, count, lists,
+                                 compression, max_body, encoded[f]));
+      });
+    }
+  };
+  for (std::size_t first = 0; first < frames || !ready.empty();
+       first += window) {
+    if (first < frames) {
+      submit(first);
+    }
+    for (const auto &frame : ready) {
+      if (auto error = emit(frame)) {
+        pool.wait();
+        return error;
+      }
+    }
+    pool.wait();
+    if (auto error = failed.take()) {
+      return error;
+    }
+    ready = std::move(encoded);
+    encoded.clear();
+    if (first >= frames) {
+      break;
+    }
+  }
+
+  std::string end;
+  append_u32(end, 0);
+  append_u32(end, 0);
+  if (auto error = emit(end)) {
+    return error;
+  }
+  auto digest = hasher.finish();
+  if (auto error = file.write(std::string_view(
+          reinterpret_cast<const char *>(digest.data()), digest.size()))) {
+    return error;
+  }
+  out.bytes += digest.size();
+  if (auto error = file.sync()) {
+    return error;
+  }
+  if (auto error = file.commit(path)) {
+    return error;
+  }
+  out.header = std::move(header);
+  out.written = entries.size();
+  return std::nullopt;
+}
+
+std::optional<Error> read_bundle_header(const std::filesystem::path &path,
+                                        BundleHeader &out) {
+  MappedFile file;
+  if (auto error = MappedFile::open(path, file)) {
+    return error;
+  }
+  auto in = file.view();
+  return parse_header(in, path, out);
+}
+
+std::optional<Error> unbundle(const std::filesystem::path &path,
+                              ObjectStore &store, WorkPool &pool,
+                              BundleResult &out) {
+  CHRONA_TRACE_SCOPE("bundle.unbundle");
+  out = BundleResult();
+  MappedFile file;
+  if (auto error = MappedFile::open(path, file)) {
+    return error;
+  }
+  auto all = file.view();
+  auto corrupt = [&](const std::string &what) {
+    return create_error(ErrorCode::CorruptObject,
+                        "Corrupt bundle " + path.string() + ": " + what);
+  };
+  if (all.size() < Sha256::digest_size) {
+    return corrupt("too short");
+  }
+  auto body = all.substr(0, all.size() - Sha256::digest_size);
+  auto in = body;
+  if (auto error = parse_header(in, path, out.header)) {
+    return error;
+  }
+  for (const auto &id : out.header.prerequisites) {
+    if (!store.contains(id)) {
+      return create_error(ErrorCode::NotFound,
+                          "The bundle needs commit " + id.hex() +
+                              ", which this repository does not have");
+    }
+  }
+
+  // The file is read and hashed in order on this thread while the frames
+  // seen so far decode on the pool, a window at a time
+  Sha256 hasher;
+  hasher.update(body.substr(0, body.size() - in.size()));
+  std::atomic<std::size_t> written{0};
+  std::atomic<std::size_t> present{0};
+  PendingLists pending;
+  FirstError failed;
+  const std::size_t window = std::max<std::size_t>(4, pool.size() * 4);
+  std::size_t in_flight = 0;
+  std::uint64_t objects = 0;
+  while (true) {
+    if (in.size() < frame_header_size) {
+      pool.wait();
+      return corrupt("truncated frame header");
+    }
+    std::uint32_t size = load_u32(in.data());
+    std::uint32_t count = load_u32(in.data() + 4);
+    if (in.size() - frame_header_size < size) {
+      pool.wait();
+      return corrupt("truncated frame");
+    }
+    auto frame = in.substr(0, frame_header_size + size);
+    in.remove_prefix(frame.size());
+    if (size == 0 && count == 0) {
+      hasher.update(frame);
+      break;
+    }
+    objects += count;
+    pool.submit([&, frame, count] {
+      failed.set(decode_frame(store, frame.substr(frame_header_size), count,
+                              written, present, pending));
+    });
+    // Hashing the frame here touches its pages, so the workers find them
+    // resident
+    hasher.update(frame);
+    if (++in_flight == window) {
+      pool.wait();
+      in_flight = 0;
+      if (auto error = failed.take()) {
+        return error;
+      }
+    }
+  }
+  pool.wait();
+  if (auto error = failed.take()) {
+    return error;
+  }
+  auto digest = hasher.finish();
+  if (!in.empty() ||
+      std::memcmp(digest.data(), all.data() + body.size(), digest.size()) !=
+          0) {
+    return corrupt("checksum mismatch");
+  }
+  if (objects != out.header.objects) {
+    return corrupt("object count mismatch");
+  }
+
+  // Each list is checked by hashing its chunks back from the store
+  for (const auto &[id, chunks] : pending.lists) {
+    pool.submit([&, &id = id, &chunks = chunks] {
+      ObjectBatch batch(store);
+      auto error = batch.add_chunk_list(id, chunks);
+      if (!error) {
+        error = batch.commit();
+      }
+      if (!error) {
+        written.fetch_add(1, std::memory_order_relaxed);
+      }
+      failed.set(std::move(error));
+    });
+  }
+  pool.wait();
+  if (auto error = failed.take()) {
+    return error;
+  }
+  out.bytes = all.size();
+  out.written = written.load();
+  out.present = present.load();
+  return std::nullopt;
+}
+
+} // namespace chrona
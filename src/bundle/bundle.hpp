@@ -0,0 +1,85 @@
+#pragma once
+
+#include "compress/compress.hpp"
+#include "errors/error.hpp"
+#include "objects/object.hpp"
+#include "objects/object_store.hpp"
+#include "parallel/work_pool.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace chrona {
+
+// Bundle layout: one file carrying refs and the objects behind them.
+//
+//   "chrona bundle 1\n"
+//   "prerequisite <hex>\n"*   commits the importer must already have
+//   "ref <hex> <name>\n"*
+//   "objects <count>\n"
+//   "\n"
+//   frame*      u32 body_size u32 object_count, then per object:
+//                 u8 type (| 0x40 when compressed) id[32] varint size
+//                 [varint stored size] <content or compressed stream>
+//               or, for a chunked blob:
+//                 u8 blob | 0x80 id[32] varint size varint list size
+//                 ("<varint chunk size><chunk id[32]>")*
+//   u32 0 u32 0 (end of frames)
+//   SHA-256 of everything above
+//
+// Objects are stored whole, never as deltas, so every frame decodes on
+// its own and frames import in parallel. Each object carries its id, so
+// the importer checks content against it and skips objects it already
+// has without decompressing them. A chunked blob is sent as its list,
+// its chunks following as blobs of their own, and is stored chunked on
+// import once every frame is in, so no side reassembles it in memory.
+struct BundleHeader {
+  std::vector<ObjectId> prerequisites;
+  std::vector<std::pair<std::string, ObjectId>> refs;
+  std::uint64_t objects = 0;
+};
+
+struct BundleOptions {
+  std::size_t frame_objects = 256;
+  // Frame bodies are held below this, and below the 4 GiB their u32 size
+  // field allows, by closing a frame early. An object too large for a
+  // frame of its own fails the bundle with InvalidArgument.
+  std::uint64_t max_frame_bytes = UINT32_MAX;
+  // Unset uses the store's setting, or the fast codec if that is none.
+  std::optional<CompressionOptions> compression;
+};
+
+struct BundleResult {
+  BundleHeader header;
+  std::uint64_t bytes = 0;
+  std::size_t written = 0; // objects the import stored
+  std::size_t present = 0; // objects the store already had
+};
+
+// Writes `objects` (read from `store`) with the refs and prerequisites of
+// `header` to `path`, replacing it atomically. Frames are encoded on
+// `pool` while earlier ones are hashed and written.
+std::optional<Error> create_bundle(const std::filesystem::path &path,
+                                   const ObjectStore &store, WorkPool &pool,
+                                   BundleHeader header,
+                                   const std::vector<ObjectId> &objects,
+                                   BundleResult &out,
+                                   const BundleOptions &options = {});
+
+std::optional<Error> read_bundle_header(const std::filesystem::path &path,
+                                        BundleHeader &out);
+
+// Imports every object of the bundle into `store`, frames in parallel on
+// `pool` while the whole file is hashed in order. Fails with NotFound
+// when a prerequisite is missing. An interrupted import is resumed by
+// running it again. Refs are left to the caller, who should only trust
+// `out.header` once this returns without error.
+std::optional<Error> unbundle(const std::filesystem::path &path,
+                              ObjectStore &store, WorkPool &pool,
+                              BundleResult &out);
+
+} // namespace chrona
@@ -0,0 +1,639 @@
+#include "checkout.hpp"
+#include "history/commit.hpp"
+#include "io/file_io.hpp"
+#include "refs/refs.hpp"
+#include "snapshot/tree.hpp"
+#include "snapshot/tree_builder.hpp"
+#include "status/status.hpp"
+#include "trace/trace.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <fcntl.h>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace chrona {
+
+namespace {
+
+// Collects the first error raised by any pool task.
+class FirstError {
+public:
+  void set(std::optional<Error> error) {
+    std::lock_guard lock(mutex_);
+    if (!error_) {
+      error_ = std::move(error);
+    }
+  }
+  bool failed() const {
+    std::lock_guard lock(mutex_);
+    return error_.has_value();
+  }
+  std::optional<Error> take() { return std::move(error_); }
+
+private:
+  mutable std::mutex mutex_;
+  std::optional<Error> error_;
+};
+
+std::optional<Error> commit_tree(const ObjectStore &store,
+                                 const ObjectId &commit_id, ObjectId &out) {
+  ObjectView view;
+  if (auto error = store.read(commit_id, view)) {
+    return error;
+  }
+  if (view.type() != ObjectType::Commit) {
+    return create_error(ErrorCode::InvalidArgument,
+                        "Not a commit: " + commit_id.hex());
+  }
+  InlineArena<1024> arena;
+  CommitView commit;
+  if (auto error = parse_commit(view.content(), arena, commit)) {
+    return error;
+  }
+  out = commit.tree;
+  return std::nullopt;
+}
+
+// Resolves paths in one tree, reading only the directories on their way
+// (each once), so looking up a few paths costs a few trees rather than the
+// whole of a large tree.
+class TreeLookup {
+public:
+  TreeLookup(const ObjectStore &store, const ObjectId &root)
+      : store_(store), root_(root) {}
+
+  // `out` is null when nothing is at `path`.
+  std::optional<Error> find(std::string_view path, const TreeEntry *&out) {
+    out = nullptr;
+    std::string dir;
+    ObjectId id = root_;
+    while (true) {
+      const std::vector<TreeEntry> *entries = nullptr;
+      if (auto error = load(dir, id, entries)) {
+        return error;
+      }
+      auto slash = path.find('/');
+      auto name = path.substr(0, slash);
+      auto it = std::lower_bound(
+          entries->begin(), entries->end(), name,
+          [](const TreeEntry &entry, std::string_view key) {
+            return entry.name < key;
+          });
+      if (it == entries->end() || it->name != name) {
+        return std::nullopt;
+      }
+      if (slash == std::string_view::npos) {
+        out = &*it;
+        return std::nullopt;
+      }
+      if (it->mode != EntryMode::Directory) {
+        return std::nullopt;
+      }
+      dir += std::string(name) + "/";
+      id = it->id;
+      path = path.substr(slash + 1);
+    }
+  }
+
+private:
+  std::optional<Error> load(const std::string &dir, const ObjectId &id,
+                            const std::vector<TreeEntry> *&out) {
+    auto it = dirs_.find(dir);
+    if (it == dirs_.end()) {
+      ObjectView view;
+      if (auto error = store_.read(id, view)) {
+        return error;
+      }
+      if (view.type() != ObjectType::Tree) {
+        return create_error(ErrorCode::CorruptObject,
+                            "Not a tree: " + id.hex());
+      }
+      std::vector<TreeEntry> entries;
+      if (auto error = decode_tree(view.content(), entries)) {
+        return error;
+      }
+      std::sort(entries.begin(), entries.end(),
+                [](const TreeEntry &a, const TreeEntry &b) {
+                  return a.name < b.name;
+                });
+      it = dirs_.emplace(dir, std::move(entries)).first;
+    }
+    out = &it->second;
+    return std::nullopt;
+  }
+
+  const ObjectStore &store_;
+  ObjectId root_;
+  std::map<std::string, std::vector<TreeEntry>> dirs_;
+};
+
+// The first parent of `path` that is on disk as something other than a
+// directory, when the index does not track it.
+std::optional<std::string> untracked_parent(const std::filesystem::path &root,
+                                            const IndexView &index,
+                                            const std::string &path) {
+  for (auto slash = path.find('/'); slash != std::string::npos;
+       slash = path.find('/', slash + 1)) {
+    auto parent = path.substr(0, slash);
+    struct stat st;
+    trace_count(TraceCounter::StatCalls);
+    if (::lstat((root / parent).c_str(), &st) != 0) {
+      return std::nullopt;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+      if (index.find(parent)) {
+        return std::nullopt;
+      }
+      return parent;
+    }
+  }
+  return std::nullopt;
+}
+
+std::optional<Error> would_overwrite(const std::string &path,
+                                     const std::string &why) {
+  return create_error(ErrorCode::AlreadyExists,
+                      "Checkout would overwrite " + why + ": " + path +
+                          " (commit or stage it, or use --force)");
+}
+
+// Fails if the tracked file at `path` differs from index entry `i`. A file
+// that is already gone has nothing to lose.
+std::optional<Error> check_unmodified(const std::filesystem::path &root,
+                                      const IndexView &index, std::size_t i) {
+  std::string path(index.path(i));
+  FileStat stat;
+  if (auto error = stat_file(root / path, stat)) {
+    if (error->error_code == ErrorCode::NotFound) {
+      return std::nullopt;
+    }
+    return would_overwrite(path, "a path that is no longer a file");
+  }
+  if (index.matches(i, stat) && !index.is_racy(i)) {
+    return std::nullopt;
+  }
+  ObjectId id;
+  if (auto error = hash_worktree_file(root / path, stat, id)) {
+    return error;
+  }
+  if (id != index.id(i) || stat.mode != index.stat(i).mode) {
+    return would_overwrite(path, "local changes");
+  }
+  return std::nullopt;
+}
+
+// Removes `dir` and then its parents for as long as they are empty.
+void prune_empty_parents(const std::filesystem::path &root, std::string dir) {
+  while (!dir.empty() && ::rmdir((root / dir).c_str()) == 0) {
+    auto slash = dir.rfind('/');
+    dir = slash == std::string::npos ? "" : dir.substr(0, slash);
+  }
+}
+
+std::string parent_of(const std::string &path) {
+  auto slash = path.rfind('/');
+  return slash == std::string::npos ? "" : path.substr(0, slash);
+}
+
+std::optional<Error> write_symlink(const std::filesystem::path &path,
+                                   std::string_view target) {
+  // No mkstemp for links: a counter keeps concurrent writers apart
+  static std::atomic<std::uint64_t> counter{0};
+  auto temp = path.parent_path() /
+              (".tmp-link-" + std::to_string(::getpid()) + "-" +
+               std::to_string(counter.fetch_add(1)));
+  if (::symlink(std::string(target).c_str(), temp.c_str()) != 0) {
+    return errno_error("Cannot create link", temp);
+  }
+  if (::rename(temp.c_str(), path.c_str()) != 0) {
+    auto error = errno_error("Cannot rename link to", path);
+    ::unlink(temp.c_str());
+    return error;
+  }
+  return std::nullopt;
+}
+
+// Streams the blob into place, so a compressed object is never held whole
+std::optional<Error> write_regular(const std::filesystem::path &path,
+                                   const ObjectStore &store,
+                                   const ObjectId &id, mode_t mode,
+                                   bool durable, std::uint64_t &size) {
+  TempFile file;
+  if (auto error = TempFile::create(path.parent_path(), file)) {
+    return error;
+  }
+  auto begin = [&](ObjectType type,
+                   std::uint64_t length) -> std::optional<Error> {
+    if (type != ObjectType::Blob) {
+      return create_error(ErrorCode::CorruptObject, "Not a blob: " + id.hex());
+    }
+    size = length;
+    // Reserving the final size up front keeps large files contiguous and
+    // surfaces ENOSPC before any data is written
+    if (length > 0) {
+      int rc = ::posix_fallocate(file.fd(), 0, static_cast<off_t>(length));
+      if (rc != 0 && rc != EOPNOTSUPP && rc != EINVAL) {
+        errno = rc;
+        return errno_error("Cannot allocate", path);
+      }
+    }
+    return std::nullopt;
+  };
+  auto chunk = [&](std::string_view data) { return file.write(data); };
+  if (auto error = store.read_stream(id, begin, chunk)) {
+    return error;
+  }
+  if (::fchmod(file.fd(), mode) != 0) {
+    return errno_error("Cannot set mode of", path);
+  }
+  if (durable) {
+    if (auto error = file.sync()) {
+      return error;
+    }
+  }
+  return file.commit(path);
+}
+
+std::optional<Error> read_journal(const std::filesystem::path &path,
+                                  std::string &ref, ObjectId &tree) {
+  std::string contents;
+  if (auto error = read_file(path, contents)) {
+    return error;
+  }
+  auto newline = contents.find('\n');
+  auto second = contents.find('\n', newline + 1);
+  if (newline == std::string::npos || second == std::string::npos ||
+      contents.rfind("ref: ", 0) != 0 ||
+      contents.compare(newline + 1, 5, "tree ") != 0) {
+    return create_error(ErrorCode::CorruptObject,
+                        "Malformed checkout journal: " + path.string());
+  }
+  ref = contents.substr(5, newline - 5);
+  auto id = ObjectId::from_hex(
+      std::string_view(contents).substr(newline + 6, second - newline - 6));
+  if (!id || !is_valid_ref_name(ref)) {
+    return create_error(ErrorCode::CorruptObject,
+                        "Malformed checkout journal: " + path.string());
+  }
+  tree = *id;
+  return std::nullopt;
+}
+
+} // namespace
+
+std::optional<Error> plan_checkout(const std::filesystem::path &root,
+                                   const ObjectStore &store, WorkPool &pool,
+                                   const ObjectId &tree,
+                                   const std::optional<ObjectId> &base_tree,
+                                   CheckoutPlan &out,
+                                   const CheckoutOptions &options) {
+  CHRONA_TRACE_SCOPE("checkout.plan");
+  out = CheckoutPlan();
+  SparseCone cone;
+  if (options.cone) {
+    cone = *options.cone;
+  } else if (auto error = SparseCone::load(root / ".chrona", cone)) {
+    return error;
+  }
+  if (auto error = read_tree_files(store, tree, out.index, &cone)) {
+    return error;
+  }
+  IndexView index;
+  if (auto error = IndexView::open(root / ".chrona" / "index", index)) {
+    return error;
+  }
+
+  // Merge-join the sorted index against the sorted target. `touched`
+  // records the index position of every path that changes (or SIZE_MAX
+  // for paths the index does not have). Sparse directories are never
+  // written or removed: one the index drops goes to `sparse_dropped`, so
+  // it can be checked against `base_tree` like a touched file.
+  std::vector<std::size_t> touched;
+  std::vector<std::size_t> sparse_dropped;
+  std::vector<std::string> untracked;
+  auto add_write = [&](std::size_t t) {
+    if (out.index[t].stat.mode != EntryMode::Directory) {
+      out.writes.push_back(t);
+      untracked.push_back(out.index[t].path);
+    }
+  };
+  std::size_t i = 0;
+  std::size_t t = 0;
+  while (i < index.size() || t < out.index.size()) {
+    int order = i == index.size()       ? 1
+                : t == out.index.size() ? -1
+                : index.path(i).compare(out.index[t].path);
+    if (order < 0) {
+      if (index.is_sparse_dir(i)) {
+        sparse_dropped.push_back(i++);
+        continue;
+      }
+      out.removes.emplace_back(index.path(i));
+      touched.push_back(i++);
+      continue;
+    }
+    if (order > 0) {
+      add_write(t++);
+      continue;
+    }
+    auto &entry = out.index[t];
+    if (index.id(i) == entry.id && index.stat(i).mode == entry.stat.mode) {
+      // Unchanged: the cached stat data carries over
+      entry.stat = index.stat(i);
+    } else if (index.is_sparse_dir(i)) {
+      sparse_dropped.push_back(i);
+      add_write(t);
+    } else if (entry.stat.mode == EntryMode::Directory) {
+      out.removes.emplace_back(index.path(i));
+      touched.push_back(i);
+    } else {
+      out.writes.push_back(t);
+      touched.push_back(i);
+    }
+    ++i;
+    ++t;
+  }
+  if (options.force) {
+    return std::nullopt;
+  }
+
+  // Staged changes would be lost just like unstaged ones
+  if (base_tree) {
+    TreeLookup base(store, *base_tree);
+    for (auto position : touched) {
+      std::string path(index.path(position));
+      const TreeEntry *committed = nullptr;
+      if (auto error = base.find(path, committed)) {
+        return error;
+      }
+      if (committed == nullptr || committed->id != index.id(position) ||
+          committed->mode != index.stat(position).mode) {
+        return would_overwrite(path, "staged changes");
+      }
+    }
+    for (auto position : sparse_dropped) {
+      std::string path(index.path(position));
+      const TreeEntry *committed = nullptr;
+      if (auto error = base.find(path, committed)) {
+        return error;
+      }
+      if (committed == nullptr || committed->id != index.id(position) ||
+          committed->mode != EntryMode::Directory) {
+        return would_overwrite(path, "staged changes");
+      }
+    }
+  }
+
+  FirstError failure;
+  pool.parallel_for(touched.size(), 256, [&](std::size_t begin,
+                                             std::size_t end) {
+    for (std::size_t k = begin; k < end && !failure.failed(); ++k) {
+      if (auto error = check_unmodified(root, index, touched[k])) {
+        failure.set(std::move(error));
+      }
+    }
+  });
+  pool.parallel_for(untracked.size(), 256, [&](std::size_t begin,
+                                               std::size_t end) {
+    for (std::size_t k = begin; k < end && !failure.failed(); ++k) {
+      const auto &path = untracked[k];
+      struct stat st;
+      trace_count(TraceCounter::StatCalls);
+      if (::lstat((root / path).c_str(), &st) != 0) {
+        // Some parent is not a directory: unless it is a tracked file
+        // this checkout replaces, it stops the directory being created
+        if (errno == ENOTDIR) {
+          if (auto blocker = untracked_parent(root, index, path)) {
+            failure.set(would_overwrite(*blocker, "an untracked file"));
+          }
+        }
+        continue;
+      }
+      // A directory of tracked files that this checkout removes is fine
+      if (S_ISDIR(st.st_mode) && index.has_prefix(path + "/")) {
+        continue;
+      }
+      failure.set(would_overwrite(path, "an untracked file"));
+    }
+  });
+  return failure.take();
+}
+
+std::optional<Error> apply_checkout(const std::filesystem::path &root,
+                                    const ObjectStore &store, WorkPool &pool,
+                                    CheckoutPlan &plan, CheckoutResult &out,
+                                    const CheckoutOptions &options) {
+  CHRONA_TRACE_SCOPE("checkout.apply");
+  out = CheckoutResult();
+
+  // Removals go first so a file can turn into a directory and back
+  std::set<std::string> emptied;
+  for (const auto &path : plan.removes) {
+    if (::unlink((root / path).c_str()) != 0 && errno != ENOENT) {
+      return errno_error("Cannot remove", root / path);
+    }
+    emptied.insert(parent_of(path));
+    ++out.removed;
+  }
+  // Deepest first, so a parent is only tried once its children are gone
+  for (auto it = emptied.rbegin(); it != emptied.rend(); ++it) {
+    prune_empty_parents(root, *it);
+  }
+
+  // Every directory the new files need, parents before children
+  std::vector<std::string> dirs;
+  for (auto position : plan.writes) {
+    for (auto dir = parent_of(plan.index[position].path); !dir.empty();
+         dir = parent_of(dir)) {
+      dirs.push_back(dir);
+    }
+  }
+  std::sort(dirs.begin(), dirs.end());
+  dirs.erase(std::unique(dirs.begin(), dirs.end()), dirs.end());
+  for (const auto &dir : dirs) {
+    auto path = root / dir;
+    if (::mkdir(path.c_str(), 0777) != 0 && errno != EEXIST) {
+      return errno_error("Cannot create directory", path);
+    }
+  }
+
+  mode_t mask = ::umask(0);
+  ::umask(mask);
+  FirstError failure;
+  std::atomic<std::uint64_t> bytes{0};
+  pool.parallel_for(
+      plan.writes.size(), std::max<std::size_t>(1, options.files_per_task),
+      [&](std::size_t begin, std::size_t end) {
+        CHRONA_TRACE_SCOPE("checkout.write_files");
+        for (std::size_t k = begin; k < end && !failure.failed(); ++k) {
+          auto &entry = plan.index[plan.writes[k]];
+          auto path = root / entry.path;
+          mode_t mode =
+              (entry.stat.mode == EntryMode::Executable ? 0777 : 0666) & ~mask;
+          std::uint64_t size = 0;
+          std::optional<Error> error;
+          if (entry.stat.mode == EntryMode::Symlink) {
+            ObjectView blob;
+            error = store.read(entry.id, blob);
+            if (!error && blob.type() != ObjectType::Blob) {
+              error = create_error(ErrorCode::CorruptObject,
+                                   "Not a blob: " + entry.id.hex());
+            }
+            if (!error) {
+              size = blob.size();
+              error = write_symlink(path, blob.content());
+            }
+          } else {
+            error = write_regular(path, store, entry.id, mode,
+                                  options.durable, size);
+          }
+          if (!error) {
+            error = stat_file(path, entry.stat);
+          }
+          if (error) {
+            failure.set(std::move(error));
+            return;
+          }
+          bytes.fetch_add(size, std::memory_order_relaxed);
+        }
+      });
+  if (auto error = failure.take()) {
+    return error;
+  }
+
+  if (options.durable) {
+    std::set<std::string> written_dirs;
+    for (auto position : plan.writes) {
+      written_dirs.insert(parent_of(plan.index[position].path));
+    }
+    for (const auto &dir : written_dirs) {
+      if (auto error = fsync_directory(dir.empty() ? root : root / dir)) {
+        return error;
+      }
+    }
+  }
+
+  out.written = plan.writes.size();
+  out.unchanged = plan.index.size() - plan.writes.size();
+  out.bytes = bytes.load();
+  return write_index(root / ".chrona" / "index", std::move(plan.index),
+                     options.durable);
+}
+
+std::optional<Error> checkout_tree(const std::filesystem::path &root,
+                                   const ObjectStore &store, WorkPool &pool,
+                                   const ObjectId &tree,
+                                   const std::optional<ObjectId> &base_tree,
+                                   CheckoutResult &out,
+                                   const CheckoutOptions &options) {
+  CheckoutPlan plan;
+  if (auto error =
+          plan_checkout(root, store, pool, tree, base_tree, plan, options)) {
+    return error;
+  }
+  return apply_checkout(root, store, pool, plan, out, options);
+}
+
+std::optional<Error> switch_branch(const std::filesystem::path &root,
+                                   const ObjectStore &store, WorkPool &pool,
+                                   const std::string &ref, CheckoutResult &out,
+                                   const CheckoutOptions &options) {
+  auto chrona_dir = root / ".chrona";
+  bool resumed = false;
+  if (auto error = resume_checkout(root, store, pool, resumed)) {
+    return error;
+  }
+
+  std::optional<ObjectId> target;
+  if (auto error = read_ref(chrona_dir, ref, target)) {
+    return error;
+  }
+  if (!target) {
+    return create_error(ErrorCode::NotFound, "No such branch: " + ref);
+  }
+  ObjectId tree;
+  if (auto error = commit_tree(store, *target, tree)) {
+    return error;
+  }
+
+  std::string head;
+  std::optional<ObjectId> head_commit;
+  if (auto error = read_head(chrona_dir, head)) {
+    return error;
+  }
+  if (auto error = read_ref(chrona_dir, head, head_commit)) {
+    return error;
+  }
+  std::optional<ObjectId> base_tree;
+  if (head_commit) {
+    base_tree.emplace();
+    if (auto error = commit_tree(store, *head_commit, *base_tree)) {
+      return error;
+    }
+  }
+
+  CheckoutPlan plan;
+  if (auto error =
+          plan_checkout(root, store, pool, tree, base_tree, plan, options)) {
+    return error;
+  }
+  // From here on the working tree may be half switched; the journal lets
+  // the next checkout finish the job
+  auto journal = chrona_dir / "CHECKOUT";
+  if (auto error = write_file_atomic(
+          journal, "ref: " + ref + "\ntree " + tree.hex() + "\n", true)) {
+    return error;
+  }
+  if (auto error = apply_checkout(root, store, pool, plan, out, options)) {
+    return error;
+  }
+  if (auto error = write_head(chrona_dir, ref)) {
+    return error;
+  }
+  if (::unlink(journal.c_str()) != 0) {
+    return errno_error("Cannot remove", journal);
+  }
+  return std::nullopt;
+}
+
+std::optional<Error> resume_checkout(const std::filesystem::path &root,
+                                     const ObjectStore &store, WorkPool &pool,
+                                     bool &resumed) {
+  resumed = false;
+  auto chrona_dir = root / ".chrona";
+  auto journal = chrona_dir / "CHECKOUT";
+  std::string ref;
+  ObjectId tree;
+  if (auto error = read_journal(journal, ref, tree)) {
+    if (error->error_code == ErrorCode::NotFound) {
+      return std::nullopt;
+    }
+    return error;
+  }
+
+  // Paths already switched now look like local changes, so the
+  // roll-forward is forced
+  CheckoutOptions options;
+  options.force = true;
+  options.durable = true;
+  CheckoutResult result;
+  if (auto error = checkout_tree(root, store, pool, tree, std::nullopt, result,
+                                options)) {
+    return error;
+  }
+  if (auto error = write_head(chrona_dir, ref)) {
+    return error;
+  }
+  if (::unlink(journal.c_str()) != 0) {
+    return errno_error("Cannot remove", journal);
+  }
+  resumed = true;
+  return std::nullopt;
+}
+
+} // namespace chrona
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "errors/error.hpp"
+#include "index/index.hpp"
+#include "objects/object_store.hpp"
+#include "parallel/work_pool.hpp"
+#include "sparse/sparse.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace chrona {
+
+struct CheckoutOptions {
+  // Overwrite local modifications and untracked files in the way.
+  bool force = false;
+  // fsync every written file, its directory and the index.
+  bool durable = false;
+  // Files written per pool task.
+  std::size_t files_per_task = 16;
+  // The sparse cone to check out; .chrona/sparse when unset.
+  std::optional<SparseCone> cone;
+};
+
+// What a checkout will do, worked out without touching anything.
+struct CheckoutPlan {
+  std::vector<IndexEntry> index;    // the new index; stat data to be filled
+  std::vector<std::size_t> writes;  // positions in `index` to materialise
+  std::vector<std::string> removes; // tracked paths that go away
+};
+
+struct CheckoutResult {
+  std::size_t written = 0;
+  std::size_t removed = 0;
+  std::size_t unchanged = 0;
+  std::uint64_t bytes = 0;
+};
+
+// Diffs `tree` against the index so that only paths whose id or mode
+// differ are touched. Unless forced, fails if one of those paths has
+// unstaged changes, staged changes against `base_tree` (the tree HEAD
+// points at, if any), or is an untracked file in the way. Directories
+// outside the sparse cone become sparse entries in the new index and are
+// neither read nor written.
+std::optional<Error> plan_checkout(const std::filesystem::path &root,
+                                   const ObjectStore &store, WorkPool &pool,
+                                   const ObjectId &tree,
+                                   const std::optional<ObjectId> &base_tree,
+                                   CheckoutPlan &out,
+                                   const CheckoutOptions &options = {});
+
+// Carries out a plan: removals first, then every missing directory in one
+// sorted pass, then the files on `pool`. Each file goes into a
+// preallocated temp file that is renamed over its path, so a path only
+// ever holds its old or its new contents. The index is written last.
+std::optional<Error> apply_checkout(const std::filesystem::path &root,
+                                    const ObjectStore &store, WorkPool &pool,
+                                    CheckoutPlan &plan, CheckoutResult &out,
+                                    const CheckoutOptions &options = {});
+
+// plan_checkout() followed by apply_checkout().
+std::optional<Error> checkout_tree(const std::filesystem::path &root,
+                                   const ObjectStore &store, WorkPool &pool,
+                                   const ObjectId &tree,
+                                   const std::optional<ObjectId> &base_tree,
+                                   CheckoutResult &out,
+                                   const CheckoutOptions &options = {});
+
+// Checks out the commit `ref` points at and points HEAD at `ref`. The
+// target is journalled in .chrona/CHECKOUT before the working tree is
+// touched, and an interrupted switch is finished (rolled forward) before
+// a new one starts.
+std::optional<Error> switch_branch(const std::filesystem::path &root,
+                                   const ObjectStore &store, WorkPool &pool,
+                                   const std::string &ref, CheckoutResult &out,
+                                   const CheckoutOptions &options = {});
+
+// Finishes an interrupted switch_branch(), if there is one.
+std::optional<Error> resume_checkout(const std::filesystem::path &root,
+                                     const ObjectStore &store, WorkPool &pool,
+                                     bool &resumed);
+
+} // namespace chrona
@@ -1,46 +1,264 @@
 #include "cli.hpp"
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <optional>
+#include <span>
 
 namespace chrona {
 
-ParseResult parse_args(int argc, char *argv[]) {
+namespace {
 
-  if (argc > 2) {
-    return ParseResult{
-        ParseAction::Error, std::nullopt, {}, "Too many arguments provided"};
+enum class OptionValue : std::uint8_t {
+  None,   // a plain flag
+  Next,   // takes the following argument ("-n 5")
+  Joined, // the value follows the name ("-U3", "--budget=10")
+};
+
+struct OptionSpec {
+  std::string_view name;
+  OptionValue value;
+};
+
+constexpr std::size_t unlimited = SIZE_MAX;
+
+struct CommandSpec {
+  std::string_view name;
+  Command command;
+  std::span<const OptionSpec> options;
+  std::size_t max_operands;
+  std::string_view summary;
+};
+
+constexpr OptionSpec commit_options[] = {{"-m", OptionValue::Next}};
+constexpr OptionSpec log_options[] = {{"-n", OptionValue::Next}};
+constexpr OptionSpec merge_base_options[] = {
+    {"--is-ancestor", OptionValue::None}};
+constexpr OptionSpec diff_options[] = {{"--myers", OptionValue::None},
+                                       {"--histogram", OptionValue::None},
+                                       {"--patience", OptionValue::None},
+                                       {"-U", OptionValue::Joined}};
+constexpr OptionSpec gc_options[] = {{"--budget=", OptionValue::Joined},
+                                     {"--grace=", OptionValue::Joined}};
+constexpr OptionSpec checkout_options[] = {{"-f", OptionValue::None},
+                                           {"--force", OptionValue::None}};
+constexpr OptionSpec fsck_options[] = {{"--sample=", OptionValue::Joined},
+                                       {"--incremental", OptionValue::None}};
+constexpr OptionSpec cat_file_options[] = {
+    {"-t", OptionValue::None},
+    {"-s", OptionValue::None},
+    {"--batch", OptionValue::None},
+    {"--batch-check", OptionValue::None}};
+
+// Also the order of `chrona --help`. A '\n' in a summary continues it on
+// the next line, under the first.
+constexpr CommandSpec command_specs[] = {
+    {"init", Command::Init, {}, 0, "Initialize a new repository"},
+    {"add", Command::Add, {}, unlimited,
+     "Stage files (default: the whole working tree)"},
+    {"status", Command::Status, {}, 0,
+     "Show working tree changes against the index"},
+    {"diff", Command::Diff, diff_options, 0,
+     "Show unstaged changes as a unified diff"},
+    {"commit", Command::Commit, commit_options, 0,
+     "Record the index as a new commit (-m <message>)"},
+    {"checkout", Command::Checkout, checkout_options, 1,
+     "Switch the working tree to a branch ([-f] <branch>)"},
+    {"log", Command::Log, log_options, 2,
+     "Show history ([-n <count>] [<revision>] [-- <path>])"},
+    {"merge", Command::Merge, {}, 1,
+     "Merge a branch or commit into the current branch (<revision>)"},
+    {"merge-base", Command::MergeBase, merge_base_options, 2,
+     "Find common ancestors ([--is-ancestor] <a> <b>)"},
+    {"commit-graph", Command::CommitGraph, {}, 0,
+     "Write the commit-graph file for fast traversal"},
+    {"pack", Command::Pack, {}, 0,
+     "Compact all objects into one delta-compressed pack"},
+    {"gc", Command::Gc, gc_options, 0,
+     "Delete unreachable objects ([--budget=<ms>] [--grace=<seconds>])"},
+    {"count-objects", Command::CountObjects, {}, 0,
+     "Count stored objects, and the objects reachable from the refs"},
+    {"fsck", Command::Fsck, fsck_options, 0,
+     "Verify every object and the links from the refs, MERGE_HEAD and\n"
+     "the index ([--sample=<percent>], or [--incremental] to rehash only\n"
+     "new objects; the links are still walked in full)"},
+    {"bundle", Command::Bundle, {}, unlimited,
+     "Write refs and their objects to one file, or import one\n"
+     "(create <file> [<ref>|^<rev>|<rev>..<ref>]..., unbundle <file>)"},
+    {"sparse", Command::Sparse, {}, unlimited,
+     "Limit the working tree to some directories\n"
+     "(set <dir>..., list, disable)"},
+    {"daemon", Command::Daemon, {}, 1,
+     "Watch the tree to answer status instantly ([start|run|stop])"},
+    {"cat-file", Command::CatFile, cat_file_options, 1,
+     "Print objects ([-t|-s] <revision>, or --batch and --batch-check\n"
+     "reading ids from stdin)"},
+};
+
+constexpr const CommandSpec *find_command(std::string_view name) {
+  for (const auto &spec : command_specs) {
+    if (name == spec.name) {
+      return &spec;
+    }
+  }
+  return nullptr;
+}
+
+constexpr bool every_command_listed_once() {
+  for (std::size_t i = 0; i < command_count; ++i) {
+    std::size_t listed = 0;
+    for (const auto &spec : command_specs) {
+      listed += static_cast<std::size_t>(spec.command) == i;
+    }
+    if (listed != 1) {
+      return false;
+    }
+  }
+  return std::size(command_specs) == command_count;
+}
+
+static_assert(every_command_listed_once(),
+              "command_specs must list every Command exactly once");
+static_assert(find_command("cat-file")->command == Command::CatFile);
+
+const OptionSpec *find_option(const CommandSpec &spec, std::string_view arg) {
+  for (const auto &option : spec.options) {
+    if (option.value == OptionValue::Joined
+            ? arg.size() > option.name.size() && arg.starts_with(option.name)
+            : arg == option.name) {
+      return &option;
+    }
   }
+  return nullptr;
+}
+
+// Fills in the options, operands and separator of `out` from `args`.
+std::optional<std::string> check_args(const CommandSpec &spec,
+                                      const ArgList &args, ParseResult &out) {
+  std::array<std::size_t, OperandList::max_skipped> skipped;
+  std::size_t skipped_count = 0;
+  std::size_t operands = 0;
+  bool options_done = false;
+  for (std::size_t i = 0; i < args.size(); ++i) {
+    auto arg = args[i];
+    if (!options_done && arg == "--") {
+      options_done = true;
+      out.separator = operands;
+      skipped[skipped_count++] = i;
+      continue;
+    }
+    if (options_done || arg.size() < 2 || arg[0] != '-') {
+      if (++operands > spec.max_operands) {
+        return "Too many arguments provided";
+      }
+      continue;
+    }
+    const auto *option = find_option(spec, arg);
+    if (option == nullptr) {
+      return "Unknown option for " + std::string(spec.name) + ": " +
+             std::string(arg);
+    }
+    if (out.options.size() == max_options) {
+      return "Too many options provided";
+    }
+    ParsedOption parsed{option->name, {}};
+    skipped[skipped_count++] = i;
+    if (option->value == OptionValue::Joined) {
+      parsed.value = arg.substr(option->name.size());
+    } else if (option->value == OptionValue::Next) {
+      if (++i == args.size()) {
+        return "Option " + std::string(arg) + " needs a value";
+      }
+      parsed.value = args[i];
+      skipped[skipped_count++] = i;
+    }
+    out.options.add(parsed);
+  }
+  out.operands = OperandList(args, skipped.data(), skipped_count);
+  return std::nullopt;
+}
+
+} // namespace
+
+ParseResult parse_args(int argc, char *argv[]) {
 
   if (argc == 1) {
     return ParseResult{
         ParseAction::ShowHelp, std::nullopt, {}, "No arguments provided"};
   }
 
-  if (std::string(argv[1]) == "--help") {
+  std::string_view name = argv[1];
+  if (name == "--help") {
+    if (argc > 2) {
+      return ParseResult{
+          ParseAction::Error, std::nullopt, {}, "Too many arguments provided"};
+    }
     return ParseResult{ParseAction::ShowHelp, std::nullopt, {}, std::nullopt};
   }
 
-  if (std::string(argv[1]) == "init") {
-    return ParseResult{
-        ParseAction::RunCommand, Command::Init, {}, std::nullopt};
+  const CommandSpec *spec = find_command(name);
+  if (spec == nullptr) {
+    return ParseResult{ParseAction::Error,
+                       std::nullopt,
+                       {},
+                       "Unknown command: " + std::string(name)};
   }
 
-  return ParseResult{ParseAction::Error,
-                     std::nullopt,
-                     {},
-                     "Unknown command: " + std::string(argv[1])};
+  ArgList args(argv + 2, static_cast<std::size_t>(argc - 2));
+  ParseResult result{ParseAction::RunCommand, spec->command, args,
+                     std::nullopt};
+  if (auto message = check_args(*spec, args, result)) {
+    return ParseResult{ParseAction::Error, std::nullopt, {}, message};
+  }
+  return result;
+}
+
+std::optional<std::string> take_trace_option(int &argc, char *argv[]) {
+  if (argc > 1 && std::strncmp(argv[1], "--trace", 7) == 0 &&
+      (argv[1][7] == '\0' || argv[1][7] == '=')) {
+    std::string spec = argv[1][7] == '=' ? argv[1] + 8 : "1";
+    for (int i = 1; i + 1 < argc; ++i) {
+      argv[i] = argv[i + 1];
+    }
+    --argc;
+    return spec.empty() ? "1" : spec;
+  }
+  const char *variable = std::getenv("CHRONA_TRACE");
+  if (variable != nullptr && *variable != '\0') {
+    return std::string(variable);
+  }
+  return std::nullopt;
 }
 
 void print_usage() {
+  constexpr std::size_t name_width = 14;
+  std::cout << "Usage: chrona [--trace[=<file>]] <command> [args...]"
+            << std::endl
+            << std::endl
+            << "Commands:" << std::endl;
+  for (const auto &spec : command_specs) {
+    std::cout << "  " << spec.name
+              << std::string(name_width - spec.name.size(), ' ');
+    auto summary = spec.summary;
+    for (auto newline = summary.find('\n'); newline != std::string_view::npos;
+         newline = summary.find('\n')) {
+      std::cout << summary.substr(0, newline) << std::endl
+                << std::string(2 + name_width, ' ');
+      summary.remove_prefix(newline + 1);
+    }
+    std::cout << summary << std::endl;
+  }
   std::cout
-      << "Usage: chrona <command> [args...]" << std::endl
+      << "  help          Show help" << std::endl
+      << std::endl
+      << "Set CHRONA_TRACE=1 or pass --trace first for a timing summary,"
       << std::endl
-      << "Commands:" << std::endl
-      << "  init    Initialize a new repository" << std::endl
-      << "  help    Show help" << std::endl
+      << "or --trace=<file.json> for a Chrome trace." << std::endl
       << std::endl
       << "For more information, see the documentation at https://chrona.com"
       << std::endl;
 }
 
-} // namespace chrona
\ No newline at end of file
+} // namespace chrona
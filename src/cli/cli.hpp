@@ -1,24 +1,228 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <iterator>
 #include <optional>
 #include <string>
-#include <vector>
+#include <string_view>
+#include <utility>
 
 namespace chrona {
 
 enum class Command {
   Init,
+  Add,
+  Status,
+  Pack,
+  Commit,
+  Log,
+  MergeBase,
+  CommitGraph,
+  Diff,
+  Gc,
+  Checkout,
+  Daemon,
+  CatFile,
+  Merge,
+  CountObjects,
+  Bundle,
+  Fsck,
+  Sparse,
 };
 
+inline constexpr std::size_t command_count =
+    static_cast<std::size_t>(Command::Sparse) + 1;
+
 enum class ParseAction { RunCommand, ShowHelp, Error };
 
+// The arguments after the command name, viewed in place in argv: parsing
+// and reading them never copies or allocates.
+class ArgList {
+public:
+  class iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::string_view;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = std::string_view;
+
+    iterator() = default;
+    explicit iterator(char *const *at) : at_(at) {}
+    std::string_view operator*() const { return *at_; }
+    iterator &operator++() {
+      ++at_;
+      return *this;
+    }
+    iterator operator++(int) { return iterator(at_++); }
+    bool operator==(const iterator &other) const = default;
+
+  private:
+    char *const *at_ = nullptr;
+  };
+
+  ArgList() = default;
+  ArgList(char *const *argv, std::size_t count)
+      : argv_(argv), count_(count) {}
+
+  std::size_t size() const { return count_; }
+  bool empty() const { return count_ == 0; }
+  std::string_view operator[](std::size_t i) const { return argv_[i]; }
+  iterator begin() const { return iterator(argv_); }
+  iterator end() const { return iterator(argv_ + count_); }
+
+private:
+  char *const *argv_ = nullptr;
+  std::size_t count_ = 0;
+};
+
+// An option as the command table declares it ("-n", "-U", "--budget="),
+// with the text after the name for a joined one ("3" of "-U3"), the next
+// argument for one that takes it, and nothing for a flag.
+struct ParsedOption {
+  std::string_view name;
+  std::string_view value;
+};
+
+// A command line carries at most this many options, so they fit in place.
+inline constexpr std::size_t max_options = 16;
+
+// The options of a command line in the order given, repeats included.
+class OptionList {
+public:
+  std::size_t size() const { return count_; }
+  bool empty() const { return count_ == 0; }
+  const ParsedOption *begin() const { return options_.data(); }
+  const ParsedOption *end() const { return options_.data() + count_; }
+  // The last one given under `name`, or null.
+  const ParsedOption *find(std::string_view name) const {
+    for (auto i = count_; i > 0; --i) {
+      if (options_[i - 1].name == name) {
+        return &options_[i - 1];
+      }
+    }
+    return nullptr;
+  }
+
+  // Ignored once max_options are in.
+  void add(ParsedOption option) {
+    if (count_ < max_options) {
+      options_[count_++] = option;
+    }
+  }
+
+private:
+  std::array<ParsedOption, max_options> options_{};
+  std::size_t count_ = 0;
+};
+
+// The operands among the arguments, in order: everything but the options,
+// their values and the "--" ending them. Views into argv like ArgList;
+// what is left out is at most one index per option, value and "--".
+class OperandList {
+public:
+  static constexpr std::size_t max_skipped = 2 * max_options + 1;
+
+  class iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::string_view;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = std::string_view;
+
+    iterator() = default;
+    iterator(const OperandList *list, std::size_t at)
+        : list_(list), at_(at) {
+      settle();
+    }
+    std::string_view operator*() const { return list_->args_[at_]; }
+    iterator &operator++() {
+      ++at_;
+      settle();
+      return *this;
+    }
+    iterator operator++(int) {
+      auto copy = *this;
+      ++*this;
+      return copy;
+    }
+    bool operator==(const iterator &other) const { return at_ == other.at_; }
+
+  private:
+    // Steps over left-out arguments, which are sorted
+    void settle() {
+      while (skip_ < list_->skipped_count_ &&
+             list_->skipped_[skip_] <= at_) {
+        if (list_->skipped_[skip_++] == at_) {
+          ++at_;
+        }
+      }
+    }
+
+    const OperandList *list_ = nullptr;
+    std::size_t at_ = 0;
+    std::size_t skip_ = 0;
+  };
+
+  OperandList() = default;
+  // `skipped` lists the indices into `args` that are not operands, in
+  // increasing order; at most max_skipped are kept.
+  OperandList(ArgList args, const std::size_t *skipped, std::size_t count)
+      : args_(args), skipped_count_(std::min(count, max_skipped)) {
+    std::copy(skipped, skipped + skipped_count_, skipped_.begin());
+  }
+
+  std::size_t size() const { return args_.size() - skipped_count_; }
+  bool empty() const { return size() == 0; }
+  std::string_view operator[](std::size_t i) const {
+    for (std::size_t k = 0; k < skipped_count_ && skipped_[k] <= i; ++k) {
+      ++i;
+    }
+    return args_[i];
+  }
+  iterator begin() const { return iterator(this, 0); }
+  iterator end() const { return iterator(this, args_.size()); }
+
+private:
+  ArgList args_;
+  std::array<std::size_t, max_skipped> skipped_{};
+  std::size_t skipped_count_ = 0;
+};
+
 struct ParseResult {
+  ParseResult(ParseAction action, std::optional<Command> command,
+              ArgList args, std::optional<std::string> error_message)
+      : action(action), command(command), args(args),
+        error_message(std::move(error_message)) {}
+
   ParseAction action;
   std::optional<Command> command;
-  std::vector<std::string> args;
+  // Everything after the command name, as given.
+  ArgList args;
   std::optional<std::string> error_message;
+  // What the command table makes of `args`; commands read these rather
+  // than scanning `args` again.
+  OptionList options;
+  OperandList operands;
+  // How many operands came before "--", when it was given.
+  std::optional<std::size_t> separator;
 };
 
+// Looks the command up in the command table and checks its arguments
+// against the options the table declares for it: unknown options, options
+// missing their value, more than max_options options and surplus operands
+// are rejected here, before any command code runs. Everything after "--"
+// is an operand.
 ParseResult parse_args(int argc, char *argv[]);
 
+// Removes a leading "--trace" (summary) or "--trace=<file>" (Chrome JSON)
+// from argv and returns its start_trace() spec. Without the flag, falls
+// back to the CHRONA_TRACE environment variable.
+std::optional<std::string> take_trace_option(int &argc, char *argv[]);
+
 void print_usage();
 
-} // namespace chrona
\ No newline at end of file
+} // namespace chrona
@@ -0,0 +1,176 @@
+#include "commands.hpp"
+#include "fsmonitor/daemon.hpp"
+#include "index/index.hpp"
+#include "objects/object_store.hpp"
+#include "parallel/work_pool.hpp"
+#include "snapshot/tree_builder.hpp"
+#include <algorithm>
+#include <iostream>
+#include <set>
+#include <sys/stat.h>
+
+namespace chrona {
+
+namespace {
+
+bool covered_by(std::string_view path, const std::vector<std::string> &specs) {
+  return std::any_of(specs.begin(), specs.end(), [&](const std::string &spec) {
+    return spec.empty() || path == spec ||
+           (path.size() > spec.size() && path[spec.size()] == '/' &&
+            path.substr(0, spec.size()) == spec);
+  });
+}
+
+// With a daemon running, directories need not be walked: each one is
+// replaced by the changed paths the daemon reports below it
+std::vector<std::string> narrow_specs(const std::filesystem::path &root,
+                                      const std::vector<std::string> &specs,
+                                      const std::vector<StatusChange> &changes,
+                                      std::set<std::string> &reported) {
+  std::vector<std::string> out;
+  for (const auto &spec : specs) {
+    struct stat st;
+    if (!spec.empty() &&
+        (::lstat((root / spec).c_str(), &st) != 0 || !S_ISDIR(st.st_mode))) {
+      out.push_back(spec);
+      continue;
+    }
+    for (const auto &change : changes) {
+      auto path = change.path;
+      if (!path.empty() && path.back() == '/') {
+        path.pop_back();
+        // Inside an untracked directory: walk the spec as given
+        if (covered_by(spec, {path})) {
+          out.push_back(spec);
+          continue;
+        }
+      }
+      if (covered_by(path, {spec})) {
+        reported.insert(path);
+        out.push_back(std::move(path));
+      }
+    }
+  }
+  std::sort(out.begin(), out.end());
+  out.erase(std::unique(out.begin(), out.end()), out.end());
+  return out;
+}
+
+// The sparse directory at or above `path`, if there is one
+std::optional<std::string> sparse_parent(const IndexView &index,
+                                         const std::string &path) {
+  for (auto end = path.size(); end != 0 && end != std::string::npos;
+       end = path.rfind('/', end - 1)) {
+    auto found = index.find(std::string_view(path).substr(0, end));
+    if (found && index.is_sparse_dir(*found)) {
+      return path.substr(0, end);
+    }
+  }
+  return std::nullopt;
+}
+
+} // namespace
+
+int run_add(const ParseResult &args) {
+  Repository *repo = nullptr;
+  if (auto error = Repository::current(repo)) {
+    return report_error(*error);
+  }
+  const auto &root = repo->root();
+  const auto &chrona_dir = repo->chrona_dir();
+
+  // No paths stages the whole working tree, deletions included
+  std::vector<std::string> specs;
+  for (auto arg : args.operands) {
+    if (arg == "--") {
+      continue;
+    }
+    std::string spec;
+    if (auto error = repo_relative_path(*repo, arg, spec)) {
+      return report_error(*error);
+    }
+    specs.push_back(std::move(spec));
+  }
+  if (specs.empty()) {
+    specs.emplace_back();
+  }
+
+  std::set<std::string> reported;
+  std::vector<StatusChange> changes;
+  if (!query_daemon(chrona_dir, changes)) {
+    specs = narrow_specs(root, specs, changes, reported);
+  }
+
+  IndexView index;
+  if (auto error = IndexView::open(chrona_dir / "index", index)) {
+    return report_error(*error);
+  }
+
+  auto &store = repo->objects();
+  auto &pool = repo->pool();
+  std::vector<IndexEntry> staged;
+  std::size_t hashed = 0;
+
+  for (const auto &spec : specs) {
+    if (auto sparse = sparse_parent(index, spec)) {
+      return report_error(*create_error(
+          ErrorCode::InvalidArgument,
+          "Path is outside the sparse cone: " + spec +
+              " (widen it with chrona sparse set)"));
+    }
+    auto path = spec.empty() ? root : root / spec;
+    struct stat st;
+    if (::lstat(path.c_str(), &st) != 0) {
+      // A vanished path stages its deletion, if it was tracked at all
+      if (!reported.count(spec) && !index.find(spec) &&
+          !index.has_prefix(spec + "/")) {
+        return report_error(*create_error(
+            ErrorCode::NotFound, "Path did not match any files: " + spec));
+      }
+      continue;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+      SnapshotOptions options;
+      options.prefix = spec;
+      options.stat_cache = &index;
+      options.collect = &staged;
+      SnapshotResult snapshot;
+      if (auto error = build_snapshot(path, store, pool, snapshot, options)) {
+        return report_error(*error);
+      }
+      hashed += snapshot.hashed;
+      continue;
+    }
+
+    ObjectBatch batch(store);
+    IndexEntry entry;
+    bool was_hashed = false;
+    if (auto error = stage_file(path, spec, batch, &index, entry, was_hashed)) {
+      return report_error(*error);
+    }
+    if (auto error = batch.commit()) {
+      return report_error(*error);
+    }
+    hashed += was_hashed ? 1 : 0;
+    staged.push_back(std::move(entry));
+  }
+
+  // Entries outside the given paths keep their staged state, and so do
+  // sparse directories, which a snapshot never scans
+  for (std::size_t i = 0; i < index.size(); ++i) {
+    if (index.is_sparse_dir(i) || !covered_by(index.path(i), specs)) {
+      staged.push_back(index.entry(i));
+    }
+  }
+
+  auto count = staged.size();
+  if (auto error = write_index(chrona_dir / "index", std::move(staged))) {
+    return report_error(*error);
+  }
+  std::cout << "Staged " << count << " files (" << hashed << " hashed)"
+            << std::endl;
+  return 0;
+}
+
+} // namespace chrona
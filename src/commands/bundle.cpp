@@ -0,0 +1,202 @@
+#include "bundle/bundle.hpp"
+#include "commands.hpp"
+#include "history/commit_graph.hpp"
+#include "history/history.hpp"
+#include "pack/bitmap.hpp"
+#include "refs/refs.hpp"
+#include "refs/transaction.hpp"
+#include <iostream>
+
+namespace chrona {
+
+namespace {
+
+std::optional<Error> usage() {
+  return create_error(ExitCode::UsageError, ErrorCode::InvalidArgument,
+                      "Usage: chrona bundle create <file> [<ref>|^<revision>|"
+                      "<revision>..<ref>]...\n"
+                      "       chrona bundle unbundle <file>");
+}
+
+// "HEAD", a full ref name or a branch name, as the full ref name.
+std::optional<Error> ref_name(const std::filesystem::path &chrona_dir,
+                              const std::string &spec, std::string &out) {
+  if (spec == "HEAD") {
+    return read_head(chrona_dir, out);
+  }
+  out = spec.rfind("refs/", 0) == 0 ? spec : "refs/heads/" + spec;
+  if (!is_valid_ref_name(out)) {
+    return create_error(ErrorCode::InvalidArgument,
+                        "Invalid ref name: " + spec);
+  }
+  return std::nullopt;
+}
+
+int create(Repository &repo, const ParseResult &args) {
+  const auto &chrona_dir = repo.chrona_dir();
+  std::filesystem::path path(args.operands[1]);
+  BundleHeader header;
+  std::vector<std::string> wanted;
+  for (std::size_t i = 2; i < args.operands.size(); ++i) {
+    std::string spec(args.operands[i]);
+    std::string exclude;
+    if (spec.rfind("^", 0) == 0) {
+      exclude = spec.substr(1);
+      spec.clear();
+    } else if (auto dots = spec.find(".."); dots != std::string::npos) {
+      exclude = spec.substr(0, dots);
+      spec = spec.substr(dots + 2);
+    }
+    if (!exclude.empty()) {
+      ObjectId id;
+      if (auto error = repo.resolve(exclude, id)) {
+        return report_error(*error);
+      }
+      header.prerequisites.push_back(id);
+    }
+    if (!spec.empty()) {
+      wanted.emplace_back();
+      if (auto error = ref_name(chrona_dir, spec, wanted.back())) {
+        return report_error(*error);
+      }
+    } else if (exclude.empty()) {
+      return report_error(*usage());
+    }
+  }
+  if (wanted.empty()) {
+    if (auto error = list_refs(chrona_dir, header.refs)) {
+      return report_error(*error);
+    }
+  }
+  for (const auto &name : wanted) {
+    std::optional<ObjectId> id;
+    if (auto error = read_ref(chrona_dir, name, id)) {
+      return report_error(*error);
+    }
+    if (!id) {
+      return report_error(
+          *create_error(ErrorCode::NotFound, "No such ref: " + name));
+    }
+    header.refs.emplace_back(name, *id);
+  }
+  if (header.refs.empty()) {
+    return report_error(
+        *create_error(ErrorCode::InvalidArgument, "Nothing to bundle"));
+  }
+
+  std::vector<ObjectId> tips;
+  for (const auto &[name, id] : header.refs) {
+    tips.push_back(id);
+  }
+  const auto &store = repo.objects();
+  std::vector<ObjectId> objects;
+  Reachability reachability(store);
+  if (auto error =
+          reachability.missing(tips, header.prerequisites, objects)) {
+    return report_error(*error);
+  }
+  BundleResult result;
+  if (auto error = create_bundle(path, store, repo.pool(), std::move(header),
+                                 objects, result)) {
+    return report_error(*error);
+  }
+  std::cout << "Wrote " << path.string() << ": " << result.header.refs.size()
+            << " refs, " << result.written << " objects, " << result.bytes
+            << " bytes" << std::endl;
+  return 0;
+}
+
+int unbundle_refs(Repository &repo, const ParseResult &args) {
+  const auto &chrona_dir = repo.chrona_dir();
+  auto &store = repo.objects();
+  std::filesystem::path path(args.operands[1]);
+
+  // Bad ref names fail before any object is written
+  BundleHeader header;
+  if (auto error = read_bundle_header(path, header)) {
+    return report_error(*error);
+  }
+  for (const auto &[name, id] : header.refs) {
+    if (name.rfind("refs/", 0) != 0 || !is_valid_ref_name(name)) {
+      return report_error(*create_error(ErrorCode::CorruptObject,
+                                        "Bundle has a bad ref name: " + name));
+    }
+  }
+  BundleResult result;
+  if (auto error = unbundle(path, store, repo.pool(), result)) {
+    return report_error(*error);
+  }
+  std::cout << "Unbundled " << result.written << " objects ("
+            << result.present << " already present)" << std::endl;
+
+  std::string head;
+  if (auto error = repo.head(head)) {
+    return report_error(*error);
+  }
+  CommitGraph graph;
+  if (auto error = CommitGraph::open(chrona_dir / "commit-graph", graph)) {
+    return report_error(*error);
+  }
+  History history(store, graph);
+  RefTransaction transaction(chrona_dir);
+  std::vector<std::string> report;
+  bool head_created = false;
+  for (const auto &[name, id] : result.header.refs) {
+    std::optional<ObjectId> old;
+    if (auto error = read_ref(chrona_dir, name, old)) {
+      return report_error(*error);
+    }
+    if (!old) {
+      transaction.update(name, id, old);
+      report.push_back("  new " + name);
+      head_created = head_created || name == head;
+      continue;
+    }
+    if (*old == id) {
+      continue;
+    }
+    bool fast_forward = false;
+    if (auto error = history.is_ancestor(*old, id, fast_forward)) {
+      return report_error(*error);
+    }
+    if (!fast_forward) {
+      report.push_back("  skipped " + name + " (not a fast-forward)");
+    } else if (name == head) {
+      // Moving it would leave the working tree behind
+      report.push_back("  skipped " + name + " (checked out)");
+    } else {
+      transaction.update(name, id, old);
+      report.push_back("  updated " + name);
+    }
+  }
+  if (auto error = transaction.commit()) {
+    return report_error(*error);
+  }
+  for (const auto &line : report) {
+    std::cout << line << '\n';
+  }
+  if (head_created) {
+    auto branch = head.rfind("refs/heads/", 0) == 0 ? head.substr(11) : head;
+    std::cout << "Run 'chrona checkout " << branch
+              << "' to update the working tree\n";
+  }
+  std::cout << std::flush;
+  return 0;
+}
+
+} // namespace
+
+int run_bundle(const ParseResult &args) {
+  bool creating = !args.operands.empty() && args.operands[0] == "create";
+  bool unbundling = args.operands.size() == 2 && args.operands[0] == "unbundle";
+  if ((!creating && !unbundling) || args.operands.size() < 2) {
+    return report_error(*usage());
+  }
+  Repository *repo = nullptr;
+  if (auto error = Repository::current(repo)) {
+    return report_error(*error);
+  }
+  return creating ? create(*repo, args) : unbundle_refs(*repo, args);
+}
+
+} // namespace chrona
@@ -0,0 +1,179 @@
+#include "commands.hpp"
+#include "io/file_io.hpp"
+#include "objects/batch_read.hpp"
+#include "objects/object_store.hpp"
+#include <iostream>
+#include <unistd.h>
+
+namespace chrona {
+
+namespace {
+
+const std::filesystem::path standard_output = "standard output";
+
+// One output piece: a range of the header buffer or an object's content
+struct Part {
+  std::size_t begin;
+  std::size_t end;
+  std::string_view content;
+};
+
+// Answers one batch of request lines. Every object is read first, in
+// storage order, then the replies go out in request order with a single
+// vectored write that points straight at the mapped object data.
+std::optional<Error> answer_batch(Repository &repo, std::string_view lines,
+                                  bool contents) {
+  constexpr std::size_t unresolved = SIZE_MAX;
+  std::vector<std::string_view> requests;
+  std::vector<std::size_t> slots;
+  std::vector<ObjectId> ids;
+  while (!lines.empty()) {
+    auto newline = lines.find('\n');
+    auto line = lines.substr(0, newline);
+    lines.remove_prefix(std::min(lines.size(), newline + 1));
+    if (line.empty()) {
+      continue;
+    }
+    auto id = ObjectId::from_hex(line);
+    if (!id) {
+      ObjectId resolved;
+      if (!repo.resolve(std::string(line), resolved)) {
+        id = resolved;
+      }
+    }
+    requests.push_back(line);
+    slots.push_back(id ? ids.size() : unresolved);
+    if (id) {
+      ids.push_back(*id);
+    }
+  }
+
+  std::vector<BatchRead> results;
+  read_batch(repo.objects(), ids, results, &repo.pool());
+
+  std::string headers;
+  std::vector<Part> parts;
+  for (std::size_t i = 0; i < requests.size(); ++i) {
+    auto begin = headers.size();
+    auto slot = slots[i];
+    if (slot != unresolved && results[slot].error &&
+        results[slot].error->error_code != ErrorCode::NotFound) {
+      return results[slot].error;
+    }
+    if (slot == unresolved || results[slot].error) {
+      headers.append(requests[i]);
+      headers += " missing\n";
+      parts.push_back(Part{begin, headers.size(), {}});
+      continue;
+    }
+    const auto &view = results[slot].view;
+    headers += ids[slot].hex();
+    headers += ' ';
+    headers += object_type_name(view.type());
+    headers += ' ';
+    headers += std::to_string(view.size());
+    headers += '\n';
+    parts.push_back(Part{begin, headers.size(), {}});
+    if (contents) {
+      parts.push_back(Part{0, 0, view.content()});
+      headers += '\n';
+      parts.push_back(Part{headers.size() - 1, headers.size(), {}});
+    }
+  }
+
+  // Views into the header buffer are only taken once it stops growing
+  std::vector<std::string_view> output;
+  output.reserve(parts.size());
+  std::string_view all(headers);
+  for (const auto &part : parts) {
+    output.push_back(part.end > part.begin
+                         ? all.substr(part.begin, part.end - part.begin)
+                         : part.content);
+  }
+  return write_vectored(STDOUT_FILENO, output, standard_output);
+}
+
+// Reads request lines from stdin until it closes. Each read() hands over
+// whatever has arrived, so a pipeline gets large batches and an
+// interactive client gets an answer per line it sends.
+int run_batch(Repository &repo, bool contents) {
+  std::string pending;
+  char buffer[64 * 1024];
+  for (bool done = false; !done;) {
+    ssize_t n = ::read(STDIN_FILENO, buffer, sizeof(buffer));
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return report_error(*errno_error("Cannot read", "standard input"));
+    }
+    if (n == 0) {
+      done = true;
+      if (!pending.empty() && pending.back() != '\n') {
+        pending += '\n';
+      }
+    } else {
+      pending.append(buffer, static_cast<std::size_t>(n));
+    }
+
+    auto last = pending.rfind('\n');
+    if (last == std::string::npos) {
+      continue;
+    }
+    if (auto error =
+            answer_batch(repo, std::string_view(pending).substr(0, last + 1),
+                         contents)) {
+      return report_error(*error);
+    }
+    pending.erase(0, last + 1);
+  }
+  return 0;
+}
+
+} // namespace
+
+int run_cat_file(const ParseResult &args) {
+  const auto usage = create_error(
+      ExitCode::UsageError, ErrorCode::InvalidArgument,
+      "Usage: chrona cat-file [-t|-s] <revision> | --batch | --batch-check");
+  if (args.options.size() > 1) {
+    return report_error(*usage);
+  }
+  std::string mode(args.options.empty() ? "" : args.options.begin()->name);
+  std::string revision(args.operands.empty() ? "" : args.operands[0]);
+  bool batch = mode == "--batch" || mode == "--batch-check";
+  if (batch != revision.empty()) {
+    return report_error(*usage);
+  }
+
+  Repository *repo = nullptr;
+  if (auto error = Repository::current(repo)) {
+    return report_error(*error);
+  }
+  if (batch) {
+    return run_batch(*repo, mode == "--batch");
+  }
+
+  ObjectId id;
+  ObjectView view;
+  if (auto error = repo->resolve(revision, id)) {
+    return report_error(*error);
+  }
+  if (auto error = repo->objects().read(id, view)) {
+    return report_error(*error);
+  }
+  if (mode == "-t") {
+    std::cout << object_type_name(view.type()) << std::endl;
+  } else if (mode == "-s") {
+    std::cout << view.size() << std::endl;
+  } else {
+    std::string_view content = view.content();
+    if (auto error = write_vectored(STDOUT_FILENO, {&content, 1},
+                                    standard_output)) {
+      return report_error(*error);
+    }
+  }
+  return 0;
+}
+
+} // namespace chrona
@@ -0,0 +1,49 @@
+#include "checkout/checkout.hpp"
+#include "commands.hpp"
+#include "objects/object_store.hpp"
+#include "parallel/work_pool.hpp"
+#include "refs/refs.hpp"
+#include <iostream>
+
+namespace chrona {
+
+int run_checkout(const ParseResult &args) {
+  CheckoutOptions options;
+  options.durable = true;
+  options.force = args.options.find("-f") || args.options.find("--force");
+  std::string branch(args.operands.empty() ? "" : args.operands[0]);
+  std::string ref =
+      branch.rfind("refs/", 0) == 0 ? branch : "refs/heads/" + branch;
+  if (branch.empty() || !is_valid_ref_name(ref)) {
+    return report_error(*create_error(ExitCode::UsageError,
+                                      ErrorCode::InvalidArgument,
+                                      "Usage: chrona checkout [-f] <branch>"));
+  }
+
+  Repository *repo = nullptr;
+  if (auto error = Repository::current(repo)) {
+    return report_error(*error);
+  }
+  const auto &root = repo->root();
+  auto &store = repo->objects();
+  auto &pool = repo->pool();
+
+  bool resumed = false;
+  if (auto error = resume_checkout(root, store, pool, resumed)) {
+    return report_error(*error);
+  }
+  if (resumed) {
+    std::cout << "Finished an interrupted checkout" << std::endl;
+  }
+
+  CheckoutResult result;
+  if (auto error = switch_branch(root, store, pool, ref, result, options)) {
+    return report_error(*error);
+  }
+  std::cout << "Switched to " << branch << " (" << result.written
+            << " written, " << result.removed << " removed, "
+            << result.unchanged << " unchanged)" << std::endl;
+  return 0;
+}
+
+} // namespace chrona
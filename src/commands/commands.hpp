@@ -0,0 +1,44 @@
+#pragma once
+
+#include "cli/cli.hpp"
+#include "errors/error.hpp"
+#include "repo/repository.hpp"
+#include <filesystem>
+#include <optional>
+#include <string>
+
+namespace chrona {
+
+// Command handlers; each returns the process exit code.
+int run_init(const ParseResult &args);
+int run_add(const ParseResult &args);
+int run_status(const ParseResult &args);
+int run_pack(const ParseResult &args);
+int run_commit(const ParseResult &args);
+int run_log(const ParseResult &args);
+int run_merge_base(const ParseResult &args);
+int run_commit_graph(const ParseResult &args);
+int run_diff(const ParseResult &args);
+int run_gc(const ParseResult &args);
+int run_checkout(const ParseResult &args);
+int run_daemon(const ParseResult &args);
+int run_cat_file(const ParseResult &args);
+int run_merge(const ParseResult &args);
+int run_count_objects(const ParseResult &args);
+int run_bundle(const ParseResult &args);
+int run_fsck(const ParseResult &args);
+int run_sparse(const ParseResult &args);
+
+// Prints the error and returns its exit code.
+int report_error(const Error &error);
+
+// $CHRONA_AUTHOR_NAME, else $USER, else "unknown".
+std::string author_name();
+
+// Turns a command-line path into a '/'-separated path relative to the
+// repository root ("" for the root itself).
+std::optional<Error> repo_relative_path(const Repository &repo,
+                                        std::string_view arg,
+                                        std::string &out);
+
+} // namespace chrona
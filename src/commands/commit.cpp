@@ -0,0 +1,104 @@
+#include "commands.hpp"
+#include "history/commit.hpp"
+#include "index/index.hpp"
+#include "merge/merge.hpp"
+#include "objects/object_store.hpp"
+#include "refs/refs.hpp"
+#include "snapshot/tree_builder.hpp"
+#include <ctime>
+#include <iostream>
+
+namespace chrona {
+
+int run_commit(const ParseResult &args) {
+  const auto *message = args.options.find("-m");
+  if (message == nullptr || message->value.empty()) {
+    return report_error(*create_error(ExitCode::UsageError,
+                                      ErrorCode::InvalidArgument,
+                                      "Usage: chrona commit -m <message>"));
+  }
+
+  Repository *repo = nullptr;
+  if (auto error = Repository::current(repo)) {
+    return report_error(*error);
+  }
+  const auto &chrona_dir = repo->chrona_dir();
+
+  IndexView index;
+  if (auto error = IndexView::open(chrona_dir / "index", index)) {
+    return report_error(*error);
+  }
+  if (index.conflict_count() > 0) {
+    return report_error(*create_error(
+        ErrorCode::InvalidArgument,
+        std::to_string(index.conflict_count()) +
+            " paths still have merge conflicts; resolve and add them"));
+  }
+  std::optional<ObjectId> merging;
+  if (auto error = read_merge_head(chrona_dir, merging)) {
+    return report_error(*error);
+  }
+  std::string head;
+  if (auto error = repo->head(head)) {
+    return report_error(*error);
+  }
+  std::optional<ObjectId> parent;
+  if (auto error = read_ref(chrona_dir, head, parent)) {
+    return report_error(*error);
+  }
+
+  auto &store = repo->objects();
+  ObjectBatch batch(store, true);
+  Commit commit;
+  if (auto error = write_index_tree(index, batch, commit.tree)) {
+    return report_error(*error);
+  }
+
+  if (parent) {
+    ObjectView view;
+    Commit previous;
+    if (auto error = store.read(*parent, view)) {
+      return report_error(*error);
+    }
+    if (auto error = decode_commit(view.content(), previous)) {
+      return report_error(*error);
+    }
+    if (previous.tree == commit.tree && !merging) {
+      std::cout << "Nothing to commit, the index matches " << head
+                << std::endl;
+      return 0;
+    }
+    commit.parents.push_back(*parent);
+  }
+  if (merging) {
+    commit.parents.push_back(*merging);
+  }
+
+  commit.author = author_name();
+  commit.time = static_cast<std::int64_t>(std::time(nullptr));
+  commit.message = message->value;
+  if (commit.message.back() != '\n') {
+    commit.message += '\n';
+  }
+
+  ObjectId id;
+  if (auto error = batch.add(ObjectType::Commit, encode_commit(commit), id)) {
+    return report_error(*error);
+  }
+  if (auto error = batch.commit()) {
+    return report_error(*error);
+  }
+  if (auto error = repo->update_ref(head, id, parent)) {
+    return report_error(*error);
+  }
+  if (merging) {
+    std::filesystem::remove(merge_head_path(chrona_dir));
+  }
+
+  auto branch = head.substr(head.rfind('/') + 1);
+  std::cout << "[" << branch << " " << id.hex().substr(0, 12) << "] "
+            << message->value << std::endl;
+  return 0;
+}
+
+} // namespace chrona
@@ -0,0 +1,58 @@
+#include "commands.hpp"
+#include "history/commit_graph.hpp"
+#include "history/path_filter.hpp"
+#include "objects/object_store.hpp"
+#include "refs/refs.hpp"
+#include <iostream>
+
+namespace chrona {
+
+int run_commit_graph(const ParseResult &) {
+  Repository *repo = nullptr;
+  if (auto error = Repository::current(repo)) {
+    return report_error(*error);
+  }
+  const auto &chrona_dir = repo->chrona_dir();
+
+  std::vector<std::pair<std::string, ObjectId>> refs;
+  if (auto error = list_refs(chrona_dir, refs)) {
+    return report_error(*error);
+  }
+  std::vector<ObjectId> tips;
+  for (const auto &[name, id] : refs) {
+    tips.push_back(id);
+  }
+
+  // Filters from the previous graph are carried over; if either file is
+  // unreadable every filter is simply recomputed
+  const auto graph_path = chrona_dir / "commit-graph";
+  const auto filters_path = chrona_dir / "commit-graph-bloom";
+  CommitGraph previous_graph;
+  PathFilters previous_filters;
+  if (CommitGraph::open(graph_path, previous_graph) ||
+      PathFilters::open(filters_path, previous_graph, previous_filters)) {
+    previous_graph = CommitGraph();
+    previous_filters = PathFilters();
+  }
+
+  auto &store = repo->objects();
+  std::size_t written = 0;
+  if (auto error = write_commit_graph(graph_path, store, tips, written)) {
+    return report_error(*error);
+  }
+  CommitGraph graph;
+  if (auto error = CommitGraph::open(graph_path, graph)) {
+    return report_error(*error);
+  }
+  std::size_t computed = 0;
+  if (auto error = write_path_filters(filters_path, store, graph,
+                                      previous_graph, previous_filters,
+                                      computed)) {
+    return report_error(*error);
+  }
+  std::cout << "Wrote commit graph with " << written << " commits ("
+            << computed << " new path filters)" << std::endl;
+  return 0;
+}
+
+} // namespace chrona
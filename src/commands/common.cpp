@@ -0,0 +1,42 @@
+#include "commands.hpp"
+#include <cstdlib>
+
+namespace chrona {
+
+int report_error(const Error &error) {
+  print_error(error);
+  return static_cast<int>(error.exit_code);
+}
+
+std::string author_name() {
+  for (const char *variable : {"CHRONA_AUTHOR_NAME", "USER"}) {
+    const char *value = std::getenv(variable);
+    if (value != nullptr && *value != '\0') {
+      return value;
+    }
+  }
+  return "unknown";
+}
+
+std::optional<Error> repo_relative_path(const Repository &repo,
+                                        std::string_view arg,
+                                        std::string &out) {
+  auto absolute = (repo.cwd() / arg).lexically_normal();
+  auto relative = absolute.lexically_relative(repo.root());
+  auto text = relative.generic_string();
+  if (relative.empty() || text == ".." || text.rfind("../", 0) == 0) {
+    return create_error(ErrorCode::InvalidArgument,
+                        "Path is outside the repository: " +
+                            std::string(arg));
+  }
+  if (text == ".") {
+    text.clear();
+  }
+  while (!text.empty() && text.back() == '/') {
+    text.pop_back();
+  }
+  out = text;
+  return std::nullopt;
+}
+
+} // namespace chrona
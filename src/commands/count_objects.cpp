@@ -0,0 +1,66 @@
+#include "commands.hpp"
+#include "objects/object_store.hpp"
+#include "pack/bitmap.hpp"
+#include "pack/pack.hpp"
+#include "refs/refs.hpp"
+#include <iostream>
+#include <sys/stat.h>
+
+namespace chrona {
+
+int run_count_objects(const ParseResult &) {
+  Repository *repo = nullptr;
+  if (auto error = Repository::current(repo)) {
+    return report_error(*error);
+  }
+  const auto &store = repo->objects();
+
+  std::size_t loose = 0;
+  std::uint64_t loose_bytes = 0;
+  store.for_each_loose([&](const ObjectId &id) {
+    struct stat st;
+    if (::stat(store.object_path(id).c_str(), &st) == 0) {
+      ++loose;
+      loose_bytes += static_cast<std::uint64_t>(st.st_size);
+    }
+  });
+  auto packs = store.packs();
+  std::size_t packed = 0;
+  std::uint64_t pack_bytes = 0;
+  for (const auto &pack : *packs) {
+    struct stat st;
+    if (::stat(pack->path().c_str(), &st) == 0) {
+      packed += pack->size();
+      pack_bytes += static_cast<std::uint64_t>(st.st_size);
+    }
+  }
+
+  std::vector<std::pair<std::string, ObjectId>> refs;
+  if (auto error = list_refs(repo->chrona_dir(), refs)) {
+    return report_error(*error);
+  }
+  std::vector<ObjectId> tips;
+  for (const auto &[name, id] : refs) {
+    tips.push_back(id);
+  }
+  Reachability reachability(store);
+  ObjectSet reachable;
+  if (auto error = reachability.reachable(tips, reachable)) {
+    return report_error(*error);
+  }
+
+  std::cout << "Loose objects: " << loose << " (" << loose_bytes
+            << " bytes)\n"
+            << "Packed objects: " << packed << " in " << packs->size()
+            << " packs (" << pack_bytes << " bytes)\n"
+            << "Reachable objects: " << reachability.count(reachable) << " ("
+            << reachability.count(reachable, ObjectType::Commit)
+            << " commits, "
+            << reachability.count(reachable, ObjectType::Tree) << " trees, "
+            << reachability.count(reachable, ObjectType::Blob) << " blobs"
+            << (reachability.has_bitmaps() ? ", using bitmaps" : "") << ")"
+            << std::endl;
+  return 0;
+}
+
+} // namespace chrona
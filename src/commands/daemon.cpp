@@ -0,0 +1,110 @@
+#include "commands.hpp"
+#include "fsmonitor/daemon.hpp"
+#include "io/file_io.hpp"
+#include "parallel/work_pool.hpp"
+#include <csignal>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace chrona {
+
+namespace {
+
+// Forks a detached daemon and waits until it answers queries or fails
+int start_daemon(Repository &repo) {
+  int ready[2];
+  if (::pipe2(ready, O_CLOEXEC) != 0) {
+    return report_error(*errno_error("Cannot start daemon for",
+                                     repo.chrona_dir()));
+  }
+  pid_t pid = ::fork();
+  if (pid < 0) {
+    return report_error(*errno_error("Cannot start daemon for",
+                                     repo.chrona_dir()));
+  }
+
+  if (pid == 0) {
+    ::close(ready[0]);
+    ::setsid();
+    // Reporting a late failure to a starter that has gone must not kill us
+    ::signal(SIGPIPE, SIG_IGN);
+    int null = ::open("/dev/null", O_RDWR);
+    if (null >= 0) {
+      ::dup2(null, STDIN_FILENO);
+      ::dup2(null, STDOUT_FILENO);
+      ::dup2(null, STDERR_FILENO);
+      ::close(null);
+    }
+    DaemonOptions options;
+    options.ready_fd = ready[1];
+    // The pool is first created here, so no worker threads cross the fork
+    auto error = serve_daemon(repo.root(), repo.chrona_dir(), repo.pool(),
+                              options);
+    if (error) {
+      auto message = "error " + error->message + "\n";
+      [[maybe_unused]] auto n =
+          ::write(ready[1], message.data(), message.size());
+    }
+    ::_exit(error ? 1 : 0);
+  }
+
+  ::close(ready[1]);
+  std::string reply;
+  char buffer[256];
+  ssize_t n;
+  while ((n = ::read(ready[0], buffer, sizeof(buffer))) > 0) {
+    reply.append(buffer, static_cast<std::size_t>(n));
+    if (reply.find('\n') != std::string::npos) {
+      break;
+    }
+  }
+  ::close(ready[0]);
+  if (reply.rfind("ok\n", 0) == 0) {
+    std::cout << "Daemon watching " << repo.root().string() << std::endl;
+    return 0;
+  }
+  ::waitpid(pid, nullptr, 0);
+  auto message = reply.rfind("error ", 0) == 0 ? reply.substr(6)
+                                               : "Daemon exited during startup";
+  while (!message.empty() && message.back() == '\n') {
+    message.pop_back();
+  }
+  return report_error(*create_error(ErrorCode::IOError, message));
+}
+
+} // namespace
+
+int run_daemon(const ParseResult &args) {
+  std::string_view action = args.operands.empty() ? "start" : args.operands[0];
+  if (args.operands.size() > 1 ||
+      (action != "start" && action != "stop" && action != "run")) {
+    return report_error(*create_error(ExitCode::UsageError,
+                                      ErrorCode::InvalidArgument,
+                                      "Usage: chrona daemon [start|run|stop]"));
+  }
+
+  Repository *repo = nullptr;
+  if (auto error = Repository::current(repo)) {
+    return report_error(*error);
+  }
+
+  if (action == "stop") {
+    if (auto error = stop_daemon(repo->chrona_dir())) {
+      return report_error(*error);
+    }
+    std::cout << "Daemon stopped" << std::endl;
+    return 0;
+  }
+  if (action == "start") {
+    return start_daemon(*repo);
+  }
+  if (auto error =
+          serve_daemon(repo->root(), repo->chrona_dir(), repo->pool())) {
+    return report_error(*error);
+  }
+  return 0;
+}
+
+} // namespace chrona
@@ -0,0 +1,111 @@
+#include "commands.hpp"
+#include "diff/file_diff.hpp"
+#include "index/index.hpp"
+#include "io/file_io.hpp"
+#include "objects/object_store.hpp"
+#include "parallel/work_pool.hpp"
+#include "status/status.hpp"
+#include <charconv>
+#include <iostream>
+#include <unistd.h>
+
+namespace chrona {
+
+namespace {
+
+std::optional<Error> read_worktree(const std::filesystem::path &path,
+                                   std::string &out) {
+  if (std::filesystem::is_symlink(path)) {
+    std::error_code ec;
+    out = std::filesystem::read_symlink(path, ec).string();
+    if (ec) {
+      return create_error(ErrorCode::IOError,
+                          "Cannot read link " + path.string());
+    }
+    return std::nullopt;
+  }
+  return read_file(path, out);
+}
+
+// The command table has already checked the names
+std::optional<Error> parse_options(const OptionList &given,
+                                   DiffOptions &options) {
+  for (const auto &[name, value] : given) {
+    if (name == "--myers") {
+      options.algorithm = DiffAlgorithm::Myers;
+    } else if (name == "--histogram") {
+      options.algorithm = DiffAlgorithm::Histogram;
+    } else if (name == "--patience") {
+      options.algorithm = DiffAlgorithm::Patience;
+    } else if (name == "-U") {
+      auto [ptr, ec] = std::from_chars(
+          value.data(), value.data() + value.size(), options.context);
+      if (ec != std::errc() || ptr != value.data() + value.size()) {
+        return create_error(ExitCode::UsageError, ErrorCode::InvalidArgument,
+                            "Invalid context: -U" + std::string(value));
+      }
+    }
+  }
+  return std::nullopt;
+}
+
+} // namespace
+
+int run_diff(const ParseResult &args) {
+  DiffOptions options;
+  if (auto error = parse_options(args.options, options)) {
+    return report_error(*error);
+  }
+
+  Repository *repo = nullptr;
+  if (auto error = Repository::current(repo)) {
+    return report_error(*error);
+  }
+  const auto &root = repo->root();
+  const auto &chrona_dir = repo->chrona_dir();
+
+  IndexView index;
+  if (auto error = IndexView::open(chrona_dir / "index", index)) {
+    return report_error(*error);
+  }
+  auto &pool = repo->pool();
+  StatusOptions status_options;
+  status_options.untracked = false;
+  StatusResult status;
+  if (auto error = compute_status(root, index, pool, status, status_options)) {
+    return report_error(*error);
+  }
+
+  auto &store = repo->objects();
+  std::vector<FileDiffJob> jobs;
+  for (const auto &change : status.changes) {
+    auto id = index.id(*index.find(change.path));
+    auto path = root / change.path;
+    bool deleted = change.kind == ChangeKind::Deleted;
+    FileDiffJob job;
+    job.old_label = "a/" + change.path;
+    job.new_label = deleted ? "/dev/null" : "b/" + change.path;
+    job.load = [&store, id, path, deleted](std::string &old_text,
+                                           std::string &new_text) {
+      ObjectView view;
+      if (auto error = store.read(id, view)) {
+        return error;
+      }
+      old_text = std::string(view.content());
+      return deleted ? std::nullopt : read_worktree(path, new_text);
+    };
+    jobs.push_back(std::move(job));
+  }
+
+  auto error = diff_files(jobs, pool, options,
+                          [](std::size_t, std::string_view text) {
+                            std::cout << text;
+                          });
+  std::cout.flush();
+  if (error) {
+    return report_error(*error);
+  }
+  return 0;
+}
+
+} // namespace chrona
@@ -0,0 +1,73 @@
+#include "commands.hpp"
+#include "fsck/fsck.hpp"
+#include <charconv>
+#include <iostream>
+#include <random>
+
+namespace chrona {
+
+namespace {
+
+// Only --incremental and --sample= get past the command table
+std::optional<Error> parse_options(const OptionList &given,
+                                   FsckOptions &options) {
+  for (const auto &[name, value] : given) {
+    if (name == "--incremental") {
+      options.incremental = true;
+      continue;
+    }
+    int percent = 0;
+    auto [ptr, ec] =
+        std::from_chars(value.data(), value.data() + value.size(), percent);
+    if (ec != std::errc() || ptr != value.data() + value.size() ||
+        percent < 1 || percent > 100) {
+      return create_error(ExitCode::UsageError, ErrorCode::InvalidArgument,
+                          "Invalid value: " + std::string(name) +
+                              std::string(value));
+    }
+    options.sample = percent / 100.0;
+  }
+  return std::nullopt;
+}
+
+} // namespace
+
+int run_fsck(const ParseResult &args) {
+  FsckOptions options;
+  if (auto error = parse_options(args.options, options)) {
+    return report_error(*error);
+  }
+  // Each sampled run looks at a different subset
+  options.seed = std::random_device()();
+
+  Repository *repo = nullptr;
+  if (auto error = Repository::current(repo)) {
+    return report_error(*error);
+  }
+  FsckResult result;
+  if (auto error =
+          fsck(repo->chrona_dir(), repo->objects(), repo->pool(), result,
+               options)) {
+    return report_error(*error);
+  }
+
+  // One problem per line, "<problem> <id> <detail>", for scripts
+  for (const auto &issue : result.issues) {
+    std::cout << fsck_problem_name(issue.problem) << ' ' << issue.id.hex()
+              << ' ' << issue.detail << '\n';
+  }
+  std::cout << "Checked " << result.loose + result.packed << " objects ("
+            << result.loose << " loose, " << result.chunked << " chunked, "
+            << result.packed << " packed in " << result.packs << " packs, "
+            << result.bytes << " bytes), skipped " << result.skipped
+            << ", " << result.reachable << " reachable from the roots"
+            << std::endl;
+  if (!result.issues.empty()) {
+    return report_error(*create_error(
+        ErrorCode::CorruptObject,
+        std::to_string(result.issues.size()) + " problems found"));
+  }
+  return 0;
+}
+
+} // namespace chrona
@@ -0,0 +1,69 @@
+#include "commands.hpp"
+#include "gc/gc.hpp"
+#include "objects/object_store.hpp"
+#include "parallel/work_pool.hpp"
+#include "refs/packed_refs.hpp"
+#include <charconv>
+#include <iostream>
+
+namespace chrona {
+
+namespace {
+
+// Only --budget= and --grace= get past the command table
+std::optional<Error> parse_options(const OptionList &given,
+                                   GcOptions &options) {
+  for (const auto &[name, value] : given) {
+    auto *target =
+        name == "--budget=" ? &options.budget_ms : &options.grace_seconds;
+    auto [ptr, ec] =
+        std::from_chars(value.data(), value.data() + value.size(), *target);
+    if (ec != std::errc() || ptr != value.data() + value.size() ||
+        *target < 0) {
+      return create_error(ExitCode::UsageError, ErrorCode::InvalidArgument,
+                          "Invalid value: " + std::string(name) +
+                              std::string(value));
+    }
+  }
+  return std::nullopt;
+}
+
+} // namespace
+
+int run_gc(const ParseResult &args) {
+  GcOptions options;
+  if (auto error = parse_options(args.options, options)) {
+    return report_error(*error);
+  }
+  Repository *repo = nullptr;
+  if (auto error = Repository::current(repo)) {
+    return report_error(*error);
+  }
+  const auto &chrona_dir = repo->chrona_dir();
+  auto &store = repo->objects();
+  auto &pool = repo->pool();
+
+  GcResult result;
+  if (auto error = collect_garbage(chrona_dir, store, pool, result, options)) {
+    return report_error(*error);
+  }
+  if (!result.complete) {
+    std::cout << "Time budget reached after marking " << result.marked
+              << " objects; progress saved, run chrona gc again to continue"
+              << std::endl;
+    return 0;
+  }
+  // One mmapped file instead of a file per ref
+  std::size_t refs_packed = 0;
+  if (auto error = pack_refs(chrona_dir, refs_packed)) {
+    return report_error(*error);
+  }
+  std::cout << "Kept " << result.marked << " reachable objects, removed "
+            << result.loose_removed << " loose and " << result.packed_dropped
+            << " packed objects (" << result.packs_rewritten
+            << " packs rewritten, " << result.bytes_freed << " bytes freed, "
+            << refs_packed << " refs packed)" << std::endl;
+  return 0;
+}
+
+} // namespace chrona
@@ -0,0 +1,17 @@
+#include "commands.hpp"
+#include "repo/repo.hpp"
+#include <iostream>
+
+namespace chrona {
+
+int run_init(const ParseResult &) {
+  auto root = std::filesystem::current_path();
+  if (auto error = init_repo(root)) {
+    return report_error(*error);
+  }
+  std::cout << "Initialized empty Chrona repository in "
+            << (root / ".chrona").string() << std::endl;
+  return 0;
+}
+
+} // namespace chrona
@@ -0,0 +1,134 @@
+#include "commands.hpp"
+#include "history/commit.hpp"
+#include "history/history.hpp"
+#include "history/path_filter.hpp"
+#include "objects/object_store.hpp"
+#include "refs/refs.hpp"
+#include <charconv>
+#include <ctime>
+#include <iostream>
+
+namespace chrona {
+
+namespace {
+
+std::string format_time(std::int64_t seconds) {
+  auto value = static_cast<std::time_t>(seconds);
+  std::tm utc;
+  ::gmtime_r(&value, &utc);
+  char buffer[64];
+  std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S +0000", &utc);
+  return buffer;
+}
+
+} // namespace
+
+int run_log(const ParseResult &args) {
+  std::size_t limit = SIZE_MAX;
+  if (const auto *option = args.options.find("-n")) {
+    const auto &count = option->value;
+    auto [ptr, ec] =
+        std::from_chars(count.data(), count.data() + count.size(), limit);
+    if (ec != std::errc() || ptr != count.data() + count.size()) {
+      return report_error(*create_error(ExitCode::UsageError,
+                                        ErrorCode::InvalidArgument,
+                                        "Invalid count: " +
+                                            std::string(count)));
+    }
+  }
+  // At most a revision before "--" and exactly one path after it
+  auto revisions = args.separator.value_or(args.operands.size());
+  if (revisions > 1 ||
+      (args.separator && args.operands.size() != revisions + 1)) {
+    return report_error(*create_error(ExitCode::UsageError,
+                                      ErrorCode::InvalidArgument,
+                                      "Usage: chrona log [-n <count>] "
+                                      "[<revision>] [-- <path>]"));
+  }
+  std::string revision(revisions == 1 ? args.operands[0] : "HEAD");
+  std::optional<std::string> path_arg;
+  if (args.separator) {
+    path_arg = std::string(args.operands[revisions]);
+  }
+
+  Repository *repo = nullptr;
+  if (auto error = Repository::current(repo)) {
+    return report_error(*error);
+  }
+  const auto &chrona_dir = repo->chrona_dir();
+  std::string path;
+  if (path_arg) {
+    if (auto error = repo_relative_path(*repo, *path_arg, path)) {
+      return report_error(*error);
+    }
+  }
+
+  ObjectId tip;
+  if (auto error = repo->resolve(revision, tip)) {
+    if (revision == "HEAD" && error->error_code == ErrorCode::NotFound) {
+      std::cout << "No commits yet" << std::endl;
+      return 0;
+    }
+    return report_error(*error);
+  }
+
+  auto &store = repo->objects();
+  CommitGraph graph;
+  if (auto error = CommitGraph::open(chrona_dir / "commit-graph", graph)) {
+    return report_error(*error);
+  }
+  History history(store, graph);
+  std::vector<ObjectId> ids;
+  if (auto error = history.log({tip}, ids, path_arg ? SIZE_MAX : limit)) {
+    return report_error(*error);
+  }
+  if (path_arg) {
+    // The changed-path filters let most commits be dropped without
+    // reading a single tree
+    PathFilters filters;
+    if (auto error = PathFilters::open(chrona_dir / "commit-graph-bloom",
+                                       graph, filters)) {
+      return report_error(*error);
+    }
+    std::vector<ObjectId> touching;
+    if (auto error =
+            filter_by_path(store, graph, filters, ids, path, touching, limit)) {
+      return report_error(*error);
+    }
+    ids = std::move(touching);
+  }
+
+  // Only the commits actually printed are read for their messages
+  Arena arena;
+  for (std::size_t i = 0; i < ids.size(); ++i) {
+    ObjectView view;
+    CommitView commit;
+    if (auto error = store.read(ids[i], view)) {
+      return report_error(*error);
+    }
+    arena.reset();
+    if (auto error = parse_commit(view.content(), arena, commit)) {
+      return report_error(*error);
+    }
+    if (i > 0) {
+      std::cout << std::endl;
+    }
+    std::cout << "commit " << ids[i].hex() << std::endl
+              << "Author: " << commit.author << std::endl
+              << "Date:   " << format_time(commit.time) << std::endl
+              << std::endl;
+    std::size_t start = 0;
+    while (start < commit.message.size()) {
+      auto end = commit.message.find('\n', start);
+      if (end == std::string_view::npos) {
+        end = commit.message.size();
+      }
+      std::cout << "    " << commit.message.substr(start, end - start)
+                << std::endl;
+      start = end + 1;
+    }
+  }
+  return 0;
+}
+
+} // namespace chrona
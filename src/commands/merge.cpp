@@ -0,0 +1,214 @@
+#include "checkout/checkout.hpp"
+#include "commands.hpp"
+#include "history/commit.hpp"
+#include "history/history.hpp"
+#include "merge/merge.hpp"
+#include "refs/refs.hpp"
+#include "sparse/sparse.hpp"
+#include <ctime>
+#include <iostream>
+#include <unordered_map>
+
+namespace chrona {
+
+namespace {
+
+ConflictSide conflict_side(const std::optional<PathEntry> &entry) {
+  if (!entry) {
+    return {};
+  }
+  return ConflictSide{static_cast<std::uint32_t>(entry->mode), entry->id};
+}
+
+std::optional<Error> commit_tree(const ObjectStore &store, const ObjectId &id,
+                                 ObjectId &out) {
+  ObjectView view;
+  Commit commit;
+  if (auto error = store.read(id, view)) {
+    return error;
+  }
+  if (auto error = decode_commit(view.content(), commit)) {
+    return error;
+  }
+  out = commit.tree;
+  return std::nullopt;
+}
+
+} // namespace
+
+int run_merge(const ParseResult &args) {
+  if (args.operands.size() != 1) {
+    return report_error(*create_error(ExitCode::UsageError,
+                                      ErrorCode::InvalidArgument,
+                                      "Usage: chrona merge <revision>"));
+  }
+  std::string revision(args.operands[0]);
+
+  Repository *repo = nullptr;
+  if (auto error = Repository::current(repo)) {
+    return report_error(*error);
+  }
+  const auto &root = repo->root();
+  const auto &chrona_dir = repo->chrona_dir();
+  auto &store = repo->objects();
+  auto &pool = repo->pool();
+
+  std::optional<ObjectId> pending;
+  if (auto error = read_merge_head(chrona_dir, pending)) {
+    return report_error(*error);
+  }
+  if (pending) {
+    return report_error(*create_error(
+        ErrorCode::InvalidArgument,
+        "A merge is in progress; resolve it and commit first"));
+  }
+
+  std::string head;
+  std::optional<ObjectId> ours;
+  ObjectId theirs;
+  if (auto error = repo->head(head)) {
+    return report_error(*error);
+  }
+  if (auto error = read_ref(chrona_dir, head, ours)) {
+    return report_error(*error);
+  }
+  if (!ours) {
+    return report_error(*create_error(ErrorCode::InvalidArgument,
+                                      "Cannot merge into an unborn branch"));
+  }
+  if (auto error = repo->resolve(revision, theirs)) {
+    return report_error(*error);
+  }
+
+  CommitGraph graph;
+  if (auto error = CommitGraph::open(chrona_dir / "commit-graph", graph)) {
+    return report_error(*error);
+  }
+  History history(store, graph);
+  bool up_to_date = false;
+  bool fast_forward = false;
+  if (auto error = history.is_ancestor(theirs, *ours, up_to_date)) {
+    return report_error(*error);
+  }
+  if (up_to_date) {
+    std::cout << "Already up to date" << std::endl;
+    return 0;
+  }
+  if (auto error = history.is_ancestor(*ours, theirs, fast_forward)) {
+    return report_error(*error);
+  }
+
+  ObjectId ours_tree;
+  if (auto error = commit_tree(store, *ours, ours_tree)) {
+    return report_error(*error);
+  }
+  MergeResult merge;
+  if (fast_forward) {
+    if (auto error = commit_tree(store, theirs, merge.tree)) {
+      return report_error(*error);
+    }
+  } else {
+    MergeOptions options;
+    options.labels = {"HEAD", revision};
+    if (auto error = merge_commits(store, pool, history, *ours, theirs,
+                                   merge, options)) {
+      return report_error(*error);
+    }
+  }
+
+  // Refuses before touching anything if local changes are in the way
+  CheckoutPlan plan;
+  CheckoutOptions checkout_options;
+  checkout_options.durable = true;
+  if (auto error = plan_checkout(root, store, pool, merge.tree, ours_tree,
+                                 plan, checkout_options)) {
+    return report_error(*error);
+  }
+  std::unordered_map<std::string_view, const MergeConflict *> conflicts;
+  for (const auto &conflict : merge.conflicts) {
+    conflicts.emplace(conflict.path, &conflict);
+  }
+  for (auto &entry : plan.index) {
+    auto it = conflicts.find(entry.path);
+    if (it != conflicts.end()) {
+      entry.conflict = IndexConflict{conflict_side(it->second->base),
+                                     conflict_side(it->second->ours),
+                                     conflict_side(it->second->theirs)};
+      conflicts.erase(it);
+    }
+  }
+  // A conflict inside a sparse directory would have nowhere to be resolved.
+  // Every other conflict is on a file of the merged tree, so one left over
+  // here is a bug.
+  if (!conflicts.empty()) {
+    SparseCone cone;
+    if (auto error = SparseCone::load(chrona_dir, cone)) {
+      return report_error(*error);
+    }
+    for (const auto &[path, conflict] : conflicts) {
+      if (cone.includes(path)) {
+        return report_error(*create_error(
+            ErrorCode::UnknownError,
+            "Internal error: merge conflict on " + std::string(path) +
+                " has no entry in the merged index"));
+      }
+    }
+    return report_error(*create_error(
+        ErrorCode::InvalidArgument,
+        "Merge conflicts outside the sparse cone: " +
+            std::string(conflicts.begin()->first) +
+            " (widen it with chrona sparse set)"));
+  }
+  CheckoutResult checkout;
+  if (auto error = apply_checkout(root, store, pool, plan, checkout,
+                                  checkout_options)) {
+    return report_error(*error);
+  }
+
+  if (fast_forward) {
+    if (auto error = repo->update_ref(head, theirs, ours)) {
+      return report_error(*error);
+    }
+    std::cout << "Fast-forward to " << theirs.hex().substr(0, 12) << " ("
+              << checkout.written << " written, " << checkout.removed
+              << " removed)" << std::endl;
+    return 0;
+  }
+
+  if (!merge.conflicts.empty()) {
+    if (auto error = write_merge_head(chrona_dir, theirs)) {
+      return report_error(*error);
+    }
+    for (const auto &conflict : merge.conflicts) {
+      std::cout << "CONFLICT " << conflict.path << std::endl;
+    }
+    std::cout << "Automatic merge failed: fix the conflicts, add the files "
+                 "and commit"
+              << std::endl;
+    return 1;
+  }
+
+  Commit commit;
+  commit.tree = merge.tree;
+  commit.parents = {*ours, theirs};
+  commit.author = author_name();
+  commit.time = static_cast<std::int64_t>(std::time(nullptr));
+  commit.message = "Merge " + revision + "\n";
+  ObjectBatch batch(store, true);
+  ObjectId id;
+  if (auto error = batch.add(ObjectType::Commit, encode_commit(commit), id)) {
+    return report_error(*error);
+  }
+  if (auto error = batch.commit()) {
+    return report_error(*error);
+  }
+  if (auto error = repo->update_ref(head, id, ours)) {
+    return report_error(*error);
+  }
+  std::cout << "Merged " << revision << " as " << id.hex().substr(0, 12)
+            << " (" << merge.stats.files_merged << " files merged by line, "
+            << checkout.written << " written)" << std::endl;
+  return 0;
+}
+
+} // namespace chrona
@@ -0,0 +1,60 @@
+#include "commands.hpp"
+#include "history/history.hpp"
+#include "objects/object_store.hpp"
+#include "refs/refs.hpp"
+#include <iostream>
+
+namespace chrona {
+
+int run_merge_base(const ParseResult &args) {
+  bool ancestry = args.options.find("--is-ancestor") != nullptr;
+  if (args.operands.size() != 2) {
+    return report_error(*create_error(
+        ExitCode::UsageError, ErrorCode::InvalidArgument,
+        "Usage: chrona merge-base [--is-ancestor] <commit> <commit>"));
+  }
+
+  Repository *repo = nullptr;
+  if (auto error = Repository::current(repo)) {
+    return report_error(*error);
+  }
+  const auto &chrona_dir = repo->chrona_dir();
+
+  ObjectId a;
+  ObjectId b;
+  if (auto error = repo->resolve(std::string(args.operands[0]), a)) {
+    return report_error(*error);
+  }
+  if (auto error = repo->resolve(std::string(args.operands[1]), b)) {
+    return report_error(*error);
+  }
+
+  auto &store = repo->objects();
+  CommitGraph graph;
+  if (auto error = CommitGraph::open(chrona_dir / "commit-graph", graph)) {
+    return report_error(*error);
+  }
+  History history(store, graph);
+
+  if (ancestry) {
+    bool result = false;
+    if (auto error = history.is_ancestor(a, b, result)) {
+      return report_error(*error);
+    }
+    return result ? 0 : 1;
+  }
+
+  std::vector<ObjectId> bases;
+  if (auto error = history.merge_bases(a, b, bases)) {
+    return report_error(*error);
+  }
+  if (bases.empty()) {
+    return 1;
+  }
+  for (const auto &base : bases) {
+    std::cout << base.hex() << std::endl;
+  }
+  return 0;
+}
+
+} // namespace chrona
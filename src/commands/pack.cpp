@@ -0,0 +1,92 @@
+#include "commands.hpp"
+#include "objects/object_store.hpp"
+#include "pack/bitmap.hpp"
+#include "pack/pack.hpp"
+#include "pack/pack_writer.hpp"
+#include "refs/refs.hpp"
+#include <iostream>
+#include <unistd.h>
+
+namespace chrona {
+
+int run_pack(const ParseResult &) {
+  Repository *repo = nullptr;
+  if (auto error = Repository::current(repo)) {
+    return report_error(*error);
+  }
+  auto &store = repo->objects();
+
+  // Everything is repacked into one pack, so loose objects and existing
+  // packs are all inputs
+  std::vector<ObjectId> ids;
+  store.for_each_loose([&](const ObjectId &id) { ids.push_back(id); });
+  const std::size_t loose = ids.size();
+  auto old_packs = store.packs();
+  for (const auto &pack : *old_packs) {
+    for (std::size_t i = 0; i < pack->size(); ++i) {
+      ids.push_back(pack->id_at(i));
+    }
+  }
+  if (ids.empty()) {
+    std::cout << "Nothing to pack" << std::endl;
+    return 0;
+  }
+
+  PackOptions options;
+  options.durable = true;
+  PackResult result;
+  if (auto error = write_pack(store.pack_dir(), store, ids, result, options)) {
+    return report_error(*error);
+  }
+  if (auto error = store.reload_packs()) {
+    return report_error(*error);
+  }
+  std::shared_ptr<PackFile> packed;
+  for (const auto &pack : *store.packs()) {
+    if (pack->path() == result.path) {
+      packed = pack;
+    }
+  }
+  if (!packed) {
+    return report_error(*create_error(
+        ErrorCode::NotFound, "New pack not found: " + result.path.string()));
+  }
+
+  // Only now is every object reachable through the new pack
+  for (const auto &pack : *old_packs) {
+    if (pack->path() == result.path) {
+      continue;
+    }
+    remove_pack_files(pack->path());
+  }
+  // Only loose objects the new pack holds go: chunked blobs stay loose as
+  // chunk lists, and objects written since the listing are in no pack
+  for (std::size_t i = 0; i < loose; ++i) {
+    if (packed->find(ids[i])) {
+      ::unlink(store.object_path(ids[i]).c_str());
+    }
+  }
+
+  // The new pack holds everything but chunked blobs, so without those it
+  // can answer reachability from bitmaps alone
+  std::vector<std::pair<std::string, ObjectId>> refs;
+  if (auto error = list_refs(repo->chrona_dir(), refs)) {
+    return report_error(*error);
+  }
+  std::vector<ObjectId> tips;
+  for (const auto &[name, id] : refs) {
+    tips.push_back(id);
+  }
+  std::size_t bitmaps = 0;
+  if (auto error = write_pack_bitmaps(store, *packed, tips, bitmaps)) {
+    return report_error(*error);
+  }
+
+  std::cout << "Packed " << result.objects << " objects (" << result.deltas
+            << " deltas, " << result.bytes << " bytes, " << bitmaps
+            << " bitmaps) into " << result.path.filename().string()
+            << std::endl;
+  return 0;
+}
+
+} // namespace chrona
@@ -0,0 +1,119 @@
+#include "checkout/checkout.hpp"
+#include "commands.hpp"
+#include "snapshot/tree_builder.hpp"
+#include "sparse/sparse.hpp"
+#include <iostream>
+
+namespace chrona {
+
+namespace {
+
+std::optional<Error> usage() {
+  return create_error(ExitCode::UsageError, ErrorCode::InvalidArgument,
+                      "Usage: chrona sparse set <dir>...\n"
+                      "       chrona sparse list\n"
+                      "       chrona sparse disable");
+}
+
+// Reshapes the working tree to `cone`. The target is the tree of the index
+// itself, so staged and unstaged changes inside the new cone carry over
+// untouched; a file with unstaged changes that would leave the cone stops
+// the command before anything is written.
+int reshape(Repository &repo, const SparseCone &cone) {
+  const auto &root = repo.root();
+  const auto &chrona_dir = repo.chrona_dir();
+  auto &store = repo.objects();
+  auto &pool = repo.pool();
+
+  bool resumed = false;
+  if (auto error = resume_checkout(root, store, pool, resumed)) {
+    return report_error(*error);
+  }
+  IndexView index;
+  if (auto error = IndexView::open(chrona_dir / "index", index)) {
+    return report_error(*error);
+  }
+  if (index.conflict_count() > 0) {
+    return report_error(*create_error(
+        ErrorCode::InvalidArgument,
+        std::to_string(index.conflict_count()) +
+            " paths still have merge conflicts; resolve and add them"));
+  }
+  ObjectBatch batch(store);
+  ObjectId tree;
+  if (auto error = write_index_tree(index, batch, tree)) {
+    return report_error(*error);
+  }
+  if (auto error = batch.commit()) {
+    return report_error(*error);
+  }
+
+  CheckoutOptions options;
+  options.durable = true;
+  options.cone = cone;
+  CheckoutPlan plan;
+  if (auto error = plan_checkout(root, store, pool, tree, std::nullopt, plan,
+                                 options)) {
+    return report_error(*error);
+  }
+  if (auto error = cone.save(chrona_dir)) {
+    return report_error(*error);
+  }
+  CheckoutResult result;
+  if (auto error = apply_checkout(root, store, pool, plan, result, options)) {
+    return report_error(*error);
+  }
+  std::cout << (cone.enabled() ? "Sparse cone set" : "Sparse cone disabled")
+            << " (" << result.written << " written, " << result.removed
+            << " removed, " << result.unchanged << " unchanged)"
+            << std::endl;
+  return 0;
+}
+
+} // namespace
+
+int run_sparse(const ParseResult &args) {
+  if (args.operands.empty()) {
+    return report_error(*usage());
+  }
+  auto action = args.operands[0];
+  bool setting = action == "set" && args.operands.size() > 1;
+  if (!setting && (args.operands.size() != 1 ||
+                   (action != "list" && action != "disable"))) {
+    return report_error(*usage());
+  }
+
+  Repository *repo = nullptr;
+  if (auto error = Repository::current(repo)) {
+    return report_error(*error);
+  }
+  if (action == "list") {
+    SparseCone cone;
+    if (auto error = SparseCone::load(repo->chrona_dir(), cone)) {
+      return report_error(*error);
+    }
+    for (const auto &dir : cone.dirs()) {
+      std::cout << dir << '\n';
+    }
+    std::cout << std::flush;
+    return 0;
+  }
+
+  SparseCone cone;
+  if (setting) {
+    std::vector<std::string> dirs;
+    for (std::size_t i = 1; i < args.operands.size(); ++i) {
+      dirs.emplace_back();
+      if (auto error =
+              repo_relative_path(*repo, args.operands[i], dirs.back())) {
+        return report_error(*error);
+      }
+    }
+    if (auto error = SparseCone::parse(dirs, cone)) {
+      return report_error(*error);
+    }
+  }
+  return reshape(*repo, cone);
+}
+
+} // namespace chrona
@@ -0,0 +1,84 @@
+#include "commands.hpp"
+#include "fsmonitor/daemon.hpp"
+#include "index/index.hpp"
+#include "parallel/work_pool.hpp"
+#include "status/status.hpp"
+#include <iostream>
+#include <unordered_map>
+
+namespace chrona {
+
+namespace {
+
+// Rewrites the index with fresh stat data for entries that were rehashed
+// and found unchanged, so the next status can skip them.
+std::optional<Error> refresh_index(const std::filesystem::path &path,
+                                   const IndexView &index,
+                                   std::vector<IndexEntry> refreshed) {
+  std::unordered_map<std::string_view, const IndexEntry *> by_path;
+  for (const auto &entry : refreshed) {
+    by_path.emplace(entry.path, &entry);
+  }
+
+  auto entries = index.entries();
+  for (auto &entry : entries) {
+    auto it = by_path.find(entry.path);
+    if (it != by_path.end()) {
+      entry.stat = it->second->stat;
+    }
+  }
+  return write_index(path, std::move(entries));
+}
+
+} // namespace
+
+int run_status(const ParseResult &) {
+  Repository *repo = nullptr;
+  if (auto error = Repository::current(repo)) {
+    return report_error(*error);
+  }
+  const auto &root = repo->root();
+  auto index_path = repo->chrona_dir() / "index";
+
+  // A running daemon already knows the answer; without one, scan
+  StatusResult status;
+  if (query_daemon(repo->chrona_dir(), status.changes)) {
+    IndexView index;
+    if (auto error = IndexView::open(index_path, index)) {
+      return report_error(*error);
+    }
+
+    auto &pool = repo->pool();
+    if (auto error = compute_status(root, index, pool, status)) {
+      return report_error(*error);
+    }
+
+    if (!status.refreshed.empty()) {
+      // Best effort: a failed refresh only costs a rehash next time
+      refresh_index(index_path, index, std::move(status.refreshed));
+    }
+  }
+
+  if (status.changes.empty()) {
+    std::cout << "Nothing to report, working tree matches the index"
+              << std::endl;
+    return 0;
+  }
+  for (const auto &change : status.changes) {
+    switch (change.kind) {
+    case ChangeKind::Modified:
+      std::cout << "  modified:  ";
+      break;
+    case ChangeKind::Deleted:
+      std::cout << "  deleted:   ";
+      break;
+    case ChangeKind::Untracked:
+      std::cout << "  untracked: ";
+      break;
+    }
+    std::cout << change.path << std::endl;
+  }
+  return 0;
+}
+
+} // namespace chrona
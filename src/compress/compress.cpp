@@ -0,0 +1,641 @@
+#include "compress.hpp"
+#include "pack/varint.hpp"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <queue>
+#include <vector>
+
+namespace chrona {
+
+namespace {
+
+// Block methods
+constexpr std::uint8_t method_stored = 0;
+constexpr std::uint8_t method_lz = 1;
+constexpr std::uint8_t method_huffman = 2; // LZ, then Huffman-coded
+
+constexpr int default_level = 5;
+constexpr std::size_t min_match = 4;
+constexpr std::size_t max_offset = 0xffff;
+constexpr int max_code_length = 12;
+constexpr std::size_t code_table_size = std::size_t{1} << max_code_length;
+
+int effective_level(int level) {
+  return level <= 0 ? default_level : std::min(level, 9);
+}
+
+std::uint32_t load32(const char *p) {
+  std::uint32_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+std::uint32_t hash4(const char *p, int bits) {
+  return (load32(p) * 2654435761u) >> (32 - bits);
+}
+
+std::size_t common_length(const char *a, const char *b, std::size_t limit) {
+  std::size_t n = 0;
+  while (n < limit && a[n] == b[n]) {
+    ++n;
+  }
+  return n;
+}
+
+// LZ sequences, as in LZ4: a token whose high nibble is the literal count
+// and low nibble the match length minus 4 (15 means "more bytes follow,
+// each adding up to 255"), the literals, then a 16-bit little-endian
+// offset. The last sequence carries literals only.
+void append_length(std::string &out, std::size_t extra) {
+  while (extra >= 255) {
+    out += static_cast<char>(255);
+    extra -= 255;
+  }
+  out += static_cast<char>(extra);
+}
+
+void emit_sequence(std::string &out, std::string_view literals,
+                   std::size_t offset, std::size_t match) {
+  std::size_t lit = literals.size();
+  std::size_t ml = match == 0 ? 0 : match - min_match;
+  out += static_cast<char>((std::min<std::size_t>(lit, 15) << 4) |
+                           (match == 0 ? 0 : std::min<std::size_t>(ml, 15)));
+  if (lit >= 15) {
+    append_length(out, lit - 15);
+  }
+  out.append(literals);
+  if (match == 0) {
+    return;
+  }
+  out += static_cast<char>(offset & 0xff);
+  out += static_cast<char>(offset >> 8);
+  if (ml >= 15) {
+    append_length(out, ml - 15);
+  }
+}
+
+// Greedy parse with one hash probe per position. Positions that keep
+// missing are skipped at a growing stride, so incompressible data passes
+// through quickly; higher levels widen the table and skip later.
+void lz_fast(std::string_view in, int level, std::string &out) {
+  const int bits = std::min(12 + (level + 1) / 2, 16);
+  const int skip_shift = 3 + level;
+  thread_local std::vector<std::uint32_t> table;
+  table.assign(std::size_t{1} << bits, 0);
+
+  const char *base = in.data();
+  std::size_t n = in.size();
+  std::size_t anchor = 0;
+  std::size_t pos = 1; // position 0 doubles as the empty marker
+  std::size_t misses = 0;
+  while (pos + min_match <= n) {
+    auto h = hash4(base + pos, bits);
+    std::size_t candidate = table[h];
+    table[h] = static_cast<std::uint32_t>(pos);
+    if (candidate == 0 || pos - candidate > max_offset ||
+        load32(base + candidate) != load32(base + pos)) {
+      pos += 1 + (++misses >> skip_shift);
+      continue;
+    }
+    misses = 0;
+    std::size_t length =
+        min_match + common_length(base + candidate + min_match,
+                                  base + pos + min_match,
+                                  n - pos - min_match);
+    while (pos > anchor && candidate > 0 &&
+           base[pos - 1] == base[candidate - 1]) {
+      --pos;
+      --candidate;
+      ++length;
+    }
+    emit_sequence(out, in.substr(anchor, pos - anchor), pos - candidate,
+                  length);
+    pos += length;
+    anchor = pos;
+    if (pos + min_match <= n) {
+      table[hash4(base + pos - 2, bits)] = static_cast<std::uint32_t>(pos - 2);
+    }
+  }
+  if (anchor < n) {
+    emit_sequence(out, in.substr(anchor), 0, 0);
+  }
+}
+
+// Hash chains searched up to a depth set by the level, with one step of
+// lazy matching: a match is deferred if the next position has a longer one.
+class ChainMatcher {
+public:
+  ChainMatcher(std::string_view in, int level)
+      : base_(in.data()), n_(in.size()),
+        depth_(std::size_t{1} << (level + 1)),
+        nice_(level >= 8 ? in.size() : 16 + 16 * std::size_t(level)) {
+    head_.assign(std::size_t{1} << bits, -1);
+    prev_.resize(n_);
+  }
+
+  void insert(std::size_t pos) {
+    auto h = hash4(base_ + pos, bits);
+    prev_[pos] = head_[h];
+    head_[h] = static_cast<std::int32_t>(pos);
+  }
+
+  // Longest earlier match at pos, or length 0 if none reaches min_match
+  void find(std::size_t pos, std::size_t &length, std::size_t &offset) const {
+    length = 0;
+    offset = 0;
+    std::size_t best = min_match - 1;
+    std::size_t limit = n_ - pos;
+    std::int32_t candidate = head_[hash4(base_ + pos, bits)];
+    for (std::size_t chain = depth_; candidate >= 0 && chain > 0; --chain) {
+      auto c = static_cast<std::size_t>(candidate);
+      if (pos - c > max_offset) {
+        break;
+      }
+      if (best < limit && base_[c + best] == base_[pos + best]) {
+        auto len = common_length(base_ + c, base_ + pos, limit);
+        if (len > best) {
+          best = len;
+          length = len;
+          offset = pos - c;
+          if (len >= nice_) {
+            break;
+          }
+        }
+      }
+      candidate = prev_[c];
+    }
+  }
+
+private:
+  static constexpr int bits = 16;
+  const char *base_;
+  std::size_t n_;
+  std::size_t depth_;
+  std::size_t nice_;
+  std::vector<std::int32_t> head_;
+  std::vector<std::int32_t> prev_;
+};
+
+void lz_dense(std::string_view in, int level, std::string &out) {
+  ChainMatcher matcher(in, level);
+  bool lazy = level >= 4;
+  std::size_t n = in.size();
+  std::size_t anchor = 0;
+  std::size_t pos = 0;
+  while (pos + min_match <= n) {
+    std::size_t length, offset;
+    matcher.find(pos, length, offset);
+    matcher.insert(pos);
+    if (length == 0) {
+      ++pos;
+      continue;
+    }
+    while (lazy && pos + 1 + min_match <= n) {
+      std::size_t next_length, next_offset;
+      matcher.find(pos + 1, next_length, next_offset);
+      if (next_length <= length) {
+        break;
+      }
+      ++pos;
+      matcher.insert(pos);
+      length = next_length;
+      offset = next_offset;
+    }
+    emit_sequence(out, in.substr(anchor, pos - anchor), offset, length);
+    for (std::size_t i = pos + 1; i < pos + length && i + min_match <= n;
+         ++i) {
+      matcher.insert(i);
+    }
+    pos += length;
+    anchor = pos;
+  }
+  if (anchor < n) {
+    emit_sequence(out, in.substr(anchor), 0, 0);
+  }
+}
+
+bool read_length(std::string_view &in, std::size_t &value) {
+  for (;;) {
+    if (in.empty()) {
+      return false;
+    }
+    auto byte = static_cast<std::uint8_t>(in.front());
+    in.remove_prefix(1);
+    value += byte;
+    if (byte != 255) {
+      return true;
+    }
+  }
+}
+
+bool lz_decode(std::string_view in, std::size_t raw_size, char *out) {
+  std::size_t produced = 0;
+  while (produced < raw_size) {
+    if (in.empty()) {
+      return false;
+    }
+    auto token = static_cast<std::uint8_t>(in.front());
+    in.remove_prefix(1);
+    std::size_t literals = token >> 4;
+    if (literals == 15 && !read_length(in, literals)) {
+      return false;
+    }
+    if (literals > in.size() || literals > raw_size - produced) {
+      return false;
+    }
+    std::memcpy(out + produced, in.data(), literals);
+    in.remove_prefix(literals);
+    produced += literals;
+    if (produced == raw_size) {
+      break;
+    }
+
+    if (in.size() < 2) {
+      return false;
+    }
+    std::size_t offset = static_cast<std::uint8_t>(in[0]) |
+                         (std::size_t{static_cast<std::uint8_t>(in[1])} << 8);
+    in.remove_prefix(2);
+    std::size_t match = token & 0xf;
+    if (match == 15 && !read_length(in, match)) {
+      return false;
+    }
+    match += min_match;
+    if (offset == 0 || offset > produced || match > raw_size - produced) {
+      return false;
+    }
+    const char *from = out + produced - offset;
+    if (offset >= match) {
+      std::memcpy(out + produced, from, match);
+    } else {
+      // Overlapping copies repeat the last `offset` bytes
+      for (std::size_t i = 0; i < match; ++i) {
+        out[produced + i] = from[i];
+      }
+    }
+    produced += match;
+  }
+  return in.empty();
+}
+
+// Code lengths for a length-limited Huffman code. Frequencies are halved
+// until the tree fits, which costs little since it rarely happens.
+void build_lengths(std::array<std::uint32_t, 256> freq,
+                   std::array<std::uint8_t, 256> &lengths) {
+  lengths.fill(0);
+  for (;;) {
+    struct Node {
+      std::uint64_t weight;
+      int left;
+      int right;
+    };
+    std::vector<Node> nodes;
+    using Entry = std::pair<std::uint64_t, int>;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<>> queue;
+    for (int s = 0; s < 256; ++s) {
+      if (freq[s] > 0) {
+        nodes.push_back({freq[s], -1, s});
+        queue.push({freq[s], static_cast<int>(nodes.size() - 1)});
+      }
+    }
+    if (nodes.empty()) {
+      return;
+    }
+    if (nodes.size() == 1) {
+      lengths[nodes[0].right] = 1;
+      return;
+    }
+    while (queue.size() > 1) {
+      auto a = queue.top();
+      queue.pop();
+      auto b = queue.top();
+      queue.pop();
+      nodes.push_back({a.first + b.first, a.second, b.second});
+      queue.push({a.first + b.first, static_cast<int>(nodes.size() - 1)});
+    }
+
+    // Depth-first from the root; leaves have left == -1
+    int deepest = 0;
+    std::vector<std::pair<int, int>> stack{{queue.top().second, 0}};
+    while (!stack.empty()) {
+      auto [node, depth] = stack.back();
+      stack.pop_back();
+      if (nodes[node].left < 0) {
+        lengths[nodes[node].right] = static_cast<std::uint8_t>(depth);
+        deepest = std::max(deepest, depth);
+      } else {
+        stack.push_back({nodes[node].left, depth + 1});
+        stack.push_back({nodes[node].right, depth + 1});
+      }
+    }
+    if (deepest <= max_code_length) {
+      return;
+    }
+    for (auto &f : freq) {
+      if (f > 0) {
+        f = (f >> 1) | 1;
+      }
+    }
+  }
+}
+
+// Canonical codes, bit-reversed because the bit stream is LSB-first
+void assign_codes(const std::array<std::uint8_t, 256> &lengths,
+                  std::array<std::uint16_t, 256> &codes) {
+  std::array<std::uint16_t, max_code_length + 2> next{};
+  std::array<std::uint16_t, max_code_length + 1> count{};
+  for (auto length : lengths) {
+    ++count[length];
+  }
+  count[0] = 0;
+  std::uint16_t code = 0;
+  for (int len = 1; len <= max_code_length; ++len) {
+    code = static_cast<std::uint16_t>((code + count[len - 1]) << 1);
+    next[len] = code;
+  }
+  for (int s = 0; s < 256; ++s) {
+    int len = lengths[s];
+    if (len == 0) {
+      continue;
+    }
+    std::uint16_t value = next[len]++;
+    std::uint16_t reversed = 0;
+    for (int i = 0; i < len; ++i) {
+      reversed = static_cast<std::uint16_t>((reversed << 1) | (value & 1));
+      value >>= 1;
+    }
+    codes[s] = reversed;
+  }
+}
+
+// Payload: varint LZ size, 256 code lengths packed in nibbles, bit stream
+void huffman_encode(std::string_view in, std::string &out) {
+  std::array<std::uint32_t, 256> freq{};
+  for (char c : in) {
+    ++freq[static_cast<std::uint8_t>(c)];
+  }
+  std::array<std::uint8_t, 256> lengths;
+  build_lengths(freq, lengths);
+  std::array<std::uint16_t, 256> codes{};
+  assign_codes(lengths, codes);
+
+  append_varint(out, in.size());
+  for (int s = 0; s < 256; s += 2) {
+    out += static_cast<char>(lengths[s] | (lengths[s + 1] << 4));
+  }
+  std::uint64_t bits = 0;
+  int count = 0;
+  for (char c : in) {
+    auto s = static_cast<std::uint8_t>(c);
+    bits |= std::uint64_t{codes[s]} << count;
+    count += lengths[s];
+    while (count >= 8) {
+      out += static_cast<char>(bits & 0xff);
+      bits >>= 8;
+      count -= 8;
+    }
+  }
+  if (count > 0) {
+    out += static_cast<char>(bits & 0xff);
+  }
+}
+
+bool huffman_decode(std::string_view in, std::string &out) {
+  std::uint64_t size;
+  if (!read_varint(in, size) || size > 2 * compress_block_size ||
+      in.size() < 128) {
+    return false;
+  }
+  std::array<std::uint8_t, 256> lengths;
+  for (int s = 0; s < 256; s += 2) {
+    auto byte = static_cast<std::uint8_t>(in[s / 2]);
+    lengths[s] = byte & 0xf;
+    lengths[s + 1] = byte >> 4;
+  }
+  in.remove_prefix(128);
+
+  std::size_t kraft = 0;
+  for (auto length : lengths) {
+    if (length > max_code_length) {
+      return false;
+    }
+    if (length > 0) {
+      kraft += code_table_size >> length;
+    }
+  }
+  if (kraft > code_table_size) {
+    return false;
+  }
+  std::array<std::uint16_t, 256> codes{};
+  assign_codes(lengths, codes);
+  // Entry: symbol << 4 | length; every index whose low bits are a code
+  // maps to that code's symbol
+  thread_local std::vector<std::uint16_t> table;
+  table.assign(code_table_size, 0);
+  for (int s = 0; s < 256; ++s) {
+    if (lengths[s] == 0) {
+      continue;
+    }
+    for (std::size_t i = codes[s]; i < code_table_size;
+         i += std::size_t{1} << lengths[s]) {
+      table[i] = static_cast<std::uint16_t>((s << 4) | lengths[s]);
+    }
+  }
+
+  out.resize(size);
+  std::uint64_t bits = 0;
+  int count = 0;
+  std::size_t next = 0;
+  std::uint64_t consumed = 0;
+  for (std::size_t i = 0; i < size; ++i) {
+    while (count <= 56) {
+      // Past the end reads zeros; overrunning is caught below
+      std::uint64_t byte =
+          next < in.size() ? static_cast<std::uint8_t>(in[next]) : 0;
+      bits |= byte << count;
+      ++next;
+      count += 8;
+    }
+    auto entry = table[bits & (code_table_size - 1)];
+    int length = entry & 0xf;
+    if (length == 0) {
+      return false;
+    }
+    out[i] = static_cast<char>(entry >> 4);
+    bits >>= length;
+    count -= length;
+    consumed += static_cast<std::uint64_t>(length);
+  }
+  return (consumed + 7) / 8 == in.size();
+}
+
+std::optional<Error> corrupt_stream(const char *what) {
+  return create_error(ErrorCode::CorruptObject,
+                      std::string("Corrupt compressed data: ") + what);
+}
+
+} // namespace
+
+std::optional<Codec> parse_codec(std::string_view name) {
+  if (name == "none") {
+    return Codec::None;
+  }
+  if (name == "fast") {
+    return Codec::Fast;
+  }
+  if (name == "dense") {
+    return Codec::Dense;
+  }
+  return std::nullopt;
+}
+
+const char *codec_name(Codec codec) {
+  switch (codec) {
+  case Codec::None:
+    return "none";
+  case Codec::Fast:
+    return "fast";
+  case Codec::Dense:
+    return "dense";
+  }
+  return "none";
+}
+
+Compressor::Compressor(const CompressionOptions &options)
+    : options_(options) {
+  options_.level = effective_level(options_.level);
+  pending_.reserve(compress_block_size);
+}
+
+void Compressor::update(std::string_view data, std::string &out) {
+  while (!data.empty()) {
+    auto take = std::min(data.size(), compress_block_size - pending_.size());
+    pending_.append(data.substr(0, take));
+    data.remove_prefix(take);
+    if (pending_.size() == compress_block_size) {
+      flush_block(out);
+    }
+  }
+}
+
+void Compressor::finish(std::string &out) {
+  if (!pending_.empty()) {
+    flush_block(out);
+  }
+  append_varint(out, 0);
+}
+
+void Compressor::flush_block(std::string &out) {
+  std::string_view block(pending_);
+  std::string_view best = block;
+  std::uint8_t method = method_stored;
+
+  scratch_.clear();
+  if (options_.codec == Codec::Dense) {
+    lz_dense(block, options_.level, scratch_);
+  } else if (options_.codec == Codec::Fast) {
+    lz_fast(block, options_.level, scratch_);
+  }
+  if (options_.codec != Codec::None && scratch_.size() < best.size()) {
+    best = scratch_;
+    method = method_lz;
+  }
+  std::string coded;
+  if (options_.codec == Codec::Dense && !scratch_.empty()) {
+    huffman_encode(scratch_, coded);
+    if (coded.size() < best.size()) {
+      best = coded;
+      method = method_huffman;
+    }
+  }
+
+  append_varint(out, block.size());
+  append_varint(out, best.size());
+  out += static_cast<char>(method);
+  out.append(best);
+  pending_.clear();
+}
+
+std::string compress(std::string_view data,
+                     const CompressionOptions &options) {
+  std::string out;
+  Compressor compressor(options);
+  compressor.update(data, out);
+  compressor.finish(out);
+  return out;
+}
+
+std::optional<Error> decompress(std::string_view &in, const ChunkSink &sink) {
+  std::string block;
+  std::string lz;
+  for (;;) {
+    std::uint64_t raw_size, stored_size;
+    if (!read_varint(in, raw_size)) {
+      return corrupt_stream("truncated block header");
+    }
+    if (raw_size == 0) {
+      return std::nullopt;
+    }
+    if (!read_varint(in, stored_size) || in.empty()) {
+      return corrupt_stream("truncated block header");
+    }
+    auto method = static_cast<std::uint8_t>(in.front());
+    in.remove_prefix(1);
+    if (raw_size > compress_block_size || stored_size > in.size()) {
+      return corrupt_stream("block out of range");
+    }
+    auto stored = in.substr(0, stored_size);
+    in.remove_prefix(stored_size);
+
+    std::string_view data;
+    if (method == method_stored) {
+      if (stored_size != raw_size) {
+        return corrupt_stream("stored block size mismatch");
+      }
+      data = stored;
+    } else if (method == method_lz || method == method_huffman) {
+      if (method == method_huffman) {
+        if (!huffman_decode(stored, lz)) {
+          return corrupt_stream("bad Huffman block");
+        }
+        stored = lz;
+      }
+      block.resize(raw_size);
+      if (!lz_decode(stored, raw_size, block.data())) {
+        return corrupt_stream("bad LZ block");
+      }
+      data = block;
+    } else {
+      return corrupt_stream("unknown block method");
+    }
+    if (auto error = sink(data)) {
+      return error;
+    }
+  }
+}
+
+std::optional<Error> decompress(std::string_view in, std::uint64_t size,
+                                std::string &out) {
+  out.clear();
+  // `size` comes from a header that may be corrupt: a block takes at least
+  // three bytes (two varints and a method) and expands to one block size
+  out.reserve(std::min<std::uint64_t>(
+      size, in.size() / 3 * std::uint64_t{compress_block_size}));
+  auto error = decompress(in, [&](std::string_view chunk) {
+    if (chunk.size() > size - out.size()) {
+      return corrupt_stream("longer than recorded size");
+    }
+    out.append(chunk);
+    return std::optional<Error>();
+  });
+  if (error) {
+    return error;
+  }
+  if (out.size() != size || !in.empty()) {
+    return corrupt_stream("size mismatch");
+  }
+  return std::nullopt;
+}
+
+} // namespace chrona
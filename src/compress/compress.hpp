@@ -0,0 +1,65 @@
+#pragma once
+
+#include "errors/error.hpp"
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace chrona {
+
+// Fast is a byte-oriented LZ77 with a single-probe hash table; Dense
+// searches hash chains with lazy matching and Huffman-codes the result.
+enum class Codec : std::uint8_t { None = 0, Fast = 1, Dense = 2 };
+
+std::optional<Codec> parse_codec(std::string_view name);
+const char *codec_name(Codec codec);
+
+struct CompressionOptions {
+  Codec codec = Codec::None;
+  // 1 (quickest) to 9 (smallest); 0 picks the codec's default.
+  int level = 0;
+};
+
+// Input is cut into blocks of at most this many bytes, so compressing and
+// decompressing both run in memory bounded by the block size.
+constexpr std::size_t compress_block_size = 64 * 1024;
+
+// A stream is a sequence of blocks, each
+//   varint raw size, varint stored size, method byte, stored bytes
+// ended by a zero raw size. A block that does not shrink is stored as-is,
+// so incompressible input grows by a few bytes per block at most.
+class Compressor {
+public:
+  explicit Compressor(const CompressionOptions &options);
+
+  // Appends the encoding of every completed block to `out`.
+  void update(std::string_view data, std::string &out);
+  // Flushes the last partial block and the end marker.
+  void finish(std::string &out);
+
+private:
+  void flush_block(std::string &out);
+
+  CompressionOptions options_;
+  std::string pending_;
+  std::string scratch_;
+};
+
+// Compresses a whole buffer into one stream.
+std::string compress(std::string_view data, const CompressionOptions &options);
+
+// Receives decompressed data one block at a time; the view is only valid
+// during the call.
+using ChunkSink = std::function<std::optional<Error>(std::string_view)>;
+
+// Decodes the stream at the front of `in`, feeding each block to `sink`,
+// and leaves `in` just past the end marker.
+std::optional<Error> decompress(std::string_view &in, const ChunkSink &sink);
+
+// Decodes a stream that must hold exactly `size` bytes.
+std::optional<Error> decompress(std::string_view in, std::uint64_t size,
+                                std::string &out);
+
+} // namespace chrona
@@ -0,0 +1,490 @@
+#include "diff.hpp"
+#include "diff/lines.hpp"
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+namespace chrona {
+
+namespace {
+
+constexpr std::uint32_t no_line = 0xffffffff;
+// Histogram diff ignores lines that occur more often than this in a region
+constexpr std::uint32_t max_chain = 64;
+
+struct Range {
+  std::size_t a0, a1, b0, b1;
+};
+
+class DiffEngine {
+public:
+  DiffEngine(const std::vector<std::uint32_t> &a,
+             const std::vector<std::uint32_t> &b, std::size_t id_count,
+             const DiffOptions &options, EditScript &out)
+      : a_(a), b_(b), id_count_(id_count), options_(options), out_(out) {
+    out_.removed.assign(a.size(), false);
+    out_.added.assign(b.size(), false);
+    max_cost_ = options.max_cost;
+    if (max_cost_ == 0) {
+      auto total = static_cast<double>(a.size() + b.size());
+      max_cost_ = std::max<std::size_t>(
+          256, static_cast<std::size_t>(std::sqrt(total)));
+    }
+  }
+
+  void run() {
+    pending_.push_back(Range{0, a_.size(), 0, b_.size()});
+    while (!pending_.empty()) {
+      auto range = pending_.back();
+      pending_.pop_back();
+      if (!trim(range)) {
+        continue;
+      }
+      switch (options_.algorithm) {
+      case DiffAlgorithm::Myers:
+        myers(range);
+        break;
+      case DiffAlgorithm::Histogram:
+        histogram(range);
+        break;
+      case DiffAlgorithm::Patience:
+        patience(range);
+        break;
+      }
+    }
+  }
+
+private:
+  // Strips the common prefix and suffix; returns false once nothing is
+  // left to compare (remaining lines, if any, are marked as changed).
+  bool trim(Range &r) {
+    while (r.a0 < r.a1 && r.b0 < r.b1 && a_[r.a0] == b_[r.b0]) {
+      ++r.a0;
+      ++r.b0;
+    }
+    while (r.a0 < r.a1 && r.b0 < r.b1 && a_[r.a1 - 1] == b_[r.b1 - 1]) {
+      --r.a1;
+      --r.b1;
+    }
+    if (r.a0 == r.a1 || r.b0 == r.b1) {
+      mark_changed(r);
+      return false;
+    }
+    return true;
+  }
+
+  void mark_changed(const Range &r) {
+    for (auto i = r.a0; i < r.a1; ++i) {
+      out_.removed[i] = true;
+    }
+    for (auto j = r.b0; j < r.b1; ++j) {
+      out_.added[j] = true;
+    }
+  }
+
+  // Linear-space Myers: find a point on an optimal (or, past max_cost,
+  // a good enough) path through the middle and solve both halves.
+  void myers(const Range &r) {
+    auto n = a_.size();
+    auto m = b_.size();
+    if (forward_.size() < n + m + 3) {
+      forward_.assign(n + m + 3, 0);
+      backward_.assign(n + m + 3, 0);
+    }
+    std::ptrdiff_t sx;
+    std::ptrdiff_t sy;
+    split(r, sx, sy);
+    if ((std::size_t(sx) == r.a0 && std::size_t(sy) == r.b0) ||
+        (std::size_t(sx) == r.a1 && std::size_t(sy) == r.b1)) {
+      // No progress possible; a full replacement is still a valid diff
+      mark_changed(r);
+      return;
+    }
+    pending_.push_back(Range{std::size_t(sx), r.a1, std::size_t(sy), r.b1});
+    pending_.push_back(Range{r.a0, std::size_t(sx), r.b0, std::size_t(sy)});
+  }
+
+  void split(const Range &r, std::ptrdiff_t &sx, std::ptrdiff_t &sy) {
+    const auto off1 = std::ptrdiff_t(r.a0), lim1 = std::ptrdiff_t(r.a1);
+    const auto off2 = std::ptrdiff_t(r.b0), lim2 = std::ptrdiff_t(r.b1);
+    const std::ptrdiff_t base = std::ptrdiff_t(b_.size()) + 1;
+    auto fv = [&](std::ptrdiff_t d) -> std::ptrdiff_t & {
+      return forward_[std::size_t(d + base)];
+    };
+    auto bv = [&](std::ptrdiff_t d) -> std::ptrdiff_t & {
+      return backward_[std::size_t(d + base)];
+    };
+
+    const std::ptrdiff_t dmin = off1 - lim2, dmax = lim1 - off2;
+    const std::ptrdiff_t fmid = off1 - off2, bmid = lim1 - lim2;
+    const bool odd = ((fmid - bmid) & 1) != 0;
+    std::ptrdiff_t fmin = fmid, fmax = fmid, bmin = bmid, bmax = bmid;
+    fv(fmid) = off1;
+    bv(bmid) = lim1;
+
+    for (std::size_t cost = 1;; ++cost) {
+      if (fmin > dmin) {
+        fv(--fmin - 1) = -1;
+      } else {
+        ++fmin;
+      }
+      if (fmax < dmax) {
+        fv(++fmax + 1) = -1;
+      } else {
+        --fmax;
+      }
+      for (auto d = fmax; d >= fmin; d -= 2) {
+        auto x = fv(d - 1) >= fv(d + 1) ? fv(d - 1) + 1 : fv(d + 1);
+        auto y = x - d;
+        while (x < lim1 && y < lim2 && a_[x] == b_[y]) {
+          ++x;
+          ++y;
+        }
+        fv(d) = x;
+        if (odd && bmin <= d && d <= bmax && bv(d) <= x) {
+          sx = x;
+          sy = y;
+          return;
+        }
+      }
+
+      if (bmin > dmin) {
+        bv(--bmin - 1) = PTRDIFF_MAX;
+      } else {
+        ++bmin;
+      }
+      if (bmax < dmax) {
+        bv(++bmax + 1) = PTRDIFF_MAX;
+      } else {
+        --bmax;
+      }
+      for (auto d = bmax; d >= bmin; d -= 2) {
+        auto x = bv(d - 1) < bv(d + 1) ? bv(d - 1) : bv(d + 1) - 1;
+        auto y = x - d;
+        while (x > off1 && y > off2 && a_[x - 1] == b_[y - 1]) {
+          --x;
+          --y;
+        }
+        bv(d) = x;
+        if (!odd && fmin <= d && d <= fmax && x <= fv(d)) {
+          sx = x;
+          sy = y;
+          return;
+        }
+      }
+
+      if (cost < max_cost_) {
+        continue;
+      }
+      // Too expensive: split at whichever frontier got furthest
+      std::ptrdiff_t fbest = -1, fbest_x = 0;
+      for (auto d = fmax; d >= fmin; d -= 2) {
+        auto x = std::min(fv(d), lim1);
+        auto y = x - d;
+        if (y > lim2) {
+          x = lim2 + d;
+          y = lim2;
+        }
+        if (fbest < x + y) {
+          fbest = x + y;
+          fbest_x = x;
+        }
+      }
+      std::ptrdiff_t bbest = PTRDIFF_MAX, bbest_x = 0;
+      for (auto d = bmax; d >= bmin; d -= 2) {
+        auto x = std::max(off1, bv(d));
+        auto y = x - d;
+        if (y < off2) {
+          x = off2 + d;
+          y = off2;
+        }
+        if (x + y < bbest) {
+          bbest = x + y;
+          bbest_x = x;
+        }
+      }
+      if ((lim1 + lim2) - bbest < fbest - (off1 + off2)) {
+        sx = fbest_x;
+        sy = fbest - fbest_x;
+      } else {
+        sx = bbest_x;
+        sy = bbest - bbest_x;
+      }
+      return;
+    }
+  }
+
+  void prepare_tables() {
+    if (head_.size() < id_count_) {
+      head_.assign(id_count_, no_line);
+      count_.assign(id_count_, 0);
+      count_b_.assign(id_count_, 0);
+    }
+    if (next_.size() < a_.size()) {
+      next_.resize(a_.size());
+    }
+  }
+
+  // Occurrences of each line within a[a0, a1); head_ lists them in order.
+  void index_old(const Range &r) {
+    prepare_tables();
+    for (auto i = r.a1; i-- > r.a0;) {
+      auto id = a_[i];
+      next_[i] = head_[id];
+      head_[id] = static_cast<std::uint32_t>(i);
+      ++count_[id];
+    }
+  }
+
+  void clear_old(const Range &r) {
+    for (auto i = r.a0; i < r.a1; ++i) {
+      head_[a_[i]] = no_line;
+      count_[a_[i]] = 0;
+    }
+  }
+
+  // Anchors on the matching run whose rarest line is least common in the
+  // old side, then recurses on both sides of it. Falls back to Myers when
+  // every common line is too frequent to be a useful anchor.
+  void histogram(const Range &r) {
+    index_old(r);
+    std::uint32_t best_count = max_chain + 1;
+    std::size_t best_len = 0, best_a = 0, best_b = 0;
+
+    for (auto j = r.b0; j < r.b1;) {
+      auto id = b_[j];
+      if (count_[id] == 0 || count_[id] > best_count) {
+        ++j;
+        continue;
+      }
+      std::size_t next_j = j + 1;
+      for (auto i = head_[id]; i != no_line; i = next_[i]) {
+        std::size_t len = 1;
+        std::uint32_t rarest = count_[id];
+        // Extend backwards and forwards while the lines keep matching
+        std::size_t as = i, bs = j;
+        while (as > r.a0 && bs > r.b0 && a_[as - 1] == b_[bs - 1]) {
+          --as;
+          --bs;
+          ++len;
+          rarest = std::min(rarest, count_[a_[as]]);
+        }
+        while (as + len < r.a1 && bs + len < r.b1 &&
+               a_[as + len] == b_[bs + len]) {
+          rarest = std::min(rarest, count_[a_[as + len]]);
+          ++len;
+        }
+        next_j = std::max(next_j, bs + len);
+        if (rarest < best_count || (rarest == best_count && len > best_len)) {
+          best_count = rarest;
+          best_len = len;
+          best_a = as;
+          best_b = bs;
+        }
+      }
+      j = next_j;
+    }
+    clear_old(r);
+
+    if (best_len == 0) {
+      myers(r);
+      return;
+    }
+    pending_.push_back(Range{best_a + best_len, r.a1, best_b + best_len, r.b1});
+    pending_.push_back(Range{r.a0, best_a, r.b0, best_b});
+  }
+
+  // Anchors on lines that occur exactly once on each side, keeping the
+  // longest run of them that appears in the same order on both.
+  void patience(const Range &r) {
+    index_old(r);
+    for (auto j = r.b0; j < r.b1; ++j) {
+      ++count_b_[b_[j]];
+    }
+    std::vector<std::pair<std::size_t, std::size_t>> unique; // (a, b)
+    for (auto j = r.b0; j < r.b1; ++j) {
+      auto id = b_[j];
+      if (count_[id] == 1 && count_b_[id] == 1) {
+        unique.emplace_back(head_[id], j);
+      }
+    }
+    for (auto j = r.b0; j < r.b1; ++j) {
+      count_b_[b_[j]] = 0;
+    }
+    clear_old(r);
+
+    if (unique.empty()) {
+      myers(r);
+      return;
+    }
+
+    // Longest increasing subsequence of old positions (in new order)
+    std::vector<std::size_t> tails;
+    std::vector<std::size_t> previous(unique.size(), SIZE_MAX);
+    for (std::size_t k = 0; k < unique.size(); ++k) {
+      auto it = std::lower_bound(
+          tails.begin(), tails.end(), unique[k].first,
+          [&](std::size_t t, std::size_t a) { return unique[t].first < a; });
+      if (it != tails.begin()) {
+        previous[k] = *(it - 1);
+      }
+      if (it == tails.end()) {
+        tails.push_back(k);
+      } else {
+        *it = k;
+      }
+    }
+    std::vector<std::size_t> anchors;
+    for (auto k = tails.back(); k != SIZE_MAX; k = previous[k]) {
+      anchors.push_back(k);
+    }
+
+    // anchors run last to first, so pushing in this order solves the
+    // regions front to back
+    std::size_t a_end = r.a1, b_end = r.b1;
+    for (auto k : anchors) {
+      auto [a, b] = unique[k];
+      pending_.push_back(Range{a + 1, a_end, b + 1, b_end});
+      a_end = a;
+      b_end = b;
+    }
+    pending_.push_back(Range{r.a0, a_end, r.b0, b_end});
+  }
+
+  const std::vector<std::uint32_t> &a_;
+  const std::vector<std::uint32_t> &b_;
+  std::size_t id_count_;
+  const DiffOptions &options_;
+  EditScript &out_;
+  std::size_t max_cost_;
+  std::vector<Range> pending_;
+  std::vector<std::ptrdiff_t> forward_;
+  std::vector<std::ptrdiff_t> backward_;
+  std::vector<std::uint32_t> head_;
+  std::vector<std::uint32_t> next_;
+  std::vector<std::uint32_t> count_;
+  std::vector<std::uint32_t> count_b_;
+};
+
+} // namespace
+
+EditScript diff_ids(const std::vector<std::uint32_t> &old_ids,
+                    const std::vector<std::uint32_t> &new_ids,
+                    std::size_t id_count, const DiffOptions &options) {
+  EditScript script;
+  DiffEngine(old_ids, new_ids, id_count, options, script).run();
+  return script;
+}
+
+DiffStats diff_text(std::string_view old_text, std::string_view new_text,
+                    const HunkCallback &on_hunk, const DiffOptions &options) {
+  std::vector<std::string_view> old_lines;
+  std::vector<std::string_view> new_lines;
+  split_lines(old_text, old_lines);
+  split_lines(new_text, new_lines);
+
+  LineInterner interner(old_lines.size() + new_lines.size());
+  std::vector<std::uint32_t> old_ids;
+  std::vector<std::uint32_t> new_ids;
+  old_ids.reserve(old_lines.size());
+  new_ids.reserve(new_lines.size());
+  for (auto line : old_lines) {
+    old_ids.push_back(interner.intern(line));
+  }
+  for (auto line : new_lines) {
+    new_ids.push_back(interner.intern(line));
+  }
+  auto script = diff_ids(old_ids, new_ids, interner.size(), options);
+
+  // Walk both sides in step; each change is a run of removed and/or added
+  // lines at one aligned position. Changes closer than twice the context
+  // share a hunk.
+  DiffStats stats;
+  const std::size_t n = old_lines.size();
+  const std::size_t m = new_lines.size();
+  const std::size_t context = options.context;
+  std::size_t i = 0;
+  std::size_t j = 0;
+  while (true) {
+    while (i < n && j < m && !script.removed[i] && !script.added[j]) {
+      ++i;
+      ++j;
+    }
+    if (i == n && j == m) {
+      break;
+    }
+
+    DiffHunk hunk;
+    std::size_t lead = std::min({context, i, j});
+    hunk.old_start = i - lead;
+    hunk.new_start = j - lead;
+    for (std::size_t k = 0; k < lead; ++k) {
+      hunk.lines.push_back(DiffLine{' ', old_lines[i - lead + k]});
+    }
+
+    while (true) {
+      while (i < n && script.removed[i]) {
+        hunk.lines.push_back(DiffLine{'-', old_lines[i++]});
+        ++stats.removed;
+      }
+      while (j < m && script.added[j]) {
+        hunk.lines.push_back(DiffLine{'+', new_lines[j++]});
+        ++stats.added;
+      }
+
+      // Count the equal run up to the next change (or the end)
+      std::size_t run = 0;
+      while (i + run < n && j + run < m && !script.removed[i + run] &&
+             !script.added[j + run]) {
+        ++run;
+      }
+      bool at_end = (i + run == n && j + run == m);
+      if (at_end || run > 2 * context) {
+        auto tail = std::min(run, context);
+        for (std::size_t k = 0; k < tail; ++k) {
+          hunk.lines.push_back(DiffLine{' ', old_lines[i + k]});
+        }
+        i += tail;
+        j += tail;
+        break;
+      }
+      for (std::size_t k = 0; k < run; ++k) {
+        hunk.lines.push_back(DiffLine{' ', old_lines[i + k]});
+      }
+      i += run;
+      j += run;
+    }
+
+    hunk.old_count = i - hunk.old_start;
+    hunk.new_count = j - hunk.new_start;
+    // Unified diffs number an empty side from the line before it
+    hunk.old_start += hunk.old_count > 0 ? 1 : 0;
+    hunk.new_start += hunk.new_count > 0 ? 1 : 0;
+    ++stats.hunks;
+    if (!on_hunk(hunk)) {
+      break;
+    }
+  }
+  return stats;
+}
+
+void format_hunk(const DiffHunk &hunk, std::string &out) {
+  out += "@@ -" + std::to_string(hunk.old_start);
+  if (hunk.old_count != 1) {
+    out += "," + std::to_string(hunk.old_count);
+  }
+  out += " +" + std::to_string(hunk.new_start);
+  if (hunk.new_count != 1) {
+    out += "," + std::to_string(hunk.new_count);
+  }
+  out += " @@\n";
+  for (const auto &line : hunk.lines) {
+    out += line.kind;
+    out += line.text;
+    if (line.text.empty() || line.text.back() != '\n') {
+      out += "\n\\ No newline at end of file\n";
+    }
+  }
+}
+
+} // namespace chrona
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <vector>
+
+namespace chrona {
+
+enum class DiffAlgorithm { Myers, Histogram, Patience };
+
+struct DiffOptions {
+  DiffAlgorithm algorithm = DiffAlgorithm::Histogram;
+  std::size_t context = 3;
+  // Myers gives up looking for a minimal edit after this many steps and
+  // splits at the furthest point reached instead; 0 picks a bound from the
+  // input size. Bounds the O(ND) worst case on very different inputs.
+  std::size_t max_cost = 0;
+};
+
+struct DiffLine {
+  char kind; // ' ', '-' or '+'
+  std::string_view text;
+};
+
+struct DiffHunk {
+  // 1-based starts, as in "@@ -old_start,old_count +new_start,new_count @@"
+  std::size_t old_start = 0;
+  std::size_t old_count = 0;
+  std::size_t new_start = 0;
+  std::size_t new_count = 0;
+  std::vector<DiffLine> lines;
+};
+
+struct DiffStats {
+  std::size_t hunks = 0;
+  std::size_t added = 0;
+  std::size_t removed = 0;
+};
+
+// Return false to stop the diff early.
+using HunkCallback = std::function<bool(const DiffHunk &)>;
+
+// Per-line change flags; equal lines of the two sides pair up in order.
+struct EditScript {
+  std::vector<bool> removed; // one per old line
+  std::vector<bool> added;   // one per new line
+};
+
+// Line ids come from a LineInterner shared by both sides.
+EditScript diff_ids(const std::vector<std::uint32_t> &old_ids,
+                    const std::vector<std::uint32_t> &new_ids,
+                    std::size_t id_count, const DiffOptions &options = {});
+
+// Splits, interns and diffs the two texts, handing each hunk to `on_hunk`
+// as soon as it is complete. Hunk lines point into the inputs.
+DiffStats diff_text(std::string_view old_text, std::string_view new_text,
+                    const HunkCallback &on_hunk,
+                    const DiffOptions &options = {});
+
+// Appends the "@@ ... @@" header and lines of a hunk in unified format.
+void format_hunk(const DiffHunk &hunk, std::string &out);
+
+} // namespace chrona
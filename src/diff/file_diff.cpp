@@ -0,0 +1,91 @@
+#include "file_diff.hpp"
+#include "trace/trace.hpp"
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+namespace chrona {
+
+namespace {
+
+constexpr std::size_t binary_probe_size = 8000;
+
+} // namespace
+
+bool looks_binary(std::string_view text) {
+  auto probe = text.substr(0, std::min(text.size(), binary_probe_size));
+  return std::memchr(probe.data(), '\0', probe.size()) != nullptr;
+}
+
+std::string render_file_diff(const std::string &old_label,
+                             const std::string &new_label,
+                             std::string_view old_text,
+                             std::string_view new_text,
+                             const DiffOptions &options) {
+  if (old_text == new_text) {
+    return {};
+  }
+  // The header names the path on both sides even for added/deleted files
+  auto header_old =
+      old_label == "/dev/null" ? "a/" + new_label.substr(2) : old_label;
+  auto header_new =
+      new_label == "/dev/null" ? "b/" + old_label.substr(2) : new_label;
+  std::string out = "diff --chrona " + header_old + " " + header_new + "\n";
+  if (looks_binary(old_text) || looks_binary(new_text)) {
+    out += "Binary files " + old_label + " and " + new_label + " differ\n";
+    return out;
+  }
+  out += "--- " + old_label + "\n";
+  out += "+++ " + new_label + "\n";
+  diff_text(
+      old_text, new_text,
+      [&](const DiffHunk &hunk) {
+        format_hunk(hunk, out);
+        return true;
+      },
+      options);
+  return out;
+}
+
+std::optional<Error>
+diff_files(const std::vector<FileDiffJob> &jobs, WorkPool &pool,
+           const DiffOptions &options,
+           const std::function<void(std::size_t, std::string_view)> &emit) {
+  CHRONA_TRACE_SCOPE("diff_files");
+  std::vector<std::string> rendered(jobs.size());
+  std::vector<bool> ready(jobs.size(), false);
+  std::size_t next = 0;
+  std::mutex mutex;
+  std::optional<Error> first_error;
+
+  pool.parallel_for(jobs.size(), 1, [&](std::size_t begin, std::size_t end) {
+    for (auto i = begin; i < end; ++i) {
+      std::string old_text;
+      std::string new_text;
+      std::string text;
+      auto error = jobs[i].load(old_text, new_text);
+      if (!error) {
+        text = render_file_diff(jobs[i].old_label, jobs[i].new_label,
+                                old_text, new_text, options);
+      }
+
+      std::lock_guard lock(mutex);
+      if (error && !first_error) {
+        first_error = std::move(error);
+      }
+      rendered[i] = std::move(text);
+      ready[i] = true;
+      // Flush the finished prefix; later jobs wait for earlier ones
+      while (next < jobs.size() && ready[next]) {
+        if (!rendered[next].empty()) {
+          emit(next, rendered[next]);
+        }
+        std::string().swap(rendered[next]);
+        ++next;
+      }
+    }
+  });
+  return first_error;
+}
+
+} // namespace chrona
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "diff/diff.hpp"
+#include "errors/error.hpp"
+#include "parallel/work_pool.hpp"
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace chrona {
+
+struct FileDiffJob {
+  std::string old_label; // "a/<path>", or "/dev/null" for a new file
+  std::string new_label; // "b/<path>", or "/dev/null" for a deleted file
+  // Loads both sides; runs on a pool thread.
+  std::function<std::optional<Error>(std::string &old_text,
+                                     std::string &new_text)>
+      load;
+};
+
+// Content with a NUL byte in its first 8000 bytes is binary: diff reports
+// it as such and merge does not merge it by line.
+bool looks_binary(std::string_view text);
+
+// Renders one file pair as a unified diff ("" when the texts are equal).
+// Binary content is reported as such.
+std::string render_file_diff(const std::string &old_label,
+                             const std::string &new_label,
+                             std::string_view old_text,
+                             std::string_view new_text,
+                             const DiffOptions &options = {});
+
+// Loads and diffs the jobs in parallel. Each rendering is passed to `emit`
+// in job order as soon as it and every earlier job are done, so output is
+// streamed yet identical for any thread count. Returns the first load
+// error after all jobs have run.
+std::optional<Error>
+diff_files(const std::vector<FileDiffJob> &jobs, WorkPool &pool,
+           const DiffOptions &options,
+           const std::function<void(std::size_t, std::string_view)> &emit);
+
+} // namespace chrona
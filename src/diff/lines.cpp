@@ -0,0 +1,151 @@
+#include "lines.hpp"
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CHRONA_HAVE_AVX2 1
+#include <immintrin.h>
+#endif
+
+namespace chrona {
+
+namespace {
+
+void split_scalar(std::string_view text, std::vector<std::string_view> &out) {
+  const char *begin = text.data();
+  const char *end = begin + text.size();
+  while (begin < end) {
+    auto *newline = static_cast<const char *>(
+        std::memchr(begin, '\n', static_cast<std::size_t>(end - begin)));
+    const char *line_end = newline ? newline + 1 : end;
+    out.emplace_back(begin, static_cast<std::size_t>(line_end - begin));
+    begin = line_end;
+  }
+}
+
+#ifdef CHRONA_HAVE_AVX2
+
+__attribute__((target("avx2"))) void
+split_avx2(std::string_view text, std::vector<std::string_view> &out) {
+  const char *data = text.data();
+  const std::size_t size = text.size();
+  const __m256i newline = _mm256_set1_epi8('\n');
+  std::size_t line_start = 0;
+  std::size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    __m256i chunk =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+    auto mask = static_cast<std::uint32_t>(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, newline)));
+    while (mask != 0) {
+      std::size_t end = i + static_cast<std::size_t>(__builtin_ctz(mask)) + 1;
+      out.emplace_back(data + line_start, end - line_start);
+      line_start = end;
+      mask &= mask - 1;
+    }
+  }
+  split_scalar(text.substr(line_start), out);
+}
+
+bool cpu_has_avx2() {
+  static const bool has = __builtin_cpu_supports("avx2");
+  return has;
+}
+
+#endif
+
+std::uint64_t mix(std::uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  return h;
+}
+
+} // namespace
+
+void split_lines(std::string_view text, std::vector<std::string_view> &out,
+                 LineKernel kernel) {
+  out.clear();
+#ifdef CHRONA_HAVE_AVX2
+  if (kernel == LineKernel::Auto && cpu_has_avx2()) {
+    split_avx2(text, out);
+    return;
+  }
+#else
+  (void)kernel;
+#endif
+  split_scalar(text, out);
+}
+
+const char *line_kernel_name() {
+#ifdef CHRONA_HAVE_AVX2
+  if (cpu_has_avx2()) {
+    return "avx2";
+  }
+#endif
+  return "scalar";
+}
+
+std::uint64_t hash_line(std::string_view line) {
+  std::uint64_t h = 0x9E3779B97F4A7C15ULL ^ line.size();
+  const char *p = line.data();
+  std::size_t left = line.size();
+  for (; left >= 8; left -= 8, p += 8) {
+    std::uint64_t word;
+    std::memcpy(&word, p, sizeof(word));
+    h = (h ^ word) * 0x100000001b3ULL;
+    h = (h << 29) | (h >> 35);
+  }
+  if (left > 0) {
+    std::uint64_t word = 0;
+    std::memcpy(&word, p, left);
+    h = (h ^ word) * 0x100000001b3ULL;
+  }
+  return mix(h);
+}
+
+LineInterner::LineInterner(std::size_t expected_lines) {
+  std::size_t capacity = 64;
+  while (capacity < expected_lines * 2) {
+    capacity *= 2;
+  }
+  slots_.resize(capacity);
+  lines_.reserve(expected_lines);
+}
+
+std::uint32_t LineInterner::intern(std::string_view line) {
+  if ((lines_.size() + 1) * 2 > slots_.size()) {
+    grow();
+  }
+  auto hash = hash_line(line);
+  auto mask = slots_.size() - 1;
+  for (auto i = static_cast<std::size_t>(hash) & mask;; i = (i + 1) & mask) {
+    auto &slot = slots_[i];
+    if (slot.id == empty) {
+      slot.hash = hash;
+      slot.id = static_cast<std::uint32_t>(lines_.size());
+      lines_.push_back(line);
+      return slot.id;
+    }
+    if (slot.hash == hash && lines_[slot.id] == line) {
+      return slot.id;
+    }
+  }
+}
+
+void LineInterner::grow() {
+  std::vector<Slot> old(slots_.size() * 2);
+  old.swap(slots_);
+  auto mask = slots_.size() - 1;
+  for (const auto &slot : old) {
+    if (slot.id == empty) {
+      continue;
+    }
+    auto i = static_cast<std::size_t>(slot.hash) & mask;
+    while (slots_[i].id != empty) {
+      i = (i + 1) & mask;
+    }
+    slots_[i] = slot;
+  }
+}
+
+} // namespace chrona
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace chrona {
+
+enum class LineKernel { Auto, Scalar };
+
+// Splits text into lines. Each line keeps its '\n'; only the last line can
+// lack one. Newlines are found 32 bytes at a time with AVX2 when the CPU has
+// it, otherwise with memchr.
+void split_lines(std::string_view text, std::vector<std::string_view> &out,
+                 LineKernel kernel = LineKernel::Auto);
+
+// Name of the kernel LineKernel::Auto resolves to ("avx2" or "scalar").
+const char *line_kernel_name();
+
+// Word-at-a-time 64-bit hash; not cryptographic.
+std::uint64_t hash_line(std::string_view line);
+
+// Gives equal lines (from either side of a diff) the same dense id, so the
+// diff algorithms compare integers instead of strings.
+class LineInterner {
+public:
+  explicit LineInterner(std::size_t expected_lines = 0);
+
+  std::uint32_t intern(std::string_view line);
+  std::size_t size() const { return lines_.size(); }
+
+private:
+  void grow();
+
+  struct Slot {
+    std::uint64_t hash = 0;
+    std::uint32_t id = empty;
+  };
+  static constexpr std::uint32_t empty = 0xffffffff;
+
+  std::vector<Slot> slots_; // open addressing, power-of-two size
+  std::vector<std::string_view> lines_;
+};
+
+} // namespace chrona
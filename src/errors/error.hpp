@@ -1,5 +1,8 @@
+#pragma once
+
 #include <iostream>
 #include <optional>
+#include <string>
 
 namespace chrona {
 
@@ -14,6 +17,12 @@ enum class ErrorCode {
   AlreadyExists,
   InvalidArgument,
   IOError,
+  CorruptObject,
+  // A compare-and-swap found another value than expected, or a name
+  // clashes with an existing one
+  Conflict,
+  // Another writer holds the lock
+  Locked,
   UnknownError,
 };
 
@@ -0,0 +1,591 @@
+#include "fsck.hpp"
+#include "hash/sha256.hpp"
+#include "history/commit.hpp"
+#include "index/index.hpp"
+#include "io/file_io.hpp"
+#include "io/mapped_file.hpp"
+#include "merge/merge.hpp"
+#include "pack/pack.hpp"
+#include "refs/refs.hpp"
+#include "snapshot/tree.hpp"
+#include "trace/trace.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <sys/stat.h>
+#include <tuple>
+#include <unordered_set>
+
+namespace chrona {
+
+namespace {
+
+constexpr char state_magic[4] = {'C', 'F', 'S', 'K'};
+constexpr std::uint32_t state_version = 1;
+// Pack entries verified per task; each task reads its run of positions
+// in pack order
+constexpr std::size_t min_pack_segment = 256;
+// The pack trailer is hashed in slices read ahead of the hasher
+constexpr std::size_t checksum_slice = 4 << 20;
+// File times come from a coarse clock that may lag the system clock, so
+// the recorded start is moved back by this much
+constexpr std::int64_t mtime_slack_ns = 100000000;
+
+std::int64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+std::int64_t mtime_ns(const struct stat &st) {
+  return static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000 +
+         st.st_mtim.tv_nsec;
+}
+
+// .chrona/fsck-state: "CFSK" u32 version i64 start_ns u32 count, then
+// the trailers of the packs that run verified.
+struct FsckState {
+  std::int64_t start_ns = 0;
+  std::unordered_set<ObjectId, ObjectIdHash> packs;
+};
+
+// A missing or unreadable state just verifies everything.
+bool load_state(const std::filesystem::path &path, FsckState &state) {
+  std::string data;
+  if (read_file(path, data)) {
+    return false;
+  }
+  constexpr std::size_t header = 4 + 4 + 8 + 4;
+  std::uint32_t version;
+  std::uint32_t count;
+  if (data.size() < header || std::memcmp(data.data(), state_magic, 4) != 0) {
+    return false;
+  }
+  std::memcpy(&version, data.data() + 4, 4);
+  std::memcpy(&state.start_ns, data.data() + 8, 8);
+  std::memcpy(&count, data.data() + 16, 4);
+  if (version != state_version ||
+      data.size() != header + std::size_t{count} * ObjectId::size) {
+    return false;
+  }
+  for (std::uint32_t i = 0; i < count; ++i) {
+    ObjectId id;
+    std::memcpy(id.bytes.data(), data.data() + header + i * ObjectId::size,
+                ObjectId::size);
+    state.packs.insert(id);
+  }
+  return true;
+}
+
+std::optional<Error> save_state(const std::filesystem::path &path,
+                                const FsckState &state) {
+  std::string out(state_magic, 4);
+  auto count = static_cast<std::uint32_t>(state.packs.size());
+  out.append(reinterpret_cast<const char *>(&state_version), 4);
+  out.append(reinterpret_cast<const char *>(&state.start_ns), 8);
+  out.append(reinterpret_cast<const char *>(&count), 4);
+  for (const auto &id : state.packs) {
+    out.append(reinterpret_cast<const char *>(id.bytes.data()),
+               ObjectId::size);
+  }
+  return write_file_atomic(path, out);
+}
+
+bool sampled(const ObjectId &id, const FsckOptions &options) {
+  if (options.sample >= 1.0) {
+    return true;
+  }
+  // splitmix64 over the leading id bytes, so every seed picks a
+  // different, evenly spread subset
+  std::uint64_t x;
+  std::memcpy(&x, id.bytes.data(), sizeof(x));
+  x += options.seed + 0x9E3779B97F4A7C15ULL;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  x ^= x >> 31;
+  return static_cast<double>(x >> 11) * 0x1p-53 < options.sample;
+}
+
+class Checker {
+public:
+  explicit Checker(const ObjectStore &store) : store_(store) {}
+
+  void report(FsckProblem problem, const ObjectId &id, std::string detail) {
+    std::lock_guard lock(mutex_);
+    issues_.push_back(FsckIssue{problem, id, std::move(detail)});
+  }
+
+  // The detail is only built for a missing object.
+  void require(const ObjectId &id, const char *kind,
+               const ObjectId &referrer, std::string_view entry = {}) {
+    if (store_.contains(id)) {
+      return;
+    }
+    auto detail = std::string("referenced by ") + kind + " " + referrer.hex();
+    if (!entry.empty()) {
+      detail += " entry " + std::string(entry);
+    }
+    report(FsckProblem::Missing, id, std::move(detail));
+  }
+
+  // Verifies one stored copy of `id`; `where` names the copy.
+  void check(const ObjectId &id, const ObjectView &view,
+             std::string_view where) {
+    auto content = view.content();
+    bytes_.fetch_add(content.size(), std::memory_order_relaxed);
+    auto got = hash_object(view.type(), content);
+    if (got != id) {
+      report(FsckProblem::HashMismatch, id,
+             std::string(where) + " hashes to " + got.hex());
+      return;
+    }
+    if (view.type() == ObjectType::Tree) {
+      check_tree(id, content);
+    } else if (view.type() == ObjectType::Commit) {
+      check_commit(id, content);
+    }
+  }
+
+  // A chunk list is verified by streaming its chunks through one hasher:
+  // each must exist, be a blob of the listed size, and together they
+  // must hash to the blob's id.
+  void check_chunked(const ObjectId &id,
+                     const std::vector<ChunkRef> &chunks) {
+    std::uint64_t size = 0;
+    for (const auto &chunk : chunks) {
+      size += chunk.size;
+    }
+    Sha256 hasher;
+    hasher.update(encode_object_header(ObjectType::Blob, size));
+    for (const auto &chunk : chunks) {
+      if (!store_.contains(chunk.id)) {
+        report(FsckProblem::Missing, chunk.id, "chunk of " + id.hex());
+        return;
+      }
+      auto error = store_.read_stream(
+          chunk.id,
+          [&](ObjectType type, std::uint64_t chunk_size) {
+            if (type != ObjectType::Blob || chunk_size != chunk.size) {
+              return create_error(ErrorCode::CorruptObject,
+                                  "chunk " + chunk.id.hex() +
+                                      " does not match the chunk list");
+            }
+            return std::optional<Error>();
+          },
+          [&](std::string_view data) {
+            hasher.update(data);
+            return std::optional<Error>();
+          });
+      if (error) {
+        report(FsckProblem::Unreadable, id, error->message);
+        return;
+      }
+    }
+    bytes_.fetch_add(size, std::memory_order_relaxed);
+    auto digest = hasher.finish();
+    ObjectId got;
+    std::memcpy(got.bytes.data(), digest.data(), ObjectId::size);
+    if (got != id) {
+      report(FsckProblem::HashMismatch, id,
+             "chunks reassemble to " + got.hex());
+    }
+  }
+
+  std::vector<FsckIssue> take_issues() { return std::move(issues_); }
+  std::uint64_t bytes() const { return bytes_.load(); }
+
+private:
+  void check_tree(const ObjectId &id, std::string_view content) {
+    std::vector<TreeEntry> entries;
+    if (auto error = decode_tree(content, entries)) {
+      report(FsckProblem::BadEncoding, id, error->message);
+      return;
+    }
+    for (const auto &entry : entries) {
+      if (!is_valid_entry_name(entry.name)) {
+        report(FsckProblem::BadEncoding, id,
+               "bad entry name \"" + entry.name + "\"");
+        return;
+      }
+    }
+    if (encode_tree(entries) != content) {
+      report(FsckProblem::BadEncoding, id, "tree is not in canonical form");
+      return;
+    }
+    for (const auto &entry : entries) {
+      require(entry.id, "tree", id, entry.name);
+    }
+  }
+
+  void check_commit(const ObjectId &id, std::string_view content) {
+    Commit commit;
+    if (auto error = decode_commit(content, commit)) {
+      report(FsckProblem::BadEncoding, id, error->message);
+      return;
+    }
+    if (encode_commit(commit) != content) {
+      report(FsckProblem::BadEncoding, id, "commit is not in canonical form");
+      return;
+    }
+    require(commit.tree, "commit", id);
+    for (const auto &parent : commit.parents) {
+      require(parent, "commit", id);
+    }
+  }
+
+  const ObjectStore &store_;
+  std::mutex mutex_;
+  std::vector<FsckIssue> issues_;
+  std::atomic<std::uint64_t> bytes_{0};
+};
+
+// An edge of the walk from the roots: `id` is expected to be of `type`.
+struct Link {
+  ObjectId id;
+  ObjectType type;
+  ObjectId referrer;
+  const char *kind; // what `referrer` is
+};
+
+// Walks everything reachable from `links` level by level on `pool` and
+// reports each object that is absent. Commits and trees are read; blobs
+// are only looked up, apart from a chunked blob's list, which is followed
+// to its chunks. Returns the number of objects reached.
+std::size_t check_reachable(const ObjectStore &store, WorkPool &pool,
+                            std::vector<Link> links, Checker &checker) {
+  CHRONA_TRACE_SCOPE("fsck.reachable");
+  std::unordered_set<ObjectId, ObjectIdHash> chunked;
+  std::string list;
+  if (!read_file(store.chunked_list_path(), list)) {
+    for (std::size_t at = 0; at + ObjectId::size <= list.size();
+         at += ObjectId::size) {
+      ObjectId id;
+      std::memcpy(id.bytes.data(), list.data() + at, ObjectId::size);
+      chunked.insert(id);
+    }
+  }
+
+  auto visit = [&](const Link &link, std::vector<Link> &found) {
+    if (!store.contains(link.id)) {
+      checker.report(FsckProblem::Missing, link.id,
+                     std::string("referenced by ") + link.kind + " " +
+                         link.referrer.hex());
+      return;
+    }
+    if (link.type == ObjectType::Blob) {
+      std::vector<ChunkRef> chunks;
+      if (chunked.count(link.id) &&
+          !store.read_chunk_list(link.id, chunks)) {
+        for (const auto &chunk : chunks) {
+          found.push_back(
+              Link{chunk.id, ObjectType::Blob, link.id, "chunk list"});
+        }
+      }
+      return;
+    }
+    ObjectView view;
+    if (store.read(link.id, view) || view.type() != link.type) {
+      return; // reported when the object itself is checked
+    }
+    if (link.type == ObjectType::Commit) {
+      Commit commit;
+      if (decode_commit(view.content(), commit)) {
+        return;
+      }
+      found.push_back(Link{commit.tree, ObjectType::Tree, link.id, "commit"});
+      for (const auto &parent : commit.parents) {
+        found.push_back(Link{parent, ObjectType::Commit, link.id, "commit"});
+      }
+    } else if (link.type == ObjectType::Tree) {
+      std::vector<TreeEntry> entries;
+      if (decode_tree(view.content(), entries)) {
+        return;
+      }
+      for (const auto &entry : entries) {
+        found.push_back(Link{entry.id,
+                             entry.mode == EntryMode::Directory
+                                 ? ObjectType::Tree
+                                 : ObjectType::Blob,
+                             link.id, "tree"});
+      }
+    }
+  };
+
+  std::unordered_set<ObjectId, ObjectIdHash> seen;
+  std::vector<Link> level;
+  for (auto &link : links) {
+    if (seen.insert(link.id).second) {
+      level.push_back(link);
+    }
+  }
+  std::mutex mutex;
+  while (!level.empty()) {
+    std::vector<Link> next;
+    pool.parallel_for(level.size(), 64, [&](std::size_t begin,
+                                            std::size_t end) {
+      std::vector<Link> found;
+      for (std::size_t i = begin; i < end; ++i) {
+        visit(level[i], found);
+      }
+      std::lock_guard lock(mutex);
+      next.insert(next.end(), found.begin(), found.end());
+    });
+    level.clear();
+    for (auto &link : next) {
+      if (seen.insert(link.id).second) {
+        level.push_back(link);
+      }
+    }
+  }
+  return seen.size();
+}
+
+// Hashes the whole pack in one sequential pass, reading ahead of the
+// hasher, and compares the result with its trailer.
+void check_pack_trailer(const PackFile &pack, Checker &checker) {
+  auto name = pack.path().filename().string();
+  MappedFile file;
+  if (auto error = MappedFile::open(pack.path(), file)) {
+    checker.report(FsckProblem::BadPack, pack.checksum(),
+                   name + ": " + error->message);
+    return;
+  }
+  if (file.size() < Sha256::digest_size) {
+    checker.report(FsckProblem::BadPack, pack.checksum(), name + ": too short");
+    return;
+  }
+  auto body = file.view().substr(0, file.size() - Sha256::digest_size);
+  Sha256 hasher;
+  for (std::size_t at = 0; at < body.size(); at += checksum_slice) {
+    file.prefetch(at + checksum_slice, checksum_slice);
+    hasher.update(body.substr(at, checksum_slice));
+  }
+  auto digest = hasher.finish();
+  if (std::memcmp(digest.data(), file.data() + body.size(), digest.size()) !=
+      0) {
+    checker.report(FsckProblem::BadPack, pack.checksum(),
+                   name + ": checksum mismatch");
+  }
+}
+
+} // namespace
+
+const char *fsck_problem_name(FsckProblem problem) {
+  switch (problem) {
+  case FsckProblem::HashMismatch:
+    return "hash-mismatch";
+  case FsckProblem::Unreadable:
+    return "unreadable";
+  case FsckProblem::BadEncoding:
+    return "bad-encoding";
+  case FsckProblem::Missing:
+    return "missing";
+  case FsckProblem::BadPack:
+    return "bad-pack";
+  case FsckProblem::BadRef:
+    return "bad-ref";
+  }
+  return "unknown";
+}
+
+std::optional<Error> fsck(const std::filesystem::path &chrona_dir,
+                          const ObjectStore &store, WorkPool &pool,
+                          FsckResult &out, const FsckOptions &options) {
+  CHRONA_TRACE_SCOPE("fsck");
+  out = FsckResult();
+  const auto state_path = chrona_dir / "fsck-state";
+  const bool full = options.sample >= 1.0;
+  FsckState previous;
+  if (options.incremental && !load_state(state_path, previous)) {
+    previous = FsckState();
+  }
+  FsckState next;
+  next.start_ns = now_ns() - mtime_slack_ns;
+  Checker checker(store);
+
+  // The pack trailers hash in the background while the objects are
+  // checked
+  auto packs = store.packs();
+  for (const auto &pack : *packs) {
+    if (previous.packs.count(pack->checksum()) != 0) {
+      continue;
+    }
+    if (full) {
+      pool.submit([&checker, pack] { check_pack_trailer(*pack, checker); });
+    }
+  }
+
+  std::vector<ObjectId> loose;
+  store.for_each_loose([&](const ObjectId &id) {
+    if (sampled(id, options)) {
+      loose.push_back(id);
+    } else {
+      ++out.skipped;
+    }
+  });
+  std::atomic<std::size_t> loose_checked{0};
+  std::atomic<std::size_t> chunked{0};
+  std::atomic<std::size_t> loose_skipped{0};
+  pool.parallel_for(loose.size(), 64, [&](std::size_t begin, std::size_t end) {
+    for (std::size_t i = begin; i < end; ++i) {
+      const auto &id = loose[i];
+      struct stat st;
+      if (::stat(store.object_path(id).c_str(), &st) != 0) {
+        continue; // packed or pruned since the listing
+      }
+      if (previous.start_ns != 0 && mtime_ns(st) < previous.start_ns) {
+        loose_skipped.fetch_add(1, std::memory_order_relaxed);
+        continue;
+      }
+      std::vector<ChunkRef> chunks;
+      if (auto error = store.read_chunk_list(id, chunks)) {
+        checker.report(FsckProblem::Unreadable, id, error->message);
+        continue;
+      }
+      loose_checked.fetch_add(1, std::memory_order_relaxed);
+      if (!chunks.empty()) {
+        chunked.fetch_add(1, std::memory_order_relaxed);
+        checker.check_chunked(id, chunks);
+        continue;
+      }
+      ObjectView view;
+      if (auto error = store.read_loose(id, view)) {
+        if (error->error_code != ErrorCode::NotFound) {
+          checker.report(FsckProblem::Unreadable, id, error->message);
+        }
+        continue;
+      }
+      checker.check(id, view, "loose object");
+    }
+  });
+
+  std::atomic<std::size_t> packed{0};
+  for (const auto &pack : *packs) {
+    const auto count = pack->size();
+    if (previous.packs.count(pack->checksum()) != 0) {
+      next.packs.insert(pack->checksum());
+      out.skipped += count;
+      continue;
+    }
+    ++out.packs;
+    if (full) {
+      next.packs.insert(pack->checksum());
+    }
+    auto where = "entry in " + pack->path().filename().string();
+    auto segment =
+        std::max(min_pack_segment, count / std::max<std::size_t>(
+                                               1, pool.size() * 4));
+    std::atomic<std::size_t> pack_skipped{0};
+    pool.parallel_for(count, segment, [&](std::size_t begin, std::size_t end) {
+      pack->prefetch(pack->offset_at(pack->index_at_position(begin)),
+                     pack->offset_at(pack->index_at_position(end - 1)) + 1);
+      for (std::size_t pos = begin; pos < end; ++pos) {
+        auto index = pack->index_at_position(pos);
+        auto id = pack->id_at(index);
+        if (!sampled(id, options)) {
+          pack_skipped.fetch_add(1, std::memory_order_relaxed);
+          continue;
+        }
+        packed.fetch_add(1, std::memory_order_relaxed);
+        ObjectView view;
+        if (auto error =
+                pack->read(pack->offset_at(index), store.delta_cache(), view)) {
+          checker.report(FsckProblem::Unreadable, id, error->message);
+          continue;
+        }
+        checker.check(id, view, where);
+      }
+    });
+    out.skipped += pack_skipped.load();
+  }
+  pool.wait();
+
+  // The roots: every ref, MERGE_HEAD, and every version the index holds
+  std::vector<std::pair<std::string, ObjectId>> refs;
+  if (auto error = list_refs(chrona_dir, refs)) {
+    return error;
+  }
+  std::optional<ObjectId> merge_head;
+  if (auto error = read_merge_head(chrona_dir, merge_head)) {
+    return error;
+  }
+  if (merge_head) {
+    refs.emplace_back("MERGE_HEAD", *merge_head);
+  }
+  std::vector<Link> roots;
+  for (const auto &[name, id] : refs) {
+    ObjectView view;
+    if (!store.contains(id)) {
+      checker.report(FsckProblem::BadRef, id,
+                     name + " points to a missing object");
+    } else if (store.read(id, view) || view.type() != ObjectType::Commit) {
+      checker.report(FsckProblem::BadRef, id,
+                     name + " does not point to a commit");
+    } else {
+      roots.push_back(Link{id, ObjectType::Commit, {}, "ref"});
+    }
+  }
+  IndexView index;
+  if (auto error = IndexView::open(chrona_dir / "index", index)) {
+    return error;
+  }
+  for (std::size_t i = 0; i < index.size(); ++i) {
+    auto require_in_index = [&](const ObjectId &id, ObjectType type,
+                                const char *what) {
+      if (!store.contains(id)) {
+        checker.report(FsckProblem::Missing, id,
+                       std::string("referenced by index ") + what + " " +
+                           std::string(index.path(i)));
+      } else {
+        roots.push_back(Link{id, type, {}, "index"});
+      }
+    };
+    require_in_index(index.id(i),
+                     index.is_sparse_dir(i) ? ObjectType::Tree
+                                            : ObjectType::Blob,
+                     "entry");
+    if (auto conflict = index.conflict(i)) {
+      for (const auto *side :
+           {&conflict->base, &conflict->ours, &conflict->theirs}) {
+        if (side->present()) {
+          require_in_index(side->id, ObjectType::Blob, "conflict");
+        }
+      }
+    }
+  }
+  // Sampling is for a quick look, so only full runs walk from the roots;
+  // --incremental does, as it is the only check of old objects' links
+  if (full) {
+    out.reachable = check_reachable(store, pool, std::move(roots), checker);
+  }
+
+  out.issues = checker.take_issues();
+  std::sort(out.issues.begin(), out.issues.end(),
+            [](const FsckIssue &a, const FsckIssue &b) {
+              return std::tie(a.problem, a.id, a.detail) <
+                     std::tie(b.problem, b.id, b.detail);
+            });
+  // A missing object is reported once, with the first referrer
+  out.issues.erase(std::unique(out.issues.begin(), out.issues.end(),
+                               [](const FsckIssue &a, const FsckIssue &b) {
+                                 return a.problem == FsckProblem::Missing &&
+                                        b.problem == FsckProblem::Missing &&
+                                        a.id == b.id;
+                               }),
+                   out.issues.end());
+  out.loose = loose_checked.load();
+  out.chunked = chunked.load();
+  out.skipped += loose_skipped.load();
+  out.packed = packed.load();
+  out.bytes = checker.bytes();
+
+  // Only a clean run over everything vouches for what it saw
+  if (full && out.issues.empty()) {
+    return save_state(state_path, next);
+  }
+  return std::nullopt;
+}
+
+} // namespace chrona
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "errors/error.hpp"
+#include "objects/object.hpp"
+#include "objects/object_store.hpp"
+#include "parallel/work_pool.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace chrona {
+
+enum class FsckProblem {
+  HashMismatch, // the content does not hash to the object's id
+  Unreadable,   // the object is stored but cannot be read back
+  BadEncoding,  // a tree or commit that does not parse or is not canonical
+  Missing,      // referenced by a tree, commit or chunk list, but absent
+  BadPack,      // a pack whose trailer does not match its contents
+  BadRef,       // a ref to a missing object or to something not a commit
+};
+
+// "hash-mismatch", "unreadable", ... as printed by chrona fsck.
+const char *fsck_problem_name(FsckProblem problem);
+
+struct FsckIssue {
+  FsckProblem problem;
+  ObjectId id; // for BadPack, the pack trailer
+  std::string detail;
+};
+
+struct FsckOptions {
+  // Fraction of objects to verify, picked by id mixed with `seed`.
+  // Sampled runs skip the pack checksums and never update the state file.
+  double sample = 1.0;
+  std::uint64_t seed = 0;
+  // Skips rehashing packs verified by an earlier clean run and loose
+  // objects written before it started, as recorded in .chrona/fsck-state.
+  // The walk from the roots still covers everything reachable.
+  bool incremental = false;
+};
+
+struct FsckResult {
+  std::vector<FsckIssue> issues; // sorted by problem, then id
+  std::size_t loose = 0;         // loose objects verified
+  std::size_t packed = 0;        // packed objects verified
+  std::size_t chunked = 0;       // chunked blobs reassembled and rehashed
+  std::size_t skipped = 0;       // left out by sampling or --incremental
+  std::size_t packs = 0;         // packs whose entries were verified
+  std::size_t reachable = 0;     // objects reached from the roots
+  std::uint64_t bytes = 0;       // content bytes hashed
+};
+
+// Rehashes every loose and packed object on `pool`, checks that trees
+// and commits parse and re-encode to the same bytes, and that everything
+// they (and chunk lists) point at exists. Each pack is read in pack
+// order, in contiguous segments of positions, and its trailer is checked
+// in one sequential pass.
+//
+// Connectivity is then checked from the roots: the refs and MERGE_HEAD
+// must name commits, and everything reachable from them and from the
+// index (sparse directories and conflict versions included) must exist,
+// however long ago it was verified. Sampled runs skip this walk. Problems
+// go to `out.issues`; an error is only returned when the check itself
+// cannot run.
+std::optional<Error> fsck(const std::filesystem::path &chrona_dir,
+                          const ObjectStore &store, WorkPool &pool,
+                          FsckResult &out, const FsckOptions &options = {});
+
+} // namespace chrona
@@ -0,0 +1,303 @@
+#include "daemon.hpp"
+#include "fsmonitor/monitor.hpp"
+#include "io/file_io.hpp"
+#include "trace/trace.hpp"
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace chrona {
+
+namespace {
+
+constexpr int client_timeout_seconds = 5;
+
+std::optional<Error> socket_address(const std::filesystem::path &path,
+                                    sockaddr_un &out) {
+  std::memset(&out, 0, sizeof(out));
+  out.sun_family = AF_UNIX;
+  if (path.native().size() >= sizeof(out.sun_path)) {
+    return create_error(ErrorCode::InvalidArgument,
+                        "Socket path too long: " + path.string());
+  }
+  std::memcpy(out.sun_path, path.c_str(), path.native().size());
+  return std::nullopt;
+}
+
+void set_timeout(int fd, int seconds) {
+  timeval tv{seconds, 0};
+  ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+bool send_all(int fd, std::string_view data) {
+  while (!data.empty()) {
+    auto n = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data.remove_prefix(static_cast<std::size_t>(n));
+  }
+  return true;
+}
+
+// Connects to the daemon; ENOENT and ECONNREFUSED mean none is running
+std::optional<Error> connect_daemon(const std::filesystem::path &chrona_dir,
+                                    int &fd) {
+  auto path = daemon_socket_path(chrona_dir);
+  sockaddr_un address;
+  if (auto error = socket_address(path, address)) {
+    return error;
+  }
+  fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return errno_error("Cannot create socket for", path);
+  }
+  if (::connect(fd, reinterpret_cast<sockaddr *>(&address),
+                sizeof(address)) != 0) {
+    int saved = errno;
+    ::close(fd);
+    fd = -1;
+    if (saved == ENOENT || saved == ECONNREFUSED) {
+      return create_error(ErrorCode::NotFound,
+                          "No daemon is running for this repository");
+    }
+    errno = saved;
+    return errno_error("Cannot connect to", path);
+  }
+  set_timeout(fd, client_timeout_seconds);
+  return std::nullopt;
+}
+
+std::optional<Error> request(const std::filesystem::path &chrona_dir,
+                             std::string_view line, std::string &reply) {
+  int fd = -1;
+  if (auto error = connect_daemon(chrona_dir, fd)) {
+    return error;
+  }
+  reply.clear();
+  std::optional<Error> error;
+  if (!send_all(fd, line)) {
+    error = errno_error("Cannot send to", daemon_socket_path(chrona_dir));
+  }
+  char buffer[16 * 1024];
+  while (!error) {
+    auto n = ::recv(fd, buffer, sizeof(buffer), 0);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      error = errno_error("Cannot read from", daemon_socket_path(chrona_dir));
+    } else if (n == 0) {
+      break;
+    } else {
+      reply.append(buffer, static_cast<std::size_t>(n));
+    }
+  }
+  ::close(fd);
+  if (error) {
+    return error;
+  }
+  if (reply.rfind("ok\n", 0) != 0) {
+    auto message = reply.rfind("error ", 0) == 0 ? reply.substr(6) : reply;
+    while (!message.empty() && message.back() == '\n') {
+      message.pop_back();
+    }
+    return create_error(ErrorCode::IOError, "Daemon: " + message);
+  }
+  return std::nullopt;
+}
+
+std::string encode_changes(const std::vector<StatusChange> &changes) {
+  std::string out = "ok\n";
+  for (const auto &change : changes) {
+    out += change.kind == ChangeKind::Modified  ? 'M'
+           : change.kind == ChangeKind::Deleted ? 'D'
+                                                : '?';
+    out += ' ';
+    out += change.path;
+    out += '\0';
+  }
+  return out;
+}
+
+class Server {
+public:
+  Server(const std::filesystem::path &root,
+         const std::filesystem::path &chrona_dir, WorkPool &pool,
+         const DaemonOptions &options)
+      : chrona_dir_(chrona_dir), monitor_(root, chrona_dir, pool),
+        options_(options) {}
+
+  ~Server() {
+    if (listen_fd_ >= 0) {
+      ::close(listen_fd_);
+      ::unlink(daemon_socket_path(chrona_dir_).c_str());
+    }
+  }
+
+  std::optional<Error> run() {
+    if (auto error = listen()) {
+      return error;
+    }
+    if (auto error = monitor_.start()) {
+      return error;
+    }
+    if (options_.ready_fd >= 0) {
+      send_ready();
+    }
+
+    while (!stopping_) {
+      pollfd fds[2] = {{monitor_.fd(), POLLIN, 0}, {listen_fd_, POLLIN, 0}};
+      if (::poll(fds, 2, -1) < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return errno_error("Cannot wait for events in", chrona_dir_);
+      }
+      // Events are applied as they arrive, so queries find little to do
+      if (fds[0].revents & POLLIN) {
+        if (auto error = monitor_.update()) {
+          return error;
+        }
+      }
+      if (fds[1].revents & POLLIN) {
+        if (auto error = serve()) {
+          return error;
+        }
+      }
+    }
+    return std::nullopt;
+  }
+
+private:
+  std::optional<Error> listen() {
+    auto path = daemon_socket_path(chrona_dir_);
+    sockaddr_un address;
+    if (auto error = socket_address(path, address)) {
+      return error;
+    }
+    // A leftover socket file from a daemon that died is replaced
+    int probe = -1;
+    auto error = connect_daemon(chrona_dir_, probe);
+    if (!error) {
+      ::close(probe);
+      return create_error(ErrorCode::AlreadyExists,
+                          "A daemon is already running for this repository");
+    }
+    if (error->error_code != ErrorCode::NotFound) {
+      return error;
+    }
+    ::unlink(path.c_str());
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+      return errno_error("Cannot create socket for", path);
+    }
+    if (::bind(fd, reinterpret_cast<sockaddr *>(&address),
+               sizeof(address)) != 0 ||
+        ::listen(fd, 16) != 0) {
+      auto failure = errno_error("Cannot listen on", path);
+      ::close(fd);
+      return failure;
+    }
+    listen_fd_ = fd;
+    return std::nullopt;
+  }
+
+  void send_ready() {
+    const char ok[] = "ok\n";
+    // The starter only waits for the line; nothing to do if it has gone
+    [[maybe_unused]] auto n = ::write(options_.ready_fd, ok, sizeof(ok) - 1);
+  }
+
+  std::optional<Error> serve() {
+    int client = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (client < 0) {
+      return std::nullopt; // the client gave up first
+    }
+    set_timeout(client, client_timeout_seconds);
+
+    std::string line;
+    char c;
+    while (line.size() < 64 && ::recv(client, &c, 1, 0) == 1 && c != '\n') {
+      line += c;
+    }
+
+    std::string reply;
+    if (line == "status") {
+      CHRONA_TRACE_SCOPE("daemon.status");
+      if (auto error = monitor_.sync(options_.sync_timeout_ms)) {
+        reply = "error " + error->message + "\n";
+      } else {
+        reply = encode_changes(monitor_.changes());
+      }
+    } else if (line == "stop") {
+      reply = "ok\n";
+      stopping_ = true;
+    } else {
+      reply = "error Unknown request: " + line + "\n";
+    }
+    send_all(client, reply);
+    ::close(client);
+    return std::nullopt;
+  }
+
+  std::filesystem::path chrona_dir_;
+  StatusMonitor monitor_;
+  DaemonOptions options_;
+  int listen_fd_ = -1;
+  bool stopping_ = false;
+};
+
+} // namespace
+
+std::filesystem::path
+daemon_socket_path(const std::filesystem::path &chrona_dir) {
+  return chrona_dir / "daemon.sock";
+}
+
+std::optional<Error> serve_daemon(const std::filesystem::path &root,
+                                  const std::filesystem::path &chrona_dir,
+                                  WorkPool &pool,
+                                  const DaemonOptions &options) {
+  Server server(root, chrona_dir, pool, options);
+  return server.run();
+}
+
+std::optional<Error> query_daemon(const std::filesystem::path &chrona_dir,
+                                  std::vector<StatusChange> &out) {
+  std::string reply;
+  if (auto error = request(chrona_dir, "status\n", reply)) {
+    return error;
+  }
+  out.clear();
+  std::string_view rest(reply);
+  rest.remove_prefix(3);
+  while (!rest.empty()) {
+    auto end = rest.find('\0');
+    if (end == std::string_view::npos || end < 2 || rest[1] != ' ') {
+      return create_error(ErrorCode::IOError, "Daemon: malformed reply");
+    }
+    auto kind = rest[0] == 'M'   ? ChangeKind::Modified
+                : rest[0] == 'D' ? ChangeKind::Deleted
+                                 : ChangeKind::Untracked;
+    out.push_back(StatusChange{std::string(rest.substr(2, end - 2)), kind});
+    rest.remove_prefix(end + 1);
+  }
+  return std::nullopt;
+}
+
+std::optional<Error> stop_daemon(const std::filesystem::path &chrona_dir) {
+  std::string reply;
+  return request(chrona_dir, "stop\n", reply);
+}
+
+} // namespace chrona
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "errors/error.hpp"
+#include "parallel/work_pool.hpp"
+#include "status/status.hpp"
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+namespace chrona {
+
+// The daemon listens on .chrona/daemon.sock. A request is one line
+// ("status" or "stop"); the reply is "ok\n" followed, for status, by one
+// "<M|D|?> <path>\0" record per change, or "error <message>\n".
+std::filesystem::path
+daemon_socket_path(const std::filesystem::path &chrona_dir);
+
+struct DaemonOptions {
+  // Receives "ok\n" once queries are being answered.
+  int ready_fd = -1;
+  // How long a query waits for the kernel to deliver earlier events.
+  int sync_timeout_ms = 1000;
+};
+
+// Watches the working tree under `root` and answers queries until a stop
+// request arrives. Fails with AlreadyExists if another daemon is serving.
+std::optional<Error> serve_daemon(const std::filesystem::path &root,
+                                  const std::filesystem::path &chrona_dir,
+                                  WorkPool &pool,
+                                  const DaemonOptions &options = {});
+
+// Asks a running daemon for the working tree status. Fails with NotFound
+// when no daemon is listening, in which case callers scan instead.
+std::optional<Error> query_daemon(const std::filesystem::path &chrona_dir,
+                                  std::vector<StatusChange> &out);
+
+std::optional<Error> stop_daemon(const std::filesystem::path &chrona_dir);
+
+} // namespace chrona
@@ -0,0 +1,458 @@
+#include "monitor.hpp"
+#include "io/file_io.hpp"
+#include "trace/trace.hpp"
+#include <cerrno>
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace chrona {
+
+namespace {
+
+constexpr std::uint32_t tree_events =
+    IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB |
+    IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR | IN_DONT_FOLLOW |
+    IN_EXCL_UNLINK;
+
+// Only the index and the sync cookies matter inside .chrona
+constexpr std::uint32_t chrona_events =
+    IN_CREATE | IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR;
+
+std::string join(const std::string &dir, std::string_view name) {
+  return dir.empty() ? std::string(name) : dir + "/" + std::string(name);
+}
+
+std::string parent_of(const std::string &path) {
+  auto slash = path.rfind('/');
+  return slash == std::string::npos ? std::string() : path.substr(0, slash);
+}
+
+bool is_under(std::string_view path, std::string_view dir) {
+  return dir.empty() || (path.size() > dir.size() && path[dir.size()] == '/' &&
+                         path.substr(0, dir.size()) == dir);
+}
+
+std::int64_t now_ms() {
+  timespec ts;
+  ::clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<std::int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+} // namespace
+
+StatusMonitor::StatusMonitor(std::filesystem::path root,
+                             std::filesystem::path chrona_dir, WorkPool &pool)
+    : root_(std::move(root)), chrona_dir_(std::move(chrona_dir)),
+      pool_(pool) {}
+
+StatusMonitor::~StatusMonitor() {
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+}
+
+std::optional<Error> StatusMonitor::start() {
+  fd_ = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd_ < 0) {
+    return errno_error("Cannot start watching", root_);
+  }
+  chrona_wd_ = ::inotify_add_watch(fd_, chrona_dir_.c_str(), chrona_events);
+  if (chrona_wd_ < 0) {
+    return errno_error("Cannot watch", chrona_dir_);
+  }
+  return rescan();
+}
+
+std::optional<Error> StatusMonitor::watch_tree(const std::string &relative) {
+  std::vector<std::string> pending = {relative};
+  while (!pending.empty()) {
+    auto dir = std::move(pending.back());
+    pending.pop_back();
+    auto path = dir.empty() ? root_ : root_ / dir;
+    int wd = ::inotify_add_watch(fd_, path.c_str(), tree_events);
+    if (wd < 0) {
+      if (errno == ENOENT || errno == ENOTDIR || errno == EACCES) {
+        continue; // gone again, or not ours to watch
+      }
+      if (errno == ENOSPC) {
+        return create_error(ErrorCode::IOError,
+                            "Out of inotify watches at " + path.string() +
+                                " (raise fs.inotify.max_user_watches)");
+      }
+      return errno_error("Cannot watch", path);
+    }
+    // A directory moved within the tree keeps its watch under a new name
+    if (auto it = dirs_.find(wd); it != dirs_.end() && it->second != dir) {
+      paths_.erase(it->second);
+    }
+    dirs_[wd] = dir;
+    paths_[dir] = wd;
+
+    DIR *handle = ::opendir(path.c_str());
+    if (handle == nullptr) {
+      continue;
+    }
+    while (auto *entry = ::readdir(handle)) {
+      std::string_view name = entry->d_name;
+      if (name == "." || name == ".." || (dir.empty() && name == ".chrona")) {
+        continue;
+      }
+      auto type = entry->d_type;
+      if (type == DT_UNKNOWN) {
+        struct stat st;
+        trace_count(TraceCounter::StatCalls);
+        if (::lstat((path / name).c_str(), &st) != 0) {
+          continue;
+        }
+        type = S_ISDIR(st.st_mode) ? DT_DIR : DT_REG;
+      }
+      if (type == DT_DIR) {
+        pending.push_back(join(dir, name));
+      }
+    }
+    ::closedir(handle);
+  }
+  return std::nullopt;
+}
+
+void StatusMonitor::unwatch_tree(const std::string &relative) {
+  auto it = paths_.lower_bound(relative);
+  while (it != paths_.end() &&
+         (it->first == relative || is_under(it->first, relative))) {
+    // Fails harmlessly when the kernel already dropped the watch
+    ::inotify_rm_watch(fd_, it->second);
+    dirs_.erase(it->second);
+    it = paths_.erase(it);
+  }
+}
+
+std::optional<Error> StatusMonitor::read_events() {
+  alignas(inotify_event) char buffer[64 * 1024];
+  while (true) {
+    auto n = ::read(fd_, buffer, sizeof(buffer));
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN) {
+        return std::nullopt;
+      }
+      return errno_error("Cannot read events for", root_);
+    }
+    trace_count(TraceCounter::Syscalls);
+
+    for (char *p = buffer; p < buffer + n;) {
+      const auto *event = reinterpret_cast<const inotify_event *>(p);
+      p += sizeof(inotify_event) + event->len;
+      std::string_view name =
+          event->len > 0 ? std::string_view(event->name) : std::string_view();
+
+      if (event->mask & IN_Q_OVERFLOW) {
+        overflowed_ = true;
+        continue;
+      }
+      if (event->wd == chrona_wd_) {
+        if (name == "index") {
+          index_changed_ = true;
+        } else if (!cookie_.empty() && name == cookie_) {
+          cookie_seen_ = true;
+        }
+        continue;
+      }
+
+      auto dir = dirs_.find(event->wd);
+      if (dir == dirs_.end()) {
+        continue;
+      }
+      if (event->mask & IN_IGNORED) {
+        if (auto it = paths_.find(dir->second);
+            it != paths_.end() && it->second == event->wd) {
+          paths_.erase(it);
+        }
+        dirs_.erase(dir);
+        continue;
+      }
+      if (name.empty()) {
+        continue; // the parent reports what happened to the directory
+      }
+
+      auto path = join(dir->second, name);
+      if (!(event->mask & IN_ISDIR)) {
+        dirty_files_.insert(std::move(path));
+        continue;
+      }
+      if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+        unwatch_tree(path);
+      } else if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+        // Watch before anything else lands in it; files created before
+        // the watch are found when the whole tree is re-checked
+        if (auto error = watch_tree(path)) {
+          return error;
+        }
+      } else {
+        continue;
+      }
+      dirty_trees_.insert(std::move(path));
+    }
+  }
+}
+
+std::optional<Error> StatusMonitor::update() {
+  if (auto error = read_events()) {
+    return error;
+  }
+  return apply();
+}
+
+std::optional<Error> StatusMonitor::sync(int timeout_ms) {
+  cookie_ = "fsmonitor-cookie-" + std::to_string(::getpid()) + "-" +
+            std::to_string(cookies_++);
+  cookie_seen_ = false;
+  auto cookie_path = chrona_dir_ / cookie_;
+  int fd = ::open(cookie_path.c_str(), O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC,
+                  0600);
+  if (fd < 0) {
+    return errno_error("Cannot create", cookie_path);
+  }
+  ::close(fd);
+
+  auto deadline = now_ms() + timeout_ms;
+  std::optional<Error> error;
+  while (!error && !cookie_seen_) {
+    auto remaining = deadline - now_ms();
+    if (remaining <= 0) {
+      error = create_error(ErrorCode::IOError,
+                           "Timed out waiting for filesystem events");
+      break;
+    }
+    pollfd waiting{fd_, POLLIN, 0};
+    if (::poll(&waiting, 1, static_cast<int>(remaining)) < 0 &&
+        errno != EINTR) {
+      error = errno_error("Cannot wait for events in", root_);
+      break;
+    }
+    error = read_events();
+  }
+  ::unlink(cookie_path.c_str());
+  cookie_.clear();
+  if (error) {
+    return error;
+  }
+  return apply();
+}
+
+std::vector<StatusChange> StatusMonitor::changes() const {
+  std::vector<StatusChange> out;
+  out.reserve(changes_.size());
+  for (const auto &[path, kind] : changes_) {
+    out.push_back(StatusChange{path, kind});
+  }
+  return out;
+}
+
+std::optional<Error> StatusMonitor::rescan() {
+  CHRONA_TRACE_SCOPE("fsmonitor.rescan");
+  ++rescans_;
+  overflowed_ = false;
+  index_changed_ = false;
+  dirty_files_.clear();
+  dirty_trees_.clear();
+  dirty_chains_.clear();
+
+  // Directories created while the queue overflowed have no watch yet
+  if (auto error = watch_tree("")) {
+    return error;
+  }
+  if (auto error = IndexView::open(chrona_dir_ / "index", index_)) {
+    return error;
+  }
+  StatusResult status;
+  if (auto error = compute_status(root_, index_, pool_, status)) {
+    return error;
+  }
+  changes_.clear();
+  for (auto &change : status.changes) {
+    changes_.emplace(std::move(change.path), change.kind);
+  }
+  return std::nullopt;
+}
+
+// Entries whose id and stat data are unchanged keep their state. Every
+// other path added, dropped or restaged is re-checked, together with the
+// directories above it, since whether they hold tracked files may differ.
+std::optional<Error> StatusMonitor::reload_index() {
+  index_changed_ = false;
+  IndexView fresh;
+  if (auto error = IndexView::open(chrona_dir_ / "index", fresh)) {
+    return error;
+  }
+  std::size_t i = 0;
+  std::size_t j = 0;
+  while (i < index_.size() || j < fresh.size()) {
+    int order = i == index_.size()   ? 1
+                : j == fresh.size()  ? -1
+                                     : index_.path(i).compare(fresh.path(j));
+    if (order < 0) {
+      auto path = std::string(index_.path(i++));
+      changes_.erase(path);
+      dirty_chains_.insert(std::move(path));
+    } else if (order > 0) {
+      dirty_chains_.insert(std::string(fresh.path(j++)));
+    } else {
+      if (index_.id(i) != fresh.id(j) || !fresh.matches(j, index_.stat(i))) {
+        dirty_chains_.insert(std::string(fresh.path(j)));
+      }
+      ++i;
+      ++j;
+    }
+  }
+  index_ = std::move(fresh);
+  return std::nullopt;
+}
+
+std::optional<Error> StatusMonitor::apply() {
+  if (overflowed_) {
+    return rescan();
+  }
+  if (index_changed_) {
+    if (auto error = reload_index()) {
+      return error;
+    }
+  }
+  if (dirty_files_.empty() && dirty_trees_.empty() && dirty_chains_.empty()) {
+    return std::nullopt;
+  }
+  CHRONA_TRACE_SCOPE("fsmonitor.apply");
+
+  std::set<std::string> units;
+  std::set<std::string> deep;
+  for (const auto &path : dirty_files_) {
+    if (auto i = index_.find(path)) {
+      recheck(*i);
+    }
+    units.insert(unit_of(path));
+  }
+  for (const auto &path : dirty_trees_) {
+    recheck_tree(path);
+    units.insert(unit_of(path));
+    if (index_.has_prefix(path + "/")) {
+      deep.insert(path);
+    }
+  }
+  for (const auto &path : dirty_chains_) {
+    if (auto i = index_.find(path)) {
+      recheck(*i);
+    }
+    for (auto dir = parent_of(path);; dir = parent_of(dir)) {
+      if (dir.empty() || index_.has_prefix(dir + "/")) {
+        units.insert(dir);
+      } else {
+        // Anything listed inside it now collapses into one entry above
+        drop_untracked(dir, true);
+      }
+      if (dir.empty()) {
+        break;
+      }
+    }
+  }
+  dirty_files_.clear();
+  dirty_trees_.clear();
+  dirty_chains_.clear();
+
+  for (const auto &dir : deep) {
+    relist(dir, true);
+  }
+  for (const auto &dir : units) {
+    relist(dir, false);
+  }
+  return std::nullopt;
+}
+
+void StatusMonitor::recheck(std::size_t i) {
+  std::string path(index_.path(i));
+  EntryState state;
+  FileStat stat;
+  bool rehashed = false;
+  // A file that cannot be read is mid-change; its next event settles it
+  auto error = check_entry(root_, index_, i, state, stat, rehashed);
+  if (error || state == EntryState::Modified) {
+    changes_[path] = ChangeKind::Modified;
+  } else if (state == EntryState::Deleted) {
+    changes_[path] = ChangeKind::Deleted;
+  } else {
+    changes_.erase(path);
+  }
+}
+
+void StatusMonitor::recheck_tree(const std::string &relative) {
+  if (auto i = index_.find(relative)) {
+    recheck(*i);
+  }
+  auto prefix = relative + "/";
+  for (auto i = index_.lower_bound(prefix);
+       i < index_.size() && index_.path(i).substr(0, prefix.size()) == prefix;
+       ++i) {
+    recheck(i);
+  }
+}
+
+// The nearest directory above `relative` that holds tracked files; its
+// listing decides whether `relative` is reported, and how.
+std::string StatusMonitor::unit_of(const std::string &relative) const {
+  auto dir = parent_of(relative);
+  while (!dir.empty() && !index_.has_prefix(dir + "/")) {
+    dir = parent_of(dir);
+  }
+  return dir;
+}
+
+// Untracked entries below a subdirectory that holds tracked files belong
+// to that subdirectory's listing, and are only dropped when `recursive`.
+void StatusMonitor::drop_untracked(const std::string &dir, bool recursive) {
+  auto it = dir.empty() ? changes_.begin() : changes_.lower_bound(dir + "/");
+  while (it != changes_.end() && is_under(it->first, dir)) {
+    if (it->second != ChangeKind::Untracked) {
+      ++it;
+      continue;
+    }
+    auto rest = std::string_view(it->first);
+    rest.remove_prefix(dir.empty() ? 0 : dir.size() + 1);
+    auto slash = rest.find('/');
+    bool nested = slash != std::string_view::npos && slash + 1 < rest.size();
+    if (!recursive && nested &&
+        index_.has_prefix(join(dir, rest.substr(0, slash)) + "/")) {
+      ++it;
+      continue;
+    }
+    it = changes_.erase(it);
+  }
+}
+
+// Replaces the untracked entries listed for `dir`, and with `recursive`
+// those of every directory below it that holds tracked files.
+void StatusMonitor::relist(const std::string &dir, bool recursive) {
+  drop_untracked(dir, recursive);
+  std::vector<std::string> pending = {dir};
+  while (!pending.empty()) {
+    auto next = std::move(pending.back());
+    pending.pop_back();
+    std::vector<StatusChange> found;
+    std::vector<std::string> tracked_dirs;
+    list_untracked(root_, index_, next, found, tracked_dirs);
+    for (auto &change : found) {
+      changes_[std::move(change.path)] = change.kind;
+    }
+    if (recursive) {
+      pending.insert(pending.end(),
+                     std::make_move_iterator(tracked_dirs.begin()),
+                     std::make_move_iterator(tracked_dirs.end()));
+    }
+  }
+}
+
+} // namespace chrona
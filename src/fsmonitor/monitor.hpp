@@ -0,0 +1,94 @@
+#pragma once
+
+#include "errors/error.hpp"
+#include "index/index.hpp"
+#include "parallel/work_pool.hpp"
+#include "status/status.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace chrona {
+
+// Keeps the status of one working tree current from inotify events, so
+// reading it costs the number of changes rather than the number of files.
+//
+// Every directory of the working tree is watched. An event marks its path
+// dirty; update() re-checks only the dirty index entries and re-lists only
+// the directories whose untracked entries they can affect. A rewritten
+// index is merge-joined against the previous one, so `chrona add` does not
+// force a full rescan either; only a queue overflow does.
+class StatusMonitor {
+public:
+  StatusMonitor(std::filesystem::path root, std::filesystem::path chrona_dir,
+                WorkPool &pool);
+  ~StatusMonitor();
+
+  StatusMonitor(const StatusMonitor &) = delete;
+  StatusMonitor &operator=(const StatusMonitor &) = delete;
+
+  // Watches the working tree and computes the initial status.
+  std::optional<Error> start();
+
+  // Readable while events are pending.
+  int fd() const { return fd_; }
+
+  // Applies every pending event without blocking.
+  std::optional<Error> update();
+
+  // Applies every change made before the call: creates a cookie file in
+  // .chrona and reads events until its creation shows up, since inotify
+  // delivers one instance's events in order.
+  std::optional<Error> sync(int timeout_ms = 1000);
+
+  // What compute_status() would report now (without `refreshed`), as of
+  // the last update() or sync().
+  std::vector<StatusChange> changes() const;
+
+  std::size_t watched() const { return paths_.size(); }
+  std::size_t rescans() const { return rescans_; }
+
+private:
+  std::optional<Error> watch_tree(const std::string &relative);
+  void unwatch_tree(const std::string &relative);
+  std::optional<Error> read_events();
+  std::optional<Error> apply();
+  std::optional<Error> rescan();
+  std::optional<Error> reload_index();
+
+  void recheck(std::size_t i);
+  void recheck_tree(const std::string &relative);
+  std::string unit_of(const std::string &relative) const;
+  void drop_untracked(const std::string &dir, bool recursive);
+  void relist(const std::string &dir, bool recursive);
+
+  std::filesystem::path root_;
+  std::filesystem::path chrona_dir_;
+  WorkPool &pool_;
+
+  int fd_ = -1;
+  int chrona_wd_ = -1;
+  std::unordered_map<int, std::string> dirs_; // watch -> directory
+  std::map<std::string, int> paths_;          // directory -> watch
+
+  IndexView index_;
+  std::map<std::string, ChangeKind> changes_;
+
+  std::set<std::string> dirty_files_;
+  std::set<std::string> dirty_trees_;
+  std::set<std::string> dirty_chains_; // tracked-ness may have changed
+  bool index_changed_ = false;
+  bool overflowed_ = false;
+
+  std::string cookie_;
+  bool cookie_seen_ = false;
+  std::uint64_t cookies_ = 0;
+  std::size_t rescans_ = 0;
+};
+
+} // namespace chrona
@@ -0,0 +1,510 @@
+#include "gc.hpp"
+#include "history/commit.hpp"
+#include "index/index.hpp"
+#include "io/file_io.hpp"
+#include "merge/merge.hpp"
+#include "pack/bitmap.hpp"
+#include "pack/pack.hpp"
+#include "pack/pack_writer.hpp"
+#include "refs/refs.hpp"
+#include "snapshot/tree.hpp"
+#include "trace/trace.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <dirent.h>
+#include <mutex>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_set>
+
+namespace chrona {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr char state_magic[4] = {'C', 'G', 'C', 'S'};
+constexpr std::uint32_t state_version = 2;
+// Work done per run even when the budget is already spent, so a cron job
+// with a tiny budget still converges
+constexpr std::size_t min_marks_per_run = 256;
+
+enum class Phase : std::uint32_t { Mark = 0, SweepLoose = 1, SweepPacks = 2 };
+
+std::int64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+std::int64_t mtime_ns(const struct stat &st) {
+  return static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000 +
+         st.st_mtim.tv_nsec;
+}
+
+// Concurrent set of marked ids, sharded by the first id byte.
+class MarkSet {
+public:
+  bool insert(const ObjectId &id) {
+    auto &shard = shards_[id.bytes[0] % shards_.size()];
+    std::lock_guard lock(shard.mutex);
+    return shard.ids.insert(id).second;
+  }
+  bool contains(const ObjectId &id) const {
+    auto &shard = shards_[id.bytes[0] % shards_.size()];
+    std::lock_guard lock(shard.mutex);
+    return shard.ids.count(id) > 0;
+  }
+  std::size_t size() const {
+    std::size_t total = 0;
+    for (auto &shard : shards_) {
+      std::lock_guard lock(shard.mutex);
+      total += shard.ids.size();
+    }
+    return total;
+  }
+  template <typename Fn> void for_each(Fn &&fn) const {
+    for (auto &shard : shards_) {
+      std::lock_guard lock(shard.mutex);
+      for (const auto &id : shard.ids) {
+        fn(id);
+      }
+    }
+  }
+
+private:
+  struct Shard {
+    mutable std::mutex mutex;
+    std::unordered_set<ObjectId, ObjectIdHash> ids;
+  };
+  mutable std::array<Shard, 64> shards_;
+};
+
+struct GcState {
+  std::int64_t cycle_start_ns = 0;
+  Phase phase = Phase::Mark;
+  std::uint32_t cursor = 0; // next loose shard to sweep
+  MarkSet marked;
+  std::vector<ObjectId> frontier; // marked, children not yet visited
+  // Trailers of the packs already swept. The pack list can change between
+  // runs, so a position in it would skip or repeat packs.
+  std::unordered_set<ObjectId, ObjectIdHash> swept;
+};
+
+void append_raw(std::string &out, const void *data, std::size_t size) {
+  out.append(static_cast<const char *>(data), size);
+}
+
+std::optional<Error> save_state(const std::filesystem::path &path,
+                                const GcState &state) {
+  std::string out;
+  append_raw(out, state_magic, 4);
+  append_raw(out, &state_version, 4);
+  append_raw(out, &state.cycle_start_ns, 8);
+  auto phase = static_cast<std::uint32_t>(state.phase);
+  append_raw(out, &phase, 4);
+  append_raw(out, &state.cursor, 4);
+  std::uint64_t marked = state.marked.size();
+  std::uint64_t frontier = state.frontier.size();
+  std::uint64_t swept = state.swept.size();
+  append_raw(out, &marked, 8);
+  append_raw(out, &frontier, 8);
+  append_raw(out, &swept, 8);
+  state.marked.for_each(
+      [&](const ObjectId &id) { append_raw(out, id.bytes.data(), 32); });
+  for (const auto &id : state.frontier) {
+    append_raw(out, id.bytes.data(), 32);
+  }
+  for (const auto &id : state.swept) {
+    append_raw(out, id.bytes.data(), 32);
+  }
+  return write_file_atomic(path, out);
+}
+
+// A missing or unreadable state just starts a new cycle; ids are only
+// loaded once the whole file has checked out.
+bool load_state(const std::filesystem::path &path, GcState &state) {
+  std::string data;
+  if (read_file(path, data)) {
+    return false;
+  }
+  constexpr std::size_t header = 4 + 4 + 8 + 4 + 4 + 8 + 8 + 8;
+  std::uint32_t version;
+  std::uint32_t phase;
+  std::uint64_t marked;
+  std::uint64_t frontier;
+  std::uint64_t swept;
+  if (data.size() < header || std::memcmp(data.data(), state_magic, 4) != 0) {
+    return false;
+  }
+  std::memcpy(&version, data.data() + 4, 4);
+  std::memcpy(&state.cycle_start_ns, data.data() + 8, 8);
+  std::memcpy(&phase, data.data() + 16, 4);
+  std::memcpy(&state.cursor, data.data() + 20, 4);
+  std::memcpy(&marked, data.data() + 24, 8);
+  std::memcpy(&frontier, data.data() + 32, 8);
+  std::memcpy(&swept, data.data() + 40, 8);
+  std::uint64_t count = (data.size() - header) / 32;
+  if (version != state_version || phase > 2 || marked > count ||
+      frontier > count - marked || swept != count - marked - frontier ||
+      data.size() != header + count * 32) {
+    return false;
+  }
+  state.phase = static_cast<Phase>(phase);
+  const char *p = data.data() + header;
+  for (std::uint64_t i = 0; i < count; ++i, p += 32) {
+    ObjectId id;
+    std::memcpy(id.bytes.data(), p, 32);
+    if (i < marked) {
+      state.marked.insert(id);
+    } else if (i < marked + frontier) {
+      state.frontier.push_back(id);
+    } else {
+      state.swept.insert(id);
+    }
+  }
+  return true;
+}
+
+// Parallel mark: one task per commit or tree. Blobs are marked without
+// being read. Once the deadline passes, unvisited objects are parked in
+// the frontier for the next run.
+class Marker {
+public:
+  Marker(const ObjectStore &store, WorkPool &pool, GcState &state,
+         Clock::time_point deadline, bool limited)
+      : store_(store), pool_(pool), state_(state), deadline_(deadline),
+        limited_(limited) {}
+
+  std::optional<Error> run() {
+    CHRONA_TRACE_SCOPE("gc.mark");
+    auto work = std::move(state_.frontier);
+    state_.frontier.clear();
+    for (const auto &id : work) {
+      pool_.submit([this, id] { visit(id); });
+    }
+    pool_.wait();
+    return std::move(error_);
+  }
+
+private:
+  void visit(const ObjectId &id) {
+    if (limited_ &&
+        visited_.fetch_add(1, std::memory_order_relaxed) >= min_marks_per_run &&
+        Clock::now() > deadline_) {
+      std::lock_guard lock(mutex_);
+      state_.frontier.push_back(id);
+      return;
+    }
+
+    ObjectView view;
+    if (auto error = store_.read(id, view)) {
+      fail(create_error(ErrorCode::CorruptObject,
+                        "Reachable object " + id.hex() +
+                            " is unreadable, refusing to prune: " +
+                            error->message));
+      return;
+    }
+    InlineArena<4096> arena;
+    if (view.type() == ObjectType::Commit) {
+      CommitView commit;
+      if (auto error = parse_commit(view.content(), arena, commit)) {
+        fail(std::move(error));
+        return;
+      }
+      follow(commit.tree);
+      for (const auto &parent : commit.parents) {
+        follow(parent);
+      }
+    } else if (view.type() == ObjectType::Tree) {
+      TreeView tree;
+      if (auto error = parse_tree(view.content(), arena, tree)) {
+        fail(std::move(error));
+        return;
+      }
+      for (const auto &entry : tree.entries) {
+        if (entry.mode == EntryMode::Directory) {
+          follow(entry.id());
+        } else {
+          state_.marked.insert(entry.id());
+        }
+      }
+    }
+  }
+
+  void follow(const ObjectId &id) {
+    if (state_.marked.insert(id)) {
+      pool_.submit([this, id] { visit(id); });
+    }
+  }
+
+  void fail(std::optional<Error> error) {
+    std::lock_guard lock(mutex_);
+    if (!error_) {
+      error_ = std::move(error);
+    }
+  }
+
+  const ObjectStore &store_;
+  WorkPool &pool_;
+  GcState &state_;
+  Clock::time_point deadline_;
+  bool limited_;
+  std::atomic<std::size_t> visited_{0};
+  std::mutex mutex_;
+  std::optional<Error> error_;
+};
+
+// Marks the current roots; unmarked commits and trees join the frontier.
+// A ref whose commit has a reachability bitmap is marked whole from it,
+// without reading a single object.
+std::optional<Error> add_roots(const std::filesystem::path &chrona_dir,
+                               const ObjectStore &store, GcState &state,
+                               std::size_t &added) {
+  added = 0;
+  std::vector<std::pair<std::string, ObjectId>> refs;
+  if (auto error = list_refs(chrona_dir, refs)) {
+    return error;
+  }
+  std::vector<ObjectId> unmarked;
+  for (const auto &[name, id] : refs) {
+    if (!state.marked.contains(id)) {
+      unmarked.push_back(id);
+    }
+  }
+  Reachability reachability(store);
+  ObjectSet bitmapped;
+  reachability.reachable_from_bitmaps(unmarked, bitmapped);
+  reachability.for_each(bitmapped, [&](const ObjectId &id) {
+    added += state.marked.insert(id) ? 1 : 0;
+  });
+  for (const auto &[name, id] : refs) {
+    if (state.marked.insert(id)) {
+      state.frontier.push_back(id);
+      ++added;
+    }
+  }
+  // A merge waiting on its conflicts commits MERGE_HEAD as second parent
+  std::optional<ObjectId> merge_head;
+  if (auto error = read_merge_head(chrona_dir, merge_head)) {
+    return error;
+  }
+  if (merge_head && state.marked.insert(*merge_head)) {
+    state.frontier.push_back(*merge_head);
+    ++added;
+  }
+
+  IndexView index;
+  if (auto error = IndexView::open(chrona_dir / "index", index)) {
+    return error;
+  }
+  for (std::size_t i = 0; i < index.size(); ++i) {
+    if (state.marked.insert(index.id(i))) {
+      ++added;
+      // A sparse directory holds a whole tree, which has to be walked
+      if (index.is_sparse_dir(i)) {
+        state.frontier.push_back(index.id(i));
+      }
+    }
+    // Every version of a conflicted path stays until it is resolved
+    if (auto conflict = index.conflict(i)) {
+      for (const auto *side :
+           {&conflict->base, &conflict->ours, &conflict->theirs}) {
+        if (side->present() && state.marked.insert(side->id)) {
+          ++added;
+        }
+      }
+    }
+  }
+  return std::nullopt;
+}
+
+// Chunked blobs are marked like any blob, without being read, so their
+// chunks are marked here from the lists recorded in objects/chunked. A
+// list written or reused within the grace period keeps its chunks too.
+std::optional<Error> mark_chunks(const ObjectStore &store, GcState &state,
+                                 std::int64_t cutoff_ns) {
+  CHRONA_TRACE_SCOPE("gc.mark_chunks");
+  std::string ids;
+  if (auto error = read_file(store.chunked_list_path(), ids)) {
+    return error->error_code == ErrorCode::NotFound ? std::nullopt : error;
+  }
+  std::vector<ChunkRef> chunks;
+  for (std::size_t at = 0; at + ObjectId::size <= ids.size();
+       at += ObjectId::size) {
+    ObjectId id;
+    std::memcpy(id.bytes.data(), ids.data() + at, ObjectId::size);
+    if (!state.marked.contains(id)) {
+      struct stat st;
+      if (::stat(store.object_path(id).c_str(), &st) != 0 ||
+          mtime_ns(st) < cutoff_ns) {
+        continue;
+      }
+    }
+    if (auto error = store.read_chunk_list(id, chunks)) {
+      // Pruned or packed since it was recorded
+      if (error->error_code == ErrorCode::NotFound) {
+        continue;
+      }
+      return create_error(ErrorCode::CorruptObject,
+                          "Reachable object " + id.hex() +
+                              " is unreadable, refusing to prune: " +
+                              error->message);
+    }
+    for (const auto &chunk : chunks) {
+      state.marked.insert(chunk.id);
+    }
+  }
+  return std::nullopt;
+}
+
+} // namespace
+
+std::optional<Error>
+collect_garbage(const std::filesystem::path &chrona_dir, ObjectStore &store,
+                WorkPool &pool, GcResult &out, const GcOptions &options) {
+  CHRONA_TRACE_SCOPE("gc");
+  out = GcResult();
+  const auto started = Clock::now();
+  const bool limited = options.budget_ms > 0;
+  const auto deadline = started + std::chrono::milliseconds(options.budget_ms);
+  auto out_of_time = [&] { return limited && Clock::now() > deadline; };
+  const auto state_path = chrona_dir / "gc-state";
+
+  GcState state;
+  if (!load_state(state_path, state)) {
+    state.cycle_start_ns = now_ns();
+    state.phase = Phase::Mark;
+    state.cursor = 0;
+  }
+  const std::int64_t cutoff_ns =
+      state.cycle_start_ns - options.grace_seconds * 1000000000;
+  auto suspend = [&]() -> std::optional<Error> {
+    out.marked = state.marked.size();
+    return save_state(state_path, state);
+  };
+
+  if (state.phase == Phase::Mark) {
+    // Roots are re-read after every mark pass and marking repeats until
+    // they stop changing, so refs moved while we marked are covered too
+    while (true) {
+      std::size_t added = 0;
+      if (auto error = add_roots(chrona_dir, store, state, added)) {
+        return error;
+      }
+      if (added == 0 && state.frontier.empty()) {
+        break;
+      }
+      Marker marker(store, pool, state, deadline, limited);
+      if (auto error = marker.run()) {
+        return error;
+      }
+      if (!state.frontier.empty()) {
+        return suspend();
+      }
+    }
+    if (auto error = mark_chunks(store, state, cutoff_ns)) {
+      return error;
+    }
+    state.phase = Phase::SweepLoose;
+    state.cursor = 0;
+  }
+
+  if (state.phase == Phase::SweepLoose) {
+    static constexpr char digits[] = "0123456789abcdef";
+    for (; state.cursor < 256; ++state.cursor) {
+      if (state.cursor > 0 && out_of_time()) {
+        return suspend();
+      }
+      std::string prefix = {digits[state.cursor >> 4],
+                            digits[state.cursor & 0xf]};
+      auto shard = store.root() / prefix;
+      DIR *dir = ::opendir(shard.c_str());
+      if (dir == nullptr) {
+        continue;
+      }
+      std::vector<std::string> names;
+      while (auto *entry = ::readdir(dir)) {
+        names.emplace_back(entry->d_name);
+      }
+      ::closedir(dir);
+
+      for (const auto &name : names) {
+        auto id = ObjectId::from_hex(prefix + name);
+        // Leftovers of interrupted writes are swept like unreachable objects
+        bool stale_temp = name.rfind(".tmp-", 0) == 0;
+        if ((!id && !stale_temp) || (id && state.marked.contains(*id))) {
+          continue;
+        }
+        auto path = shard / name;
+        struct stat st;
+        if (::lstat(path.c_str(), &st) != 0 || mtime_ns(st) >= cutoff_ns) {
+          continue;
+        }
+        if (::unlink(path.c_str()) == 0) {
+          out.loose_removed += id ? 1 : 0;
+          out.bytes_freed += static_cast<std::uint64_t>(st.st_size);
+        }
+      }
+    }
+    state.phase = Phase::SweepPacks;
+    state.cursor = 0;
+  }
+
+  if (state.phase == Phase::SweepPacks) {
+    auto packs = store.packs();
+    bool swept_any = false;
+    for (const auto &pack : *packs) {
+      auto checksum = pack->checksum();
+      if (state.swept.count(checksum)) {
+        continue;
+      }
+      if (swept_any && out_of_time()) {
+        return suspend();
+      }
+      swept_any = true;
+      state.swept.insert(checksum);
+      struct stat st;
+      if (::stat(pack->path().c_str(), &st) != 0 ||
+          mtime_ns(st) >= cutoff_ns) {
+        continue;
+      }
+      std::vector<ObjectId> keep;
+      for (std::size_t i = 0; i < pack->size(); ++i) {
+        auto id = pack->id_at(i);
+        if (state.marked.contains(id)) {
+          keep.push_back(id);
+        }
+      }
+      if (keep.size() == pack->size()) {
+        continue;
+      }
+
+      if (!keep.empty()) {
+        PackOptions pack_options;
+        pack_options.durable = true;
+        PackResult written;
+        if (auto error = write_pack(store.pack_dir(), store, keep, written,
+                                    pack_options)) {
+          return error;
+        }
+      }
+      remove_pack_files(pack->path());
+      ++out.packs_rewritten;
+      out.packed_dropped += pack->size() - keep.size();
+      out.bytes_freed += static_cast<std::uint64_t>(st.st_size);
+    }
+    if (auto error = store.reload_packs()) {
+      return error;
+    }
+  }
+
+  out.marked = state.marked.size();
+  out.complete = true;
+  ::unlink(state_path.c_str());
+  return std::nullopt;
+}
+
+} // namespace chrona
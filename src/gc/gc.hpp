@@ -0,0 +1,41 @@
+#pragma once
+
+#include "errors/error.hpp"
+#include "objects/object_store.hpp"
+#include "parallel/work_pool.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+
+namespace chrona {
+
+struct GcOptions {
+  // Wall-clock budget for one run in milliseconds; 0 means no limit. A run
+  // that hits it saves its progress in .chrona/gc-state and the next run
+  // picks up from there.
+  std::int64_t budget_ms = 0;
+  // Unreachable objects written less than this long before the cycle
+  // started are kept: they may belong to an add or commit still running.
+  std::int64_t grace_seconds = 3600;
+};
+
+struct GcResult {
+  bool complete = false; // false: out of budget, progress saved
+  std::size_t marked = 0;
+  std::size_t loose_removed = 0;
+  std::size_t packs_rewritten = 0;
+  std::size_t packed_dropped = 0;
+  std::uint64_t bytes_freed = 0;
+};
+
+// Marks everything reachable from the refs and the index, then deletes
+// unreachable loose objects and rewrites packs without their unreachable
+// entries. Marking runs on `pool`. Nothing written (or reused, see
+// ObjectStore::freshen) after the cycle's start minus the grace period is
+// ever deleted, and the roots are re-read once marking finishes, so
+// concurrent writers are safe.
+std::optional<Error>
+collect_garbage(const std::filesystem::path &chrona_dir, ObjectStore &store,
+                WorkPool &pool, GcResult &out, const GcOptions &options = {});
+
+} // namespace chrona
@@ -0,0 +1,226 @@
+#include "sha256.hpp"
+#include "trace/trace.hpp"
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CHRONA_HAVE_SHA_NI 1
+#include <immintrin.h>
+#endif
+
+namespace chrona {
+
+namespace {
+
+alignas(16) constexpr std::uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+constexpr std::array<std::uint32_t, 8> initial_state = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+inline std::uint32_t rotr(std::uint32_t x, int n) {
+  return (x >> n) | (x << (32 - n));
+}
+
+void compress_scalar(std::uint32_t *state, const std::uint8_t *data,
+                     std::size_t blocks) {
+  std::uint32_t w[64];
+  for (; blocks > 0; --blocks, data += Sha256::block_size) {
+    for (int i = 0; i < 16; ++i) {
+      w[i] = (std::uint32_t(data[i * 4]) << 24) |
+             (std::uint32_t(data[i * 4 + 1]) << 16) |
+             (std::uint32_t(data[i * 4 + 2]) << 8) |
+             std::uint32_t(data[i * 4 + 3]);
+    }
+    for (int i = 16; i < 64; ++i) {
+      std::uint32_t s0 =
+          rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+      std::uint32_t s1 =
+          rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+      w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    std::uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    std::uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; ++i) {
+      std::uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+      std::uint32_t ch = (e & f) ^ (~e & g);
+      std::uint32_t t1 = h + s1 + ch + K[i] + w[i];
+      std::uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+      std::uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+      std::uint32_t t2 = s0 + maj;
+      h = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = c;
+      c = b;
+      b = a;
+      a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+  }
+}
+
+#ifdef CHRONA_HAVE_SHA_NI
+
+// Four rounds per step; message words for step i >= 4 are derived from the
+// previous four schedule vectors with sha256msg1/msg2.
+__attribute__((target("sha,sse4.1"))) void
+compress_sha_ni(std::uint32_t *state, const std::uint8_t *data,
+                std::size_t blocks) {
+  const __m128i mask =
+      _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+  __m128i tmp = _mm_loadu_si128(reinterpret_cast<const __m128i *>(state));
+  __m128i state1 =
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(state + 4));
+  tmp = _mm_shuffle_epi32(tmp, 0xB1);          // CDAB
+  state1 = _mm_shuffle_epi32(state1, 0x1B);    // EFGH
+  __m128i state0 = _mm_alignr_epi8(tmp, state1, 8); // ABEF
+  state1 = _mm_blend_epi16(state1, tmp, 0xF0);      // CDGH
+
+  for (; blocks > 0; --blocks, data += Sha256::block_size) {
+    const __m128i abef_save = state0;
+    const __m128i cdgh_save = state1;
+    __m128i w[4];
+
+    for (int i = 0; i < 16; ++i) {
+      if (i < 4) {
+        w[i] = _mm_shuffle_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i * 16)),
+            mask);
+      } else {
+        __m128i next = _mm_sha256msg1_epu32(w[i % 4], w[(i + 1) % 4]);
+        next = _mm_add_epi32(
+            next, _mm_alignr_epi8(w[(i + 3) % 4], w[(i + 2) % 4], 4));
+        w[i % 4] = _mm_sha256msg2_epu32(next, w[(i + 3) % 4]);
+      }
+      auto *k = reinterpret_cast<const __m128i *>(K + i * 4);
+      __m128i msg = _mm_add_epi32(w[i % 4], _mm_load_si128(k));
+      state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+      msg = _mm_shuffle_epi32(msg, 0x0E);
+      state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+    }
+
+    state0 = _mm_add_epi32(state0, abef_save);
+    state1 = _mm_add_epi32(state1, cdgh_save);
+  }
+
+  tmp = _mm_shuffle_epi32(state0, 0x1B);       // FEBA
+  state1 = _mm_shuffle_epi32(state1, 0xB1);    // DCHG
+  state0 = _mm_blend_epi16(tmp, state1, 0xF0); // DCBA
+  state1 = _mm_alignr_epi8(state1, tmp, 8);    // ABEF
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(state), state0);
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(state + 4), state1);
+}
+
+bool cpu_has_sha_ni() {
+  static const bool has =
+      __builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1");
+  return has;
+}
+
+#endif
+
+} // namespace
+
+Sha256::Sha256(Sha256Kernel kernel) : state_(initial_state) {
+  compress_ = compress_scalar;
+#ifdef CHRONA_HAVE_SHA_NI
+  if (kernel == Sha256Kernel::Auto && cpu_has_sha_ni()) {
+    compress_ = compress_sha_ni;
+  }
+#else
+  (void)kernel;
+#endif
+}
+
+void Sha256::update(const void *data, std::size_t length) {
+  trace_count(TraceCounter::BytesHashed, length);
+  auto bytes = static_cast<const std::uint8_t *>(data);
+  total_ += length;
+
+  if (buffered_ > 0) {
+    std::size_t take = std::min(length, block_size - buffered_);
+    std::memcpy(buffer_.data() + buffered_, bytes, take);
+    buffered_ += take;
+    bytes += take;
+    length -= take;
+    if (buffered_ < block_size) {
+      return;
+    }
+    compress_(state_.data(), buffer_.data(), 1);
+    buffered_ = 0;
+  }
+
+  // Whole blocks go straight from the caller's buffer to the kernel
+  std::size_t blocks = length / block_size;
+  if (blocks > 0) {
+    compress_(state_.data(), bytes, blocks);
+    bytes += blocks * block_size;
+    length -= blocks * block_size;
+  }
+
+  if (length > 0) {
+    std::memcpy(buffer_.data(), bytes, length);
+    buffered_ = length;
+  }
+}
+
+Sha256::Digest Sha256::finish() {
+  std::uint64_t bit_length = total_ * 8;
+  std::uint8_t padding[block_size * 2] = {0x80};
+  std::size_t pad_length = (buffered_ < 56) ? (56 - buffered_)
+                                            : (block_size + 56 - buffered_);
+  for (int i = 0; i < 8; ++i) {
+    padding[pad_length + i] =
+        static_cast<std::uint8_t>(bit_length >> (56 - i * 8));
+  }
+  update(padding, pad_length + 8);
+
+  Digest digest;
+  for (std::size_t i = 0; i < 8; ++i) {
+    digest[i * 4] = static_cast<std::uint8_t>(state_[i] >> 24);
+    digest[i * 4 + 1] = static_cast<std::uint8_t>(state_[i] >> 16);
+    digest[i * 4 + 2] = static_cast<std::uint8_t>(state_[i] >> 8);
+    digest[i * 4 + 3] = static_cast<std::uint8_t>(state_[i]);
+  }
+  return digest;
+}
+
+Sha256::Digest sha256(std::string_view data) {
+  Sha256 hasher;
+  hasher.update(data);
+  return hasher.finish();
+}
+
+const char *sha256_kernel_name() {
+#ifdef CHRONA_HAVE_SHA_NI
+  if (cpu_has_sha_ni()) {
+    return "sha-ni";
+  }
+#endif
+  return "scalar";
+}
+
+} // namespace chrona
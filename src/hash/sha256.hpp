@@ -0,0 +1,42 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace chrona {
+
+enum class Sha256Kernel { Auto, Scalar };
+
+// Streaming SHA-256. Blocks are fed to the SHA-NI kernel when the CPU has it,
+// otherwise to the portable scalar kernel; both produce identical digests.
+class Sha256 {
+public:
+  static constexpr std::size_t digest_size = 32;
+  static constexpr std::size_t block_size = 64;
+  using Digest = std::array<std::uint8_t, digest_size>;
+
+  explicit Sha256(Sha256Kernel kernel = Sha256Kernel::Auto);
+
+  void update(const void *data, std::size_t length);
+  void update(std::string_view data) { update(data.data(), data.size()); }
+  Digest finish();
+
+private:
+  using CompressFn = void (*)(std::uint32_t *, const std::uint8_t *,
+                              std::size_t);
+
+  CompressFn compress_;
+  std::array<std::uint32_t, 8> state_;
+  std::array<std::uint8_t, block_size> buffer_;
+  std::size_t buffered_ = 0;
+  std::uint64_t total_ = 0;
+};
+
+Sha256::Digest sha256(std::string_view data);
+
+// Name of the kernel Sha256Kernel::Auto resolves to ("sha-ni" or "scalar").
+const char *sha256_kernel_name();
+
+} // namespace chrona
@@ -0,0 +1,109 @@
+#include "commit.hpp"
+#include <charconv>
+
+namespace chrona {
+
+std::string encode_commit(const Commit &commit) {
+  std::string out = "tree " + commit.tree.hex() + "\n";
+  for (const auto &parent : commit.parents) {
+    out += "parent " + parent.hex() + "\n";
+  }
+  out += "author " + commit.author + " " + std::to_string(commit.time) + "\n";
+  out += "\n";
+  out += commit.message;
+  return out;
+}
+
+std::optional<Error> parse_commit(std::string_view content, Arena &arena,
+                                  CommitView &out) {
+  out = CommitView();
+  auto corrupt = [](const std::string &what) {
+    return create_error(ErrorCode::CorruptObject, "Malformed commit: " + what);
+  };
+
+  // Parent lines are contiguous, so they are counted up front and parsed
+  // straight into an exactly sized arena array
+  std::span<ObjectId> parents;
+  std::size_t parent_count = 0;
+  bool have_tree = false;
+  bool have_author = false;
+  while (true) {
+    auto end = content.find('\n');
+    if (end == std::string_view::npos) {
+      return corrupt("unterminated header");
+    }
+    auto line = content.substr(0, end);
+    content.remove_prefix(end + 1);
+    if (line.empty()) {
+      break;
+    }
+
+    auto space = line.find(' ');
+    auto key = line.substr(0, space);
+    auto value = space == std::string_view::npos ? std::string_view()
+                                                 : line.substr(space + 1);
+    if (key == "tree" && !have_tree) {
+      auto id = ObjectId::from_hex(value);
+      if (!id) {
+        return corrupt("bad tree id");
+      }
+      out.tree = *id;
+      have_tree = true;
+    } else if (key == "parent" && have_tree && !have_author) {
+      if (parents.empty()) {
+        std::size_t count = 1;
+        for (auto rest = content; rest.substr(0, 7) == "parent ";) {
+          ++count;
+          auto next = rest.find('\n');
+          rest.remove_prefix(next == std::string_view::npos ? rest.size()
+                                                            : next + 1);
+        }
+        parents = arena.allocate_array<ObjectId>(count);
+      }
+      auto id = ObjectId::from_hex(value);
+      if (!id || parent_count == parents.size()) {
+        return corrupt("bad parent id");
+      }
+      parents[parent_count++] = *id;
+    } else if (key == "author" && have_tree && !have_author) {
+      auto last = value.rfind(' ');
+      if (last == std::string_view::npos) {
+        return corrupt("bad author line");
+      }
+      auto digits = value.substr(last + 1);
+      auto [ptr, ec] = std::from_chars(digits.data(),
+                                       digits.data() + digits.size(), out.time);
+      if (ec != std::errc() || ptr != digits.data() + digits.size()) {
+        return corrupt("bad author time");
+      }
+      out.author = value.substr(0, last);
+      have_author = true;
+    } else {
+      return corrupt("unexpected header '" + std::string(key) + "'");
+    }
+  }
+
+  if (!have_tree || !have_author) {
+    return corrupt("missing tree or author");
+  }
+  out.parents = parents.first(parent_count);
+  out.message = content;
+  return std::nullopt;
+}
+
+std::optional<Error> decode_commit(std::string_view content, Commit &out) {
+  out = Commit();
+  InlineArena<512> arena;
+  CommitView view;
+  if (auto error = parse_commit(content, arena, view)) {
+    return error;
+  }
+  out.tree = view.tree;
+  out.parents.assign(view.parents.begin(), view.parents.end());
+  out.author = std::string(view.author);
+  out.time = view.time;
+  out.message = std::string(view.message);
+  return std::nullopt;
+}
+
+} // namespace chrona
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "errors/error.hpp"
+#include "memory/arena.hpp"
+#include "objects/object.hpp"
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace chrona {
+
+// Commits are encoded as text:
+//
+//   tree <hex>
+//   parent <hex>          (zero or more)
+//   author <name> <unix seconds>
+//
+//   <message>
+struct Commit {
+  ObjectId tree;
+  std::vector<ObjectId> parents;
+  std::string author;
+  std::int64_t time = 0;
+  std::string message;
+};
+
+// A commit parsed in place: author and message point into the encoded
+// commit, and the parent list lives in an arena.
+struct CommitView {
+  ObjectId tree;
+  std::span<const ObjectId> parents;
+  std::string_view author;
+  std::int64_t time = 0;
+  std::string_view message;
+};
+
+std::string encode_commit(const Commit &commit);
+
+// `content` has to outlive the view.
+std::optional<Error> parse_commit(std::string_view content, Arena &arena,
+                                  CommitView &out);
+// Owning variant of parse_commit().
+std::optional<Error> decode_commit(std::string_view content, Commit &out);
+
+} // namespace chrona
@@ -0,0 +1,373 @@
+#include "commit_graph.hpp"
+#include "hash/sha256.hpp"
+#include "history/commit.hpp"
+#include "io/file_io.hpp"
+#include "trace/trace.hpp"
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+namespace chrona {
+
+namespace {
+
+constexpr char graph_magic[4] = {'C', 'G', 'P', 'H'};
+constexpr std::uint32_t graph_version = 1;
+constexpr std::size_t header_size = 16;
+constexpr std::size_t fanout_size = 256 * 4;
+
+std::uint32_t load_u32(const std::uint8_t *p) {
+  std::uint32_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+void append_u32(std::string &out, std::uint32_t value) {
+  out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+void append_i64(std::string &out, std::int64_t value) {
+  out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+void append_id(std::string &out, const ObjectId &id) {
+  out.append(reinterpret_cast<const char *>(id.bytes.data()), ObjectId::size);
+}
+
+struct GraphCommit {
+  ObjectId id;
+  ObjectId tree;
+  std::int64_t time = 0;
+  std::vector<ObjectId> parent_ids;
+  std::vector<std::uint32_t> parents;
+  std::uint32_t generation = 0;
+};
+
+} // namespace
+
+std::optional<Error> CommitGraph::open(const std::filesystem::path &path,
+                                       CommitGraph &out) {
+  out = CommitGraph();
+  if (auto error = MappedFile::open(path, out.file_)) {
+    if (error->error_code == ErrorCode::NotFound) {
+      return std::nullopt;
+    }
+    return error;
+  }
+
+  auto corrupt = [&] {
+    return create_error(ErrorCode::CorruptObject,
+                        "Corrupt commit graph: " + path.string());
+  };
+  const auto *data = out.file_.data();
+  const auto size = out.file_.size();
+  if (size < header_size + fanout_size + ObjectId::size ||
+      std::memcmp(data, graph_magic, 4) != 0 ||
+      load_u32(data + 4) != graph_version) {
+    return corrupt();
+  }
+
+  out.count_ = load_u32(data + 8);
+  out.extra_count_ = load_u32(data + 12);
+  std::uint64_t expected = header_size + fanout_size +
+                           std::uint64_t(out.count_) * (2 * ObjectId::size +
+                                                        3 * 4 + 8) +
+                           std::uint64_t(out.extra_count_) * 4 +
+                           ObjectId::size;
+  if (size != expected) {
+    return corrupt();
+  }
+
+  out.fanout_ = data + header_size;
+  out.ids_ = out.fanout_ + fanout_size;
+  out.trees_ = out.ids_ + out.count_ * ObjectId::size;
+  out.parent1_ = out.trees_ + out.count_ * ObjectId::size;
+  out.parent2_ = out.parent1_ + out.count_ * 4;
+  out.generations_ = out.parent2_ + out.count_ * 4;
+  out.times_ = out.generations_ + out.count_ * 4;
+  out.extra_edges_ = out.times_ + out.count_ * 8;
+  if (out.validate()) {
+    return corrupt();
+  }
+  return std::nullopt;
+}
+
+// One pass over the fanout and the parent columns, so lookups and
+// traversals never need bounds checks.
+std::optional<Error> CommitGraph::validate() const {
+  auto bad = create_error(ErrorCode::CorruptObject, "bad edge");
+  // find() trusts the fanout to bound its search within the id table
+  std::uint32_t previous = 0;
+  for (std::size_t bucket = 0; bucket < 256; ++bucket) {
+    auto value = load_u32(fanout_ + bucket * 4);
+    if (value < previous || value > count_) {
+      return bad;
+    }
+    previous = value;
+  }
+  if (previous != count_) {
+    return bad;
+  }
+  for (std::size_t i = 0; i < count_; ++i) {
+    auto first = load_u32(parent1_ + i * 4);
+    auto second = load_u32(parent2_ + i * 4);
+    if (first != no_parent && first >= count_) {
+      return bad;
+    }
+    if (second == no_parent || (second & extra_edges_flag) == 0) {
+      if (second != no_parent && second >= count_) {
+        return bad;
+      }
+      continue;
+    }
+    for (std::size_t edge = second & ~extra_edges_flag;; ++edge) {
+      if (edge >= extra_count_) {
+        return bad;
+      }
+      auto value = load_u32(extra_edges_ + edge * 4);
+      if ((value & ~last_edge_flag) >= count_) {
+        return bad;
+      }
+      if (value & last_edge_flag) {
+        break;
+      }
+    }
+  }
+  return std::nullopt;
+}
+
+std::optional<std::uint32_t> CommitGraph::find(const ObjectId &id) const {
+  if (count_ == 0) {
+    return std::nullopt;
+  }
+  std::uint8_t first = id.bytes[0];
+  std::size_t low = (first == 0) ? 0 : load_u32(fanout_ + (first - 1) * 4);
+  std::size_t high = load_u32(fanout_ + first * 4);
+  while (low < high) {
+    std::size_t mid = low + (high - low) / 2;
+    int cmp = std::memcmp(ids_ + mid * ObjectId::size, id.bytes.data(),
+                          ObjectId::size);
+    if (cmp == 0) {
+      return static_cast<std::uint32_t>(mid);
+    }
+    if (cmp < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return std::nullopt;
+}
+
+ObjectId CommitGraph::id_at(std::uint32_t pos) const {
+  ObjectId id;
+  std::memcpy(id.bytes.data(), ids_ + pos * ObjectId::size, ObjectId::size);
+  return id;
+}
+
+ObjectId CommitGraph::tree_at(std::uint32_t pos) const {
+  ObjectId id;
+  std::memcpy(id.bytes.data(), trees_ + pos * ObjectId::size, ObjectId::size);
+  return id;
+}
+
+std::uint32_t CommitGraph::generation_at(std::uint32_t pos) const {
+  return load_u32(generations_ + pos * 4);
+}
+
+std::int64_t CommitGraph::time_at(std::uint32_t pos) const {
+  std::int64_t value;
+  std::memcpy(&value, times_ + std::size_t(pos) * 8, sizeof(value));
+  return value;
+}
+
+void CommitGraph::parents(std::uint32_t pos,
+                          std::vector<std::uint32_t> &out) const {
+  out.clear();
+  auto first = load_u32(parent1_ + pos * 4);
+  if (first == no_parent) {
+    return;
+  }
+  out.push_back(first);
+  auto second = load_u32(parent2_ + pos * 4);
+  if (second == no_parent) {
+    return;
+  }
+  if ((second & extra_edges_flag) == 0) {
+    out.push_back(second);
+    return;
+  }
+  for (std::size_t edge = second & ~extra_edges_flag;; ++edge) {
+    auto value = load_u32(extra_edges_ + edge * 4);
+    out.push_back(value & ~last_edge_flag);
+    if (value & last_edge_flag) {
+      return;
+    }
+  }
+}
+
+ObjectId CommitGraph::checksum() const {
+  ObjectId id;
+  if (file_.size() >= ObjectId::size) {
+    std::memcpy(id.bytes.data(), file_.data() + file_.size() - ObjectId::size,
+                ObjectId::size);
+  }
+  return id;
+}
+
+std::optional<Error> write_commit_graph(const std::filesystem::path &path,
+                                        const ObjectStore &store,
+                                        const std::vector<ObjectId> &tips,
+                                        std::size_t &written) {
+  CHRONA_TRACE_SCOPE("commit_graph.write");
+  written = 0;
+
+  // Collect every reachable commit; an explicit stack keeps deep linear
+  // histories off the call stack
+  std::unordered_map<ObjectId, GraphCommit, ObjectIdHash> found;
+  std::vector<ObjectId> stack(tips.begin(), tips.end());
+  while (!stack.empty()) {
+    auto id = stack.back();
+    stack.pop_back();
+    if (found.count(id) > 0) {
+      continue;
+    }
+    ObjectView view;
+    if (auto error = store.read(id, view)) {
+      return error;
+    }
+    if (view.type() != ObjectType::Commit) {
+      return create_error(ErrorCode::InvalidArgument,
+                          "Not a commit: " + id.hex());
+    }
+    InlineArena<1024> scratch;
+    CommitView commit;
+    if (auto error = parse_commit(view.content(), scratch, commit)) {
+      return error;
+    }
+    auto &entry = found[id];
+    entry.id = id;
+    entry.tree = commit.tree;
+    entry.time = commit.time;
+    entry.parent_ids.assign(commit.parents.begin(), commit.parents.end());
+    for (const auto &parent : entry.parent_ids) {
+      stack.push_back(parent);
+    }
+  }
+  if (found.size() >= CommitGraph::extra_edges_flag) {
+    return create_error(ErrorCode::InvalidArgument,
+                        "Too many commits for a commit graph");
+  }
+
+  std::vector<GraphCommit> commits;
+  commits.reserve(found.size());
+  for (auto &[id, commit] : found) {
+    commits.push_back(std::move(commit));
+  }
+  found.clear();
+  std::sort(commits.begin(), commits.end(),
+            [](const GraphCommit &a, const GraphCommit &b) {
+              return a.id < b.id;
+            });
+  auto position = [&](const ObjectId &id) {
+    auto it = std::lower_bound(
+        commits.begin(), commits.end(), id,
+        [](const GraphCommit &c, const ObjectId &target) {
+          return c.id < target;
+        });
+    return static_cast<std::uint32_t>(it - commits.begin());
+  };
+  for (auto &commit : commits) {
+    for (const auto &parent : commit.parent_ids) {
+      commit.parents.push_back(position(parent));
+    }
+  }
+
+  // Generations: a commit is finished once all of its parents are
+  for (std::uint32_t start = 0; start < commits.size(); ++start) {
+    std::vector<std::uint32_t> pending = {start};
+    while (!pending.empty()) {
+      auto &commit = commits[pending.back()];
+      if (commit.generation != 0) {
+        pending.pop_back();
+        continue;
+      }
+      std::uint32_t generation = 1;
+      bool ready = true;
+      for (auto parent : commit.parents) {
+        if (commits[parent].generation == 0) {
+          pending.push_back(parent);
+          ready = false;
+        } else {
+          generation = std::max(generation, commits[parent].generation + 1);
+        }
+      }
+      if (ready) {
+        commit.generation = generation;
+        pending.pop_back();
+      }
+    }
+  }
+
+  std::string out;
+  out.append(graph_magic, 4);
+  append_u32(out, graph_version);
+  append_u32(out, static_cast<std::uint32_t>(commits.size()));
+  std::size_t extra_count_offset = out.size();
+  append_u32(out, 0);
+
+  std::size_t next = 0;
+  for (int bucket = 0; bucket < 256; ++bucket) {
+    while (next < commits.size() && commits[next].id.bytes[0] <= bucket) {
+      ++next;
+    }
+    append_u32(out, static_cast<std::uint32_t>(next));
+  }
+  for (const auto &commit : commits) {
+    append_id(out, commit.id);
+  }
+  for (const auto &commit : commits) {
+    append_id(out, commit.tree);
+  }
+  for (const auto &commit : commits) {
+    append_u32(out, commit.parents.empty() ? CommitGraph::no_parent
+                                           : commit.parents[0]);
+  }
+  std::vector<std::uint32_t> extra_edges;
+  for (const auto &commit : commits) {
+    if (commit.parents.size() < 2) {
+      append_u32(out, CommitGraph::no_parent);
+    } else if (commit.parents.size() == 2) {
+      append_u32(out, commit.parents[1]);
+    } else {
+      append_u32(out, CommitGraph::extra_edges_flag |
+                          static_cast<std::uint32_t>(extra_edges.size()));
+      for (std::size_t i = 1; i < commit.parents.size(); ++i) {
+        extra_edges.push_back(commit.parents[i]);
+      }
+      extra_edges.back() |= CommitGraph::last_edge_flag;
+    }
+  }
+  for (const auto &commit : commits) {
+    append_u32(out, commit.generation);
+  }
+  for (const auto &commit : commits) {
+    append_i64(out, commit.time);
+  }
+  for (auto edge : extra_edges) {
+    append_u32(out, edge);
+  }
+  auto extra_count = static_cast<std::uint32_t>(extra_edges.size());
+  std::memcpy(out.data() + extra_count_offset, &extra_count,
+              sizeof(extra_count));
+
+  auto digest = sha256(out);
+  out.append(reinterpret_cast<const char *>(digest.data()), digest.size());
+  if (auto error = write_file_atomic(path, out)) {
+    return error;
+  }
+  written = commits.size();
+  return std::nullopt;
+}
+
+} // namespace chrona
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "errors/error.hpp"
+#include "io/mapped_file.hpp"
+#include "objects/object.hpp"
+#include "objects/object_store.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+namespace chrona {
+
+// Commit-graph layout (.chrona/commit-graph, little-endian), one column
+// per field so a traversal only touches the columns it needs:
+//
+//   "CGPH" u32 version u32 commit_count u32 extra_edge_count
+//   u32 fanout[256]            commits whose first id byte is <= i
+//   ids[commit_count]          32 bytes each, sorted
+//   trees[commit_count]        32 bytes each
+//   u32 parent1[commit_count]  graph position or no_parent
+//   u32 parent2[commit_count]  graph position, no_parent, or
+//                              extra_edges_flag | index into extra_edges
+//   u32 generation[commit_count]  1 for roots, else 1 + max over parents
+//   i64 time[commit_count]
+//   u32 extra_edges[extra_edge_count]  parents 2..n of octopus merges; the
+//                              last edge of each list has last_edge_flag
+//   trailer                    SHA-256 of everything above
+class CommitGraph {
+public:
+  static constexpr std::uint32_t no_parent = 0xffffffff;
+  static constexpr std::uint32_t extra_edges_flag = 0x80000000;
+  static constexpr std::uint32_t last_edge_flag = 0x80000000;
+
+  // A missing file opens as an empty graph.
+  static std::optional<Error> open(const std::filesystem::path &path,
+                                   CommitGraph &out);
+
+  std::size_t size() const { return count_; }
+
+  // Fanout bucket + binary search; allocation-free.
+  std::optional<std::uint32_t> find(const ObjectId &id) const;
+
+  ObjectId id_at(std::uint32_t pos) const;
+  ObjectId tree_at(std::uint32_t pos) const;
+  std::uint32_t generation_at(std::uint32_t pos) const;
+  std::int64_t time_at(std::uint32_t pos) const;
+  // Replaces `out` with the parent positions of `pos`, in commit order.
+  void parents(std::uint32_t pos, std::vector<std::uint32_t> &out) const;
+
+  // The file's trailer, which identifies this exact graph; all zeros for
+  // an empty graph.
+  ObjectId checksum() const;
+
+private:
+  std::optional<Error> validate() const;
+
+  MappedFile file_;
+  std::size_t count_ = 0;
+  std::size_t extra_count_ = 0;
+  const std::uint8_t *fanout_ = nullptr;
+  const std::uint8_t *ids_ = nullptr;
+  const std::uint8_t *trees_ = nullptr;
+  const std::uint8_t *parent1_ = nullptr;
+  const std::uint8_t *parent2_ = nullptr;
+  const std::uint8_t *generations_ = nullptr;
+  const std::uint8_t *times_ = nullptr;
+  const std::uint8_t *extra_edges_ = nullptr;
+};
+
+// Parses every commit reachable from `tips` once and writes the graph
+// file; `written` receives the number of commits it covers.
+std::optional<Error> write_commit_graph(const std::filesystem::path &path,
+                                        const ObjectStore &store,
+                                        const std::vector<ObjectId> &tips,
+                                        std::size_t &written);
+
+} // namespace chrona
@@ -0,0 +1,345 @@
+#include "history.hpp"
+#include "history/commit.hpp"
+#include "trace/trace.hpp"
+#include <algorithm>
+#include <queue>
+
+namespace chrona {
+
+namespace {
+
+enum : std::uint8_t {
+  seen = 1,
+  parent1 = 2,
+  parent2 = 4,
+  stale = 8,
+  result = 16,
+  queued = 32,
+};
+
+// Per-query flags, grown as parsing discovers new commits.
+class Flags {
+public:
+  explicit Flags(std::size_t size) : flags_(size, 0) {}
+  std::uint8_t &operator[](std::size_t node) {
+    if (node >= flags_.size()) {
+      flags_.resize(node + 1, 0);
+    }
+    return flags_[node];
+  }
+
+private:
+  std::vector<std::uint8_t> flags_;
+};
+
+} // namespace
+
+bool History::QueueEntry::operator<(const QueueEntry &other) const {
+  // std::priority_queue pops the largest: highest generation, then newest
+  if (generation != other.generation) {
+    return generation < other.generation;
+  }
+  if (time != other.time) {
+    return time < other.time;
+  }
+  return node < other.node;
+}
+
+History::History(const ObjectStore &store, const CommitGraph &graph)
+    : store_(store), graph_(graph) {}
+
+History::Node History::intern(const ObjectId &id) {
+  if (auto pos = graph_.find(id)) {
+    return *pos;
+  }
+  auto [it, inserted] = extra_ids_.emplace(id, 0);
+  if (inserted) {
+    it->second = static_cast<Node>(node_count());
+    extra_.push_back(Parsed{id, false, 0, {}});
+  }
+  return it->second;
+}
+
+std::optional<Error> History::lookup(const ObjectId &id, Node &out) {
+  out = intern(id);
+  return load(out);
+}
+
+std::optional<Error> History::load(Node node) {
+  if (node < graph_.size()) {
+    return std::nullopt;
+  }
+  auto index = node - graph_.size();
+  if (extra_[index].loaded) {
+    return std::nullopt;
+  }
+
+  auto id = extra_[index].id;
+  ObjectView view;
+  if (auto error = store_.read(id, view)) {
+    return error;
+  }
+  if (view.type() != ObjectType::Commit) {
+    return create_error(ErrorCode::InvalidArgument,
+                        "Not a commit: " + id.hex());
+  }
+  InlineArena<1024> scratch;
+  CommitView commit;
+  if (auto error = parse_commit(view.content(), scratch, commit)) {
+    return error;
+  }
+  ++parsed_;
+
+  auto parent_nodes = arena_.allocate_array<Node>(commit.parents.size());
+  for (std::size_t i = 0; i < commit.parents.size(); ++i) {
+    parent_nodes[i] = intern(commit.parents[i]);
+  }
+  // intern() may have grown extra_, so index again
+  auto &parsed = extra_[index];
+  parsed.loaded = true;
+  parsed.time = commit.time;
+  parsed.parents = parent_nodes;
+  return std::nullopt;
+}
+
+std::optional<Error> History::parents(Node node, std::vector<Node> &out) {
+  if (node < graph_.size()) {
+    graph_.parents(node, out);
+    return std::nullopt;
+  }
+  if (auto error = load(node)) {
+    return error;
+  }
+  const auto &parents = extra_[node - graph_.size()].parents;
+  out.assign(parents.begin(), parents.end());
+  return std::nullopt;
+}
+
+ObjectId History::id(Node node) const {
+  return node < graph_.size() ? graph_.id_at(node)
+                              : extra_[node - graph_.size()].id;
+}
+
+std::uint32_t History::generation(Node node) const {
+  return node < graph_.size() ? graph_.generation_at(node)
+                              : infinite_generation;
+}
+
+std::int64_t History::time(Node node) const {
+  return node < graph_.size() ? graph_.time_at(node)
+                              : extra_[node - graph_.size()].time;
+}
+
+History::QueueEntry History::entry(Node node) const {
+  return QueueEntry{generation(node), time(node), node};
+}
+
+std::optional<Error> History::log(const std::vector<ObjectId> &tips,
+                                  std::vector<ObjectId> &out,
+                                  std::size_t limit) {
+  CHRONA_TRACE_SCOPE("history.log");
+  out.clear();
+  Flags flags(node_count());
+  // Generations are ignored here: log order is commit time
+  auto by_time = [this](Node a, Node b) {
+    return time(a) != time(b) ? time(a) < time(b) : a < b;
+  };
+  std::priority_queue<Node, std::vector<Node>, decltype(by_time)> queue(
+      by_time);
+
+  for (const auto &tip : tips) {
+    Node node;
+    if (auto error = lookup(tip, node)) {
+      return error;
+    }
+    if (!(flags[node] & seen)) {
+      flags[node] |= seen;
+      queue.push(node);
+    }
+  }
+
+  std::vector<Node> next;
+  while (!queue.empty() && out.size() < limit) {
+    Node node = queue.top();
+    queue.pop();
+    out.push_back(id(node));
+    if (auto error = parents(node, next)) {
+      return error;
+    }
+    for (Node parent : next) {
+      if (flags[parent] & seen) {
+        continue;
+      }
+      // Parsed commits need their time before they can be ordered
+      if (auto error = load(parent)) {
+        return error;
+      }
+      flags[parent] |= seen;
+      queue.push(parent);
+    }
+  }
+  return std::nullopt;
+}
+
+std::optional<Error> History::is_ancestor(const ObjectId &ancestor,
+                                          const ObjectId &descendant,
+                                          bool &out) {
+  Node a;
+  Node b;
+  if (auto error = lookup(ancestor, a)) {
+    return error;
+  }
+  if (auto error = lookup(descendant, b)) {
+    return error;
+  }
+  return reaches(a, b, out);
+}
+
+std::optional<Error> History::reaches(Node ancestor, Node descendant,
+                                      bool &out) {
+  out = false;
+  if (ancestor == descendant) {
+    out = true;
+    return std::nullopt;
+  }
+
+  // Nothing below the ancestor's generation can lead back up to it
+  std::uint32_t cutoff = generation(ancestor);
+  if (cutoff == infinite_generation) {
+    cutoff = 0;
+  }
+  if (generation(descendant) <= cutoff) {
+    return std::nullopt;
+  }
+
+  Flags flags(node_count());
+  std::vector<Node> stack = {descendant};
+  std::vector<Node> next;
+  flags[descendant] |= seen;
+  while (!stack.empty()) {
+    Node node = stack.back();
+    stack.pop_back();
+    if (auto error = parents(node, next)) {
+      return error;
+    }
+    for (Node parent : next) {
+      if (parent == ancestor) {
+        out = true;
+        return std::nullopt;
+      }
+      if ((flags[parent] & seen) || generation(parent) < cutoff) {
+        continue;
+      }
+      flags[parent] |= seen;
+      stack.push_back(parent);
+    }
+  }
+  return std::nullopt;
+}
+
+std::optional<Error> History::merge_bases(const ObjectId &a,
+                                          const ObjectId &b,
+                                          std::vector<ObjectId> &out) {
+  CHRONA_TRACE_SCOPE("history.merge_bases");
+  out.clear();
+  Node left;
+  Node right;
+  if (auto error = lookup(a, left)) {
+    return error;
+  }
+  if (auto error = lookup(b, right)) {
+    return error;
+  }
+  if (left == right) {
+    out.push_back(a);
+    return std::nullopt;
+  }
+
+  // Paint both sides down the graph in generation order. A commit reached
+  // from both is a candidate, and everything below it is stale; the walk
+  // ends once only stale commits are left in the queue.
+  Flags flags(node_count());
+  std::priority_queue<QueueEntry> queue;
+  std::size_t interesting = 0;
+  std::vector<Node> candidates;
+
+  auto mark = [&](Node node, std::uint8_t bits) -> std::optional<Error> {
+    std::uint8_t before = flags[node];
+    if ((before & bits) == bits) {
+      return std::nullopt;
+    }
+    flags[node] |= bits;
+    if (before & queued) {
+      if (!(before & stale) && (bits & stale)) {
+        --interesting;
+      }
+      return std::nullopt;
+    }
+    if (auto error = load(node)) {
+      return error;
+    }
+    flags[node] |= queued;
+    queue.push(entry(node));
+    if (!(flags[node] & stale)) {
+      ++interesting;
+    }
+    return std::nullopt;
+  };
+
+  if (auto error = mark(left, parent1)) {
+    return error;
+  }
+  if (auto error = mark(right, parent2)) {
+    return error;
+  }
+
+  std::vector<Node> next;
+  while (interesting > 0) {
+    Node node = queue.top().node;
+    queue.pop();
+    flags[node] &= ~queued;
+    std::uint8_t paint = flags[node] & (parent1 | parent2 | stale);
+    if (!(paint & stale)) {
+      --interesting;
+      if ((paint & (parent1 | parent2)) == (parent1 | parent2)) {
+        if (!(flags[node] & result)) {
+          flags[node] |= result;
+          candidates.push_back(node);
+        }
+        paint |= stale;
+      }
+    }
+
+    if (auto error = parents(node, next)) {
+      return error;
+    }
+    for (Node parent : next) {
+      if (auto error = mark(parent, paint)) {
+        return error;
+      }
+    }
+  }
+
+  // Drop candidates that are ancestors of other candidates
+  std::vector<bool> redundant(candidates.size(), false);
+  for (std::size_t i = 0; i < candidates.size(); ++i) {
+    for (std::size_t j = 0; j < candidates.size() && !redundant[i]; ++j) {
+      if (i == j || redundant[j]) {
+        continue;
+      }
+      bool below = false;
+      if (auto error = reaches(candidates[i], candidates[j], below)) {
+        return error;
+      }
+      redundant[i] = below;
+    }
+  }
+  for (std::size_t i = 0; i < candidates.size(); ++i) {
+    if (!redundant[i]) {
+      out.push_back(id(candidates[i]));
+    }
+  }
+  return std::nullopt;
+}
+
+} // namespace chrona
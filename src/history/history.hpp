@@ -0,0 +1,81 @@
+#pragma once
+
+#include "errors/error.hpp"
+#include "history/commit_graph.hpp"
+#include "memory/arena.hpp"
+#include "objects/object.hpp"
+#include "objects/object_store.hpp"
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+namespace chrona {
+
+// Ancestry queries over the commit DAG. Commits covered by the commit graph
+// are answered from its mmapped columns; anything newer is parsed from its
+// object once and remembered. Commits outside the graph have an unknown
+// (infinite) generation, so with no graph at all every query degrades to a
+// plain walk that parses each commit it visits.
+//
+// Not thread-safe; use one History per thread.
+class History {
+public:
+  History(const ObjectStore &store, const CommitGraph &graph);
+
+  // Commits reachable from `tips`, newest commit time first, at most
+  // `limit` of them.
+  std::optional<Error> log(const std::vector<ObjectId> &tips,
+                           std::vector<ObjectId> &out,
+                           std::size_t limit = SIZE_MAX);
+
+  std::optional<Error> is_ancestor(const ObjectId &ancestor,
+                                   const ObjectId &descendant, bool &out);
+
+  // Best common ancestors: none of them is an ancestor of another.
+  std::optional<Error> merge_bases(const ObjectId &a, const ObjectId &b,
+                                   std::vector<ObjectId> &out);
+
+  // Commits that had to be parsed from objects so far.
+  std::size_t parsed() const { return parsed_; }
+
+private:
+  using Node = std::uint32_t;
+  static constexpr std::uint32_t infinite_generation = 0xffffffff;
+
+  struct Parsed {
+    ObjectId id;
+    bool loaded = false;
+    std::int64_t time = 0;
+    std::span<const Node> parents; // in arena_
+  };
+
+  struct QueueEntry {
+    std::uint32_t generation;
+    std::int64_t time;
+    Node node;
+    bool operator<(const QueueEntry &other) const;
+  };
+
+  Node intern(const ObjectId &id);
+  std::optional<Error> lookup(const ObjectId &id, Node &out);
+  std::optional<Error> load(Node node);
+  std::optional<Error> parents(Node node, std::vector<Node> &out);
+  ObjectId id(Node node) const;
+  std::uint32_t generation(Node node) const;
+  std::int64_t time(Node node) const;
+  QueueEntry entry(Node node) const;
+  std::size_t node_count() const { return graph_.size() + extra_.size(); }
+
+  std::optional<Error> reaches(Node ancestor, Node descendant, bool &out);
+
+  const ObjectStore &store_;
+  const CommitGraph &graph_;
+  std::vector<Parsed> extra_; // node = graph size + index
+  std::unordered_map<ObjectId, Node, ObjectIdHash> extra_ids_;
+  Arena arena_; // parent lists of parsed commits
+  std::size_t parsed_ = 0;
+};
+
+} // namespace chrona
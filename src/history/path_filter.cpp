@@ -0,0 +1,320 @@
+#include "path_filter.hpp"
+#include "hash/sha256.hpp"
+#include "history/commit.hpp"
+#include "io/file_io.hpp"
+#include "snapshot/tree_diff.hpp"
+#include "trace/trace.hpp"
+#include <algorithm>
+#include <cstring>
+#include <unordered_set>
+
+namespace chrona {
+
+namespace {
+
+constexpr char filter_magic[4] = {'C', 'G', 'B', 'F'};
+constexpr std::uint32_t filter_version = 1;
+constexpr std::size_t header_size = 12 + ObjectId::size;
+// About a 1% false positive rate, as for git's changed-path filters
+constexpr std::uint32_t hash_count = 7;
+constexpr std::uint64_t bits_per_path = 10;
+constexpr std::size_t max_paths = 512;
+// Below this the probes of even two keys crowd each other out
+constexpr std::size_t min_filter_bytes = 8;
+constexpr char too_large = static_cast<char>(0xff);
+
+std::uint64_t load_u64(const std::uint8_t *p) {
+  std::uint64_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+void append_u32(std::string &out, std::uint32_t value) {
+  out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+void append_u64(std::string &out, std::uint64_t value) {
+  out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+// FNV-1a, then a finaliser so every bit of the result is well mixed
+std::uint64_t mix(std::uint64_t hash) {
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ULL;
+  return hash ^ (hash >> 33);
+}
+
+std::uint64_t hash_path(std::string_view path) {
+  std::uint64_t hash = 0xcbf29ce484222325ULL;
+  for (char c : path) {
+    hash = (hash ^ static_cast<std::uint8_t>(c)) * 0x100000001b3ULL;
+  }
+  return mix(hash);
+}
+
+// A commit's tree and first parent, from the graph's columns when the
+// commit is covered and from the object otherwise.
+std::optional<Error> commit_tree(const ObjectStore &store,
+                                 const CommitGraph &graph, const ObjectId &id,
+                                 ObjectId &tree,
+                                 std::optional<ObjectId> &parent) {
+  parent.reset();
+  if (auto pos = graph.find(id)) {
+    tree = graph.tree_at(*pos);
+    std::vector<std::uint32_t> parents;
+    graph.parents(*pos, parents);
+    if (!parents.empty()) {
+      parent = graph.id_at(parents[0]);
+    }
+    return std::nullopt;
+  }
+  ObjectView view;
+  if (auto error = store.read(id, view)) {
+    return error;
+  }
+  InlineArena<1024> scratch;
+  CommitView commit;
+  if (auto error = parse_commit(view.content(), scratch, commit)) {
+    return error;
+  }
+  tree = commit.tree;
+  if (!commit.parents.empty()) {
+    parent = commit.parents[0];
+  }
+  return std::nullopt;
+}
+
+} // namespace
+
+PathKey::PathKey(std::string_view path) : root_(path.empty()) {
+  h1_ = hash_path(path);
+  h2_ = mix(h1_ ^ 0x9e3779b97f4a7c15ULL) | 1;
+}
+
+std::string build_path_filter(const std::vector<std::string> &paths) {
+  std::unordered_set<std::string_view> keys;
+  for (std::string_view path : paths) {
+    keys.insert(path);
+    for (auto slash = path.find('/'); slash != std::string_view::npos;
+         slash = path.find('/', slash + 1)) {
+      keys.insert(path.substr(0, slash));
+    }
+    if (keys.size() > max_paths) {
+      return std::string(1, too_large);
+    }
+  }
+  if (keys.empty()) {
+    return {};
+  }
+
+  std::string filter(
+      std::max(min_filter_bytes, (keys.size() * bits_per_path + 7) / 8),
+      '\0');
+  std::uint64_t bits = filter.size() * 8;
+  for (auto key : keys) {
+    PathKey probes(key);
+    for (std::uint32_t i = 0; i < hash_count; ++i) {
+      auto bit = probes.probe(i, bits);
+      filter[bit / 8] = static_cast<char>(filter[bit / 8] | (1 << (bit % 8)));
+    }
+  }
+  return filter;
+}
+
+bool path_filter_may_contain(std::string_view filter, const PathKey &key) {
+  if (key.root()) {
+    return !filter.empty();
+  }
+  if (filter.empty()) {
+    return false;
+  }
+  if (filter.size() == 1 && filter[0] == too_large) {
+    return true;
+  }
+  std::uint64_t bits = filter.size() * 8;
+  for (std::uint32_t i = 0; i < hash_count; ++i) {
+    auto bit = key.probe(i, bits);
+    if ((static_cast<std::uint8_t>(filter[bit / 8]) & (1 << (bit % 8))) == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::optional<Error> PathFilters::open(const std::filesystem::path &path,
+                                       const CommitGraph &graph,
+                                       PathFilters &out) {
+  out = PathFilters();
+  MappedFile file;
+  if (auto error = MappedFile::open(path, file)) {
+    if (error->error_code == ErrorCode::NotFound) {
+      return std::nullopt;
+    }
+    return error;
+  }
+
+  auto corrupt = [&] {
+    return create_error(ErrorCode::CorruptObject,
+                        "Corrupt path filters: " + path.string());
+  };
+  const auto *data = file.data();
+  auto size = file.size();
+  if (size < header_size + ObjectId::size ||
+      std::memcmp(data, filter_magic, 4) != 0) {
+    return corrupt();
+  }
+  std::uint32_t version, count;
+  std::memcpy(&version, data + 4, 4);
+  std::memcpy(&count, data + 8, 4);
+  auto checksum = graph.checksum();
+  if (version != filter_version ||
+      std::memcmp(data + 12, checksum.bytes.data(), ObjectId::size) != 0 ||
+      count != graph.size()) {
+    return std::nullopt; // stale: written for an older graph
+  }
+
+  std::uint64_t fixed = header_size + std::uint64_t(count) * 8;
+  if (size < fixed + ObjectId::size) {
+    return corrupt();
+  }
+  const auto *ends = data + header_size;
+  std::uint64_t previous = 0;
+  for (std::uint32_t i = 0; i < count; ++i) {
+    auto end = load_u64(ends + std::size_t(i) * 8);
+    if (end < previous) {
+      return corrupt();
+    }
+    previous = end;
+  }
+  if (fixed + previous + ObjectId::size != size) {
+    return corrupt();
+  }
+
+  out.count_ = count;
+  out.ends_ = ends;
+  out.data_ = data + fixed;
+  out.file_ = std::move(file);
+  return std::nullopt;
+}
+
+std::string_view PathFilters::filter_at(std::uint32_t pos) const {
+  auto begin = pos == 0 ? 0 : load_u64(ends_ + std::size_t(pos - 1) * 8);
+  auto end = load_u64(ends_ + std::size_t(pos) * 8);
+  return {reinterpret_cast<const char *>(data_) + begin, end - begin};
+}
+
+std::optional<Error> write_path_filters(const std::filesystem::path &path,
+                                        const ObjectStore &store,
+                                        const CommitGraph &graph,
+                                        const CommitGraph &previous_graph,
+                                        const PathFilters &previous,
+                                        std::size_t &computed) {
+  CHRONA_TRACE_SCOPE("path_filters.write");
+  computed = 0;
+  std::string filters;
+  std::vector<std::uint64_t> ends;
+  ends.reserve(graph.size());
+  std::vector<std::uint32_t> parents;
+  std::vector<std::string> paths;
+  for (std::uint32_t pos = 0; pos < graph.size(); ++pos) {
+    auto id = graph.id_at(pos);
+    auto old = previous_graph.find(id);
+    if (old && *old < previous.size()) {
+      filters.append(previous.filter_at(*old));
+    } else {
+      auto tree = graph.tree_at(pos);
+      graph.parents(pos, parents);
+      std::optional<ObjectId> parent_tree;
+      if (!parents.empty()) {
+        parent_tree = graph.tree_at(parents[0]);
+      }
+      if (auto error = changed_paths(
+              store, parent_tree ? &*parent_tree : nullptr, tree, paths)) {
+        return error;
+      }
+      filters.append(build_path_filter(paths));
+      ++computed;
+    }
+    ends.push_back(filters.size());
+  }
+
+  std::string out;
+  out.reserve(header_size + ends.size() * 8 + filters.size() +
+              ObjectId::size);
+  out.append(filter_magic, 4);
+  append_u32(out, filter_version);
+  append_u32(out, static_cast<std::uint32_t>(graph.size()));
+  auto checksum = graph.checksum();
+  out.append(reinterpret_cast<const char *>(checksum.bytes.data()),
+             ObjectId::size);
+  for (auto end : ends) {
+    append_u64(out, end);
+  }
+  out.append(filters);
+  auto digest = sha256(out);
+  out.append(reinterpret_cast<const char *>(digest.data()), digest.size());
+  return write_file_atomic(path, out);
+}
+
+std::optional<Error> filter_by_path(const ObjectStore &store,
+                                    const CommitGraph &graph,
+                                    const PathFilters &filters,
+                                    const std::vector<ObjectId> &ids,
+                                    std::string_view path,
+                                    std::vector<ObjectId> &out,
+                                    std::size_t limit, PathLogStats *stats) {
+  CHRONA_TRACE_SCOPE("history.filter_by_path");
+  PathLogStats counts;
+  PathKey key(path);
+  out.clear();
+  for (const auto &id : ids) {
+    if (out.size() >= limit) {
+      break;
+    }
+    auto pos = graph.find(id);
+    bool filtered = pos && *pos < filters.size();
+    if (filtered && !filters.maybe_changed(*pos, key)) {
+      ++counts.skipped;
+      continue;
+    }
+
+    ++counts.checked;
+    ObjectId tree;
+    std::optional<ObjectId> parent;
+    std::optional<PathEntry> entry;
+    std::optional<PathEntry> parent_entry;
+    if (auto error = commit_tree(store, graph, id, tree, parent)) {
+      return error;
+    }
+    if (auto error = lookup_path(store, tree, path, entry)) {
+      return error;
+    }
+    if (parent) {
+      ObjectId parent_tree;
+      std::optional<ObjectId> unused;
+      if (auto error =
+              commit_tree(store, graph, *parent, parent_tree, unused)) {
+        return error;
+      }
+      if (auto error = lookup_path(store, parent_tree, path, parent_entry)) {
+        return error;
+      }
+    }
+    bool same = entry.has_value() == parent_entry.has_value() &&
+                (!entry || (entry->mode == parent_entry->mode &&
+                            entry->id == parent_entry->id));
+    if (!same) {
+      out.push_back(id);
+    } else if (filtered) {
+      ++counts.false_positives;
+    }
+  }
+  if (stats != nullptr) {
+    *stats = counts;
+  }
+  return std::nullopt;
+}
+
+} // namespace chrona
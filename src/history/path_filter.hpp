@@ -0,0 +1,101 @@
+#pragma once
+
+#include "errors/error.hpp"
+#include "history/commit_graph.hpp"
+#include "io/mapped_file.hpp"
+#include "objects/object.hpp"
+#include "objects/object_store.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace chrona {
+
+// A path's filter probes, worked out once per query.
+class PathKey {
+public:
+  explicit PathKey(std::string_view path);
+
+  bool root() const { return root_; }
+  std::uint32_t probe(std::uint32_t i, std::uint64_t bits) const {
+    return static_cast<std::uint32_t>((h1_ + i * h2_) % bits);
+  }
+
+private:
+  bool root_;
+  std::uint64_t h1_;
+  std::uint64_t h2_;
+};
+
+// Bloom filter over every file a commit changed against its first parent,
+// plus each of their leading directories, so one probe answers for a file
+// or a whole directory. Empty means the commit changed nothing; a single
+// 0xff byte means it changed too much to be worth filtering.
+std::string build_path_filter(const std::vector<std::string> &paths);
+bool path_filter_may_contain(std::string_view filter, const PathKey &key);
+
+// Changed-path filters for the commits of one commit graph, in graph
+// order (.chrona/commit-graph-bloom, little-endian):
+//
+//   "CGBF" u32 version u32 commit_count
+//   graph checksum        trailer of the commit-graph file they belong to
+//   u64 ends[commit_count]  where each filter ends within the data
+//   data                  the filters, back to back
+//   trailer               SHA-256 of everything above
+class PathFilters {
+public:
+  // A missing file, or one written for another graph, opens as empty: the
+  // filters then rule nothing out.
+  static std::optional<Error> open(const std::filesystem::path &path,
+                                   const CommitGraph &graph,
+                                   PathFilters &out);
+
+  std::size_t size() const { return count_; }
+  std::string_view filter_at(std::uint32_t pos) const;
+
+  // False only when the commit at graph position `pos` certainly did not
+  // touch the key's path or anything under it.
+  bool maybe_changed(std::uint32_t pos, const PathKey &key) const {
+    return key.root() || pos >= count_ ||
+           path_filter_may_contain(filter_at(pos), key);
+  }
+
+private:
+  MappedFile file_;
+  std::size_t count_ = 0;
+  const std::uint8_t *ends_ = nullptr;
+  const std::uint8_t *data_ = nullptr;
+};
+
+// Writes filters for every commit in `graph`. Commits that `previous`
+// (with the graph it was written for) already covers are copied over, so
+// rewriting the graph after new commits only diffs the new ones;
+// `computed` counts the filters built from tree diffs.
+std::optional<Error> write_path_filters(const std::filesystem::path &path,
+                                        const ObjectStore &store,
+                                        const CommitGraph &graph,
+                                        const CommitGraph &previous_graph,
+                                        const PathFilters &previous,
+                                        std::size_t &computed);
+
+struct PathLogStats {
+  std::size_t skipped = 0;         // ruled out by a filter
+  std::size_t checked = 0;         // compared tree entries
+  std::size_t false_positives = 0; // filter said maybe, trees said no
+};
+
+// Keeps, in order and up to `limit`, the commits of `ids` whose entry at
+// `path` (a file or a directory) differs from their first parent's.
+std::optional<Error> filter_by_path(const ObjectStore &store,
+                                    const CommitGraph &graph,
+                                    const PathFilters &filters,
+                                    const std::vector<ObjectId> &ids,
+                                    std::string_view path,
+                                    std::vector<ObjectId> &out,
+                                    std::size_t limit = SIZE_MAX,
+                                    PathLogStats *stats = nullptr);
+
+} // namespace chrona
@@ -0,0 +1,287 @@
+#include "index.hpp"
+#include "io/file_io.hpp"
+#include "trace/trace.hpp"
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <sys/stat.h>
+
+namespace chrona {
+
+static_assert(std::endian::native == std::endian::little,
+              "the index is mmapped in place and assumes little-endian");
+
+namespace {
+
+constexpr char index_magic[4] = {'C', 'I', 'D', 'X'};
+constexpr std::uint32_t index_version = 1;
+
+std::int64_t to_ns(const struct timespec &ts) {
+  return static_cast<std::int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+} // namespace
+
+std::optional<Error> stat_file(const std::filesystem::path &path,
+                               FileStat &out) {
+  trace_count(TraceCounter::StatCalls);
+  struct stat st;
+  if (::lstat(path.c_str(), &st) != 0) {
+    return errno_error("Cannot stat", path);
+  }
+
+  if (S_ISLNK(st.st_mode)) {
+    out.mode = EntryMode::Symlink;
+  } else if (S_ISREG(st.st_mode)) {
+    out.mode = (st.st_mode & S_IXUSR) ? EntryMode::Executable
+                                      : EntryMode::Regular;
+  } else {
+    return create_error(ErrorCode::InvalidArgument,
+                        "Not a regular file or symlink: " + path.string());
+  }
+  out.mtime_ns = to_ns(st.st_mtim);
+  out.ctime_ns = to_ns(st.st_ctim);
+  out.size = static_cast<std::uint64_t>(st.st_size);
+  out.ino = static_cast<std::uint64_t>(st.st_ino);
+  out.dev = static_cast<std::uint64_t>(st.st_dev);
+  return std::nullopt;
+}
+
+std::optional<Error> IndexView::open(const std::filesystem::path &path,
+                                     IndexView &out) {
+  out = IndexView();
+
+  struct stat st;
+  if (::stat(path.c_str(), &st) != 0) {
+    if (errno == ENOENT) {
+      return std::nullopt;
+    }
+    return errno_error("Cannot stat", path);
+  }
+  out.timestamp_ns_ = to_ns(st.st_mtim);
+
+  if (auto error = MappedFile::open(path, out.file_)) {
+    return error;
+  }
+
+  const auto size = out.file_.size();
+  IndexHeader header;
+  if (size < sizeof(header)) {
+    return create_error(ErrorCode::CorruptObject, "Index is truncated");
+  }
+  std::memcpy(&header, out.file_.data(), sizeof(header));
+  if (std::memcmp(header.magic, index_magic, sizeof(index_magic)) != 0 ||
+      header.version != index_version ||
+      header.record_size != sizeof(IndexRecord)) {
+    return create_error(ErrorCode::CorruptObject,
+                        "Unsupported index format in " + path.string());
+  }
+
+  std::uint64_t records_end =
+      sizeof(header) + std::uint64_t(header.entry_count) * sizeof(IndexRecord);
+  if (records_end > header.paths_offset || header.paths_offset > size ||
+      header.paths_size > size - header.paths_offset) {
+    return create_error(ErrorCode::CorruptObject, "Index is truncated");
+  }
+
+  out.records_ =
+      reinterpret_cast<const IndexRecord *>(out.file_.data() + sizeof(header));
+  out.paths_ =
+      reinterpret_cast<const char *>(out.file_.data() + header.paths_offset);
+  out.paths_size_ = header.paths_size;
+  out.count_ = header.entry_count;
+
+  if (header.conflict_count > 0) {
+    auto table = std::uint64_t(header.conflict_count) * sizeof(ConflictRecord);
+    if (header.conflicts_offset > size ||
+        table > size - header.conflicts_offset ||
+        header.conflicts_offset % alignof(ConflictRecord) != 0) {
+      return create_error(ErrorCode::CorruptObject, "Index is truncated");
+    }
+    out.conflicts_ = reinterpret_cast<const ConflictRecord *>(
+        out.file_.data() + header.conflicts_offset);
+    out.conflict_count_ = header.conflict_count;
+  }
+  return std::nullopt;
+}
+
+std::string_view IndexView::path(std::size_t i) const {
+  const auto &record = records_[i];
+  if (std::uint64_t(record.path_offset) + record.path_length > paths_size_) {
+    return {};
+  }
+  return {paths_ + record.path_offset, record.path_length};
+}
+
+ObjectId IndexView::id(std::size_t i) const {
+  ObjectId id;
+  std::memcpy(id.bytes.data(), records_[i].id, ObjectId::size);
+  return id;
+}
+
+FileStat IndexView::stat(std::size_t i) const {
+  const auto &record = records_[i];
+  return FileStat{record.mtime_ns, record.ctime_ns, record.size,
+                  record.ino,      record.dev,
+                  static_cast<EntryMode>(record.mode)};
+}
+
+std::optional<std::size_t> IndexView::find(std::string_view target) const {
+  auto i = lower_bound(target);
+  if (i < count_ && path(i) == target) {
+    return i;
+  }
+  return std::nullopt;
+}
+
+std::size_t IndexView::lower_bound(std::string_view target) const {
+  std::size_t low = 0;
+  std::size_t high = count_;
+  while (low < high) {
+    std::size_t mid = low + (high - low) / 2;
+    if (path(mid) < target) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+bool IndexView::has_prefix(std::string_view prefix) const {
+  auto i = lower_bound(prefix);
+  return i < count_ && path(i).substr(0, prefix.size()) == prefix;
+}
+
+bool IndexView::is_racy(std::size_t i) const {
+  return records_[i].mtime_ns >= timestamp_ns_;
+}
+
+bool IndexView::matches(std::size_t i, const FileStat &stat) const {
+  const auto &record = records_[i];
+  return record.mtime_ns == stat.mtime_ns &&
+         record.ctime_ns == stat.ctime_ns && record.size == stat.size &&
+         record.ino == stat.ino && record.dev == stat.dev &&
+         record.mode == static_cast<std::uint32_t>(stat.mode);
+}
+
+std::optional<IndexConflict> IndexView::conflict(std::size_t i) const {
+  if (!is_conflicted(i)) {
+    return std::nullopt;
+  }
+  auto end = conflicts_ + conflict_count_;
+  auto it = std::lower_bound(
+      conflicts_, end, i,
+      [](const ConflictRecord &record, std::size_t entry) {
+        return record.entry < entry;
+      });
+  if (it == end || it->entry != i) {
+    return std::nullopt;
+  }
+  IndexConflict out;
+  ConflictSide *sides[] = {&out.base, &out.ours, &out.theirs};
+  for (int side = 0; side < 3; ++side) {
+    sides[side]->mode = it->modes[side];
+    std::memcpy(sides[side]->id.bytes.data(), it->ids[side], ObjectId::size);
+  }
+  return out;
+}
+
+IndexEntry IndexView::entry(std::size_t i) const {
+  return IndexEntry{std::string(path(i)), id(i), stat(i), records_[i].flags,
+                    conflict(i)};
+}
+
+std::vector<IndexEntry> IndexView::entries() const {
+  std::vector<IndexEntry> out;
+  out.reserve(count_);
+  for (std::size_t i = 0; i < count_; ++i) {
+    out.push_back(entry(i));
+  }
+  return out;
+}
+
+std::optional<Error> write_index(const std::filesystem::path &path,
+                                 std::vector<IndexEntry> entries,
+                                 bool durable) {
+  CHRONA_TRACE_SCOPE("index.write");
+  std::sort(entries.begin(), entries.end(),
+            [](const IndexEntry &a, const IndexEntry &b) {
+              return a.path < b.path;
+            });
+
+  std::uint64_t paths_size = 0;
+  std::size_t conflicts = 0;
+  for (const auto &entry : entries) {
+    paths_size += entry.path.size() + 1;
+    conflicts += entry.conflict ? 1 : 0;
+  }
+  if (entries.size() > UINT32_MAX || paths_size > UINT32_MAX) {
+    return create_error(ErrorCode::InvalidArgument, "Index is too large");
+  }
+
+  IndexHeader header{};
+  std::memcpy(header.magic, index_magic, sizeof(index_magic));
+  header.version = index_version;
+  header.entry_count = static_cast<std::uint32_t>(entries.size());
+  header.record_size = sizeof(IndexRecord);
+  header.paths_offset = sizeof(header) + entries.size() * sizeof(IndexRecord);
+  header.paths_size = paths_size;
+  if (conflicts > 0) {
+    auto align = alignof(ConflictRecord);
+    header.conflicts_offset =
+        (header.paths_offset + paths_size + align - 1) / align * align;
+    header.conflict_count = static_cast<std::uint32_t>(conflicts);
+  }
+
+  std::string buffer(conflicts > 0 ? header.conflicts_offset +
+                                         conflicts * sizeof(ConflictRecord)
+                                   : header.paths_offset + paths_size,
+                     '\0');
+  std::memcpy(buffer.data(), &header, sizeof(header));
+
+  auto *records =
+      reinterpret_cast<IndexRecord *>(buffer.data() + sizeof(header));
+  char *paths = buffer.data() + header.paths_offset;
+  auto *conflict_records = reinterpret_cast<ConflictRecord *>(
+      buffer.data() + header.conflicts_offset);
+  std::uint32_t offset = 0;
+  for (std::size_t i = 0; i < entries.size(); ++i) {
+    const auto &entry = entries[i];
+    IndexRecord record{};
+    std::memcpy(record.id, entry.id.bytes.data(), ObjectId::size);
+    record.mtime_ns = entry.stat.mtime_ns;
+    record.ctime_ns = entry.stat.ctime_ns;
+    record.size = entry.stat.size;
+    record.ino = entry.stat.ino;
+    record.dev = entry.stat.dev;
+    record.mode = static_cast<std::uint32_t>(entry.stat.mode);
+    record.flags = entry.conflict ? entry.flags | index_flag_conflict
+                                  : entry.flags & ~index_flag_conflict;
+    record.path_offset = offset;
+    record.path_length = static_cast<std::uint32_t>(entry.path.size());
+    std::memcpy(&records[i], &record, sizeof(record));
+
+    std::memcpy(paths + offset, entry.path.data(), entry.path.size());
+    offset += record.path_length + 1;
+
+    if (entry.conflict) {
+      ConflictRecord conflict{};
+      conflict.entry = static_cast<std::uint32_t>(i);
+      const ConflictSide *sides[] = {&entry.conflict->base,
+                                     &entry.conflict->ours,
+                                     &entry.conflict->theirs};
+      for (int side = 0; side < 3; ++side) {
+        conflict.modes[side] = sides[side]->mode;
+        std::memcpy(conflict.ids[side], sides[side]->id.bytes.data(),
+                    ObjectId::size);
+      }
+      std::memcpy(conflict_records++, &conflict, sizeof(conflict));
+    }
+  }
+
+  return write_file_atomic(path, buffer, durable);
+}
+
+} // namespace chrona
@@ -0,0 +1,163 @@
+#pragma once
+
+#include "errors/error.hpp"
+#include "io/mapped_file.hpp"
+#include "objects/object.hpp"
+#include "snapshot/tree.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace chrona {
+
+// The subset of lstat() the index caches to detect unchanged files.
+struct FileStat {
+  std::int64_t mtime_ns = 0;
+  std::int64_t ctime_ns = 0;
+  std::uint64_t size = 0;
+  std::uint64_t ino = 0;
+  std::uint64_t dev = 0;
+  EntryMode mode = EntryMode::Regular;
+};
+
+// lstat() a path; fails with NotFound for missing paths and InvalidArgument
+// for anything that is not a regular file or symlink.
+std::optional<Error> stat_file(const std::filesystem::path &path,
+                               FileStat &out);
+
+// On-disk index layout (version 1, little-endian):
+//
+//   IndexHeader                      64 bytes
+//   IndexRecord[entry_count]         96 bytes each, sorted by path
+//   path table                       NUL-terminated paths
+//   ConflictRecord[conflict_count]   112 bytes each, sorted by entry
+//
+// Records are fixed width so the file can be mmapped and binary-searched
+// in place; no entry is parsed until it is looked at. An index written
+// before conflicts were recorded has a zero conflict count.
+struct IndexHeader {
+  char magic[4];
+  std::uint32_t version;
+  std::uint32_t entry_count;
+  std::uint32_t record_size;
+  std::uint64_t paths_offset;
+  std::uint64_t paths_size;
+  std::uint64_t conflicts_offset;
+  std::uint32_t conflict_count;
+  std::uint8_t reserved[20];
+};
+static_assert(sizeof(IndexHeader) == 64);
+
+struct IndexRecord {
+  std::uint8_t id[ObjectId::size];
+  std::int64_t mtime_ns;
+  std::int64_t ctime_ns;
+  std::uint64_t size;
+  std::uint64_t ino;
+  std::uint64_t dev;
+  std::uint32_t mode;
+  std::uint32_t flags;
+  std::uint32_t path_offset;
+  std::uint32_t path_length;
+  std::uint8_t reserved[8];
+};
+static_assert(sizeof(IndexRecord) == 96);
+
+// Set on an entry a merge left unresolved. The entry itself holds what
+// the merge wrote to the working tree, usually the file with conflict
+// markers, and the conflict table holds the three versions it came from.
+constexpr std::uint32_t index_flag_conflict = 1u << 0;
+
+// One version of a conflicted path; mode 0 when that side has no entry.
+struct ConflictSide {
+  std::uint32_t mode = 0;
+  ObjectId id;
+
+  bool present() const { return mode != 0; }
+};
+
+struct IndexConflict {
+  ConflictSide base;
+  ConflictSide ours;
+  ConflictSide theirs;
+};
+
+struct ConflictRecord {
+  std::uint32_t entry; // position of the conflicted entry
+  std::uint32_t modes[3];
+  std::uint8_t ids[3][ObjectId::size];
+};
+static_assert(sizeof(ConflictRecord) == 112);
+
+// An entry with mode Directory is a sparse directory: a whole subtree left
+// out of the working tree (see sparse/sparse.hpp), with the tree's id and
+// its path without a trailing slash. Nothing below it has an entry.
+struct IndexEntry {
+  std::string path;
+  ObjectId id;
+  FileStat stat;
+  std::uint32_t flags = 0;
+  // Written to the conflict table; sets index_flag_conflict.
+  std::optional<IndexConflict> conflict;
+};
+
+// Read-only view over an mmapped index file.
+class IndexView {
+public:
+  // A missing index file opens as an empty index.
+  static std::optional<Error> open(const std::filesystem::path &path,
+                                   IndexView &out);
+
+  std::size_t size() const { return count_; }
+  const IndexRecord &record(std::size_t i) const { return records_[i]; }
+  std::string_view path(std::size_t i) const;
+  ObjectId id(std::size_t i) const;
+  FileStat stat(std::size_t i) const;
+
+  std::optional<std::size_t> find(std::string_view path) const;
+  // First entry whose path is not less than `path`.
+  std::size_t lower_bound(std::string_view path) const;
+  bool has_prefix(std::string_view prefix) const;
+
+  // Entries whose mtime is not older than the index file itself may have
+  // changed within the same timestamp tick and must be rehashed.
+  bool is_racy(std::size_t i) const;
+  bool matches(std::size_t i, const FileStat &stat) const;
+
+  bool is_sparse_dir(std::size_t i) const {
+    return records_[i].mode ==
+           static_cast<std::uint32_t>(EntryMode::Directory);
+  }
+
+  bool is_conflicted(std::size_t i) const {
+    return (records_[i].flags & index_flag_conflict) != 0;
+  }
+  std::size_t conflict_count() const { return conflict_count_; }
+  // The versions a conflicted entry came from; nullopt for any other.
+  std::optional<IndexConflict> conflict(std::size_t i) const;
+
+  // Entry `i` with its conflict, if it has one.
+  IndexEntry entry(std::size_t i) const;
+  std::vector<IndexEntry> entries() const;
+
+private:
+  MappedFile file_;
+  const IndexRecord *records_ = nullptr;
+  const char *paths_ = nullptr;
+  std::size_t paths_size_ = 0;
+  std::size_t count_ = 0;
+  const ConflictRecord *conflicts_ = nullptr;
+  std::size_t conflict_count_ = 0;
+  std::int64_t timestamp_ns_ = 0;
+};
+
+// Sorts `entries` by path and atomically replaces the index file. The
+// conflict flag follows each entry's `conflict`.
+std::optional<Error> write_index(const std::filesystem::path &path,
+                                 std::vector<IndexEntry> entries,
+                                 bool durable = false);
+
+} // namespace chrona
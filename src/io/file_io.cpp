@@ -0,0 +1,330 @@
+#include "file_io.hpp"
+#include "trace/trace.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace chrona {
+
+std::optional<Error> errno_error(const std::string &what,
+                                 const std::filesystem::path &path) {
+  int saved = errno;
+  auto code = (saved == ENOENT) ? ErrorCode::NotFound : ErrorCode::IOError;
+  return create_error(code, what + " " + path.string() + ": " +
+                                std::strerror(saved));
+}
+
+std::optional<Error> read_file(const std::filesystem::path &path,
+                               std::string &out) {
+  trace_count(TraceCounter::Syscalls);
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return errno_error("Cannot open", path);
+  }
+
+  out.clear();
+  char buffer[16384];
+  while (true) {
+    trace_count(TraceCounter::Syscalls);
+    ssize_t n = ::read(fd, buffer, sizeof(buffer));
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      auto error = errno_error("Cannot read", path);
+      ::close(fd);
+      return error;
+    }
+    if (n == 0) {
+      break;
+    }
+    out.append(buffer, static_cast<std::size_t>(n));
+  }
+  ::close(fd);
+  return std::nullopt;
+}
+
+std::optional<Error> write_file_atomic(const std::filesystem::path &path,
+                                       std::string_view contents,
+                                       bool durable) {
+  TempFile temp;
+  if (auto error = TempFile::create(path.parent_path(), temp)) {
+    return error;
+  }
+  if (auto error = temp.write(contents)) {
+    return error;
+  }
+  if (durable) {
+    if (auto error = temp.sync()) {
+      return error;
+    }
+  }
+  if (auto error = temp.commit(path)) {
+    return error;
+  }
+  if (durable) {
+    return fsync_directory(path.parent_path());
+  }
+  return std::nullopt;
+}
+
+std::optional<Error> fsync_directory(const std::filesystem::path &dir) {
+  trace_count(TraceCounter::Syscalls, 3); // open, fsync, close
+  int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    return errno_error("Cannot open directory", dir);
+  }
+  std::optional<Error> error;
+  if (::fsync(fd) != 0) {
+    error = errno_error("Cannot sync directory", dir);
+  }
+  ::close(fd);
+  return error;
+}
+
+std::optional<Error> write_vectored(int fd,
+                                    std::span<const std::string_view> parts,
+                                    const std::filesystem::path &what) {
+  constexpr std::size_t max_iov = 1024; // IOV_MAX on Linux
+  std::vector<iovec> iov;
+  iov.reserve(std::min(parts.size(), max_iov));
+  std::size_t next = 0;
+  while (next < parts.size() || !iov.empty()) {
+    while (next < parts.size() && iov.size() < max_iov) {
+      if (!parts[next].empty()) {
+        iov.push_back(iovec{const_cast<char *>(parts[next].data()),
+                            parts[next].size()});
+      }
+      ++next;
+    }
+    if (iov.empty()) {
+      break;
+    }
+    trace_count(TraceCounter::Syscalls);
+    ssize_t n = ::writev(fd, iov.data(), static_cast<int>(iov.size()));
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno_error("Cannot write to", what);
+    }
+    // Drop what was written; a partly written buffer is trimmed in place
+    auto written = static_cast<std::size_t>(n);
+    std::size_t done = 0;
+    while (done < iov.size() && written >= iov[done].iov_len) {
+      written -= iov[done].iov_len;
+      ++done;
+    }
+    iov.erase(iov.begin(), iov.begin() + static_cast<std::ptrdiff_t>(done));
+    if (!iov.empty()) {
+      auto &front = iov.front();
+      front.iov_base = static_cast<char *>(front.iov_base) + written;
+      front.iov_len -= written;
+    }
+  }
+  return std::nullopt;
+}
+
+TempFile::~TempFile() { discard(); }
+
+TempFile::TempFile(TempFile &&other) noexcept
+    : fd_(std::exchange(other.fd_, -1)), path_(std::move(other.path_)) {
+  other.path_.clear();
+}
+
+TempFile &TempFile::operator=(TempFile &&other) noexcept {
+  if (this != &other) {
+    discard();
+    fd_ = std::exchange(other.fd_, -1);
+    path_ = std::move(other.path_);
+    other.path_.clear();
+  }
+  return *this;
+}
+
+std::optional<Error> TempFile::create(const std::filesystem::path &dir,
+                                      TempFile &out) {
+  out.discard();
+  trace_count(TraceCounter::Syscalls);
+  std::string pattern = (dir / ".tmp-XXXXXX").string();
+  int fd = ::mkostemp(pattern.data(), O_CLOEXEC);
+  if (fd < 0) {
+    return errno_error("Cannot create temporary file in", dir);
+  }
+  out.fd_ = fd;
+  out.path_ = pattern;
+  return std::nullopt;
+}
+
+std::optional<Error> TempFile::write(std::string_view data) {
+  while (!data.empty()) {
+    trace_count(TraceCounter::Syscalls);
+    ssize_t n = ::write(fd_, data.data(), data.size());
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno_error("Cannot write", path_);
+    }
+    data.remove_prefix(static_cast<std::size_t>(n));
+  }
+  return std::nullopt;
+}
+
+std::optional<Error> TempFile::sync() {
+  trace_count(TraceCounter::Syscalls);
+  if (::fsync(fd_) != 0) {
+    return errno_error("Cannot sync", path_);
+  }
+  return std::nullopt;
+}
+
+std::optional<Error> TempFile::close() {
+  if (fd_ >= 0 && ::close(std::exchange(fd_, -1)) != 0) {
+    return errno_error("Cannot close", path_);
+  }
+  return std::nullopt;
+}
+
+std::optional<Error> TempFile::commit(const std::filesystem::path &target) {
+  if (auto error = close()) {
+    return error;
+  }
+  trace_count(TraceCounter::Syscalls, 2); // close, rename
+  if (::rename(path_.c_str(), target.c_str()) != 0) {
+    return errno_error("Cannot rename into", target);
+  }
+  path_.clear();
+  return std::nullopt;
+}
+
+void TempFile::discard() {
+  if (fd_ >= 0) {
+    ::close(std::exchange(fd_, -1));
+  }
+  if (!path_.empty()) {
+    ::unlink(path_.c_str());
+    path_.clear();
+  }
+}
+
+LockFile::~LockFile() { release(); }
+
+LockFile::LockFile(LockFile &&other) noexcept
+    : fd_(std::exchange(other.fd_, -1)), path_(std::move(other.path_)),
+      lock_path_(std::move(other.lock_path_)) {
+  other.path_.clear();
+  other.lock_path_.clear();
+}
+
+LockFile &LockFile::operator=(LockFile &&other) noexcept {
+  if (this != &other) {
+    release();
+    fd_ = std::exchange(other.fd_, -1);
+    path_ = std::move(other.path_);
+    lock_path_ = std::move(other.lock_path_);
+    other.path_.clear();
+    other.lock_path_.clear();
+  }
+  return *this;
+}
+
+std::optional<Error> LockFile::acquire(const std::filesystem::path &path,
+                                       std::chrono::milliseconds timeout,
+                                       LockFile &out) {
+  out.release();
+  auto lock_path = path;
+  lock_path += ".lock";
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  auto backoff = std::chrono::microseconds(100);
+  bool created_parent = false;
+  for (;;) {
+    trace_count(TraceCounter::Syscalls);
+    int fd = ::open(lock_path.c_str(),
+                    O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd >= 0) {
+      out.fd_ = fd;
+      out.path_ = path;
+      out.lock_path_ = std::move(lock_path);
+      return std::nullopt;
+    }
+    if (errno == ENOENT && !created_parent) {
+      // The parent may also have been pruned after we created it; one
+      // more attempt covers that
+      created_parent = true;
+      std::error_code ec;
+      std::filesystem::create_directories(path.parent_path(), ec);
+      if (ec) {
+        return create_error(ErrorCode::IOError,
+                            "Cannot create " + path.parent_path().string() +
+                                ": " + ec.message());
+      }
+      continue;
+    }
+    if (errno != EEXIST) {
+      return errno_error("Cannot create lock", lock_path);
+    }
+    if (std::chrono::steady_clock::now() >= deadline) {
+      return create_error(ErrorCode::Locked,
+                          lock_path.string() +
+                              " exists: another writer holds it, or remove "
+                              "it if that writer crashed");
+    }
+    std::this_thread::sleep_for(backoff);
+    backoff = std::min(backoff * 2, std::chrono::microseconds(8000));
+  }
+}
+
+std::optional<Error> LockFile::write(std::string_view data) {
+  while (!data.empty()) {
+    trace_count(TraceCounter::Syscalls);
+    ssize_t n = ::write(fd_, data.data(), data.size());
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno_error("Cannot write", lock_path_);
+    }
+    data.remove_prefix(static_cast<std::size_t>(n));
+  }
+  return std::nullopt;
+}
+
+std::optional<Error> LockFile::sync() {
+  trace_count(TraceCounter::Syscalls);
+  if (::fsync(fd_) != 0) {
+    return errno_error("Cannot sync", lock_path_);
+  }
+  return std::nullopt;
+}
+
+std::optional<Error> LockFile::commit() {
+  if (fd_ >= 0 && ::close(std::exchange(fd_, -1)) != 0) {
+    return errno_error("Cannot close", lock_path_);
+  }
+  trace_count(TraceCounter::Syscalls, 2); // close, rename
+  if (::rename(lock_path_.c_str(), path_.c_str()) != 0) {
+    return errno_error("Cannot rename into", path_);
+  }
+  lock_path_.clear();
+  return std::nullopt;
+}
+
+void LockFile::release() {
+  if (fd_ >= 0) {
+    ::close(std::exchange(fd_, -1));
+  }
+  if (!lock_path_.empty()) {
+    ::unlink(lock_path_.c_str());
+    lock_path_.clear();
+  }
+}
+
+} // namespace chrona
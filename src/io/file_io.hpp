@@ -0,0 +1,99 @@
+#pragma once
+
+#include "errors/error.hpp"
+#include <chrono>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace chrona {
+
+// Builds an IOError (or NotFound for ENOENT) from the current errno.
+std::optional<Error> errno_error(const std::string &what,
+                                 const std::filesystem::path &path);
+
+std::optional<Error> read_file(const std::filesystem::path &path,
+                               std::string &out);
+
+// Writes via a temporary file in the same directory and renames it into
+// place, so readers only ever see the old or the new contents.
+std::optional<Error> write_file_atomic(const std::filesystem::path &path,
+                                       std::string_view contents,
+                                       bool durable = false);
+
+std::optional<Error> fsync_directory(const std::filesystem::path &dir);
+
+// Writes every part in order with writev, straight from the callers'
+// buffers, resuming after short writes. `what` names the target in errors.
+std::optional<Error> write_vectored(int fd,
+                                    std::span<const std::string_view> parts,
+                                    const std::filesystem::path &what);
+
+// A uniquely named file in `dir` that is either renamed into place with
+// commit() or unlinked on destruction.
+class TempFile {
+public:
+  TempFile() = default;
+  ~TempFile();
+
+  TempFile(const TempFile &) = delete;
+  TempFile &operator=(const TempFile &) = delete;
+  TempFile(TempFile &&other) noexcept;
+  TempFile &operator=(TempFile &&other) noexcept;
+
+  static std::optional<Error> create(const std::filesystem::path &dir,
+                                     TempFile &out);
+
+  std::optional<Error> write(std::string_view data);
+  std::optional<Error> sync();
+  // Closes the descriptor; the file stays on disk until commit or discard.
+  std::optional<Error> close();
+  std::optional<Error> commit(const std::filesystem::path &target);
+  void discard();
+
+  int fd() const { return fd_; }
+  const std::filesystem::path &path() const { return path_; }
+
+private:
+  int fd_ = -1;
+  std::filesystem::path path_;
+};
+
+// Exclusive write access to `path` through "<path>.lock", created with
+// O_EXCL: writers of one file take turns while other files stay free.
+// The new contents go into the lock file, which commit() renames over
+// `path`; release() (or destruction) drops the lock and leaves `path` as
+// it was.
+class LockFile {
+public:
+  LockFile() = default;
+  ~LockFile();
+
+  LockFile(const LockFile &) = delete;
+  LockFile &operator=(const LockFile &) = delete;
+  LockFile(LockFile &&other) noexcept;
+  LockFile &operator=(LockFile &&other) noexcept;
+
+  // While another writer holds the lock, retries with backoff for up to
+  // `timeout`, then fails with Locked. Creates missing parent directories.
+  static std::optional<Error> acquire(const std::filesystem::path &path,
+                                      std::chrono::milliseconds timeout,
+                                      LockFile &out);
+
+  std::optional<Error> write(std::string_view data);
+  std::optional<Error> sync();
+  std::optional<Error> commit();
+  void release();
+
+  bool locked() const { return !lock_path_.empty(); }
+  const std::filesystem::path &path() const { return path_; }
+
+private:
+  int fd_ = -1;
+  std::filesystem::path path_;
+  std::filesystem::path lock_path_;
+};
+
+} // namespace chrona
@@ -0,0 +1,86 @@
+#include "mapped_file.hpp"
+#include "trace/trace.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace chrona {
+
+MappedFile::~MappedFile() { reset(); }
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+    : address_(std::exchange(other.address_, nullptr)),
+      size_(std::exchange(other.size_, 0)) {}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+  if (this != &other) {
+    reset();
+    address_ = std::exchange(other.address_, nullptr);
+    size_ = std::exchange(other.size_, 0);
+  }
+  return *this;
+}
+
+void MappedFile::reset() {
+  if (address_ != nullptr) {
+    ::munmap(address_, size_);
+  }
+  address_ = nullptr;
+  size_ = 0;
+}
+
+std::optional<Error> MappedFile::open(const std::filesystem::path &path,
+                                      MappedFile &out) {
+  trace_count(TraceCounter::Syscalls, 4); // open, fstat, mmap, close
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    auto code = (errno == ENOENT) ? ErrorCode::NotFound : ErrorCode::IOError;
+    return create_error(code, "Cannot open " + path.string() + ": " +
+                                  std::strerror(errno));
+  }
+
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    int saved = errno;
+    ::close(fd);
+    return create_error(ErrorCode::IOError, "Cannot stat " + path.string() +
+                                                ": " + std::strerror(saved));
+  }
+
+  out.reset();
+  if (st.st_size > 0) {
+    void *address = ::mmap(nullptr, static_cast<std::size_t>(st.st_size),
+                           PROT_READ, MAP_PRIVATE, fd, 0);
+    if (address == MAP_FAILED) {
+      int saved = errno;
+      ::close(fd);
+      return create_error(ErrorCode::IOError, "Cannot map " + path.string() +
+                                                  ": " + std::strerror(saved));
+    }
+    out.address_ = address;
+    out.size_ = static_cast<std::size_t>(st.st_size);
+  }
+
+  // The mapping keeps the pages alive; the descriptor is no longer needed
+  ::close(fd);
+  return std::nullopt;
+}
+
+void MappedFile::prefetch(std::size_t offset, std::size_t length) const {
+  if (address_ == nullptr || offset >= size_) {
+    return;
+  }
+  length = std::min(length, size_ - offset);
+  // madvise wants a page-aligned start; the mapping itself is aligned
+  static const auto page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+  std::size_t start = offset & ~(page - 1);
+  ::madvise(static_cast<char *>(address_) + start, length + (offset - start),
+            MADV_WILLNEED);
+}
+
+} // namespace chrona
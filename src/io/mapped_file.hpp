@@ -0,0 +1,45 @@
+#pragma once
+
+#include "errors/error.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string_view>
+
+namespace chrona {
+
+// Read-only mmap of a whole file. Empty files map to an empty view.
+class MappedFile {
+public:
+  MappedFile() = default;
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  MappedFile(MappedFile &&other) noexcept;
+  MappedFile &operator=(MappedFile &&other) noexcept;
+
+  static std::optional<Error> open(const std::filesystem::path &path,
+                                   MappedFile &out);
+
+  const std::uint8_t *data() const {
+    return static_cast<const std::uint8_t *>(address_);
+  }
+  std::size_t size() const { return size_; }
+  std::string_view view() const {
+    return {static_cast<const char *>(address_), size_};
+  }
+
+  // Asks the kernel to start reading [offset, offset + length) in now, so
+  // later accesses find the pages resident.
+  void prefetch(std::size_t offset, std::size_t length) const;
+
+private:
+  void reset();
+
+  void *address_ = nullptr;
+  std::size_t size_ = 0;
+};
+
+} // namespace chrona
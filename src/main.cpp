@@ -1,38 +1,83 @@
 #include "cli/cli.hpp"
+#include "commands/commands.hpp"
 #include "errors/error.hpp"
+#include "trace/trace.hpp"
+#include <algorithm>
+#include <array>
 
-int main(int argc, char *argv[]) {
-  // First we need to parse the arguments
-  auto result = chrona::parse_args(argc, argv);
+namespace {
+
+using Handler = int (*)(const chrona::ParseResult &);
+
+struct Route {
+  chrona::Command command;
+  Handler handler;
+};
+
+constexpr Route routes[] = {
+    {chrona::Command::Init, chrona::run_init},
+    {chrona::Command::Add, chrona::run_add},
+    {chrona::Command::Status, chrona::run_status},
+    {chrona::Command::Pack, chrona::run_pack},
+    {chrona::Command::Commit, chrona::run_commit},
+    {chrona::Command::Log, chrona::run_log},
+    {chrona::Command::MergeBase, chrona::run_merge_base},
+    {chrona::Command::CommitGraph, chrona::run_commit_graph},
+    {chrona::Command::Diff, chrona::run_diff},
+    {chrona::Command::Gc, chrona::run_gc},
+    {chrona::Command::Checkout, chrona::run_checkout},
+    {chrona::Command::Daemon, chrona::run_daemon},
+    {chrona::Command::CatFile, chrona::run_cat_file},
+    {chrona::Command::Merge, chrona::run_merge},
+    {chrona::Command::CountObjects, chrona::run_count_objects},
+    {chrona::Command::Bundle, chrona::run_bundle},
+    {chrona::Command::Fsck, chrona::run_fsck},
+    {chrona::Command::Sparse, chrona::run_sparse},
+};
 
-  // Then we need to handle the result
+// Indexed by Command, built at compile time; a command without a route
+// (or with two) fails the build instead of falling through at run time.
+constexpr auto handlers = [] {
+  std::array<Handler, chrona::command_count> table{};
+  for (const auto &route : routes) {
+    table[static_cast<std::size_t>(route.command)] = route.handler;
+  }
+  return table;
+}();
+
+static_assert(std::size(routes) == chrona::command_count &&
+                  std::find(handlers.begin(), handlers.end(), nullptr) ==
+                      handlers.end(),
+              "every Command needs exactly one route");
+
+int run(int argc, char *argv[]) {
+  auto result = chrona::parse_args(argc, argv);
   switch (result.action) {
-    // Show help
   case chrona::ParseAction::ShowHelp:
     chrona::print_usage();
     return 0;
-
-    // Error
   case chrona::ParseAction::Error:
     chrona::print_error(chrona::create_error(chrona::ErrorCode::InvalidArgument,
                                              result.error_message.value())
                             .value());
     return 1;
-
-    // Run command
   case chrona::ParseAction::RunCommand:
-    switch (result.command.value()) {
-    case chrona::Command::Init:
-      // TODO: Implement init command
-      return 0;
-    default:
-      chrona::print_error(
-          chrona::create_error(
-              chrona::ErrorCode::InvalidArgument,
-              "Unknown command: " +
-                  std::to_string(static_cast<int>(result.command.value())))
-              .value());
-      return 1;
-    }
+    return handlers[static_cast<std::size_t>(*result.command)](result);
+  }
+  return 1;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  if (auto trace = chrona::take_trace_option(argc, argv)) {
+    chrona::start_trace(*trace);
+  }
+  int code = 0;
+  {
+    CHRONA_TRACE_SCOPE("chrona");
+    code = run(argc, argv);
   }
+  chrona::finish_trace();
+  return code;
 }
@@ -0,0 +1,79 @@
+#include "arena.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace chrona {
+
+Arena::Arena(void *buffer, std::size_t size, std::size_t block_size)
+    : block_size_(block_size), buffer_(static_cast<std::byte *>(buffer)),
+      buffer_size_(size), block_begin_(buffer_), cursor_(buffer_),
+      end_(buffer_ + size) {}
+
+Arena::~Arena() {
+  run_finalizers();
+  while (blocks_ != nullptr) {
+    auto *next = blocks_->next;
+    ::operator delete(blocks_);
+    blocks_ = next;
+  }
+  ::operator delete(spare_);
+}
+
+void *Arena::allocate_slow(std::size_t size, std::size_t align) {
+  // Oversized requests get a block of their own
+  std::size_t needed = sizeof(Block) + size + align;
+  Block *block = nullptr;
+  if (spare_ != nullptr && spare_->size >= needed) {
+    block = spare_;
+    spare_ = nullptr;
+  } else {
+    std::size_t block_size = std::max(block_size_, needed);
+    block = static_cast<Block *>(::operator new(block_size));
+    block->size = block_size;
+  }
+  block->next = blocks_;
+  blocks_ = block;
+
+  used_ += static_cast<std::size_t>(cursor_ - block_begin_);
+  block_begin_ = reinterpret_cast<std::byte *>(block + 1);
+  cursor_ = block_begin_;
+  end_ = reinterpret_cast<std::byte *>(block) + block->size;
+  return allocate(size, align);
+}
+
+std::string_view Arena::copy(std::string_view text) {
+  if (text.empty()) {
+    return {};
+  }
+  auto *out = static_cast<char *>(allocate(text.size(), 1));
+  std::memcpy(out, text.data(), text.size());
+  return {out, text.size()};
+}
+
+void Arena::run_finalizers() {
+  for (auto *node = finalizers_; node != nullptr; node = node->next) {
+    node->destroy(node->object);
+  }
+  finalizers_ = nullptr;
+}
+
+void Arena::reset() {
+  run_finalizers();
+
+  // Keep one standard-sized block for reuse; oversized ones are one-offs
+  while (blocks_ != nullptr) {
+    auto *next = blocks_->next;
+    if (spare_ == nullptr && blocks_->size == block_size_) {
+      spare_ = blocks_;
+    } else {
+      ::operator delete(blocks_);
+    }
+    blocks_ = next;
+  }
+  used_ = 0;
+  block_begin_ = buffer_;
+  cursor_ = buffer_;
+  end_ = buffer_ + buffer_size_;
+}
+
+} // namespace chrona
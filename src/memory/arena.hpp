@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+namespace chrona {
+
+// Bump allocator for the parsed objects of one operation (a log walk, a
+// checkout, a diff). Allocation is a pointer increment; nothing is freed
+// individually, and everything goes at once in reset() or the destructor.
+// Not thread-safe: give each task its own arena.
+class Arena {
+public:
+  static constexpr std::size_t default_block_size = 64 * 1024;
+
+  explicit Arena(std::size_t block_size = default_block_size)
+      : block_size_(block_size) {}
+  // Serves allocations from `buffer` (typically on the stack) until it
+  // runs out, then falls back to heap blocks.
+  Arena(void *buffer, std::size_t size,
+        std::size_t block_size = default_block_size);
+  ~Arena();
+
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  void *allocate(std::size_t size, std::size_t align) {
+    auto aligned = (reinterpret_cast<std::uintptr_t>(cursor_) + align - 1) &
+                   ~(static_cast<std::uintptr_t>(align) - 1);
+    if (cursor_ == nullptr ||
+        aligned + size > reinterpret_cast<std::uintptr_t>(end_)) {
+      return allocate_slow(size, align);
+    }
+    cursor_ = reinterpret_cast<std::byte *>(aligned + size);
+    return reinterpret_cast<void *>(aligned);
+  }
+
+  // Uninitialized storage for `count` trivially destructible values.
+  template <typename T> std::span<T> allocate_array(std::size_t count) {
+    static_assert(std::is_trivially_destructible_v<T>);
+    if (count == 0) {
+      return {};
+    }
+    return {static_cast<T *>(allocate(sizeof(T) * count, alignof(T))), count};
+  }
+
+  // Constructs a T in the arena; its destructor runs on reset().
+  template <typename T, typename... Args> T *create(Args &&...args) {
+    if constexpr (std::is_trivially_destructible_v<T>) {
+      return new (allocate(sizeof(T), alignof(T)))
+          T(std::forward<Args>(args)...);
+    } else {
+      auto *object =
+          new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+      finalizers_ = new (allocate(sizeof(Finalizer), alignof(Finalizer)))
+          Finalizer{[](void *p) { static_cast<T *>(p)->~T(); }, object,
+                    finalizers_};
+      return object;
+    }
+  }
+
+  std::string_view copy(std::string_view text);
+
+  // Destroys everything allocated so far. One heap block is kept, so an
+  // arena reused in a loop stops allocating after the first iteration.
+  void reset();
+
+  // Bytes handed out since construction or the last reset().
+  std::size_t used() const { return used_ + (cursor_ - block_begin_); }
+
+private:
+  struct Block {
+    Block *next;
+    std::size_t size;
+  };
+  struct Finalizer {
+    void (*destroy)(void *);
+    void *object;
+    Finalizer *next;
+  };
+
+  void *allocate_slow(std::size_t size, std::size_t align);
+  void run_finalizers();
+
+  std::size_t block_size_;
+  std::byte *buffer_ = nullptr; // caller-provided initial buffer
+  std::size_t buffer_size_ = 0;
+  Block *blocks_ = nullptr; // newest first
+  Block *spare_ = nullptr;  // kept by reset() for the next allocation
+  std::byte *block_begin_ = nullptr;
+  std::byte *cursor_ = nullptr;
+  std::byte *end_ = nullptr;
+  std::size_t used_ = 0; // in blocks before the current one
+  Finalizer *finalizers_ = nullptr;
+};
+
+// An arena whose first `Size` bytes live inline, so short-lived arenas for
+// small objects never touch the heap.
+template <std::size_t Size> class InlineArena : public Arena {
+public:
+  InlineArena() : Arena(storage_, Size) {}
+
+private:
+  alignas(std::max_align_t) std::byte storage_[Size];
+};
+
+} // namespace chrona
@@ -0,0 +1,485 @@
+#include "merge.hpp"
+#include "diff/file_diff.hpp"
+#include "history/commit.hpp"
+#include "io/file_io.hpp"
+#include "snapshot/tree.hpp"
+#include "trace/trace.hpp"
+#include <algorithm>
+#include <memory>
+
+namespace chrona {
+
+namespace {
+
+using Side = std::optional<PathEntry>;
+
+bool same(const Side &a, const Side &b) {
+  if (!a || !b) {
+    return !a && !b;
+  }
+  return a->mode == b->mode && a->id == b->id;
+}
+
+bool is_dir(const Side &side) {
+  return side && side->mode == EntryMode::Directory;
+}
+
+bool is_file(const Side &side) {
+  return side && (side->mode == EntryMode::Regular ||
+                  side->mode == EntryMode::Executable);
+}
+
+std::string join(const std::string &prefix, std::string_view name) {
+  return prefix.empty() ? std::string(name) : prefix + "/" + std::string(name);
+}
+
+struct MergedDir;
+
+struct MergedEntry {
+  std::string name;
+  EntryMode mode;
+  ObjectId id;
+  std::unique_ptr<MergedDir> dir; // a subtree that still has to be written
+};
+
+struct MergedDir {
+  std::vector<MergedEntry> entries;
+};
+
+// A file (or symlink) that clashed with a directory on the other side. It
+// moves aside to "<name>~<label>" once the directory's other names are
+// known, and is conflicted there.
+struct Displaced {
+  std::string name;
+  std::string_view label;
+  PathEntry entry;
+  Side base;
+  Side ours;
+  Side theirs;
+};
+
+// A file both sides changed, to be merged by line. The result lands in
+// `dir->entries[slot]`.
+struct FileMerge {
+  MergedDir *dir;
+  std::size_t slot;
+  std::string path;
+  Side base;
+  Side ours;
+  Side theirs;
+  bool mode_conflict = false;
+  bool conflicted = false;
+  std::optional<Error> error;
+};
+
+std::optional<Error> read_commit(const ObjectStore &store, const ObjectId &id,
+                                 Commit &out) {
+  ObjectView view;
+  if (auto error = store.read(id, view)) {
+    return error;
+  }
+  if (view.type() != ObjectType::Commit) {
+    return create_error(ErrorCode::InvalidArgument,
+                        "Not a commit: " + id.hex());
+  }
+  return decode_commit(view.content(), out);
+}
+
+class TreeMerge {
+public:
+  TreeMerge(ObjectStore &store, const MergeOptions &options,
+            MergeResult &out)
+      : store_(store), options_(options), out_(out) {}
+
+  std::optional<Error> run(WorkPool &pool, const ObjectId *base,
+                           const ObjectId &ours, const ObjectId &theirs) {
+    out_.conflicts.clear();
+    out_.stats = MergeStats();
+    MergedDir root;
+    if (auto error = merge_dir(base, &ours, &theirs, "", root)) {
+      return error;
+    }
+    if (auto error = merge_files(pool)) {
+      return error;
+    }
+    std::sort(out_.conflicts.begin(), out_.conflicts.end(),
+              [](const MergeConflict &a, const MergeConflict &b) {
+                return a.path < b.path;
+              });
+
+    ObjectBatch batch(store_);
+    if (auto error = write_dir(root, batch, out_.tree)) {
+      return error;
+    }
+    return batch.commit();
+  }
+
+private:
+  std::optional<Error> read_tree(const ObjectId *id,
+                                 std::vector<TreeEntry> &out) {
+    if (id == nullptr) {
+      return std::nullopt;
+    }
+    ++out_.stats.trees_read;
+    ObjectView view;
+    if (auto error = store_.read(*id, view)) {
+      return error;
+    }
+    if (view.type() != ObjectType::Tree) {
+      return create_error(ErrorCode::CorruptObject, "Not a tree: " + id->hex());
+    }
+    return decode_tree(view.content(), out);
+  }
+
+  // Merge-joins the three (sorted) entry lists by name.
+  std::optional<Error> merge_dir(const ObjectId *base, const ObjectId *ours,
+                                 const ObjectId *theirs,
+                                 const std::string &prefix, MergedDir &out) {
+    std::vector<TreeEntry> trees[3];
+    const ObjectId *ids[] = {base, ours, theirs};
+    for (int side = 0; side < 3; ++side) {
+      if (auto error = read_tree(ids[side], trees[side])) {
+        return error;
+      }
+    }
+
+    std::size_t at[3] = {0, 0, 0};
+    std::vector<Displaced> displaced;
+    for (;;) {
+      const std::string *name = nullptr;
+      for (int side = 0; side < 3; ++side) {
+        if (at[side] < trees[side].size() &&
+            (name == nullptr || trees[side][at[side]].name < *name)) {
+          name = &trees[side][at[side]].name;
+        }
+      }
+      if (name == nullptr) {
+        break;
+      }
+      Side sides[3];
+      for (int side = 0; side < 3; ++side) {
+        if (at[side] < trees[side].size() &&
+            trees[side][at[side]].name == *name) {
+          const auto &entry = trees[side][at[side]];
+          sides[side] = PathEntry{entry.mode, entry.id};
+        }
+      }
+      auto entry_name = *name;
+      for (int side = 0; side < 3; ++side) {
+        at[side] += sides[side] ? 1 : 0;
+      }
+      if (auto error = merge_entry(prefix, entry_name, sides[0], sides[1],
+                                   sides[2], out, displaced)) {
+        return error;
+      }
+    }
+
+    for (const auto &moved : displaced) {
+      auto name = moved.name + "~" + std::string(moved.label);
+      std::replace(name.begin(), name.end(), '/', '_');
+      auto stem = name;
+      for (int n = 1; taken(out, name); ++n) {
+        name = stem + "_" + std::to_string(n);
+      }
+      out.entries.push_back(
+          MergedEntry{name, moved.entry.mode, moved.entry.id, nullptr});
+      out_.conflicts.push_back(MergeConflict{
+          join(prefix, name), moved.base, moved.ours, moved.theirs});
+    }
+    return std::nullopt;
+  }
+
+  static bool taken(const MergedDir &dir, const std::string &name) {
+    return std::any_of(
+        dir.entries.begin(), dir.entries.end(),
+        [&](const MergedEntry &entry) { return entry.name == name; });
+  }
+
+  std::optional<Error> merge_entry(const std::string &prefix,
+                                   const std::string &name, const Side &base,
+                                   const Side &ours, const Side &theirs,
+                                   MergedDir &out,
+                                   std::vector<Displaced> &displaced) {
+    // Two versions agree: the third one wins, whatever it is
+    const Side *taken = nullptr;
+    if (same(ours, theirs) || same(base, theirs)) {
+      taken = &ours;
+    } else if (same(base, ours)) {
+      taken = &theirs;
+    }
+    if (taken != nullptr) {
+      ++out_.stats.entries_taken;
+      if (*taken) {
+        out.entries.push_back(MergedEntry{name, (*taken)->mode,
+                                          (*taken)->id, nullptr});
+      }
+      return std::nullopt;
+    }
+
+    auto path = join(prefix, name);
+    if (is_dir(ours) && is_dir(theirs)) {
+      auto child = std::make_unique<MergedDir>();
+      if (auto error = merge_dir(is_dir(base) ? &base->id : nullptr,
+                                 &ours->id, &theirs->id, path, *child)) {
+        return error;
+      }
+      out.entries.push_back(
+          MergedEntry{name, EntryMode::Directory, {}, std::move(child)});
+      return std::nullopt;
+    }
+
+    if (is_file(ours) && is_file(theirs) && (!base || is_file(base))) {
+      FileMerge file{&out, out.entries.size(), path, base, ours, theirs,
+                     false, false, std::nullopt};
+      auto mode = merge_mode(base, ours, theirs, file.mode_conflict);
+      out.entries.push_back(MergedEntry{name, mode, ours->id, nullptr});
+
+      // The content may still be decided without reading it
+      if (ours->id == theirs->id || (base && base->id == ours->id)) {
+        out.entries.back().id = theirs->id;
+      } else if (!base || base->id != theirs->id) {
+        files_.push_back(std::move(file));
+        return std::nullopt;
+      }
+      if (file.mode_conflict) {
+        out_.conflicts.push_back(MergeConflict{path, base, ours, theirs});
+      }
+      return std::nullopt;
+    }
+
+    // A directory against a file or nothing: the directory is merged with
+    // the other side empty inside it. A clashing file moves aside, so every
+    // conflict lands on a file path the index can hold.
+    if (is_dir(ours) || is_dir(theirs)) {
+      auto child = std::make_unique<MergedDir>();
+      if (auto error = merge_dir(is_dir(base) ? &base->id : nullptr,
+                                 is_dir(ours) ? &ours->id : nullptr,
+                                 is_dir(theirs) ? &theirs->id : nullptr,
+                                 path, *child)) {
+        return error;
+      }
+      out.entries.push_back(
+          MergedEntry{name, EntryMode::Directory, {}, std::move(child)});
+      bool ours_moved = ours && !is_dir(ours);
+      if (ours_moved || (theirs && !is_dir(theirs))) {
+        const auto &labels = options_.labels;
+        displaced.push_back(Displaced{
+            name, ours_moved ? labels.ours : labels.theirs,
+            ours_moved ? *ours : *theirs, is_dir(base) ? Side() : base,
+            ours_moved ? ours : Side(), ours_moved ? Side() : theirs});
+      }
+      return std::nullopt;
+    }
+
+    // Deleted on one side and changed on the other, or a file against a
+    // symlink: keep what is there on our side (theirs if we deleted it)
+    // and leave the rest to the user.
+    const auto &kept = ours ? ours : theirs;
+    out.entries.push_back(MergedEntry{name, kept->mode, kept->id, nullptr});
+    out_.conflicts.push_back(MergeConflict{path, base, ours, theirs});
+    return std::nullopt;
+  }
+
+  static EntryMode merge_mode(const Side &base, const Side &ours,
+                              const Side &theirs, bool &conflict) {
+    conflict = false;
+    if (ours->mode == theirs->mode || (base && base->mode == theirs->mode)) {
+      return ours->mode;
+    }
+    if (base && base->mode == ours->mode) {
+      return theirs->mode;
+    }
+    conflict = true;
+    return ours->mode;
+  }
+
+  std::optional<Error> read_content(const Side &side, ObjectView &out) {
+    if (!side) {
+      out = ObjectView();
+      return std::nullopt;
+    }
+    return store_.read(side->id, out);
+  }
+
+  void merge_file(FileMerge &file) {
+    ObjectView versions[3];
+    const Side *sides[] = {&file.base, &file.ours, &file.theirs};
+    for (int side = 0; side < 3; ++side) {
+      if (auto error = read_content(*sides[side], versions[side])) {
+        file.error = error;
+        return;
+      }
+    }
+    auto &entry = file.dir->entries[file.slot];
+    if (looks_binary(versions[0].content()) ||
+        looks_binary(versions[1].content()) ||
+        looks_binary(versions[2].content())) {
+      file.conflicted = true;
+      return;
+    }
+    std::string merged;
+    auto conflicts =
+        merge_text(versions[0].content(), versions[1].content(),
+                   versions[2].content(), merged, options_.labels);
+    file.conflicted = conflicts > 0 || file.mode_conflict;
+    file.error = store_.write(ObjectType::Blob, merged, entry.id);
+  }
+
+  std::optional<Error> merge_files(WorkPool &pool) {
+    CHRONA_TRACE_SCOPE("merge.files");
+    out_.stats.files_merged = files_.size();
+    pool.parallel_for(files_.size(), 1, [&](std::size_t begin,
+                                            std::size_t end) {
+      for (auto i = begin; i < end; ++i) {
+        merge_file(files_[i]);
+      }
+    });
+    for (auto &file : files_) {
+      if (file.error) {
+        return file.error;
+      }
+      if (file.conflicted) {
+        out_.conflicts.push_back(
+            MergeConflict{file.path, file.base, file.ours, file.theirs});
+      }
+    }
+    return std::nullopt;
+  }
+
+  // Writes the subtrees first; a directory left empty is dropped.
+  std::optional<Error> write_dir(MergedDir &dir, ObjectBatch &batch,
+                                 ObjectId &out) {
+    std::vector<TreeEntry> entries;
+    entries.reserve(dir.entries.size());
+    for (auto &entry : dir.entries) {
+      if (entry.dir) {
+        if (auto error = write_dir(*entry.dir, batch, entry.id)) {
+          return error;
+        }
+        if (entry.dir->entries.empty()) {
+          continue;
+        }
+      }
+      entries.push_back(TreeEntry{entry.name, entry.mode, entry.id});
+    }
+    if (entries.empty()) {
+      dir.entries.clear();
+    }
+    return batch.add(ObjectType::Tree, encode_tree(std::move(entries)), out);
+  }
+
+  ObjectStore &store_;
+  const MergeOptions &options_;
+  MergeResult &out_;
+  std::vector<FileMerge> files_;
+};
+
+// The tree to merge `a` and `b` against, merging several best bases
+// into virtual commits first.
+std::optional<Error> base_tree(ObjectStore &store, WorkPool &pool,
+                               History &history, const ObjectId &a,
+                               const ObjectId &b,
+                               std::optional<ObjectId> &out) {
+  std::vector<ObjectId> bases;
+  if (auto error = history.merge_bases(a, b, bases)) {
+    return error;
+  }
+  out.reset();
+  if (bases.empty()) {
+    return std::nullopt;
+  }
+
+  auto current = bases[0];
+  Commit merged;
+  if (auto error = read_commit(store, current, merged)) {
+    return error;
+  }
+  for (std::size_t i = 1; i < bases.size(); ++i) {
+    Commit next;
+    if (auto error = read_commit(store, bases[i], next)) {
+      return error;
+    }
+    std::optional<ObjectId> inner;
+    if (auto error = base_tree(store, pool, history, current, bases[i],
+                               inner)) {
+      return error;
+    }
+    MergeResult result;
+    MergeOptions options;
+    options.labels = {"base", "other base"};
+    if (auto error = merge_trees(store, pool, inner ? &*inner : nullptr,
+                                 merged.tree, next.tree, result, options)) {
+      return error;
+    }
+    merged.tree = result.tree;
+    merged.parents = {current, bases[i]};
+    merged.author = "chrona";
+    merged.time = std::max(merged.time, next.time);
+    merged.message = "virtual merge base\n";
+    if (auto error =
+            store.write(ObjectType::Commit, encode_commit(merged), current)) {
+      return error;
+    }
+  }
+  out = merged.tree;
+  return std::nullopt;
+}
+
+} // namespace
+
+std::optional<Error> merge_trees(ObjectStore &store, WorkPool &pool,
+                                 const ObjectId *base, const ObjectId &ours,
+                                 const ObjectId &theirs, MergeResult &out,
+                                 const MergeOptions &options) {
+  CHRONA_TRACE_SCOPE("merge.trees");
+  return TreeMerge(store, options, out).run(pool, base, ours, theirs);
+}
+
+std::optional<Error> merge_commits(ObjectStore &store, WorkPool &pool,
+                                   History &history, const ObjectId &ours,
+                                   const ObjectId &theirs, MergeResult &out,
+                                   const MergeOptions &options) {
+  Commit ours_commit;
+  Commit theirs_commit;
+  if (auto error = read_commit(store, ours, ours_commit)) {
+    return error;
+  }
+  if (auto error = read_commit(store, theirs, theirs_commit)) {
+    return error;
+  }
+  std::optional<ObjectId> base;
+  if (auto error = base_tree(store, pool, history, ours, theirs, base)) {
+    return error;
+  }
+  return merge_trees(store, pool, base ? &*base : nullptr, ours_commit.tree,
+                     theirs_commit.tree, out, options);
+}
+
+std::optional<Error> read_merge_head(const std::filesystem::path &chrona_dir,
+                                     std::optional<ObjectId> &out) {
+  out.reset();
+  auto path = merge_head_path(chrona_dir);
+  std::string text;
+  if (auto error = read_file(path, text)) {
+    if (error->error_code == ErrorCode::NotFound) {
+      return std::nullopt;
+    }
+    return error;
+  }
+  while (!text.empty() && text.back() == '\n') {
+    text.pop_back();
+  }
+  out = ObjectId::from_hex(text);
+  if (!out) {
+    return create_error(ErrorCode::CorruptObject,
+                        "Invalid commit id in " + path.string());
+  }
+  return std::nullopt;
+}
+
+std::optional<Error> write_merge_head(const std::filesystem::path &chrona_dir,
+                                      const ObjectId &id) {
+  return write_file_atomic(merge_head_path(chrona_dir), id.hex() + "\n");
+}
+
+} // namespace chrona
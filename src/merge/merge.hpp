@@ -0,0 +1,79 @@
+#pragma once
+
+#include "errors/error.hpp"
+#include "history/history.hpp"
+#include "merge/text_merge.hpp"
+#include "objects/object_store.hpp"
+#include "parallel/work_pool.hpp"
+#include "snapshot/tree_diff.hpp"
+#include <cstddef>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace chrona {
+
+struct MergeOptions {
+  TextMergeLabels labels;
+};
+
+// A path the merge could not resolve. Each side is empty where that
+// version has nothing at the path.
+struct MergeConflict {
+  std::string path;
+  std::optional<PathEntry> base;
+  std::optional<PathEntry> ours;
+  std::optional<PathEntry> theirs;
+};
+
+struct MergeStats {
+  std::size_t trees_read = 0;
+  // Entries taken whole because two of the three versions agreed on them;
+  // for a directory this skips everything below it.
+  std::size_t entries_taken = 0;
+  std::size_t files_merged = 0; // line-level merges run
+};
+
+struct MergeResult {
+  // Always written. A conflicted file appears with conflict markers, or as
+  // our version when it could not be merged by line. A file that clashes
+  // with a directory moves aside to "<name>~<label>"; every conflict path
+  // is a file in this tree.
+  ObjectId tree;
+  std::vector<MergeConflict> conflicts; // sorted by path
+  MergeStats stats;
+};
+
+// Three-way merge of `ours` and `theirs` against `base` (nullptr: the
+// empty tree). The three trees are walked together and any entry two of
+// them agree on is decided by id alone, so unchanged directories are
+// never read. Files both sides changed are merged line by line on
+// `pool`; only the trees along changed paths are rewritten.
+std::optional<Error> merge_trees(ObjectStore &store, WorkPool &pool,
+                                 const ObjectId *base, const ObjectId &ours,
+                                 const ObjectId &theirs, MergeResult &out,
+                                 const MergeOptions &options = {});
+
+// Merges the trees of two commits. With several best merge bases, they
+// are first merged pairwise into virtual base commits (written to the
+// store, unreferenced), keeping any conflicts in the merged base, so the
+// final merge sees one base that carries every side's history.
+std::optional<Error> merge_commits(ObjectStore &store, WorkPool &pool,
+                                   History &history, const ObjectId &ours,
+                                   const ObjectId &theirs, MergeResult &out,
+                                   const MergeOptions &options = {});
+
+// While a merge waits for its conflicts to be resolved, MERGE_HEAD holds
+// the commit being merged; the next commit takes it as second parent.
+inline std::filesystem::path
+merge_head_path(const std::filesystem::path &chrona_dir) {
+  return chrona_dir / "MERGE_HEAD";
+}
+// Leaves `out` empty when no merge is in progress.
+std::optional<Error> read_merge_head(const std::filesystem::path &chrona_dir,
+                                     std::optional<ObjectId> &out);
+std::optional<Error> write_merge_head(const std::filesystem::path &chrona_dir,
+                                      const ObjectId &id);
+
+} // namespace chrona
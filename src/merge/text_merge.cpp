@@ -0,0 +1,160 @@
+#include "text_merge.hpp"
+#include "diff/diff.hpp"
+#include "diff/lines.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace chrona {
+
+namespace {
+
+constexpr std::size_t unmatched = SIZE_MAX;
+
+// For each base line, the line of `side` it is paired with by the diff,
+// or `unmatched` when the side removed it.
+std::vector<std::size_t> match_lines(const std::vector<std::uint32_t> &base,
+                                     const std::vector<std::uint32_t> &side,
+                                     std::size_t id_count) {
+  auto script = diff_ids(base, side, id_count);
+  std::vector<std::size_t> out(base.size(), unmatched);
+  std::size_t j = 0;
+  for (std::size_t i = 0; i < base.size(); ++i) {
+    if (script.removed[i]) {
+      continue;
+    }
+    while (script.added[j]) {
+      ++j;
+    }
+    out[i] = j++;
+  }
+  return out;
+}
+
+struct Side {
+  std::vector<std::string_view> lines;
+  std::vector<std::uint32_t> ids;
+};
+
+bool same_lines(const Side &a, std::size_t a0, std::size_t a1, const Side &b,
+                std::size_t b0, std::size_t b1) {
+  return a1 - a0 == b1 - b0 &&
+         std::equal(a.ids.begin() + static_cast<std::ptrdiff_t>(a0),
+                    a.ids.begin() + static_cast<std::ptrdiff_t>(a1),
+                    b.ids.begin() + static_cast<std::ptrdiff_t>(b0));
+}
+
+void append_lines(const Side &side, std::size_t begin, std::size_t end,
+                  std::string &out) {
+  for (auto i = begin; i < end; ++i) {
+    out.append(side.lines[i]);
+  }
+}
+
+// Inside conflict markers every line needs its newline, even the last
+// line of a file that has none.
+void append_marked(const Side &side, std::size_t begin, std::size_t end,
+                   std::string &out) {
+  append_lines(side, begin, end, out);
+  if (begin < end && out.back() != '\n') {
+    out += '\n';
+  }
+}
+
+void append_marker(char c, std::string_view label, std::string &out) {
+  out.append(7, c);
+  if (!label.empty()) {
+    out += ' ';
+    out.append(label);
+  }
+  out += '\n';
+}
+
+} // namespace
+
+std::size_t merge_text(std::string_view base, std::string_view ours,
+                       std::string_view theirs, std::string &out,
+                       const TextMergeLabels &labels) {
+  Side sides[3];
+  split_lines(base, sides[0].lines);
+  split_lines(ours, sides[1].lines);
+  split_lines(theirs, sides[2].lines);
+  LineInterner interner(sides[0].lines.size() + sides[1].lines.size() +
+                        sides[2].lines.size());
+  for (auto &side : sides) {
+    side.ids.reserve(side.lines.size());
+    for (auto line : side.lines) {
+      side.ids.push_back(interner.intern(line));
+    }
+  }
+  const auto &b = sides[0];
+  const auto &o = sides[1];
+  const auto &t = sides[2];
+  auto to_ours = match_lines(b.ids, o.ids, interner.size());
+  auto to_theirs = match_lines(b.ids, t.ids, interner.size());
+
+  out.clear();
+  out.reserve(std::max(ours.size(), theirs.size()));
+  std::size_t conflicts = 0;
+  std::size_t bi = 0;
+  std::size_t oi = 0;
+  std::size_t ti = 0;
+  const auto nb = b.lines.size();
+  while (bi < nb || oi < o.lines.size() || ti < t.lines.size()) {
+    // Lines all three agree on are copied through
+    if (bi < nb && to_ours[bi] == oi && to_theirs[bi] == ti) {
+      out.append(b.lines[bi]);
+      ++bi;
+      ++oi;
+      ++ti;
+      continue;
+    }
+    // Otherwise the region runs up to the next base line both sides kept
+    auto end = bi;
+    while (end < nb &&
+           (to_ours[end] == unmatched || to_theirs[end] == unmatched)) {
+      ++end;
+    }
+    auto o_end = end < nb ? to_ours[end] : o.lines.size();
+    auto t_end = end < nb ? to_theirs[end] : t.lines.size();
+
+    if (same_lines(b, bi, end, o, oi, o_end)) {
+      append_lines(t, ti, t_end, out);
+    } else if (same_lines(b, bi, end, t, ti, t_end) ||
+               same_lines(o, oi, o_end, t, ti, t_end)) {
+      append_lines(o, oi, o_end, out);
+    } else {
+      // Lines both sides start or end the region with stay outside the
+      // markers, so the conflict covers only what really differs
+      auto o0 = oi;
+      auto t0 = ti;
+      auto o1 = o_end;
+      auto t1 = t_end;
+      while (o0 < o1 && t0 < t1 && o.ids[o0] == t.ids[t0]) {
+        ++o0;
+        ++t0;
+      }
+      while (o0 < o1 && t0 < t1 && o.ids[o1 - 1] == t.ids[t1 - 1]) {
+        --o1;
+        --t1;
+      }
+      ++conflicts;
+      append_lines(o, oi, o0, out);
+      if (!out.empty() && out.back() != '\n') {
+        out += '\n';
+      }
+      append_marker('<', labels.ours, out);
+      append_marked(o, o0, o1, out);
+      append_marker('=', {}, out);
+      append_marked(t, t0, t1, out);
+      append_marker('>', labels.theirs, out);
+      append_lines(o, o1, o_end, out);
+    }
+    bi = end;
+    oi = o_end;
+    ti = t_end;
+  }
+  return conflicts;
+}
+
+} // namespace chrona
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace chrona {
+
+struct TextMergeLabels {
+  std::string_view ours = "ours";
+  std::string_view theirs = "theirs";
+};
+
+// Line-level three-way merge (diff3). Both sides are diffed against
+// `base`; lines unchanged on both sides anchor the result, and each region
+// between anchors takes whichever side changed it. A region both sides
+// changed differently, less any lines they agree on at its start and
+// end, is written as
+//
+//   <<<<<<< ours
+//   ...
+//   =======
+//   ...
+//   >>>>>>> theirs
+//
+// Returns the number of such conflict regions; 0 means a clean merge.
+std::size_t merge_text(std::string_view base, std::string_view ours,
+                       std::string_view theirs, std::string &out,
+                       const TextMergeLabels &labels = {});
+
+} // namespace chrona
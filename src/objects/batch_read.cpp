@@ -0,0 +1,94 @@
+#include "batch_read.hpp"
+#include "pack/pack.hpp"
+#include "trace/trace.hpp"
+#include <algorithm>
+#include <cstdint>
+
+namespace chrona {
+
+namespace {
+
+constexpr std::size_t loose = SIZE_MAX;
+// Entries closer together than this share one read-ahead request
+constexpr std::uint64_t prefetch_gap = 1 << 20;
+// Room for the last entry of a run, whose length the index does not give
+constexpr std::uint64_t prefetch_tail = 64 << 10;
+// Below this, handing loose reads to the pool costs more than it saves
+constexpr std::size_t parallel_loose_min = 64;
+
+struct Location {
+  std::size_t pack;
+  std::uint64_t offset;
+  std::size_t index;
+};
+
+} // namespace
+
+void read_batch(const ObjectStore &store, std::span<const ObjectId> ids,
+                std::vector<BatchRead> &out, WorkPool *pool) {
+  CHRONA_TRACE_SCOPE("read_batch");
+  trace_count(TraceCounter::ObjectsRead, ids.size());
+  out.assign(ids.size(), BatchRead());
+  auto packs = store.packs();
+
+  std::vector<Location> order;
+  order.reserve(ids.size());
+  for (std::size_t i = 0; i < ids.size(); ++i) {
+    Location location{loose, 0, i};
+    for (std::size_t p = 0; p < packs->size(); ++p) {
+      if (auto offset = (*packs)[p]->find(ids[i])) {
+        location.pack = p;
+        location.offset = *offset;
+        break;
+      }
+    }
+    order.push_back(location);
+  }
+  std::sort(order.begin(), order.end(),
+            [&](const Location &a, const Location &b) {
+              if (a.pack != b.pack) {
+                return a.pack < b.pack;
+              }
+              if (a.pack == loose) {
+                return ids[a.index] < ids[b.index];
+              }
+              return a.offset < b.offset;
+            });
+  auto first_loose = std::find_if(
+      order.begin(), order.end(),
+      [](const Location &location) { return location.pack == loose; });
+
+  // Ask for every run's pages before reading any, so the disk works
+  // through later runs while earlier objects are decoded
+  for (auto run = order.begin(); run != first_loose;) {
+    auto end = run + 1;
+    while (end != first_loose && end->pack == run->pack &&
+           end->offset - (end - 1)->offset <= prefetch_gap) {
+      ++end;
+    }
+    (*packs)[run->pack]->prefetch(run->offset,
+                                  (end - 1)->offset + prefetch_tail);
+    run = end;
+  }
+  for (auto it = order.begin(); it != first_loose; ++it) {
+    auto &slot = out[it->index];
+    slot.error =
+        (*packs)[it->pack]->read(it->offset, store.delta_cache(), slot.view);
+  }
+
+  std::span<const Location> rest(order);
+  rest = rest.subspan(static_cast<std::size_t>(first_loose - order.begin()));
+  auto read_range = [&](std::size_t begin, std::size_t end) {
+    for (std::size_t k = begin; k < end; ++k) {
+      auto &slot = out[rest[k].index];
+      slot.error = store.read_loose(ids[rest[k].index], slot.view);
+    }
+  };
+  if (pool != nullptr && rest.size() >= parallel_loose_min) {
+    pool->parallel_for(rest.size(), 16, read_range);
+  } else {
+    read_range(0, rest.size());
+  }
+}
+
+} // namespace chrona
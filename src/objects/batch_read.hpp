@@ -0,0 +1,27 @@
+#pragma once
+
+#include "errors/error.hpp"
+#include "objects/object.hpp"
+#include "objects/object_store.hpp"
+#include "parallel/work_pool.hpp"
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace chrona {
+
+struct BatchRead {
+  ObjectView view;
+  std::optional<Error> error; // NotFound for an id the store lacks
+};
+
+// Reads every object in `ids` into out[i], in whatever order suits the
+// storage rather than the order asked for. Packed objects are located up
+// front, grouped by pack and read in offset order, with each run of nearby
+// entries prefetched before its first read; loose objects follow in id
+// order, spread over `pool` when one is given. A failure only fills its
+// own slot, so one missing id does not stop the batch.
+void read_batch(const ObjectStore &store, std::span<const ObjectId> ids,
+                std::vector<BatchRead> &out, WorkPool *pool = nullptr);
+
+} // namespace chrona
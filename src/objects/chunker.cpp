@@ -0,0 +1,91 @@
+#include "chunker.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+
+namespace chrona {
+
+namespace {
+
+// 256 random 64-bit values, fixed forever: changing them would move every
+// chunk boundary and lose all deduplication against existing chunks
+constexpr std::array<std::uint64_t, 256> make_gear(int shift) {
+  std::array<std::uint64_t, 256> table{};
+  std::uint64_t state = 0x63687265636e6b73ULL; // "chrecnks"
+  for (auto &value : table) {
+    state += 0x9e3779b97f4a7c15ULL;
+    std::uint64_t z = state;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    value = (z ^ (z >> 31)) << shift;
+  }
+  return table;
+}
+
+constexpr auto gear = make_gear(0);
+constexpr auto gear_shifted = make_gear(1);
+
+// `bits` one bits just below the top bit, so that shifting the mask left
+// by one, as the two-byte step does, loses nothing
+constexpr std::uint64_t cut_mask(unsigned bits) {
+  return ((std::uint64_t(1) << bits) - 1) << (63 - bits);
+}
+
+} // namespace
+
+std::size_t next_chunk(std::string_view data, std::size_t average_size) {
+  const std::size_t min_size = average_size / 4;
+  const std::size_t max_size = average_size * 4;
+  std::size_t size = data.size();
+  if (size <= min_size) {
+    return size;
+  }
+  size = std::min(size, max_size);
+  const std::size_t normal = std::min(size, average_size);
+
+  const auto bits = static_cast<unsigned>(std::countr_zero(average_size));
+  const std::uint64_t strict = cut_mask(bits + 2);
+  const std::uint64_t loose = cut_mask(bits - 2);
+  const auto *src = reinterpret_cast<const std::uint8_t *>(data.data());
+
+  // Two bytes per step (FastCDC's "rolling two bytes"): the first byte is
+  // added pre-shifted and tested against the shifted mask, which finds the
+  // same cut points as one byte at a time with half the shifts. The hash
+  // is one long dependency chain, so this is what keeps the loop fast
+  // rather than SIMD.
+  std::uint64_t hash = 0;
+  std::size_t i = min_size;
+  for (; i + 2 <= normal; i += 2) {
+    hash = (hash << 2) + gear_shifted[src[i]];
+    if ((hash & (strict << 1)) == 0) {
+      return i + 1;
+    }
+    hash += gear[src[i + 1]];
+    if ((hash & strict) == 0) {
+      return i + 2;
+    }
+  }
+  for (; i + 2 <= size; i += 2) {
+    hash = (hash << 2) + gear_shifted[src[i]];
+    if ((hash & (loose << 1)) == 0) {
+      return i + 1;
+    }
+    hash += gear[src[i + 1]];
+    if ((hash & loose) == 0) {
+      return i + 2;
+    }
+  }
+  return size;
+}
+
+void split_chunks(std::string_view data, std::size_t average_size,
+                  std::vector<std::size_t> &lengths) {
+  lengths.clear();
+  while (!data.empty()) {
+    auto length = next_chunk(data, average_size);
+    lengths.push_back(length);
+    data.remove_prefix(length);
+  }
+}
+
+} // namespace chrona
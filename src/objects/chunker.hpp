@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace chrona {
+
+struct ChunkingOptions {
+  // Blobs at least this large are stored as chunks; 0 turns chunking off.
+  std::uint64_t min_blob_size = 0;
+  // Target chunk size, a power of two. Chunks are cut no shorter than a
+  // quarter of it and no longer than four times it.
+  std::size_t average_size = 64 * 1024;
+
+  std::size_t min_chunk() const { return average_size / 4; }
+  std::size_t max_chunk() const { return average_size * 4; }
+};
+
+// Content-defined chunking after FastCDC: a gear hash rolls over the
+// input and a cut is made where its top bits are zero, so an edit only
+// moves the boundaries next to it and every other chunk keeps its id.
+// Normalised chunking uses a stricter mask before the average size and a
+// looser one after it, which keeps chunk sizes close to the average.
+//
+// Returns the length of the chunk at the front of `data`.
+std::size_t next_chunk(std::string_view data, std::size_t average_size);
+
+// Lengths of all chunks of `data`, in order.
+void split_chunks(std::string_view data, std::size_t average_size,
+                  std::vector<std::size_t> &lengths);
+
+} // namespace chrona
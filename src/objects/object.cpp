@@ -0,0 +1,192 @@
+#include "object.hpp"
+#include "hash/sha256.hpp"
+#include "io/file_io.hpp"
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace chrona {
+
+namespace {
+
+constexpr std::size_t hash_chunk_size = 256 * 1024;
+
+int hex_value(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  return -1;
+}
+
+ObjectId to_object_id(const Sha256::Digest &digest) {
+  ObjectId id;
+  std::memcpy(id.bytes.data(), digest.data(), ObjectId::size);
+  return id;
+}
+
+} // namespace
+
+const char *object_type_name(ObjectType type) {
+  switch (type) {
+  case ObjectType::Blob:
+    return "blob";
+  case ObjectType::Tree:
+    return "tree";
+  case ObjectType::Commit:
+    return "commit";
+  }
+  return "unknown";
+}
+
+std::optional<ObjectType> parse_object_type(std::string_view name) {
+  if (name == "blob") {
+    return ObjectType::Blob;
+  }
+  if (name == "tree") {
+    return ObjectType::Tree;
+  }
+  if (name == "commit") {
+    return ObjectType::Commit;
+  }
+  return std::nullopt;
+}
+
+std::string ObjectId::hex() const {
+  static constexpr char digits[] = "0123456789abcdef";
+  std::string out(hex_size, '0');
+  for (std::size_t i = 0; i < size; ++i) {
+    out[i * 2] = digits[bytes[i] >> 4];
+    out[i * 2 + 1] = digits[bytes[i] & 0xf];
+  }
+  return out;
+}
+
+std::optional<ObjectId> ObjectId::from_hex(std::string_view hex) {
+  if (hex.size() != hex_size) {
+    return std::nullopt;
+  }
+  ObjectId id;
+  for (std::size_t i = 0; i < size; ++i) {
+    int hi = hex_value(hex[i * 2]);
+    int lo = hex_value(hex[i * 2 + 1]);
+    if (hi < 0 || lo < 0) {
+      return std::nullopt;
+    }
+    id.bytes[i] = static_cast<std::uint8_t>((hi << 4) | lo);
+  }
+  return id;
+}
+
+std::size_t ObjectIdHash::operator()(const ObjectId &id) const {
+  // The id is already a uniformly distributed hash
+  std::size_t value;
+  std::memcpy(&value, id.bytes.data(), sizeof(value));
+  return value;
+}
+
+std::string encode_object_header(ObjectType type, std::uint64_t size) {
+  std::string header = object_type_name(type);
+  header += ' ';
+  header += std::to_string(size);
+  header += '\0';
+  return header;
+}
+
+std::optional<Error> parse_object_header(std::string_view raw,
+                                         ObjectType &type, std::uint64_t &size,
+                                         std::size_t &header_length) {
+  // Headers are tiny; don't scan far into a corrupt object looking for NUL
+  auto limit = raw.substr(0, 32);
+  auto space = limit.find(' ');
+  auto nul = limit.find('\0');
+  if (space == std::string_view::npos || nul == std::string_view::npos ||
+      nul < space) {
+    return create_error(ErrorCode::CorruptObject, "Malformed object header");
+  }
+
+  auto parsed_type = parse_object_type(limit.substr(0, space));
+  if (!parsed_type) {
+    return create_error(ErrorCode::CorruptObject,
+                        "Unknown object type: " +
+                            std::string(limit.substr(0, space)));
+  }
+
+  auto digits = limit.substr(space + 1, nul - space - 1);
+  auto [end, ec] =
+      std::from_chars(digits.data(), digits.data() + digits.size(), size);
+  if (ec != std::errc() || end != digits.data() + digits.size() ||
+      digits.empty()) {
+    return create_error(ErrorCode::CorruptObject, "Malformed object size");
+  }
+
+  type = *parsed_type;
+  header_length = nul + 1;
+  return std::nullopt;
+}
+
+ObjectId hash_object(ObjectType type, std::string_view content) {
+  Sha256 hasher;
+  hasher.update(encode_object_header(type, content.size()));
+  hasher.update(content);
+  return to_object_id(hasher.finish());
+}
+
+std::optional<Error> hash_file(const std::filesystem::path &path,
+                               ObjectId &out) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return errno_error("Cannot open", path);
+  }
+
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    auto error = errno_error("Cannot stat", path);
+    ::close(fd);
+    return error;
+  }
+#ifdef POSIX_FADV_SEQUENTIAL
+  ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+  Sha256 hasher;
+  hasher.update(encode_object_header(ObjectType::Blob,
+                                     static_cast<std::uint64_t>(st.st_size)));
+
+  // One chunk buffer per thread, reused across files
+  thread_local std::unique_ptr<char[]> chunk(new char[hash_chunk_size]);
+  std::uint64_t remaining = static_cast<std::uint64_t>(st.st_size);
+  while (remaining > 0) {
+    ssize_t n = ::read(fd, chunk.get(), hash_chunk_size);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      auto error = errno_error("Cannot read", path);
+      ::close(fd);
+      return error;
+    }
+    if (n == 0) {
+      break;
+    }
+    auto length = std::min<std::uint64_t>(static_cast<std::uint64_t>(n),
+                                          remaining);
+    hasher.update(chunk.get(), static_cast<std::size_t>(length));
+    remaining -= length;
+  }
+  ::close(fd);
+
+  if (remaining != 0) {
+    return create_error(ErrorCode::IOError,
+                        "File changed size while hashing: " + path.string());
+  }
+  out = to_object_id(hasher.finish());
+  return std::nullopt;
+}
+
+} // namespace chrona
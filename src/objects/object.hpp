@@ -0,0 +1,74 @@
+#pragma once
+
+#include "errors/error.hpp"
+#include <array>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace chrona {
+
+enum class ObjectType : std::uint8_t {
+  Blob = 1,
+  Tree = 2,
+  Commit = 3,
+};
+
+const char *object_type_name(ObjectType type);
+std::optional<ObjectType> parse_object_type(std::string_view name);
+
+// SHA-256 of the canonical encoding "<type> <size>\0<content>".
+struct ObjectId {
+  static constexpr std::size_t size = 32;
+  static constexpr std::size_t hex_size = size * 2;
+
+  std::array<std::uint8_t, size> bytes{};
+
+  std::string hex() const;
+  static std::optional<ObjectId> from_hex(std::string_view hex);
+
+  auto operator<=>(const ObjectId &) const = default;
+};
+
+struct ObjectIdHash {
+  std::size_t operator()(const ObjectId &id) const;
+};
+
+// A read-only object whose content points straight into the backing storage
+// (an mmapped loose file or pack). Copies share the same mapping.
+class ObjectView {
+public:
+  ObjectView() = default;
+  ObjectView(ObjectType type, std::string_view content,
+             std::shared_ptr<const void> storage)
+      : type_(type), content_(content), storage_(std::move(storage)) {}
+
+  ObjectType type() const { return type_; }
+  std::uint64_t size() const { return content_.size(); }
+  std::string_view content() const { return content_; }
+
+private:
+  ObjectType type_ = ObjectType::Blob;
+  std::string_view content_;
+  std::shared_ptr<const void> storage_;
+};
+
+std::string encode_object_header(ObjectType type, std::uint64_t size);
+
+// Parses the header at the start of `raw`; header_length includes the NUL.
+std::optional<Error> parse_object_header(std::string_view raw,
+                                         ObjectType &type, std::uint64_t &size,
+                                         std::size_t &header_length);
+
+ObjectId hash_object(ObjectType type, std::string_view content);
+
+// Hashes a file as a blob, streaming it through a fixed-size chunk buffer.
+std::optional<Error> hash_file(const std::filesystem::path &path,
+                               ObjectId &out);
+
+} // namespace chrona
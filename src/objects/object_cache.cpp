@@ -0,0 +1,237 @@
+#include "objects/object_cache.hpp"
+#include "trace/trace.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+namespace chrona {
+
+namespace {
+
+// A shard sizes its table for entries of about this many bytes; a
+// typical tree or commit is smaller, so the byte budget binds first.
+constexpr std::size_t expected_entry_size = 512;
+constexpr std::size_t min_slots = 64;
+
+} // namespace
+
+ObjectCache::ObjectCache(std::size_t max_bytes)
+    : max_bytes_(max_bytes), shard_budget_(max_bytes / shard_count),
+      shards_(std::make_unique<Shard[]>(shard_count)) {
+  auto slots = std::bit_ceil(
+      std::max(min_slots, shard_budget_ / expected_entry_size));
+  slot_mask_ = slots - 1;
+  for (std::size_t i = 0; i < shard_count; ++i) {
+    shards_[i].slots = std::make_unique<Slot[]>(slots);
+  }
+}
+
+ObjectCache::~ObjectCache() {
+  for (std::size_t i = 0; i < shard_count; ++i) {
+    auto &shard = shards_[i];
+    for (std::size_t slot = 0; slot <= slot_mask_; ++slot) {
+      if (auto *entry = shard.slots[slot].load(std::memory_order_relaxed)) {
+        release(entry);
+      }
+    }
+    for (auto *entry : shard.retired) {
+      release(entry);
+    }
+    for (auto *entry : shard.draining) {
+      release(entry);
+    }
+  }
+}
+
+void ObjectCache::release(Entry *entry) {
+  // Views handed out may still hold the entry; the last one frees it.
+  auto self = std::move(entry->self);
+}
+
+std::size_t ObjectCache::entry_cost(const Entry &entry) {
+  return sizeof(Entry) + entry.content.size();
+}
+
+ObjectCache::Shard &ObjectCache::shard_for(const ObjectId &id) {
+  return shards_[id.bytes[0] % shard_count];
+}
+
+std::size_t ObjectCache::home_slot(const ObjectId &id) const {
+  // Ids are SHA-256 digests, so any bytes not used to pick the shard are
+  // already uniformly spread.
+  std::uint64_t bits;
+  std::memcpy(&bits, id.bytes.data() + 8, sizeof(bits));
+  return static_cast<std::size_t>(bits) & slot_mask_;
+}
+
+bool ObjectCache::get(const ObjectId &id, ObjectView &out) {
+  auto &shard = shard_for(id);
+  // Enter the current epoch. If it moved on meanwhile, the writer may
+  // have checked the old count already, so announce again in the new one.
+  std::uint64_t epoch;
+  for (;;) {
+    epoch = shard.epoch.load();
+    shard.readers[epoch & 1].fetch_add(1);
+    if (shard.epoch.load() == epoch) {
+      break;
+    }
+    shard.readers[epoch & 1].fetch_sub(1);
+  }
+
+  bool found = false;
+  auto home = home_slot(id);
+  for (std::size_t k = 0; k < probe_window; ++k) {
+    const auto *entry =
+        shard.slots[(home + k) & slot_mask_].load(std::memory_order_acquire);
+    if (entry && entry->id == id) {
+      // Only store when the bit is clear, so a hot entry's cache line is
+      // not written on every hit.
+      if (!entry->referenced.load(std::memory_order_relaxed)) {
+        entry->referenced.store(true, std::memory_order_relaxed);
+      }
+      out = ObjectView(entry->type, entry->content, entry->self);
+      found = true;
+      break;
+    }
+  }
+  shard.readers[epoch & 1].fetch_sub(1, std::memory_order_release);
+
+  if (found) {
+    shard.hits.fetch_add(1, std::memory_order_relaxed);
+    trace_count(TraceCounter::ObjectCacheHits);
+  } else {
+    shard.misses.fetch_add(1, std::memory_order_relaxed);
+    trace_count(TraceCounter::ObjectCacheMisses);
+  }
+  return found;
+}
+
+void ObjectCache::put(const ObjectId &id, const ObjectView &view) {
+  if (sizeof(Entry) + view.size() > shard_budget_) {
+    return;
+  }
+  auto &shard = shard_for(id);
+  auto home = home_slot(id);
+  std::lock_guard lock(shard.write_mutex);
+
+  std::size_t target = SIZE_MAX;
+  for (std::size_t k = 0; k < probe_window; ++k) {
+    auto slot = (home + k) & slot_mask_;
+    const auto *entry = shard.slots[slot].load(std::memory_order_relaxed);
+    if (!entry) {
+      if (target == SIZE_MAX) {
+        target = slot;
+      }
+    } else if (entry->id == id) {
+      return;
+    }
+  }
+  if (target == SIZE_MAX) {
+    // The window is full: give each entry in it a second chance, and take
+    // the last one looked at if readers keep marking them all.
+    for (std::size_t k = 0; k < 2 * probe_window; ++k) {
+      target = (home + k) & slot_mask_;
+      const auto *entry = shard.slots[target].load(std::memory_order_relaxed);
+      if (!entry->referenced.exchange(false, std::memory_order_relaxed)) {
+        break;
+      }
+    }
+    evict(shard, target);
+  }
+
+  auto entry = std::make_shared<Entry>();
+  entry->id = id;
+  entry->type = view.type();
+  entry->content = view.content();
+  entry->self = entry;
+  shard.bytes.fetch_add(entry_cost(*entry), std::memory_order_relaxed);
+  shard.slots[target].store(entry.get(), std::memory_order_release);
+  enforce_budget(shard, target);
+  reclaim(shard);
+}
+
+void ObjectCache::evict(Shard &shard, std::size_t slot) {
+  if (auto *entry = shard.slots[slot].exchange(nullptr)) {
+    shard.bytes.fetch_sub(entry_cost(*entry), std::memory_order_relaxed);
+    shard.evictions.fetch_add(1, std::memory_order_relaxed);
+    shard.retired.push_back(entry);
+  }
+}
+
+void ObjectCache::reclaim(Shard &shard) {
+  // Entries unlinked in the epoch before can only be seen by readers that
+  // entered it or earlier. Once its count drains they are released, the
+  // current ones start draining and new readers count in the free parity.
+  // With readers still inside, this just waits for a later put().
+  if (shard.retired.empty() && shard.draining.empty()) {
+    return;
+  }
+  auto epoch = shard.epoch.load();
+  if (shard.readers[(epoch + 1) & 1].load() != 0) {
+    return;
+  }
+  for (auto *entry : shard.draining) {
+    release(entry);
+  }
+  shard.draining.clear();
+  std::swap(shard.draining, shard.retired);
+  shard.epoch.store(epoch + 1);
+}
+
+void ObjectCache::enforce_budget(Shard &shard, std::size_t keep) {
+  // Two sweeps clear every bit set before the first began; after that the
+  // hand evicts whatever it reaches, so the loop ends even under a storm
+  // of concurrent hits.
+  const auto patience = 2 * (slot_mask_ + 1);
+  for (std::size_t steps = 0;
+       shard.bytes.load(std::memory_order_relaxed) > shard_budget_;
+       ++steps) {
+    auto slot = shard.hand++ & slot_mask_;
+    if (slot == keep) {
+      continue;
+    }
+    const auto *entry = shard.slots[slot].load(std::memory_order_relaxed);
+    if (!entry) {
+      continue;
+    }
+    if (steps < patience &&
+        entry->referenced.exchange(false, std::memory_order_relaxed)) {
+      continue;
+    }
+    evict(shard, slot);
+  }
+}
+
+std::uint64_t ObjectCache::hits() const {
+  std::uint64_t total = 0;
+  for (std::size_t i = 0; i < shard_count; ++i) {
+    total += shards_[i].hits.load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+std::uint64_t ObjectCache::misses() const {
+  std::uint64_t total = 0;
+  for (std::size_t i = 0; i < shard_count; ++i) {
+    total += shards_[i].misses.load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+std::uint64_t ObjectCache::evictions() const {
+  std::uint64_t total = 0;
+  for (std::size_t i = 0; i < shard_count; ++i) {
+    total += shards_[i].evictions.load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+std::size_t ObjectCache::bytes() const {
+  std::size_t total = 0;
+  for (std::size_t i = 0; i < shard_count; ++i) {
+    total += shards_[i].bytes.load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+} // namespace chrona
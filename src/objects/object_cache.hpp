@@ -0,0 +1,99 @@
+#pragma once
+
+#include "objects/object.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace chrona {
+
+// Process-wide cache of object contents keyed by id, shared by
+// every thread reading through one ObjectStore. Meant for the trees and
+// commits that parallel status, diff, checkout and gc all read again and
+// again, not for blobs.
+//
+// Ids are split across 64 shards by their first byte. A shard is a fixed
+// open-addressed table of atomic entry pointers. get() takes no lock: it
+// announces itself in the shard's reader count for the current epoch,
+// probes a short window of slots and takes a reference to the entry it
+// finds. put() takes the shard's mutex and evicts with CLOCK (second
+// chance): a hit sets the entry's referenced bit, and the hand clears
+// bits until it finds an entry nobody used since its last pass. Evicted
+// entries are unlinked at once but only released after the epoch moves
+// on and every reader that entered before has left (RCU-style), and a
+// view handed out earlier keeps its entry alive for as long as it needs.
+class ObjectCache {
+public:
+  static constexpr std::size_t shard_count = 64;
+  // Slots in the window an id may occupy, starting at its home slot.
+  static constexpr std::size_t probe_window = 8;
+
+  explicit ObjectCache(std::size_t max_bytes = 64 << 20);
+  ~ObjectCache();
+
+  ObjectCache(const ObjectCache &) = delete;
+  ObjectCache &operator=(const ObjectCache &) = delete;
+
+  // On a hit the view owns a reference to the cached copy.
+  bool get(const ObjectId &id, ObjectView &out);
+  // Copies the content, so `view` may point into a mapping about to go
+  // away. Objects larger than a shard's share of the budget are skipped.
+  void put(const ObjectId &id, const ObjectView &view);
+
+  std::uint64_t hits() const;
+  std::uint64_t misses() const;
+  std::uint64_t evictions() const;
+  // Bytes held, counting each entry's content and bookkeeping.
+  std::size_t bytes() const;
+  std::size_t max_bytes() const { return max_bytes_; }
+
+private:
+  struct Entry {
+    ObjectId id;
+    ObjectType type;
+    std::string content;
+    mutable std::atomic<bool> referenced{false};
+    // The cache's own reference, copied into every view handed out and
+    // dropped once the entry is evicted and no reader can still reach it.
+    std::shared_ptr<const Entry> self;
+  };
+  using Slot = std::atomic<Entry *>;
+
+  // Padded so that shards written by different threads never share a
+  // cache line.
+  struct alignas(64) Shard {
+    std::unique_ptr<Slot[]> slots;
+    std::atomic<std::uint64_t> hits{0};
+    std::atomic<std::uint64_t> misses{0};
+    std::atomic<std::uint64_t> evictions{0};
+    std::atomic<std::size_t> bytes{0};
+    std::atomic<std::uint64_t> epoch{0};
+    // Readers inside get(), by the parity of the epoch they entered in.
+    std::atomic<std::uint32_t> readers[2] = {0, 0};
+    std::mutex write_mutex;
+    // Guarded by write_mutex
+    std::size_t hand = 0;
+    std::vector<Entry *> retired;  // unlinked in the current epoch
+    std::vector<Entry *> draining; // unlinked in the epoch before
+  };
+
+  static std::size_t entry_cost(const Entry &entry);
+  Shard &shard_for(const ObjectId &id);
+  std::size_t home_slot(const ObjectId &id) const;
+  // These run under the shard's write mutex.
+  void evict(Shard &shard, std::size_t slot);
+  void enforce_budget(Shard &shard, std::size_t keep);
+  void reclaim(Shard &shard);
+  static void release(Entry *entry);
+
+  std::size_t max_bytes_;
+  std::size_t shard_budget_;
+  std::size_t slot_mask_;
+  std::unique_ptr<Shard[]> shards_;
+};
+
+} // namespace chrona
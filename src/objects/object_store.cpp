@@ -0,0 +1,775 @@
+#include "object_store.hpp"
+#include "hash/sha256.hpp"
+#include "io/mapped_file.hpp"
+#include "objects/object_cache.hpp"
+#include "pack/varint.hpp"
+#include "pack/pack.hpp"
+#include "trace/trace.hpp"
+#include <dirent.h>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <set>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace chrona {
+
+namespace {
+
+constexpr std::size_t copy_chunk_size = 256 * 1024;
+// Smaller objects are stored as-is: the stream framing would eat the gain
+constexpr std::uint64_t min_compress_size = 64;
+constexpr char compressed_marker = '\0';
+constexpr char chunked_marker = '\1';
+
+enum class LooseForm { Plain, Compressed, Chunked };
+
+// Splits a loose object file into its header fields and body
+std::optional<Error> parse_loose(const ObjectId &id, std::string_view file,
+                                 ObjectType &type, std::uint64_t &size,
+                                 std::string_view &body, LooseForm &form) {
+  form = LooseForm::Plain;
+  if (!file.empty() && file.front() == compressed_marker) {
+    form = LooseForm::Compressed;
+  } else if (!file.empty() && file.front() == chunked_marker) {
+    form = LooseForm::Chunked;
+  }
+  if (form != LooseForm::Plain) {
+    file.remove_prefix(1);
+  }
+  std::size_t header_length;
+  if (auto error = parse_object_header(file, type, size, header_length)) {
+    return create_error(ErrorCode::CorruptObject,
+                        "Corrupt object " + id.hex() + ": " + error->message);
+  }
+  body = file.substr(header_length);
+  if (form == LooseForm::Plain && size != body.size()) {
+    return create_error(ErrorCode::CorruptObject,
+                        "Corrupt object " + id.hex() + ": size mismatch");
+  }
+  return std::nullopt;
+}
+
+std::optional<Error> parse_chunk_list(const ObjectId &id, std::string_view body,
+                                      std::uint64_t size,
+                                      std::vector<ChunkRef> &out) {
+  out.clear();
+  std::uint64_t total = 0;
+  while (!body.empty()) {
+    ChunkRef chunk;
+    if (!read_varint(body, chunk.size) || chunk.size == 0 ||
+        body.size() < ObjectId::size) {
+      out.clear();
+      return create_error(ErrorCode::CorruptObject,
+                          "Corrupt chunk list " + id.hex());
+    }
+    std::memcpy(chunk.id.bytes.data(), body.data(), ObjectId::size);
+    body.remove_prefix(ObjectId::size);
+    total += chunk.size;
+    out.push_back(chunk);
+  }
+  if (total != size) {
+    out.clear();
+    return create_error(ErrorCode::CorruptObject,
+                        "Corrupt chunk list " + id.hex() + ": size mismatch");
+  }
+  return std::nullopt;
+}
+
+// Writes a staged object's header and content, compressing the content on
+// the way through when the store asks for it
+class BodyWriter {
+public:
+  BodyWriter(TempFile &file, const CompressionOptions &options,
+             std::uint64_t size)
+      : file_(file), compressor_(options),
+        compress_(options.codec != Codec::None && size >= min_compress_size) {
+  }
+
+  std::optional<Error> start(std::string_view header) {
+    if (!compress_) {
+      return file_.write(header);
+    }
+    buffer_ += compressed_marker;
+    buffer_.append(header);
+    return std::nullopt;
+  }
+
+  std::optional<Error> write(std::string_view data) {
+    if (!compress_) {
+      return file_.write(data);
+    }
+    while (!data.empty()) {
+      auto piece = data.substr(0, copy_chunk_size);
+      data.remove_prefix(piece.size());
+      compressor_.update(piece, buffer_);
+      if (buffer_.size() >= copy_chunk_size) {
+        if (auto error = flush()) {
+          return error;
+        }
+      }
+    }
+    return std::nullopt;
+  }
+
+  std::optional<Error> finish() {
+    if (!compress_) {
+      return std::nullopt;
+    }
+    compressor_.finish(buffer_);
+    return flush();
+  }
+
+private:
+  std::optional<Error> flush() {
+    auto error = file_.write(buffer_);
+    buffer_.clear();
+    return error;
+  }
+
+  TempFile &file_;
+  Compressor compressor_;
+  bool compress_;
+  std::string buffer_;
+};
+
+// One write with O_APPEND, so concurrent batches never interleave ids
+std::optional<Error> append_chunked_ids(const std::filesystem::path &path,
+                                        std::string_view ids, bool durable) {
+  int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                  0644);
+  if (fd < 0) {
+    return errno_error("Cannot open", path);
+  }
+  std::optional<Error> error;
+  ssize_t n = ::write(fd, ids.data(), ids.size());
+  if (n != static_cast<ssize_t>(ids.size())) {
+    error = errno_error("Cannot write", path);
+  } else if (durable && ::fsync(fd) != 0) {
+    error = errno_error("Cannot sync", path);
+  }
+  ::close(fd);
+  return error;
+}
+
+} // namespace
+
+ObjectStore::ObjectStore(std::filesystem::path objects_dir)
+    : root_(std::move(objects_dir)),
+      delta_cache_(std::make_unique<DeltaBaseCache>()),
+      object_cache_(std::make_unique<ObjectCache>()) {}
+
+ObjectStore::~ObjectStore() = default;
+
+std::filesystem::path ObjectStore::shard_path(const ObjectId &id) const {
+  return root_ / id.hex().substr(0, 2);
+}
+
+std::filesystem::path ObjectStore::object_path(const ObjectId &id) const {
+  auto hex = id.hex();
+  return root_ / hex.substr(0, 2) / hex.substr(2);
+}
+
+bool ObjectStore::contains(const ObjectId &id) const {
+  for (const auto &pack : *packs()) {
+    if (pack->find(id)) {
+      return true;
+    }
+  }
+  return contains_loose(id);
+}
+
+bool ObjectStore::contains_loose(const ObjectId &id) const {
+  struct stat st;
+  return ::stat(object_path(id).c_str(), &st) == 0;
+}
+
+bool ObjectStore::freshen(const ObjectId &id) const {
+  if (::utimensat(AT_FDCWD, object_path(id).c_str(), nullptr, 0) == 0) {
+    return true;
+  }
+  for (const auto &pack : *packs()) {
+    if (pack->find(id)) {
+      ::utimensat(AT_FDCWD, pack->path().c_str(), nullptr, 0);
+      return true;
+    }
+  }
+  return false;
+}
+
+std::optional<Error> ObjectStore::read(const ObjectId &id,
+                                       ObjectView &out) const {
+  trace_count(TraceCounter::ObjectsRead);
+  if (object_cache_->get(id, out)) {
+    return std::nullopt;
+  }
+  std::optional<Error> error;
+  bool found = false;
+  for (const auto &pack : *packs()) {
+    if (auto offset = pack->find(id)) {
+      error = pack->read(*offset, *delta_cache_, out);
+      found = true;
+      break;
+    }
+  }
+  if (!found) {
+    error = read_loose(id, out);
+  }
+  if (!error && out.type() != ObjectType::Blob) {
+    object_cache_->put(id, out);
+  }
+  return error;
+}
+
+std::optional<Error> ObjectStore::read_loose(const ObjectId &id,
+                                             ObjectView &out) const {
+  auto mapped = std::make_shared<MappedFile>();
+  if (auto error = MappedFile::open(object_path(id), *mapped)) {
+    if (error->error_code == ErrorCode::NotFound) {
+      return create_error(ErrorCode::NotFound, "Object not found: " + id.hex());
+    }
+    return error;
+  }
+
+  ObjectType type;
+  std::uint64_t size;
+  std::string_view body;
+  LooseForm form;
+  if (auto error = parse_loose(id, mapped->view(), type, size, body, form)) {
+    return error;
+  }
+  if (form == LooseForm::Plain) {
+    out = ObjectView(type, body, std::move(mapped));
+    return std::nullopt;
+  }
+
+  auto content = std::make_shared<std::string>();
+  if (form == LooseForm::Chunked) {
+    // The header size is trusted for the reserve only once the list adds
+    // up to it
+    std::vector<ChunkRef> chunks;
+    if (auto error = parse_chunk_list(id, body, size, chunks)) {
+      return error;
+    }
+    content->reserve(size);
+    if (auto error = read_stream(
+            id, [](ObjectType, std::uint64_t) { return std::nullopt; },
+            [&](std::string_view data) {
+              content->append(data);
+              return std::optional<Error>();
+            })) {
+      return error;
+    }
+  } else if (auto error = decompress(body, size, *content)) {
+    return create_error(ErrorCode::CorruptObject,
+                        "Corrupt object " + id.hex() + ": " + error->message);
+  }
+  std::shared_ptr<const std::string> shared = std::move(content);
+  out = ObjectView(type, *shared, shared);
+  return std::nullopt;
+}
+
+std::optional<Error> ObjectStore::read_stream(const ObjectId &id,
+                                              const ObjectBegin &begin,
+                                              const ChunkSink &chunk) const {
+  auto whole = [&](const ObjectView &view) -> std::optional<Error> {
+    if (auto error = begin(view.type(), view.size())) {
+      return error;
+    }
+    return chunk(view.content());
+  };
+  trace_count(TraceCounter::ObjectsRead);
+  for (const auto &pack : *packs()) {
+    if (auto offset = pack->find(id)) {
+      ObjectView view;
+      if (auto error = pack->read(*offset, *delta_cache_, view)) {
+        return error;
+      }
+      return whole(view);
+    }
+  }
+
+  MappedFile mapped;
+  if (auto error = MappedFile::open(object_path(id), mapped)) {
+    if (error->error_code == ErrorCode::NotFound) {
+      return create_error(ErrorCode::NotFound, "Object not found: " + id.hex());
+    }
+    return error;
+  }
+  ObjectType type;
+  std::uint64_t size;
+  std::string_view body;
+  LooseForm form;
+  if (auto error = parse_loose(id, mapped.view(), type, size, body, form)) {
+    return error;
+  }
+  std::vector<ChunkRef> chunks;
+  if (form == LooseForm::Chunked) {
+    if (auto error = parse_chunk_list(id, body, size, chunks)) {
+      return error;
+    }
+  }
+  if (auto error = begin(type, size)) {
+    return error;
+  }
+  if (form == LooseForm::Plain) {
+    return chunk(body);
+  }
+  if (form == LooseForm::Chunked) {
+    // Each chunk streams in turn, so a huge blob is reassembled with one
+    // chunk in memory at a time
+    for (const auto &ref : chunks) {
+      auto error = read_stream(
+          ref.id,
+          [&](ObjectType chunk_type, std::uint64_t chunk_size) {
+            if (chunk_type != ObjectType::Blob || chunk_size != ref.size) {
+              return create_error(ErrorCode::CorruptObject,
+                                  "Chunk " + ref.id.hex() + " of " +
+                                      id.hex() + " does not match its list");
+            }
+            return std::optional<Error>();
+          },
+          chunk);
+      if (error) {
+        return error;
+      }
+    }
+    return std::nullopt;
+  }
+
+  std::uint64_t produced = 0;
+  std::optional<Error> sink_error;
+  auto error = decompress(body, [&](std::string_view data) {
+    produced += data.size();
+    if (produced > size) {
+      return create_error(ErrorCode::CorruptObject, "size mismatch");
+    }
+    sink_error = chunk(data);
+    return sink_error;
+  });
+  if (sink_error) {
+    return sink_error;
+  }
+  if (!error && (produced != size || !body.empty())) {
+    error = create_error(ErrorCode::CorruptObject, "size mismatch");
+  }
+  if (error) {
+    return create_error(ErrorCode::CorruptObject,
+                        "Corrupt object " + id.hex() + ": " + error->message);
+  }
+  return std::nullopt;
+}
+
+void ObjectStore::for_each_loose(
+    const std::function<void(const ObjectId &)> &fn) const {
+  static constexpr char digits[] = "0123456789abcdef";
+  for (int shard = 0; shard < 256; ++shard) {
+    std::string prefix = {digits[shard >> 4], digits[shard & 0xf]};
+    DIR *dir = ::opendir((root_ / prefix).c_str());
+    if (dir == nullptr) {
+      continue;
+    }
+    while (auto *entry = ::readdir(dir)) {
+      // Skips ".", ".." and in-flight ".tmp-*" files
+      if (auto id = ObjectId::from_hex(prefix + entry->d_name)) {
+        fn(*id);
+      }
+    }
+    ::closedir(dir);
+  }
+}
+
+std::optional<Error>
+ObjectStore::read_chunk_list(const ObjectId &id,
+                             std::vector<ChunkRef> &out) const {
+  out.clear();
+  MappedFile mapped;
+  if (auto error = MappedFile::open(object_path(id), mapped)) {
+    if (error->error_code == ErrorCode::NotFound) {
+      return create_error(ErrorCode::NotFound, "Object not found: " + id.hex());
+    }
+    return error;
+  }
+  ObjectType type;
+  std::uint64_t size;
+  std::string_view body;
+  LooseForm form;
+  if (auto error = parse_loose(id, mapped.view(), type, size, body, form)) {
+    return error;
+  }
+  if (form != LooseForm::Chunked) {
+    return std::nullopt;
+  }
+  return parse_chunk_list(id, body, size, out);
+}
+
+std::shared_ptr<const PackList> ObjectStore::packs() const {
+  std::lock_guard lock(packs_mutex_);
+  if (!packs_) {
+    // An unreadable pack directory just means no packs
+    if (load_packs(packs_)) {
+      packs_ = std::make_shared<const PackList>();
+    }
+  }
+  return packs_;
+}
+
+std::optional<Error> ObjectStore::reload_packs() {
+  std::shared_ptr<const PackList> fresh;
+  if (auto error = load_packs(fresh)) {
+    return error;
+  }
+  std::lock_guard lock(packs_mutex_);
+  packs_ = std::move(fresh);
+  return std::nullopt;
+}
+
+std::optional<Error>
+ObjectStore::load_packs(std::shared_ptr<const PackList> &out) const {
+  auto list = std::make_shared<PackList>();
+  std::error_code ec;
+  for (const auto &entry :
+       std::filesystem::directory_iterator(pack_dir(), ec)) {
+    const auto &path = entry.path();
+    if (path.extension() != ".pack") {
+      continue;
+    }
+    // A pack is only published once its index exists
+    auto index = path;
+    index.replace_extension(".idx");
+    if (!std::filesystem::exists(index)) {
+      continue;
+    }
+    std::shared_ptr<PackFile> pack;
+    if (auto error = PackFile::open(path, pack)) {
+      return error;
+    }
+    list->push_back(std::move(pack));
+  }
+  out = std::move(list);
+  return std::nullopt;
+}
+
+std::optional<Error> ObjectStore::write(ObjectType type,
+                                        std::string_view content,
+                                        ObjectId &out) {
+  ObjectBatch batch(*this);
+  if (auto error = batch.add(type, content, out)) {
+    return error;
+  }
+  return batch.commit();
+}
+
+std::optional<Error>
+ObjectStore::write_file(const std::filesystem::path &path, ObjectId &out) {
+  ObjectBatch batch(*this);
+  if (auto error = batch.add_file(path, out)) {
+    return error;
+  }
+  return batch.commit();
+}
+
+std::optional<Error> ObjectStore::ensure_shard(const ObjectId &id) const {
+  auto &ready = shard_ready_[id.bytes[0]];
+  if (ready.load(std::memory_order_acquire)) {
+    return std::nullopt;
+  }
+  auto shard = shard_path(id);
+  if (::mkdir(shard.c_str(), 0755) != 0 && errno != EEXIST) {
+    return errno_error("Cannot create object shard", shard);
+  }
+  ready.store(true, std::memory_order_release);
+  return std::nullopt;
+}
+
+ObjectBatch::ObjectBatch(ObjectStore &store, bool durable)
+    : store_(store), durable_(durable) {}
+
+// Reusing an existing object counts as writing it: a gc that started
+// earlier must not prune it from under the caller
+bool ObjectBatch::already_stored(const ObjectId &id) {
+  return staged_.count(id) > 0 || store_.freshen(id);
+}
+
+std::optional<Error> ObjectBatch::finish_staging(const ObjectId &id,
+                                                 TempFile &file) {
+  if (durable_) {
+    if (auto error = file.sync()) {
+      return error;
+    }
+  }
+  // Large batches would otherwise run out of descriptors
+  if (auto error = file.close()) {
+    return error;
+  }
+  staged_.insert(id);
+  pending_.push_back(Pending{id, std::move(file)});
+  return std::nullopt;
+}
+
+std::optional<Error> ObjectBatch::add(ObjectType type,
+                                      std::string_view content,
+                                      ObjectId &out) {
+  out = hash_object(type, content);
+  if (already_stored(out)) {
+    return std::nullopt;
+  }
+  const auto &chunking = store_.chunking();
+  if (type == ObjectType::Blob && chunking.min_blob_size > 0 &&
+      content.size() >= chunking.min_blob_size) {
+    return add_chunked(content, out, {});
+  }
+  return add_whole(type, content, out);
+}
+
+std::optional<Error> ObjectBatch::add_whole(ObjectType type,
+                                            std::string_view content,
+                                            const ObjectId &id) {
+  if (auto error = store_.ensure_shard(id)) {
+    return error;
+  }
+  TempFile file;
+  if (auto error = TempFile::create(store_.shard_path(id), file)) {
+    return error;
+  }
+  BodyWriter writer(file, store_.compression(), content.size());
+  if (auto error = writer.start(encode_object_header(type, content.size()))) {
+    return error;
+  }
+  if (auto error = writer.write(content)) {
+    return error;
+  }
+  if (auto error = writer.finish()) {
+    return error;
+  }
+  return finish_staging(id, file);
+}
+
+std::optional<Error>
+ObjectBatch::add_chunked(std::string_view content, const ObjectId &id,
+                         const std::filesystem::path &source) {
+  CHRONA_TRACE_SCOPE("objects.add_chunked");
+  auto header = encode_object_header(ObjectType::Blob, content.size());
+  Sha256 hasher;
+  hasher.update(header);
+
+  std::string list;
+  list += chunked_marker;
+  list += header;
+  const auto average = store_.chunking().average_size;
+  for (auto rest = content; !rest.empty();) {
+    auto piece = rest.substr(0, next_chunk(rest, average));
+    rest.remove_prefix(piece.size());
+    hasher.update(piece);
+    // Chunks are stored whole: they are always below the chunking size
+    ObjectId chunk_id = hash_object(ObjectType::Blob, piece);
+    if (!already_stored(chunk_id)) {
+      if (auto error = add_whole(ObjectType::Blob, piece, chunk_id)) {
+        return error;
+      }
+    }
+    append_varint(list, piece.size());
+    list.append(reinterpret_cast<const char *>(chunk_id.bytes.data()),
+                ObjectId::size);
+  }
+  auto digest = hasher.finish();
+  if (std::memcmp(digest.data(), id.bytes.data(), ObjectId::size) != 0) {
+    return create_error(ErrorCode::IOError,
+                        "File changed while being stored: " + source.string());
+  }
+  // Staged after its chunks, so commit() never publishes a list whose
+  // chunks are missing
+  return stage_chunk_list(id, list);
+}
+
+std::optional<Error>
+ObjectBatch::add_chunk_list(const ObjectId &id,
+                            const std::vector<ChunkRef> &chunks) {
+  CHRONA_TRACE_SCOPE("objects.add_chunk_list");
+  if (already_stored(id)) {
+    return std::nullopt;
+  }
+  std::uint64_t size = 0;
+  for (const auto &chunk : chunks) {
+    size += chunk.size;
+  }
+  auto header = encode_object_header(ObjectType::Blob, size);
+  Sha256 hasher;
+  hasher.update(header);
+
+  std::string list;
+  list += chunked_marker;
+  list += header;
+  // Only one chunk is held at a time
+  for (const auto &chunk : chunks) {
+    ObjectView view;
+    if (auto error = store_.read(chunk.id, view)) {
+      return error;
+    }
+    if (view.type() != ObjectType::Blob ||
+        view.content().size() != chunk.size || chunk.size == 0) {
+      return create_error(ErrorCode::CorruptObject,
+                          "Chunk " + chunk.id.hex() + " of " + id.hex() +
+                              " does not match its list");
+    }
+    hasher.update(view.content());
+    append_varint(list, chunk.size);
+    list.append(reinterpret_cast<const char *>(chunk.id.bytes.data()),
+                ObjectId::size);
+  }
+  auto digest = hasher.finish();
+  if (chunks.empty() ||
+      std::memcmp(digest.data(), id.bytes.data(), ObjectId::size) != 0) {
+    return create_error(ErrorCode::CorruptObject,
+                        "Chunks do not add up to object " + id.hex());
+  }
+  return stage_chunk_list(id, list);
+}
+
+std::optional<Error> ObjectBatch::stage_chunk_list(const ObjectId &id,
+                                                   std::string_view list) {
+  if (auto error = store_.ensure_shard(id)) {
+    return error;
+  }
+  TempFile file;
+  if (auto error = TempFile::create(store_.shard_path(id), file)) {
+    return error;
+  }
+  if (auto error = file.write(list)) {
+    return error;
+  }
+  chunked_.push_back(id);
+  return finish_staging(id, file);
+}
+
+std::optional<Error> ObjectBatch::add_file(const std::filesystem::path &path,
+                                           ObjectId &out) {
+  // Hash first so unchanged content never costs a write
+  if (auto error = hash_file(path, out)) {
+    return error;
+  }
+  if (already_stored(out)) {
+    return std::nullopt;
+  }
+  const auto &chunking = store_.chunking();
+  if (chunking.min_blob_size > 0) {
+    struct stat st;
+    if (::stat(path.c_str(), &st) == 0 &&
+        static_cast<std::uint64_t>(st.st_size) >= chunking.min_blob_size) {
+      // Chunking needs to look back and forth, so the file is mapped;
+      // the chunker rehashes it to catch changes since hash_file
+      MappedFile mapped;
+      if (auto error = MappedFile::open(path, mapped)) {
+        return error;
+      }
+      return add_chunked(mapped.view(), out, path);
+    }
+  }
+
+  if (auto error = store_.ensure_shard(out)) {
+    return error;
+  }
+  TempFile file;
+  if (auto error = TempFile::create(store_.shard_path(out), file)) {
+    return error;
+  }
+
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return errno_error("Cannot open", path);
+  }
+
+  // The copy is re-hashed so a file modified since hash_file cannot be
+  // stored under the wrong id
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    auto error = errno_error("Cannot stat", path);
+    ::close(fd);
+    return error;
+  }
+  auto header = encode_object_header(ObjectType::Blob,
+                                     static_cast<std::uint64_t>(st.st_size));
+  Sha256 hasher;
+  hasher.update(header);
+  BodyWriter writer(file, store_.compression(),
+                    static_cast<std::uint64_t>(st.st_size));
+  std::optional<Error> error = writer.start(header);
+
+  auto chunk = std::make_unique<char[]>(copy_chunk_size);
+  std::uint64_t copied = 0;
+  while (!error) {
+    ssize_t n = ::read(fd, chunk.get(), copy_chunk_size);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      error = errno_error("Cannot read", path);
+      break;
+    }
+    if (n == 0) {
+      break;
+    }
+    std::string_view data(chunk.get(), static_cast<std::size_t>(n));
+    hasher.update(data);
+    copied += data.size();
+    error = writer.write(data);
+  }
+  ::close(fd);
+  if (!error) {
+    error = writer.finish();
+  }
+  if (error) {
+    return error;
+  }
+
+  ObjectId copied_id;
+  auto digest = hasher.finish();
+  std::memcpy(copied_id.bytes.data(), digest.data(), ObjectId::size);
+  if (copied != static_cast<std::uint64_t>(st.st_size) || copied_id != out) {
+    return create_error(ErrorCode::IOError,
+                        "File changed while being stored: " + path.string());
+  }
+  return finish_staging(out, file);
+}
+
+std::optional<Error> ObjectBatch::commit() {
+  trace_count(TraceCounter::ObjectsWritten, pending_.size());
+  std::set<std::filesystem::path> shards;
+  for (auto &pending : pending_) {
+    auto target = store_.object_path(pending.id);
+    if (auto error = pending.file.commit(target)) {
+      return error;
+    }
+    if (durable_) {
+      shards.insert(target.parent_path());
+    }
+  }
+  pending_.clear();
+  staged_.clear();
+
+  // Recorded only once published; gc follows these lists to their chunks
+  if (!chunked_.empty()) {
+    std::string ids;
+    for (const auto &id : chunked_) {
+      ids.append(reinterpret_cast<const char *>(id.bytes.data()),
+                 ObjectId::size);
+    }
+    chunked_.clear();
+    if (auto error = append_chunked_ids(store_.chunked_list_path(), ids,
+                                        durable_)) {
+      return error;
+    }
+  }
+
+  // One directory sync per touched shard instead of one per object
+  for (const auto &shard : shards) {
+    if (auto error = fsync_directory(shard)) {
+      return error;
+    }
+  }
+  return std::nullopt;
+}
+
+} // namespace chrona
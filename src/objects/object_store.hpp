@@ -0,0 +1,168 @@
+#pragma once
+
+#include "compress/compress.hpp"
+#include "errors/error.hpp"
+#include "io/file_io.hpp"
+#include "objects/chunker.hpp"
+#include "objects/object.hpp"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace chrona {
+
+class DeltaBaseCache;
+class ObjectCache;
+class PackFile;
+
+using PackList = std::vector<std::shared_ptr<PackFile>>;
+
+// Loose objects live at objects/<2 hex>/<62 hex>, one shard per id prefix
+// byte; packs live in objects/pack/. Reads look in the packs first and then
+// in the loose shards, so callers never care where an object is stored.
+// Reads and writes are safe from any number of threads.
+//
+// A loose object is "<type> <size>\0<content>", or, when compressed, a NUL
+// byte, the same header and a compressed stream of the content. Both forms
+// are always readable; the compression setting only picks how new objects
+// are written.
+//
+// A large blob may instead be stored as a chunk list: a 0x01 byte, the
+// header, then "<varint size><32-byte id>" per chunk, each chunk being a
+// blob of its own. The blob keeps the id of its whole content, so trees,
+// the index and status never see the difference, while versions that
+// differ by a small edit share all but a few chunks. The ids of chunked
+// blobs are appended to objects/chunked for gc.
+struct ChunkRef {
+  ObjectId id;
+  std::uint64_t size;
+};
+
+class ObjectStore {
+public:
+  explicit ObjectStore(std::filesystem::path objects_dir);
+  ~ObjectStore();
+
+  ObjectStore(const ObjectStore &) = delete;
+  ObjectStore &operator=(const ObjectStore &) = delete;
+
+  const std::filesystem::path &root() const { return root_; }
+  std::filesystem::path shard_path(const ObjectId &id) const;
+  std::filesystem::path object_path(const ObjectId &id) const;
+  std::filesystem::path pack_dir() const { return root_ / "pack"; }
+
+  // Set before sharing the store between threads.
+  void set_compression(const CompressionOptions &options) {
+    compression_ = options;
+  }
+  const CompressionOptions &compression() const { return compression_; }
+  void set_chunking(const ChunkingOptions &options) { chunking_ = options; }
+  const ChunkingOptions &chunking() const { return chunking_; }
+
+  bool contains(const ObjectId &id) const;
+  std::optional<Error> read(const ObjectId &id, ObjectView &out) const;
+
+  // Passes the content to `chunk` a block at a time after `begin` has seen
+  // its type and size, so a compressed or chunked loose object is never
+  // held whole. Packed and uncompressed objects arrive as a single chunk.
+  using ObjectBegin =
+      std::function<std::optional<Error>(ObjectType, std::uint64_t)>;
+  std::optional<Error> read_stream(const ObjectId &id,
+                                   const ObjectBegin &begin,
+                                   const ChunkSink &chunk) const;
+
+  std::optional<Error> write(ObjectType type, std::string_view content,
+                             ObjectId &out);
+  std::optional<Error> write_file(const std::filesystem::path &path,
+                                  ObjectId &out);
+
+  bool contains_loose(const ObjectId &id) const;
+  // Like contains(), but also bumps the mtime of the loose file or pack
+  // holding the object, so gc treats it as recently written.
+  bool freshen(const ObjectId &id) const;
+  std::optional<Error> read_loose(const ObjectId &id, ObjectView &out) const;
+  void for_each_loose(const std::function<void(const ObjectId &)> &fn) const;
+  // The chunks of a loose chunked blob; empty when the object is stored
+  // any other way.
+  std::optional<Error> read_chunk_list(const ObjectId &id,
+                                       std::vector<ChunkRef> &out) const;
+  std::filesystem::path chunked_list_path() const { return root_ / "chunked"; }
+
+  // Packs are discovered on first use; reload after adding or removing one.
+  std::shared_ptr<const PackList> packs() const;
+  std::optional<Error> reload_packs();
+  DeltaBaseCache &delta_cache() const { return *delta_cache_; }
+  // Trees and commits returned by read(), shared by all threads.
+  ObjectCache &object_cache() const { return *object_cache_; }
+
+  // Creates the shard directory for id on first use.
+  std::optional<Error> ensure_shard(const ObjectId &id) const;
+
+private:
+  std::optional<Error> load_packs(std::shared_ptr<const PackList> &out) const;
+
+  std::filesystem::path root_;
+  CompressionOptions compression_;
+  ChunkingOptions chunking_;
+  mutable std::array<std::atomic<bool>, 256> shard_ready_{};
+  mutable std::mutex packs_mutex_;
+  mutable std::shared_ptr<const PackList> packs_;
+  std::unique_ptr<DeltaBaseCache> delta_cache_;
+  std::unique_ptr<ObjectCache> object_cache_;
+};
+
+// Stages objects as temp files inside their shard and publishes them with a
+// rename on commit(). Objects that already exist are never rewritten.
+// Anything not committed is removed when the batch is destroyed.
+class ObjectBatch {
+public:
+  explicit ObjectBatch(ObjectStore &store, bool durable = false);
+
+  std::optional<Error> add(ObjectType type, std::string_view content,
+                           ObjectId &out);
+  std::optional<Error> add_file(const std::filesystem::path &path,
+                                ObjectId &out);
+  // Stores blob `id` as a list of `chunks`, which must already be in the
+  // store. The chunks are read back one at a time and hashed; a list that
+  // does not add up to `id` fails with CorruptObject.
+  std::optional<Error> add_chunk_list(const ObjectId &id,
+                                      const std::vector<ChunkRef> &chunks);
+  std::optional<Error> commit();
+
+  std::size_t pending() const { return pending_.size(); }
+
+private:
+  struct Pending {
+    ObjectId id;
+    TempFile file;
+  };
+
+  bool already_stored(const ObjectId &id);
+  std::optional<Error> finish_staging(const ObjectId &id, TempFile &file);
+  std::optional<Error> add_whole(ObjectType type, std::string_view content,
+                                 const ObjectId &id);
+  // Stores `content` as chunks plus a chunk list under `id`, which must be
+  // its blob id; a mismatch means the source changed while being read.
+  std::optional<Error> add_chunked(std::string_view content,
+                                   const ObjectId &id,
+                                   const std::filesystem::path &source);
+  // Stages the loose file of a chunked blob: marker, header and entries.
+  std::optional<Error> stage_chunk_list(const ObjectId &id,
+                                        std::string_view list);
+
+  ObjectStore &store_;
+  bool durable_;
+  std::vector<Pending> pending_;
+  std::unordered_set<ObjectId, ObjectIdHash> staged_;
+  std::vector<ObjectId> chunked_;
+};
+
+} // namespace chrona
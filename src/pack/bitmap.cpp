@@ -0,0 +1,429 @@
+#include "bitmap.hpp"
+#include "hash/sha256.hpp"
+#include "history/commit.hpp"
+#include "io/file_io.hpp"
+#include "memory/arena.hpp"
+#include "snapshot/tree.hpp"
+#include "trace/trace.hpp"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <map>
+
+namespace chrona {
+
+namespace {
+
+constexpr char bitmap_magic[4] = {'C', 'B', 'M', 'P'};
+constexpr std::uint32_t bitmap_version = 1;
+constexpr std::size_t bitmap_header_size = 16 + ObjectId::size;
+
+std::uint32_t load_u32(const char *p) {
+  std::uint32_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+void append_u32(std::string &out, std::uint32_t value) {
+  out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+// Size of the ewah at the front of `in`, or 0 when it is truncated.
+std::size_t ewah_size(std::string_view in) {
+  if (in.size() < 4) {
+    return 0;
+  }
+  std::size_t size = 4 + std::size_t(load_u32(in.data())) * 8;
+  return size <= in.size() ? size : 0;
+}
+
+std::optional<std::size_t> position_in(const PackFile *pack,
+                                       const ObjectId &id) {
+  if (pack == nullptr) {
+    return std::nullopt;
+  }
+  if (auto index = pack->find_index(id)) {
+    return pack->position_of(*index);
+  }
+  return std::nullopt;
+}
+
+// ORs in the precomputed set of the commit at a pack position, if any.
+using BitmapLookup = std::function<bool(std::size_t, Bitmap &)>;
+
+// Depth-first walk from commits, adding every object to `out` that is
+// neither in it already nor in `exclude`. Both sets are closed under
+// reachability, so the walk stops at any object they hold, and at any
+// commit `lookup` has a bitmap for.
+std::optional<Error> walk_objects(const ObjectStore &store,
+                                  const PackFile *pack,
+                                  const BitmapLookup &lookup,
+                                  const ObjectSet *exclude,
+                                  const std::vector<ObjectId> &tips,
+                                  ObjectSet &out) {
+  std::vector<std::pair<ObjectId, ObjectType>> stack;
+  for (const auto &tip : tips) {
+    stack.emplace_back(tip, ObjectType::Commit);
+  }
+  InlineArena<4096> arena;
+  while (!stack.empty()) {
+    auto [id, type] = stack.back();
+    stack.pop_back();
+
+    auto pos = position_in(pack, id);
+    if (pos) {
+      if (out.packed.test(*pos) || (exclude && exclude->packed.test(*pos))) {
+        continue;
+      }
+      if (type == ObjectType::Commit && lookup && lookup(*pos, out.packed)) {
+        continue;
+      }
+      out.packed.set(*pos);
+    } else {
+      if ((exclude && exclude->others.count(id) > 0) ||
+          !out.others.emplace(id, type).second) {
+        continue;
+      }
+    }
+    if (type == ObjectType::Blob) {
+      continue;
+    }
+
+    ObjectView view;
+    if (auto error = store.read(id, view)) {
+      return error;
+    }
+    if (view.type() != type) {
+      return create_error(ErrorCode::CorruptObject,
+                          "Expected a " +
+                              std::string(object_type_name(type)) + ": " +
+                              id.hex());
+    }
+    arena.reset();
+    if (type == ObjectType::Commit) {
+      CommitView commit;
+      if (auto error = parse_commit(view.content(), arena, commit)) {
+        return error;
+      }
+      stack.emplace_back(commit.tree, ObjectType::Tree);
+      for (const auto &parent : commit.parents) {
+        stack.emplace_back(parent, ObjectType::Commit);
+      }
+    } else {
+      TreeView tree;
+      if (auto error = parse_tree(view.content(), arena, tree)) {
+        return error;
+      }
+      for (const auto &entry : tree.entries) {
+        stack.emplace_back(entry.id(), entry.mode == EntryMode::Directory
+                                           ? ObjectType::Tree
+                                           : ObjectType::Blob);
+      }
+    }
+  }
+  return std::nullopt;
+}
+
+struct CommitNode {
+  std::int64_t time = 0;
+  bool selected = false;
+};
+
+using CommitNodes = std::unordered_map<ObjectId, CommitNode, ObjectIdHash>;
+
+// Every commit behind `tips`, parents before children.
+std::optional<Error> topological_commits(const ObjectStore &store,
+                                         const std::vector<ObjectId> &tips,
+                                         CommitNodes &nodes,
+                                         std::vector<ObjectId> &order) {
+  std::vector<std::pair<ObjectId, bool>> stack; // true: parents are done
+  for (const auto &tip : tips) {
+    stack.emplace_back(tip, false);
+  }
+  InlineArena<4096> arena;
+  while (!stack.empty()) {
+    auto [id, expanded] = stack.back();
+    stack.pop_back();
+    if (expanded) {
+      order.push_back(id);
+      continue;
+    }
+    if (nodes.count(id) > 0) {
+      continue;
+    }
+    ObjectView view;
+    if (auto error = store.read(id, view)) {
+      return error;
+    }
+    arena.reset();
+    CommitView commit;
+    if (auto error = parse_commit(view.content(), arena, commit)) {
+      return error;
+    }
+    nodes[id].time = commit.time;
+    stack.emplace_back(id, true);
+    for (const auto &parent : commit.parents) {
+      if (nodes.count(parent) == 0) {
+        stack.emplace_back(parent, false);
+      }
+    }
+  }
+  return std::nullopt;
+}
+
+} // namespace
+
+std::optional<Error> PackBitmaps::open(std::shared_ptr<const PackFile> pack,
+                                       PackBitmaps &out) {
+  auto path = pack->path();
+  path.replace_extension(".bitmap");
+  out = PackBitmaps();
+  if (auto error = MappedFile::open(path, out.file_)) {
+    return error;
+  }
+  auto corrupt = [&] {
+    return create_error(ErrorCode::CorruptObject,
+                        "Corrupt pack bitmaps: " + path.string());
+  };
+  // gc trusts these sets not to miss anything, so the whole file is
+  // checksummed rather than each bitmap sanity-checked
+  auto in = out.file_.view();
+  if (in.size() < bitmap_header_size + Sha256::digest_size ||
+      std::memcmp(in.data(), bitmap_magic, 4) != 0 ||
+      load_u32(in.data() + 4) != bitmap_version) {
+    return corrupt();
+  }
+  in.remove_suffix(Sha256::digest_size);
+  auto digest = sha256(in);
+  if (std::memcmp(digest.data(), in.data() + in.size(), digest.size()) != 0) {
+    return corrupt();
+  }
+  std::uint32_t entries = load_u32(in.data() + 8);
+  auto checksum = pack->checksum();
+  if (load_u32(in.data() + 12) != pack->size() ||
+      std::memcmp(in.data() + 16, checksum.bytes.data(), ObjectId::size) !=
+          0) {
+    return create_error(ErrorCode::CorruptObject,
+                        "Pack bitmaps do not match pack: " + path.string());
+  }
+  in.remove_prefix(bitmap_header_size);
+  for (auto &type : out.types_) {
+    if (!ewah_or_into(in, type)) {
+      return corrupt();
+    }
+  }
+  for (std::uint32_t i = 0; i < entries; ++i) {
+    if (in.size() < 4) {
+      return corrupt();
+    }
+    std::uint32_t pos = load_u32(in.data());
+    in.remove_prefix(4);
+    auto size = ewah_size(in);
+    if (size == 0 || pos >= pack->size()) {
+      return corrupt();
+    }
+    out.entries_.emplace(pos, in.substr(0, size));
+    in.remove_prefix(size);
+  }
+  if (!in.empty()) {
+    return corrupt();
+  }
+  out.pack_ = std::move(pack);
+  return std::nullopt;
+}
+
+bool PackBitmaps::reachable_from(std::size_t pos, Bitmap &out) const {
+  auto it = entries_.find(static_cast<std::uint32_t>(pos));
+  if (it == entries_.end()) {
+    return false;
+  }
+  auto in = it->second;
+  return ewah_or_into(in, out); // checksummed when the file was opened
+}
+
+std::optional<Error> write_pack_bitmaps(const ObjectStore &store,
+                                        const PackFile &pack,
+                                        const std::vector<ObjectId> &tips,
+                                        std::size_t &written,
+                                        const BitmapOptions &options) {
+  CHRONA_TRACE_SCOPE("write_pack_bitmaps");
+  written = 0;
+  CommitNodes nodes;
+  std::vector<ObjectId> order;
+  if (auto error = topological_commits(store, tips, nodes, order)) {
+    return error;
+  }
+
+  // Newest first; ties broken by id so the choice is reproducible
+  std::vector<std::pair<std::int64_t, ObjectId>> by_time;
+  by_time.reserve(order.size());
+  for (const auto &id : order) {
+    by_time.emplace_back(nodes[id].time, id);
+  }
+  std::sort(by_time.begin(), by_time.end(), [](const auto &a, const auto &b) {
+    return a.first != b.first ? a.first > b.first : a.second < b.second;
+  });
+  for (std::size_t i = 0; i < by_time.size(); ++i) {
+    bool recent = i < options.recent;
+    auto spacing = std::max<std::size_t>(
+        1, recent ? options.recent_spacing : options.spacing);
+    if ((recent ? i : i - options.recent) % spacing == 0) {
+      nodes[by_time[i].second].selected = true;
+    }
+  }
+  for (const auto &tip : tips) {
+    nodes[tip].selected = true;
+  }
+
+  // Oldest first, so each walk stops at the bitmaps of older selected
+  // commits instead of reading their history again
+  std::map<std::uint32_t, std::string> encoded;
+  BitmapLookup lookup = [&](std::size_t pos, Bitmap &out) {
+    auto it = encoded.find(static_cast<std::uint32_t>(pos));
+    if (it == encoded.end()) {
+      return false;
+    }
+    std::string_view in = it->second;
+    return ewah_or_into(in, out);
+  };
+  for (const auto &id : order) {
+    if (!nodes[id].selected) {
+      continue;
+    }
+    ObjectSet set;
+    if (auto error = walk_objects(store, &pack, lookup, nullptr, {id}, set)) {
+      return error;
+    }
+    if (!set.others.empty()) {
+      return std::nullopt; // the pack is not closed; no bitmaps
+    }
+    auto pos = position_in(&pack, id);
+    encoded.emplace(static_cast<std::uint32_t>(*pos),
+                    ewah_encode(set.packed));
+  }
+
+  std::array<Bitmap, 3> types;
+  for (std::size_t pos = 0; pos < pack.size(); ++pos) {
+    auto type = pack.type_at(pack.index_at_position(pos));
+    if (!type) {
+      return create_error(ErrorCode::CorruptObject,
+                          "Bad pack entry at position " + std::to_string(pos) +
+                              " in " + pack.path().string());
+    }
+    types[static_cast<std::size_t>(*type) - 1].set(pos);
+  }
+
+  auto checksum = pack.checksum();
+  std::string out;
+  out.append(bitmap_magic, 4);
+  append_u32(out, bitmap_version);
+  append_u32(out, static_cast<std::uint32_t>(encoded.size()));
+  append_u32(out, static_cast<std::uint32_t>(pack.size()));
+  out.append(reinterpret_cast<const char *>(checksum.bytes.data()),
+             ObjectId::size);
+  for (const auto &type : types) {
+    out += ewah_encode(type);
+  }
+  for (const auto &[pos, ewah] : encoded) {
+    append_u32(out, pos);
+    out += ewah;
+  }
+  auto digest = sha256(out);
+  out.append(reinterpret_cast<const char *>(digest.data()), digest.size());
+  auto path = pack.path();
+  path.replace_extension(".bitmap");
+  if (auto error = write_file_atomic(path, out)) {
+    return error;
+  }
+  written = encoded.size();
+  return std::nullopt;
+}
+
+Reachability::Reachability(const ObjectStore &store) : store_(store) {
+  auto packs = store.packs();
+  std::vector<std::shared_ptr<PackFile>> by_size(packs->begin(), packs->end());
+  std::sort(by_size.begin(), by_size.end(),
+            [](const auto &a, const auto &b) { return a->size() > b->size(); });
+  for (const auto &pack : by_size) {
+    auto bitmaps = std::make_unique<PackBitmaps>();
+    if (!PackBitmaps::open(pack, *bitmaps)) {
+      bitmaps_ = std::move(bitmaps);
+      return;
+    }
+  }
+}
+
+std::optional<Error> Reachability::walk(const std::vector<ObjectId> &tips,
+                                        const ObjectSet *exclude,
+                                        ObjectSet &out) const {
+  if (!bitmaps_) {
+    return walk_objects(store_, nullptr, {}, exclude, tips, out);
+  }
+  BitmapLookup lookup = [this](std::size_t pos, Bitmap &bits) {
+    return bitmaps_->reachable_from(pos, bits);
+  };
+  return walk_objects(store_, &bitmaps_->pack(), lookup, exclude, tips, out);
+}
+
+std::optional<Error> Reachability::reachable(const std::vector<ObjectId> &tips,
+                                             ObjectSet &out) const {
+  CHRONA_TRACE_SCOPE("reachability.reachable");
+  return walk(tips, nullptr, out);
+}
+
+void Reachability::reachable_from_bitmaps(const std::vector<ObjectId> &tips,
+                                          ObjectSet &out) const {
+  if (!bitmaps_) {
+    return;
+  }
+  for (const auto &tip : tips) {
+    if (auto pos = position_in(&bitmaps_->pack(), tip)) {
+      bitmaps_->reachable_from(*pos, out.packed);
+    }
+  }
+}
+
+std::optional<Error> Reachability::missing(const std::vector<ObjectId> &want,
+                                           const std::vector<ObjectId> &have,
+                                           std::vector<ObjectId> &out) const {
+  CHRONA_TRACE_SCOPE("reachability.missing");
+  ObjectSet had;
+  if (auto error = walk(have, nullptr, had)) {
+    return error;
+  }
+  ObjectSet wanted;
+  if (auto error = walk(want, &had, wanted)) {
+    return error;
+  }
+  // Bitmaps ORed in along the way may cover objects `have` reaches too
+  wanted.packed.and_not(had.packed);
+  out = ids(wanted);
+  return std::nullopt;
+}
+
+std::size_t Reachability::count(const ObjectSet &set) const {
+  return set.packed.count() + set.others.size();
+}
+
+std::size_t Reachability::count(const ObjectSet &set, ObjectType type) const {
+  std::size_t total = 0;
+  if (bitmaps_) {
+    Bitmap typed = set.packed;
+    typed &= bitmaps_->of_type(type);
+    total = typed.count();
+  }
+  for (const auto &[id, other_type] : set.others) {
+    total += other_type == type ? 1 : 0;
+  }
+  return total;
+}
+
+std::vector<ObjectId> Reachability::ids(const ObjectSet &set) const {
+  std::vector<ObjectId> out;
+  out.reserve(count(set));
+  for_each(set, [&](const ObjectId &id) { out.push_back(id); });
+  std::sort(out.begin(), out.end());
+  return out;
+}
+
+} // namespace chrona
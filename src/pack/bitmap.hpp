@@ -0,0 +1,129 @@
+#pragma once
+
+#include "errors/error.hpp"
+#include "io/mapped_file.hpp"
+#include "objects/object.hpp"
+#include "objects/object_store.hpp"
+#include "pack/ewah.hpp"
+#include "pack/pack.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace chrona {
+
+// Reachability bitmaps (pack-<name>.bitmap, little-endian), bits being
+// pack positions (see the reverse index in pack.hpp):
+//
+//   "CBMP" u32 version u32 entry_count u32 object_count
+//   pack trailer (32 bytes)
+//   ewah commits, ewah trees, ewah blobs   the pack's objects by type
+//   entries[entry_count]   u32 pack position of a commit, then the ewah
+//                          of every object reachable from it, sorted by
+//                          position
+//   SHA-256 of everything above
+//
+// The file is only valid next to the pack whose trailer it repeats, and
+// only written when that pack holds everything reachable from its tips.
+class PackBitmaps {
+public:
+  // NotFound when the pack has no bitmaps.
+  static std::optional<Error> open(std::shared_ptr<const PackFile> pack,
+                                   PackBitmaps &out);
+
+  const PackFile &pack() const { return *pack_; }
+  std::size_t size() const { return entries_.size(); }
+
+  // ORs in everything reachable from the commit at pack position `pos`;
+  // false when that commit has no bitmap.
+  bool reachable_from(std::size_t pos, Bitmap &out) const;
+  // The pack's objects of one type (commits, trees or blobs).
+  const Bitmap &of_type(ObjectType type) const {
+    return types_[static_cast<std::size_t>(type) - 1];
+  }
+
+private:
+  std::shared_ptr<const PackFile> pack_;
+  MappedFile file_;
+  std::array<Bitmap, 3> types_;
+  std::unordered_map<std::uint32_t, std::string_view> entries_;
+};
+
+struct BitmapOptions {
+  // Every ref tip gets a bitmap. So does one commit in `recent_spacing`
+  // among the `recent` newest, and one in `spacing` among the rest.
+  std::size_t recent = 100;
+  std::size_t recent_spacing = 10;
+  std::size_t spacing = 100;
+};
+
+// Writes the bitmaps of `pack` for the history behind `tips`. Nothing is
+// written (and `written` stays 0) when some reachable object is not in
+// the pack.
+std::optional<Error> write_pack_bitmaps(const ObjectStore &store,
+                                        const PackFile &pack,
+                                        const std::vector<ObjectId> &tips,
+                                        std::size_t &written,
+                                        const BitmapOptions &options = {});
+
+// A set of objects: positions in the bitmapped pack, plus the objects
+// outside it by id.
+struct ObjectSet {
+  Bitmap packed;
+  std::unordered_map<ObjectId, ObjectType, ObjectIdHash> others;
+};
+
+// Reachability queries over a store. Commits with a bitmap are answered
+// by ORing it in; from anything else the walk reads commits and trees as
+// usual, until it meets a bitmapped commit or something already found.
+// Without bitmaps this is a plain walk, so answers never depend on them.
+class Reachability {
+public:
+  // Uses the bitmaps of the largest pack that has them; unreadable
+  // bitmaps are ignored.
+  explicit Reachability(const ObjectStore &store);
+
+  bool has_bitmaps() const { return bitmaps_ != nullptr; }
+
+  // Adds everything reachable from the commits in `tips` to `out`.
+  std::optional<Error> reachable(const std::vector<ObjectId> &tips,
+                                 ObjectSet &out) const;
+  // Only what the bitmaps know: the closure of each tip that has a
+  // bitmap, nothing for the others. Reads no objects.
+  void reachable_from_bitmaps(const std::vector<ObjectId> &tips,
+                              ObjectSet &out) const;
+  // The objects reachable from `want` but not from `have`: what a store
+  // that has `have` is missing to get `want`. Sorted by id.
+  std::optional<Error> missing(const std::vector<ObjectId> &want,
+                               const std::vector<ObjectId> &have,
+                               std::vector<ObjectId> &out) const;
+
+  std::size_t count(const ObjectSet &set) const;
+  std::size_t count(const ObjectSet &set, ObjectType type) const;
+  std::vector<ObjectId> ids(const ObjectSet &set) const;
+  // Calls fn(id) for each object in the set, in no particular order.
+  template <typename Fn> void for_each(const ObjectSet &set, Fn &&fn) const {
+    if (bitmaps_) {
+      const auto &pack = bitmaps_->pack();
+      set.packed.for_each([&](std::size_t pos) {
+        fn(pack.id_at(pack.index_at_position(pos)));
+      });
+    }
+    for (const auto &[id, type] : set.others) {
+      fn(id);
+    }
+  }
+
+private:
+  std::optional<Error> walk(const std::vector<ObjectId> &tips,
+                            const ObjectSet *exclude, ObjectSet &out) const;
+
+  const ObjectStore &store_;
+  std::unique_ptr<PackBitmaps> bitmaps_;
+};
+
+} // namespace chrona
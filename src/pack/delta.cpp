@@ -0,0 +1,132 @@
+#include "delta.hpp"
+#include "pack/varint.hpp"
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+namespace chrona {
+
+namespace {
+
+constexpr std::size_t block_size = 16;
+constexpr std::uint8_t op_insert = 0x00;
+constexpr std::uint8_t op_copy = 0x01;
+
+std::uint64_t block_hash(const char *data) {
+  std::uint64_t a;
+  std::uint64_t b;
+  std::memcpy(&a, data, 8);
+  std::memcpy(&b, data + 8, 8);
+  return (a * 0x9E3779B97F4A7C15ULL) ^ (b * 0xC2B2AE3D27D4EB4FULL);
+}
+
+void flush_insert(std::string &out, std::string_view target,
+                  std::size_t begin, std::size_t end) {
+  if (begin < end) {
+    out += static_cast<char>(op_insert);
+    append_varint(out, end - begin);
+    out.append(target.substr(begin, end - begin));
+  }
+}
+
+} // namespace
+
+std::string create_delta(std::string_view base, std::string_view target) {
+  std::string out;
+  append_varint(out, base.size());
+  append_varint(out, target.size());
+
+  // Block-aligned positions of the base; the first occurrence wins
+  std::unordered_map<std::uint64_t, std::size_t> blocks;
+  blocks.reserve(base.size() / block_size + 1);
+  for (std::size_t i = 0; i + block_size <= base.size(); i += block_size) {
+    blocks.emplace(block_hash(base.data() + i), i);
+  }
+
+  std::size_t pending = 0; // start of bytes not yet emitted
+  std::size_t pos = 0;
+  while (pos + block_size <= target.size()) {
+    auto it = blocks.find(block_hash(target.data() + pos));
+    if (it == blocks.end() ||
+        std::memcmp(base.data() + it->second, target.data() + pos,
+                    block_size) != 0) {
+      ++pos;
+      continue;
+    }
+
+    // Extend the match backwards into pending literals, then forwards
+    std::size_t base_pos = it->second;
+    std::size_t start = pos;
+    while (start > pending && base_pos > 0 &&
+           base[base_pos - 1] == target[start - 1]) {
+      --start;
+      --base_pos;
+    }
+    std::size_t length = pos - start + block_size;
+    while (start + length < target.size() &&
+           base_pos + length < base.size() &&
+           base[base_pos + length] == target[start + length]) {
+      ++length;
+    }
+
+    flush_insert(out, target, pending, start);
+    out += static_cast<char>(op_copy);
+    append_varint(out, base_pos);
+    append_varint(out, length);
+    pos = start + length;
+    pending = pos;
+  }
+  flush_insert(out, target, pending, target.size());
+  return out;
+}
+
+std::optional<Error> apply_delta(std::string_view base, std::string_view delta,
+                                 std::string &out) {
+  std::uint64_t base_size;
+  std::uint64_t result_size;
+  if (!read_varint(delta, base_size) || !read_varint(delta, result_size) ||
+      base_size != base.size()) {
+    return create_error(ErrorCode::CorruptObject, "Bad delta header");
+  }
+
+  out.clear();
+  // A corrupt header must not size the allocation: the reserve covers the
+  // usual delta, the base plus its inserts, and longer results grow
+  out.reserve(std::min<std::uint64_t>(result_size,
+                                      base.size() + delta.size()));
+  while (!delta.empty()) {
+    auto op = static_cast<std::uint8_t>(delta.front());
+    delta.remove_prefix(1);
+
+    if (op == op_insert) {
+      std::uint64_t length;
+      if (!read_varint(delta, length) || length > delta.size()) {
+        return create_error(ErrorCode::CorruptObject, "Bad delta insert");
+      }
+      out.append(delta.substr(0, length));
+      delta.remove_prefix(length);
+    } else if (op == op_copy) {
+      std::uint64_t offset;
+      std::uint64_t length;
+      if (!read_varint(delta, offset) || !read_varint(delta, length) ||
+          offset > base.size() || length > base.size() - offset) {
+        return create_error(ErrorCode::CorruptObject, "Bad delta copy");
+      }
+      out.append(base.substr(offset, length));
+    } else {
+      return create_error(ErrorCode::CorruptObject, "Bad delta opcode");
+    }
+
+    if (out.size() > result_size) {
+      return create_error(ErrorCode::CorruptObject, "Delta overruns result");
+    }
+  }
+
+  if (out.size() != result_size) {
+    return create_error(ErrorCode::CorruptObject, "Delta result size mismatch");
+  }
+  return std::nullopt;
+}
+
+} // namespace chrona
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "errors/error.hpp"
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace chrona {
+
+// Delta encoding (all integers are varints):
+//
+//   <base size> <result size> <instruction>*
+//   insert: 0x00 <length> <bytes>
+//   copy:   0x01 <base offset> <length>
+//
+// create_delta() indexes the base in 16-byte blocks and greedily extends
+// every block match, so shared regions cost a few bytes each.
+std::string create_delta(std::string_view base, std::string_view target);
+
+std::optional<Error> apply_delta(std::string_view base, std::string_view delta,
+                                 std::string &out);
+
+} // namespace chrona
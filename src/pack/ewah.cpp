@@ -0,0 +1,139 @@
+#include "ewah.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+namespace chrona {
+
+namespace {
+
+constexpr std::uint64_t max_fill = 0xffffffffULL;
+constexpr std::uint64_t max_literals = 0x7fffffffULL;
+constexpr std::uint64_t all_ones = ~std::uint64_t(0);
+
+bool is_fill(std::uint64_t word) { return word == 0 || word == all_ones; }
+
+void append_u32(std::string &out, std::uint32_t value) {
+  out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+void append_u64(std::string &out, std::uint64_t value) {
+  out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+} // namespace
+
+Bitmap &Bitmap::operator|=(const Bitmap &other) {
+  if (other.words_.size() > words_.size()) {
+    words_.resize(other.words_.size());
+  }
+  for (std::size_t i = 0; i < other.words_.size(); ++i) {
+    words_[i] |= other.words_[i];
+  }
+  return *this;
+}
+
+Bitmap &Bitmap::operator&=(const Bitmap &other) {
+  if (words_.size() > other.words_.size()) {
+    words_.resize(other.words_.size());
+  }
+  for (std::size_t i = 0; i < words_.size(); ++i) {
+    words_[i] &= other.words_[i];
+  }
+  return *this;
+}
+
+Bitmap &Bitmap::and_not(const Bitmap &other) {
+  auto shared = std::min(words_.size(), other.words_.size());
+  for (std::size_t i = 0; i < shared; ++i) {
+    words_[i] &= ~other.words_[i];
+  }
+  return *this;
+}
+
+std::size_t Bitmap::count() const {
+  std::size_t total = 0;
+  for (auto word : words_) {
+    total += static_cast<std::size_t>(std::popcount(word));
+  }
+  return total;
+}
+
+// Serialised as a u32 count of stream words followed by the words.
+std::string ewah_encode(const Bitmap &bitmap) {
+  const auto &words = bitmap.words();
+  std::vector<std::uint64_t> stream;
+  std::size_t i = 0;
+  while (i < words.size()) {
+    std::uint64_t fill_bit = words[i] == all_ones ? 1 : 0;
+    std::uint64_t fills = 0;
+    while (i < words.size() && is_fill(words[i]) &&
+           (words[i] == all_ones) == (fill_bit == 1) && fills < max_fill) {
+      ++fills;
+      ++i;
+    }
+    std::size_t literals_begin = i;
+    while (i < words.size() && !is_fill(words[i]) &&
+           i - literals_begin < max_literals) {
+      ++i;
+    }
+    std::uint64_t literals = i - literals_begin;
+    stream.push_back(fill_bit | fills << 1 | literals << 33);
+    stream.insert(stream.end(), words.begin() + literals_begin,
+                  words.begin() + i);
+  }
+
+  std::string out;
+  out.reserve(4 + stream.size() * 8);
+  append_u32(out, static_cast<std::uint32_t>(stream.size()));
+  for (auto word : stream) {
+    append_u64(out, word);
+  }
+  return out;
+}
+
+bool ewah_or_into(std::string_view &in, Bitmap &out) {
+  std::uint32_t stream_words;
+  if (in.size() < 4) {
+    return false;
+  }
+  std::memcpy(&stream_words, in.data(), 4);
+  if ((in.size() - 4) / 8 < stream_words) {
+    return false;
+  }
+  const char *p = in.data() + 4;
+  const char *end = p + std::size_t(stream_words) * 8;
+  in.remove_prefix(4 + std::size_t(stream_words) * 8);
+
+  auto &words = out.words();
+  std::size_t at = 0;
+  auto reserve = [&](std::uint64_t count) {
+    if (at + count > words.size()) {
+      words.resize(at + count);
+    }
+  };
+  while (p < end) {
+    std::uint64_t marker;
+    std::memcpy(&marker, p, 8);
+    p += 8;
+    std::uint64_t fills = (marker >> 1) & max_fill;
+    std::uint64_t literals = marker >> 33;
+    if (std::uint64_t(end - p) / 8 < literals) {
+      return false;
+    }
+    if (marker & 1) {
+      reserve(fills);
+      std::fill(words.begin() + at, words.begin() + at + fills, all_ones);
+    }
+    at += fills;
+    reserve(literals);
+    for (std::uint64_t i = 0; i < literals; ++i, p += 8) {
+      std::uint64_t word;
+      std::memcpy(&word, p, 8);
+      words[at++] |= word;
+    }
+  }
+  return true;
+}
+
+} // namespace chrona
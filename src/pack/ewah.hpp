@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace chrona {
+
+// Plain bit set over object positions. Set operations work a 64-bit word
+// at a time.
+class Bitmap {
+public:
+  Bitmap() = default;
+  explicit Bitmap(std::size_t bits) : words_((bits + 63) / 64) {}
+
+  void set(std::size_t bit) {
+    if (bit / 64 >= words_.size()) {
+      words_.resize(bit / 64 + 1);
+    }
+    words_[bit / 64] |= std::uint64_t(1) << (bit % 64);
+  }
+  bool test(std::size_t bit) const {
+    return bit / 64 < words_.size() &&
+           (words_[bit / 64] >> (bit % 64) & 1) != 0;
+  }
+
+  Bitmap &operator|=(const Bitmap &other);
+  Bitmap &operator&=(const Bitmap &other);
+  // Clears every bit that is set in `other`.
+  Bitmap &and_not(const Bitmap &other);
+
+  std::size_t count() const;
+  bool empty() const { return count() == 0; }
+
+  // Calls fn(position) for each set bit, in increasing order.
+  template <typename Fn> void for_each(Fn &&fn) const {
+    for (std::size_t w = 0; w < words_.size(); ++w) {
+      for (auto word = words_[w]; word != 0; word &= word - 1) {
+        fn(w * 64 + static_cast<std::size_t>(__builtin_ctzll(word)));
+      }
+    }
+  }
+
+  const std::vector<std::uint64_t> &words() const { return words_; }
+  std::vector<std::uint64_t> &words() { return words_; }
+
+private:
+  std::vector<std::uint64_t> words_;
+};
+
+// EWAH (enhanced word-aligned hybrid) encoding of a Bitmap, as stored on
+// disk. The stream is a sequence of marker words, each followed by the
+// literal words it announces:
+//
+//   marker   bit 0: fill bit, bits 1-32: fill word count,
+//            bits 33-63: literal word count
+//
+// A fill word is 64 copies of the fill bit, so long runs of reachable or
+// unreachable objects cost one marker.
+std::string ewah_encode(const Bitmap &bitmap);
+
+// ORs the bitmap encoded at the front of `in` into `out` and consumes it;
+// false if the encoding is truncated or malformed.
+bool ewah_or_into(std::string_view &in, Bitmap &out);
+
+} // namespace chrona
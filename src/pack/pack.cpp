@@ -0,0 +1,350 @@
+#include "pack.hpp"
+#include "compress/compress.hpp"
+#include "pack/delta.hpp"
+#include "pack/varint.hpp"
+#include "trace/trace.hpp"
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <unistd.h>
+
+namespace chrona {
+
+namespace {
+
+constexpr std::size_t pack_header_size = 12;
+constexpr std::size_t index_header_size = 12;
+constexpr std::size_t fanout_size = 256 * 4;
+constexpr std::size_t reverse_header_size = 12;
+constexpr int max_delta_depth = 256;
+
+std::uint32_t load_u32(const std::uint8_t *p) {
+  std::uint32_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+std::uint64_t load_u64(const std::uint8_t *p) {
+  std::uint64_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+bool is_object_kind(int kind) {
+  return kind == static_cast<std::uint8_t>(ObjectType::Blob) ||
+         kind == static_cast<std::uint8_t>(ObjectType::Tree) ||
+         kind == static_cast<std::uint8_t>(ObjectType::Commit);
+}
+
+} // namespace
+
+void remove_pack_files(const std::filesystem::path &pack_path) {
+  for (const char *extension : {".idx", ".rev", ".bitmap", ".pack"}) {
+    auto path = pack_path;
+    path.replace_extension(extension);
+    ::unlink(path.c_str());
+  }
+}
+
+std::shared_ptr<const std::string>
+DeltaBaseCache::get(const ObjectId &pack, std::uint64_t offset) {
+  std::lock_guard lock(mutex_);
+  auto it = map_.find(Key{pack, offset});
+  if (it == map_.end()) {
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    trace_count(TraceCounter::CacheMisses);
+    return nullptr;
+  }
+  hits_.fetch_add(1, std::memory_order_relaxed);
+  trace_count(TraceCounter::CacheHits);
+  lru_.splice(lru_.begin(), lru_, it->second);
+  return it->second->second;
+}
+
+void DeltaBaseCache::put(const ObjectId &pack, std::uint64_t offset,
+                         std::shared_ptr<const std::string> content) {
+  if (content->size() > max_bytes_) {
+    return;
+  }
+  std::lock_guard lock(mutex_);
+  Key key{pack, offset};
+  if (map_.count(key) > 0) {
+    return;
+  }
+  bytes_ += content->size();
+  lru_.emplace_front(key, std::move(content));
+  map_.emplace(key, lru_.begin());
+
+  while (bytes_ > max_bytes_) {
+    auto &victim = lru_.back();
+    bytes_ -= victim.second->size();
+    map_.erase(victim.first);
+    lru_.pop_back();
+  }
+}
+
+std::optional<Error> PackFile::open(const std::filesystem::path &pack_path,
+                                    std::shared_ptr<PackFile> &out) {
+  auto pack = std::make_shared<PackFile>();
+  pack->path_ = pack_path;
+  if (auto error = MappedFile::open(pack_path, pack->pack_)) {
+    return error;
+  }
+  auto index_path = pack_path;
+  index_path.replace_extension(".idx");
+  if (auto error = MappedFile::open(index_path, pack->index_)) {
+    return error;
+  }
+
+  auto corrupt = [&](const char *what) {
+    return create_error(ErrorCode::CorruptObject,
+                        std::string(what) + ": " + pack_path.string());
+  };
+
+  const auto *pack_data = pack->pack_.data();
+  if (pack->pack_.size() < pack_header_size + ObjectId::size ||
+      std::memcmp(pack_data, "CPAK", 4) != 0 || load_u32(pack_data + 4) != 1) {
+    return corrupt("Not a pack file");
+  }
+
+  const auto *index_data = pack->index_.data();
+  if (pack->index_.size() < index_header_size + fanout_size ||
+      std::memcmp(index_data, "CPIX", 4) != 0 ||
+      load_u32(index_data + 4) != 1) {
+    return corrupt("Not a pack index");
+  }
+  pack->count_ = load_u32(index_data + 8);
+  std::uint64_t expected = index_header_size + fanout_size +
+                           std::uint64_t(pack->count_) * (ObjectId::size + 8) +
+                           ObjectId::size;
+  if (pack->index_.size() != expected ||
+      load_u32(pack_data + 8) != pack->count_ ||
+      std::memcmp(index_data + expected - ObjectId::size,
+                  pack_data + pack->pack_.size() - ObjectId::size,
+                  ObjectId::size) != 0) {
+    return corrupt("Pack index does not match pack");
+  }
+
+  pack->fanout_ = index_data + index_header_size;
+  // find() trusts the fanout to bound its search within the id table
+  std::uint32_t previous = 0;
+  for (std::size_t bucket = 0; bucket < 256; ++bucket) {
+    auto value = load_u32(pack->fanout_ + bucket * 4);
+    if (value < previous || value > pack->count_) {
+      return corrupt("Bad fanout table in pack index");
+    }
+    previous = value;
+  }
+  if (previous != pack->count_) {
+    return corrupt("Bad fanout table in pack index");
+  }
+  std::memcpy(pack->checksum_.bytes.data(),
+              pack_data + pack->pack_.size() - ObjectId::size,
+              ObjectId::size);
+  pack->ids_ = pack->fanout_ + fanout_size;
+  pack->offsets_ = pack->ids_ + pack->count_ * ObjectId::size;
+  out = std::move(pack);
+  return std::nullopt;
+}
+
+std::optional<std::uint64_t> PackFile::find(const ObjectId &id) const {
+  if (auto i = find_index(id)) {
+    return offset_at(*i);
+  }
+  return std::nullopt;
+}
+
+std::optional<std::size_t> PackFile::find_index(const ObjectId &id) const {
+  std::uint8_t first = id.bytes[0];
+  std::size_t low = (first == 0) ? 0 : load_u32(fanout_ + (first - 1) * 4);
+  std::size_t high = load_u32(fanout_ + first * 4);
+
+  while (low < high) {
+    std::size_t mid = low + (high - low) / 2;
+    int cmp = std::memcmp(ids_ + mid * ObjectId::size, id.bytes.data(),
+                          ObjectId::size);
+    if (cmp == 0) {
+      return mid;
+    }
+    if (cmp < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return std::nullopt;
+}
+
+ObjectId PackFile::id_at(std::size_t i) const {
+  ObjectId id;
+  std::memcpy(id.bytes.data(), ids_ + i * ObjectId::size, ObjectId::size);
+  return id;
+}
+
+std::uint64_t PackFile::offset_at(std::size_t i) const {
+  return load_u64(offsets_ + i * 8);
+}
+
+std::optional<ObjectType> PackFile::type_at(std::size_t i) const {
+  auto offset = offset_at(i);
+  if (offset < pack_header_size || offset >= pack_.size() - ObjectId::size) {
+    return std::nullopt;
+  }
+  int kind = pack_.data()[offset] & ~(pack_delta_flag | pack_compressed_flag);
+  if (!is_object_kind(kind)) {
+    return std::nullopt;
+  }
+  return static_cast<ObjectType>(kind);
+}
+
+ObjectId PackFile::checksum() const {
+  return checksum_;
+}
+
+void PackFile::load_reverse_index() const {
+  std::call_once(reverse_once_, [this] {
+    auto path = path_;
+    path.replace_extension(".rev");
+    // A missing, stale or damaged .rev is only a lost shortcut
+    MappedFile file;
+    if (!MappedFile::open(path, file) &&
+        file.size() == reverse_header_size + count_ * 4 + ObjectId::size &&
+        std::memcmp(file.data(), "CRIX", 4) == 0 &&
+        load_u32(file.data() + 4) == 1 && load_u32(file.data() + 8) == count_ &&
+        std::memcmp(file.data() + file.size() - ObjectId::size,
+                    pack_.data() + pack_.size() - ObjectId::size,
+                    ObjectId::size) == 0) {
+      reverse_file_ = std::move(file);
+      reverse_ = reverse_file_.data() + reverse_header_size;
+      return;
+    }
+    reverse_built_.resize(count_);
+    std::iota(reverse_built_.begin(), reverse_built_.end(), 0);
+    std::sort(reverse_built_.begin(), reverse_built_.end(),
+              [this](std::uint32_t a, std::uint32_t b) {
+                return offset_at(a) < offset_at(b);
+              });
+    reverse_ = reinterpret_cast<const std::uint8_t *>(reverse_built_.data());
+  });
+}
+
+std::size_t PackFile::index_at_position(std::size_t pos) const {
+  load_reverse_index();
+  return load_u32(reverse_ + pos * 4);
+}
+
+std::size_t PackFile::position_of(std::size_t index_pos) const {
+  load_reverse_index();
+  auto offset = offset_at(index_pos);
+  std::size_t low = 0;
+  std::size_t high = count_;
+  while (low < high) {
+    std::size_t mid = low + (high - low) / 2;
+    auto mid_offset = offset_at(load_u32(reverse_ + mid * 4));
+    if (mid_offset == offset) {
+      return mid;
+    }
+    if (mid_offset < offset) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return count_; // not reached for a valid index position
+}
+
+std::optional<Error> PackFile::read(std::uint64_t offset,
+                                    DeltaBaseCache &cache,
+                                    ObjectView &out) const {
+  return resolve(offset, cache, out, 0);
+}
+
+std::optional<Error> PackFile::resolve(std::uint64_t offset,
+                                       DeltaBaseCache &cache, ObjectView &out,
+                                       int depth) const {
+  auto corrupt = [&](const char *what) {
+    return create_error(ErrorCode::CorruptObject,
+                        std::string(what) + " at offset " +
+                            std::to_string(offset) + " in " + path_.string());
+  };
+
+  std::size_t body_end = pack_.size() - ObjectId::size;
+  if (offset < pack_header_size || offset >= body_end ||
+      depth > max_delta_depth) {
+    return corrupt("Bad pack entry");
+  }
+
+  auto in = pack_.view().substr(offset, body_end - offset);
+  auto kind = static_cast<std::uint8_t>(in.front());
+  in.remove_prefix(1);
+  std::uint64_t size;
+  if (!read_varint(in, size)) {
+    return corrupt("Truncated pack entry");
+  }
+
+  constexpr auto flags = pack_delta_flag | pack_compressed_flag;
+  auto type = static_cast<ObjectType>(kind & ~flags);
+  if (!is_object_kind(kind & ~flags)) {
+    return corrupt("Unknown pack entry kind");
+  }
+  bool delta = (kind & pack_delta_flag) != 0;
+  bool compressed = (kind & pack_compressed_flag) != 0;
+  if (!delta && !compressed) {
+    if (size > in.size()) {
+      return corrupt("Truncated pack entry");
+    }
+    out = ObjectView(type, in.substr(0, size), shared_from_this());
+    return std::nullopt;
+  }
+
+  // Reconstructed objects may themselves be bases of later deltas
+  if (auto cached = cache.get(checksum_, offset)) {
+    out = ObjectView(type, *cached, cached);
+    return std::nullopt;
+  }
+
+  std::uint64_t distance = 0;
+  std::uint64_t stored_size;
+  if ((delta && (!read_varint(in, distance) || distance == 0 ||
+                 distance > offset)) ||
+      !read_varint(in, stored_size) || stored_size > in.size()) {
+    return corrupt(delta ? "Bad delta entry" : "Bad compressed entry");
+  }
+  auto payload = in.substr(0, stored_size);
+  std::string expanded;
+  if (compressed) {
+    std::string_view stream = payload;
+    auto error = decompress(stream, [&](std::string_view chunk) {
+      expanded.append(chunk);
+      return std::optional<Error>();
+    });
+    if (error || !stream.empty()) {
+      return corrupt("Bad compressed entry");
+    }
+    payload = expanded;
+  }
+
+  auto content = std::make_shared<std::string>();
+  if (delta) {
+    ObjectView base;
+    if (auto error = resolve(offset - distance, cache, base, depth + 1)) {
+      return error;
+    }
+    if (auto error = apply_delta(base.content(), payload, *content)) {
+      return corrupt("Bad delta");
+    }
+  } else {
+    *content = std::move(expanded);
+  }
+  if (content->size() != size) {
+    return corrupt(delta ? "Delta result size mismatch"
+                         : "Compressed entry size mismatch");
+  }
+
+  std::shared_ptr<const std::string> shared = std::move(content);
+  cache.put(checksum_, offset, shared);
+  out = ObjectView(type, *shared, shared);
+  return std::nullopt;
+}
+
+} // namespace chrona
@@ -0,0 +1,149 @@
+#pragma once
+
+#include "errors/error.hpp"
+#include "io/mapped_file.hpp"
+#include "objects/object.hpp"
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+namespace chrona {
+
+// Pack layout (version 1, integers little-endian unless noted):
+//
+//   "CPAK" u32 version u32 object_count
+//   entry*      u8 kind, varint content size, then
+//                 full (kind = type):          <content>
+//                 delta (kind = 0x80 | type):  varint distance back to the
+//                                              base entry, varint delta
+//                                              size, <delta>
+//               with 0x40 set in kind, the content or delta is replaced by
+//               varint stored size, <compressed stream>
+//   trailer     SHA-256 of everything above
+//
+// Index layout (pack-<name>.idx):
+//
+//   "CPIX" u32 version u32 object_count
+//   u32 fanout[256]      objects whose first id byte is <= i
+//   ids[object_count]    32 bytes each, sorted
+//   u64 offsets[object_count]
+//   pack trailer (32 bytes)
+//
+// Reverse index layout (pack-<name>.rev), entries in pack order:
+//
+//   "CRIX" u32 version u32 object_count
+//   u32 index_positions[object_count]   sorted by pack offset
+//   pack trailer (32 bytes)
+constexpr std::uint8_t pack_delta_flag = 0x80;
+constexpr std::uint8_t pack_compressed_flag = 0x40;
+
+// Unlinks the .idx first, which hides the pack from readers, then the
+// pack itself and the files that describe it.
+void remove_pack_files(const std::filesystem::path &pack_path);
+
+// Bounded LRU of reconstructed delta bases, keyed by the pack's checksum
+// and the entry offset, so an entry stays valid across reload_packs() and
+// can never be served for a different pack. Shared by all threads reading
+// through one ObjectStore.
+class DeltaBaseCache {
+public:
+  explicit DeltaBaseCache(std::size_t max_bytes = 64 << 20)
+      : max_bytes_(max_bytes) {}
+
+  std::shared_ptr<const std::string> get(const ObjectId &pack,
+                                         std::uint64_t offset);
+  void put(const ObjectId &pack, std::uint64_t offset,
+           std::shared_ptr<const std::string> content);
+
+  std::size_t hits() const { return hits_.load(); }
+  std::size_t misses() const { return misses_.load(); }
+
+private:
+  struct Key {
+    ObjectId pack;
+    std::uint64_t offset;
+    bool operator==(const Key &) const = default;
+  };
+  struct KeyHash {
+    std::size_t operator()(const Key &key) const {
+      return ObjectIdHash()(key.pack) ^ (key.offset * 0x9E3779B97F4A7C15ULL);
+    }
+  };
+  using Entry = std::pair<Key, std::shared_ptr<const std::string>>;
+
+  std::mutex mutex_;
+  std::size_t max_bytes_;
+  std::size_t bytes_ = 0;
+  std::atomic<std::size_t> hits_{0};
+  std::atomic<std::size_t> misses_{0};
+  std::list<Entry> lru_; // most recently used at the front
+  std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> map_;
+};
+
+class PackFile : public std::enable_shared_from_this<PackFile> {
+public:
+  // Opens `<name>.pack` together with its `<name>.idx`.
+  static std::optional<Error> open(const std::filesystem::path &pack_path,
+                                   std::shared_ptr<PackFile> &out);
+
+  const std::filesystem::path &path() const { return path_; }
+  std::size_t size() const { return count_; }
+
+  // Fanout bucket + binary search over the mmapped id table; allocation-free.
+  std::optional<std::uint64_t> find(const ObjectId &id) const;
+  // The same search, returning the position in the index (id order).
+  std::optional<std::size_t> find_index(const ObjectId &id) const;
+
+  ObjectId id_at(std::size_t i) const;
+  std::uint64_t offset_at(std::size_t i) const;
+  // The type recorded in the entry header, without reading the entry;
+  // nullopt for a corrupt header.
+  std::optional<ObjectType> type_at(std::size_t i) const;
+  // The pack trailer, which names the pack and ties side files to it.
+  ObjectId checksum() const;
+
+  // Pack order, from the reverse index: the index position of the entry
+  // at pack position `pos`, and the other way round (a binary search by
+  // offset). The .rev file is read when present and built in memory on
+  // first use otherwise.
+  std::size_t index_at_position(std::size_t pos) const;
+  std::size_t position_of(std::size_t index_pos) const;
+
+  // Full entries are returned as views into the pack mapping; deltas and
+  // compressed entries are rebuilt (through `cache`) into a buffer owned
+  // by the view.
+  std::optional<Error> read(std::uint64_t offset, DeltaBaseCache &cache,
+                            ObjectView &out) const;
+
+  // Starts reading the entries in [begin, end) in from disk.
+  void prefetch(std::uint64_t begin, std::uint64_t end) const {
+    pack_.prefetch(begin, end - begin);
+  }
+
+private:
+  std::optional<Error> resolve(std::uint64_t offset, DeltaBaseCache &cache,
+                               ObjectView &out, int depth) const;
+  void load_reverse_index() const;
+
+  std::filesystem::path path_;
+  MappedFile pack_;
+  MappedFile index_;
+  mutable std::once_flag reverse_once_;
+  mutable MappedFile reverse_file_;
+  mutable std::vector<std::uint32_t> reverse_built_;
+  mutable const std::uint8_t *reverse_ = nullptr;
+  ObjectId checksum_;
+  const std::uint8_t *fanout_ = nullptr;
+  const std::uint8_t *ids_ = nullptr;
+  const std::uint8_t *offsets_ = nullptr;
+  std::size_t count_ = 0;
+};
+
+} // namespace chrona
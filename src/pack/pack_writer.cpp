@@ -0,0 +1,360 @@
+#include "pack_writer.hpp"
+#include "hash/sha256.hpp"
+#include "io/file_io.hpp"
+#include "pack/delta.hpp"
+#include "pack/pack.hpp"
+#include "pack/varint.hpp"
+#include "snapshot/tree.hpp"
+#include "trace/trace.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <numeric>
+#include <sys/stat.h>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace chrona {
+
+namespace {
+
+// Objects smaller than this are never worth a delta
+constexpr std::size_t min_delta_size = 64;
+// Nor worth compressing
+constexpr std::size_t min_compress_size = 64;
+
+// Only what ordering needs; contents are read again while writing, so a
+// pack of any size holds no more than a delta window of objects open.
+struct Candidate {
+  ObjectId id;
+  ObjectType type = ObjectType::Blob;
+  std::uint64_t size = 0;
+  std::uint32_t name_hash = 0;
+  std::size_t depth = 0;
+  std::uint64_t offset = 0;
+};
+
+// Weighted towards the last characters so "a/foo.c" and "b/bar.c" sort
+// next to each other.
+std::uint32_t hash_name(std::string_view name) {
+  std::uint32_t hash = 0;
+  for (char c : name) {
+    if (c == ' ' || c == '\t' || c == '\n') {
+      continue;
+    }
+    hash = (hash >> 2) + (static_cast<std::uint32_t>(
+                              static_cast<unsigned char>(c))
+                          << 24);
+  }
+  return hash;
+}
+
+void append_u32(std::string &out, std::uint32_t value) {
+  out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+void append_u64(std::string &out, std::uint64_t value) {
+  out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+// Picks the best delta for objects[i] against the window before it, whose
+// contents are in `views` (slot k % views.size() for object k). Returns
+// the base's index, or SIZE_MAX to store the object whole.
+std::size_t choose_delta(const std::vector<Candidate> &objects,
+                         const std::vector<ObjectView> &views, std::size_t i,
+                         const PackOptions &options, std::string &delta) {
+  delta.clear();
+  auto content = views[i % views.size()].content();
+  if (content.size() < min_delta_size) {
+    return SIZE_MAX;
+  }
+  std::size_t best = SIZE_MAX;
+  std::size_t first = i > options.window ? i - options.window : 0;
+  for (std::size_t j = i; j-- > first;) {
+    const auto &base = objects[j];
+    if (base.type != objects[i].type || base.depth >= options.max_depth ||
+        base.size < min_delta_size || base.size > content.size() * 4 ||
+        base.size * 4 < content.size()) {
+      continue;
+    }
+
+    // Anything over half the target is not worth the reconstruction cost
+    std::size_t limit = best == SIZE_MAX ? content.size() / 2 : delta.size();
+    auto candidate =
+        create_delta(views[j % views.size()].content(), content);
+    if (candidate.size() < limit) {
+      delta = std::move(candidate);
+      best = j;
+    }
+  }
+  return best;
+}
+
+// Blobs stored loose as chunk lists (see ObjectStore), from the ids in
+// objects/chunked. They are never packed: their chunks are, as blobs of
+// their own, so versions that share chunks keep sharing them.
+std::optional<Error>
+loose_chunked(const ObjectStore &store,
+              std::unordered_set<ObjectId, ObjectIdHash> &out) {
+  std::string ids;
+  if (auto error = read_file(store.chunked_list_path(), ids)) {
+    return error->error_code == ErrorCode::NotFound ? std::nullopt : error;
+  }
+  std::vector<ChunkRef> chunks;
+  for (std::size_t at = 0; at + ObjectId::size <= ids.size();
+       at += ObjectId::size) {
+    ObjectId id;
+    std::memcpy(id.bytes.data(), ids.data() + at, ObjectId::size);
+    if (out.count(id) || !store.contains_loose(id)) {
+      continue;
+    }
+    if (auto error = store.read_chunk_list(id, chunks)) {
+      if (error->error_code == ErrorCode::NotFound) {
+        continue; // pruned since
+      }
+      return error;
+    }
+    if (!chunks.empty()) {
+      out.insert(id);
+    }
+  }
+  return std::nullopt;
+}
+
+} // namespace
+
+std::optional<Error> write_pack(const std::filesystem::path &pack_dir,
+                                const ObjectStore &store,
+                                std::vector<ObjectId> ids, PackResult &out,
+                                const PackOptions &options) {
+  CHRONA_TRACE_SCOPE("write_pack");
+  out = PackResult();
+  std::sort(ids.begin(), ids.end());
+  ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+  if (ids.size() > UINT32_MAX) {
+    return create_error(ErrorCode::InvalidArgument, "Too many objects to pack");
+  }
+
+  std::unordered_set<ObjectId, ObjectIdHash> chunked;
+  if (auto error = loose_chunked(store, chunked)) {
+    return error;
+  }
+  if (!chunked.empty()) {
+    auto kept = std::stable_partition(
+        ids.begin(), ids.end(),
+        [&](const ObjectId &id) { return !chunked.count(id); });
+    out.chunked.assign(kept, ids.end());
+    ids.erase(kept, ids.end());
+  }
+
+  std::vector<Candidate> objects(ids.size());
+  std::unordered_map<ObjectId, std::uint32_t, ObjectIdHash> names;
+  Arena arena;
+  for (std::size_t i = 0; i < ids.size(); ++i) {
+    objects[i].id = ids[i];
+    ObjectView view;
+    if (auto error = store.read(ids[i], view)) {
+      return error;
+    }
+    objects[i].type = view.type();
+    objects[i].size = view.size();
+    if (view.type() != ObjectType::Tree) {
+      continue;
+    }
+    arena.reset();
+    TreeView tree;
+    if (parse_tree(view.content(), arena, tree)) {
+      continue; // packed as-is; it just gets no name hints
+    }
+    for (const auto &entry : tree.entries) {
+      names.emplace(entry.id(), hash_name(entry.name));
+    }
+  }
+  for (auto &object : objects) {
+    auto it = names.find(object.id);
+    if (it != names.end()) {
+      object.name_hash = it->second;
+    }
+  }
+
+  // Bases always precede their deltas in this order, which is also the
+  // write order, so a delta only ever points backwards
+  std::sort(objects.begin(), objects.end(),
+            [](const Candidate &a, const Candidate &b) {
+              if (a.type != b.type) {
+                return a.type < b.type;
+              }
+              if (a.name_hash != b.name_hash) {
+                return a.name_hash < b.name_hash;
+              }
+              if (a.size != b.size) {
+                return a.size > b.size;
+              }
+              return a.id < b.id;
+            });
+
+  if (::mkdir(pack_dir.c_str(), 0755) != 0 && errno != EEXIST) {
+    return errno_error("Cannot create pack directory", pack_dir);
+  }
+  TempFile file;
+  if (auto error = TempFile::create(pack_dir, file)) {
+    return error;
+  }
+
+  Sha256 hasher;
+  std::uint64_t offset = 0;
+  std::string buffer;
+  auto flush = [&]() -> std::optional<Error> {
+    hasher.update(buffer);
+    offset += buffer.size();
+    auto error = file.write(buffer);
+    buffer.clear();
+    return error;
+  };
+
+  buffer.append("CPAK", 4);
+  append_u32(buffer, 1);
+  append_u32(buffer, static_cast<std::uint32_t>(objects.size()));
+
+  auto compression = options.compression.value_or(store.compression());
+  std::string packed;
+  std::string delta_buffer;
+  // The object being written and the delta window before it
+  std::vector<ObjectView> views(options.window + 1);
+  for (std::size_t i = 0; i < objects.size(); ++i) {
+    auto &object = objects[i];
+    auto &view = views[i % views.size()];
+    if (auto error = store.read(object.id, view)) {
+      return error;
+    }
+    if (view.type() != object.type || view.size() != object.size) {
+      return create_error(ErrorCode::CorruptObject,
+                          "Object changed while packing: " + object.id.hex());
+    }
+    auto base = choose_delta(objects, views, i, options, delta_buffer);
+    object.offset = offset + buffer.size();
+    auto type = static_cast<std::uint8_t>(object.type);
+    auto content = view.content();
+    bool delta = base != SIZE_MAX;
+    if (delta) {
+      object.depth = objects[base].depth + 1;
+    }
+    std::string_view payload = delta ? delta_buffer : content;
+    bool compressed = false;
+    if (compression.codec != Codec::None &&
+        payload.size() >= min_compress_size) {
+      packed = compress(payload, compression);
+      compressed = packed.size() < payload.size();
+    }
+
+    buffer += static_cast<char>(type | (delta ? pack_delta_flag : 0) |
+                                (compressed ? pack_compressed_flag : 0));
+    append_varint(buffer, content.size());
+    if (delta) {
+      append_varint(buffer, object.offset - objects[base].offset);
+      ++out.deltas;
+    }
+    if (compressed) {
+      append_varint(buffer, packed.size());
+      buffer.append(packed);
+    } else {
+      if (delta) {
+        append_varint(buffer, payload.size());
+      }
+      buffer.append(payload);
+    }
+    if (buffer.size() >= (1 << 20)) {
+      if (auto error = flush()) {
+        return error;
+      }
+    }
+  }
+  if (auto error = flush()) {
+    return error;
+  }
+
+  auto trailer = hasher.finish();
+  std::string_view trailer_view(reinterpret_cast<const char *>(trailer.data()),
+                                trailer.size());
+  if (auto error = file.write(trailer_view)) {
+    return error;
+  }
+  if (options.durable) {
+    if (auto error = file.sync()) {
+      return error;
+    }
+  }
+
+  ObjectId name;
+  std::memcpy(name.bytes.data(), trailer.data(), ObjectId::size);
+  auto pack_path = pack_dir / ("pack-" + name.hex() + ".pack");
+  if (auto error = file.commit(pack_path)) {
+    return error;
+  }
+
+  // The index lists objects by id, not in pack order
+  std::sort(objects.begin(), objects.end(),
+            [](const Candidate &a, const Candidate &b) { return a.id < b.id; });
+  std::string index;
+  index.reserve(12 + 256 * 4 + objects.size() * (ObjectId::size + 8) +
+                ObjectId::size);
+  index.append("CPIX", 4);
+  append_u32(index, 1);
+  append_u32(index, static_cast<std::uint32_t>(objects.size()));
+  std::size_t next = 0;
+  for (int bucket = 0; bucket < 256; ++bucket) {
+    while (next < objects.size() && objects[next].id.bytes[0] <= bucket) {
+      ++next;
+    }
+    append_u32(index, static_cast<std::uint32_t>(next));
+  }
+  for (const auto &object : objects) {
+    index.append(reinterpret_cast<const char *>(object.id.bytes.data()),
+                 ObjectId::size);
+  }
+  for (const auto &object : objects) {
+    append_u64(index, object.offset);
+  }
+  index.append(trailer_view);
+
+  // The reverse index lists index positions in pack (offset) order
+  std::vector<std::uint32_t> order(objects.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(),
+            [&](std::uint32_t a, std::uint32_t b) {
+              return objects[a].offset < objects[b].offset;
+            });
+  std::string reverse;
+  reverse.reserve(12 + order.size() * 4 + ObjectId::size);
+  reverse.append("CRIX", 4);
+  append_u32(reverse, 1);
+  append_u32(reverse, static_cast<std::uint32_t>(order.size()));
+  for (auto position : order) {
+    append_u32(reverse, position);
+  }
+  reverse.append(trailer_view);
+  auto reverse_path = pack_path;
+  reverse_path.replace_extension(".rev");
+  if (auto error =
+          write_file_atomic(reverse_path, reverse, options.durable)) {
+    return error;
+  }
+
+  auto index_path = pack_path;
+  index_path.replace_extension(".idx");
+  if (auto error = write_file_atomic(index_path, index, options.durable)) {
+    return error;
+  }
+  if (options.durable) {
+    if (auto error = fsync_directory(pack_dir)) {
+      return error;
+    }
+  }
+
+  out.path = pack_path;
+  out.objects = objects.size();
+  out.bytes = offset + trailer.size();
+  return std::nullopt;
+}
+
+} // namespace chrona
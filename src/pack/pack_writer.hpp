@@ -0,0 +1,44 @@
+#pragma once
+
+#include "compress/compress.hpp"
+#include "errors/error.hpp"
+#include "objects/object.hpp"
+#include "objects/object_store.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+namespace chrona {
+
+struct PackOptions {
+  std::size_t window = 10;    // candidate bases tried per object
+  std::size_t max_depth = 50; // longest delta chain a reader has to walk
+  bool durable = false;
+  // Entry payloads are compressed when that makes them smaller; unset
+  // uses the store's own setting.
+  std::optional<CompressionOptions> compression;
+};
+
+struct PackResult {
+  std::filesystem::path path;
+  std::size_t objects = 0;
+  std::size_t deltas = 0;
+  std::uint64_t bytes = 0;
+  // Requested blobs left loose because they are stored as chunk lists.
+  std::vector<ObjectId> chunked;
+};
+
+// Writes every object in `ids` (read through `store`) into a new pack in
+// `pack_dir`. Objects are ordered by type, then by the name they appear
+// under in the packed trees, then by size, so similar blobs land in the
+// same delta window. Only the delta window's objects are held in memory at
+// any time. A blob stored loose as a chunk list is not packed (its chunks
+// are) and goes to `out.chunked`, so callers must keep it loose. The .idx
+// is written last: a pack without one is ignored by readers.
+std::optional<Error> write_pack(const std::filesystem::path &pack_dir,
+                                const ObjectStore &store,
+                                std::vector<ObjectId> ids, PackResult &out,
+                                const PackOptions &options = {});
+
+} // namespace chrona
@@ -0,0 +1,124 @@
+#include "work_pool.hpp"
+#include <algorithm>
+
+namespace chrona {
+
+namespace {
+
+// Which pool (if any) the current thread works for, and its deque index
+thread_local const WorkPool *current_pool = nullptr;
+thread_local std::size_t current_index = 0;
+
+} // namespace
+
+WorkPool::WorkPool(std::size_t threads) {
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (std::size_t i = 0; i < threads; ++i) {
+    queues_.push_back(std::make_unique<Queue>());
+  }
+  for (std::size_t i = 0; i < threads; ++i) {
+    threads_.emplace_back([this, i] { worker_loop(i); });
+  }
+}
+
+WorkPool::~WorkPool() {
+  {
+    std::lock_guard lock(sleep_mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  for (auto &thread : threads_) {
+    thread.join();
+  }
+}
+
+void WorkPool::submit(Task task) {
+  std::size_t index = (current_pool == this)
+                          ? current_index
+                          : next_queue_.fetch_add(1) % queues_.size();
+
+  pending_.fetch_add(1);
+  {
+    // Counted under the sleep mutex so a worker about to sleep sees it
+    std::lock_guard lock(sleep_mutex_);
+    queued_.fetch_add(1);
+  }
+  {
+    std::lock_guard lock(queues_[index]->mutex);
+    queues_[index]->tasks.push_back(std::move(task));
+  }
+  wake_.notify_one();
+}
+
+void WorkPool::wait() {
+  std::unique_lock lock(sleep_mutex_);
+  done_.wait(lock, [this] { return pending_.load() == 0; });
+}
+
+void WorkPool::parallel_for(
+    std::size_t count, std::size_t grain,
+    const std::function<void(std::size_t, std::size_t)> &fn) {
+  grain = std::max<std::size_t>(grain, 1);
+  for (std::size_t begin = 0; begin < count; begin += grain) {
+    std::size_t end = std::min(count, begin + grain);
+    submit([&fn, begin, end] { fn(begin, end); });
+  }
+  wait();
+}
+
+bool WorkPool::try_pop(std::size_t self, Task &out) {
+  {
+    auto &own = *queues_[self];
+    std::lock_guard lock(own.mutex);
+    if (!own.tasks.empty()) {
+      out = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      queued_.fetch_sub(1);
+      return true;
+    }
+  }
+
+  for (std::size_t offset = 1; offset < queues_.size(); ++offset) {
+    auto &victim = *queues_[(self + offset) % queues_.size()];
+    std::lock_guard lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      out = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      queued_.fetch_sub(1);
+      return true;
+    }
+  }
+  return false;
+}
+
+void WorkPool::run(Task &task) {
+  task();
+  task = nullptr;
+  if (pending_.fetch_sub(1) == 1) {
+    std::lock_guard lock(sleep_mutex_);
+    done_.notify_all();
+  }
+}
+
+void WorkPool::worker_loop(std::size_t index) {
+  current_pool = this;
+  current_index = index;
+
+  Task task;
+  while (true) {
+    if (try_pop(index, task)) {
+      run(task);
+      continue;
+    }
+
+    std::unique_lock lock(sleep_mutex_);
+    wake_.wait(lock, [this] { return stopping_ || queued_.load() > 0; });
+    if (stopping_ && queued_.load() == 0) {
+      return;
+    }
+  }
+}
+
+} // namespace chrona
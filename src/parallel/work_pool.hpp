@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace chrona {
+
+// Fixed-size thread pool with one deque per worker. Workers pop their own
+// newest task first (depth-first, cache-warm) and steal the oldest task of
+// another worker when they run dry, so recursively spawned work spreads
+// across all cores without a central queue.
+class WorkPool {
+public:
+  using Task = std::function<void()>;
+
+  // threads == 0 uses std::thread::hardware_concurrency().
+  explicit WorkPool(std::size_t threads = 0);
+  ~WorkPool();
+
+  WorkPool(const WorkPool &) = delete;
+  WorkPool &operator=(const WorkPool &) = delete;
+
+  // Safe to call from inside a running task; the task then lands on the
+  // calling worker's own deque.
+  void submit(Task task);
+
+  // Blocks until every submitted task, including ones spawned by other
+  // tasks, has finished. Must not be called from inside a task.
+  void wait();
+
+  std::size_t size() const { return threads_.size(); }
+
+  // Splits [0, count) into chunks of at most `grain` and runs fn(begin, end)
+  // on the pool, returning when all chunks are done.
+  void parallel_for(std::size_t count, std::size_t grain,
+                    const std::function<void(std::size_t, std::size_t)> &fn);
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  bool try_pop(std::size_t self, Task &out);
+  void run(Task &task);
+  void worker_loop(std::size_t index);
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> threads_;
+  std::atomic<std::size_t> pending_{0};
+  std::atomic<std::size_t> queued_{0};
+  std::atomic<std::size_t> next_queue_{0};
+  bool stopping_ = false;
+  std::mutex sleep_mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+};
+
+} // namespace chrona
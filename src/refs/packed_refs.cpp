@@ -0,0 +1,255 @@
+#include "packed_refs.hpp"
+#include "io/file_io.hpp"
+#include "refs/refs.hpp"
+#include "refs/transaction.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace chrona {
+
+namespace {
+
+constexpr char packed_magic[4] = {'C', 'P', 'R', 'F'};
+constexpr std::uint32_t packed_version = 1;
+constexpr std::size_t header_size = 16;
+constexpr std::size_t record_size = 8 + ObjectId::size;
+
+std::uint32_t load_u32(const std::uint8_t *p) {
+  std::uint32_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+void append_u32(std::string &out, std::uint32_t value) {
+  out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+// Drops directories under refs/<kind>/ that the deleted loose refs left
+// empty; rmdir refuses any that still hold something.
+void prune_empty_parents(const std::filesystem::path &chrona_dir,
+                         const std::string &name) {
+  auto dir = (chrona_dir / name).parent_path();
+  auto stop = chrona_dir / "refs";
+  while (dir.parent_path() != stop && dir != stop &&
+         ::rmdir(dir.c_str()) == 0) {
+    dir = dir.parent_path();
+  }
+}
+
+} // namespace
+
+std::optional<Error> PackedRefs::open(const std::filesystem::path &path,
+                                      PackedRefs &out) {
+  out = PackedRefs();
+  if (auto error = MappedFile::open(path, out.file_)) {
+    if (error->error_code == ErrorCode::NotFound) {
+      return std::nullopt;
+    }
+    return error;
+  }
+
+  auto corrupt = [&] {
+    return create_error(ErrorCode::CorruptObject,
+                        "Corrupt packed refs: " + path.string());
+  };
+  const auto *data = out.file_.data();
+  const auto size = out.file_.size();
+  if (size < header_size || std::memcmp(data, packed_magic, 4) != 0 ||
+      load_u32(data + 4) != packed_version) {
+    return corrupt();
+  }
+  std::uint64_t count = load_u32(data + 8);
+  std::uint64_t names_size = load_u32(data + 12);
+  if (size != header_size + count * record_size + names_size) {
+    return corrupt();
+  }
+  out.count_ = count;
+  out.records_ = data + header_size;
+  out.names_ = reinterpret_cast<const char *>(out.records_) +
+               count * record_size;
+  // One pass over the offsets, so lookups never need bounds checks
+  for (std::size_t i = 0; i < count; ++i) {
+    const auto *record = out.records_ + i * record_size;
+    std::uint64_t end =
+        std::uint64_t(load_u32(record)) + load_u32(record + 4);
+    if (end > names_size) {
+      return corrupt();
+    }
+  }
+  return std::nullopt;
+}
+
+std::optional<Error>
+PackedRefs::load(const std::filesystem::path &path,
+                 std::shared_ptr<const PackedRefs> &out) {
+  // packed-refs is only ever renamed into place, so a new file shows up
+  // as a new inode; the cached mapping keeps the old inode alive, so its
+  // number cannot be reused in the meantime
+  struct Snapshot {
+    dev_t device = 0;
+    ino_t inode = 0;
+    std::shared_ptr<const PackedRefs> refs;
+  };
+  static std::mutex mutex;
+  static std::unordered_map<std::string, Snapshot> snapshots;
+
+  struct stat st;
+  if (::stat(path.c_str(), &st) != 0) {
+    if (errno != ENOENT) {
+      return errno_error("Cannot stat", path);
+    }
+    st.st_dev = 0;
+    st.st_ino = 0;
+  }
+  std::lock_guard lock(mutex);
+  auto &snapshot = snapshots[path.string()];
+  if (!snapshot.refs || snapshot.device != st.st_dev ||
+      snapshot.inode != st.st_ino) {
+    auto refs = std::make_shared<PackedRefs>();
+    if (st.st_ino != 0) {
+      if (auto error = open(path, *refs)) {
+        return error;
+      }
+    }
+    snapshot = Snapshot{st.st_dev, st.st_ino, std::move(refs)};
+  }
+  out = snapshot.refs;
+  return std::nullopt;
+}
+
+std::string_view PackedRefs::name(std::size_t i) const {
+  const auto *record = records_ + i * record_size;
+  return {names_ + load_u32(record), load_u32(record + 4)};
+}
+
+ObjectId PackedRefs::id(std::size_t i) const {
+  ObjectId out;
+  std::memcpy(out.bytes.data(), records_ + i * record_size + 8,
+              ObjectId::size);
+  return out;
+}
+
+std::size_t PackedRefs::lower_bound(std::string_view name) const {
+  std::size_t low = 0;
+  std::size_t high = count_;
+  while (low < high) {
+    std::size_t mid = low + (high - low) / 2;
+    if (this->name(mid) < name) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+std::optional<ObjectId> PackedRefs::find(std::string_view name) const {
+  auto pos = lower_bound(name);
+  if (pos == count_ || this->name(pos) != name) {
+    return std::nullopt;
+  }
+  return id(pos);
+}
+
+std::string
+encode_packed_refs(const std::vector<std::pair<std::string, ObjectId>> &refs) {
+  std::size_t names_size = 0;
+  for (const auto &[name, id] : refs) {
+    names_size += name.size();
+  }
+  std::string out;
+  out.reserve(header_size + refs.size() * record_size + names_size);
+  out.append(packed_magic, 4);
+  append_u32(out, packed_version);
+  append_u32(out, static_cast<std::uint32_t>(refs.size()));
+  append_u32(out, static_cast<std::uint32_t>(names_size));
+  std::uint32_t offset = 0;
+  for (const auto &[name, id] : refs) {
+    append_u32(out, offset);
+    append_u32(out, static_cast<std::uint32_t>(name.size()));
+    out.append(reinterpret_cast<const char *>(id.bytes.data()),
+               ObjectId::size);
+    offset += static_cast<std::uint32_t>(name.size());
+  }
+  for (const auto &[name, id] : refs) {
+    out += name;
+  }
+  return out;
+}
+
+std::optional<Error> pack_refs(const std::filesystem::path &chrona_dir,
+                               std::size_t &packed) {
+  packed = 0;
+  LockFile lock;
+  if (auto error =
+          LockFile::acquire(packed_refs_path(chrona_dir),
+                            RefTransaction::packed_lock_timeout, lock)) {
+    return error;
+  }
+  PackedRefs old;
+  if (auto error = PackedRefs::open(packed_refs_path(chrona_dir), old)) {
+    return error;
+  }
+  std::vector<std::pair<std::string, ObjectId>> loose;
+  if (auto error = list_loose_refs(chrona_dir, loose)) {
+    return error;
+  }
+
+  // Merge-join the two sorted lists; the loose value wins
+  std::vector<std::pair<std::string, ObjectId>> refs;
+  refs.reserve(old.size() + loose.size());
+  std::size_t i = 0;
+  for (const auto &ref : loose) {
+    for (; i < old.size() && old.name(i) < ref.first; ++i) {
+      refs.emplace_back(std::string(old.name(i)), old.id(i));
+    }
+    if (i < old.size() && old.name(i) == ref.first) {
+      ++i;
+    }
+    refs.push_back(ref);
+  }
+  for (; i < old.size(); ++i) {
+    refs.emplace_back(std::string(old.name(i)), old.id(i));
+  }
+
+  if (auto error = lock.write(encode_packed_refs(refs))) {
+    return error;
+  }
+  if (auto error = lock.sync()) {
+    return error;
+  }
+  if (auto error = lock.commit()) {
+    return error;
+  }
+  if (auto error = fsync_directory(chrona_dir)) {
+    return error;
+  }
+  packed = refs.size();
+
+  // A loose ref that a writer holds or has moved since stays loose; it
+  // overrides the packed value either way
+  for (const auto &[name, id] : loose) {
+    LockFile ref_lock;
+    if (LockFile::acquire(chrona_dir / name, std::chrono::milliseconds(0),
+                          ref_lock)) {
+      continue;
+    }
+    std::optional<ObjectId> current;
+    if (read_loose_ref(chrona_dir, name, current) || current != id) {
+      continue;
+    }
+    if (::unlink((chrona_dir / name).c_str()) != 0) {
+      return errno_error("Cannot remove", chrona_dir / name);
+    }
+    ref_lock.release();
+    prune_empty_parents(chrona_dir, name);
+  }
+  return std::nullopt;
+}
+
+} // namespace chrona
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "errors/error.hpp"
+#include "io/mapped_file.hpp"
+#include "objects/object.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace chrona {
+
+inline std::filesystem::path
+packed_refs_path(const std::filesystem::path &chrona_dir) {
+  return chrona_dir / "packed-refs";
+}
+
+// Packed refs layout (.chrona/packed-refs, little-endian), read in place:
+//
+//   "CPRF" u32 version u32 ref_count u32 names_size
+//   records[ref_count]   u32 name_offset u32 name_size id[32], sorted by
+//                        name
+//   names[names_size]    the ref names, back to back
+//
+// A loose ref file under refs/ overrides the packed entry of the same
+// name. The file is only ever replaced whole, under packed-refs.lock.
+class PackedRefs {
+public:
+  // A missing file opens as empty.
+  static std::optional<Error> open(const std::filesystem::path &path,
+                                   PackedRefs &out);
+  // The mapping shared by every caller in the process, opened again only
+  // when a stat shows the file was replaced, so a lookup costs one stat
+  // rather than an open and an mmap.
+  static std::optional<Error> load(const std::filesystem::path &path,
+                                   std::shared_ptr<const PackedRefs> &out);
+
+  std::size_t size() const { return count_; }
+  std::string_view name(std::size_t i) const;
+  ObjectId id(std::size_t i) const;
+
+  // Binary search over the mapped records; allocation-free.
+  std::optional<ObjectId> find(std::string_view name) const;
+  // The first position whose name is not less than `name`.
+  std::size_t lower_bound(std::string_view name) const;
+
+private:
+  MappedFile file_;
+  std::size_t count_ = 0;
+  const std::uint8_t *records_ = nullptr;
+  const char *names_ = nullptr;
+};
+
+// `refs` must be sorted by name and free of duplicates.
+std::string
+encode_packed_refs(const std::vector<std::pair<std::string, ObjectId>> &refs);
+
+// Folds every loose ref into packed-refs, then deletes the loose files
+// that still hold the value that was packed, so lookups and listings
+// stop opening one file per ref. `packed` receives the number of refs in
+// the new file.
+std::optional<Error> pack_refs(const std::filesystem::path &chrona_dir,
+                               std::size_t &packed);
+
+} // namespace chrona
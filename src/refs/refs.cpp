@@ -0,0 +1,208 @@
+#include "refs.hpp"
+#include "io/file_io.hpp"
+#include "refs/packed_refs.hpp"
+#include "refs/transaction.hpp"
+#include <algorithm>
+
+namespace chrona {
+
+namespace {
+
+std::string trim_newline(std::string text) {
+  while (!text.empty() && (text.back() == '\n' || text.back() == '\r')) {
+    text.pop_back();
+  }
+  return text;
+}
+
+} // namespace
+
+bool is_valid_ref_name(const std::string &name) {
+  if (name.rfind("refs/", 0) != 0 || name.back() == '/' ||
+      name.find("//") != std::string::npos ||
+      name.find("..") != std::string::npos || name.ends_with(".lock")) {
+    return false;
+  }
+  return std::none_of(name.begin(), name.end(), [](char c) {
+    return static_cast<unsigned char>(c) <= ' ' || c == '\\' || c == ':';
+  });
+}
+
+std::optional<Error> read_head(const std::filesystem::path &chrona_dir,
+                               std::string &ref_name) {
+  std::string contents;
+  if (auto error = read_file(chrona_dir / "HEAD", contents)) {
+    if (error->error_code == ErrorCode::NotFound) {
+      ref_name = default_branch_ref;
+      return std::nullopt;
+    }
+    return error;
+  }
+  contents = trim_newline(std::move(contents));
+  if (contents.rfind("ref: ", 0) != 0 ||
+      !is_valid_ref_name(contents.substr(5))) {
+    return create_error(ErrorCode::CorruptObject, "Malformed HEAD");
+  }
+  ref_name = contents.substr(5);
+  return std::nullopt;
+}
+
+std::optional<Error> write_head(const std::filesystem::path &chrona_dir,
+                                const std::string &ref_name) {
+  if (!is_valid_ref_name(ref_name)) {
+    return create_error(ErrorCode::InvalidArgument,
+                        "Invalid ref name: " + ref_name);
+  }
+  return write_file_atomic(chrona_dir / "HEAD", "ref: " + ref_name + "\n",
+                           true);
+}
+
+std::optional<Error> read_loose_ref(const std::filesystem::path &chrona_dir,
+                                    const std::string &name,
+                                    std::optional<ObjectId> &out) {
+  out.reset();
+  if (!is_valid_ref_name(name)) {
+    return create_error(ErrorCode::InvalidArgument,
+                        "Invalid ref name: " + name);
+  }
+  std::string contents;
+  if (auto error = read_file(chrona_dir / name, contents)) {
+    // Nor is a directory of refs below this name, or a path through a
+    // ref's file
+    std::error_code ec;
+    if (error->error_code == ErrorCode::NotFound ||
+        !std::filesystem::is_regular_file(chrona_dir / name, ec)) {
+      return std::nullopt;
+    }
+    return error;
+  }
+  auto id = ObjectId::from_hex(trim_newline(std::move(contents)));
+  if (!id) {
+    return create_error(ErrorCode::CorruptObject, "Malformed ref: " + name);
+  }
+  out = *id;
+  return std::nullopt;
+}
+
+std::optional<Error> read_ref(const std::filesystem::path &chrona_dir,
+                              const std::string &name,
+                              std::optional<ObjectId> &out) {
+  if (auto error = read_loose_ref(chrona_dir, name, out)) {
+    return error;
+  }
+  if (out) {
+    return std::nullopt;
+  }
+  // Read after the loose file was found missing: packing writes
+  // packed-refs before it deletes loose files, so this copy is new enough
+  std::shared_ptr<const PackedRefs> packed;
+  if (auto error = PackedRefs::load(packed_refs_path(chrona_dir), packed)) {
+    return error;
+  }
+  out = packed->find(name);
+  return std::nullopt;
+}
+
+std::optional<Error> write_ref(const std::filesystem::path &chrona_dir,
+                               const std::string &name, const ObjectId &id) {
+  RefTransaction transaction(chrona_dir);
+  transaction.update(name, id);
+  return transaction.commit();
+}
+
+std::optional<Error>
+list_loose_refs(const std::filesystem::path &chrona_dir,
+                std::vector<std::pair<std::string, ObjectId>> &out) {
+  out.clear();
+  std::error_code ec;
+  std::filesystem::recursive_directory_iterator it(chrona_dir / "refs", ec);
+  for (; !ec && it != std::filesystem::recursive_directory_iterator();
+       it.increment(ec)) {
+    if (!it->is_regular_file()) {
+      continue;
+    }
+    // Lock files and in-flight temp files
+    auto file = it->path().filename().string();
+    if (file.rfind(".tmp-", 0) == 0 || file.ends_with(".lock")) {
+      continue;
+    }
+    auto name = it->path().lexically_relative(chrona_dir).generic_string();
+    std::optional<ObjectId> id;
+    if (auto error = read_loose_ref(chrona_dir, name, id)) {
+      return error;
+    }
+    if (id) {
+      out.emplace_back(std::move(name), *id);
+    }
+  }
+  std::sort(out.begin(), out.end());
+  return std::nullopt;
+}
+
+std::optional<Error>
+list_refs(const std::filesystem::path &chrona_dir,
+          std::vector<std::pair<std::string, ObjectId>> &out) {
+  std::vector<std::pair<std::string, ObjectId>> loose;
+  if (auto error = list_loose_refs(chrona_dir, loose)) {
+    return error;
+  }
+  std::shared_ptr<const PackedRefs> snapshot;
+  if (auto error = PackedRefs::load(packed_refs_path(chrona_dir), snapshot)) {
+    return error;
+  }
+  const auto &packed = *snapshot;
+  out.clear();
+  out.reserve(loose.size() + packed.size());
+  std::size_t i = 0;
+  for (auto &ref : loose) {
+    for (; i < packed.size() && packed.name(i) < ref.first; ++i) {
+      out.emplace_back(std::string(packed.name(i)), packed.id(i));
+    }
+    if (i < packed.size() && packed.name(i) == ref.first) {
+      ++i;
+    }
+    out.push_back(std::move(ref));
+  }
+  for (; i < packed.size(); ++i) {
+    out.emplace_back(std::string(packed.name(i)), packed.id(i));
+  }
+  return std::nullopt;
+}
+
+std::optional<Error> resolve_revision(const std::filesystem::path &chrona_dir,
+                                      const std::string &spec, ObjectId &out) {
+  std::vector<std::string> candidates;
+  if (spec == "HEAD") {
+    std::string head;
+    if (auto error = read_head(chrona_dir, head)) {
+      return error;
+    }
+    candidates.push_back(head);
+  } else if (spec.rfind("refs/", 0) == 0) {
+    candidates.push_back(spec);
+  } else {
+    if (auto id = ObjectId::from_hex(spec)) {
+      out = *id;
+      return std::nullopt;
+    }
+    candidates.push_back("refs/heads/" + spec);
+    candidates.push_back("refs/tags/" + spec);
+  }
+
+  for (const auto &name : candidates) {
+    if (!is_valid_ref_name(name)) {
+      continue;
+    }
+    std::optional<ObjectId> id;
+    if (auto error = read_ref(chrona_dir, name, id)) {
+      return error;
+    }
+    if (id) {
+      out = *id;
+      return std::nullopt;
+    }
+  }
+  return create_error(ErrorCode::NotFound, "Unknown revision: " + spec);
+}
+
+} // namespace chrona
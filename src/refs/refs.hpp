@@ -0,0 +1,55 @@
+#pragma once
+
+#include "errors/error.hpp"
+#include "objects/object.hpp"
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace chrona {
+
+constexpr const char *default_branch_ref = "refs/heads/main";
+
+// HEAD holds "ref: <name>"; a repository without a HEAD file is on the
+// default branch.
+std::optional<Error> read_head(const std::filesystem::path &chrona_dir,
+                               std::string &ref_name);
+
+// Points HEAD at `ref_name`, which need not exist yet.
+std::optional<Error> write_head(const std::filesystem::path &chrona_dir,
+                                const std::string &ref_name);
+
+// A ref that does not exist yet (an unborn branch) leaves `out` empty.
+// The loose file under refs/ is tried first, then packed-refs.
+std::optional<Error> read_ref(const std::filesystem::path &chrona_dir,
+                              const std::string &name,
+                              std::optional<ObjectId> &out);
+
+// A one-update RefTransaction that sets `name` unconditionally.
+std::optional<Error> write_ref(const std::filesystem::path &chrona_dir,
+                               const std::string &name, const ObjectId &id);
+
+// Every ref, loose or packed, sorted by name.
+std::optional<Error>
+list_refs(const std::filesystem::path &chrona_dir,
+          std::vector<std::pair<std::string, ObjectId>> &out);
+
+// Only the loose files under refs/, ignoring packed-refs.
+std::optional<Error> read_loose_ref(const std::filesystem::path &chrona_dir,
+                                    const std::string &name,
+                                    std::optional<ObjectId> &out);
+std::optional<Error>
+list_loose_refs(const std::filesystem::path &chrona_dir,
+                std::vector<std::pair<std::string, ObjectId>> &out);
+
+// Accepts "HEAD", a full ref name, a branch name or a full hex id.
+std::optional<Error> resolve_revision(const std::filesystem::path &chrona_dir,
+                                      const std::string &spec, ObjectId &out);
+
+// Names end in neither "/" nor ".lock" (taken by lock files) and hold no
+// "..", "//", control characters, spaces, backslashes or colons.
+bool is_valid_ref_name(const std::string &name);
+
+} // namespace chrona
@@ -0,0 +1,235 @@
+#include "transaction.hpp"
+#include "io/file_io.hpp"
+#include "refs/packed_refs.hpp"
+#include "refs/refs.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <set>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace chrona {
+
+namespace {
+
+std::string describe(const std::optional<ObjectId> &id) {
+  return id ? id->hex().substr(0, 12) : std::string("nothing");
+}
+
+bool is_loose_file(const std::filesystem::path &path) {
+  struct stat st;
+  return ::stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+// A ref cannot be created where its name is a directory of other refs,
+// or below another ref: both live in one file system namespace.
+std::optional<Error> check_name_free(const std::filesystem::path &chrona_dir,
+                                     const PackedRefs &packed,
+                                     const std::string &name) {
+  for (auto slash = name.find('/', 5); slash != std::string::npos;
+       slash = name.find('/', slash + 1)) {
+    auto prefix = name.substr(0, slash);
+    if (is_loose_file(chrona_dir / prefix) || packed.find(prefix)) {
+      return create_error(ErrorCode::Conflict, "Cannot create " + name +
+                                                   ": " + prefix +
+                                                   " exists");
+    }
+  }
+  auto children = name + "/";
+  auto pos = packed.lower_bound(children);
+  bool taken = pos < packed.size() &&
+               packed.name(pos).substr(0, children.size()) == children;
+  std::error_code ec;
+  std::filesystem::recursive_directory_iterator it(chrona_dir / name, ec);
+  for (; !taken && !ec && it != std::filesystem::end(it); it.increment(ec)) {
+    auto file = it->path().filename().string();
+    taken = it->is_regular_file() && file.rfind(".tmp-", 0) != 0 &&
+            !file.ends_with(".lock");
+  }
+  if (taken) {
+    return create_error(ErrorCode::Conflict,
+                        "Cannot create " + name + ": refs exist below it");
+  }
+  return std::nullopt;
+}
+
+} // namespace
+
+void RefTransaction::update(const std::string &name, const ObjectId &id) {
+  updates_.push_back(RefUpdate{name, id, false, std::nullopt});
+}
+
+void RefTransaction::update(const std::string &name, const ObjectId &id,
+                            const std::optional<ObjectId> &old_id) {
+  updates_.push_back(RefUpdate{name, id, true, old_id});
+}
+
+void RefTransaction::create(const std::string &name, const ObjectId &id) {
+  update(name, id, std::nullopt);
+}
+
+void RefTransaction::remove(const std::string &name) {
+  updates_.push_back(RefUpdate{name, std::nullopt, false, std::nullopt});
+}
+
+void RefTransaction::remove(const std::string &name, const ObjectId &old_id) {
+  updates_.push_back(RefUpdate{name, std::nullopt, true, old_id});
+}
+
+std::optional<Error> RefTransaction::commit() {
+  auto updates = std::move(updates_);
+  updates_.clear();
+  std::sort(updates.begin(), updates.end(),
+            [](const RefUpdate &a, const RefUpdate &b) {
+              return a.name < b.name;
+            });
+  for (std::size_t i = 0; i < updates.size(); ++i) {
+    const auto &name = updates[i].name;
+    if (!is_valid_ref_name(name)) {
+      return create_error(ErrorCode::InvalidArgument,
+                          "Invalid ref name: " + name);
+    }
+    if (i > 0 && updates[i - 1].name == name) {
+      return create_error(ErrorCode::InvalidArgument,
+                          "Ref updated twice in one transaction: " + name);
+    }
+  }
+
+  // New names must not clash with existing refs as file and directory.
+  // Checked before locking, since a clash keeps the lock file from being
+  // created at all; like any creation race, the last writer loses
+  PackedRefs packed;
+  if (auto error = PackedRefs::open(packed_refs_path(chrona_dir_), packed)) {
+    return error;
+  }
+  for (std::size_t i = 0; i < updates.size(); ++i) {
+    const auto &update = updates[i];
+    if (!update.new_id) {
+      continue;
+    }
+    std::optional<ObjectId> current;
+    if (auto error = read_loose_ref(chrona_dir_, update.name, current)) {
+      return error;
+    }
+    if (current || packed.find(update.name)) {
+      continue;
+    }
+    if (auto error = check_name_free(chrona_dir_, packed, update.name)) {
+      return error;
+    }
+    // Nor may one transaction create a ref and another below it
+    if (i + 1 < updates.size() && updates[i + 1].new_id &&
+        updates[i + 1].name.rfind(update.name + "/", 0) == 0) {
+      return create_error(ErrorCode::Conflict,
+                          "Cannot create both " + update.name + " and " +
+                              updates[i + 1].name);
+    }
+  }
+
+  // Locks are taken in name order, so two transactions never wait on
+  // each other in a cycle
+  std::vector<LockFile> locks(updates.size());
+  for (std::size_t i = 0; i < updates.size(); ++i) {
+    if (auto error = LockFile::acquire(chrona_dir_ / updates[i].name,
+                                       lock_timeout, locks[i])) {
+      return error;
+    }
+  }
+
+  // With every lock held nobody else can move these refs; packed-refs
+  // only changes under them for refs that are loose anyway
+  if (auto error = PackedRefs::open(packed_refs_path(chrona_dir_), packed)) {
+    return error;
+  }
+  bool deleting = false;
+  for (const auto &update : updates) {
+    std::optional<ObjectId> current;
+    if (auto error = read_loose_ref(chrona_dir_, update.name, current)) {
+      return error;
+    }
+    if (!current) {
+      current = packed.find(update.name);
+    }
+    if (update.check_old && current != update.old_id) {
+      return create_error(ErrorCode::Conflict,
+                          "Ref " + update.name + " moved: expected " +
+                              describe(update.old_id) + ", found " +
+                              describe(current));
+    }
+    deleting = deleting || !update.new_id;
+  }
+
+  for (std::size_t i = 0; i < updates.size(); ++i) {
+    if (!updates[i].new_id) {
+      continue;
+    }
+    if (auto error = locks[i].write(updates[i].new_id->hex() + "\n")) {
+      return error;
+    }
+    if (auto error = locks[i].sync()) {
+      return error;
+    }
+  }
+
+  // Deleted refs leave packed-refs before their loose files go, so a
+  // reader never falls through to a stale packed value. packed-refs.lock
+  // stays held until the loose files are gone: a pack_refs() in between
+  // would copy them back into packed-refs. The new packed-refs is renamed
+  // into place beside the lock, not from it, for that reason.
+  LockFile packed_lock;
+  if (deleting) {
+    if (auto error = LockFile::acquire(packed_refs_path(chrona_dir_),
+                                       packed_lock_timeout, packed_lock)) {
+      return error;
+    }
+    if (auto error =
+            PackedRefs::open(packed_refs_path(chrona_dir_), packed)) {
+      return error;
+    }
+    std::set<std::string_view> deleted;
+    for (const auto &update : updates) {
+      if (!update.new_id) {
+        deleted.insert(update.name);
+      }
+    }
+    std::vector<std::pair<std::string, ObjectId>> kept;
+    kept.reserve(packed.size());
+    for (std::size_t i = 0; i < packed.size(); ++i) {
+      if (!deleted.count(packed.name(i))) {
+        kept.emplace_back(std::string(packed.name(i)), packed.id(i));
+      }
+    }
+    if (kept.size() != packed.size()) {
+      if (auto error = write_file_atomic(packed_refs_path(chrona_dir_),
+                                         encode_packed_refs(kept), true)) {
+        return error;
+      }
+    }
+  }
+
+  // Past this point nothing is checked any more; a failure can only come
+  // from the file system
+  std::set<std::filesystem::path> dirs;
+  for (std::size_t i = 0; i < updates.size(); ++i) {
+    auto path = chrona_dir_ / updates[i].name;
+    if (updates[i].new_id) {
+      if (auto error = locks[i].commit()) {
+        return error;
+      }
+    } else {
+      if (::unlink(path.c_str()) != 0 && errno != ENOENT) {
+        return errno_error("Cannot remove", path);
+      }
+      locks[i].release();
+    }
+    dirs.insert(path.parent_path());
+  }
+  for (const auto &dir : dirs) {
+    if (auto error = fsync_directory(dir)) {
+      return error;
+    }
+  }
+  return std::nullopt;
+}
+
+} // namespace chrona
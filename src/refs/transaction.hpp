@@ -0,0 +1,60 @@
+#pragma once
+
+#include "errors/error.hpp"
+#include "objects/object.hpp"
+#include <chrono>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace chrona {
+
+struct RefUpdate {
+  std::string name;
+  std::optional<ObjectId> new_id; // empty: delete the ref
+  // With check_old, the ref must hold old_id when the transaction
+  // commits (empty old_id: must not exist)
+  bool check_old = false;
+  std::optional<ObjectId> old_id;
+};
+
+// Updates to several refs that succeed or fail together. commit() locks
+// each ref through its own "<ref>.lock" (in name order, so writers never
+// deadlock), checks every expected old value with the locks held, and
+// only then renames the new values into place. Writers that touch other
+// refs never wait for each other.
+//
+// A failed check or a lock still held after the timeout leaves every ref
+// untouched, with Conflict or Locked. Readers do not lock: they see each
+// ref either before or after, but may see some refs of a committing
+// transaction updated before others.
+class RefTransaction {
+public:
+  static constexpr std::chrono::milliseconds lock_timeout{100};
+  static constexpr std::chrono::milliseconds packed_lock_timeout{1000};
+
+  explicit RefTransaction(std::filesystem::path chrona_dir)
+      : chrona_dir_(std::move(chrona_dir)) {}
+
+  // Sets `name` to `id` whatever it holds now.
+  void update(const std::string &name, const ObjectId &id);
+  // Moves `name` from `old_id` (empty: the ref must not exist yet) to `id`.
+  void update(const std::string &name, const ObjectId &id,
+              const std::optional<ObjectId> &old_id);
+  void create(const std::string &name, const ObjectId &id);
+  void remove(const std::string &name);
+  void remove(const std::string &name, const ObjectId &old_id);
+
+  const std::vector<RefUpdate> &updates() const { return updates_; }
+
+  // Applies every queued update, durably. The transaction is spent
+  // afterwards, whatever the outcome.
+  std::optional<Error> commit();
+
+private:
+  std::filesystem::path chrona_dir_;
+  std::vector<RefUpdate> updates_;
+};
+
+} // namespace chrona
@@ -1,26 +1,73 @@
 #include "repo.hpp"
+#include "io/file_io.hpp"
+#include "trace/trace.hpp"
+#include <algorithm>
 #include <filesystem>
 #include <optional>
+#include <string>
+#include <sys/stat.h>
+#include <system_error>
 
 namespace chrona {
 
 std::optional<std::filesystem::path>
-find_repo(const std::filesystem::path &start_path) {
-  auto current = start_path;
+find_repo(const std::filesystem::path &start_path,
+          const std::vector<std::filesystem::path> &ceilings) {
+  // Parents are found by trimming one string in place, so each level costs
+  // a single stat and no path allocations
+  std::string dir = std::filesystem::absolute(start_path).lexically_normal();
+  while (dir.size() > 1 && dir.back() == '/') {
+    dir.pop_back();
+  }
 
+  std::string probe;
   while (true) {
-    if (std::filesystem::exists(current / ".chrona")) {
-      return current;
+    probe.assign(dir);
+    if (probe.back() != '/') {
+      probe += '/';
+    }
+    probe += ".chrona";
+    struct stat st;
+    trace_count(TraceCounter::StatCalls);
+    if (::stat(probe.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+      return std::filesystem::path(dir);
     }
 
-    auto parent = current.parent_path();
-    if (parent == current || parent.empty()) {
+    auto slash = dir.rfind('/');
+    if (dir == "/" || slash == std::string::npos) {
+      break;
+    }
+    dir.resize(slash == 0 ? 1 : slash);
+    if (std::find(ceilings.begin(), ceilings.end(), dir) != ceilings.end()) {
       break;
     }
-    current = parent;
   }
 
   return {};
 }
 
+std::optional<Error> init_repo(const std::filesystem::path &root) {
+  auto chrona_dir = root / ".chrona";
+  if (std::filesystem::exists(chrona_dir)) {
+    return create_error(ErrorCode::AlreadyExists,
+                        "Repository already exists at " + root.string());
+  }
+
+  std::error_code ec;
+  for (const auto &dir : {chrona_dir / "objects", chrona_dir / "refs"}) {
+    std::filesystem::create_directories(dir, ec);
+    if (ec) {
+      return create_error(ErrorCode::IOError, "Cannot create " +
+                                                  dir.string() + ": " +
+                                                  ec.message());
+    }
+  }
+
+  if (auto error = write_file_atomic(chrona_dir / "HEAD",
+                                     "ref: refs/heads/main\n")) {
+    return error;
+  }
+  return write_file_atomic(chrona_dir / "config", "version = 1\n");
+}
+
 } // namespace chrona
\ No newline at end of file
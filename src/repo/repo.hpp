@@ -1,8 +1,20 @@
+#pragma once
+
+#include "errors/error.hpp"
 #include <filesystem>
+#include <optional>
+#include <vector>
 
 namespace chrona {
 
+// The nearest directory at or above `start_path` that holds a `.chrona`
+// directory. The walk never enters one of `ceilings` (absolute, normalised
+// paths), though `start_path` itself is always checked.
 std::optional<std::filesystem::path>
-find_repo(const std::filesystem::path &start_path);
+find_repo(const std::filesystem::path &start_path,
+          const std::vector<std::filesystem::path> &ceilings = {});
+
+// Creates the .chrona/ skeleton (objects, refs, HEAD, config) under root.
+std::optional<Error> init_repo(const std::filesystem::path &root);
 
-} // namespace chrona
\ No newline at end of file
+} // namespace chrona
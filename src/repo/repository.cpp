@@ -0,0 +1,321 @@
+#include "repository.hpp"
+#include "io/file_io.hpp"
+#include "objects/object_store.hpp"
+#include "parallel/work_pool.hpp"
+#include "refs/refs.hpp"
+#include "refs/transaction.hpp"
+#include "repo/repo.hpp"
+#include "trace/trace.hpp"
+#include <charconv>
+#include <cstdlib>
+#include <sys/stat.h>
+#include <vector>
+
+namespace chrona {
+
+namespace {
+
+std::string_view trim(std::string_view text) {
+  while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) {
+    text.remove_prefix(1);
+  }
+  while (!text.empty() && (text.back() == ' ' || text.back() == '\t' ||
+                           text.back() == '\r')) {
+    text.remove_suffix(1);
+  }
+  return text;
+}
+
+std::filesystem::path normalise(const std::filesystem::path &path) {
+  auto text = std::filesystem::absolute(path).lexically_normal().string();
+  while (text.size() > 1 && text.back() == '/') {
+    text.pop_back();
+  }
+  return text;
+}
+
+// Relative entries are ignored, as a ceiling only makes sense as a fixed
+// place in the filesystem
+std::vector<std::filesystem::path> ceiling_directories() {
+  std::vector<std::filesystem::path> out;
+  const char *variable = std::getenv("CHRONA_CEILING_DIRECTORIES");
+  if (variable == nullptr) {
+    return out;
+  }
+  std::string_view rest = variable;
+  while (!rest.empty()) {
+    auto colon = rest.find(':');
+    auto entry = rest.substr(0, colon);
+    if (!entry.empty() && entry.front() == '/') {
+      out.push_back(normalise(std::string(entry)));
+    }
+    if (colon == std::string_view::npos) {
+      break;
+    }
+    rest.remove_prefix(colon + 1);
+  }
+  return out;
+}
+
+std::optional<Error> check_chrona_dir(const std::filesystem::path &dir) {
+  struct stat st;
+  trace_count(TraceCounter::StatCalls);
+  if (::stat(dir.c_str(), &st) != 0) {
+    return errno_error("Cannot open repository", dir);
+  }
+  if (!S_ISDIR(st.st_mode)) {
+    return create_error(ErrorCode::InvalidArgument,
+                        "Not a directory: " + dir.string());
+  }
+  return std::nullopt;
+}
+
+} // namespace
+
+std::optional<Error> RepoConfig::parse(std::string_view text,
+                                       RepoConfig &out) {
+  out.values_.clear();
+  std::size_t line_number = 0;
+  while (!text.empty()) {
+    ++line_number;
+    auto end = text.find('\n');
+    auto line = trim(text.substr(0, end));
+    text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+    if (line.empty() || line.front() == '#') {
+      continue;
+    }
+    auto equals = line.find('=');
+    auto key = trim(line.substr(0, equals));
+    if (equals == std::string_view::npos || key.empty()) {
+      return create_error(ErrorCode::InvalidArgument,
+                          "Malformed config line " +
+                              std::to_string(line_number) + ": " +
+                              std::string(line));
+    }
+    out.values_[std::string(key)] = std::string(trim(line.substr(equals + 1)));
+  }
+  return std::nullopt;
+}
+
+std::optional<std::string_view> RepoConfig::get(std::string_view key) const {
+  auto it = values_.find(key);
+  if (it == values_.end()) {
+    return std::nullopt;
+  }
+  return it->second;
+}
+
+Repository::Repository() = default;
+Repository::~Repository() = default;
+Repository::Repository(Repository &&) noexcept = default;
+Repository &Repository::operator=(Repository &&) noexcept = default;
+
+std::optional<Error> Repository::discover(const std::filesystem::path &start,
+                                          Repository &out) {
+  CHRONA_TRACE_SCOPE("repo.discover");
+  auto cwd = normalise(start);
+
+  const char *variable = std::getenv("CHRONA_DIR");
+  if (variable != nullptr && *variable != '\0') {
+    // The rest of the tree finds its files under <root>/.chrona, so the
+    // override has to name a directory called that
+    auto chrona_dir = normalise(cwd / variable);
+    if (chrona_dir.filename() != ".chrona") {
+      return create_error(ErrorCode::InvalidArgument,
+                          "CHRONA_DIR must name a .chrona directory: " +
+                              chrona_dir.string());
+    }
+    if (auto error = check_chrona_dir(chrona_dir)) {
+      return error;
+    }
+    out = Repository();
+    out.root_ = chrona_dir.parent_path();
+    out.chrona_dir_ = std::move(chrona_dir);
+    out.cwd_ = std::move(cwd);
+    return std::nullopt;
+  }
+
+  auto found = find_repo(cwd, ceiling_directories());
+  if (!found) {
+    return create_error(ErrorCode::NotFound,
+                        "Not a Chrona repository (or any parent directory)");
+  }
+  out = Repository();
+  out.root_ = std::move(*found);
+  out.chrona_dir_ = out.root_ / ".chrona";
+  out.cwd_ = std::move(cwd);
+  return std::nullopt;
+}
+
+std::optional<Error> Repository::open(const std::filesystem::path &root,
+                                      Repository &out) {
+  auto normalised = normalise(root);
+  auto chrona_dir = normalised / ".chrona";
+  if (auto error = check_chrona_dir(chrona_dir)) {
+    return error;
+  }
+  out = Repository();
+  out.cwd_ = normalised;
+  out.root_ = std::move(normalised);
+  out.chrona_dir_ = std::move(chrona_dir);
+  return std::nullopt;
+}
+
+std::optional<Error> Repository::current(Repository *&out) {
+  static Repository repository;
+  static bool discovered = false;
+  if (!discovered) {
+    if (auto error =
+            discover(std::filesystem::current_path(), repository)) {
+      return error;
+    }
+    discovered = true;
+  }
+  out = &repository;
+  return std::nullopt;
+}
+
+ObjectStore &Repository::objects() {
+  if (!objects_) {
+    objects_ = std::make_unique<ObjectStore>(chrona_dir_ / "objects");
+    // A bad setting only changes how new objects are written, so it
+    // falls back to storing them whole and uncompressed rather than
+    // failing reads
+    const RepoConfig *settings = nullptr;
+    if (!config(settings)) {
+      CompressionOptions compression;
+      if (!read_compression(*settings, compression)) {
+        objects_->set_compression(compression);
+      }
+      ChunkingOptions chunking;
+      if (!read_chunking(*settings, chunking)) {
+        objects_->set_chunking(chunking);
+      }
+    }
+  }
+  return *objects_;
+}
+
+WorkPool &Repository::pool() {
+  if (!pool_) {
+    pool_ = std::make_unique<WorkPool>();
+  }
+  return *pool_;
+}
+
+std::optional<Error> read_compression(const RepoConfig &config,
+                                      CompressionOptions &out) {
+  out = CompressionOptions();
+  if (auto name = config.get("compression")) {
+    auto codec = parse_codec(*name);
+    if (!codec) {
+      return create_error(ErrorCode::InvalidArgument,
+                          "Unknown compression: " + std::string(*name));
+    }
+    out.codec = *codec;
+  }
+  if (auto level = config.get("compression.level")) {
+    int value = 0;
+    auto [end, ec] =
+        std::from_chars(level->data(), level->data() + level->size(), value);
+    if (ec != std::errc() || end != level->data() + level->size() ||
+        value < 1 || value > 9) {
+      return create_error(ErrorCode::InvalidArgument,
+                          "compression.level must be 1-9, got " +
+                              std::string(*level));
+    }
+    out.level = value;
+  }
+  return std::nullopt;
+}
+
+std::optional<Error> read_chunking(const RepoConfig &config,
+                                   ChunkingOptions &out) {
+  out = ChunkingOptions();
+  auto read_size = [&](std::string_view key, std::uint64_t low,
+                       std::uint64_t high,
+                       std::uint64_t &value) -> std::optional<Error> {
+    auto text = config.get(key);
+    if (!text) {
+      return std::nullopt;
+    }
+    auto [end, ec] =
+        std::from_chars(text->data(), text->data() + text->size(), value);
+    if (ec != std::errc() || end != text->data() + text->size() ||
+        value < low || value > high) {
+      return create_error(ErrorCode::InvalidArgument,
+                          std::string(key) + " must be " +
+                              std::to_string(low) + "-" +
+                              std::to_string(high) + ", got " +
+                              std::string(*text));
+    }
+    return std::nullopt;
+  };
+
+  std::uint64_t average = out.average_size;
+  if (auto error = read_size("chunking.average-size", 4096, 1 << 22, average)) {
+    return error;
+  }
+  if ((average & (average - 1)) != 0) {
+    return create_error(ErrorCode::InvalidArgument,
+                        "chunking.average-size must be a power of two");
+  }
+  out.average_size = static_cast<std::size_t>(average);
+  // Smaller blobs would be cut into a single chunk anyway
+  return read_size("chunking.min-size", out.max_chunk(), UINT64_MAX,
+                   out.min_blob_size);
+}
+
+std::optional<Error> Repository::config(const RepoConfig *&out) {
+  if (!config_) {
+    std::string text;
+    if (auto error = read_file(chrona_dir_ / "config", text)) {
+      if (error->error_code != ErrorCode::NotFound) {
+        return error;
+      }
+    }
+    auto parsed = std::make_unique<RepoConfig>();
+    if (auto error = RepoConfig::parse(text, *parsed)) {
+      return error;
+    }
+    config_ = std::move(parsed);
+  }
+  out = config_.get();
+  return std::nullopt;
+}
+
+std::optional<Error> Repository::head(std::string &ref_name) {
+  if (!head_) {
+    std::string name;
+    if (auto error = read_head(chrona_dir_, name)) {
+      return error;
+    }
+    head_ = std::move(name);
+  }
+  ref_name = *head_;
+  return std::nullopt;
+}
+
+std::optional<Error> Repository::resolve(const std::string &spec,
+                                         ObjectId &out) {
+  if (auto it = resolved_.find(spec); it != resolved_.end()) {
+    out = it->second;
+    return std::nullopt;
+  }
+  if (auto error = resolve_revision(chrona_dir_, spec, out)) {
+    return error;
+  }
+  resolved_.emplace(spec, out);
+  return std::nullopt;
+}
+
+std::optional<Error>
+Repository::update_ref(const std::string &name, const ObjectId &id,
+                       const std::optional<ObjectId> &old_id) {
+  resolved_.clear();
+  RefTransaction transaction(chrona_dir_);
+  transaction.update(name, id, old_id);
+  return transaction.commit();
+}
+
+} // namespace chrona
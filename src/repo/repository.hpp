@@ -0,0 +1,110 @@
+#pragma once
+
+#include "compress/compress.hpp"
+#include "errors/error.hpp"
+#include "objects/chunker.hpp"
+#include "objects/object.hpp"
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace chrona {
+
+class ObjectStore;
+class WorkPool;
+
+// `.chrona/config`: one "key = value" per line; blank lines and lines
+// starting with '#' are ignored.
+class RepoConfig {
+public:
+  static std::optional<Error> parse(std::string_view text, RepoConfig &out);
+
+  std::optional<std::string_view> get(std::string_view key) const;
+
+private:
+  std::map<std::string, std::string, std::less<>> values_;
+};
+
+// "compression = none|fast|dense" and "compression.level = 1-9" pick how
+// new objects are written; both are optional.
+std::optional<Error> read_compression(const RepoConfig &config,
+                                      CompressionOptions &out);
+
+// "chunking.min-size = <bytes>" stores blobs at least that large as
+// content-defined chunks; "chunking.average-size" (a power of two,
+// default 64 KiB) sets the chunk size. Without min-size nothing is
+// chunked.
+std::optional<Error> read_chunking(const RepoConfig &config,
+                                   ChunkingOptions &out);
+
+// Everything a command needs to know about the repository it runs in.
+// Discovery happens once; the config, HEAD, resolved revisions, the
+// object store and the work pool are opened on first use and then kept.
+//
+// Not thread-safe: the accessors are meant to be called from the thread
+// running the command, though the handles they return (the store, the
+// pool) may then be shared with workers as usual.
+class Repository {
+public:
+  Repository();
+  ~Repository();
+  Repository(Repository &&) noexcept;
+  Repository &operator=(Repository &&) noexcept;
+
+  // Walks up from `start` to the nearest directory holding `.chrona`,
+  // one stat per level. CHRONA_DIR, when set, names the `.chrona`
+  // directory and skips the walk; CHRONA_CEILING_DIRECTORIES is a
+  // ':'-separated list of absolute directories the walk never enters.
+  static std::optional<Error> discover(const std::filesystem::path &start,
+                                       Repository &out);
+
+  // Opens the repository rooted exactly at `root`, without a walk.
+  static std::optional<Error> open(const std::filesystem::path &root,
+                                   Repository &out);
+
+  // The process-wide context, discovered from the current directory on
+  // the first call. A failed discovery is not cached.
+  static std::optional<Error> current(Repository *&out);
+
+  const std::filesystem::path &root() const { return root_; }
+  const std::filesystem::path &chrona_dir() const { return chrona_dir_; }
+
+  // The directory discovery started from, used to resolve command-line
+  // paths without another getcwd.
+  const std::filesystem::path &cwd() const { return cwd_; }
+
+  ObjectStore &objects();
+  WorkPool &pool();
+
+  // A repository without a config file has an empty one.
+  std::optional<Error> config(const RepoConfig *&out);
+
+  // The ref HEAD points at; see read_head().
+  std::optional<Error> head(std::string &ref_name);
+
+  // resolve_revision(), memoised per spec.
+  std::optional<Error> resolve(const std::string &spec, ObjectId &out);
+
+  // Moves `name` from `old_id` (empty: unborn) to `id` as a one-update
+  // RefTransaction, failing with Conflict if another writer moved it
+  // first, and drops the memoised revisions.
+  std::optional<Error> update_ref(const std::string &name, const ObjectId &id,
+                                  const std::optional<ObjectId> &old_id);
+
+private:
+  std::filesystem::path root_;
+  std::filesystem::path chrona_dir_;
+  std::filesystem::path cwd_;
+
+  std::unique_ptr<ObjectStore> objects_;
+  std::unique_ptr<WorkPool> pool_;
+  std::unique_ptr<RepoConfig> config_;
+  std::optional<std::string> head_;
+  std::unordered_map<std::string, ObjectId> resolved_;
+};
+
+} // namespace chrona
@@ -0,0 +1,130 @@
+#include "tree.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+
+namespace chrona {
+
+namespace {
+
+bool is_known_mode(std::uint32_t mode) {
+  switch (static_cast<EntryMode>(mode)) {
+  case EntryMode::Directory:
+  case EntryMode::Regular:
+  case EntryMode::Executable:
+  case EntryMode::Symlink:
+    return true;
+  }
+  return false;
+}
+
+} // namespace
+
+bool is_valid_entry_name(std::string_view name) {
+  return !name.empty() && name != "." && name != ".." &&
+         name.find('/') == std::string_view::npos &&
+         name.find('\0') == std::string_view::npos;
+}
+
+std::string encode_tree(std::vector<TreeEntry> entries) {
+  std::sort(entries.begin(), entries.end(),
+            [](const TreeEntry &a, const TreeEntry &b) {
+              return a.name < b.name;
+            });
+
+  std::string out;
+  for (const auto &entry : entries) {
+    char mode[16];
+    auto [end, ec] = std::to_chars(mode, mode + sizeof(mode),
+                                   static_cast<std::uint32_t>(entry.mode), 8);
+    out.append(mode, end);
+    out += ' ';
+    out += entry.name;
+    out += '\0';
+    out.append(reinterpret_cast<const char *>(entry.id.bytes.data()),
+               ObjectId::size);
+  }
+  return out;
+}
+
+ObjectId TreeEntryView::id() const {
+  ObjectId out;
+  std::memcpy(out.bytes.data(), id_bytes.data(), ObjectId::size);
+  return out;
+}
+
+const TreeEntryView *TreeView::find(std::string_view name) const {
+  auto it = std::lower_bound(
+      entries.begin(), entries.end(), name,
+      [](const TreeEntryView &entry, std::string_view key) {
+        return entry.name < key;
+      });
+  return it != entries.end() && it->name == name ? &*it : nullptr;
+}
+
+std::optional<Error> parse_tree(std::string_view content, Arena &arena,
+                                TreeView &out) {
+  // Every entry ends in a NUL followed by the id, so counting NULs while
+  // skipping ids sizes the array exactly for well-formed trees
+  std::size_t count = 0;
+  for (std::size_t pos = 0; pos < content.size(); ++count) {
+    auto nul = content.find('\0', pos);
+    if (nul == std::string_view::npos) {
+      break;
+    }
+    pos = nul + 1 + ObjectId::size;
+  }
+  auto entries = arena.allocate_array<TreeEntryView>(count);
+
+  std::size_t parsed = 0;
+  while (!content.empty()) {
+    auto space = content.find(' ');
+    if (space == std::string_view::npos) {
+      return create_error(ErrorCode::CorruptObject, "Malformed tree entry");
+    }
+    std::uint32_t mode = 0;
+    auto [end, ec] =
+        std::from_chars(content.data(), content.data() + space, mode, 8);
+    if (ec != std::errc() || end != content.data() + space ||
+        !is_known_mode(mode)) {
+      return create_error(ErrorCode::CorruptObject, "Bad tree entry mode");
+    }
+
+    auto nul = content.find('\0', space + 1);
+    if (nul == std::string_view::npos ||
+        content.size() - nul - 1 < ObjectId::size || parsed == count) {
+      return create_error(ErrorCode::CorruptObject, "Truncated tree entry");
+    }
+    auto name = content.substr(space + 1, nul - space - 1);
+    if (!is_valid_entry_name(name) ||
+        (parsed > 0 && !(entries[parsed - 1].name < name))) {
+      return create_error(ErrorCode::CorruptObject,
+                          "Bad or unsorted tree entry name");
+    }
+
+    auto *id = reinterpret_cast<const std::uint8_t *>(content.data() + nul + 1);
+    new (&entries[parsed++]) TreeEntryView{
+        name, static_cast<EntryMode>(mode),
+        std::span<const std::uint8_t, ObjectId::size>(id, ObjectId::size)};
+    content.remove_prefix(nul + 1 + ObjectId::size);
+  }
+  out.entries = entries.first(parsed);
+  return std::nullopt;
+}
+
+std::optional<Error> decode_tree(std::string_view content,
+                                 std::vector<TreeEntry> &out) {
+  out.clear();
+  InlineArena<4096> arena;
+  TreeView tree;
+  if (auto error = parse_tree(content, arena, tree)) {
+    return error;
+  }
+  out.reserve(tree.entries.size());
+  for (const auto &entry : tree.entries) {
+    out.push_back(TreeEntry{std::string(entry.name), entry.mode, entry.id()});
+  }
+  return std::nullopt;
+}
+
+} // namespace chrona
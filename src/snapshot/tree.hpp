@@ -0,0 +1,59 @@
+#pragma once
+
+#include "errors/error.hpp"
+#include "memory/arena.hpp"
+#include "objects/object.hpp"
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace chrona {
+
+enum class EntryMode : std::uint32_t {
+  Directory = 0040000,
+  Regular = 0100644,
+  Executable = 0100755,
+  Symlink = 0120000,
+};
+
+struct TreeEntry {
+  std::string name;
+  EntryMode mode;
+  ObjectId id;
+};
+
+// Entries are encoded as "<octal mode> <name>\0<32-byte id>", sorted by name
+// so the same directory state always produces the same tree id.
+std::string encode_tree(std::vector<TreeEntry> entries);
+// Owning variant of parse_tree().
+std::optional<Error> decode_tree(std::string_view content,
+                                 std::vector<TreeEntry> &out);
+
+// A tree entry parsed in place: the name and the id point into the encoded
+// tree, so parsing copies nothing.
+struct TreeEntryView {
+  std::string_view name;
+  EntryMode mode;
+  std::span<const std::uint8_t, ObjectId::size> id_bytes;
+
+  ObjectId id() const;
+};
+
+struct TreeView {
+  std::span<const TreeEntryView> entries; // sorted by name
+
+  const TreeEntryView *find(std::string_view name) const;
+};
+
+// Parses `content` into entries allocated from `arena`. The views borrow
+// from `content`, which has to outlive them (for an ObjectView, keep the
+// view itself alive).
+std::optional<Error> parse_tree(std::string_view content, Arena &arena,
+                                TreeView &out);
+
+bool is_valid_entry_name(std::string_view name);
+
+} // namespace chrona
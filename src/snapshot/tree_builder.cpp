@@ -0,0 +1,419 @@
+#include "tree_builder.hpp"
+#include "io/file_io.hpp"
+#include "snapshot/tree.hpp"
+#include "trace/trace.hpp"
+#include <algorithm>
+#include <atomic>
+#include <dirent.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace chrona {
+
+namespace {
+
+struct DirNode {
+  std::filesystem::path path;
+  std::string relative; // path from the repository root, "" at the top
+  DirNode *parent = nullptr;
+  std::size_t slot = 0; // index of this directory in parent->entries
+
+  // Files occupy the first slots, subdirectories the rest. Every task owns
+  // its slots, so no locking is needed; empty names mark skipped slots.
+  std::vector<TreeEntry> entries;
+  std::vector<std::unique_ptr<DirNode>> children;
+  std::atomic<std::size_t> remaining{1};
+};
+
+class SnapshotBuilder {
+public:
+  SnapshotBuilder(ObjectStore &store, WorkPool &pool,
+                  const SnapshotOptions &options)
+      : store_(store), pool_(pool), options_(options) {}
+
+  std::optional<Error> run(const std::filesystem::path &root,
+                           SnapshotResult &out) {
+    root_.path = root;
+    root_.relative = options_.prefix;
+    pool_.submit([this] { scan(root_); });
+    pool_.wait();
+
+    if (error_) {
+      return error_;
+    }
+    out.root = root_id_;
+    out.files = files_.load();
+    out.hashed = hashed_.load();
+    out.directories = directories_.load();
+    out.bytes = bytes_.load();
+    return std::nullopt;
+  }
+
+private:
+  bool failed() const { return failed_.load(std::memory_order_relaxed); }
+
+  void fail(std::optional<Error> error) {
+    std::lock_guard lock(error_mutex_);
+    if (!error_) {
+      error_ = std::move(error);
+      failed_.store(true);
+    }
+  }
+
+  void scan(DirNode &node) {
+    if (!failed()) {
+      list(node);
+    }
+    complete(node);
+  }
+
+  void list(DirNode &node) {
+    DIR *dir = ::opendir(node.path.c_str());
+    if (dir == nullptr) {
+      fail(errno_error("Cannot open directory", node.path));
+      return;
+    }
+
+    std::vector<std::string> files;
+    std::vector<std::string> subdirs;
+    while (auto *entry = ::readdir(dir)) {
+      std::string_view name = entry->d_name;
+      if (name == "." || name == ".." ||
+          (node.relative.empty() && name == ".chrona")) {
+        continue;
+      }
+
+      auto type = entry->d_type;
+      if (type == DT_UNKNOWN) {
+        struct stat st;
+        trace_count(TraceCounter::StatCalls);
+        if (::lstat((node.path / name).c_str(), &st) != 0) {
+          continue;
+        }
+        type = S_ISDIR(st.st_mode)   ? DT_DIR
+               : S_ISREG(st.st_mode) ? DT_REG
+               : S_ISLNK(st.st_mode) ? DT_LNK
+                                     : DT_UNKNOWN;
+      }
+      if (type == DT_DIR) {
+        subdirs.emplace_back(name);
+      } else if (type == DT_REG || type == DT_LNK) {
+        files.emplace_back(name);
+      }
+    }
+    ::closedir(dir);
+
+    node.entries.resize(files.size() + subdirs.size());
+    for (std::size_t i = 0; i < files.size(); ++i) {
+      node.entries[i].name = std::move(files[i]);
+    }
+
+    std::size_t group = std::max<std::size_t>(options_.files_per_task, 1);
+    std::size_t groups = (files.size() + group - 1) / group;
+    node.remaining.fetch_add(groups + subdirs.size());
+
+    for (std::size_t begin = 0; begin < files.size(); begin += group) {
+      std::size_t end = std::min(files.size(), begin + group);
+      pool_.submit([this, &node, begin, end] {
+        if (!failed()) {
+          hash_files(node, begin, end);
+        }
+        complete(node);
+      });
+    }
+
+    for (std::size_t i = 0; i < subdirs.size(); ++i) {
+      auto &slot = node.entries[files.size() + i];
+      auto relative = join(node.relative, subdirs[i]);
+      // A directory outside the sparse cone keeps its staged tree unread
+      if (auto sparse = sparse_entry(relative)) {
+        slot = TreeEntry{std::move(subdirs[i]), EntryMode::Directory,
+                         options_.stat_cache->id(*sparse)};
+        complete(node);
+        continue;
+      }
+      auto child = std::make_unique<DirNode>();
+      child->path = node.path / subdirs[i];
+      child->relative = std::move(relative);
+      child->parent = &node;
+      child->slot = files.size() + i;
+      slot.name = std::move(subdirs[i]);
+      auto *raw = child.get();
+      node.children.push_back(std::move(child));
+      pool_.submit([this, raw] { scan(*raw); });
+    }
+  }
+
+  std::optional<std::size_t> sparse_entry(const std::string &relative) const {
+    if (options_.stat_cache == nullptr) {
+      return std::nullopt;
+    }
+    auto found = options_.stat_cache->find(relative);
+    if (found && !options_.stat_cache->is_sparse_dir(*found)) {
+      return std::nullopt;
+    }
+    return found;
+  }
+
+  static std::string join(const std::string &dir, const std::string &name) {
+    return dir.empty() ? name : dir + "/" + name;
+  }
+
+  void hash_files(DirNode &node, std::size_t begin, std::size_t end) {
+    ObjectBatch batch(store_, options_.durable);
+    std::vector<IndexEntry> collected;
+    std::size_t hashed = 0;
+
+    for (std::size_t i = begin; i < end; ++i) {
+      auto &entry = node.entries[i];
+      auto path = node.path / entry.name;
+      auto relative = join(node.relative, entry.name);
+
+      IndexEntry staged;
+      bool was_hashed = false;
+      if (auto error = stage_file(path, relative, batch, options_.stat_cache,
+                                  staged, was_hashed)) {
+        // Vanished or replaced by something we don't track since listing
+        if (error->error_code == ErrorCode::NotFound ||
+            error->error_code == ErrorCode::InvalidArgument) {
+          continue;
+        }
+        fail(std::move(error));
+        return;
+      }
+      entry.mode = staged.stat.mode;
+      entry.id = staged.id;
+      hashed += was_hashed ? 1 : 0;
+
+      bytes_.fetch_add(staged.stat.size, std::memory_order_relaxed);
+      files_.fetch_add(1, std::memory_order_relaxed);
+      if (options_.collect != nullptr) {
+        collected.push_back(std::move(staged));
+      }
+    }
+    hashed_.fetch_add(hashed, std::memory_order_relaxed);
+
+    if (auto error = batch.commit()) {
+      fail(std::move(error));
+      return;
+    }
+    if (!collected.empty()) {
+      std::lock_guard lock(collect_mutex_);
+      options_.collect->insert(options_.collect->end(),
+                               std::make_move_iterator(collected.begin()),
+                               std::make_move_iterator(collected.end()));
+    }
+  }
+
+  // Called once per finished task; the last one for a directory writes its
+  // tree and reports up to the parent
+  void complete(DirNode &node) {
+    if (node.remaining.fetch_sub(1) != 1) {
+      return;
+    }
+
+    ObjectId id;
+    bool empty = true;
+    if (!failed()) {
+      std::vector<TreeEntry> entries;
+      entries.reserve(node.entries.size());
+      for (auto &entry : node.entries) {
+        if (!entry.name.empty() && entry.mode != EntryMode{}) {
+          entries.push_back(std::move(entry));
+        }
+      }
+      empty = entries.empty();
+      node.entries.clear();
+      node.children.clear();
+
+      if (!empty || node.parent == nullptr) {
+        ObjectBatch batch(store_, options_.durable);
+        auto error =
+            batch.add(ObjectType::Tree, encode_tree(std::move(entries)), id);
+        if (!error) {
+          error = batch.commit();
+        }
+        if (error) {
+          fail(std::move(error));
+        }
+        directories_.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+
+    if (node.parent == nullptr) {
+      root_id_ = id;
+      return;
+    }
+    auto &slot = node.parent->entries[node.slot];
+    if (!empty) {
+      slot.mode = EntryMode::Directory;
+      slot.id = id;
+    }
+    complete(*node.parent);
+  }
+
+  ObjectStore &store_;
+  WorkPool &pool_;
+  SnapshotOptions options_;
+
+  DirNode root_;
+  ObjectId root_id_;
+  std::atomic<std::size_t> files_{0};
+  std::atomic<std::size_t> hashed_{0};
+  std::atomic<std::size_t> directories_{0};
+  std::atomic<std::uint64_t> bytes_{0};
+
+  std::mutex collect_mutex_;
+
+  std::atomic<bool> failed_{false};
+  std::mutex error_mutex_;
+  std::optional<Error> error_;
+};
+
+} // namespace
+
+std::optional<Error> stage_file(const std::filesystem::path &path,
+                                const std::string &relative,
+                                ObjectBatch &batch,
+                                const IndexView *stat_cache, IndexEntry &out,
+                                bool &hashed) {
+  out.path = relative;
+  out.flags = 0;
+  hashed = false;
+  if (auto error = stat_file(path, out.stat)) {
+    return error;
+  }
+
+  if (stat_cache != nullptr) {
+    auto cached = stat_cache->find(relative);
+    if (cached && stat_cache->matches(*cached, out.stat) &&
+        !stat_cache->is_racy(*cached)) {
+      out.id = stat_cache->id(*cached);
+      return std::nullopt;
+    }
+  }
+
+  hashed = true;
+  if (out.stat.mode != EntryMode::Symlink) {
+    return batch.add_file(path, out.id);
+  }
+  std::string target(out.stat.size + 1, '\0');
+  auto n = ::readlink(path.c_str(), target.data(), target.size());
+  if (n < 0) {
+    return errno_error("Cannot read link", path);
+  }
+  target.resize(static_cast<std::size_t>(n));
+  return batch.add(ObjectType::Blob, target, out.id);
+}
+
+std::optional<Error> build_snapshot(const std::filesystem::path &root,
+                                    ObjectStore &store, WorkPool &pool,
+                                    SnapshotResult &out,
+                                    const SnapshotOptions &options) {
+  CHRONA_TRACE_SCOPE("snapshot");
+  SnapshotBuilder builder(store, pool, options);
+  return builder.run(root, out);
+}
+
+namespace {
+
+// Entries [begin, end) all start with `prefix`; sorted paths keep each
+// subdirectory's entries contiguous.
+std::optional<Error> write_index_subtree(const IndexView &index,
+                                         std::size_t begin, std::size_t end,
+                                         std::size_t prefix_length,
+                                         ObjectBatch &batch, ObjectId &out) {
+  std::vector<TreeEntry> entries;
+  std::size_t i = begin;
+  while (i < end) {
+    auto rest = index.path(i).substr(prefix_length);
+    auto slash = rest.find('/');
+    if (slash == std::string_view::npos) {
+      entries.push_back(TreeEntry{std::string(rest), index.stat(i).mode,
+                                  index.id(i)});
+      ++i;
+      continue;
+    }
+
+    auto name = rest.substr(0, slash);
+    std::size_t child_end = i + 1;
+    while (child_end < end) {
+      auto other = index.path(child_end).substr(prefix_length);
+      if (other.size() <= slash || other[slash] != '/' ||
+          other.substr(0, slash) != name) {
+        break;
+      }
+      ++child_end;
+    }
+    ObjectId child;
+    if (auto error = write_index_subtree(index, i, child_end,
+                                         prefix_length + slash + 1, batch,
+                                         child)) {
+      return error;
+    }
+    entries.push_back(
+        TreeEntry{std::string(name), EntryMode::Directory, child});
+    i = child_end;
+  }
+  return batch.add(ObjectType::Tree, encode_tree(std::move(entries)), out);
+}
+
+} // namespace
+
+std::optional<Error> write_index_tree(const IndexView &index,
+                                      ObjectBatch &batch, ObjectId &out) {
+  return write_index_subtree(index, 0, index.size(), 0, batch, out);
+}
+
+std::optional<Error> read_tree_files(const ObjectStore &store,
+                                     const ObjectId &tree,
+                                     std::vector<IndexEntry> &out,
+                                     const SparseCone *cone) {
+  out.clear();
+  Arena arena;
+  std::vector<std::pair<std::string, ObjectId>> pending = {{"", tree}};
+  while (!pending.empty()) {
+    auto [prefix, id] = std::move(pending.back());
+    pending.pop_back();
+    ObjectView view;
+    if (auto error = store.read(id, view)) {
+      return error;
+    }
+    if (view.type() != ObjectType::Tree) {
+      return create_error(ErrorCode::CorruptObject,
+                          "Not a tree: " + id.hex());
+    }
+    arena.reset();
+    TreeView parsed;
+    if (auto error = parse_tree(view.content(), arena, parsed)) {
+      return error;
+    }
+    for (const auto &entry : parsed.entries) {
+      auto path = prefix + std::string(entry.name);
+      if (entry.mode == EntryMode::Directory &&
+          (cone == nullptr ||
+           cone->match_dir(path) != SparseCone::Match::Outside)) {
+        pending.emplace_back(path + "/", entry.id());
+        continue;
+      }
+      // Files, and directories outside the cone as sparse entries
+      IndexEntry file;
+      file.path = std::move(path);
+      file.id = entry.id();
+      file.stat.mode = entry.mode;
+      out.push_back(std::move(file));
+    }
+  }
+  // Tree order puts "a/b" before "a.txt"; the index wants plain byte order
+  std::sort(out.begin(), out.end(),
+            [](const IndexEntry &a, const IndexEntry &b) {
+              return a.path < b.path;
+            });
+  return std::nullopt;
+}
+
+} // namespace chrona
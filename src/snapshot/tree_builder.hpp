@@ -0,0 +1,74 @@
+#pragma once
+
+#include "errors/error.hpp"
+#include "index/index.hpp"
+#include "objects/object_store.hpp"
+#include "parallel/work_pool.hpp"
+#include "sparse/sparse.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace chrona {
+
+struct SnapshotOptions {
+  bool durable = false;
+  // Files hashed per pool task; small groups balance better, large ones
+  // amortise task overhead.
+  std::size_t files_per_task = 32;
+  // Path of the snapshot root relative to the repository root ("" for the
+  // repository itself); prefixes index lookups and collected paths.
+  std::string prefix;
+  // Files whose stat data matches a non-racy entry here reuse its id
+  // instead of being rehashed. A directory that is sparse there is not
+  // scanned: its staged tree goes into the snapshot as it is.
+  const IndexView *stat_cache = nullptr;
+  // When set, receives one index entry per file in the snapshot.
+  std::vector<IndexEntry> *collect = nullptr;
+};
+
+struct SnapshotResult {
+  ObjectId root;
+  std::size_t files = 0;
+  std::size_t hashed = 0;
+  std::size_t directories = 0;
+  std::uint64_t bytes = 0;
+};
+
+// Stores one file or symlink as a blob and fills `out` (path, id, stat).
+// When `stat_cache` holds a matching, non-racy entry for `relative` the
+// cached id is reused and `hashed` stays false. A file that vanished fails
+// with NotFound.
+std::optional<Error> stage_file(const std::filesystem::path &path,
+                                const std::string &relative,
+                                ObjectBatch &batch,
+                                const IndexView *stat_cache, IndexEntry &out,
+                                bool &hashed);
+
+// Snapshots the directory `root` (ignoring .chrona/ at the repository root)
+// into tree and blob objects. Directory scans and file hashing run as tasks
+// on `pool`; each tree is written once all of its children are done, with
+// entries sorted by name, so the resulting root id does not depend on
+// scheduling. Empty directories are omitted.
+std::optional<Error> build_snapshot(const std::filesystem::path &root,
+                                    ObjectStore &store, WorkPool &pool,
+                                    SnapshotResult &out,
+                                    const SnapshotOptions &options = {});
+
+// Writes the trees described by the index (whose blobs are already stored)
+// and returns the root tree id. Used by commit, so the committed tree is
+// exactly what was staged, not the current working tree.
+std::optional<Error> write_index_tree(const IndexView &index,
+                                      ObjectBatch &batch, ObjectId &out);
+
+// The inverse: every file under `tree` as an index entry (path, id and
+// mode; no stat data), sorted by path like the index. With a `cone`, each
+// directory outside it becomes one sparse entry and is not read.
+std::optional<Error> read_tree_files(const ObjectStore &store,
+                                     const ObjectId &tree,
+                                     std::vector<IndexEntry> &out,
+                                     const SparseCone *cone = nullptr);
+
+} // namespace chrona
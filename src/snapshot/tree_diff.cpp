@@ -0,0 +1,134 @@
+#include "tree_diff.hpp"
+
+namespace chrona {
+
+namespace {
+
+std::optional<Error> read_tree(const ObjectStore &store, const ObjectId &id,
+                               std::vector<TreeEntry> &out) {
+  ObjectView view;
+  if (auto error = store.read(id, view)) {
+    return error;
+  }
+  if (view.type() != ObjectType::Tree) {
+    return create_error(ErrorCode::CorruptObject, "Not a tree: " + id.hex());
+  }
+  return decode_tree(view.content(), out);
+}
+
+std::string join(const std::string &prefix, std::string_view name) {
+  return prefix.empty() ? std::string(name) : prefix + "/" + std::string(name);
+}
+
+class TreeDiff {
+public:
+  TreeDiff(const ObjectStore &store, std::vector<std::string> &out)
+      : store_(store), out_(out) {}
+
+  // Either side may be absent; both absent never happens
+  std::optional<Error> diff(const ObjectId *old_tree, const ObjectId *new_tree,
+                            const std::string &prefix) {
+    std::vector<TreeEntry> before;
+    std::vector<TreeEntry> after;
+    if (old_tree != nullptr) {
+      if (auto error = read_tree(store_, *old_tree, before)) {
+        return error;
+      }
+    }
+    if (new_tree != nullptr) {
+      if (auto error = read_tree(store_, *new_tree, after)) {
+        return error;
+      }
+    }
+
+    std::size_t i = 0;
+    std::size_t j = 0;
+    while (i < before.size() || j < after.size()) {
+      const TreeEntry *a = i < before.size() ? &before[i] : nullptr;
+      const TreeEntry *b = j < after.size() ? &after[j] : nullptr;
+      if (a != nullptr && b != nullptr && a->name != b->name) {
+        (a->name < b->name ? b : a) = nullptr;
+      }
+      const auto &name = a != nullptr ? a->name : b->name;
+      i += a != nullptr;
+      j += b != nullptr;
+      if (a != nullptr && b != nullptr && a->mode == b->mode &&
+          a->id == b->id) {
+        continue;
+      }
+
+      auto path = join(prefix, name);
+      bool a_dir = a != nullptr && a->mode == EntryMode::Directory;
+      bool b_dir = b != nullptr && b->mode == EntryMode::Directory;
+      // A file replaced by a directory (or the reverse) is a change too
+      if ((a != nullptr && !a_dir) || (b != nullptr && !b_dir)) {
+        out_.push_back(path);
+      }
+      if (a_dir || b_dir) {
+        if (auto error = diff(a_dir ? &a->id : nullptr,
+                              b_dir ? &b->id : nullptr, path)) {
+          return error;
+        }
+      }
+    }
+    return std::nullopt;
+  }
+
+private:
+  const ObjectStore &store_;
+  std::vector<std::string> &out_;
+};
+
+} // namespace
+
+std::optional<Error> changed_paths(const ObjectStore &store,
+                                   const ObjectId *old_tree,
+                                   const ObjectId &new_tree,
+                                   std::vector<std::string> &out) {
+  out.clear();
+  if (old_tree != nullptr && *old_tree == new_tree) {
+    return std::nullopt;
+  }
+  TreeDiff diff(store, out);
+  return diff.diff(old_tree, &new_tree, "");
+}
+
+std::optional<Error> lookup_path(const ObjectStore &store,
+                                 const ObjectId &tree, std::string_view path,
+                                 std::optional<PathEntry> &out) {
+  out = PathEntry{EntryMode::Directory, tree};
+  Arena arena;
+  while (!path.empty()) {
+    auto slash = path.find('/');
+    auto name = path.substr(0, slash);
+    path.remove_prefix(slash == std::string_view::npos ? path.size()
+                                                       : slash + 1);
+    if (out->mode != EntryMode::Directory) {
+      out.reset();
+      return std::nullopt;
+    }
+
+    ObjectView view;
+    if (auto error = store.read(out->id, view)) {
+      return error;
+    }
+    if (view.type() != ObjectType::Tree) {
+      return create_error(ErrorCode::CorruptObject,
+                          "Not a tree: " + out->id.hex());
+    }
+    arena.reset();
+    TreeView parsed;
+    if (auto error = parse_tree(view.content(), arena, parsed)) {
+      return error;
+    }
+    const auto *entry = parsed.find(name);
+    if (entry == nullptr) {
+      out.reset();
+      return std::nullopt;
+    }
+    out = PathEntry{entry->mode, entry->id()};
+  }
+  return std::nullopt;
+}
+
+} // namespace chrona
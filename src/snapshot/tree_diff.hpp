@@ -0,0 +1,35 @@
+#pragma once
+
+#include "errors/error.hpp"
+#include "objects/object.hpp"
+#include "objects/object_store.hpp"
+#include "snapshot/tree.hpp"
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace chrona {
+
+// Every file path ('/'-separated) that differs between two trees, in tree
+// order. Subtrees with equal ids are skipped without being read; one that
+// exists on one side only contributes every file under it. A null
+// `old_tree` stands for the empty tree.
+std::optional<Error> changed_paths(const ObjectStore &store,
+                                   const ObjectId *old_tree,
+                                   const ObjectId &new_tree,
+                                   std::vector<std::string> &out);
+
+struct PathEntry {
+  EntryMode mode;
+  ObjectId id;
+};
+
+// The entry at `path` under `tree`, reading one tree per path component;
+// `out` is left empty when nothing is there. The empty path is the tree
+// itself.
+std::optional<Error> lookup_path(const ObjectStore &store,
+                                 const ObjectId &tree, std::string_view path,
+                                 std::optional<PathEntry> &out);
+
+} // namespace chrona
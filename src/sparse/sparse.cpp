@@ -0,0 +1,135 @@
+#include "sparse.hpp"
+#include "io/file_io.hpp"
+#include "snapshot/tree.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <unistd.h>
+
+namespace chrona {
+
+namespace {
+
+bool is_under(std::string_view path, std::string_view dir) {
+  return path.size() > dir.size() && path[dir.size()] == '/' &&
+         path.substr(0, dir.size()) == dir;
+}
+
+} // namespace
+
+std::optional<Error> SparseCone::parse(const std::vector<std::string> &dirs,
+                                       SparseCone &out) {
+  out = SparseCone();
+  out.enabled_ = true;
+  std::vector<std::string> cones;
+  for (auto dir : dirs) {
+    while (!dir.empty() && dir.back() == '/') {
+      dir.pop_back();
+    }
+    bool valid = !dir.empty();
+    for (std::size_t begin = 0; valid && begin <= dir.size();) {
+      auto end = std::min(dir.find('/', begin), dir.size());
+      valid = is_valid_entry_name(
+          std::string_view(dir).substr(begin, end - begin));
+      begin = end + 1;
+    }
+    if (!valid) {
+      return create_error(ErrorCode::InvalidArgument,
+                          "Not a directory path for a sparse cone: " + dir);
+    }
+    cones.push_back(std::move(dir));
+  }
+  std::sort(cones.begin(), cones.end());
+  cones.erase(std::unique(cones.begin(), cones.end()), cones.end());
+  for (const auto &dir : cones) {
+    bool nested = std::any_of(
+        cones.begin(), cones.end(),
+        [&](const std::string &other) { return is_under(dir, other); });
+    if (!nested) {
+      out.dirs_.push_back(dir);
+    }
+  }
+  // The root's own files are always in, with or without a cone
+  out.parents_.emplace_back();
+  for (const auto &dir : out.dirs_) {
+    for (auto slash = dir.find('/'); slash != std::string::npos;
+         slash = dir.find('/', slash + 1)) {
+      out.parents_.push_back(dir.substr(0, slash));
+    }
+  }
+  std::sort(out.parents_.begin(), out.parents_.end());
+  out.parents_.erase(std::unique(out.parents_.begin(), out.parents_.end()),
+                     out.parents_.end());
+  return std::nullopt;
+}
+
+std::optional<Error> SparseCone::load(const std::filesystem::path &chrona_dir,
+                                      SparseCone &out) {
+  out = SparseCone();
+  std::string data;
+  if (auto error = read_file(chrona_dir / "sparse", data)) {
+    if (error->error_code == ErrorCode::NotFound) {
+      return std::nullopt;
+    }
+    return error;
+  }
+  std::vector<std::string> dirs;
+  std::size_t begin = 0;
+  while (begin < data.size()) {
+    auto end = data.find('\n', begin);
+    if (end == std::string::npos) {
+      end = data.size();
+    }
+    if (end > begin) {
+      dirs.push_back(data.substr(begin, end - begin));
+    }
+    begin = end + 1;
+  }
+  if (auto error = parse(dirs, out)) {
+    return create_error(ErrorCode::CorruptObject,
+                        "Bad sparse cone in " +
+                            (chrona_dir / "sparse").string() + ": " +
+                            error->message);
+  }
+  return std::nullopt;
+}
+
+std::optional<Error>
+SparseCone::save(const std::filesystem::path &chrona_dir) const {
+  auto path = chrona_dir / "sparse";
+  if (!enabled_) {
+    if (::unlink(path.c_str()) != 0 && errno != ENOENT) {
+      return errno_error("Cannot remove", path);
+    }
+    return std::nullopt;
+  }
+  std::string data;
+  for (const auto &dir : dirs_) {
+    data += dir + "\n";
+  }
+  return write_file_atomic(path, data, true);
+}
+
+SparseCone::Match SparseCone::match_dir(std::string_view dir) const {
+  if (!enabled_) {
+    return Match::Inside;
+  }
+  // A cone is the directory itself or one of its ancestors
+  for (auto end = dir.size(); end != 0 && end != std::string_view::npos;
+       end = dir.rfind('/', end - 1)) {
+    if (std::binary_search(dirs_.begin(), dirs_.end(), dir.substr(0, end))) {
+      return Match::Inside;
+    }
+  }
+  return std::binary_search(parents_.begin(), parents_.end(), dir)
+             ? Match::Parent
+             : Match::Outside;
+}
+
+bool SparseCone::includes(std::string_view file) const {
+  auto slash = file.rfind('/');
+  return match_dir(slash == std::string_view::npos ? std::string_view()
+                                                   : file.substr(0, slash)) !=
+         Match::Outside;
+}
+
+} // namespace chrona
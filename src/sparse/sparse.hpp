@@ -0,0 +1,51 @@
+#pragma once
+
+#include "errors/error.hpp"
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace chrona {
+
+// Cone-mode sparse patterns, kept in .chrona/sparse as one directory per
+// line. A cone "a/b" selects everything below a/b, plus the files directly
+// inside a and the root; every other directory is left out whole. A left-
+// out directory is one index entry holding its tree id (mode Directory),
+// so nothing below it is read, stat()ed or written.
+class SparseCone {
+public:
+  enum class Match {
+    Outside, // left out whole
+    Parent,  // holds a cone below it: its own files are in
+    Inside,  // a cone or below one: everything is in
+  };
+
+  // Selects everything, as without .chrona/sparse.
+  SparseCone() = default;
+
+  // Fails with InvalidArgument for a path that is not a plain relative
+  // directory. Trailing slashes are dropped, as are cones inside others.
+  static std::optional<Error> parse(const std::vector<std::string> &dirs,
+                                    SparseCone &out);
+  // A missing file loads a cone that selects everything.
+  static std::optional<Error> load(const std::filesystem::path &chrona_dir,
+                                   SparseCone &out);
+  // Writes .chrona/sparse, or removes it for a cone that selects all.
+  std::optional<Error> save(const std::filesystem::path &chrona_dir) const;
+
+  bool enabled() const { return enabled_; }
+  const std::vector<std::string> &dirs() const { return dirs_; }
+
+  // `dir` is relative to the root, "" for the root itself.
+  Match match_dir(std::string_view dir) const;
+  bool includes(std::string_view file) const;
+
+private:
+  bool enabled_ = false;
+  std::vector<std::string> dirs_;    // sorted, none inside another
+  std::vector<std::string> parents_; // every proper ancestor, "" included
+};
+
+} // namespace chrona
@@ -0,0 +1,243 @@
+#include "status.hpp"
+#include "io/file_io.hpp"
+#include "trace/trace.hpp"
+#include <algorithm>
+#include <atomic>
+#include <dirent.h>
+#include <mutex>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace chrona {
+
+std::optional<Error> hash_worktree_file(const std::filesystem::path &path,
+                                        const FileStat &stat, ObjectId &out) {
+  if (stat.mode != EntryMode::Symlink) {
+    return hash_file(path, out);
+  }
+  std::string target(stat.size + 1, '\0');
+  auto n = ::readlink(path.c_str(), target.data(), target.size());
+  if (n < 0) {
+    return errno_error("Cannot read link", path);
+  }
+  target.resize(static_cast<std::size_t>(n));
+  out = hash_object(ObjectType::Blob, target);
+  return std::nullopt;
+}
+
+std::optional<Error> check_entry(const std::filesystem::path &root,
+                                 const IndexView &index, std::size_t i,
+                                 EntryState &state, FileStat &stat,
+                                 bool &rehashed) {
+  state = EntryState::Clean;
+  rehashed = false;
+  if (index.is_sparse_dir(i)) {
+    return std::nullopt; // outside the cone, nothing on disk to compare
+  }
+  auto path = root / index.path(i);
+  if (auto error = stat_file(path, stat)) {
+    state = EntryState::Deleted;
+    return std::nullopt;
+  }
+  if (index.matches(i, stat) && !index.is_racy(i)) {
+    return std::nullopt;
+  }
+  if (stat.mode != index.stat(i).mode ||
+      (stat.size != index.stat(i).size && stat.mode != EntryMode::Symlink)) {
+    state = EntryState::Modified;
+    return std::nullopt;
+  }
+
+  rehashed = true;
+  ObjectId id;
+  if (auto error = hash_worktree_file(path, stat, id)) {
+    return error;
+  }
+  state = id != index.id(i) ? EntryState::Modified : EntryState::Refreshed;
+  return std::nullopt;
+}
+
+namespace {
+
+bool has_entries(const std::filesystem::path &dir) {
+  DIR *handle = ::opendir(dir.c_str());
+  if (handle == nullptr) {
+    return false;
+  }
+  bool found = false;
+  while (auto *entry = ::readdir(handle)) {
+    std::string_view name = entry->d_name;
+    if (name != "." && name != "..") {
+      found = true;
+      break;
+    }
+  }
+  ::closedir(handle);
+  return found;
+}
+
+} // namespace
+
+void list_untracked(const std::filesystem::path &root, const IndexView &index,
+                    const std::string &relative,
+                    std::vector<StatusChange> &out,
+                    std::vector<std::string> &tracked_dirs) {
+  auto dir_path = relative.empty() ? root : root / relative;
+  DIR *dir = ::opendir(dir_path.c_str());
+  if (dir == nullptr) {
+    return;
+  }
+
+  while (auto *entry = ::readdir(dir)) {
+    std::string_view name = entry->d_name;
+    if (name == "." || name == ".." ||
+        (relative.empty() && name == ".chrona")) {
+      continue;
+    }
+
+    auto type = entry->d_type;
+    if (type == DT_UNKNOWN) {
+      struct stat st;
+      trace_count(TraceCounter::StatCalls);
+      if (::lstat((dir_path / name).c_str(), &st) != 0) {
+        continue;
+      }
+      type = S_ISDIR(st.st_mode)   ? DT_DIR
+             : S_ISREG(st.st_mode) ? DT_REG
+             : S_ISLNK(st.st_mode) ? DT_LNK
+                                   : DT_UNKNOWN;
+    }
+
+    auto path = relative.empty() ? std::string(name)
+                                 : relative + "/" + std::string(name);
+    if (type == DT_DIR) {
+      // A directory with nothing tracked below it is reported as a whole;
+      // one left out by the sparse cone is not looked into at all
+      auto sparse = index.find(path);
+      if (sparse && index.is_sparse_dir(*sparse)) {
+        continue;
+      }
+      if (index.has_prefix(path + "/")) {
+        tracked_dirs.push_back(std::move(path));
+      } else if (has_entries(dir_path / name)) {
+        out.push_back(StatusChange{path + "/", ChangeKind::Untracked});
+      }
+    } else if ((type == DT_REG || type == DT_LNK) && !index.find(path)) {
+      out.push_back(StatusChange{std::move(path), ChangeKind::Untracked});
+    }
+  }
+  ::closedir(dir);
+}
+
+namespace {
+
+class UntrackedWalker {
+public:
+  UntrackedWalker(const std::filesystem::path &root, const IndexView &index,
+                  WorkPool &pool)
+      : root_(root), index_(index), pool_(pool) {}
+
+  std::vector<StatusChange> run() {
+    pool_.submit([this] { walk(""); });
+    pool_.wait();
+    return std::move(found_);
+  }
+
+private:
+  void walk(const std::string &relative) {
+    std::vector<StatusChange> local;
+    std::vector<std::string> tracked_dirs;
+    list_untracked(root_, index_, relative, local, tracked_dirs);
+    for (auto &path : tracked_dirs) {
+      pool_.submit([this, path = std::move(path)] { walk(path); });
+    }
+
+    if (!local.empty()) {
+      std::lock_guard lock(mutex_);
+      found_.insert(found_.end(), std::make_move_iterator(local.begin()),
+                    std::make_move_iterator(local.end()));
+    }
+  }
+
+  const std::filesystem::path &root_;
+  const IndexView &index_;
+  WorkPool &pool_;
+  std::mutex mutex_;
+  std::vector<StatusChange> found_;
+};
+
+} // namespace
+
+std::optional<Error> compute_status(const std::filesystem::path &root,
+                                    const IndexView &index, WorkPool &pool,
+                                    StatusResult &out,
+                                    const StatusOptions &options) {
+  CHRONA_TRACE_SCOPE("status");
+  out = StatusResult();
+
+  // Each task owns a slice of these arrays, so no locking is needed
+  std::vector<EntryState> states(index.size(), EntryState::Clean);
+  std::vector<FileStat> fresh(index.size());
+  std::atomic<std::size_t> rehashed{0};
+  std::mutex error_mutex;
+  std::optional<Error> first_error;
+
+  pool.parallel_for(
+      index.size(), options.entries_per_task,
+      [&](std::size_t begin, std::size_t end) {
+        std::size_t local_rehashed = 0;
+        for (std::size_t i = begin; i < end; ++i) {
+          bool was_rehashed = false;
+          if (auto error = check_entry(root, index, i, states[i], fresh[i],
+                                       was_rehashed)) {
+            std::lock_guard lock(error_mutex);
+            if (!first_error) {
+              first_error = std::move(error);
+            }
+          }
+          local_rehashed += was_rehashed ? 1 : 0;
+        }
+        rehashed.fetch_add(local_rehashed, std::memory_order_relaxed);
+      });
+
+  if (first_error) {
+    return first_error;
+  }
+
+  for (std::size_t i = 0; i < index.size(); ++i) {
+    switch (states[i]) {
+    case EntryState::Clean:
+      break;
+    case EntryState::Modified:
+      out.changes.push_back(
+          StatusChange{std::string(index.path(i)), ChangeKind::Modified});
+      break;
+    case EntryState::Deleted:
+      out.changes.push_back(
+          StatusChange{std::string(index.path(i)), ChangeKind::Deleted});
+      break;
+    case EntryState::Refreshed:
+      out.refreshed.push_back(index.entry(i));
+      out.refreshed.back().stat = fresh[i];
+      break;
+    }
+  }
+  out.checked = index.size();
+  out.rehashed = rehashed.load();
+
+  if (options.untracked) {
+    UntrackedWalker walker(root, index, pool);
+    auto untracked = walker.run();
+    out.changes.insert(out.changes.end(),
+                       std::make_move_iterator(untracked.begin()),
+                       std::make_move_iterator(untracked.end()));
+  }
+
+  std::sort(out.changes.begin(), out.changes.end(),
+            [](const StatusChange &a, const StatusChange &b) {
+              return a.path < b.path;
+            });
+  return std::nullopt;
+}
+
+} // namespace chrona
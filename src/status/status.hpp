@@ -0,0 +1,68 @@
+#pragma once
+
+#include "errors/error.hpp"
+#include "index/index.hpp"
+#include "parallel/work_pool.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace chrona {
+
+enum class ChangeKind : std::uint8_t { Modified, Deleted, Untracked };
+
+struct StatusChange {
+  std::string path;
+  ChangeKind kind;
+};
+
+struct StatusOptions {
+  bool untracked = true;
+  // Index entries stat()ed per pool task.
+  std::size_t entries_per_task = 1024;
+};
+
+struct StatusResult {
+  std::vector<StatusChange> changes; // sorted by path
+  std::size_t checked = 0;           // index entries stat()ed
+  std::size_t rehashed = 0;          // entries that had to be rehashed
+  // Entries whose stat data changed but whose content did not. Writing them
+  // back into the index keeps the next status from rehashing them again.
+  std::vector<IndexEntry> refreshed;
+};
+
+// Hashes a working tree file (or the target of a symlink) as a blob.
+std::optional<Error> hash_worktree_file(const std::filesystem::path &path,
+                                        const FileStat &stat, ObjectId &out);
+
+enum class EntryState : std::uint8_t { Clean, Modified, Deleted, Refreshed };
+
+// Compares index entry `i` with its working tree file. `stat` receives the
+// file's current stat data; Refreshed means only that data changed. A
+// sparse directory entry is always Clean.
+std::optional<Error> check_entry(const std::filesystem::path &root,
+                                 const IndexView &index, std::size_t i,
+                                 EntryState &state, FileStat &stat,
+                                 bool &rehashed);
+
+// Lists the directory `relative` (not recursively). Untracked files and
+// directories with nothing tracked below them go to `out`; subdirectories
+// that do hold tracked files go to `tracked_dirs`. Sparse directories are
+// skipped.
+void list_untracked(const std::filesystem::path &root, const IndexView &index,
+                    const std::string &relative,
+                    std::vector<StatusChange> &out,
+                    std::vector<std::string> &tracked_dirs);
+
+// Compares the working tree under `root` with the index. Entries are stat()ed
+// in parallel and only rehashed when their stat data no longer matches the
+// index or they are racily clean. Untracked directories are reported once,
+// with a trailing '/', rather than file by file.
+std::optional<Error> compute_status(const std::filesystem::path &root,
+                                    const IndexView &index, WorkPool &pool,
+                                    StatusResult &out,
+                                    const StatusOptions &options = {});
+
+} // namespace chrona
@@ -0,0 +1,248 @@
+#include "trace.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unistd.h>
+#include <vector>
+
+namespace chrona {
+
+namespace detail {
+std::atomic<bool> trace_on{false};
+} // namespace detail
+
+namespace {
+
+struct Span {
+  const char *name;
+  std::int64_t start_ns;
+  std::int64_t duration_ns;
+};
+
+// Written only by its own thread; read once tracing has finished.
+struct ThreadBuffer {
+  std::uint32_t tid = 0;
+  std::atomic<std::uint64_t> counters[static_cast<std::size_t>(
+      TraceCounter::Count)] = {};
+  std::vector<Span> spans;
+};
+
+struct TraceState {
+  std::mutex mutex;
+  std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+  std::string output; // empty for the stderr summary
+  std::chrono::steady_clock::time_point epoch;
+  // Bumped by discard_trace() so threads re-register
+  std::atomic<std::uint64_t> generation{1};
+};
+
+TraceState &state() {
+  static TraceState instance;
+  return instance;
+}
+
+ThreadBuffer &thread_buffer() {
+  thread_local ThreadBuffer *buffer = nullptr;
+  thread_local std::uint64_t generation = 0;
+  auto &trace = state();
+  auto current = trace.generation.load(std::memory_order_acquire);
+  if (buffer == nullptr || generation != current) {
+    // Buffers outlive their threads so pool workers that already exited
+    // still show up in the merge
+    std::lock_guard lock(trace.mutex);
+    auto owned = std::make_unique<ThreadBuffer>();
+    owned->tid = static_cast<std::uint32_t>(trace.buffers.size());
+    buffer = owned.get();
+    generation = current;
+    trace.buffers.push_back(std::move(owned));
+  }
+  return *buffer;
+}
+
+void print_json_string(std::FILE *out, const char *text) {
+  std::fputc('"', out);
+  for (const char *p = text; *p != '\0'; ++p) {
+    if (*p == '"' || *p == '\\') {
+      std::fputc('\\', out);
+    }
+    std::fputc(*p, out);
+  }
+  std::fputc('"', out);
+}
+
+void write_chrome_json(
+    std::FILE *out, const std::vector<std::unique_ptr<ThreadBuffer>> &buffers,
+    const std::uint64_t *totals) {
+  auto pid = static_cast<long long>(::getpid());
+  std::fputs("{\"traceEvents\":[\n", out);
+  bool first = true;
+  for (const auto &buffer : buffers) {
+    for (const auto &span : buffer->spans) {
+      std::fputs(first ? "" : ",\n", out);
+      first = false;
+      std::fputs("{\"name\":", out);
+      print_json_string(out, span.name);
+      std::fprintf(out,
+                   ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%lld,"
+                   "\"tid\":%" PRIu32 "}",
+                   static_cast<double>(span.start_ns) / 1000.0,
+                   static_cast<double>(span.duration_ns) / 1000.0, pid,
+                   buffer->tid);
+    }
+  }
+  std::fputs("],\n\"otherData\":{", out);
+  for (std::size_t i = 0; i < static_cast<std::size_t>(TraceCounter::Count);
+       ++i) {
+    std::fprintf(out, "%s\"%s\":%" PRIu64, i == 0 ? "" : ",",
+                 trace_counter_name(static_cast<TraceCounter>(i)), totals[i]);
+  }
+  std::fputs("}}\n", out);
+}
+
+void write_summary(std::FILE *out,
+                   const std::vector<std::unique_ptr<ThreadBuffer>> &buffers,
+                   const std::uint64_t *totals) {
+  struct Totals {
+    std::uint64_t calls = 0;
+    std::int64_t ns = 0;
+  };
+  std::map<std::string, Totals> by_name;
+  for (const auto &buffer : buffers) {
+    for (const auto &span : buffer->spans) {
+      auto &entry = by_name[span.name];
+      ++entry.calls;
+      entry.ns += span.duration_ns;
+    }
+  }
+  std::vector<std::pair<std::string, Totals>> sorted(by_name.begin(),
+                                                     by_name.end());
+  std::sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b) {
+    return a.second.ns > b.second.ns;
+  });
+
+  std::fprintf(out, "trace: %-32s %10s %12s\n", "scope", "calls", "total ms");
+  for (const auto &[name, entry] : sorted) {
+    std::fprintf(out, "trace: %-32s %10" PRIu64 " %12.3f\n", name.c_str(),
+                 entry.calls, static_cast<double>(entry.ns) / 1e6);
+  }
+  for (std::size_t i = 0; i < static_cast<std::size_t>(TraceCounter::Count);
+       ++i) {
+    std::fprintf(out, "trace: %-32s %10" PRIu64 "\n",
+                 trace_counter_name(static_cast<TraceCounter>(i)), totals[i]);
+  }
+}
+
+} // namespace
+
+const char *trace_counter_name(TraceCounter counter) {
+  switch (counter) {
+  case TraceCounter::ObjectsRead:
+    return "objects_read";
+  case TraceCounter::ObjectsWritten:
+    return "objects_written";
+  case TraceCounter::BytesHashed:
+    return "bytes_hashed";
+  case TraceCounter::CacheHits:
+    return "cache_hits";
+  case TraceCounter::CacheMisses:
+    return "cache_misses";
+  case TraceCounter::ObjectCacheHits:
+    return "object_cache_hits";
+  case TraceCounter::ObjectCacheMisses:
+    return "object_cache_misses";
+  case TraceCounter::StatCalls:
+    return "stat_calls";
+  case TraceCounter::Syscalls:
+    return "syscalls";
+  case TraceCounter::Count:
+    break;
+  }
+  return "unknown";
+}
+
+namespace detail {
+
+void add_count(TraceCounter counter, std::uint64_t amount) {
+  auto &slot = thread_buffer().counters[static_cast<std::size_t>(counter)];
+  // Single writer: a relaxed load and store, no locked instruction
+  slot.store(slot.load(std::memory_order_relaxed) + amount,
+             std::memory_order_relaxed);
+}
+
+std::int64_t trace_now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - state().epoch)
+      .count();
+}
+
+void record_span(const char *name, std::int64_t start_ns) {
+  thread_buffer().spans.push_back(
+      Span{name, start_ns, trace_now_ns() - start_ns});
+}
+
+} // namespace detail
+
+void start_trace(const std::string &spec) {
+  if (spec == "0") {
+    return;
+  }
+  auto &trace = state();
+  {
+    std::lock_guard lock(trace.mutex);
+    trace.output = spec == "1" ? "" : spec;
+    trace.epoch = std::chrono::steady_clock::now();
+  }
+  detail::trace_on.store(true, std::memory_order_release);
+}
+
+std::uint64_t trace_total(TraceCounter counter) {
+  auto &trace = state();
+  std::lock_guard lock(trace.mutex);
+  std::uint64_t total = 0;
+  for (const auto &buffer : trace.buffers) {
+    total += buffer->counters[static_cast<std::size_t>(counter)].load(
+        std::memory_order_relaxed);
+  }
+  return total;
+}
+
+void finish_trace() {
+  if (!trace_enabled()) {
+    return;
+  }
+  detail::trace_on.store(false, std::memory_order_release);
+
+  std::uint64_t totals[static_cast<std::size_t>(TraceCounter::Count)];
+  for (std::size_t i = 0; i < static_cast<std::size_t>(TraceCounter::Count);
+       ++i) {
+    totals[i] = trace_total(static_cast<TraceCounter>(i));
+  }
+
+  auto &trace = state();
+  std::lock_guard lock(trace.mutex);
+  if (trace.output.empty()) {
+    write_summary(stderr, trace.buffers, totals);
+    return;
+  }
+  std::FILE *out = std::fopen(trace.output.c_str(), "w");
+  if (out == nullptr) {
+    std::fprintf(stderr, "trace: cannot write %s\n", trace.output.c_str());
+    return;
+  }
+  write_chrome_json(out, trace.buffers, totals);
+  std::fclose(out);
+}
+
+void discard_trace() {
+  detail::trace_on.store(false, std::memory_order_release);
+  auto &trace = state();
+  std::lock_guard lock(trace.mutex);
+  trace.generation.fetch_add(1, std::memory_order_acq_rel);
+  trace.buffers.clear();
+}
+
+} // namespace chrona
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace chrona {
+
+enum class TraceCounter : std::uint8_t {
+  ObjectsRead,
+  ObjectsWritten,
+  BytesHashed,
+  CacheHits,
+  CacheMisses,
+  ObjectCacheHits,
+  ObjectCacheMisses,
+  StatCalls,
+  Syscalls,
+  Count, // number of counters, not a counter
+};
+
+const char *trace_counter_name(TraceCounter counter);
+
+namespace detail {
+extern std::atomic<bool> trace_on;
+void add_count(TraceCounter counter, std::uint64_t amount);
+std::int64_t trace_now_ns();
+void record_span(const char *name, std::int64_t start_ns);
+} // namespace detail
+
+// One relaxed load: when tracing is off, every probe below costs a
+// predictable branch and nothing else.
+inline bool trace_enabled() {
+  return detail::trace_on.load(std::memory_order_relaxed);
+}
+
+inline void trace_count(TraceCounter counter, std::uint64_t amount = 1) {
+  if (trace_enabled()) {
+    detail::add_count(counter, amount);
+  }
+}
+
+// Times the enclosing scope. `name` must be a string literal (or otherwise
+// outlive the trace).
+class TraceScope {
+public:
+  explicit TraceScope(const char *name)
+      : name_(name), start_ns_(trace_enabled() ? detail::trace_now_ns() : -1) {}
+  ~TraceScope() {
+    if (start_ns_ >= 0) {
+      detail::record_span(name_, start_ns_);
+    }
+  }
+
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+  const char *name_;
+  std::int64_t start_ns_;
+};
+
+#define CHRONA_TRACE_CONCAT_(a, b) a##b
+#define CHRONA_TRACE_CONCAT(a, b) CHRONA_TRACE_CONCAT_(a, b)
+#define CHRONA_TRACE_SCOPE(name)                                               \
+  ::chrona::TraceScope CHRONA_TRACE_CONCAT(chrona_trace_scope_, __LINE__)(name)
+
+// Turns tracing on. `spec` is "" or "1" for a summary on stderr when the
+// trace is finished, or a file path to write Chrome trace-event JSON to
+// (load it in chrome://tracing or Perfetto). "0" leaves tracing off.
+void start_trace(const std::string &spec);
+
+// Merges every thread's buffer and writes the output chosen in
+// start_trace(). Spans still open are not included. Tracing stays off
+// afterwards.
+void finish_trace();
+
+// Resets all buffers without output; for tests.
+void discard_trace();
+
+// Counter totals across all threads so far.
+std::uint64_t trace_total(TraceCounter counter);
+
+} // namespace chrona
@@ -0,0 +1,243 @@
+#include "bundle/bundle.hpp"
+#include "history/commit.hpp"
+#include "io/file_io.hpp"
+#include "pack/bitmap.hpp"
+#include "snapshot/tree.hpp"
+#include "test_helpers.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <cstring>
+
+namespace chrona {
+
+namespace {
+
+// A commit of two files, one of them compressible.
+ObjectId commit(test::TestRepo &repo, std::size_t n) {
+  std::string text;
+  for (std::size_t line = 0; line < 40; ++line) {
+    text += "line " + std::to_string(line) + " of commit " +
+            std::to_string(n) + "\n";
+  }
+  return repo.commit({repo.file("big.txt", text),
+                      repo.file("small.txt", "n=" + std::to_string(n))},
+                     "commit " + std::to_string(n) + "\n");
+}
+
+// Bytes no compressor shrinks, so chunks keep their size in a bundle.
+std::string noise(std::size_t size, std::uint32_t seed) {
+  std::string out(size, '\0');
+  for (auto &c : out) {
+    seed = seed * 1664525 + 1013904223;
+    c = static_cast<char>(seed >> 24);
+  }
+  return out;
+}
+
+std::vector<ObjectId> missing(const test::TestRepo &repo,
+                              const std::vector<ObjectId> &have) {
+  std::vector<ObjectId> out;
+  REQUIRE_FALSE(
+      Reachability(repo.store).missing({repo.history.back()}, have, out));
+  return out;
+}
+
+} // namespace
+
+TEST_CASE("bundles - round trip, prerequisites and resume", "[bundle]") {
+  test::ScratchDir dir("bundle");
+  test::TestRepo source(dir.path() / "source");
+  for (std::size_t n = 0; n < 10; ++n) {
+    commit(source, n);
+  }
+  WorkPool pool(4);
+  BundleOptions options;
+  options.frame_objects = 3;
+  auto path = dir.path() / "all.bundle";
+  auto objects = missing(source, {});
+  REQUIRE(objects.size() == 40);
+  BundleHeader header;
+  header.refs.emplace_back("refs/heads/main", source.history.back());
+  BundleResult created;
+  REQUIRE_FALSE(create_bundle(path, source.store, pool, header, objects,
+                              created, options));
+  REQUIRE(created.written == 40);
+  REQUIRE(created.bytes == std::filesystem::file_size(path));
+
+  SECTION("everything arrives, and a rerun finds it all present") {
+    test::TestRepo target(dir.path() / "target");
+    BundleResult result;
+    REQUIRE_FALSE(unbundle(path, target.store, pool, result));
+    REQUIRE(result.written == 40);
+    REQUIRE(result.present == 0);
+    REQUIRE(result.header.refs == header.refs);
+    for (const auto &id : objects) {
+      ObjectView view;
+      REQUIRE_FALSE(target.store.read(id, view));
+      REQUIRE(hash_object(view.type(), view.content()) == id);
+    }
+
+    REQUIRE_FALSE(unbundle(path, target.store, pool, result));
+    REQUIRE(result.written == 0);
+    REQUIRE(result.present == 40);
+  }
+
+  SECTION("an interrupted import picks up where it stopped") {
+    test::TestRepo target(dir.path() / "target");
+    for (std::size_t i = 0; i < objects.size(); i += 2) {
+      ObjectView view;
+      REQUIRE_FALSE(source.store.read(objects[i], view));
+      ObjectId id;
+      REQUIRE_FALSE(target.store.write(view.type(), view.content(), id));
+    }
+    BundleResult result;
+    REQUIRE_FALSE(unbundle(path, target.store, pool, result));
+    REQUIRE(result.written == 20);
+    REQUIRE(result.present == 20);
+  }
+
+  SECTION("an incremental bundle needs its prerequisite") {
+    auto base = source.history[4];
+    auto increment = missing(source, {base});
+    REQUIRE(increment.size() == 20);
+    auto path2 = dir.path() / "incremental.bundle";
+    BundleHeader header2;
+    header2.prerequisites.push_back(base);
+    header2.refs = header.refs;
+    REQUIRE_FALSE(create_bundle(path2, source.store, pool, header2,
+                                increment, created, options));
+
+    test::TestRepo empty(dir.path() / "empty");
+    BundleResult result;
+    auto error = unbundle(path2, empty.store, pool, result);
+    REQUIRE(error);
+    REQUIRE(error->error_code == ErrorCode::NotFound);
+    REQUIRE_FALSE(empty.store.contains(source.history.back()));
+
+    // Applied on top of the full history it writes nothing new
+    test::TestRepo target(dir.path() / "target");
+    REQUIRE_FALSE(unbundle(path, target.store, pool, result));
+    REQUIRE_FALSE(unbundle(path2, target.store, pool, result));
+    REQUIRE(result.header.prerequisites == header2.prerequisites);
+    REQUIRE(result.present == 20);
+  }
+
+  SECTION("damage anywhere is caught") {
+    std::string data;
+    REQUIRE_FALSE(read_file(path, data));
+    for (auto offset : {data.size() / 2, data.size() - 40, data.size() - 1}) {
+      auto damaged = data;
+      damaged[offset] = static_cast<char>(damaged[offset] ^ 0x20);
+      REQUIRE_FALSE(write_file_atomic(path, damaged));
+      test::TestRepo target(dir.path() / ("target" + std::to_string(offset)));
+      BundleResult result;
+      auto error = unbundle(path, target.store, pool, result);
+      REQUIRE(error);
+      REQUIRE(error->error_code == ErrorCode::CorruptObject);
+    }
+    REQUIRE_FALSE(write_file_atomic(path, data.substr(0, data.size() - 50)));
+    test::TestRepo target(dir.path() / "truncated");
+    BundleResult result;
+    REQUIRE(unbundle(path, target.store, pool, result));
+  }
+}
+
+TEST_CASE("bundles - frames stay below the byte cap", "[bundle]") {
+  test::ScratchDir dir("bundle-cap");
+  test::TestRepo source(dir.path() / "source");
+  for (std::size_t n = 0; n < 4; ++n) {
+    commit(source, n);
+  }
+  auto objects = missing(source, {});
+  WorkPool pool(2);
+  BundleOptions options;
+  options.compression = CompressionOptions{Codec::None};
+  options.max_frame_bytes = 2000;
+  auto path = dir.path() / "capped.bundle";
+  BundleResult created;
+  REQUIRE_FALSE(create_bundle(path, source.store, pool, {}, objects, created,
+                              options));
+
+  // Walks the frames: every one is under the cap, and there are more
+  // than the one per 256 objects the count alone would give
+  std::string data;
+  REQUIRE_FALSE(read_file(path, data));
+  std::string_view in(data);
+  in.remove_prefix(in.find("\n\n") + 2);
+  std::size_t frames = 0;
+  std::uint64_t counted = 0;
+  while (true) {
+    std::uint32_t size;
+    std::uint32_t count;
+    std::memcpy(&size, in.data(), 4);
+    std::memcpy(&count, in.data() + 4, 4);
+    in.remove_prefix(8 + size);
+    if (size == 0 && count == 0) {
+      break;
+    }
+    REQUIRE(size <= options.max_frame_bytes);
+    REQUIRE(count > 0);
+    ++frames;
+    counted += count;
+  }
+  REQUIRE(frames > 1);
+  REQUIRE(counted == objects.size());
+
+  test::TestRepo target(dir.path() / "target");
+  BundleResult result;
+  REQUIRE_FALSE(unbundle(path, target.store, pool, result));
+  REQUIRE(result.written == objects.size());
+
+  // An object that cannot fit a frame of its own is refused
+  options.max_frame_bytes = 100;
+  auto error = create_bundle(path, source.store, pool, {}, objects, created,
+                             options);
+  REQUIRE(error);
+  REQUIRE(error->error_code == ErrorCode::InvalidArgument);
+  REQUIRE_FALSE(unbundle(path, target.store, pool, result));
+  REQUIRE(result.present == objects.size());
+}
+
+TEST_CASE("bundles - chunked blobs travel as chunk lists", "[bundle]") {
+  test::ScratchDir dir("bundle-chunked");
+  test::TestRepo source(dir.path() / "source");
+  source.store.set_chunking({64 * 1024, 4096});
+  auto data = noise(200 * 1024, 1);
+  auto first = source.file("data.bin", data);
+  source.commit({first});
+  data.replace(100 * 1024, 5, "edit!");
+  auto second = source.file("data.bin", data);
+  source.commit({second});
+  std::vector<ChunkRef> chunks;
+  REQUIRE_FALSE(source.store.read_chunk_list(second.id, chunks));
+  REQUIRE(chunks.size() > 1);
+
+  // No entry is bigger than a chunk, so a cap far below the blob holds
+  auto objects = missing(source, {});
+  WorkPool pool(4);
+  BundleOptions options;
+  options.max_frame_bytes = 20 * 1024;
+  auto path = dir.path() / "chunked.bundle";
+  BundleResult created;
+  REQUIRE_FALSE(create_bundle(path, source.store, pool, {}, objects, created,
+                              options));
+  REQUIRE(created.header.objects > objects.size() + chunks.size());
+
+  test::TestRepo target(dir.path() / "target");
+  BundleResult result;
+  REQUIRE_FALSE(unbundle(path, target.store, pool, result));
+  REQUIRE(result.written == created.header.objects);
+  std::vector<ChunkRef> imported;
+  REQUIRE_FALSE(target.store.read_chunk_list(second.id, imported));
+  REQUIRE(imported.size() == chunks.size());
+  ObjectView view;
+  REQUIRE_FALSE(target.store.read(second.id, view));
+  REQUIRE(view.content() == data);
+  REQUIRE_FALSE(target.store.read(first.id, view));
+  REQUIRE(hash_object(ObjectType::Blob, view.content()) == first.id);
+
+  REQUIRE_FALSE(unbundle(path, target.store, pool, result));
+  REQUIRE(result.written == 0);
+  REQUIRE(result.present == created.header.objects);
+}
+
+} // namespace chrona
@@ -0,0 +1,252 @@
+#include "checkout/checkout.hpp"
+#include "history/commit.hpp"
+#include "index/index.hpp"
+#include "refs/refs.hpp"
+#include "snapshot/tree_builder.hpp"
+#include "status/status.hpp"
+#include "test_helpers.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <fstream>
+#include <sys/stat.h>
+
+namespace chrona {
+
+namespace {
+
+std::string read(const std::filesystem::path &path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(in), {});
+}
+
+struct CheckoutRepo {
+  explicit CheckoutRepo(const std::filesystem::path &base)
+      : root(base / "work"), chrona_dir(root / ".chrona"),
+        store(chrona_dir / "objects"), pool(2) {
+    std::filesystem::create_directories(chrona_dir / "objects");
+  }
+
+  // Snapshots `dir` into a commit on `ref`.
+  ObjectId commit(const std::filesystem::path &dir, const std::string &ref) {
+    SnapshotResult snapshot;
+    REQUIRE_FALSE(build_snapshot(dir, store, pool, snapshot));
+    Commit commit;
+    commit.tree = snapshot.root;
+    commit.author = "test";
+    commit.message = ref + "\n";
+    ObjectId id;
+    REQUIRE_FALSE(store.write(ObjectType::Commit, encode_commit(commit), id));
+    REQUIRE_FALSE(write_ref(chrona_dir, ref, id));
+    return snapshot.root;
+  }
+
+  // The working tree and the index both hold exactly `tree`.
+  void require_matches(const ObjectId &tree) {
+    std::vector<IndexEntry> files;
+    REQUIRE_FALSE(read_tree_files(store, tree, files));
+    IndexView index;
+    REQUIRE_FALSE(IndexView::open(chrona_dir / "index", index));
+    REQUIRE(index.size() == files.size());
+    for (std::size_t i = 0; i < files.size(); ++i) {
+      REQUIRE(index.path(i) == files[i].path);
+      REQUIRE(index.id(i) == files[i].id);
+      FileStat stat;
+      REQUIRE_FALSE(stat_file(root / files[i].path, stat));
+      REQUIRE(stat.mode == files[i].stat.mode);
+      REQUIRE(index.matches(i, stat));
+      ObjectId id;
+      REQUIRE_FALSE(hash_worktree_file(root / files[i].path, stat, id));
+      REQUIRE(id == files[i].id);
+    }
+  }
+
+  std::filesystem::path root;
+  std::filesystem::path chrona_dir;
+  ObjectStore store;
+  WorkPool pool;
+};
+
+} // namespace
+
+TEST_CASE("checkout - switches branches touching only changed paths",
+          "[checkout]") {
+  test::ScratchDir dir("checkout");
+  CheckoutRepo repo(dir.path());
+
+  auto main_dir = dir.path() / "main";
+  test::write(main_dir / "a.txt", "a\n");
+  test::write(main_dir / "dir" / "b.txt", "b\n");
+  test::write(main_dir / "dir" / "deep" / "c.txt", "c\n");
+  test::write(main_dir / "run.sh", "#!/bin/sh\n");
+  ::chmod((main_dir / "run.sh").c_str(), 0755);
+  std::filesystem::create_symlink("a.txt", main_dir / "link");
+  auto main_tree = repo.commit(main_dir, "refs/heads/main");
+
+  // "dir" turns from a directory into a file, and "a.txt" into a directory
+  auto feature_dir = dir.path() / "feature";
+  test::write(feature_dir / "a.txt" / "inner.txt", "now a directory\n");
+  test::write(feature_dir / "dir", "now a file\n");
+  test::write(feature_dir / "x" / "y" / "z.txt", std::string(100000, 'z'));
+  test::write(feature_dir / "run.sh", "#!/bin/sh\n");
+  ::chmod((feature_dir / "run.sh").c_str(), 0755);
+  auto feature_tree = repo.commit(feature_dir, "refs/heads/feature");
+
+  CheckoutResult result;
+  REQUIRE_FALSE(checkout_tree(repo.root, repo.store, repo.pool, main_tree,
+                              std::nullopt, result));
+  REQUIRE(result.written == 5);
+  repo.require_matches(main_tree);
+  REQUIRE(std::filesystem::read_symlink(repo.root / "link") == "a.txt");
+
+  REQUIRE_FALSE(switch_branch(repo.root, repo.store, repo.pool,
+                              "refs/heads/feature", result));
+  repo.require_matches(feature_tree);
+  REQUIRE(result.unchanged == 1); // run.sh
+  REQUIRE(result.removed == 4);
+  REQUIRE(result.written == 3);
+  REQUIRE_FALSE(std::filesystem::exists(repo.root / "link"));
+  std::string head;
+  REQUIRE_FALSE(read_head(repo.chrona_dir, head));
+  REQUIRE(head == "refs/heads/feature");
+  REQUIRE_FALSE(std::filesystem::exists(repo.chrona_dir / "CHECKOUT"));
+
+  REQUIRE_FALSE(switch_branch(repo.root, repo.store, repo.pool,
+                              "refs/heads/main", result));
+  repo.require_matches(main_tree);
+  REQUIRE_FALSE(std::filesystem::exists(repo.root / "x"));
+}
+
+TEST_CASE("checkout - refuses to lose local work unless forced",
+          "[checkout]") {
+  test::ScratchDir dir("checkout");
+  CheckoutRepo repo(dir.path());
+
+  auto main_dir = dir.path() / "main";
+  test::write(main_dir / "a.txt", "a\n");
+  test::write(main_dir / "keep.txt", "same\n");
+  auto main_tree = repo.commit(main_dir, "refs/heads/main");
+  auto feature_dir = dir.path() / "feature";
+  test::write(feature_dir / "a.txt", "feature\n");
+  test::write(feature_dir / "keep.txt", "same\n");
+  test::write(feature_dir / "new.txt", "new\n");
+  auto feature_tree = repo.commit(feature_dir, "refs/heads/feature");
+
+  CheckoutResult result;
+  REQUIRE_FALSE(switch_branch(repo.root, repo.store, repo.pool,
+                              "refs/heads/main", result));
+
+  SECTION("unstaged changes") {
+    test::write(repo.root / "a.txt", "edited\n");
+    auto error = switch_branch(repo.root, repo.store, repo.pool,
+                               "refs/heads/feature", result);
+    REQUIRE(error.has_value());
+    REQUIRE(error->error_code == ErrorCode::AlreadyExists);
+    REQUIRE(read(repo.root / "a.txt") == "edited\n");
+    REQUIRE_FALSE(std::filesystem::exists(repo.chrona_dir / "CHECKOUT"));
+
+    // Edits to paths the switch does not touch are carried along
+    test::write(repo.root / "a.txt", "a\n");
+    test::write(repo.root / "keep.txt", "local edit\n");
+    REQUIRE_FALSE(switch_branch(repo.root, repo.store, repo.pool,
+                                "refs/heads/feature", result));
+    REQUIRE(read(repo.root / "keep.txt") == "local edit\n");
+  }
+  SECTION("untracked file in the way") {
+    test::write(repo.root / "new.txt", "mine\n");
+    REQUIRE(switch_branch(repo.root, repo.store, repo.pool,
+                          "refs/heads/feature", result)
+                .has_value());
+    REQUIRE(read(repo.root / "new.txt") == "mine\n");
+
+    CheckoutOptions options;
+    options.force = true;
+    REQUIRE_FALSE(switch_branch(repo.root, repo.store, repo.pool,
+                                "refs/heads/feature", result, options));
+    repo.require_matches(feature_tree);
+  }
+  SECTION("untracked file where a directory goes") {
+    auto nested_dir = dir.path() / "nested";
+    test::write(nested_dir / "a.txt", "a\n");
+    test::write(nested_dir / "sub" / "deep.txt", "deep\n");
+    repo.commit(nested_dir, "refs/heads/nested");
+    test::write(repo.root / "sub", "mine\n");
+    auto error = switch_branch(repo.root, repo.store, repo.pool,
+                               "refs/heads/nested", result);
+    REQUIRE(error.has_value());
+    REQUIRE(error->error_code == ErrorCode::AlreadyExists);
+    REQUIRE(error->message.find(": sub ") != std::string::npos);
+    // Refused while planning, so keep.txt was not removed yet
+    REQUIRE(read(repo.root / "keep.txt") == "same\n");
+    REQUIRE(read(repo.root / "sub") == "mine\n");
+    REQUIRE_FALSE(std::filesystem::exists(repo.chrona_dir / "CHECKOUT"));
+  }
+  SECTION("staged changes") {
+    test::write(repo.root / "a.txt", "staged\n");
+    std::vector<IndexEntry> entries;
+    IndexEntry staged;
+    ObjectBatch batch(repo.store);
+    bool hashed = false;
+    REQUIRE_FALSE(stage_file(repo.root / "a.txt", "a.txt", batch, nullptr,
+                             staged, hashed));
+    REQUIRE_FALSE(batch.commit());
+    IndexView index;
+    REQUIRE_FALSE(IndexView::open(repo.chrona_dir / "index", index));
+    entries = index.entries();
+    entries[0] = staged;
+    index = IndexView();
+    REQUIRE_FALSE(write_index(repo.chrona_dir / "index", entries));
+
+    auto error = switch_branch(repo.root, repo.store, repo.pool,
+                               "refs/heads/feature", result);
+    REQUIRE(error.has_value());
+    REQUIRE(error->message.find("staged") != std::string::npos);
+  }
+  (void)main_tree;
+}
+
+TEST_CASE("checkout - an interrupted switch is rolled forward",
+          "[checkout]") {
+  test::ScratchDir dir("checkout");
+  CheckoutRepo repo(dir.path());
+
+  auto main_dir = dir.path() / "main";
+  for (int i = 0; i < 50; ++i) {
+    test::write(main_dir / ("f" + std::to_string(i)),
+                "main " + std::to_string(i));
+  }
+  auto main_tree = repo.commit(main_dir, "refs/heads/main");
+  auto feature_dir = dir.path() / "feature";
+  for (int i = 0; i < 50; ++i) {
+    test::write(feature_dir / ("f" + std::to_string(i)),
+                "feature " + std::to_string(i));
+  }
+  auto feature_tree = repo.commit(feature_dir, "refs/heads/feature");
+
+  CheckoutResult result;
+  REQUIRE_FALSE(switch_branch(repo.root, repo.store, repo.pool,
+                              "refs/heads/main", result));
+  repo.require_matches(main_tree);
+
+  // Simulate a crash halfway: the journal is written and some files are
+  // already switched, but neither the index nor HEAD moved
+  REQUIRE_FALSE(write_file_atomic(repo.chrona_dir / "CHECKOUT",
+                                  "ref: refs/heads/feature\ntree " +
+                                      feature_tree.hex() + "\n"));
+  for (int i = 0; i < 20; ++i) {
+    test::write(repo.root / ("f" + std::to_string(i)),
+                "feature " + std::to_string(i));
+  }
+
+  bool resumed = false;
+  REQUIRE_FALSE(resume_checkout(repo.root, repo.store, repo.pool, resumed));
+  REQUIRE(resumed);
+  repo.require_matches(feature_tree);
+  std::string head;
+  REQUIRE_FALSE(read_head(repo.chrona_dir, head));
+  REQUIRE(head == "refs/heads/feature");
+  REQUIRE_FALSE(std::filesystem::exists(repo.chrona_dir / "CHECKOUT"));
+
+  REQUIRE_FALSE(resume_checkout(repo.root, repo.store, repo.pool, resumed));
+  REQUIRE_FALSE(resumed);
+}
+
+} // namespace chrona
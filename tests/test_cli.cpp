@@ -1,5 +1,6 @@
 #include "cli/cli.hpp"
 #include <catch2/catch_test_macros.hpp>
+#include <string_view>
 #include <vector>
 
 namespace chrona {
@@ -65,7 +66,113 @@ TEST_CASE("parse_args - unknown command with extra args", "[cli]") {
 
   REQUIRE(result.action == ParseAction::Error);
   REQUIRE(result.error_message.has_value());
-  REQUIRE(result.error_message.value() == "Too many arguments provided");
+  REQUIRE(result.error_message.value() == "Unknown command: unknown");
+}
+
+TEST_CASE("parse_args - options are checked against the command table",
+          "[cli]") {
+  SECTION("arguments are views into argv") {
+    const char *argv[] = {"chrona", "log", "-n", "5", "main", "--", "src"};
+    auto result = parse_args(7, const_cast<char **>(argv));
+
+    REQUIRE(result.action == ParseAction::RunCommand);
+    REQUIRE(result.command.value() == Command::Log);
+    REQUIRE(result.args.size() == 5);
+    REQUIRE(result.args[0] == "-n");
+    REQUIRE(result.args[4].data() == argv[6]);
+    std::vector<std::string_view> seen(result.args.begin(),
+                                       result.args.end());
+    REQUIRE(seen.back() == "src");
+
+    REQUIRE(result.options.size() == 1);
+    REQUIRE(result.options.find("-n")->value.data() == argv[3]);
+    std::vector<std::string_view> operands(result.operands.begin(),
+                                           result.operands.end());
+    REQUIRE(operands == std::vector<std::string_view>{"main", "src"});
+    REQUIRE(result.operands[1].data() == argv[6]);
+    REQUIRE(result.separator == 1);
+  }
+
+  SECTION("joined values") {
+    const char *argv[] = {"chrona", "gc", "--budget=10", "--grace=0"};
+    auto result = parse_args(4, const_cast<char **>(argv));
+    REQUIRE(result.action == ParseAction::RunCommand);
+    REQUIRE(result.args.size() == 2);
+    REQUIRE(result.options.find("--budget=")->value == "10");
+    REQUIRE(result.options.find("--grace=")->value == "0");
+    REQUIRE(result.operands.empty());
+  }
+
+  SECTION("options and operands interleave, and the last repeat wins") {
+    const char *argv[] = {"chrona", "diff", "-U1", "--", "--patience"};
+    auto result = parse_args(5, const_cast<char **>(argv));
+    REQUIRE(result.action == ParseAction::Error);
+
+    const char *argv2[] = {"chrona", "checkout", "-f", "main", "--force",
+                           "--"};
+    result = parse_args(6, const_cast<char **>(argv2));
+    REQUIRE(result.action == ParseAction::RunCommand);
+    REQUIRE(result.options.size() == 2);
+    REQUIRE(result.operands.size() == 1);
+    REQUIRE(result.operands[0] == "main");
+    REQUIRE(*result.operands.begin() == "main");
+    REQUIRE(result.separator == 1);
+
+    const char *argv3[] = {"chrona", "log", "-n", "1", "-n", "2"};
+    result = parse_args(6, const_cast<char **>(argv3));
+    REQUIRE(result.options.find("-n")->value == "2");
+    REQUIRE(result.operands.empty());
+    REQUIRE_FALSE(result.separator);
+  }
+
+  SECTION("too many options") {
+    std::vector<const char *> argv{"chrona", "checkout"};
+    for (std::size_t i = 0; i <= max_options; ++i) {
+      argv.push_back("-f");
+    }
+    auto result = parse_args(static_cast<int>(argv.size()),
+                             const_cast<char **>(argv.data()));
+    REQUIRE(result.action == ParseAction::Error);
+    REQUIRE(result.error_message.value() == "Too many options provided");
+  }
+
+  SECTION("unknown option") {
+    const char *argv[] = {"chrona", "log", "--oneline"};
+    auto result = parse_args(3, const_cast<char **>(argv));
+    REQUIRE(result.action == ParseAction::Error);
+    REQUIRE(result.error_message.value() ==
+            "Unknown option for log: --oneline");
+  }
+
+  SECTION("missing value") {
+    const char *argv[] = {"chrona", "commit", "-m"};
+    auto result = parse_args(3, const_cast<char **>(argv));
+    REQUIRE(result.action == ParseAction::Error);
+    REQUIRE(result.error_message.value() == "Option -m needs a value");
+  }
+
+  SECTION("too many operands") {
+    const char *argv[] = {"chrona", "checkout", "-f", "main", "other"};
+    auto result = parse_args(5, const_cast<char **>(argv));
+    REQUIRE(result.action == ParseAction::Error);
+    REQUIRE(result.error_message.value() == "Too many arguments provided");
+  }
+
+  SECTION("after -- everything is an operand") {
+    const char *argv[] = {"chrona", "add", "--", "-odd-name", "--help"};
+    auto result = parse_args(5, const_cast<char **>(argv));
+    REQUIRE(result.action == ParseAction::RunCommand);
+    REQUIRE(result.args.size() == 3);
+    REQUIRE(result.operands.size() == 2);
+    REQUIRE(result.operands[0] == "-odd-name");
+    REQUIRE(result.separator == 0);
+  }
+
+  SECTION("a lone dash is an operand") {
+    const char *argv[] = {"chrona", "cat-file", "-"};
+    auto result = parse_args(3, const_cast<char **>(argv));
+    REQUIRE(result.action == ParseAction::RunCommand);
+  }
 }
 
 TEST_CASE("parse_args - empty string as command", "[cli]") {
@@ -142,4 +249,16 @@ TEST_CASE("ParseResult structure", "[cli]") {
   REQUIRE(error_result.error_message.value() == "Test error message");
 }
 
-} // namespace chrona
\ No newline at end of file
+} // namespace chrona
+namespace chrona {
+
+TEST_CASE("parse_args - add command", "[cli]") {
+  const char *argv[] = {"chrona", "add"};
+  auto result = parse_args(2, const_cast<char **>(argv));
+
+  REQUIRE(result.action == ParseAction::RunCommand);
+  REQUIRE(result.command.value() == Command::Add);
+  REQUIRE(result.args.empty());
+}
+
+} // namespace chrona
@@ -0,0 +1,249 @@
+#include "compress/compress.hpp"
+#include "objects/object_store.hpp"
+#include "pack/pack_writer.hpp"
+#include "repo/repo.hpp"
+#include "repo/repository.hpp"
+#include "test_helpers.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <fstream>
+#include <random>
+
+namespace chrona {
+
+namespace {
+
+std::string source_like(std::size_t size, unsigned seed) {
+  static const char *words[] = {"int",    "return", "const",  "std::string",
+                                "value",  "if",     "else",   "for",
+                                "chrona", "error",  "object", "{", "}", ";"};
+  std::mt19937 rng(seed);
+  std::string out;
+  while (out.size() < size) {
+    out += words[rng() % std::size(words)];
+    out += rng() % 8 == 0 ? '\n' : ' ';
+  }
+  out.resize(size);
+  return out;
+}
+
+std::string random_bytes(std::size_t size, unsigned seed) {
+  std::mt19937 rng(seed);
+  std::string out(size, '\0');
+  for (auto &c : out) {
+    c = static_cast<char>(rng());
+  }
+  return out;
+}
+
+std::string round_trip(std::string_view data,
+                       const CompressionOptions &options) {
+  auto stream = compress(data, options);
+  std::string out;
+  auto error = decompress(stream, data.size(), out);
+  REQUIRE_FALSE(error);
+  return out;
+}
+
+} // namespace
+
+TEST_CASE("compress - every codec and level round trips", "[compress]") {
+  std::vector<std::string> inputs = {
+      "",
+      "a",
+      std::string(200000, 'x'),
+      source_like(3 * compress_block_size + 123, 1),
+      random_bytes(100000, 2),
+      source_like(1000, 3) + random_bytes(1000, 4) + source_like(1000, 3),
+  };
+  for (auto codec : {Codec::None, Codec::Fast, Codec::Dense}) {
+    for (int level : {1, 5, 9}) {
+      CompressionOptions options{codec, level};
+      for (const auto &input : inputs) {
+        REQUIRE(round_trip(input, options) == input);
+      }
+    }
+  }
+
+  auto text = source_like(500000, 5);
+  auto fast = compress(text, {Codec::Fast, 0});
+  auto dense = compress(text, {Codec::Dense, 0});
+  REQUIRE(fast.size() < text.size() / 2);
+  REQUIRE(dense.size() < fast.size());
+
+  // Incompressible input is stored, costing only the block framing
+  auto noise = random_bytes(200000, 6);
+  REQUIRE(compress(noise, {Codec::Dense, 9}).size() < noise.size() + 64);
+}
+
+TEST_CASE("compress - streaming matches one-shot and rejects corruption",
+          "[compress]") {
+  auto text = source_like(300000, 7);
+  CompressionOptions options{Codec::Dense, 6};
+
+  // Feeding odd-sized pieces gives the same stream as one call
+  Compressor compressor(options);
+  std::string streamed;
+  for (std::size_t at = 0; at < text.size(); at += 7777) {
+    compressor.update(std::string_view(text).substr(at, 7777), streamed);
+  }
+  compressor.finish(streamed);
+  REQUIRE(streamed == compress(text, options));
+
+  // Output arrives one block at a time and the stream ends at its marker
+  auto followed = streamed + "tail";
+  std::string_view in = followed;
+  std::size_t chunks = 0;
+  std::string out;
+  REQUIRE_FALSE(decompress(in, [&](std::string_view chunk) {
+    REQUIRE(chunk.size() <= compress_block_size);
+    ++chunks;
+    out.append(chunk);
+    return std::optional<Error>();
+  }));
+  REQUIRE(out == text);
+  REQUIRE(chunks == (text.size() + compress_block_size - 1) /
+                       compress_block_size);
+  REQUIRE(in == "tail");
+
+  SECTION("truncation") {
+    auto error = decompress(std::string_view(streamed).substr(0, 1000),
+                            text.size(), out);
+    REQUIRE(error.has_value());
+    REQUIRE(error->error_code == ErrorCode::CorruptObject);
+  }
+  SECTION("flipped bytes") {
+    bool rejected_or_differs = true;
+    for (std::size_t at = 20; at < 2000; at += 97) {
+      auto damaged = streamed;
+      damaged[at] = static_cast<char>(damaged[at] ^ 0x5a);
+      auto error = decompress(damaged, text.size(), out);
+      rejected_or_differs = rejected_or_differs && (error || out != text);
+    }
+    REQUIRE(rejected_or_differs);
+  }
+  SECTION("wrong recorded size") {
+    REQUIRE(decompress(streamed, text.size() + 1, out).has_value());
+    // A size no stream this short can reach fails instead of allocating
+    auto error = decompress(streamed, 99999999999999999ull, out);
+    REQUIRE(error);
+    REQUIRE(error->error_code == ErrorCode::CorruptObject);
+  }
+}
+
+TEST_CASE("compress - the store writes, streams and packs compressed objects",
+          "[compress]") {
+  test::ScratchDir dir("compress-store");
+  ObjectStore store(dir.path());
+  auto text = source_like(200000, 8);
+
+  // Written before compression is turned on: stays readable
+  ObjectId plain;
+  REQUIRE_FALSE(store.write(ObjectType::Blob, "plain\n", plain));
+
+  for (auto codec : {Codec::Fast, Codec::Dense}) {
+    store.set_compression({codec, 0});
+    auto content = text + codec_name(codec);
+    ObjectId id;
+    REQUIRE_FALSE(store.write(ObjectType::Blob, content, id));
+    REQUIRE(std::filesystem::file_size(store.object_path(id)) <
+            content.size() / 2);
+
+    auto file = dir.path() / (std::string(codec_name(codec)) + ".txt");
+    { std::ofstream(file, std::ios::binary) << content << "!"; }
+    ObjectId file_id;
+    REQUIRE_FALSE(store.write_file(file, file_id));
+    REQUIRE(file_id == hash_object(ObjectType::Blob, content + "!"));
+
+    ObjectView view;
+    REQUIRE_FALSE(store.read(id, view));
+    REQUIRE(view.type() == ObjectType::Blob);
+    REQUIRE(view.content() == content);
+    REQUIRE_FALSE(store.read(file_id, view));
+    REQUIRE(view.content() == content + "!");
+
+    std::uint64_t size = 0;
+    std::string streamed;
+    std::size_t chunks = 0;
+    REQUIRE_FALSE(store.read_stream(
+        id,
+        [&](ObjectType type, std::uint64_t length) {
+          REQUIRE(type == ObjectType::Blob);
+          size = length;
+          return std::optional<Error>();
+        },
+        [&](std::string_view chunk) {
+          ++chunks;
+          streamed.append(chunk);
+          return std::optional<Error>();
+        }));
+    REQUIRE(size == content.size());
+    REQUIRE(streamed == content);
+    REQUIRE(chunks > 1);
+  }
+
+  ObjectView view;
+  REQUIRE_FALSE(store.read(plain, view));
+  REQUIRE(view.content() == "plain\n");
+
+  SECTION("packs compress entries too") {
+    store.set_compression({Codec::Dense, 0});
+    std::vector<ObjectId> ids;
+    std::vector<std::string> contents;
+    for (int i = 0; i < 4; ++i) {
+      contents.push_back(source_like(20000, 20 + i));
+      ObjectId id;
+      REQUIRE_FALSE(store.write(ObjectType::Blob, contents.back(), id));
+      ids.push_back(id);
+    }
+    PackResult result;
+    REQUIRE_FALSE(write_pack(store.pack_dir(), store, ids, result));
+    REQUIRE(result.bytes < 4 * 20000 / 2);
+    for (const auto &id : ids) {
+      std::filesystem::remove(store.object_path(id));
+    }
+    REQUIRE_FALSE(store.reload_packs());
+    for (std::size_t i = 0; i < ids.size(); ++i) {
+      REQUIRE_FALSE(store.read(ids[i], view));
+      REQUIRE(view.content() == contents[i]);
+    }
+  }
+  SECTION("a damaged compressed object is reported as corrupt") {
+    store.set_compression({Codec::Fast, 0});
+    ObjectId id;
+    REQUIRE_FALSE(store.write(ObjectType::Blob, text, id));
+    std::filesystem::resize_file(store.object_path(id), 500);
+    auto error = store.read(id, view);
+    REQUIRE(error.has_value());
+    REQUIRE(error->error_code == ErrorCode::CorruptObject);
+  }
+}
+
+TEST_CASE("compress - the repository config picks the codec", "[compress]") {
+  CompressionOptions options;
+  RepoConfig config;
+  REQUIRE_FALSE(RepoConfig::parse("", config));
+  REQUIRE_FALSE(read_compression(config, options));
+  REQUIRE(options.codec == Codec::None);
+
+  REQUIRE_FALSE(RepoConfig::parse(
+      "compression = dense\ncompression.level = 8\n", config));
+  REQUIRE_FALSE(read_compression(config, options));
+  REQUIRE(options.codec == Codec::Dense);
+  REQUIRE(options.level == 8);
+
+  REQUIRE_FALSE(RepoConfig::parse("compression = zip\n", config));
+  REQUIRE(read_compression(config, options).has_value());
+  REQUIRE_FALSE(RepoConfig::parse("compression.level = 10\n", config));
+  REQUIRE(read_compression(config, options).has_value());
+
+  test::ScratchDir dir("compress-config");
+  REQUIRE_FALSE(init_repo(dir.path()));
+  {
+    std::ofstream(dir.path() / ".chrona" / "config") << "compression = fast\n";
+  }
+  Repository repo;
+  REQUIRE_FALSE(Repository::open(dir.path(), repo));
+  REQUIRE(repo.objects().compression().codec == Codec::Fast);
+}
+
+} // namespace chrona
@@ -0,0 +1,208 @@
+#include "diff/diff.hpp"
+#include "diff/file_diff.hpp"
+#include "diff/lines.hpp"
+#include "parallel/work_pool.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <random>
+
+namespace chrona {
+
+namespace {
+
+std::vector<std::uint32_t> random_ids(std::mt19937 &rng, std::size_t size,
+                                      std::uint32_t alphabet) {
+  std::vector<std::uint32_t> out(size);
+  for (auto &id : out) {
+    id = rng() % alphabet;
+  }
+  return out;
+}
+
+// Lines left unchanged on each side must be the same sequence
+bool consistent(const std::vector<std::uint32_t> &a,
+                const std::vector<std::uint32_t> &b, const EditScript &script) {
+  std::vector<std::uint32_t> kept_a;
+  std::vector<std::uint32_t> kept_b;
+  for (std::size_t i = 0; i < a.size(); ++i) {
+    if (!script.removed[i]) {
+      kept_a.push_back(a[i]);
+    }
+  }
+  for (std::size_t j = 0; j < b.size(); ++j) {
+    if (!script.added[j]) {
+      kept_b.push_back(b[j]);
+    }
+  }
+  return kept_a == kept_b;
+}
+
+std::size_t edit_count(const EditScript &script) {
+  std::size_t count = 0;
+  for (bool changed : script.removed) {
+    count += changed;
+  }
+  for (bool changed : script.added) {
+    count += changed;
+  }
+  return count;
+}
+
+std::size_t lcs_distance(const std::vector<std::uint32_t> &a,
+                         const std::vector<std::uint32_t> &b) {
+  std::vector<std::vector<std::size_t>> lcs(
+      a.size() + 1, std::vector<std::size_t>(b.size() + 1, 0));
+  for (std::size_t i = 1; i <= a.size(); ++i) {
+    for (std::size_t j = 1; j <= b.size(); ++j) {
+      lcs[i][j] = a[i - 1] == b[j - 1]
+                      ? lcs[i - 1][j - 1] + 1
+                      : std::max(lcs[i - 1][j], lcs[i][j - 1]);
+    }
+  }
+  return a.size() + b.size() - 2 * lcs[a.size()][b.size()];
+}
+
+} // namespace
+
+TEST_CASE("split_lines - kernels agree", "[diff]") {
+  std::mt19937 rng(7);
+  std::string text;
+  for (int i = 0; i < 2000; ++i) {
+    text += std::string(rng() % 90, static_cast<char>('a' + rng() % 26));
+    text += '\n';
+  }
+  text += "no trailing newline";
+
+  std::vector<std::string_view> fast;
+  std::vector<std::string_view> scalar;
+  split_lines(text, fast);
+  split_lines(text, scalar, LineKernel::Scalar);
+  REQUIRE(fast == scalar);
+  REQUIRE(fast.size() == 2001);
+  REQUIRE(fast.back() == "no trailing newline");
+
+  split_lines("", fast);
+  REQUIRE(fast.empty());
+
+  LineInterner interner;
+  auto first = interner.intern("same\n");
+  REQUIRE(interner.intern("other\n") != first);
+  REQUIRE(interner.intern("same\n") == first);
+  REQUIRE(interner.size() == 2);
+}
+
+TEST_CASE("diff_ids - every algorithm yields a valid edit script", "[diff]") {
+  std::mt19937 rng(42);
+  for (auto algorithm : {DiffAlgorithm::Myers, DiffAlgorithm::Histogram,
+                         DiffAlgorithm::Patience}) {
+    DiffOptions options;
+    options.algorithm = algorithm;
+    for (int round = 0; round < 200; ++round) {
+      auto a = random_ids(rng, rng() % 60, 1 + rng() % 12);
+      auto b = random_ids(rng, rng() % 60, 1 + rng() % 12);
+      auto script = diff_ids(a, b, 12, options);
+      REQUIRE(script.removed.size() == a.size());
+      REQUIRE(script.added.size() == b.size());
+      REQUIRE(consistent(a, b, script));
+      if (algorithm == DiffAlgorithm::Myers) {
+        REQUIRE(edit_count(script) == lcs_distance(a, b));
+      }
+    }
+  }
+}
+
+TEST_CASE("diff_ids - the cost cutoff still gives a valid script", "[diff]") {
+  std::mt19937 rng(3);
+  auto a = random_ids(rng, 3000, 50);
+  auto b = random_ids(rng, 3000, 50);
+  DiffOptions options;
+  options.algorithm = DiffAlgorithm::Myers;
+  options.max_cost = 4;
+  auto script = diff_ids(a, b, 50, options);
+  REQUIRE(consistent(a, b, script));
+}
+
+TEST_CASE("diff_text - unified hunks with context", "[diff]") {
+  std::string old_text;
+  for (int i = 1; i <= 20; ++i) {
+    old_text += "line " + std::to_string(i) + "\n";
+  }
+  std::string new_text = old_text;
+  new_text.replace(new_text.find("line 2\n"), 7, "line two\n");
+  new_text.replace(new_text.find("line 18\n"), 8, "");
+  new_text += "tail";
+
+  std::string out;
+  auto stats = diff_text(old_text, new_text, [&](const DiffHunk &hunk) {
+    format_hunk(hunk, out);
+    return true;
+  });
+  REQUIRE(stats.hunks == 2);
+  REQUIRE(stats.added == 2);
+  REQUIRE(stats.removed == 2);
+  REQUIRE(out == "@@ -1,5 +1,5 @@\n"
+                 " line 1\n"
+                 "-line 2\n"
+                 "+line two\n"
+                 " line 3\n"
+                 " line 4\n"
+                 " line 5\n"
+                 "@@ -15,6 +15,6 @@\n"
+                 " line 15\n"
+                 " line 16\n"
+                 " line 17\n"
+                 "-line 18\n"
+                 " line 19\n"
+                 " line 20\n"
+                 "+tail\n"
+                 "\\ No newline at end of file\n");
+
+  SECTION("returning false stops after the first hunk") {
+    auto first_only = diff_text(old_text, new_text,
+                                [](const DiffHunk &) { return false; });
+    REQUIRE(first_only.hunks == 1);
+  }
+}
+
+TEST_CASE("diff_files - output order does not depend on scheduling",
+          "[diff]") {
+  std::vector<FileDiffJob> jobs;
+  for (int i = 0; i < 64; ++i) {
+    FileDiffJob job;
+    job.old_label = "a/file" + std::to_string(i);
+    job.new_label = "b/file" + std::to_string(i);
+    job.load = [i](std::string &old_text, std::string &new_text) {
+      old_text = std::string(static_cast<std::size_t>(i % 7) * 1000, 'x') +
+                 "\nsame\n";
+      new_text = i % 5 == 0 ? old_text : old_text + "added\n";
+      return std::optional<Error>();
+    };
+    jobs.push_back(std::move(job));
+  }
+  jobs[3].load = [](std::string &old_text, std::string &new_text) {
+    old_text = std::string("bin\0ary", 7);
+    new_text = "text\n";
+    return std::optional<Error>();
+  };
+
+  std::string serial;
+  std::string parallel;
+  WorkPool one(1);
+  WorkPool four(4);
+  std::vector<std::size_t> order;
+  REQUIRE_FALSE(diff_files(jobs, one, {},
+                           [&](std::size_t, std::string_view text) {
+                             serial += text;
+                           }));
+  REQUIRE_FALSE(diff_files(jobs, four, {},
+                           [&](std::size_t i, std::string_view text) {
+                             order.push_back(i);
+                             parallel += text;
+                           }));
+  REQUIRE(serial == parallel);
+  REQUIRE(std::is_sorted(order.begin(), order.end()));
+  REQUIRE(order.size() == 64 - 13); // equal pairs print nothing
+  REQUIRE(parallel.find("Binary files a/file3 and b/file3 differ") !=
+          std::string::npos);
+}
+
+} // namespace chrona
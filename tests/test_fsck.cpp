@@ -0,0 +1,202 @@
+#include "fsck/fsck.hpp"
+#include "index/index.hpp"
+#include "history/commit.hpp"
+#include "io/file_io.hpp"
+#include "merge/merge.hpp"
+#include "pack/pack_writer.hpp"
+#include "refs/refs.hpp"
+#include "snapshot/tree.hpp"
+#include "test_helpers.hpp"
+#include <catch2/catch_test_macros.hpp>
+
+namespace chrona {
+
+namespace {
+
+std::string text(std::size_t lines, std::size_t seed) {
+  std::string out;
+  for (std::size_t i = 0; i < lines; ++i) {
+    out += "line " + std::to_string(i * 7919 + seed) + "\n";
+  }
+  return out;
+}
+
+// Large blobs are chunked, so fsck sees every kind of object.
+struct FsckRepo : test::TestRepo {
+  explicit FsckRepo(const std::filesystem::path &root) : TestRepo(root) {
+    store.set_chunking({64 * 1024, 4096});
+  }
+
+  FsckResult check(const FsckOptions &options = {}) {
+    // A store of its own, so nothing cached hides damage on disk
+    ObjectStore fresh(chrona_dir / "objects");
+    WorkPool pool(3);
+    FsckResult result;
+    REQUIRE_FALSE(fsck(chrona_dir, fresh, pool, result, options));
+    return result;
+  }
+};
+
+bool has(const FsckResult &result, FsckProblem problem, const ObjectId &id) {
+  for (const auto &issue : result.issues) {
+    if (issue.problem == problem && issue.id == id) {
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace
+
+TEST_CASE("fsck - finds damage in loose and packed objects", "[fsck]") {
+  test::ScratchDir dir("fsck");
+  FsckRepo repo(dir.path());
+
+  // The first commit goes into a pack, the second stays loose and holds
+  // a chunked blob
+  auto a = repo.file("a.txt", text(50, 1));
+  auto b = repo.file("b.txt", text(50, 2));
+  repo.commit({a, b});
+  std::vector<ObjectId> ids;
+  repo.store.for_each_loose([&](const ObjectId &id) { ids.push_back(id); });
+  PackResult packed;
+  REQUIRE_FALSE(write_pack(repo.store.pack_dir(), repo.store, ids, packed));
+  for (const auto &id : ids) {
+    std::filesystem::remove(repo.store.object_path(id));
+  }
+  REQUIRE_FALSE(repo.store.reload_packs());
+  auto big = repo.file("big.bin", text(20000, 3));
+  auto c = repo.file("c.txt", "small\n");
+  repo.commit({a, big, b, c});
+  std::vector<ChunkRef> chunks;
+  REQUIRE_FALSE(repo.store.read_chunk_list(big.id, chunks));
+  REQUIRE(chunks.size() > 2);
+
+  repo.store.for_each_loose(
+      [&](const ObjectId &id) { test::age(repo.store.object_path(id)); });
+  auto clean = repo.check();
+  REQUIRE(clean.issues.empty());
+  REQUIRE(clean.packed == 4);
+  REQUIRE(clean.loose == 4 + chunks.size());
+  REQUIRE(clean.chunked == 1);
+  REQUIRE(clean.packs == 1);
+  REQUIRE(clean.skipped == 0);
+  REQUIRE(clean.reachable == 8 + chunks.size());
+
+  SECTION("a loose object with the wrong content") {
+    REQUIRE_FALSE(write_file_atomic(repo.store.object_path(c.id),
+                                    std::string("blob 6") + '\0' + "smell\n"));
+    auto result = repo.check();
+    REQUIRE(result.issues.size() == 1);
+    REQUIRE(has(result, FsckProblem::HashMismatch, c.id));
+  }
+
+  SECTION("a compressed loose object with a forged size") {
+    ObjectStore compressed(repo.store.root());
+    compressed.set_compression({Codec::Fast});
+    ObjectId id;
+    REQUIRE_FALSE(compressed.write(ObjectType::Blob, text(100, 4), id));
+    std::string file;
+    REQUIRE_FALSE(read_file(compressed.object_path(id), file));
+    REQUIRE(file.front() == '\0');
+    auto nul = file.find('\0', 1);
+    file = file.substr(0, 1) + "blob 99999999999999999" + file.substr(nul);
+    std::filesystem::remove(compressed.object_path(id));
+    REQUIRE_FALSE(write_file_atomic(compressed.object_path(id), file));
+    auto result = repo.check();
+    REQUIRE(result.issues.size() == 1);
+    REQUIRE(has(result, FsckProblem::Unreadable, id));
+  }
+
+  SECTION("a missing blob and a missing chunk") {
+    std::filesystem::remove(repo.store.object_path(c.id));
+    std::filesystem::remove(repo.store.object_path(chunks[1].id));
+    auto result = repo.check();
+    REQUIRE(result.issues.size() == 2);
+    REQUIRE(has(result, FsckProblem::Missing, c.id));
+    REQUIRE(has(result, FsckProblem::Missing, chunks[1].id));
+  }
+
+  SECTION("a damaged pack") {
+    std::string data;
+    REQUIRE_FALSE(read_file(packed.path, data));
+    data[data.size() / 2] = static_cast<char>(data[data.size() / 2] ^ 0x01);
+    REQUIRE_FALSE(write_file_atomic(packed.path, data));
+    auto result = repo.check();
+    REQUIRE(result.issues.size() >= 2);
+    bool bad_pack = false;
+    for (const auto &issue : result.issues) {
+      bad_pack = bad_pack || issue.problem == FsckProblem::BadPack;
+    }
+    REQUIRE(bad_pack);
+  }
+
+  SECTION("a tree out of order and a ref to a blob") {
+    auto unsorted = encode_tree({b}) + encode_tree({a});
+    ObjectId tree;
+    REQUIRE_FALSE(repo.store.write(ObjectType::Tree, unsorted, tree));
+    REQUIRE_FALSE(write_ref(repo.chrona_dir, "refs/heads/blob", c.id));
+    auto result = repo.check();
+    REQUIRE(result.issues.size() == 2);
+    REQUIRE(has(result, FsckProblem::BadEncoding, tree));
+    REQUIRE(has(result, FsckProblem::BadRef, c.id));
+  }
+
+  SECTION("sampling checks a share and records nothing") {
+    std::filesystem::remove(repo.chrona_dir / "fsck-state");
+    FsckOptions options;
+    options.sample = 0.5;
+    options.seed = 7;
+    auto result = repo.check(options);
+    REQUIRE(result.issues.empty());
+    REQUIRE(result.loose + result.packed + result.skipped ==
+            clean.loose + clean.packed);
+    REQUIRE(result.skipped > 0);
+    REQUIRE(result.loose + result.packed > 0);
+    REQUIRE_FALSE(std::filesystem::exists(repo.chrona_dir / "fsck-state"));
+  }
+
+  SECTION("an incremental run checks only what is new") {
+    FsckOptions options;
+    options.incremental = true;
+    auto result = repo.check(options);
+    REQUIRE(result.loose + result.packed == 0);
+    REQUIRE(result.packs == 0);
+    REQUIRE(result.skipped == clean.loose + clean.packed);
+
+    repo.file("d.txt", "new\n");
+    result = repo.check(options);
+    REQUIRE(result.loose == 1);
+    REQUIRE(result.issues.empty());
+
+    // Links are walked from the roots however old the objects are
+    std::filesystem::remove(repo.store.object_path(c.id));
+    std::filesystem::remove(repo.store.object_path(chunks[1].id));
+    result = repo.check(options);
+    REQUIRE(result.packed == 0);
+    REQUIRE(result.issues.size() == 2);
+    REQUIRE(has(result, FsckProblem::Missing, c.id));
+    REQUIRE(has(result, FsckProblem::Missing, chunks[1].id));
+  }
+
+  SECTION("MERGE_HEAD and the index are roots") {
+    auto gone = hash_object(ObjectType::Commit, "never written");
+    REQUIRE_FALSE(write_merge_head(repo.chrona_dir, gone));
+    auto regular = static_cast<std::uint32_t>(EntryMode::Regular);
+    IndexEntry entry;
+    entry.path = "a.txt";
+    entry.id = hash_object(ObjectType::Blob, "not stored");
+    IndexConflict sides;
+    sides.ours = {regular, a.id};
+    sides.theirs = {regular, hash_object(ObjectType::Blob, "nor this")};
+    entry.conflict = sides;
+    REQUIRE_FALSE(write_index(repo.chrona_dir / "index", {entry}));
+    auto result = repo.check();
+    REQUIRE(result.issues.size() == 3);
+    REQUIRE(has(result, FsckProblem::BadRef, gone));
+    REQUIRE(has(result, FsckProblem::Missing, entry.id));
+    REQUIRE(has(result, FsckProblem::Missing, sides.theirs.id));
+  }
+}
+
+} // namespace chrona
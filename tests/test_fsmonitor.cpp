@@ -0,0 +1,154 @@
+#include "fsmonitor/daemon.hpp"
+#include "fsmonitor/monitor.hpp"
+#include "repo/repo.hpp"
+#include "snapshot/tree_builder.hpp"
+#include "test_helpers.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <thread>
+
+namespace chrona {
+
+namespace {
+
+struct Fixture {
+  test::ScratchDir dir{"fsmonitor"};
+  std::filesystem::path root = dir.path();
+  std::filesystem::path chrona_dir = root / ".chrona";
+  ObjectStore store{chrona_dir / "objects"};
+  WorkPool pool{2};
+
+  Fixture() {
+    REQUIRE_FALSE(init_repo(root));
+    test::write(root / "a.txt", "alpha");
+    test::write(root / "src" / "main.cpp", "int main() {}");
+    test::write(root / "src" / "util.cpp", "// util");
+    test::write(root / "lib" / "deep" / "x.h", "x");
+  }
+
+  void stage(const std::string &skip_prefix = "") {
+    std::vector<IndexEntry> entries;
+    SnapshotOptions options;
+    options.collect = &entries;
+    SnapshotResult result;
+    REQUIRE_FALSE(build_snapshot(root, store, pool, result, options));
+    if (!skip_prefix.empty()) {
+      std::erase_if(entries, [&](const IndexEntry &entry) {
+        return entry.path.rfind(skip_prefix, 0) == 0;
+      });
+    }
+    REQUIRE_FALSE(write_index(chrona_dir / "index", std::move(entries)));
+  }
+
+  std::vector<std::string> scanned() {
+    IndexView index;
+    REQUIRE_FALSE(IndexView::open(chrona_dir / "index", index));
+    StatusResult result;
+    REQUIRE_FALSE(compute_status(root, index, pool, result));
+    return describe(result.changes);
+  }
+
+  static std::vector<std::string>
+  describe(const std::vector<StatusChange> &changes) {
+    std::vector<std::string> out;
+    for (const auto &change : changes) {
+      char kind = change.kind == ChangeKind::Modified  ? 'M'
+                  : change.kind == ChangeKind::Deleted ? 'D'
+                                                       : '?';
+      out.push_back(std::string(1, kind) + " " + change.path);
+    }
+    return out;
+  }
+};
+
+} // namespace
+
+TEST_CASE("StatusMonitor - tracks a full scan through every kind of change",
+          "[fsmonitor]") {
+  Fixture f;
+  f.stage();
+  StatusMonitor monitor(f.root, f.chrona_dir, f.pool);
+  REQUIRE_FALSE(monitor.start());
+  REQUIRE(monitor.changes().empty());
+
+  auto check = [&] {
+    REQUIRE_FALSE(monitor.sync());
+    REQUIRE(Fixture::describe(monitor.changes()) == f.scanned());
+  };
+
+  test::write(f.root / "a.txt", "changed");
+  test::write(f.root / "src" / "new.cpp", "new");
+  std::filesystem::remove(f.root / "src" / "util.cpp");
+  test::write(f.root / "tmp" / "x" / "y" / "z.txt", "untracked");
+  check();
+  REQUIRE(monitor.changes().size() == 4);
+
+  // Files landing in a fresh directory before its watch exists
+  std::filesystem::create_directories(f.root / "lib" / "deep" / "more");
+  test::write(f.root / "lib" / "deep" / "more" / "m.txt", "m");
+  std::filesystem::rename(f.root / "tmp", f.root / "tmp2");
+  check();
+
+  // Restaging reloads the index without a rescan
+  f.stage();
+  check();
+  REQUIRE(monitor.changes().empty());
+
+  std::filesystem::remove_all(f.root / "src");
+  check();
+  std::filesystem::rename(f.root / "lib", f.root / "lib2");
+  check();
+  std::filesystem::rename(f.root / "lib2", f.root / "lib");
+  test::write(f.root / "src" / "main.cpp", "int main() {}");
+  check();
+
+  // Entries dropped from the index turn their directory untracked
+  f.stage("lib/");
+  check();
+  test::write(f.root / "lib" / "deep" / "another.h", "a");
+  check();
+  f.stage();
+  check();
+  REQUIRE(monitor.changes().empty());
+  REQUIRE(monitor.rescans() == 1);
+}
+
+TEST_CASE("daemon - answers status over its socket", "[fsmonitor]") {
+  Fixture f;
+  f.stage();
+  std::vector<StatusChange> changes;
+  auto error = query_daemon(f.chrona_dir, changes);
+  REQUIRE(error.has_value());
+  REQUIRE(error->error_code == ErrorCode::NotFound);
+
+  std::optional<Error> served;
+  std::thread daemon([&] { served = serve_daemon(f.root, f.chrona_dir,
+                                                 f.pool); });
+  bool answered = false;
+  for (int attempt = 0; attempt < 500 && !answered; ++attempt) {
+    answered = !query_daemon(f.chrona_dir, changes);
+    if (!answered) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+  REQUIRE(answered);
+  REQUIRE(changes.empty());
+
+  test::write(f.root / "a.txt", "changed");
+  test::write(f.root / "notes.txt", "untracked");
+  REQUIRE_FALSE(query_daemon(f.chrona_dir, changes));
+  REQUIRE(Fixture::describe(changes) == f.scanned());
+  REQUIRE(changes.size() == 2);
+
+  // A second daemon for the same repository is refused
+  WorkPool other_pool{1};
+  error = serve_daemon(f.root, f.chrona_dir, other_pool);
+  REQUIRE(error.has_value());
+  REQUIRE(error->error_code == ErrorCode::AlreadyExists);
+
+  REQUIRE_FALSE(stop_daemon(f.chrona_dir));
+  daemon.join();
+  REQUIRE_FALSE(served);
+  REQUIRE_FALSE(std::filesystem::exists(daemon_socket_path(f.chrona_dir)));
+}
+
+} // namespace chrona
@@ -0,0 +1,293 @@
+#include "gc/gc.hpp"
+#include "history/commit.hpp"
+#include "index/index.hpp"
+#include "merge/merge.hpp"
+#include "objects/object_store.hpp"
+#include "pack/pack.hpp"
+#include "pack/pack_writer.hpp"
+#include "refs/refs.hpp"
+#include "snapshot/tree.hpp"
+#include "test_helpers.hpp"
+#include <catch2/catch_test_macros.hpp>
+
+namespace chrona {
+
+namespace {
+
+// A commit of one file, on top of the last one, with the file's content
+// as its message.
+ObjectId commit(test::TestRepo &repo, const std::string &content) {
+  return repo.commit({repo.file("file.txt", content)}, content + "\n");
+}
+
+} // namespace
+
+TEST_CASE("gc - prunes old unreachable loose objects only", "[gc]") {
+  test::ScratchDir dir("gc");
+  test::TestRepo repo(dir.path());
+  WorkPool pool(2);
+
+  auto first = commit(repo, "one");
+  auto second = commit(repo, "two");
+  auto old_orphan = repo.blob("old orphan");
+  auto new_orphan = repo.blob("new orphan");
+  test::age(repo.store.object_path(old_orphan));
+  test::age(repo.store.object_path(first)); // age alone never prunes
+
+  GcResult result;
+  REQUIRE_FALSE(collect_garbage(repo.chrona_dir, repo.store, pool, result));
+  REQUIRE(result.complete);
+  REQUIRE(result.loose_removed == 1);
+  REQUIRE(result.marked == 6);
+  REQUIRE_FALSE(repo.store.contains(old_orphan));
+  REQUIRE(repo.store.contains(new_orphan));
+  REQUIRE(repo.store.contains(first));
+  REQUIRE(repo.store.contains(second));
+  REQUIRE_FALSE(std::filesystem::exists(repo.chrona_dir / "gc-state"));
+
+  SECTION("rewriting an unreachable object protects it") {
+    test::age(repo.store.object_path(new_orphan));
+    REQUIRE(repo.blob("new orphan") == new_orphan);
+    REQUIRE_FALSE(collect_garbage(repo.chrona_dir, repo.store, pool, result));
+    REQUIRE(repo.store.contains(new_orphan));
+  }
+  SECTION("a zero grace period prunes fresh orphans") {
+    GcOptions options;
+    options.grace_seconds = 0;
+    REQUIRE_FALSE(
+        collect_garbage(repo.chrona_dir, repo.store, pool, result, options));
+    REQUIRE_FALSE(repo.store.contains(new_orphan));
+    REQUIRE(repo.store.contains(second));
+  }
+}
+
+TEST_CASE("gc - keeps what an unfinished merge still needs", "[gc]") {
+  test::ScratchDir dir("gc");
+  test::TestRepo repo(dir.path());
+  WorkPool pool(2);
+
+  // The merged commit is only named by MERGE_HEAD, and the versions of the
+  // conflicted file only by the index conflict table
+  auto theirs = commit(repo, "theirs");
+  repo.history.clear();
+  commit(repo, "ours");
+  REQUIRE_FALSE(write_merge_head(repo.chrona_dir, theirs));
+  auto regular = static_cast<std::uint32_t>(EntryMode::Regular);
+  IndexConflict sides;
+  sides.base = {regular, repo.blob("base version")};
+  sides.ours = {regular, repo.blob("our version")};
+  sides.theirs = {regular, repo.blob("their version")};
+  IndexEntry entry;
+  entry.path = "file.txt";
+  entry.id = repo.blob("<<<<<<< conflict markers");
+  entry.conflict = sides;
+  REQUIRE_FALSE(write_index(repo.chrona_dir / "index", {entry}));
+  auto orphan = repo.blob("orphan");
+  repo.store.for_each_loose(
+      [&](const ObjectId &id) { test::age(repo.store.object_path(id)); });
+
+  GcResult result;
+  REQUIRE_FALSE(collect_garbage(repo.chrona_dir, repo.store, pool, result));
+  REQUIRE(result.complete);
+  REQUIRE(result.loose_removed == 1);
+  REQUIRE_FALSE(repo.store.contains(orphan));
+  REQUIRE(repo.store.contains(theirs));
+  REQUIRE(repo.store.contains(hash_object(ObjectType::Blob, "theirs")));
+  REQUIRE(repo.store.contains(entry.id));
+  for (const auto *side : {&sides.base, &sides.ours, &sides.theirs}) {
+    REQUIRE(repo.store.contains(side->id));
+  }
+
+  SECTION("they go once the merge is done") {
+    std::filesystem::remove(merge_head_path(repo.chrona_dir));
+    REQUIRE_FALSE(write_index(repo.chrona_dir / "index", {}));
+    REQUIRE_FALSE(collect_garbage(repo.chrona_dir, repo.store, pool, result));
+    REQUIRE(result.loose_removed == 7);
+    REQUIRE_FALSE(repo.store.contains(theirs));
+    REQUIRE_FALSE(repo.store.contains(sides.ours.id));
+  }
+}
+
+TEST_CASE("gc - drops unreachable objects from old packs", "[gc]") {
+  test::ScratchDir dir("gc");
+  test::TestRepo repo(dir.path());
+  WorkPool pool(2);
+
+  auto tip = commit(repo, "kept");
+  auto orphan = repo.blob("packed orphan");
+  std::vector<ObjectId> ids;
+  repo.store.for_each_loose([&](const ObjectId &id) { ids.push_back(id); });
+  PackResult packed;
+  REQUIRE_FALSE(write_pack(repo.store.pack_dir(), repo.store, ids, packed));
+  repo.store.for_each_loose([&](const ObjectId &id) {
+    std::filesystem::remove(repo.store.object_path(id));
+  });
+  test::age(packed.path);
+  REQUIRE_FALSE(repo.store.reload_packs());
+
+  GcResult result;
+  REQUIRE_FALSE(collect_garbage(repo.chrona_dir, repo.store, pool, result));
+  REQUIRE(result.packs_rewritten == 1);
+  REQUIRE(result.packed_dropped == 1);
+  REQUIRE_FALSE(std::filesystem::exists(packed.path));
+  REQUIRE(repo.store.packs()->size() == 1);
+  REQUIRE_FALSE(repo.store.contains(orphan));
+
+  ObjectView view;
+  REQUIRE_FALSE(repo.store.read(tip, view));
+  REQUIRE(view.type() == ObjectType::Commit);
+}
+
+TEST_CASE("gc - keeps the chunks of reachable chunked blobs", "[gc]") {
+  test::ScratchDir dir("gc");
+  test::TestRepo repo(dir.path());
+  WorkPool pool(2);
+  repo.store.set_chunking({64 * 1024, 4096});
+
+  std::string kept(256 * 1024, '\0');
+  std::string dropped(256 * 1024, '\0');
+  for (std::size_t i = 0; i < kept.size(); ++i) {
+    kept[i] = static_cast<char>((i * 2654435761u) >> 13);
+    dropped[i] = static_cast<char>((i * 40503u) >> 7);
+  }
+  commit(repo, kept);
+  auto orphan = repo.blob(dropped);
+  std::vector<ChunkRef> kept_chunks;
+  std::vector<ChunkRef> dropped_chunks;
+  REQUIRE_FALSE(repo.store.read_chunk_list(
+      hash_object(ObjectType::Blob, kept), kept_chunks));
+  REQUIRE_FALSE(repo.store.read_chunk_list(orphan, dropped_chunks));
+  REQUIRE_FALSE(kept_chunks.empty());
+  REQUIRE_FALSE(dropped_chunks.empty());
+  repo.store.for_each_loose(
+      [&](const ObjectId &id) { test::age(repo.store.object_path(id)); });
+
+  GcResult result;
+  REQUIRE_FALSE(collect_garbage(repo.chrona_dir, repo.store, pool, result));
+  REQUIRE(result.complete);
+  ObjectView view;
+  REQUIRE_FALSE(
+      repo.store.read(hash_object(ObjectType::Blob, kept), view));
+  REQUIRE(view.content() == kept);
+  REQUIRE_FALSE(repo.store.contains(orphan));
+  for (const auto &chunk : dropped_chunks) {
+    REQUIRE_FALSE(repo.store.contains(chunk.id));
+  }
+}
+
+TEST_CASE("gc - a tiny budget resumes until the cycle completes", "[gc]") {
+  test::ScratchDir dir("gc");
+  test::TestRepo repo(dir.path());
+  WorkPool pool(2);
+
+  std::optional<ObjectId> tip;
+  for (int i = 0; i < 600; ++i) {
+    tip = commit(repo, "version " + std::to_string(i));
+  }
+  std::vector<ObjectId> orphans;
+  for (int i = 0; i < 50; ++i) {
+    orphans.push_back(repo.blob("orphan " + std::to_string(i)));
+    test::age(repo.store.object_path(orphans.back()));
+  }
+
+  GcOptions options;
+  options.budget_ms = 1;
+  GcResult result;
+  REQUIRE_FALSE(
+      collect_garbage(repo.chrona_dir, repo.store, pool, result, options));
+  REQUIRE_FALSE(result.complete);
+  REQUIRE(std::filesystem::exists(repo.chrona_dir / "gc-state"));
+
+  // A commit made between runs is picked up from the refs
+  tip = commit(repo, "between runs");
+  int runs = 1;
+  while (!result.complete && runs < 10000) {
+    REQUIRE_FALSE(
+        collect_garbage(repo.chrona_dir, repo.store, pool, result, options));
+    ++runs;
+  }
+
+  REQUIRE(result.complete);
+  REQUIRE(runs > 1);
+  REQUIRE(result.marked == 601 * 3);
+  for (const auto &orphan : orphans) {
+    REQUIRE_FALSE(repo.store.contains(orphan));
+  }
+  REQUIRE(repo.store.contains(*tip));
+}
+
+TEST_CASE("gc - a resumed pack sweep survives a changing pack list",
+          "[gc]") {
+  test::ScratchDir dir("gc");
+  test::TestRepo repo(dir.path());
+  WorkPool pool(2);
+
+  // Old packs, each holding a commit and an unreachable blob
+  std::optional<ObjectId> tip;
+  std::vector<ObjectId> orphans;
+  for (int i = 0; i < 16; ++i) {
+    tip = commit(repo, "packed " + std::to_string(i));
+    orphans.push_back(repo.blob("packed orphan " + std::to_string(i)));
+    std::vector<ObjectId> ids;
+    repo.store.for_each_loose([&](const ObjectId &id) { ids.push_back(id); });
+    PackResult packed;
+    REQUIRE_FALSE(write_pack(repo.store.pack_dir(), repo.store, ids, packed));
+    for (const auto &id : ids) {
+      std::filesystem::remove(repo.store.object_path(id));
+    }
+    test::age(packed.path);
+  }
+  REQUIRE_FALSE(repo.store.reload_packs());
+
+  // Every run adds a fresh pack, moving the old ones around in the list
+  GcOptions options;
+  options.budget_ms = 1;
+  GcResult result;
+  std::size_t rewritten = 0;
+  int runs = 0;
+  while (!result.complete && runs < 10000) {
+    auto fresh = repo.blob("fresh " + std::to_string(runs));
+    PackResult packed;
+    REQUIRE_FALSE(
+        write_pack(repo.store.pack_dir(), repo.store, {fresh}, packed));
+    std::filesystem::remove(repo.store.object_path(fresh));
+    REQUIRE_FALSE(repo.store.reload_packs());
+    REQUIRE_FALSE(
+        collect_garbage(repo.chrona_dir, repo.store, pool, result, options));
+    rewritten += result.packs_rewritten;
+    ++runs;
+  }
+
+  REQUIRE(result.complete);
+  REQUIRE(rewritten == 16);
+  for (const auto &orphan : orphans) {
+    REQUIRE_FALSE(repo.store.contains(orphan));
+  }
+  for (auto id = tip; id;) {
+    ObjectView view;
+    REQUIRE_FALSE(repo.store.read(*id, view));
+    Commit commit;
+    REQUIRE_FALSE(decode_commit(view.content(), commit));
+    REQUIRE(repo.store.contains(commit.tree));
+    id = commit.parents.empty() ? std::nullopt
+                                : std::optional<ObjectId>(commit.parents[0]);
+  }
+}
+
+TEST_CASE("gc - refuses to prune when a reachable object is missing",
+          "[gc]") {
+  test::ScratchDir dir("gc");
+  test::TestRepo repo(dir.path());
+  WorkPool pool(2);
+
+  auto first = commit(repo, "one");
+  commit(repo, "two");
+  std::filesystem::remove(repo.store.object_path(first));
+
+  GcResult result;
+  auto error = collect_garbage(repo.chrona_dir, repo.store, pool, result);
+  REQUIRE(error.has_value());
+  REQUIRE(error->error_code == ErrorCode::CorruptObject);
+}
+
+} // namespace chrona
@@ -0,0 +1,61 @@
+#include "hash/sha256.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+
+namespace chrona {
+
+namespace {
+
+std::string to_hex(const Sha256::Digest &digest) {
+  static constexpr char digits[] = "0123456789abcdef";
+  std::string out;
+  for (auto byte : digest) {
+    out += digits[byte >> 4];
+    out += digits[byte & 0xf];
+  }
+  return out;
+}
+
+std::string digest_with(Sha256Kernel kernel, const std::string &data,
+                        std::size_t piece) {
+  Sha256 hasher(kernel);
+  for (std::size_t i = 0; i < data.size(); i += piece) {
+    hasher.update(std::string_view(data).substr(i, piece));
+  }
+  return to_hex(hasher.finish());
+}
+
+} // namespace
+
+TEST_CASE("sha256 - known vectors", "[hash]") {
+  REQUIRE(to_hex(sha256("")) ==
+          "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+  REQUIRE(to_hex(sha256("abc")) ==
+          "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+  REQUIRE(to_hex(sha256("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnop"
+                        "nopq")) ==
+          "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+}
+
+TEST_CASE("sha256 - one million 'a'", "[hash]") {
+  std::string data(1000000, 'a');
+  REQUIRE(to_hex(sha256(data)) ==
+          "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+}
+
+TEST_CASE("sha256 - kernels and chunkings agree", "[hash]") {
+  std::string data;
+  std::uint32_t seed = 12345;
+  for (int i = 0; i < 10000; ++i) {
+    seed = seed * 1103515245 + 12345;
+    data += static_cast<char>(seed >> 16);
+  }
+
+  auto expected = digest_with(Sha256Kernel::Scalar, data, data.size());
+  for (std::size_t piece : {1, 7, 63, 64, 65, 1000}) {
+    REQUIRE(digest_with(Sha256Kernel::Scalar, data, piece) == expected);
+    REQUIRE(digest_with(Sha256Kernel::Auto, data, piece) == expected);
+  }
+}
+
+} // namespace chrona
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "history/commit.hpp"
+#include "objects/object_store.hpp"
+#include "refs/refs.hpp"
+#include "snapshot/tree.hpp"
+#include <atomic>
+#include <catch2/catch_test_macros.hpp>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace chrona::test {
+
+// A fresh directory under the system temp dir, removed on destruction.
+class ScratchDir {
+public:
+  explicit ScratchDir(std::string_view name) {
+    static std::atomic<int> counter{0};
+    path_ = std::filesystem::temp_directory_path() /
+            ("chrona-test-" + std::string(name) + "-" +
+             std::to_string(::getpid()) + "-" + std::to_string(counter++));
+    std::filesystem::remove_all(path_);
+    std::filesystem::create_directories(path_);
+  }
+  ~ScratchDir() {
+    std::error_code ec;
+    std::filesystem::remove_all(path_, ec);
+  }
+
+  ScratchDir(const ScratchDir &) = delete;
+  ScratchDir &operator=(const ScratchDir &) = delete;
+
+  const std::filesystem::path &path() const { return path_; }
+
+private:
+  std::filesystem::path path_;
+};
+
+// Writes `contents` to `path`, creating its parent directories.
+inline void write(const std::filesystem::path &path,
+                  const std::string &contents) {
+  std::filesystem::create_directories(path.parent_path());
+  std::ofstream(path, std::ios::binary) << contents;
+}
+
+// Sets the mtime of `path` well in the past, before any grace period.
+inline void age(const std::filesystem::path &path) {
+  timespec times[2] = {{1000000, 0}, {1000000, 0}};
+  REQUIRE(::utimensat(AT_FDCWD, path.c_str(), times, 0) == 0);
+}
+
+// The .chrona directory of a repository under `root`, with an object store
+// and shorthands for building history in it.
+struct TestRepo {
+  explicit TestRepo(const std::filesystem::path &root)
+      : chrona_dir(root / ".chrona"), store(chrona_dir / "objects") {
+    std::filesystem::create_directories(chrona_dir / "objects");
+  }
+
+  ObjectId blob(std::string_view content) {
+    ObjectId id;
+    REQUIRE_FALSE(store.write(ObjectType::Blob, content, id));
+    return id;
+  }
+
+  TreeEntry file(const std::string &name, std::string_view content) {
+    return TreeEntry{name, EntryMode::Regular, blob(content)};
+  }
+
+  // Commits a tree of `files` on top of the last commit made here (a root
+  // commit while `history` is empty) and moves refs/heads/main to it.
+  ObjectId commit(const std::vector<TreeEntry> &files,
+                  const std::string &message = "commit\n") {
+    Commit commit;
+    REQUIRE_FALSE(
+        store.write(ObjectType::Tree, encode_tree(files), commit.tree));
+    if (!history.empty()) {
+      commit.parents.push_back(history.back());
+    }
+    commit.author = "test";
+    commit.message = message;
+    ObjectId id;
+    REQUIRE_FALSE(store.write(ObjectType::Commit, encode_commit(commit), id));
+    REQUIRE_FALSE(write_ref(chrona_dir, default_branch_ref, id));
+    history.push_back(id);
+    return id;
+  }
+
+  std::filesystem::path chrona_dir;
+  ObjectStore store;
+  std::vector<ObjectId> history;
+};
+
+} // namespace chrona::test
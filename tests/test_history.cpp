@@ -0,0 +1,407 @@
+#include "history/commit.hpp"
+#include "history/commit_graph.hpp"
+#include "history/history.hpp"
+#include "history/path_filter.hpp"
+#include "io/file_io.hpp"
+#include "objects/object_store.hpp"
+#include "snapshot/tree_diff.hpp"
+#include "test_helpers.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+namespace chrona {
+
+namespace {
+
+// Builds commits by name; each gets a distinct, increasing time.
+class Dag {
+public:
+  explicit Dag(ObjectStore &store) : store_(store) {}
+
+  ObjectId add(const std::string &name,
+               const std::vector<std::string> &parents) {
+    Commit commit;
+    commit.tree = hash_object(ObjectType::Tree, "");
+    for (const auto &parent : parents) {
+      commit.parents.push_back(ids.at(parent));
+    }
+    commit.author = "test";
+    commit.time = 1000 + static_cast<std::int64_t>(ids.size());
+    commit.message = name + "\n";
+    ObjectId id;
+    REQUIRE_FALSE(store_.write(ObjectType::Commit, encode_commit(commit), id));
+    ids[name] = id;
+    names[id] = name;
+    return id;
+  }
+
+  std::vector<std::string> named(const std::vector<ObjectId> &list) const {
+    std::vector<std::string> out;
+    for (const auto &id : list) {
+      out.push_back(names.at(id));
+    }
+    return out;
+  }
+
+  std::map<std::string, ObjectId> ids;
+  std::map<ObjectId, std::string> names;
+
+private:
+  ObjectStore &store_;
+};
+
+// Writes the tree for a set of '/'-separated file paths and contents.
+ObjectId write_files(ObjectStore &store,
+                     const std::map<std::string, std::string> &files) {
+  std::vector<TreeEntry> entries;
+  std::map<std::string, std::map<std::string, std::string>> subdirs;
+  for (const auto &[path, content] : files) {
+    auto slash = path.find('/');
+    if (slash != std::string::npos) {
+      subdirs[path.substr(0, slash)][path.substr(slash + 1)] = content;
+      continue;
+    }
+    ObjectId id;
+    REQUIRE_FALSE(store.write(ObjectType::Blob, content, id));
+    entries.push_back({path, EntryMode::Regular, id});
+  }
+  for (const auto &[name, children] : subdirs) {
+    entries.push_back(
+        {name, EntryMode::Directory, write_files(store, children)});
+  }
+  ObjectId id;
+  REQUIRE_FALSE(
+      store.write(ObjectType::Tree, encode_tree(std::move(entries)), id));
+  return id;
+}
+
+ObjectId write_commit(ObjectStore &store, const ObjectId &tree,
+                      const std::vector<ObjectId> &parents,
+                      std::int64_t time) {
+  Commit commit;
+  commit.tree = tree;
+  commit.parents = parents;
+  commit.author = "test";
+  commit.time = time;
+  commit.message = "change\n";
+  ObjectId id;
+  REQUIRE_FALSE(store.write(ObjectType::Commit, encode_commit(commit), id));
+  return id;
+}
+
+} // namespace
+
+TEST_CASE("commit - encode and decode round trip", "[history]") {
+  Commit commit;
+  commit.tree = hash_object(ObjectType::Tree, "tree");
+  commit.parents = {hash_object(ObjectType::Commit, "a"),
+                    hash_object(ObjectType::Commit, "b")};
+  commit.author = "Ada Lovelace";
+  commit.time = 1700000000;
+  commit.message = "Subject\n\nBody line\n";
+
+  Commit decoded;
+  REQUIRE_FALSE(decode_commit(encode_commit(commit), decoded));
+  REQUIRE(decoded.tree == commit.tree);
+  REQUIRE(decoded.parents == commit.parents);
+  REQUIRE(decoded.author == commit.author);
+  REQUIRE(decoded.time == commit.time);
+  REQUIRE(decoded.message == commit.message);
+
+  REQUIRE(decode_commit("tree zz\n\nmsg", decoded).has_value());
+  REQUIRE(decode_commit("parent " + commit.tree.hex() + "\n\n", decoded)
+              .has_value());
+}
+
+TEST_CASE("parse_commit - views into the encoded commit", "[history]") {
+  Commit commit;
+  commit.tree = hash_object(ObjectType::Tree, "tree");
+  for (const char *name : {"a", "b", "c"}) {
+    commit.parents.push_back(hash_object(ObjectType::Commit, name));
+  }
+  commit.author = "Ada Lovelace";
+  commit.time = 1700000000;
+  commit.message = "Subject\n";
+  auto encoded = encode_commit(commit);
+
+  InlineArena<256> arena;
+  CommitView view;
+  REQUIRE_FALSE(parse_commit(encoded, arena, view));
+  REQUIRE(view.tree == commit.tree);
+  REQUIRE(std::equal(view.parents.begin(), view.parents.end(),
+                     commit.parents.begin(), commit.parents.end()));
+  REQUIRE(view.author == "Ada Lovelace");
+  REQUIRE(view.author.data() > encoded.data());
+  REQUIRE(view.time == commit.time);
+  REQUIRE(view.message == "Subject\n");
+
+  commit.parents.clear();
+  encoded = encode_commit(commit);
+  REQUIRE_FALSE(parse_commit(encoded, arena, view));
+  REQUIRE(view.parents.empty());
+}
+
+TEST_CASE("History - queries agree with and without the commit graph",
+          "[history]") {
+  test::ScratchDir dir("history");
+  ObjectStore store(dir.path() / "objects");
+  std::filesystem::create_directories(dir.path() / "objects");
+
+  // root - a1 - a2 - m1 - m2 (criss-cross merges of a2 and b2)
+  //     \- b1 - b2 - n1 - n2
+  //                \- side
+  Dag dag(store);
+  dag.add("root", {});
+  dag.add("a1", {"root"});
+  dag.add("b1", {"root"});
+  dag.add("a2", {"a1"});
+  dag.add("b2", {"b1"});
+  dag.add("side", {"b2"});
+  dag.add("m1", {"a2", "b2"});
+  dag.add("n1", {"b2", "a2"});
+  dag.add("m2", {"m1"});
+  dag.add("n2", {"n1"});
+  dag.add("octopus", {"m2", "n2", "side"});
+
+  CommitGraph empty;
+  std::size_t written = 0;
+  auto graph_path = dir.path() / "commit-graph";
+  REQUIRE_FALSE(
+      write_commit_graph(graph_path, store, {dag.ids["octopus"]}, written));
+  REQUIRE(written == dag.ids.size());
+  CommitGraph graph;
+  REQUIRE_FALSE(CommitGraph::open(graph_path, graph));
+  REQUIRE(graph.size() == written);
+
+  auto root_pos = graph.find(dag.ids["root"]).value();
+  auto octopus_pos = graph.find(dag.ids["octopus"]).value();
+  REQUIRE(graph.generation_at(root_pos) == 1);
+  REQUIRE(graph.generation_at(octopus_pos) == 6);
+  std::vector<std::uint32_t> parents;
+  graph.parents(octopus_pos, parents);
+  REQUIRE(parents.size() == 3);
+  REQUIRE(graph.id_at(parents[2]) == dag.ids["side"]);
+
+  for (const CommitGraph *source : {&empty, &graph}) {
+    History history(store, *source);
+
+    std::vector<ObjectId> log;
+    REQUIRE_FALSE(history.log({dag.ids["octopus"]}, log));
+    REQUIRE(log.size() == dag.ids.size());
+    REQUIRE(dag.names.at(log.front()) == "octopus");
+    REQUIRE(dag.names.at(log.back()) == "root");
+
+    REQUIRE_FALSE(history.log({dag.ids["n2"]}, log, 3));
+    REQUIRE(dag.named(log) ==
+            std::vector<std::string>{"n2", "n1", "b2"});
+
+    bool ancestor = false;
+    REQUIRE_FALSE(
+        history.is_ancestor(dag.ids["a1"], dag.ids["octopus"], ancestor));
+    REQUIRE(ancestor);
+    REQUIRE_FALSE(
+        history.is_ancestor(dag.ids["side"], dag.ids["m2"], ancestor));
+    REQUIRE_FALSE(ancestor);
+    REQUIRE_FALSE(history.is_ancestor(dag.ids["m2"], dag.ids["a1"], ancestor));
+    REQUIRE_FALSE(ancestor);
+
+    std::vector<ObjectId> bases;
+    REQUIRE_FALSE(history.merge_bases(dag.ids["m2"], dag.ids["n2"], bases));
+    auto names = dag.named(bases);
+    std::sort(names.begin(), names.end());
+    REQUIRE(names == std::vector<std::string>{"a2", "b2"});
+
+    REQUIRE_FALSE(history.merge_bases(dag.ids["a2"], dag.ids["side"], bases));
+    REQUIRE(dag.named(bases) == std::vector<std::string>{"root"});
+
+    REQUIRE_FALSE(history.merge_bases(dag.ids["side"], dag.ids["octopus"],
+                                      bases));
+    REQUIRE(dag.named(bases) == std::vector<std::string>{"side"});
+
+    if (source == &graph) {
+      REQUIRE(history.parsed() == 0);
+    } else {
+      REQUIRE(history.parsed() == dag.ids.size());
+    }
+  }
+
+  SECTION("commits newer than the graph are parsed on demand") {
+    auto tip = dag.add("after", {"octopus"});
+    History history(store, graph);
+    std::vector<ObjectId> bases;
+    REQUIRE_FALSE(history.merge_bases(tip, dag.ids["n1"], bases));
+    REQUIRE(dag.named(bases) == std::vector<std::string>{"n1"});
+    REQUIRE(history.parsed() == 1);
+  }
+
+  SECTION("a fanout that leaves the id table is rejected") {
+    std::string data;
+    REQUIRE_FALSE(read_file(graph_path, data));
+    std::uint32_t count;
+    std::memcpy(&count, data.data() + 8, 4);
+    // Past the id table, and then a first bucket above the next one; the
+    // fanout follows the 16-byte header
+    std::pair<std::size_t, std::uint32_t> damage[] = {{0x80, count + 1000},
+                                                      {0, count}};
+    for (auto [bucket, value] : damage) {
+      auto damaged = data;
+      std::memcpy(damaged.data() + 16 + bucket * 4, &value, 4);
+      REQUIRE_FALSE(write_file_atomic(graph_path, damaged));
+      CommitGraph broken;
+      auto error = CommitGraph::open(graph_path, broken);
+      REQUIRE(error.has_value());
+      REQUIRE(error->error_code == ErrorCode::CorruptObject);
+    }
+  }
+
+  SECTION("a truncated graph is rejected") {
+    std::filesystem::resize_file(graph_path,
+                                 std::filesystem::file_size(graph_path) - 1);
+    CommitGraph broken;
+    auto error = CommitGraph::open(graph_path, broken);
+    REQUIRE(error.has_value());
+    REQUIRE(error->error_code == ErrorCode::CorruptObject);
+  }
+}
+
+TEST_CASE("changed_paths - files that differ between two trees",
+          "[history]") {
+  test::ScratchDir dir("tree-diff");
+  ObjectStore store(dir.path() / "objects");
+  std::filesystem::create_directories(dir.path() / "objects");
+
+  auto before = write_files(store, {{"README", "hello\n"},
+                                    {"src/a.cpp", "a\n"},
+                                    {"src/b.cpp", "b\n"},
+                                    {"docs/guide", "guide\n"},
+                                    {"tool", "file\n"}});
+  auto after = write_files(store, {{"README", "hello\n"},
+                                   {"src/a.cpp", "a2\n"},
+                                   {"src/b.cpp", "b\n"},
+                                   {"src/c.cpp", "c\n"},
+                                   {"tool/run", "dir now\n"}});
+  std::vector<std::string> paths;
+  REQUIRE_FALSE(changed_paths(store, &before, after, paths));
+  REQUIRE(paths == std::vector<std::string>{"docs/guide", "src/a.cpp",
+                                            "src/c.cpp", "tool",
+                                            "tool/run"});
+
+  REQUIRE_FALSE(changed_paths(store, &after, after, paths));
+  REQUIRE(paths.empty());
+  REQUIRE_FALSE(changed_paths(store, nullptr, before, paths));
+  REQUIRE(paths.size() == 5);
+
+  std::optional<PathEntry> entry;
+  REQUIRE_FALSE(lookup_path(store, after, "src/c.cpp", entry));
+  REQUIRE(entry.has_value());
+  REQUIRE(entry->id == hash_object(ObjectType::Blob, "c\n"));
+  REQUIRE_FALSE(lookup_path(store, after, "src", entry));
+  REQUIRE(entry->mode == EntryMode::Directory);
+  REQUIRE_FALSE(lookup_path(store, after, "README/x", entry));
+  REQUIRE_FALSE(entry.has_value());
+  REQUIRE_FALSE(lookup_path(store, after, "", entry));
+  REQUIRE(entry->id == after);
+}
+
+TEST_CASE("PathFilters - path-limited log skips commits without misses",
+          "[history]") {
+  test::ScratchDir dir("path-filters");
+  ObjectStore store(dir.path() / "objects");
+  std::filesystem::create_directories(dir.path() / "objects");
+
+  // Each commit rewrites one of 24 files spread over four directories
+  std::map<std::string, std::string> files;
+  std::vector<std::string> names;
+  for (int i = 0; i < 24; ++i) {
+    names.push_back("dir" + std::to_string(i % 4) + "/file" +
+                    std::to_string(i));
+    files[names.back()] = "0\n";
+  }
+  std::vector<ObjectId> commits;
+  commits.push_back(write_commit(store, write_files(store, files), {}, 1000));
+  for (int i = 1; i < 120; ++i) {
+    files[names[(i * 7) % names.size()]] = std::to_string(i) + "\n";
+    commits.push_back(write_commit(store, write_files(store, files),
+                                   {commits.back()}, 1000 + i));
+  }
+
+  auto graph_path = dir.path() / "commit-graph";
+  auto filters_path = dir.path() / "commit-graph-bloom";
+  std::size_t written = 0;
+  REQUIRE_FALSE(
+      write_commit_graph(graph_path, store, {commits.back()}, written));
+  CommitGraph graph;
+  REQUIRE_FALSE(CommitGraph::open(graph_path, graph));
+  CommitGraph no_graph;
+  PathFilters none;
+  std::size_t computed = 0;
+  REQUIRE_FALSE(write_path_filters(filters_path, store, graph, no_graph,
+                                   none, computed));
+  REQUIRE(computed == commits.size());
+  PathFilters filters;
+  REQUIRE_FALSE(PathFilters::open(filters_path, graph, filters));
+  REQUIRE(filters.size() == commits.size());
+
+  std::vector<ObjectId> log;
+  History history(store, graph);
+  REQUIRE_FALSE(history.log({commits.back()}, log));
+
+  // Filtering never changes the answer, only how much work it takes
+  std::size_t skipped = 0;
+  std::vector<std::string> queries = {"", "dir1", "dir2/file6",
+                                      "dir3/file3", "missing/file"};
+  for (const auto &query : queries) {
+    std::vector<ObjectId> expected;
+    std::vector<ObjectId> actual;
+    PathLogStats stats;
+    REQUIRE_FALSE(
+        filter_by_path(store, graph, none, log, query, expected));
+    REQUIRE_FALSE(filter_by_path(store, graph, filters, log, query, actual,
+                                 SIZE_MAX, &stats));
+    REQUIRE(actual == expected);
+    REQUIRE(stats.skipped + stats.checked == log.size());
+    skipped += stats.skipped;
+  }
+  REQUIRE(skipped > log.size() * 2);
+
+  std::vector<ObjectId> touching;
+  REQUIRE_FALSE(
+      filter_by_path(store, graph, filters, log, "dir1", touching, 3));
+  REQUIRE(touching.size() == 3);
+
+  SECTION("rewriting the graph only diffs the new commits") {
+    files["dir0/file0"] = "new\n";
+    auto tip = write_commit(store, write_files(store, files),
+                            {commits.back()}, 5000);
+    REQUIRE_FALSE(write_commit_graph(graph_path, store, {tip}, written));
+    CommitGraph updated;
+    REQUIRE_FALSE(CommitGraph::open(graph_path, updated));
+
+    // The old filters no longer match the graph, so they rule nothing out
+    PathFilters stale;
+    REQUIRE_FALSE(PathFilters::open(filters_path, updated, stale));
+    REQUIRE(stale.size() == 0);
+
+    REQUIRE_FALSE(write_path_filters(filters_path, store, updated, graph,
+                                     filters, computed));
+    REQUIRE(computed == 1);
+    PathFilters fresh;
+    REQUIRE_FALSE(PathFilters::open(filters_path, updated, fresh));
+    REQUIRE(fresh.size() == commits.size() + 1);
+    REQUIRE_FALSE(fresh.maybe_changed(*updated.find(tip), PathKey("dir1")));
+    REQUIRE(fresh.maybe_changed(*updated.find(tip), PathKey("dir0")));
+  }
+
+  SECTION("a truncated filter file is rejected") {
+    std::filesystem::resize_file(
+        filters_path, std::filesystem::file_size(filters_path) - 40);
+    PathFilters broken;
+    auto error = PathFilters::open(filters_path, graph, broken);
+    REQUIRE(error.has_value());
+    REQUIRE(error->error_code == ErrorCode::CorruptObject);
+  }
+}
+
+} // namespace chrona
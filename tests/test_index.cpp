@@ -0,0 +1,126 @@
+#include "index/index.hpp"
+#include "io/file_io.hpp"
+#include "test_helpers.hpp"
+#include <catch2/catch_test_macros.hpp>
+
+namespace chrona {
+
+namespace {
+
+IndexEntry make_entry(const std::string &path, std::int64_t mtime) {
+  IndexEntry entry;
+  entry.path = path;
+  entry.id = hash_object(ObjectType::Blob, path);
+  entry.stat.mtime_ns = mtime;
+  entry.stat.size = path.size();
+  entry.stat.ino = 42;
+  return entry;
+}
+
+} // namespace
+
+TEST_CASE("IndexView - missing index is empty", "[index]") {
+  test::ScratchDir dir("index-missing");
+  IndexView index;
+  REQUIRE_FALSE(IndexView::open(dir.path() / "index", index));
+  REQUIRE(index.size() == 0);
+  REQUIRE_FALSE(index.find("anything").has_value());
+}
+
+TEST_CASE("write_index - sorted records searchable in place", "[index]") {
+  test::ScratchDir dir("index-roundtrip");
+  auto path = dir.path() / "index";
+  REQUIRE_FALSE(write_index(path, {make_entry("src/b.cpp", 1),
+                                   make_entry("README.md", 2),
+                                   make_entry("src/a.cpp", 3),
+                                   make_entry("src.txt", 4)}));
+
+  IndexView index;
+  REQUIRE_FALSE(IndexView::open(path, index));
+  REQUIRE(index.size() == 4);
+  REQUIRE(index.path(0) == "README.md");
+  REQUIRE(index.path(3) == "src/b.cpp");
+
+  auto found = index.find("src/a.cpp");
+  REQUIRE(found.has_value());
+  REQUIRE(index.id(*found) == hash_object(ObjectType::Blob, "src/a.cpp"));
+  REQUIRE(index.stat(*found).mtime_ns == 3);
+  REQUIRE_FALSE(index.find("src").has_value());
+
+  REQUIRE(index.has_prefix("src/"));
+  REQUIRE_FALSE(index.has_prefix("docs/"));
+
+  auto entries = index.entries();
+  REQUIRE(entries.size() == 4);
+  REQUIRE(entries[1].path == "src.txt");
+}
+
+TEST_CASE("write_index - conflicts are kept beside their entries",
+          "[index]") {
+  test::ScratchDir dir("index-conflicts");
+  auto path = dir.path() / "index";
+  auto conflicted = make_entry("b.txt", 1);
+  IndexConflict sides;
+  sides.base = {static_cast<std::uint32_t>(EntryMode::Regular),
+                hash_object(ObjectType::Blob, "base")};
+  sides.ours = {static_cast<std::uint32_t>(EntryMode::Executable),
+                hash_object(ObjectType::Blob, "ours")};
+  conflicted.conflict = sides;
+  REQUIRE_FALSE(write_index(path, {make_entry("c.txt", 2), conflicted,
+                                   make_entry("a.txt", 3)}));
+
+  IndexView index;
+  REQUIRE_FALSE(IndexView::open(path, index));
+  REQUIRE(index.conflict_count() == 1);
+  REQUIRE_FALSE(index.conflict(0));
+  REQUIRE(index.is_conflicted(1));
+  auto conflict = index.conflict(1);
+  REQUIRE(conflict);
+  REQUIRE(conflict->base.id == sides.base.id);
+  REQUIRE(conflict->ours.mode ==
+          static_cast<std::uint32_t>(EntryMode::Executable));
+  REQUIRE_FALSE(conflict->theirs.present());
+
+  // Rewriting keeps it; restaging the path without one resolves it
+  auto entries = index.entries();
+  REQUIRE_FALSE(write_index(path, entries));
+  REQUIRE_FALSE(IndexView::open(path, index));
+  REQUIRE(index.conflict(1));
+  entries[1].conflict.reset();
+  REQUIRE_FALSE(write_index(path, entries));
+  REQUIRE_FALSE(IndexView::open(path, index));
+  REQUIRE(index.conflict_count() == 0);
+  REQUIRE_FALSE(index.is_conflicted(1));
+}
+
+TEST_CASE("IndexView - racy and matching entries", "[index]") {
+  test::ScratchDir dir("index-racy");
+  auto path = dir.path() / "index";
+  auto old_entry = make_entry("old", 1);
+  auto future_entry = make_entry("future", INT64_MAX);
+  REQUIRE_FALSE(write_index(path, {old_entry, future_entry}));
+
+  IndexView index;
+  REQUIRE_FALSE(IndexView::open(path, index));
+  auto old_index = index.find("old").value();
+  REQUIRE_FALSE(index.is_racy(old_index));
+  REQUIRE(index.is_racy(index.find("future").value()));
+
+  REQUIRE(index.matches(old_index, old_entry.stat));
+  auto touched = old_entry.stat;
+  touched.mtime_ns += 1;
+  REQUIRE_FALSE(index.matches(old_index, touched));
+}
+
+TEST_CASE("IndexView - rejects foreign files", "[index]") {
+  test::ScratchDir dir("index-corrupt");
+  auto path = dir.path() / "index";
+  REQUIRE_FALSE(write_file_atomic(path, std::string(100, 'x')));
+
+  IndexView index;
+  auto error = IndexView::open(path, index);
+  REQUIRE(error.has_value());
+  REQUIRE(error->error_code == ErrorCode::CorruptObject);
+}
+
+} // namespace chrona
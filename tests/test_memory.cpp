@@ -0,0 +1,71 @@
+#include "memory/arena.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <string>
+
+namespace chrona {
+
+TEST_CASE("Arena - aligned bump allocation across blocks", "[memory]") {
+  Arena arena(256);
+  char *first = static_cast<char *>(arena.allocate(3, 1));
+  auto *wide = static_cast<std::uint64_t *>(arena.allocate(8, 8));
+  REQUIRE(reinterpret_cast<std::uintptr_t>(wide) % 8 == 0);
+  REQUIRE(reinterpret_cast<char *>(wide) > first);
+
+  // Larger than a block: served from a block of its own
+  auto big = arena.allocate_array<std::uint32_t>(1000);
+  big[999] = 7;
+  REQUIRE(big.size() == 1000);
+
+  auto text = arena.copy("hello");
+  REQUIRE(text == "hello");
+  REQUIRE(arena.used() >= 3 + 8 + 4000 + 5);
+
+  arena.reset();
+  REQUIRE(arena.used() == 0);
+  REQUIRE(arena.copy("again") == "again");
+}
+
+TEST_CASE("Arena - create runs destructors on reset", "[memory]") {
+  int destroyed = 0;
+  struct Counted {
+    int *counter;
+    std::string payload = std::string(100, 'x'); // not trivially destructible
+    ~Counted() { ++*counter; }
+  };
+
+  Arena arena;
+  for (int i = 0; i < 3; ++i) {
+    auto *object = arena.create<Counted>(&destroyed);
+    REQUIRE(object->payload.size() == 100);
+  }
+  auto *plain = arena.create<int>(42);
+  REQUIRE(*plain == 42);
+  arena.reset();
+  REQUIRE(destroyed == 3);
+
+  {
+    Arena scoped;
+    scoped.create<Counted>(&destroyed);
+  }
+  REQUIRE(destroyed == 4);
+}
+
+TEST_CASE("InlineArena - spills to the heap when full", "[memory]") {
+  InlineArena<64> arena;
+  auto *inline_part = static_cast<char *>(arena.allocate(32, 1));
+  REQUIRE(reinterpret_cast<std::uintptr_t>(inline_part) >=
+          reinterpret_cast<std::uintptr_t>(&arena));
+  REQUIRE(reinterpret_cast<std::uintptr_t>(inline_part) <
+          reinterpret_cast<std::uintptr_t>(&arena) + sizeof(arena));
+
+  auto spill = arena.allocate_array<char>(128);
+  auto spill_at = reinterpret_cast<std::uintptr_t>(spill.data());
+  auto begin = reinterpret_cast<std::uintptr_t>(&arena);
+  bool on_heap = spill_at < begin || spill_at >= begin + sizeof(arena);
+  REQUIRE(on_heap);
+  arena.reset();
+  REQUIRE(static_cast<char *>(arena.allocate(1, 1)) == inline_part);
+}
+
+} // namespace chrona
@@ -0,0 +1,329 @@
+#include "diff/file_diff.hpp"
+#include "history/commit.hpp"
+#include "history/commit_graph.hpp"
+#include "history/history.hpp"
+#include "merge/merge.hpp"
+#include "merge/text_merge.hpp"
+#include "objects/object_store.hpp"
+#include "test_helpers.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <map>
+
+namespace chrona {
+
+namespace {
+
+std::string merged(std::string_view base, std::string_view ours,
+                   std::string_view theirs, std::size_t conflicts = 0) {
+  std::string out;
+  REQUIRE(merge_text(base, ours, theirs, out) == conflicts);
+  return out;
+}
+
+// Writes the tree for a set of '/'-separated file paths and contents; a
+// content starting with '#!' is stored executable.
+ObjectId write_files(ObjectStore &store,
+                     const std::map<std::string, std::string> &files) {
+  std::vector<TreeEntry> entries;
+  std::map<std::string, std::map<std::string, std::string>> subdirs;
+  for (const auto &[path, content] : files) {
+    auto slash = path.find('/');
+    if (slash != std::string::npos) {
+      subdirs[path.substr(0, slash)][path.substr(slash + 1)] = content;
+      continue;
+    }
+    ObjectId id;
+    REQUIRE_FALSE(store.write(ObjectType::Blob, content, id));
+    auto mode = content.rfind("#!", 0) == 0 ? EntryMode::Executable
+                                             : EntryMode::Regular;
+    entries.push_back({path, mode, id});
+  }
+  for (const auto &[name, children] : subdirs) {
+    entries.push_back(
+        {name, EntryMode::Directory, write_files(store, children)});
+  }
+  ObjectId id;
+  REQUIRE_FALSE(
+      store.write(ObjectType::Tree, encode_tree(std::move(entries)), id));
+  return id;
+}
+
+// Every file under `tree` with its content.
+void read_files(const ObjectStore &store, const ObjectId &tree,
+                const std::string &prefix,
+                std::map<std::string, std::string> &out) {
+  ObjectView view;
+  REQUIRE_FALSE(store.read(tree, view));
+  std::vector<TreeEntry> entries;
+  REQUIRE_FALSE(decode_tree(view.content(), entries));
+  for (const auto &entry : entries) {
+    auto path = prefix + entry.name;
+    if (entry.mode == EntryMode::Directory) {
+      read_files(store, entry.id, path + "/", out);
+      continue;
+    }
+    ObjectView blob;
+    REQUIRE_FALSE(store.read(entry.id, blob));
+    out[path] = std::string(blob.content());
+  }
+}
+
+std::map<std::string, std::string> files_of(const ObjectStore &store,
+                                            const ObjectId &tree) {
+  std::map<std::string, std::string> out;
+  read_files(store, tree, "", out);
+  return out;
+}
+
+ObjectId write_commit(ObjectStore &store, const ObjectId &tree,
+                      const std::vector<ObjectId> &parents,
+                      std::int64_t time) {
+  Commit commit;
+  commit.tree = tree;
+  commit.parents = parents;
+  commit.author = "test";
+  commit.time = time;
+  commit.message = "change\n";
+  ObjectId id;
+  REQUIRE_FALSE(store.write(ObjectType::Commit, encode_commit(commit), id));
+  return id;
+}
+
+} // namespace
+
+TEST_CASE("merge_text - takes each side's changes", "[merge]") {
+  std::string base = "a\nb\nc\nd\ne\n";
+  REQUIRE(merged(base, "A\nb\nc\nd\ne\n", "a\nb\nc\nd\nE\n") ==
+          "A\nb\nc\nd\nE\n");
+  REQUIRE(merged(base, "a\nb\nX\nd\ne\n", "a\nb\nX\nd\ne\n") ==
+          "a\nb\nX\nd\ne\n");
+  REQUIRE(merged(base, "a\nb\nc\nd\ne\nf\n", "a\nc\nd\ne\n") ==
+          "a\nc\nd\ne\nf\n");
+  REQUIRE(merged("", "", "new\n") == "new\n");
+  REQUIRE(merged("x", "x", "y") == "y");
+}
+
+TEST_CASE("merge_text - overlapping changes are marked", "[merge]") {
+  REQUIRE(merged("a\nb\nc\n", "a\nB1\nc\n", "a\nB2\nc\n", 1) ==
+          "a\n<<<<<<< ours\nB1\n=======\nB2\n>>>>>>> theirs\nc\n");
+
+  // Two regions, and a last line without a newline
+  std::string out;
+  TextMergeLabels labels{"HEAD", "topic"};
+  REQUIRE(merge_text("1\n2\n3\n4\n5", "one\n2\n3\n4\nfive",
+                     "uno\n2\n3\n4\ncinco", out, labels) == 2);
+  REQUIRE(out == "<<<<<<< HEAD\none\n=======\nuno\n>>>>>>> topic\n"
+                 "2\n3\n4\n"
+                 "<<<<<<< HEAD\nfive\n=======\ncinco\n>>>>>>> topic\n");
+
+  // Added on both sides with different content: no base to agree on
+  REQUIRE(merged("", "same\nours\n", "same\ntheirs\n", 1) ==
+          "same\n<<<<<<< ours\nours\n=======\ntheirs\n>>>>>>> theirs\n");
+  REQUIRE(looks_binary(std::string("ab\0cd", 5)));
+  REQUIRE_FALSE(looks_binary("text\n"));
+}
+
+TEST_CASE("merge_trees - unchanged directories are never read",
+          "[merge]") {
+  test::ScratchDir dir("merge-trees");
+  ObjectStore store(dir.path());
+  WorkPool pool(2);
+
+  std::map<std::string, std::string> base_files;
+  for (int d = 0; d < 20; ++d) {
+    for (int f = 0; f < 5; ++f) {
+      base_files["dir" + std::to_string(d) + "/f" + std::to_string(f)] =
+          "line 1\nline 2\nline 3\nfile " + std::to_string(d * 5 + f) + "\n";
+    }
+  }
+  base_files["README"] = "title\n\nbody\n\nend\n";
+  auto ours_files = base_files;
+  auto theirs_files = base_files;
+  ours_files["dir3/f1"] = "line 1 (ours)\nline 2\nline 3\nfile 16\n";
+  theirs_files["dir3/f1"] = "line 1\nline 2\nline 3 (theirs)\nfile 16\n";
+  ours_files["README"] = "Title\n\nbody\n\nend\n";
+  theirs_files["README"] = "title\n\nbody\n\nThe end\n";
+  ours_files["dir5/new"] = "added by us\n";
+  theirs_files.erase("dir7/f0");
+  theirs_files["dir9/f2"] = "#!/bin/sh\n";
+
+  auto base = write_files(store, base_files);
+  auto ours = write_files(store, ours_files);
+  auto theirs = write_files(store, theirs_files);
+  MergeResult result;
+  REQUIRE_FALSE(merge_trees(store, pool, &base, ours, theirs, result));
+  REQUIRE(result.conflicts.empty());
+  REQUIRE(result.stats.files_merged == 2);
+  // The root plus dir3 on each side; dir5, dir7 and dir9 changed on one
+  // side only and are taken whole
+  REQUIRE(result.stats.trees_read == 6);
+
+  auto expected = base_files;
+  expected["dir3/f1"] = "line 1 (ours)\nline 2\nline 3 (theirs)\nfile 16\n";
+  expected["README"] = "Title\n\nbody\n\nThe end\n";
+  expected["dir5/new"] = "added by us\n";
+  expected.erase("dir7/f0");
+  expected["dir9/f2"] = "#!/bin/sh\n";
+  REQUIRE(files_of(store, result.tree) == expected);
+  REQUIRE(result.tree == write_files(store, expected));
+
+  // Merging with no changes on one side returns the other tree itself
+  REQUIRE_FALSE(merge_trees(store, pool, &base, base, theirs, result));
+  REQUIRE(result.tree == theirs);
+  REQUIRE(result.stats.trees_read == 3);
+}
+
+TEST_CASE("merge_trees - conflicts are reported with all three sides",
+          "[merge]") {
+  test::ScratchDir dir("merge-conflicts");
+  ObjectStore store(dir.path());
+  WorkPool pool(2);
+
+  auto base = write_files(store, {{"a.txt", "one\ntwo\n"},
+                                  {"gone.txt", "keep me\n"},
+                                  {"lib/x", "x\n"},
+                                  {"same.txt", "s\n"}});
+  auto ours = write_files(store, {{"a.txt", "ONE\ntwo\n"},
+                                  {"gone.txt", "edited\n"},
+                                  {"lib/x", "x\n"},
+                                  {"lib/y", "y\n"},
+                                  {"same.txt", "s\n"},
+                                  {"both.txt", "ours\n"}});
+  auto theirs = write_files(store, {{"a.txt", "uno\ntwo\n"},
+                                    {"lib", "now a file\n"},
+                                    {"same.txt", "s\n"},
+                                    {"both.txt", "ours\n"}});
+  MergeResult result;
+  MergeOptions options;
+  options.labels = {"main", "topic"};
+  REQUIRE_FALSE(
+      merge_trees(store, pool, &base, ours, theirs, result, options));
+
+  std::vector<std::string> paths;
+  for (const auto &conflict : result.conflicts) {
+    paths.push_back(conflict.path);
+  }
+  REQUIRE(paths ==
+          std::vector<std::string>{"a.txt", "gone.txt", "lib~topic"});
+
+  const auto &text = result.conflicts[0];
+  REQUIRE(text.base);
+  REQUIRE(text.ours);
+  REQUIRE(text.theirs);
+  REQUIRE(text.ours->id == hash_object(ObjectType::Blob, "ONE\ntwo\n"));
+  // Modified here, deleted there: our version stays
+  REQUIRE(result.conflicts[1].ours);
+  REQUIRE_FALSE(result.conflicts[1].theirs);
+  // Their file clashed with our directory and moved aside
+  REQUIRE_FALSE(result.conflicts[2].base);
+  REQUIRE_FALSE(result.conflicts[2].ours);
+  REQUIRE(result.conflicts[2].theirs->mode == EntryMode::Regular);
+
+  auto files = files_of(store, result.tree);
+  REQUIRE(files["a.txt"] ==
+          "<<<<<<< main\nONE\n=======\nuno\n>>>>>>> topic\ntwo\n");
+  REQUIRE(files["gone.txt"] == "edited\n");
+  REQUIRE(files["lib/y"] == "y\n");
+  REQUIRE(files.count("lib/x") == 0);
+  REQUIRE(files["lib~topic"] == "now a file\n");
+  REQUIRE(files["both.txt"] == "ours\n");
+}
+
+TEST_CASE("merge_trees - a file clashing with a directory moves aside",
+          "[merge]") {
+  test::ScratchDir dir("merge-file-dir");
+  ObjectStore store(dir.path());
+  WorkPool pool(2);
+
+  auto base = write_files(store, {{"f", "one\n"}, {"f~topic", "taken\n"}});
+  auto ours = write_files(store, {{"f/x", "x\n"}, {"f~topic", "taken\n"}});
+  auto theirs = write_files(store, {{"f", "two\n"}, {"f~topic", "taken\n"}});
+  MergeOptions options;
+  options.labels = {"HEAD", "topic"};
+  MergeResult result;
+  REQUIRE_FALSE(
+      merge_trees(store, pool, &base, ours, theirs, result, options));
+
+  REQUIRE(result.conflicts.size() == 1);
+  const auto &conflict = result.conflicts[0];
+  REQUIRE(conflict.path == "f~topic_1");
+  REQUIRE(conflict.base->id == hash_object(ObjectType::Blob, "one\n"));
+  REQUIRE_FALSE(conflict.ours);
+  REQUIRE(conflict.theirs->id == hash_object(ObjectType::Blob, "two\n"));
+  REQUIRE(files_of(store, result.tree) ==
+          std::map<std::string, std::string>{{"f/x", "x\n"},
+                                             {"f~topic", "taken\n"},
+                                             {"f~topic_1", "two\n"}});
+
+  // The other way round, our file moves aside under our label
+  REQUIRE_FALSE(
+      merge_trees(store, pool, &base, theirs, ours, result, options));
+  REQUIRE(result.conflicts.size() == 1);
+  REQUIRE(result.conflicts[0].path == "f~HEAD");
+  REQUIRE(result.conflicts[0].ours->id ==
+          hash_object(ObjectType::Blob, "two\n"));
+  REQUIRE_FALSE(result.conflicts[0].theirs);
+  REQUIRE(files_of(store, result.tree)["f/x"] == "x\n");
+}
+
+TEST_CASE("merge_commits - several merge bases merge into a virtual one",
+          "[merge]") {
+  test::ScratchDir dir("merge-recursive");
+  ObjectStore store(dir.path());
+  WorkPool pool(2);
+
+  // Criss-cross: a2 and b2 each merge a and b, so a3 and b3 have two best
+  // common ancestors, a and b
+  auto root = write_commit(store, write_files(store, {{"f", "1\n2\n3\n"}}),
+                           {}, 100);
+  auto a = write_commit(store, write_files(store, {{"f", "1a\n2\n3\n"}}),
+                        {root}, 101);
+  auto b = write_commit(store, write_files(store, {{"f", "1\n2\n3b\n"}}),
+                        {root}, 102);
+  auto both = write_files(store, {{"f", "1a\n2\n3b\n"}});
+  auto a2 = write_commit(store, both, {a, b}, 103);
+  auto b2 = write_commit(store, both, {b, a}, 104);
+  auto a3 = write_commit(store, write_files(store, {{"f", "1a\n2x\n3b\n"}}),
+                         {a2}, 105);
+  auto b3 = write_commit(
+      store, write_files(store, {{"f", "1a\n2\n3b\n"}, {"g", "g\n"}}), {b2},
+      106);
+
+  CommitGraph graph;
+  History history(store, graph);
+  std::vector<ObjectId> bases;
+  REQUIRE_FALSE(history.merge_bases(a3, b3, bases));
+  REQUIRE(bases.size() == 2);
+
+  // Against either real base alone, line 2 and line 3 collide
+  Commit a_commit;
+  ObjectView view;
+  REQUIRE_FALSE(store.read(a, view));
+  REQUIRE_FALSE(decode_commit(view.content(), a_commit));
+  MergeResult single;
+  auto a3_tree = write_files(store, {{"f", "1a\n2x\n3b\n"}});
+  auto b3_tree = write_files(store, {{"f", "1a\n2\n3b\n"}, {"g", "g\n"}});
+  REQUIRE_FALSE(
+      merge_trees(store, pool, &a_commit.tree, a3_tree, b3_tree, single));
+  REQUIRE(single.conflicts.size() == 1);
+
+  MergeResult result;
+  REQUIRE_FALSE(merge_commits(store, pool, history, a3, b3, result));
+  REQUIRE(result.conflicts.empty());
+  REQUIRE(files_of(store, result.tree) ==
+          std::map<std::string, std::string>{{"f", "1a\n2x\n3b\n"},
+                                             {"g", "g\n"}});
+}
+
+TEST_CASE("merge head - records the commit being merged", "[merge]") {
+  test::ScratchDir dir("merge-head");
+  std::optional<ObjectId> out;
+  REQUIRE_FALSE(read_merge_head(dir.path(), out));
+  REQUIRE_FALSE(out);
+  auto id = hash_object(ObjectType::Commit, "x");
+  REQUIRE_FALSE(write_merge_head(dir.path(), id));
+  REQUIRE_FALSE(read_merge_head(dir.path(), out));
+  REQUIRE(out == id);
+}
+
+} // namespace chrona
@@ -0,0 +1,490 @@
+#include "io/file_io.hpp"
+#include "objects/batch_read.hpp"
+#include "objects/chunker.hpp"
+#include "objects/object_cache.hpp"
+#include "objects/object_store.hpp"
+#include "pack/pack_writer.hpp"
+#include "repo/repo.hpp"
+#include "test_helpers.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <fcntl.h>
+#include <fstream>
+#include <random>
+#include <set>
+#include <thread>
+#include <unistd.h>
+
+namespace chrona {
+
+TEST_CASE("init_repo - creates object store layout", "[objects]") {
+  test::ScratchDir dir("init");
+
+  REQUIRE_FALSE(init_repo(dir.path()).has_value());
+  REQUIRE(std::filesystem::is_directory(dir.path() / ".chrona" / "objects"));
+  REQUIRE(find_repo(dir.path()).value() == dir.path());
+
+  auto error = init_repo(dir.path());
+  REQUIRE(error.has_value());
+  REQUIRE(error->error_code == ErrorCode::AlreadyExists);
+}
+
+TEST_CASE("ObjectId - hex round trip", "[objects]") {
+  auto id = hash_object(ObjectType::Blob, "hello");
+  auto parsed = ObjectId::from_hex(id.hex());
+
+  REQUIRE(parsed.has_value());
+  REQUIRE(*parsed == id);
+  REQUIRE_FALSE(ObjectId::from_hex("zz").has_value());
+}
+
+TEST_CASE("ObjectStore - write and read back", "[objects]") {
+  test::ScratchDir dir("store");
+  ObjectStore store(dir.path());
+
+  ObjectId id;
+  REQUIRE_FALSE(store.write(ObjectType::Blob, "hello world\n", id));
+  REQUIRE(store.contains(id));
+  REQUIRE(store.object_path(id).parent_path().filename() ==
+          id.hex().substr(0, 2));
+
+  ObjectView view;
+  REQUIRE_FALSE(store.read(id, view));
+  REQUIRE(view.type() == ObjectType::Blob);
+  REQUIRE(view.content() == "hello world\n");
+
+  SECTION("same content yields the same id") {
+    ObjectId again;
+    REQUIRE_FALSE(store.write(ObjectType::Blob, "hello world\n", again));
+    REQUIRE(again == id);
+  }
+
+  SECTION("type is part of the identity") {
+    ObjectId tree_id;
+    REQUIRE_FALSE(store.write(ObjectType::Tree, "hello world\n", tree_id));
+    REQUIRE(tree_id != id);
+  }
+}
+
+TEST_CASE("ObjectStore - missing and corrupt objects", "[objects]") {
+  test::ScratchDir dir("corrupt");
+  ObjectStore store(dir.path());
+  ObjectView view;
+
+  auto missing = store.read(hash_object(ObjectType::Blob, "nope"), view);
+  REQUIRE(missing.has_value());
+  REQUIRE(missing->error_code == ErrorCode::NotFound);
+
+  ObjectId id;
+  REQUIRE_FALSE(store.write(ObjectType::Blob, "twelve bytes", id));
+  REQUIRE_FALSE(write_file_atomic(store.object_path(id),
+                                         std::string_view("blob 99\0abc", 11)));
+
+  auto corrupt = store.read(id, view);
+  REQUIRE(corrupt.has_value());
+  REQUIRE(corrupt->error_code == ErrorCode::CorruptObject);
+}
+
+TEST_CASE("ObjectBatch - publishes on commit only", "[objects]") {
+  test::ScratchDir dir("batch");
+  ObjectStore store(dir.path());
+
+  ObjectId first;
+  ObjectId second;
+  {
+    ObjectBatch batch(store);
+    REQUIRE_FALSE(batch.add(ObjectType::Blob, "one", first));
+    REQUIRE_FALSE(batch.add(ObjectType::Blob, "one", first));
+    REQUIRE_FALSE(batch.add(ObjectType::Blob, "two", second));
+    REQUIRE(batch.pending() == 2);
+    REQUIRE_FALSE(store.contains(first));
+    REQUIRE_FALSE(batch.commit());
+  }
+  REQUIRE(store.contains(first));
+  REQUIRE(store.contains(second));
+
+  ObjectId dropped;
+  {
+    ObjectBatch batch(store);
+    REQUIRE_FALSE(batch.add(ObjectType::Blob, "three", dropped));
+  }
+  REQUIRE_FALSE(store.contains(dropped));
+  REQUIRE(std::filesystem::is_empty(store.shard_path(dropped)));
+}
+
+TEST_CASE("ObjectStore - files are stored as streamed blobs", "[objects]") {
+  test::ScratchDir dir("files");
+  ObjectStore store(dir.path() / "objects");
+  std::filesystem::create_directories(store.root());
+
+  std::string contents(1 << 20, 'x');
+  contents += "tail";
+  auto path = dir.path() / "big.bin";
+  std::ofstream(path, std::ios::binary) << contents;
+
+  ObjectId hashed;
+  REQUIRE_FALSE(hash_file(path, hashed));
+  REQUIRE(hashed == hash_object(ObjectType::Blob, contents));
+
+  ObjectId stored;
+  REQUIRE_FALSE(store.write_file(path, stored));
+  REQUIRE(stored == hashed);
+
+  ObjectView view;
+  REQUIRE_FALSE(store.read(stored, view));
+  REQUIRE(view.content() == contents);
+}
+
+namespace {
+
+std::string random_content(std::size_t size, unsigned seed) {
+  std::mt19937 rng(seed);
+  std::string out(size, '\0');
+  for (auto &c : out) {
+    c = static_cast<char>(rng());
+  }
+  return out;
+}
+
+std::set<std::string_view> chunks_of(std::string_view data,
+                                     std::size_t average) {
+  std::set<std::string_view> out;
+  std::vector<std::size_t> lengths;
+  split_chunks(data, average, lengths);
+  for (auto length : lengths) {
+    out.insert(data.substr(0, length));
+    data.remove_prefix(length);
+  }
+  return out;
+}
+
+} // namespace
+
+TEST_CASE("split_chunks - cut points follow the content", "[objects]") {
+  constexpr std::size_t average = 8192;
+  auto data = random_content(2 << 20, 1);
+  std::vector<std::size_t> lengths;
+  split_chunks(data, average, lengths);
+
+  std::size_t total = 0;
+  for (std::size_t i = 0; i < lengths.size(); ++i) {
+    total += lengths[i];
+    REQUIRE(lengths[i] <= average * 4);
+    if (i + 1 < lengths.size()) {
+      REQUIRE(lengths[i] >= average / 4);
+    }
+  }
+  REQUIRE(total == data.size());
+  auto count = lengths.size();
+  REQUIRE(count > data.size() / average / 2);
+  REQUIRE(count < data.size() / average * 2);
+
+  // An insertion only disturbs the chunks around it
+  auto before = chunks_of(data, average);
+  auto edited = data;
+  edited.insert(edited.size() / 2, "inserted bytes");
+  auto after = chunks_of(edited, average);
+  std::size_t shared = 0;
+  for (auto chunk : after) {
+    shared += before.count(chunk);
+  }
+  REQUIRE(shared + 3 >= before.size());
+
+  REQUIRE(next_chunk("short", average) == 5);
+  REQUIRE(next_chunk("", average) == 0);
+}
+
+TEST_CASE("ObjectStore - large blobs are stored as shared chunks",
+          "[objects]") {
+  test::ScratchDir dir("chunked");
+  ObjectStore store(dir.path() / "objects");
+  std::filesystem::create_directories(store.root());
+  store.set_chunking({64 * 1024, 4096});
+
+  auto content = random_content(1 << 20, 2);
+  ObjectId id;
+  REQUIRE_FALSE(store.write(ObjectType::Blob, content, id));
+  REQUIRE(id == hash_object(ObjectType::Blob, content));
+  std::vector<ChunkRef> chunks;
+  REQUIRE_FALSE(store.read_chunk_list(id, chunks));
+  REQUIRE(chunks.size() > 100);
+  REQUIRE(std::filesystem::file_size(store.object_path(id)) <
+          chunks.size() * 40);
+
+  ObjectView view;
+  REQUIRE_FALSE(store.read(id, view));
+  REQUIRE(view.type() == ObjectType::Blob);
+  REQUIRE(view.content() == content);
+
+  std::string streamed;
+  std::size_t pieces = 0;
+  REQUIRE_FALSE(store.read_stream(
+      id,
+      [&](ObjectType type, std::uint64_t size) {
+        REQUIRE(type == ObjectType::Blob);
+        REQUIRE(size == content.size());
+        return std::optional<Error>();
+      },
+      [&](std::string_view piece) {
+        ++pieces;
+        streamed.append(piece);
+        return std::optional<Error>();
+      }));
+  REQUIRE(streamed == content);
+  REQUIRE(pieces == chunks.size());
+
+  // A small edit, stored from a file, adds only a few new chunks
+  auto edited = content;
+  edited.replace(300000, 5, "edit!");
+  auto path = dir.path() / "edited.bin";
+  { std::ofstream(path, std::ios::binary) << edited; }
+  std::size_t before = 0;
+  store.for_each_loose([&](const ObjectId &) { ++before; });
+  ObjectId edited_id;
+  REQUIRE_FALSE(store.write_file(path, edited_id));
+  REQUIRE(edited_id == hash_object(ObjectType::Blob, edited));
+  std::size_t after = 0;
+  store.for_each_loose([&](const ObjectId &) { ++after; });
+  REQUIRE(after - before <= 4);
+  REQUIRE_FALSE(store.read(edited_id, view));
+  REQUIRE(view.content() == edited);
+  REQUIRE(std::filesystem::file_size(store.chunked_list_path()) ==
+          2 * ObjectId::size);
+
+  // Small blobs and other object types are never chunked
+  ObjectId small;
+  REQUIRE_FALSE(store.write(ObjectType::Blob, "small", small));
+  REQUIRE_FALSE(store.read_chunk_list(small, chunks));
+  REQUIRE(chunks.empty());
+
+  SECTION("a missing chunk fails the read") {
+    REQUIRE_FALSE(store.read_chunk_list(id, chunks));
+    std::filesystem::remove(store.object_path(chunks[7].id));
+    REQUIRE(store.read(id, view).has_value());
+  }
+
+  SECTION("a chunk list with a forged size is corrupt") {
+    std::string file;
+    REQUIRE_FALSE(read_file(store.object_path(id), file));
+    auto nul = file.find('\0');
+    file = file.substr(0, 1) + "blob 99999999999999999" + file.substr(nul);
+    std::filesystem::remove(store.object_path(id));
+    REQUIRE_FALSE(write_file_atomic(store.object_path(id), file));
+    ObjectStore fresh(store.root());
+    auto error = fresh.read(id, view);
+    REQUIRE(error);
+    REQUIRE(error->error_code == ErrorCode::CorruptObject);
+  }
+
+  SECTION("a chunk list is stored only when its chunks add up") {
+    ObjectStore other(dir.path() / "other");
+    std::filesystem::create_directories(other.root());
+    REQUIRE_FALSE(store.read_chunk_list(id, chunks));
+    ObjectBatch batch(other);
+    auto missing = batch.add_chunk_list(id, chunks);
+    REQUIRE(missing);
+    REQUIRE(missing->error_code == ErrorCode::NotFound);
+    for (const auto &chunk : chunks) {
+      REQUIRE_FALSE(store.read(chunk.id, view));
+      ObjectId copied;
+      REQUIRE_FALSE(batch.add(ObjectType::Blob, view.content(), copied));
+    }
+    REQUIRE_FALSE(batch.commit());
+
+    auto swapped = chunks;
+    std::swap(swapped[0], swapped[1]);
+    auto error = batch.add_chunk_list(id, swapped);
+    REQUIRE(error);
+    REQUIRE(error->error_code == ErrorCode::CorruptObject);
+    REQUIRE_FALSE(batch.add_chunk_list(id, chunks));
+    REQUIRE_FALSE(batch.commit());
+    REQUIRE_FALSE(other.read(id, view));
+    REQUIRE(view.content() == content);
+    std::vector<ChunkRef> stored;
+    REQUIRE_FALSE(other.read_chunk_list(id, stored));
+    REQUIRE(stored.size() == chunks.size());
+  }
+}
+
+TEST_CASE("ObjectCache - trees and commits are served from memory",
+          "[objects]") {
+  test::ScratchDir dir("object-cache");
+  ObjectStore store(dir.path());
+  ObjectId tree;
+  ObjectId blob;
+  REQUIRE_FALSE(store.write(ObjectType::Tree, "tree entries", tree));
+  REQUIRE_FALSE(store.write(ObjectType::Blob, "blob\n", blob));
+  auto &cache = store.object_cache();
+
+  ObjectView view;
+  REQUIRE_FALSE(store.read(tree, view));
+  REQUIRE(cache.misses() == 1);
+  REQUIRE_FALSE(store.read(tree, view));
+  REQUIRE(cache.hits() == 1);
+  REQUIRE(view.type() == ObjectType::Tree);
+  REQUIRE(view.content() == "tree entries");
+
+  // Blobs are looked up but never kept
+  REQUIRE_FALSE(store.read(blob, view));
+  REQUIRE_FALSE(store.read(blob, view));
+  REQUIRE(cache.hits() == 1);
+  REQUIRE(cache.misses() == 3);
+
+  // A hit does not touch the object's file
+  std::filesystem::remove(store.object_path(tree));
+  REQUIRE_FALSE(store.read(tree, view));
+  REQUIRE(view.type() == ObjectType::Tree);
+}
+
+TEST_CASE("ObjectCache - eviction keeps the cache within its budget",
+          "[objects]") {
+  ObjectCache cache(64 << 10);
+  std::vector<ObjectId> ids;
+  for (int i = 0; i < 2000; ++i) {
+    auto content = std::to_string(i) + std::string(200, 'x');
+    ids.push_back(hash_object(ObjectType::Commit, content));
+    cache.put(ids.back(), ObjectView(ObjectType::Commit, content, nullptr));
+    REQUIRE(cache.bytes() <= cache.max_bytes());
+  }
+  REQUIRE(cache.evictions() > 0);
+
+  // A view taken before eviction stays valid after it
+  ObjectView held;
+  std::size_t present = 0;
+  for (int i = 0; i < 2000; ++i) {
+    ObjectView view;
+    if (cache.get(ids[i], view)) {
+      ++present;
+      REQUIRE(view.content() == std::to_string(i) + std::string(200, 'x'));
+      held = view;
+    }
+  }
+  REQUIRE(present > 0);
+  REQUIRE(present < 2000);
+  auto expected = std::string(held.content());
+  for (int i = 0; i < 2000; ++i) {
+    auto content = "again" + std::to_string(i) + std::string(200, 'y');
+    cache.put(hash_object(ObjectType::Tree, content),
+              ObjectView(ObjectType::Tree, content, nullptr));
+  }
+  REQUIRE(held.content() == expected);
+
+  // Larger than a shard's share of the budget: never cached
+  std::string huge(2 << 10, 'z');
+  auto huge_id = hash_object(ObjectType::Tree, huge);
+  cache.put(huge_id, ObjectView(ObjectType::Tree, huge, nullptr));
+  ObjectView view;
+  REQUIRE_FALSE(cache.get(huge_id, view));
+}
+
+TEST_CASE("ObjectCache - concurrent readers and writers", "[objects]") {
+  ObjectCache cache(256 << 10);
+  constexpr int objects = 3000;
+  std::vector<ObjectId> ids;
+  std::vector<std::string> contents;
+  for (int i = 0; i < objects; ++i) {
+    contents.push_back("tree " + std::to_string(i) +
+                       std::string(static_cast<std::size_t>(i % 300), '.'));
+    ids.push_back(hash_object(ObjectType::Tree, contents.back()));
+  }
+
+  std::atomic<int> wrong{0};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&, t] {
+      std::mt19937 rng(static_cast<unsigned>(t));
+      for (int n = 0; n < 20000; ++n) {
+        // Mostly a hot tenth of the objects, sometimes anything
+        auto i = static_cast<int>(rng() % (rng() % 4 ? objects / 10
+                                                      : objects));
+        ObjectView view;
+        if (cache.get(ids[i], view)) {
+          if (view.content() != contents[i]) {
+            ++wrong;
+          }
+        } else {
+          cache.put(ids[i], ObjectView(ObjectType::Tree, contents[i],
+                                       nullptr));
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  REQUIRE(wrong == 0);
+  REQUIRE(cache.hits() + cache.misses() == 8 * 20000);
+  REQUIRE(cache.hits() > cache.misses());
+  REQUIRE(cache.bytes() <= cache.max_bytes());
+}
+
+TEST_CASE("read_batch - packed and loose objects in request order",
+          "[objects]") {
+  test::ScratchDir dir("batch");
+  ObjectStore store(dir.path());
+  std::vector<ObjectId> packed;
+  std::vector<ObjectId> ids;
+  std::vector<std::string> contents;
+  for (int i = 0; i < 200; ++i) {
+    contents.push_back("object " + std::to_string(i) + "\n");
+    ObjectId id;
+    REQUIRE_FALSE(store.write(ObjectType::Blob, contents.back(), id));
+    ids.push_back(id);
+    if (i % 2 == 0) {
+      packed.push_back(id);
+    }
+  }
+  PackResult result;
+  REQUIRE_FALSE(write_pack(store.pack_dir(), store, packed, result));
+  for (const auto &id : packed) {
+    std::filesystem::remove(store.object_path(id));
+  }
+  REQUIRE_FALSE(store.reload_packs());
+
+  // Reversed, with a missing id and a repeat in the middle
+  std::vector<ObjectId> request(ids.rbegin(), ids.rend());
+  auto missing = hash_object(ObjectType::Blob, "never written");
+  request.insert(request.begin() + 50, missing);
+  request.insert(request.begin() + 100, ids[3]);
+
+  WorkPool pool(2);
+  for (auto *workers : {static_cast<WorkPool *>(nullptr), &pool}) {
+    std::vector<BatchRead> out;
+    read_batch(store, request, out, workers);
+    REQUIRE(out.size() == request.size());
+    for (std::size_t i = 0; i < request.size(); ++i) {
+      if (request[i] == missing) {
+        REQUIRE(out[i].error.has_value());
+        REQUIRE(out[i].error->error_code == ErrorCode::NotFound);
+        continue;
+      }
+      REQUIRE_FALSE(out[i].error);
+      REQUIRE(hash_object(out[i].view.type(), out[i].view.content()) ==
+              request[i]);
+    }
+  }
+}
+
+TEST_CASE("write_vectored - writes every part in order", "[objects]") {
+  test::ScratchDir dir("vectored");
+  auto path = dir.path() / "out";
+  int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  REQUIRE(fd >= 0);
+
+  // More parts than one writev takes, some of them empty
+  std::vector<std::string> storage;
+  std::string expected;
+  for (int i = 0; i < 3000; ++i) {
+    storage.push_back(i % 7 == 0 ? "" : std::to_string(i) + ",");
+    expected += storage.back();
+  }
+  std::vector<std::string_view> parts(storage.begin(), storage.end());
+  auto error = write_vectored(fd, parts, path);
+  ::close(fd);
+  REQUIRE_FALSE(error);
+
+  std::string written;
+  REQUIRE_FALSE(read_file(path, written));
+  REQUIRE(written == expected);
+}
+
+} // namespace chrona
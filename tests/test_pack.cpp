@@ -0,0 +1,436 @@
+#include "history/commit.hpp"
+#include "objects/object_store.hpp"
+#include "pack/bitmap.hpp"
+#include "pack/delta.hpp"
+#include "pack/ewah.hpp"
+#include "pack/pack.hpp"
+#include "pack/pack_writer.hpp"
+#include "pack/varint.hpp"
+#include "snapshot/tree.hpp"
+#include "test_helpers.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <cstring>
+#include <fstream>
+#include <random>
+
+namespace chrona {
+
+namespace {
+
+std::string numbered_lines(int count, int changed = -1) {
+  std::string out;
+  for (int i = 0; i < count; ++i) {
+    out += (i == changed ? "changed line " : "line number ") +
+           std::to_string(i) + "\n";
+  }
+  return out;
+}
+
+std::vector<std::size_t> set_bits(const Bitmap &bitmap) {
+  std::vector<std::size_t> out;
+  bitmap.for_each([&](std::size_t bit) { out.push_back(bit); });
+  return out;
+}
+
+// Each commit changes one of the files; a root commit has no parents.
+ObjectId commit_on(ObjectStore &store, std::vector<TreeEntry> &files,
+                   std::vector<ObjectId> parents, int n) {
+  auto &file = files[static_cast<std::size_t>(n) % files.size()];
+  auto content = numbered_lines(20, n % 20) + std::to_string(n) + "\n";
+  REQUIRE_FALSE(store.write(ObjectType::Blob, content, file.id));
+  Commit commit;
+  REQUIRE_FALSE(store.write(ObjectType::Tree, encode_tree(files), commit.tree));
+  commit.parents = std::move(parents);
+  commit.author = "test";
+  commit.time = n;
+  commit.message = "commit " + std::to_string(n) + "\n";
+  ObjectId id;
+  REQUIRE_FALSE(store.write(ObjectType::Commit, encode_commit(commit), id));
+  return id;
+}
+
+} // namespace
+
+TEST_CASE("ewah - round trips sparse, dense and run-heavy bitmaps",
+          "[pack]") {
+  std::mt19937 random(7);
+  std::vector<Bitmap> bitmaps(5);
+  bitmaps[1].set(1000);
+  for (std::size_t bit = 0; bit < 10000; ++bit) {
+    bitmaps[2].set(bit);
+  }
+  for (std::size_t bit = 0; bit < 20000; ++bit) {
+    // Runs of set and clear words with noisy words in between
+    if ((bit / 640) % 3 == 0 || (bit % 97 == 0 && random() % 2 == 0)) {
+      bitmaps[3].set(bit);
+    }
+  }
+  for (int i = 0; i < 3000; ++i) {
+    bitmaps[4].set(random() % 50000);
+  }
+
+  for (const auto &bitmap : bitmaps) {
+    auto encoded = ewah_encode(bitmap);
+    std::string_view in = encoded;
+    Bitmap decoded;
+    REQUIRE(ewah_or_into(in, decoded));
+    REQUIRE(in.empty());
+    REQUIRE(set_bits(decoded) == set_bits(bitmap));
+    REQUIRE(decoded.count() == bitmap.count());
+  }
+  // Long runs cost a marker, not a word each
+  REQUIRE(ewah_encode(bitmaps[2]).size() < 64);
+
+  auto encoded = ewah_encode(bitmaps[4]);
+  std::string_view truncated(encoded.data(), encoded.size() - 1);
+  Bitmap ignored;
+  REQUIRE_FALSE(ewah_or_into(truncated, ignored));
+
+  Bitmap a = bitmaps[3];
+  a.and_not(bitmaps[2]);
+  for (auto bit : set_bits(a)) {
+    REQUIRE(bit >= 10000);
+  }
+  Bitmap b = bitmaps[3];
+  b &= bitmaps[2];
+  a |= b;
+  REQUIRE(set_bits(a) == set_bits(bitmaps[3]));
+}
+
+TEST_CASE("delta - round trips similar and unrelated content", "[pack]") {
+  auto base = numbered_lines(200);
+  auto target = numbered_lines(200, 100) + "appended\n";
+
+  auto delta = create_delta(base, target);
+  REQUIRE(delta.size() < target.size() / 10);
+  std::string rebuilt;
+  REQUIRE_FALSE(apply_delta(base, delta, rebuilt));
+  REQUIRE(rebuilt == target);
+
+  auto unrelated = create_delta("short", target);
+  REQUIRE_FALSE(apply_delta("short", unrelated, rebuilt));
+  REQUIRE(rebuilt == target);
+
+  SECTION("a delta against the wrong base is rejected") {
+    REQUIRE(apply_delta(base.substr(1), delta, rebuilt).has_value());
+  }
+  SECTION("a truncated delta is rejected") {
+    REQUIRE(apply_delta(base, delta.substr(0, delta.size() - 1), rebuilt)
+                .has_value());
+  }
+  SECTION("a delta claiming a huge result fails without allocating it") {
+    std::string_view ops = delta;
+    std::uint64_t base_size;
+    std::uint64_t result_size;
+    REQUIRE(read_varint(ops, base_size));
+    REQUIRE(read_varint(ops, result_size));
+    std::string forged;
+    append_varint(forged, base_size);
+    append_varint(forged, 99999999999999999ull);
+    forged += ops;
+    auto error = apply_delta(base, forged, rebuilt);
+    REQUIRE(error);
+    REQUIRE(error->error_code == ErrorCode::CorruptObject);
+  }
+}
+
+TEST_CASE("write_pack - objects read back through the store", "[pack]") {
+  test::ScratchDir dir("pack");
+  ObjectStore store(dir.path());
+
+  // Versions of the same file under one name should end up as a delta chain
+  std::vector<ObjectId> ids;
+  std::vector<std::string> contents;
+  for (int version = 0; version < 5; ++version) {
+    contents.push_back(numbered_lines(300, version * 10));
+    ObjectId id;
+    REQUIRE_FALSE(store.write(ObjectType::Blob, contents.back(), id));
+    ids.push_back(id);
+
+    ObjectId tree;
+    REQUIRE_FALSE(store.write(
+        ObjectType::Tree,
+        encode_tree({TreeEntry{"notes.txt", EntryMode::Regular, id}}), tree));
+    ids.push_back(tree);
+  }
+
+  PackResult result;
+  REQUIRE_FALSE(write_pack(store.pack_dir(), store, ids, result));
+  REQUIRE(result.objects == ids.size());
+  REQUIRE(result.deltas >= 4);
+
+  // Remove the loose copies so every read has to go through the pack
+  for (const auto &id : ids) {
+    std::filesystem::remove(store.object_path(id));
+  }
+  REQUIRE_FALSE(store.reload_packs());
+  REQUIRE(store.packs()->size() == 1);
+
+  for (std::size_t i = 0; i < contents.size(); ++i) {
+    ObjectView view;
+    REQUIRE(store.contains(ids[i * 2]));
+    REQUIRE_FALSE(store.read(ids[i * 2], view));
+    REQUIRE(view.type() == ObjectType::Blob);
+    REQUIRE(view.content() == contents[i]);
+    REQUIRE(hash_object(view.type(), view.content()) == ids[i * 2]);
+  }
+
+  SECTION("lookups of unknown ids miss") {
+    auto missing = hash_object(ObjectType::Blob, "not packed");
+    REQUIRE_FALSE(store.contains(missing));
+    REQUIRE_FALSE(store.packs()->front()->find(missing).has_value());
+    ObjectView view;
+    auto error = store.read(missing, view);
+    REQUIRE(error.has_value());
+    REQUIRE(error->error_code == ErrorCode::NotFound);
+  }
+
+  SECTION("repeated reads hit the delta base cache") {
+    ObjectView view;
+    for (std::size_t i = 0; i < contents.size(); ++i) {
+      REQUIRE_FALSE(store.read(ids[i * 2], view));
+    }
+    REQUIRE(store.delta_cache().hits() > 0);
+
+    // Cached bases belong to one pack, whatever address it had
+    const auto &pack = *store.packs()->front();
+    auto other = hash_object(ObjectType::Blob, "another pack");
+    auto base = std::make_shared<const std::string>("base");
+    store.delta_cache().put(other, 1, base);
+    REQUIRE(store.delta_cache().get(other, 1) == base);
+    REQUIRE(store.delta_cache().get(pack.checksum(), 1) ==
+            nullptr);
+  }
+
+  SECTION("an index with a broken fanout table is rejected") {
+    auto index_path = result.path;
+    index_path.replace_extension(".idx");
+    std::string index;
+    {
+      std::ifstream in(index_path, std::ios::binary);
+      index.assign(std::istreambuf_iterator<char>(in), {});
+    }
+    // Bucket 0 claims more entries than the index holds
+    std::uint32_t bogus = static_cast<std::uint32_t>(ids.size()) + 7;
+    std::memcpy(index.data() + 12, &bogus, sizeof(bogus));
+    std::ofstream(index_path, std::ios::binary | std::ios::trunc) << index;
+    std::shared_ptr<PackFile> pack;
+    auto error = PackFile::open(result.path, pack);
+    REQUIRE(error.has_value());
+    REQUIRE(error->error_code == ErrorCode::CorruptObject);
+  }
+}
+
+TEST_CASE("write_pack - chunked blobs stay loose and share packed chunks",
+          "[pack]") {
+  test::ScratchDir dir("pack-chunked");
+  ObjectStore store(dir.path());
+  store.set_chunking({64 * 1024, 4096});
+
+  // Two versions of a large file that differ in one spot share most chunks
+  std::mt19937 random(7);
+  std::string first(256 * 1024, '\0');
+  for (auto &c : first) {
+    c = static_cast<char>(random());
+  }
+  auto second = first;
+  second.replace(100 * 1024, 5, "edit!");
+  ObjectId first_id;
+  ObjectId second_id;
+  REQUIRE_FALSE(store.write(ObjectType::Blob, first, first_id));
+  REQUIRE_FALSE(store.write(ObjectType::Blob, second, second_id));
+  std::vector<ChunkRef> first_chunks;
+  std::vector<ChunkRef> second_chunks;
+  REQUIRE_FALSE(store.read_chunk_list(first_id, first_chunks));
+  REQUIRE_FALSE(store.read_chunk_list(second_id, second_chunks));
+
+  std::vector<ObjectId> ids;
+  store.for_each_loose([&](const ObjectId &id) { ids.push_back(id); });
+  PackResult result;
+  REQUIRE_FALSE(write_pack(store.pack_dir(), store, ids, result));
+  std::sort(result.chunked.begin(), result.chunked.end());
+  auto expected = std::vector<ObjectId>{first_id, second_id};
+  std::sort(expected.begin(), expected.end());
+  REQUIRE(result.chunked == expected);
+  REQUIRE(result.objects == ids.size() - 2);
+  REQUIRE(result.objects < first_chunks.size() + second_chunks.size());
+
+  for (const auto &id : ids) {
+    if (id != first_id && id != second_id) {
+      std::filesystem::remove(store.object_path(id));
+    }
+  }
+  REQUIRE_FALSE(store.reload_packs());
+
+  // The lists are still loose and their chunks come from the pack
+  std::vector<ChunkRef> chunks;
+  REQUIRE_FALSE(store.read_chunk_list(second_id, chunks));
+  REQUIRE(chunks.size() == second_chunks.size());
+  REQUIRE(store.packs()->front()->find(chunks.front().id).has_value());
+  ObjectView view;
+  REQUIRE_FALSE(store.read(first_id, view));
+  REQUIRE(view.content() == first);
+  REQUIRE_FALSE(store.read(second_id, view));
+  REQUIRE(view.content() == second);
+}
+
+TEST_CASE("ObjectStore - loose objects are still found next to packs",
+          "[pack]") {
+  test::ScratchDir dir("pack-mixed");
+  ObjectStore store(dir.path());
+
+  ObjectId packed;
+  REQUIRE_FALSE(store.write(ObjectType::Blob, "packed", packed));
+  PackResult result;
+  REQUIRE_FALSE(write_pack(store.pack_dir(), store, {packed}, result));
+  REQUIRE_FALSE(store.reload_packs());
+
+  ObjectId loose;
+  REQUIRE_FALSE(store.write(ObjectType::Blob, "loose", loose));
+
+  std::vector<ObjectId> listed;
+  store.for_each_loose([&](const ObjectId &id) { listed.push_back(id); });
+  REQUIRE(listed.size() == 2);
+
+  ObjectView view;
+  REQUIRE_FALSE(store.read(loose, view));
+  REQUIRE(view.content() == "loose");
+  REQUIRE_FALSE(store.read(packed, view));
+  REQUIRE(view.content() == "packed");
+}
+
+TEST_CASE("reverse index - pack order with and without the .rev file",
+          "[pack]") {
+  test::ScratchDir dir("pack-rev");
+  ObjectStore store(dir.path());
+  std::vector<ObjectId> ids;
+  for (int i = 0; i < 50; ++i) {
+    ObjectId id;
+    REQUIRE_FALSE(store.write(ObjectType::Blob, numbered_lines(i + 1), id));
+    ids.push_back(id);
+  }
+  PackResult result;
+  REQUIRE_FALSE(write_pack(store.pack_dir(), store, ids, result));
+  auto rev = result.path;
+  rev.replace_extension(".rev");
+  REQUIRE(std::filesystem::exists(rev));
+
+  auto check = [&] {
+    std::shared_ptr<PackFile> pack;
+    REQUIRE_FALSE(PackFile::open(result.path, pack));
+    std::uint64_t previous = 0;
+    for (std::size_t pos = 0; pos < pack->size(); ++pos) {
+      auto index = pack->index_at_position(pos);
+      REQUIRE(pack->offset_at(index) > previous);
+      previous = pack->offset_at(index);
+      REQUIRE(pack->position_of(index) == pos);
+      REQUIRE(pack->type_at(index) == ObjectType::Blob);
+    }
+  };
+  check();
+  std::filesystem::remove(rev);
+  check();
+}
+
+TEST_CASE("reachability bitmaps - agree with a plain walk", "[pack]") {
+  test::ScratchDir dir("pack-bitmaps");
+  ObjectStore store(dir.path());
+
+  // main: 30 commits; topic forks at 15 with 10 commits; main then
+  // merges topic
+  std::vector<TreeEntry> files(5);
+  for (std::size_t i = 0; i < files.size(); ++i) {
+    files[i] = TreeEntry{"file" + std::to_string(i), EntryMode::Regular, {}};
+    REQUIRE_FALSE(store.write(ObjectType::Blob, files[i].name, files[i].id));
+  }
+  std::vector<ObjectId> main;
+  for (int n = 0; n < 30; ++n) {
+    main.push_back(commit_on(store, files, main.empty()
+                                               ? std::vector<ObjectId>{}
+                                               : std::vector{main.back()},
+                             n));
+  }
+  auto topic_files = files;
+  std::vector<ObjectId> topic{main[15]};
+  for (int n = 100; n < 110; ++n) {
+    topic.push_back(commit_on(store, topic_files, {topic.back()}, n));
+  }
+  auto merge = commit_on(store, files, {main.back(), topic.back()}, 200);
+  std::vector<ObjectId> tips{merge, topic.back()};
+
+  Reachability plain(store);
+  REQUIRE_FALSE(plain.has_bitmaps());
+  ObjectSet expected_set;
+  REQUIRE_FALSE(plain.reachable(tips, expected_set));
+  auto expected = plain.ids(expected_set);
+  REQUIRE(plain.count(expected_set, ObjectType::Commit) == 41);
+  std::vector<ObjectId> expected_missing;
+  REQUIRE_FALSE(plain.missing({merge}, {main[20]}, expected_missing));
+  REQUIRE_FALSE(expected_missing.empty());
+
+  std::vector<ObjectId> all;
+  store.for_each_loose([&](const ObjectId &id) { all.push_back(id); });
+  PackResult result;
+  REQUIRE_FALSE(write_pack(store.pack_dir(), store, all, result));
+  REQUIRE_FALSE(store.reload_packs());
+  BitmapOptions options;
+  options.recent = 5;
+  options.recent_spacing = 2;
+  options.spacing = 7;
+  std::size_t written = 0;
+  REQUIRE_FALSE(write_pack_bitmaps(store, *store.packs()->front(), tips,
+                                   written, options));
+  REQUIRE(written > tips.size());
+
+  Reachability bitmapped(store);
+  REQUIRE(bitmapped.has_bitmaps());
+  ObjectSet set;
+  REQUIRE_FALSE(bitmapped.reachable(tips, set));
+  REQUIRE(set.others.empty());
+  REQUIRE(bitmapped.ids(set) == expected);
+  REQUIRE(bitmapped.count(set, ObjectType::Commit) == 41);
+  REQUIRE(bitmapped.count(set, ObjectType::Tree) ==
+          plain.count(expected_set, ObjectType::Tree));
+  std::vector<ObjectId> missing;
+  REQUIRE_FALSE(bitmapped.missing({merge}, {main[20]}, missing));
+  REQUIRE(missing == expected_missing);
+
+  ObjectSet from_bitmaps;
+  bitmapped.reachable_from_bitmaps({merge}, from_bitmaps);
+  REQUIRE(from_bitmaps.packed.count() == bitmapped.count(set));
+
+  SECTION("history newer than the pack is walked up to the bitmaps") {
+    auto tip = commit_on(store, files, {merge}, 300);
+    ObjectSet newer;
+    REQUIRE_FALSE(bitmapped.reachable({tip}, newer));
+    REQUIRE(newer.others.size() == 3); // commit, tree, blob
+    REQUIRE(bitmapped.count(newer) == expected.size() + 3);
+  }
+
+  SECTION("a pack that lacks reachable objects gets no bitmaps") {
+    auto tip = commit_on(store, files, {merge}, 300);
+    REQUIRE_FALSE(write_pack_bitmaps(store, *store.packs()->front(), {tip},
+                                     written));
+    REQUIRE(written == 0);
+  }
+
+  SECTION("damaged bitmaps are ignored") {
+    auto path = result.path;
+    path.replace_extension(".bitmap");
+    {
+      std::fstream file(path, std::ios::in | std::ios::out |
+                                  std::ios::binary);
+      file.seekp(100);
+      file.put('\x5a');
+    }
+    PackBitmaps bitmaps;
+    REQUIRE(PackBitmaps::open(store.packs()->front(), bitmaps).has_value());
+    Reachability fallback(store);
+    REQUIRE_FALSE(fallback.has_bitmaps());
+    ObjectSet walked;
+    REQUIRE_FALSE(fallback.reachable(tips, walked));
+    REQUIRE(fallback.ids(walked) == expected);
+  }
+}
+
+} // namespace chrona
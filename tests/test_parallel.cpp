@@ -0,0 +1,51 @@
+#include "parallel/work_pool.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <atomic>
+#include <vector>
+
+namespace chrona {
+
+TEST_CASE("WorkPool - runs every submitted task", "[parallel]") {
+  WorkPool pool(4);
+  std::atomic<int> count{0};
+  for (int i = 0; i < 1000; ++i) {
+    pool.submit([&count] { count.fetch_add(1); });
+  }
+  pool.wait();
+  REQUIRE(count.load() == 1000);
+}
+
+TEST_CASE("WorkPool - waits for recursively spawned tasks", "[parallel]") {
+  WorkPool pool(3);
+  std::atomic<int> leaves{0};
+
+  // A binary tree of depth 10 spawned from inside tasks
+  std::function<void(int)> spawn = [&](int depth) {
+    if (depth == 0) {
+      leaves.fetch_add(1);
+      return;
+    }
+    pool.submit([&, depth] { spawn(depth - 1); });
+    pool.submit([&, depth] { spawn(depth - 1); });
+  };
+  pool.submit([&] { spawn(10); });
+  pool.wait();
+
+  REQUIRE(leaves.load() == 1024);
+}
+
+TEST_CASE("WorkPool - parallel_for covers the range once", "[parallel]") {
+  WorkPool pool(2);
+  std::vector<int> hits(1001, 0);
+  pool.parallel_for(hits.size(), 64, [&](std::size_t begin, std::size_t end) {
+    for (auto i = begin; i < end; ++i) {
+      hits[i]++;
+    }
+  });
+
+  for (int hit : hits) {
+    REQUIRE(hit == 1);
+  }
+}
+
+} // namespace chrona
@@ -0,0 +1,264 @@
+#include "io/file_io.hpp"
+#include "refs/packed_refs.hpp"
+#include "refs/refs.hpp"
+#include "refs/transaction.hpp"
+#include "repo/repo.hpp"
+#include "test_helpers.hpp"
+#include <atomic>
+#include <catch2/catch_test_macros.hpp>
+#include <thread>
+
+namespace chrona {
+
+TEST_CASE("refs - HEAD, branches and revisions", "[refs]") {
+  test::ScratchDir dir("refs");
+  REQUIRE_FALSE(init_repo(dir.path()));
+  auto chrona_dir = dir.path() / ".chrona";
+
+  std::string head;
+  REQUIRE_FALSE(read_head(chrona_dir, head));
+  REQUIRE(head == default_branch_ref);
+
+  std::optional<ObjectId> id;
+  REQUIRE_FALSE(read_ref(chrona_dir, head, id));
+  REQUIRE_FALSE(id.has_value());
+
+  ObjectId resolved;
+  auto error = resolve_revision(chrona_dir, "HEAD", resolved);
+  REQUIRE(error.has_value());
+  REQUIRE(error->error_code == ErrorCode::NotFound);
+
+  auto commit = hash_object(ObjectType::Commit, "c");
+  REQUIRE_FALSE(write_ref(chrona_dir, head, commit));
+  REQUIRE_FALSE(write_ref(chrona_dir, "refs/heads/topic/x", commit));
+
+  for (const char *spec : {"HEAD", "main", "refs/heads/main", "topic/x"}) {
+    REQUIRE_FALSE(resolve_revision(chrona_dir, spec, resolved));
+    REQUIRE(resolved == commit);
+  }
+  REQUIRE_FALSE(resolve_revision(chrona_dir, commit.hex(), resolved));
+  REQUIRE(resolved == commit);
+
+  std::vector<std::pair<std::string, ObjectId>> refs;
+  REQUIRE_FALSE(list_refs(chrona_dir, refs));
+  REQUIRE(refs.size() == 2);
+  REQUIRE(refs[0].first == "refs/heads/main");
+  REQUIRE(refs[1].first == "refs/heads/topic/x");
+
+  REQUIRE_FALSE(is_valid_ref_name("refs/heads/../config"));
+  REQUIRE_FALSE(is_valid_ref_name("heads/main"));
+  REQUIRE(write_ref(chrona_dir, "refs/heads/a b", commit).has_value());
+  REQUIRE_FALSE(is_valid_ref_name("refs/heads/main.lock"));
+}
+
+TEST_CASE("packed refs - loose refs override packed ones", "[refs]") {
+  test::ScratchDir dir("packed-refs");
+  REQUIRE_FALSE(init_repo(dir.path()));
+  auto chrona_dir = dir.path() / ".chrona";
+  auto one = hash_object(ObjectType::Commit, "one");
+  auto two = hash_object(ObjectType::Commit, "two");
+
+  for (const char *name : {"refs/heads/main", "refs/heads/topic/a",
+                           "refs/heads/topic/b", "refs/tags/v1"}) {
+    REQUIRE_FALSE(write_ref(chrona_dir, name, one));
+  }
+  std::size_t packed = 0;
+  REQUIRE_FALSE(pack_refs(chrona_dir, packed));
+  REQUIRE(packed == 4);
+  REQUIRE_FALSE(std::filesystem::exists(chrona_dir / "refs/heads/main"));
+  REQUIRE_FALSE(std::filesystem::exists(chrona_dir / "refs/heads/topic"));
+  REQUIRE(std::filesystem::exists(chrona_dir / "refs/heads"));
+
+  PackedRefs view;
+  REQUIRE_FALSE(PackedRefs::open(packed_refs_path(chrona_dir), view));
+  REQUIRE(view.size() == 4);
+  REQUIRE(view.name(1) == "refs/heads/topic/a");
+  REQUIRE(view.find("refs/tags/v1") == one);
+  REQUIRE_FALSE(view.find("refs/heads/topic"));
+
+  // A loose write shadows the packed value until the next pack
+  REQUIRE_FALSE(write_ref(chrona_dir, "refs/heads/topic/a", two));
+  std::optional<ObjectId> id;
+  REQUIRE_FALSE(read_ref(chrona_dir, "refs/heads/topic/a", id));
+  REQUIRE(id == two);
+  REQUIRE_FALSE(read_ref(chrona_dir, "refs/heads/main", id));
+  REQUIRE(id == one);
+
+  RefTransaction remove(chrona_dir);
+  remove.remove("refs/heads/topic/a", two);
+  remove.remove("refs/tags/v1");
+  REQUIRE_FALSE(remove.commit());
+  std::vector<std::pair<std::string, ObjectId>> refs;
+  REQUIRE_FALSE(list_refs(chrona_dir, refs));
+  REQUIRE(refs.size() == 2);
+  REQUIRE(refs[0].first == "refs/heads/main");
+  REQUIRE(refs[1].first == "refs/heads/topic/b");
+  REQUIRE_FALSE(read_ref(chrona_dir, "refs/heads/topic/a", id));
+  REQUIRE_FALSE(id);
+
+  REQUIRE_FALSE(write_file_atomic(packed_refs_path(chrona_dir), "CPRF"));
+  auto error = read_ref(chrona_dir, "refs/heads/main", id);
+  REQUIRE(error.has_value());
+  REQUIRE(error->error_code == ErrorCode::CorruptObject);
+}
+
+TEST_CASE("ref transactions - all or nothing", "[refs]") {
+  test::ScratchDir dir("ref-transaction");
+  REQUIRE_FALSE(init_repo(dir.path()));
+  auto chrona_dir = dir.path() / ".chrona";
+  auto one = hash_object(ObjectType::Commit, "one");
+  auto two = hash_object(ObjectType::Commit, "two");
+  REQUIRE_FALSE(write_ref(chrona_dir, "refs/heads/main", one));
+
+  auto value = [&](const std::string &name) {
+    std::optional<ObjectId> id;
+    REQUIRE_FALSE(read_ref(chrona_dir, name, id));
+    return id;
+  };
+
+  // One stale expectation fails the whole transaction
+  RefTransaction stale(chrona_dir);
+  stale.create("refs/heads/new", two);
+  stale.update("refs/heads/main", two, two);
+  auto error = stale.commit();
+  REQUIRE(error.has_value());
+  REQUIRE(error->error_code == ErrorCode::Conflict);
+  REQUIRE(value("refs/heads/main") == one);
+  REQUIRE_FALSE(value("refs/heads/new"));
+  REQUIRE_FALSE(std::filesystem::exists(chrona_dir / "refs/heads/new.lock"));
+
+  RefTransaction both(chrona_dir);
+  both.create("refs/heads/new", two);
+  both.update("refs/heads/main", two, one);
+  REQUIRE_FALSE(both.commit());
+  REQUIRE(value("refs/heads/main") == two);
+  REQUIRE(value("refs/heads/new") == two);
+
+  // A held lock makes writers give up after the timeout
+  {
+    LockFile held;
+    REQUIRE_FALSE(LockFile::acquire(chrona_dir / "refs/heads/main",
+                                    std::chrono::milliseconds(0), held));
+    error = write_ref(chrona_dir, "refs/heads/main", one);
+    REQUIRE(error.has_value());
+    REQUIRE(error->error_code == ErrorCode::Locked);
+  }
+  REQUIRE_FALSE(write_ref(chrona_dir, "refs/heads/main", one));
+
+  // Names that would need a file and a directory at the same path
+  error = write_ref(chrona_dir, "refs/heads/new/x", one);
+  REQUIRE(error.has_value());
+  REQUIRE(error->error_code == ErrorCode::Conflict);
+  error = write_ref(chrona_dir, "refs/heads", one);
+  REQUIRE(error.has_value());
+  REQUIRE(error->error_code == ErrorCode::Conflict);
+
+  RefTransaction twice(chrona_dir);
+  twice.update("refs/heads/main", one);
+  twice.remove("refs/heads/main");
+  error = twice.commit();
+  REQUIRE(error.has_value());
+  REQUIRE(error->error_code == ErrorCode::InvalidArgument);
+}
+
+TEST_CASE("ref transactions - concurrent compare-and-swap loses nothing",
+          "[refs]") {
+  test::ScratchDir dir("ref-cas");
+  REQUIRE_FALSE(init_repo(dir.path()));
+  auto chrona_dir = dir.path() / ".chrona";
+  const std::string name = "refs/heads/shared";
+  auto next = [](const ObjectId &id) {
+    return hash_object(ObjectType::Commit, id.hex());
+  };
+  auto start = hash_object(ObjectType::Commit, "start");
+  REQUIRE_FALSE(write_ref(chrona_dir, name, start));
+
+  // Each thread advances the shared ref along one chain of ids; an update
+  // that lost a race retries from the new value
+  constexpr int threads = 4;
+  constexpr int steps = 25;
+  std::vector<std::thread> workers;
+  std::atomic<int> failures{0};
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&] {
+      for (int done = 0; done < steps;) {
+        std::optional<ObjectId> current;
+        if (read_ref(chrona_dir, name, current) || !current) {
+          ++failures;
+          return;
+        }
+        RefTransaction transaction(chrona_dir);
+        transaction.update(name, next(*current), current);
+        auto error = transaction.commit();
+        if (!error) {
+          ++done;
+        } else if (error->error_code != ErrorCode::Conflict &&
+                   error->error_code != ErrorCode::Locked) {
+          ++failures;
+          return;
+        }
+      }
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  REQUIRE(failures == 0);
+
+  auto expected = start;
+  for (int i = 0; i < threads * steps; ++i) {
+    expected = next(expected);
+  }
+  std::optional<ObjectId> id;
+  REQUIRE_FALSE(read_ref(chrona_dir, name, id));
+  REQUIRE(id == expected);
+}
+
+TEST_CASE("ref transactions - a deleted ref stays deleted under pack_refs",
+          "[refs]") {
+  test::ScratchDir dir("ref-delete-pack");
+  REQUIRE_FALSE(init_repo(dir.path()));
+  auto chrona_dir = dir.path() / ".chrona";
+  auto id = hash_object(ObjectType::Commit, "one");
+
+  // Refs are created and deleted again while another thread keeps packing
+  // them; a pack between the two steps of a delete would bring one back
+  std::atomic<bool> done{false};
+  std::atomic<int> failures{0};
+  std::thread packer([&] {
+    while (!done) {
+      std::size_t packed = 0;
+      auto error = pack_refs(chrona_dir, packed);
+      if (error && error->error_code != ErrorCode::Locked) {
+        ++failures;
+      }
+    }
+  });
+  for (int i = 0; i < 200; ++i) {
+    auto name = "refs/heads/b" + std::to_string(i);
+    RefTransaction create(chrona_dir);
+    create.create(name, id);
+    std::optional<Error> error;
+    while ((error = create.commit()) &&
+           error->error_code == ErrorCode::Locked) {
+      create.create(name, id);
+    }
+    REQUIRE_FALSE(error);
+    RefTransaction remove(chrona_dir);
+    remove.remove(name, id);
+    while ((error = remove.commit()) &&
+           error->error_code == ErrorCode::Locked) {
+      remove.remove(name, id);
+    }
+    REQUIRE_FALSE(error);
+  }
+  done = true;
+  packer.join();
+  REQUIRE(failures == 0);
+
+  std::vector<std::pair<std::string, ObjectId>> refs;
+  REQUIRE_FALSE(list_refs(chrona_dir, refs));
+  REQUIRE(refs.empty());
+}
+
+} // namespace chrona
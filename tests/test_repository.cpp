@@ -0,0 +1,161 @@
+#include "objects/object_store.hpp"
+#include "refs/refs.hpp"
+#include "repo/repo.hpp"
+#include "repo/repository.hpp"
+#include "test_helpers.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <cstdlib>
+#include <fstream>
+
+namespace chrona {
+
+namespace {
+
+// Sets an environment variable for one scope
+class ScopedEnv {
+public:
+  ScopedEnv(const char *name, const std::string &value) : name_(name) {
+    ::setenv(name, value.c_str(), 1);
+  }
+  ~ScopedEnv() { ::unsetenv(name_); }
+
+private:
+  const char *name_;
+};
+
+} // namespace
+
+TEST_CASE("repository - discovery walks up and honours ceilings",
+          "[repository]") {
+  test::ScratchDir dir("repository-discover");
+  REQUIRE_FALSE(init_repo(dir.path()));
+  auto nested = dir.path() / "a" / "b" / "c";
+  std::filesystem::create_directories(nested);
+
+  Repository repo;
+  REQUIRE_FALSE(Repository::discover(nested, repo));
+  REQUIRE(repo.root() == dir.path());
+  REQUIRE(repo.chrona_dir() == dir.path() / ".chrona");
+  REQUIRE(repo.cwd() == nested);
+
+  // A file called .chrona is not a repository
+  { std::ofstream(nested / ".chrona") << "x"; }
+  REQUIRE(find_repo(nested / "..") == dir.path());
+  REQUIRE(find_repo(nested) == dir.path());
+  REQUIRE(find_repo(dir.path() / "a" / "b" / "", {dir.path() / "a"}) ==
+          std::nullopt);
+
+  {
+    ScopedEnv ceiling("CHRONA_CEILING_DIRECTORIES",
+                      "relative:" + (dir.path() / "a").string() + "/");
+    auto error = Repository::discover(nested, repo);
+    REQUIRE(error.has_value());
+    REQUIRE(error->error_code == ErrorCode::NotFound);
+  }
+  {
+    // The start directory itself is always checked
+    ScopedEnv ceiling("CHRONA_CEILING_DIRECTORIES", dir.path().string());
+    REQUIRE_FALSE(Repository::discover(dir.path(), repo));
+  }
+}
+
+TEST_CASE("repository - CHRONA_DIR skips discovery", "[repository]") {
+  test::ScratchDir dir("repository-env");
+  REQUIRE_FALSE(init_repo(dir.path() / "work"));
+  std::filesystem::create_directories(dir.path() / "elsewhere");
+
+  Repository repo;
+  {
+    ScopedEnv env("CHRONA_DIR", (dir.path() / "work" / ".chrona").string());
+    REQUIRE_FALSE(Repository::discover(dir.path() / "elsewhere", repo));
+    REQUIRE(repo.root() == dir.path() / "work");
+  }
+  {
+    ScopedEnv env("CHRONA_DIR", (dir.path() / "work").string());
+    auto error = Repository::discover(dir.path(), repo);
+    REQUIRE(error.has_value());
+    REQUIRE(error->error_code == ErrorCode::InvalidArgument);
+  }
+  {
+    ScopedEnv env("CHRONA_DIR", "missing/.chrona");
+    auto error = Repository::discover(dir.path(), repo);
+    REQUIRE(error.has_value());
+    REQUIRE(error->error_code == ErrorCode::NotFound);
+  }
+}
+
+TEST_CASE("repository - lazily opened handles", "[repository]") {
+  test::ScratchDir dir("repository-handles");
+  REQUIRE_FALSE(init_repo(dir.path()));
+  Repository repo;
+  REQUIRE_FALSE(Repository::open(dir.path(), repo));
+
+  const RepoConfig *config = nullptr;
+  REQUIRE_FALSE(repo.config(config));
+  REQUIRE(config->get("version") == "1");
+  REQUIRE_FALSE(config->get("missing"));
+
+  std::string head;
+  REQUIRE_FALSE(repo.head(head));
+  REQUIRE(head == default_branch_ref);
+
+  auto &store = repo.objects();
+  REQUIRE(&store == &repo.objects());
+  ObjectId first;
+  REQUIRE_FALSE(store.write(ObjectType::Commit, "first", first));
+  REQUIRE_FALSE(repo.update_ref(head, first, std::nullopt));
+
+  ObjectId resolved;
+  REQUIRE_FALSE(repo.resolve("HEAD", resolved));
+  REQUIRE(resolved == first);
+
+  // Updates through the context are seen; the memoised answer is not
+  // re-read behind its back
+  ObjectId second;
+  REQUIRE_FALSE(store.write(ObjectType::Commit, "second", second));
+  REQUIRE_FALSE(repo.update_ref(head, second, first));
+  REQUIRE_FALSE(repo.resolve("HEAD", resolved));
+  REQUIRE(resolved == second);
+  REQUIRE_FALSE(write_ref(repo.chrona_dir(), head, first));
+  REQUIRE_FALSE(repo.resolve("HEAD", resolved));
+  REQUIRE(resolved == second);
+}
+
+TEST_CASE("repository - config parsing", "[repository]") {
+  RepoConfig config;
+  REQUIRE_FALSE(RepoConfig::parse("# comment\n\n version = 1 \r\n"
+                                  "core.compression=fast\nempty =\n",
+                                  config));
+  REQUIRE(config.get("version") == "1");
+  REQUIRE(config.get("core.compression") == "fast");
+  REQUIRE(config.get("empty") == "");
+
+  auto error = RepoConfig::parse("version = 1\nno equals sign\n", config);
+  REQUIRE(error.has_value());
+  REQUIRE(error->error_code == ErrorCode::InvalidArgument);
+  REQUIRE(error->message.find("line 2") != std::string::npos);
+}
+
+TEST_CASE("repository - chunking settings", "[repository]") {
+  RepoConfig config;
+  ChunkingOptions options;
+  REQUIRE_FALSE(RepoConfig::parse("", config));
+  REQUIRE_FALSE(read_chunking(config, options));
+  REQUIRE(options.min_blob_size == 0);
+
+  REQUIRE_FALSE(RepoConfig::parse(
+      "chunking.min-size = 1048576\nchunking.average-size = 16384\n",
+      config));
+  REQUIRE_FALSE(read_chunking(config, options));
+  REQUIRE(options.min_blob_size == 1048576);
+  REQUIRE(options.average_size == 16384);
+
+  for (const char *bad : {"chunking.average-size = 10000\n",
+                          "chunking.min-size = 1000\n",
+                          "chunking.min-size = lots\n"}) {
+    REQUIRE_FALSE(RepoConfig::parse(bad, config));
+    REQUIRE(read_chunking(config, options).has_value());
+  }
+}
+
+} // namespace chrona
@@ -0,0 +1,139 @@
+#include "objects/object_store.hpp"
+#include "snapshot/tree.hpp"
+#include "snapshot/tree_builder.hpp"
+#include "test_helpers.hpp"
+#include <catch2/catch_test_macros.hpp>
+
+namespace chrona {
+
+TEST_CASE("encode_tree - sorted and round trips", "[snapshot]") {
+  std::vector<TreeEntry> entries = {
+      {"b.txt", EntryMode::Regular, hash_object(ObjectType::Blob, "b")},
+      {"a", EntryMode::Directory, hash_object(ObjectType::Tree, "")},
+      {"run.sh", EntryMode::Executable, hash_object(ObjectType::Blob, "x")},
+  };
+  auto encoded = encode_tree(entries);
+
+  std::vector<TreeEntry> decoded;
+  REQUIRE_FALSE(decode_tree(encoded, decoded));
+  REQUIRE(decoded.size() == 3);
+  REQUIRE(decoded[0].name == "a");
+  REQUIRE(decoded[0].mode == EntryMode::Directory);
+  REQUIRE(decoded[1].name == "b.txt");
+  REQUIRE(decoded[2].id == entries[2].id);
+
+  std::reverse(entries.begin(), entries.end());
+  REQUIRE(encode_tree(entries) == encoded);
+}
+
+TEST_CASE("parse_tree - views point into the encoded tree", "[snapshot]") {
+  auto blob = hash_object(ObjectType::Blob, "x");
+  auto encoded = encode_tree({{"z.txt", EntryMode::Regular, blob},
+                              {"lib", EntryMode::Directory, blob},
+                              {"link", EntryMode::Symlink, blob}});
+  Arena arena;
+  TreeView tree;
+  REQUIRE_FALSE(parse_tree(encoded, arena, tree));
+  REQUIRE(tree.entries.size() == 3);
+  REQUIRE(tree.entries[0].name == "lib");
+  REQUIRE(tree.entries[0].name.data() > encoded.data());
+  REQUIRE(tree.entries[0].name.data() < encoded.data() + encoded.size());
+  REQUIRE(tree.entries[2].id() == blob);
+
+  REQUIRE(tree.find("link") == &tree.entries[1]);
+  REQUIRE(tree.find("missing") == nullptr);
+
+  REQUIRE_FALSE(parse_tree("", arena, tree));
+  REQUIRE(tree.entries.empty());
+  REQUIRE(parse_tree(encoded.substr(0, encoded.size() - 1), arena, tree)
+              .has_value());
+}
+
+TEST_CASE("decode_tree - rejects malformed input", "[snapshot]") {
+  std::vector<TreeEntry> decoded;
+  REQUIRE(decode_tree("100644 name", decoded).has_value());
+  REQUIRE(decode_tree(std::string("777 x\0", 6) + std::string(32, 'a'),
+                      decoded)
+              .has_value());
+}
+
+TEST_CASE("build_snapshot - identity is independent of threads",
+          "[snapshot]") {
+  test::ScratchDir dir("snapshot");
+  auto work = dir.path() / "work";
+  for (int d = 0; d < 5; ++d) {
+    for (int f = 0; f < 40; ++f) {
+      test::write(work / ("dir" + std::to_string(d)) / "nested" /
+                      ("file" + std::to_string(f) + ".txt"),
+                  "contents " + std::to_string(d * 100 + f));
+    }
+  }
+  test::write(work / "top.txt", "top");
+  std::filesystem::create_directories(work / "empty" / "deeper");
+  std::filesystem::create_directories(work / ".chrona" / "objects");
+  test::write(work / ".chrona" / "ignored", "not part of the snapshot");
+
+  ObjectStore store(dir.path() / "objects");
+  std::filesystem::create_directories(store.root());
+
+  SnapshotResult single;
+  {
+    WorkPool pool(1);
+    REQUIRE_FALSE(build_snapshot(work, store, pool, single));
+  }
+  SnapshotResult many;
+  {
+    WorkPool pool(8);
+    SnapshotOptions options;
+    options.files_per_task = 3;
+    REQUIRE_FALSE(build_snapshot(work, store, pool, many, options));
+  }
+
+  REQUIRE(single.root == many.root);
+  REQUIRE(single.files == 201);
+  REQUIRE(many.files == 201);
+
+  ObjectView root;
+  REQUIRE_FALSE(store.read(single.root, root));
+  std::vector<TreeEntry> entries;
+  REQUIRE_FALSE(decode_tree(root.content(), entries));
+  REQUIRE(entries.size() == 6); // dir0..dir4 + top.txt, no empty/.chrona
+  REQUIRE(entries.back().name == "top.txt");
+  REQUIRE(store.contains(hash_object(ObjectType::Blob, "contents 412")));
+
+  SECTION("content changes change the root id") {
+    test::write(work / "dir3" / "nested" / "file7.txt", "edited");
+    WorkPool pool(4);
+    SnapshotResult edited;
+    REQUIRE_FALSE(build_snapshot(work, store, pool, edited));
+    REQUIRE(edited.root != single.root);
+  }
+}
+
+TEST_CASE("build_snapshot - modes and symlinks", "[snapshot]") {
+  test::ScratchDir dir("modes");
+  auto work = dir.path() / "work";
+  test::write(work / "script.sh", "#!/bin/sh\n");
+  std::filesystem::permissions(work / "script.sh",
+                               std::filesystem::perms::owner_exec,
+                               std::filesystem::perm_options::add);
+  std::filesystem::create_symlink("script.sh", work / "link");
+
+  ObjectStore store(dir.path() / "objects");
+  std::filesystem::create_directories(store.root());
+  WorkPool pool(2);
+  SnapshotResult result;
+  REQUIRE_FALSE(build_snapshot(work, store, pool, result));
+
+  ObjectView root;
+  REQUIRE_FALSE(store.read(result.root, root));
+  std::vector<TreeEntry> entries;
+  REQUIRE_FALSE(decode_tree(root.content(), entries));
+  REQUIRE(entries.size() == 2);
+  REQUIRE(entries[0].name == "link");
+  REQUIRE(entries[0].mode == EntryMode::Symlink);
+  REQUIRE(entries[0].id == hash_object(ObjectType::Blob, "script.sh"));
+  REQUIRE(entries[1].mode == EntryMode::Executable);
+}
+
+} // namespace chrona
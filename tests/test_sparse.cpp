@@ -0,0 +1,182 @@
+#include "checkout/checkout.hpp"
+#include "index/index.hpp"
+#include "snapshot/tree_builder.hpp"
+#include "sparse/sparse.hpp"
+#include "status/status.hpp"
+#include "test_helpers.hpp"
+#include <catch2/catch_test_macros.hpp>
+
+namespace chrona {
+
+namespace {
+
+SparseCone cone_of(const std::vector<std::string> &dirs) {
+  SparseCone cone;
+  REQUIRE_FALSE(SparseCone::parse(dirs, cone));
+  return cone;
+}
+
+std::vector<std::string> paths(const std::vector<IndexEntry> &entries) {
+  std::vector<std::string> out;
+  for (const auto &entry : entries) {
+    out.push_back(entry.path +
+                  (entry.stat.mode == EntryMode::Directory ? "/" : ""));
+  }
+  return out;
+}
+
+} // namespace
+
+TEST_CASE("sparse - cone patterns", "[sparse]") {
+  using Match = SparseCone::Match;
+  auto cone = cone_of({"src/lib/", "src/lib/core", "docs", "docs"});
+  REQUIRE(cone.enabled());
+  REQUIRE(cone.dirs() == std::vector<std::string>{"docs", "src/lib"});
+
+  REQUIRE(cone.match_dir("") == Match::Parent);
+  REQUIRE(cone.match_dir("src") == Match::Parent);
+  REQUIRE(cone.match_dir("src/lib") == Match::Inside);
+  REQUIRE(cone.match_dir("src/lib/core/x") == Match::Inside);
+  REQUIRE(cone.match_dir("src/libs") == Match::Outside);
+  REQUIRE(cone.match_dir("src/app") == Match::Outside);
+  REQUIRE(cone.match_dir("doc") == Match::Outside);
+
+  REQUIRE(cone.includes("README"));
+  REQUIRE(cone.includes("src/main.c"));
+  REQUIRE(cone.includes("docs/a/b.md"));
+  REQUIRE_FALSE(cone.includes("src/app/main.c"));
+
+  REQUIRE(SparseCone().match_dir("anything") == Match::Inside);
+  SparseCone bad;
+  REQUIRE(SparseCone::parse({"a/../b"}, bad));
+  REQUIRE(SparseCone::parse({""}, bad));
+
+  test::ScratchDir dir("sparse-cone");
+  REQUIRE_FALSE(cone.save(dir.path()));
+  SparseCone loaded;
+  REQUIRE_FALSE(SparseCone::load(dir.path(), loaded));
+  REQUIRE(loaded.dirs() == cone.dirs());
+  REQUIRE_FALSE(SparseCone().save(dir.path()));
+  REQUIRE_FALSE(SparseCone::load(dir.path(), loaded));
+  REQUIRE_FALSE(loaded.enabled());
+}
+
+TEST_CASE("sparse - checkout narrows and widens the working tree",
+          "[sparse]") {
+  test::ScratchDir dir("sparse");
+  auto root = dir.path() / "work";
+  auto chrona_dir = root / ".chrona";
+  std::filesystem::create_directories(chrona_dir / "objects");
+  ObjectStore store(chrona_dir / "objects");
+  WorkPool pool(2);
+
+  auto source = dir.path() / "source";
+  test::write(source / "top.txt", "top\n");
+  test::write(source / "src" / "main.c", "main\n");
+  test::write(source / "src" / "lib" / "a.c", "a\n");
+  test::write(source / "src" / "lib" / "deep" / "b.c", "b\n");
+  test::write(source / "src" / "app" / "c.c", "c\n");
+  test::write(source / "docs" / "d.md", "d\n");
+  SnapshotResult snapshot;
+  REQUIRE_FALSE(build_snapshot(source, store, pool, snapshot));
+  auto tree = snapshot.root;
+
+  std::vector<IndexEntry> files;
+  auto cone = cone_of({"src/lib"});
+  REQUIRE_FALSE(read_tree_files(store, tree, files, &cone));
+  REQUIRE(paths(files) == std::vector<std::string>{
+                              "docs/", "src/app/", "src/lib/a.c",
+                              "src/lib/deep/b.c", "src/main.c", "top.txt"});
+
+  CheckoutResult result;
+  REQUIRE_FALSE(
+      checkout_tree(root, store, pool, tree, std::nullopt, result));
+  REQUIRE(result.written == 6);
+
+  // Narrowing removes what left the cone and keeps each subtree's id
+  CheckoutOptions options;
+  options.cone = cone;
+  REQUIRE_FALSE(checkout_tree(root, store, pool, tree, tree, result, options));
+  REQUIRE(result.removed == 2);
+  REQUIRE(result.written == 0);
+  REQUIRE_FALSE(std::filesystem::exists(root / "docs"));
+  REQUIRE_FALSE(std::filesystem::exists(root / "src" / "app"));
+  REQUIRE(std::filesystem::exists(root / "src" / "lib" / "deep" / "b.c"));
+
+  IndexView index;
+  REQUIRE_FALSE(IndexView::open(chrona_dir / "index", index));
+  REQUIRE(index.size() == 6);
+  auto docs = index.find("docs");
+  REQUIRE(docs);
+  REQUIRE(index.is_sparse_dir(*docs));
+
+  // The index still describes the whole tree
+  ObjectBatch batch(store);
+  ObjectId written;
+  REQUIRE_FALSE(write_index_tree(index, batch, written));
+  REQUIRE_FALSE(batch.commit());
+  REQUIRE(written == tree);
+
+  // Status neither reports nor looks into sparse directories
+  test::write(root / "docs" / "stray.md", "stray\n");
+  test::write(root / "src" / "new.c", "new\n");
+  StatusResult status;
+  REQUIRE_FALSE(compute_status(root, index, pool, status));
+  REQUIRE(status.changes.size() == 1);
+  REQUIRE(status.changes[0].path == "src/new.c");
+  REQUIRE(status.changes[0].kind == ChangeKind::Untracked);
+
+  // A snapshot with the index as its stat cache keeps the staged trees of
+  // sparse directories, whatever is on disk there
+  test::write(root / "src" / "app" / "stray.c", "stray\n");
+  std::filesystem::remove(root / "src" / "new.c");
+  std::vector<IndexEntry> collected;
+  SnapshotOptions snapshot_options;
+  snapshot_options.stat_cache = &index;
+  snapshot_options.collect = &collected;
+  REQUIRE_FALSE(
+      build_snapshot(root, store, pool, snapshot, snapshot_options));
+  REQUIRE(snapshot.root == tree);
+  REQUIRE(collected.size() == 4);
+  std::filesystem::remove_all(root / "docs");
+  std::filesystem::remove_all(root / "src" / "app");
+
+  // Widening writes the files back
+  options.cone = SparseCone();
+  REQUIRE_FALSE(checkout_tree(root, store, pool, tree, tree, result, options));
+  REQUIRE(result.written == 2);
+  REQUIRE(result.removed == 0);
+  REQUIRE(std::filesystem::exists(root / "docs" / "d.md"));
+  REQUIRE(std::filesystem::exists(root / "src" / "app" / "c.c"));
+  REQUIRE_FALSE(IndexView::open(chrona_dir / "index", index));
+  REQUIRE(index.size() == 6);
+  REQUIRE_FALSE(index.is_sparse_dir(*index.find("docs/d.md")));
+}
+
+TEST_CASE("sparse - checkout refuses to drop local work", "[sparse]") {
+  test::ScratchDir dir("sparse-guard");
+  auto root = dir.path() / "work";
+  std::filesystem::create_directories(root / ".chrona" / "objects");
+  ObjectStore store(root / ".chrona" / "objects");
+  WorkPool pool(2);
+
+  auto source = dir.path() / "source";
+  test::write(source / "keep" / "a.txt", "a\n");
+  test::write(source / "drop" / "b.txt", "b\n");
+  SnapshotResult snapshot;
+  REQUIRE_FALSE(build_snapshot(source, store, pool, snapshot));
+  CheckoutResult result;
+  REQUIRE_FALSE(checkout_tree(root, store, pool, snapshot.root, std::nullopt,
+                              result));
+
+  test::write(root / "drop" / "b.txt", "changed\n");
+  CheckoutOptions options;
+  options.cone = cone_of({"keep"});
+  auto error = checkout_tree(root, store, pool, snapshot.root, snapshot.root,
+                             result, options);
+  REQUIRE(error);
+  REQUIRE(error->error_code == ErrorCode::AlreadyExists);
+  REQUIRE(std::filesystem::exists(root / "drop" / "b.txt"));
+}
+
+} // namespace chrona
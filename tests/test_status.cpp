@@ -0,0 +1,120 @@
+#include "index/index.hpp"
+#include "snapshot/tree_builder.hpp"
+#include "status/status.hpp"
+#include "test_helpers.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <fstream>
+
+namespace chrona {
+
+namespace {
+
+void write(const std::filesystem::path &path, const std::string &contents) {
+  std::filesystem::create_directories(path.parent_path());
+  std::ofstream(path, std::ios::binary) << contents;
+  // Keep files out of the racy window so the stat cache is trusted
+  std::filesystem::last_write_time(
+      path, std::filesystem::file_time_type::clock::now() -
+                std::chrono::hours(1));
+}
+
+struct Fixture {
+  test::ScratchDir dir{"status"};
+  std::filesystem::path work = dir.path() / "work";
+  std::filesystem::path index_path = dir.path() / "index";
+  ObjectStore store{dir.path() / "objects"};
+  WorkPool pool{4};
+
+  Fixture() {
+    std::filesystem::create_directories(store.root());
+    write(work / "a.txt", "alpha");
+    write(work / "src" / "main.cpp", "int main() {}");
+    write(work / "src" / "util.cpp", "// util");
+  }
+
+  void stage() {
+    std::vector<IndexEntry> entries;
+    SnapshotOptions options;
+    options.collect = &entries;
+    SnapshotResult result;
+    REQUIRE_FALSE(build_snapshot(work, store, pool, result, options));
+    REQUIRE_FALSE(write_index(index_path, std::move(entries)));
+  }
+
+  StatusResult status() {
+    IndexView index;
+    REQUIRE_FALSE(IndexView::open(index_path, index));
+    StatusResult result;
+    REQUIRE_FALSE(compute_status(work, index, pool, result, {true, 1}));
+    return result;
+  }
+};
+
+} // namespace
+
+TEST_CASE("compute_status - clean tree skips hashing", "[status]") {
+  Fixture fixture;
+  fixture.stage();
+
+  auto result = fixture.status();
+  REQUIRE(result.changes.empty());
+  REQUIRE(result.checked == 3);
+  REQUIRE(result.rehashed == 0);
+}
+
+TEST_CASE("compute_status - reports each kind of change", "[status]") {
+  Fixture fixture;
+  fixture.stage();
+
+  write(fixture.work / "a.txt", "ALPHA");
+  std::filesystem::remove(fixture.work / "src" / "util.cpp");
+  write(fixture.work / "new.txt", "new");
+  write(fixture.work / "src" / "extra.cpp", "extra");
+  write(fixture.work / "docs" / "guide.md", "guide");
+
+  auto result = fixture.status();
+  REQUIRE(result.changes.size() == 5);
+  REQUIRE(result.changes[0].path == "a.txt");
+  REQUIRE(result.changes[0].kind == ChangeKind::Modified);
+  REQUIRE(result.changes[1].path == "docs/");
+  REQUIRE(result.changes[1].kind == ChangeKind::Untracked);
+  REQUIRE(result.changes[2].path == "new.txt");
+  REQUIRE(result.changes[3].path == "src/extra.cpp");
+  REQUIRE(result.changes[3].kind == ChangeKind::Untracked);
+  REQUIRE(result.changes[4].path == "src/util.cpp");
+  REQUIRE(result.changes[4].kind == ChangeKind::Deleted);
+}
+
+TEST_CASE("compute_status - touched but unchanged files are refreshed",
+          "[status]") {
+  Fixture fixture;
+  fixture.stage();
+
+  std::filesystem::last_write_time(
+      fixture.work / "a.txt", std::filesystem::file_time_type::clock::now() -
+                                  std::chrono::minutes(5));
+
+  auto result = fixture.status();
+  REQUIRE(result.changes.empty());
+  REQUIRE(result.rehashed == 1);
+  REQUIRE(result.refreshed.size() == 1);
+  REQUIRE(result.refreshed[0].path == "a.txt");
+}
+
+TEST_CASE("build_snapshot - stat cache avoids rehashing", "[status]") {
+  Fixture fixture;
+  fixture.stage();
+
+  IndexView index;
+  REQUIRE_FALSE(IndexView::open(fixture.index_path, index));
+  SnapshotOptions options;
+  options.stat_cache = &index;
+  SnapshotResult result;
+  REQUIRE_FALSE(build_snapshot(fixture.work, fixture.store, fixture.pool,
+                               result, options));
+  REQUIRE(result.files == 3);
+  REQUIRE(result.hashed == 0);
+}
+
+} // namespace chrona
@@ -0,0 +1,58 @@
+#include "hash/sha256.hpp"
+#include "objects/object_store.hpp"
+#include "parallel/work_pool.hpp"
+#include "test_helpers.hpp"
+#include "trace/trace.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <fstream>
+#include <sstream>
+
+namespace chrona {
+
+TEST_CASE("trace - probes are inert while tracing is off", "[trace]") {
+  discard_trace();
+  trace_count(TraceCounter::StatCalls, 5);
+  {
+    CHRONA_TRACE_SCOPE("ignored");
+  }
+  REQUIRE(trace_total(TraceCounter::StatCalls) == 0);
+  finish_trace(); // no output, nothing to do
+}
+
+TEST_CASE("trace - counters merge across threads", "[trace]") {
+  discard_trace();
+  test::ScratchDir dir("trace");
+  auto json = dir.path() / "trace.json";
+  start_trace(json.string());
+
+  WorkPool pool(4);
+  pool.parallel_for(1000, 10, [](std::size_t begin, std::size_t end) {
+    CHRONA_TRACE_SCOPE("chunk");
+    trace_count(TraceCounter::StatCalls, end - begin);
+  });
+  REQUIRE(trace_total(TraceCounter::StatCalls) == 1000);
+
+  std::filesystem::create_directories(dir.path() / "objects");
+  ObjectStore store(dir.path() / "objects");
+  ObjectId id;
+  REQUIRE_FALSE(store.write(ObjectType::Blob, "traced", id));
+  ObjectView view;
+  REQUIRE_FALSE(store.read(id, view));
+  REQUIRE(trace_total(TraceCounter::ObjectsWritten) == 1);
+  REQUIRE(trace_total(TraceCounter::ObjectsRead) == 1);
+  REQUIRE(trace_total(TraceCounter::BytesHashed) >= 6);
+  REQUIRE(trace_total(TraceCounter::Syscalls) > 0);
+
+  finish_trace();
+  REQUIRE_FALSE(trace_enabled());
+  std::ifstream in(json);
+  std::stringstream contents;
+  contents << in.rdbuf();
+  auto text = contents.str();
+  REQUIRE(text.rfind("{\"traceEvents\":[", 0) == 0);
+  REQUIRE(text.find("\"name\":\"chunk\",\"ph\":\"X\"") != std::string::npos);
+  REQUIRE(text.find("\"stat_calls\":1000") != std::string::npos);
+  discard_trace();
+}
+
+} // namespace chrona